@@ -204,6 +204,9 @@ typedef struct {
     OI_UINT8 restrictSubbands;
     OI_UINT8 enhancedEnabled;
     OI_UINT8 bufferedBlocks;
+/* BK4BTSTACK_CHANGE START */
+    OI_UINT8 simdLevel;                     /* OI_CODEC_SBC_SIMD_*, set by OI_CODEC_SBC_DecoderReset() */
+/* BK4BTSTACK_CHANGE END */
 } OI_CODEC_SBC_DECODER_CONTEXT;
 
 typedef struct {
@@ -246,6 +249,24 @@ OI_STATUS OI_CODEC_SBC_DecoderReset(OI_CODEC_SBC_DECODER_CONTEXT *context,
 OI_STATUS OI_CODEC_mSBC_DecoderReset(OI_CODEC_SBC_DECODER_CONTEXT *context,
                                     OI_UINT32 *decoderData,
                                     OI_UINT32 decoderDataBytes);
+
+#define OI_CODEC_SBC_SIMD_NONE  0
+#define OI_CODEC_SBC_SIMD_SSE2  1
+#define OI_CODEC_SBC_SIMD_AVX2  2
+#define OI_CODEC_SBC_SIMD_NEON  3
+
+/**
+ * This function selects the SIMD kernels used for 8-subband synthesis by
+ * decoders reset afterwards. By default, the fastest kernels supported by
+ * the CPU are used. All kernels produce bit-exact output.
+ *
+ * @param level     One of the OI_CODEC_SBC_SIMD_* values,
+ *                  OI_CODEC_SBC_SIMD_NONE selects the C code.
+ *
+ * @return          The selected level, which is the best one available if
+ *                  the requested level is not supported.
+ */
+OI_UINT8 OI_CODEC_SBC_SetSimdLevel(OI_UINT8 level);
 /* BK4BTSTACK_CHANGE END */
 
 /**
@@ -133,6 +133,19 @@ typedef struct {
 #define DCTIII_8_SHIFT_IN 3
 #define DCTIII_8_SHIFT_OUT 14
 
+/* BK4BTSTACK_CHANGE START */
+/* Set SBC_USE_SIMD to FALSE to disable the SSE2/AVX2 (x86) and NEON (ARM) kernels for 8-subband synthesis */
+#ifndef SBC_USE_SIMD
+#define SBC_USE_SIMD TRUE
+#endif
+
+#if (SBC_USE_SIMD == TRUE) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define SBC_SYNTH_SIMD_X86
+#elif (SBC_USE_SIMD == TRUE) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#define SBC_SYNTH_SIMD_ARM
+#endif
+/* BK4BTSTACK_CHANGE END */
+
 OI_UINT computeBitneed(OI_CODEC_SBC_COMMON_CONTEXT *common,
                               OI_UINT8 *bitneeds,
                               OI_UINT ch,
@@ -192,6 +205,19 @@ PRIVATE void shift_buffer(SBC_BUFFER_T *dest, SBC_BUFFER_T *src, OI_UINT wordCou
 PRIVATE void cosineModulateSynth4(SBC_BUFFER_T * RESTRICT out, OI_INT32 const * RESTRICT in);
 PRIVATE void SynthWindow40_int32_int32_symmetry_with_sum(OI_INT16 *pcm, SBC_BUFFER_T buffer[80], OI_UINT strideShift);
 
+/* BK4BTSTACK_CHANGE START */
+/* DCTs of count blocks, block i reads in + i * inStride and writes out - 8 * i */
+PRIVATE void dct2_8_batch(SBC_BUFFER_T *out, OI_INT32 const *in, OI_UINT inStride, OI_UINT count);
+#ifdef SBC_SYNTH_SIMD_X86
+PRIVATE void dct2_8_batch_SSE2(SBC_BUFFER_T *out, OI_INT32 const *in, OI_UINT inStride, OI_UINT count);
+PRIVATE void dct2_8_batch_AVX2(SBC_BUFFER_T *out, OI_INT32 const *in, OI_UINT inStride, OI_UINT count);
+#endif
+#ifdef SBC_SYNTH_SIMD_ARM
+PRIVATE void dct2_8_batch_NEON(SBC_BUFFER_T *out, OI_INT32 const *in, OI_UINT inStride, OI_UINT count);
+#endif
+PRIVATE OI_UINT8 OI_SBC_SynthSimdLevel(void);
+/* BK4BTSTACK_CHANGE END */
+
 INLINE void dct3_4(OI_INT32 * RESTRICT out, OI_INT32 const * RESTRICT in);
 PRIVATE void analyze4_generated(SBC_BUFFER_T analysisBuffer[RESTRICT 40],
                                 OI_INT16 *pcm,
@@ -71,6 +71,9 @@ INLINE OI_STATUS internal_DecoderReset(OI_CODEC_SBC_DECODER_CONTEXT *context,
     context->common.codecInfo = OI_Codec_Copyright;
     context->common.maxBitneed = 0;
     context->limitFrameFormat = FALSE;
+    /* BK4BTSTACK_CHANGE START */
+    context->simdLevel = OI_SBC_SynthSimdLevel();
+    /* BK4BTSTACK_CHANGE END */
     OI_SBC_ExpandFrameFields(&context->common.frameInfo);
 
     /*PLATFORM_DECODER_RESET(context);*/
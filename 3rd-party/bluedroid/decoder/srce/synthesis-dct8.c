@@ -36,6 +36,15 @@
 
 #include "oi_codec_sbc_private.h"
 
+/* BK4BTSTACK_CHANGE START */
+#ifdef SBC_SYNTH_SIMD_X86
+#include <immintrin.h>
+#endif
+#ifdef SBC_SYNTH_SIMD_ARM
+#include <arm_neon.h>
+#endif
+/* BK4BTSTACK_CHANGE END */
+
 #define AAN_C4_FIX (759250125)/* S1.30  759250125   0.707107*/
 
 #define AAN_C6_FIX (410903207)/* S1.30  410903207   0.382683*/
@@ -304,4 +313,309 @@ PRIVATE void dct2_8(SBC_BUFFER_T * RESTRICT out, OI_INT32 const *RESTRICT in)
 #endif
 }
 
+/* BK4BTSTACK_CHANGE START */
+
+PRIVATE void dct2_8_batch(SBC_BUFFER_T *out, OI_INT32 const *in, OI_UINT inStride, OI_UINT count)
+{
+    for (; count > 0; count--) {
+        dct2_8(out, in);
+        out -= 8;
+        in += inStride;
+    }
+}
+
+#if defined(SBC_SYNTH_SIMD_X86) || defined(SBC_SYNTH_SIMD_ARM)
+
+/*
+ * dct2_8 for one block per SIMD lane. Each step matches the C code above
+ * including the truncating divisions and the wrap-around of 32 bit integer
+ * arithmetic, so the output is bit-exact. The ISA specific code provides
+ * VEC, VADD, VSUB, VSHL, VSRA, VSRL, VSET, FIX_MULT_DCT_VEC and VSCALE_OUT,
+ * where VSCALE_OUT(x, y) must yield SCALE(x, y) truncated to 16 bits.
+ */
+#define DCT_BUTTERFLY_VEC(x, y) x = VADD(x, y); y = VSUB(x, VSHL(y, 1));
+#define DCT_DIV2_VEC(x) VSRA(VADD(x, VSRL(x, 31)), 1)
+
+#define DCT2_8_VEC(out, in)                                          \
+{                                                                   \
+    VEC L00, L01, L02, L03, L04, L05, L06, L07, L25;                 \
+                                                                    \
+    L00 = VADD(in[0], in[7]);                                       \
+    L01 = VADD(in[1], in[6]);                                       \
+    L02 = VADD(in[2], in[5]);                                       \
+    L03 = VADD(in[3], in[4]);                                       \
+                                                                    \
+    L04 = VSUB(in[3], in[4]);                                       \
+    L05 = VSUB(in[2], in[5]);                                       \
+    L06 = VSUB(in[1], in[6]);                                       \
+    L07 = VSUB(in[0], in[7]);                                       \
+                                                                    \
+    DCT_BUTTERFLY_VEC(L00, L03);                                    \
+    DCT_BUTTERFLY_VEC(L01, L02);                                    \
+    L02 = VADD(L02, L03);                                           \
+    L02 = FIX_MULT_DCT_VEC(AAN_C4_FIX, L02);                        \
+    DCT_BUTTERFLY_VEC(L00, L01);                                    \
+    out[0] = VSCALE_OUT(L00, DCTII_8_SHIFT_0);                      \
+    out[4] = VSCALE_OUT(L01, DCTII_8_SHIFT_4);                      \
+                                                                    \
+    DCT_BUTTERFLY_VEC(L03, L02);                                    \
+    out[6] = VSCALE_OUT(L02, DCTII_8_SHIFT_6);                      \
+    out[2] = VSCALE_OUT(L03, DCTII_8_SHIFT_2);                      \
+                                                                    \
+    L04 = VADD(L04, L05);                                           \
+    L05 = VADD(L05, L06);                                           \
+    L06 = VADD(L06, L07);                                           \
+    L04 = DCT_DIV2_VEC(L04);                                        \
+    L05 = DCT_DIV2_VEC(L05);                                        \
+    L06 = DCT_DIV2_VEC(L06);                                        \
+    L07 = DCT_DIV2_VEC(L07);                                        \
+                                                                    \
+    L05 = FIX_MULT_DCT_VEC(AAN_C4_FIX, L05);                        \
+    L25 = FIX_MULT_DCT_VEC(AAN_C6_FIX, VSUB(L06, L04));             \
+    L04 = VSUB(FIX_MULT_DCT_VEC(AAN_Q0_FIX, L04), L25);             \
+    L06 = VSUB(FIX_MULT_DCT_VEC(AAN_Q1_FIX, L06), L25);             \
+                                                                    \
+    DCT_BUTTERFLY_VEC(L07, L05);                                    \
+    DCT_BUTTERFLY_VEC(L05, L04);                                    \
+    out[3] = VSCALE_OUT(L04, DCTII_8_SHIFT_3 - 1);                  \
+    out[5] = VSCALE_OUT(L05, DCTII_8_SHIFT_5 - 1);                  \
+                                                                    \
+    DCT_BUTTERFLY_VEC(L07, L06);                                    \
+    out[7] = VSCALE_OUT(L06, DCTII_8_SHIFT_7 - 1);                  \
+    out[1] = VSCALE_OUT(L07, DCTII_8_SHIFT_1 - 1);                  \
+}
+
+#endif
+
+#ifdef SBC_SYNTH_SIMD_X86
+
+/* the high word of the unsigned product is off by K for negative x, as K > 0 */
+static INLINE __m128i fix_mult_dct_SSE2(OI_INT32 k, __m128i x)
+{
+    const __m128i coeff = _mm_set1_epi32(k);
+    __m128i even = _mm_mul_epu32(x, coeff);
+    __m128i odd  = _mm_mul_epu32(_mm_srli_epi64(x, 32), coeff);
+    __m128i hi = _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(3, 1, 3, 1)),
+                                    _mm_shuffle_epi32(odd,  _MM_SHUFFLE(3, 1, 3, 1)));
+    hi = _mm_sub_epi32(hi, _mm_and_si128(_mm_srai_epi32(x, 31), coeff));
+    return _mm_slli_epi32(hi, 2);
+}
+
+#define DCT_TRANSPOSE4_SSE2(r0, r1, r2, r3)                          \
+{                                                                   \
+    __m128i t0 = _mm_unpacklo_epi32(r0, r1);                        \
+    __m128i t1 = _mm_unpacklo_epi32(r2, r3);                        \
+    __m128i t2 = _mm_unpackhi_epi32(r0, r1);                        \
+    __m128i t3 = _mm_unpackhi_epi32(r2, r3);                        \
+    r0 = _mm_unpacklo_epi64(t0, t1);                                \
+    r1 = _mm_unpackhi_epi64(t0, t1);                                \
+    r2 = _mm_unpacklo_epi64(t2, t3);                                \
+    r3 = _mm_unpackhi_epi64(t2, t3);                                \
+}
+
+#define VEC                     __m128i
+#define VADD(a, b)              _mm_add_epi32(a, b)
+#define VSUB(a, b)              _mm_sub_epi32(a, b)
+#define VSHL(a, n)              _mm_slli_epi32(a, n)
+#define VSRA(a, n)              _mm_srai_epi32(a, n)
+#define VSRL(a, n)              _mm_srli_epi32(a, n)
+#define FIX_MULT_DCT_VEC(k, a)  fix_mult_dct_SSE2(k, a)
+/* keeps bits y..y+15 of the rounded value, sign extended, so that packs does not saturate */
+#define VSCALE_OUT(x, y)        _mm_srai_epi32(_mm_slli_epi32(_mm_add_epi32(x, _mm_set1_epi32(1 << ((y) - 1))), 16 - (y)), 16)
+
+static void dct2_8_x4_SSE2(SBC_BUFFER_T *out, OI_INT32 const *in, OI_UINT inStride)
+{
+    __m128i x[8];
+    __m128i y[8];
+    OI_UINT i;
+
+    for (i = 0; i < 4; i++) {
+        x[i]     = _mm_loadu_si128((const __m128i *)(in + i * inStride));
+        x[i + 4] = _mm_loadu_si128((const __m128i *)(in + i * inStride + 4));
+    }
+    DCT_TRANSPOSE4_SSE2(x[0], x[1], x[2], x[3]);
+    DCT_TRANSPOSE4_SSE2(x[4], x[5], x[6], x[7]);
+    DCT2_8_VEC(y, x);
+    DCT_TRANSPOSE4_SSE2(y[0], y[1], y[2], y[3]);
+    DCT_TRANSPOSE4_SSE2(y[4], y[5], y[6], y[7]);
+    for (i = 0; i < 4; i++) {
+        _mm_storeu_si128((__m128i *)(out - 8 * i), _mm_packs_epi32(y[i], y[i + 4]));
+    }
+}
+
+PRIVATE void dct2_8_batch_SSE2(SBC_BUFFER_T *out, OI_INT32 const *in, OI_UINT inStride, OI_UINT count)
+{
+    for (; count >= 4; count -= 4) {
+        dct2_8_x4_SSE2(out, in, inStride);
+        out -= 4 * 8;
+        in += 4 * inStride;
+    }
+    dct2_8_batch(out, in, inStride, count);
+}
+
+#undef VEC
+#undef VADD
+#undef VSUB
+#undef VSHL
+#undef VSRA
+#undef VSRL
+#undef FIX_MULT_DCT_VEC
+#undef VSCALE_OUT
+
+__attribute__((target("avx2")))
+static INLINE __m256i fix_mult_dct_AVX2(OI_INT32 k, __m256i x)
+{
+    const __m256i coeff = _mm256_set1_epi32(k);
+    __m256i even = _mm256_srli_epi64(_mm256_mul_epi32(x, coeff), 32);
+    __m256i odd  = _mm256_mul_epi32(_mm256_srli_epi64(x, 32), coeff);
+    return _mm256_slli_epi32(_mm256_blend_epi32(even, odd, 0xaa), 2);
+}
+
+/* 4x4 transposes within each 128 bit lane, then the lanes are swapped between r0..3 and r4..7 */
+#define DCT_TRANSPOSE8_AVX2(r)                                       \
+{                                                                   \
+    __m256i t[8];                                                   \
+    for (i = 0; i < 8; i += 4) {                                    \
+        t[i]     = _mm256_unpacklo_epi32(r[i],     r[i + 1]);       \
+        t[i + 1] = _mm256_unpacklo_epi32(r[i + 2], r[i + 3]);       \
+        t[i + 2] = _mm256_unpackhi_epi32(r[i],     r[i + 1]);       \
+        t[i + 3] = _mm256_unpackhi_epi32(r[i + 2], r[i + 3]);       \
+        r[i]     = _mm256_unpacklo_epi64(t[i],     t[i + 1]);       \
+        r[i + 1] = _mm256_unpackhi_epi64(t[i],     t[i + 1]);       \
+        r[i + 2] = _mm256_unpacklo_epi64(t[i + 2], t[i + 3]);       \
+        r[i + 3] = _mm256_unpackhi_epi64(t[i + 2], t[i + 3]);       \
+    }                                                               \
+    for (i = 0; i < 4; i++) {                                       \
+        t[i]     = _mm256_permute2x128_si256(r[i], r[i + 4], 0x20); \
+        t[i + 4] = _mm256_permute2x128_si256(r[i], r[i + 4], 0x31); \
+    }                                                               \
+    for (i = 0; i < 8; i++) {                                       \
+        r[i] = t[i];                                                \
+    }                                                               \
+}
+
+#define VEC                     __m256i
+#define VADD(a, b)              _mm256_add_epi32(a, b)
+#define VSUB(a, b)              _mm256_sub_epi32(a, b)
+#define VSHL(a, n)              _mm256_slli_epi32(a, n)
+#define VSRA(a, n)              _mm256_srai_epi32(a, n)
+#define VSRL(a, n)              _mm256_srli_epi32(a, n)
+#define FIX_MULT_DCT_VEC(k, a)  fix_mult_dct_AVX2(k, a)
+#define VSCALE_OUT(x, y)        _mm256_srai_epi32(_mm256_slli_epi32(_mm256_add_epi32(x, _mm256_set1_epi32(1 << ((y) - 1))), 16 - (y)), 16)
+
+__attribute__((target("avx2")))
+static void dct2_8_x8_AVX2(SBC_BUFFER_T *out, OI_INT32 const *in, OI_UINT inStride)
+{
+    __m256i x[8];
+    __m256i y[8];
+    OI_UINT i;
+
+    for (i = 0; i < 8; i++) {
+        x[i] = _mm256_loadu_si256((const __m256i *)(in + i * inStride));
+    }
+    DCT_TRANSPOSE8_AVX2(x);
+    DCT2_8_VEC(y, x);
+    DCT_TRANSPOSE8_AVX2(y);
+    /* blocks i + 1 and i are adjacent in the filter buffer, in that order */
+    for (i = 0; i < 8; i += 2) {
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(y[i + 1], y[i]), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256((__m256i *)(out - 8 * (i + 1)), packed);
+    }
+}
+
+__attribute__((target("avx2")))
+PRIVATE void dct2_8_batch_AVX2(SBC_BUFFER_T *out, OI_INT32 const *in, OI_UINT inStride, OI_UINT count)
+{
+    for (; count >= 8; count -= 8) {
+        dct2_8_x8_AVX2(out, in, inStride);
+        out -= 8 * 8;
+        in += 8 * inStride;
+    }
+    dct2_8_batch_SSE2(out, in, inStride, count);
+}
+
+#undef VEC
+#undef VADD
+#undef VSUB
+#undef VSHL
+#undef VSRA
+#undef VSRL
+#undef FIX_MULT_DCT_VEC
+#undef VSCALE_OUT
+
+#endif /* SBC_SYNTH_SIMD_X86 */
+
+#ifdef SBC_SYNTH_SIMD_ARM
+
+static INLINE int32x4_t fix_mult_dct_NEON(OI_INT32 k, int32x4_t x)
+{
+    const int32x2_t coeff = vdup_n_s32(k);
+    int32x2_t lo = vshrn_n_s64(vmull_s32(vget_low_s32(x), coeff), 32);
+    int32x2_t hi = vshrn_n_s64(vmull_s32(vget_high_s32(x), coeff), 32);
+    return vshlq_n_s32(vcombine_s32(lo, hi), 2);
+}
+
+#define DCT_TRANSPOSE4_NEON(r0, r1, r2, r3)                          \
+{                                                                   \
+    int32x4x2_t t01 = vtrnq_s32(r0, r1);                            \
+    int32x4x2_t t23 = vtrnq_s32(r2, r3);                            \
+    r0 = vcombine_s32(vget_low_s32(t01.val[0]),  vget_low_s32(t23.val[0]));  \
+    r1 = vcombine_s32(vget_low_s32(t01.val[1]),  vget_low_s32(t23.val[1]));  \
+    r2 = vcombine_s32(vget_high_s32(t01.val[0]), vget_high_s32(t23.val[0])); \
+    r3 = vcombine_s32(vget_high_s32(t01.val[1]), vget_high_s32(t23.val[1])); \
+}
+
+#define VEC                     int32x4_t
+#define VADD(a, b)              vaddq_s32(a, b)
+#define VSUB(a, b)              vsubq_s32(a, b)
+#define VSHL(a, n)              vshlq_n_s32(a, n)
+#define VSRA(a, n)              vshrq_n_s32(a, n)
+#define VSRL(a, n)              vreinterpretq_s32_u32(vshrq_n_u32(vreinterpretq_u32_s32(a), n))
+#define FIX_MULT_DCT_VEC(k, a)  fix_mult_dct_NEON(k, a)
+/* vmovn_s32 truncates to 16 bits */
+#define VSCALE_OUT(x, y)        vshrq_n_s32(vaddq_s32(x, vdupq_n_s32(1 << ((y) - 1))), y)
+
+static void dct2_8_x4_NEON(SBC_BUFFER_T *out, OI_INT32 const *in, OI_UINT inStride)
+{
+    int32x4_t x[8];
+    int32x4_t y[8];
+    OI_UINT i;
+
+    for (i = 0; i < 4; i++) {
+        x[i]     = vld1q_s32(in + i * inStride);
+        x[i + 4] = vld1q_s32(in + i * inStride + 4);
+    }
+    DCT_TRANSPOSE4_NEON(x[0], x[1], x[2], x[3]);
+    DCT_TRANSPOSE4_NEON(x[4], x[5], x[6], x[7]);
+    DCT2_8_VEC(y, x);
+    DCT_TRANSPOSE4_NEON(y[0], y[1], y[2], y[3]);
+    DCT_TRANSPOSE4_NEON(y[4], y[5], y[6], y[7]);
+    for (i = 0; i < 4; i++) {
+        vst1q_s16(out - 8 * i, vcombine_s16(vmovn_s32(y[i]), vmovn_s32(y[i + 4])));
+    }
+}
+
+PRIVATE void dct2_8_batch_NEON(SBC_BUFFER_T *out, OI_INT32 const *in, OI_UINT inStride, OI_UINT count)
+{
+    for (; count >= 4; count -= 4) {
+        dct2_8_x4_NEON(out, in, inStride);
+        out -= 4 * 8;
+        in += 4 * inStride;
+    }
+    dct2_8_batch(out, in, inStride, count);
+}
+
+#undef VEC
+#undef VADD
+#undef VSUB
+#undef VSHL
+#undef VSRA
+#undef VSRL
+#undef FIX_MULT_DCT_VEC
+#undef VSCALE_OUT
+
+#endif /* SBC_SYNTH_SIMD_ARM */
+
+/* BK4BTSTACK_CHANGE END */
+
 /**@}*/
@@ -161,6 +161,20 @@ The output samples X[0..7] are defined as sums of W:
 
 #include "oi_codec_sbc_private.h"
 
+/* BK4BTSTACK_CHANGE START */
+/* the SIMD path replaces DCT2_8 and SYNTH80, so it is not used if the platform provides its own */
+#if defined(DCT2_8) || defined(SYNTH80)
+#undef SBC_SYNTH_SIMD_X86
+#undef SBC_SYNTH_SIMD_ARM
+#endif
+#ifdef SBC_SYNTH_SIMD_X86
+#include <immintrin.h>
+#endif
+#ifdef SBC_SYNTH_SIMD_ARM
+#include <arm_neon.h>
+#endif
+/* BK4BTSTACK_CHANGE END */
+
 const OI_INT32 dec_window_4[21] = {
            0,        /* +0.00000000E+00 */
           97,        /* +5.36548976E-04 */
@@ -256,6 +270,201 @@ typedef void (*SYNTH_FRAME)(OI_CODEC_SBC_DECODER_CONTEXT *context, OI_INT16 *pcm
 #define SYNTH112 SynthWindow112_generated
 #endif
 
+/* BK4BTSTACK_CHANGE START */
+#if defined(SBC_SYNTH_SIMD_X86) || defined(SBC_SYNTH_SIMD_ARM)
+
+/*
+ * SIMD version of SynthWindow80_generated with pcm[k] in lane k. In the r-th group
+ * of 16 filter buffer values, pcm[k] depends on buffer[16 * r + 4 + k] and
+ * buffer[16 * r + 12 - k], which are loaded as one vector each. The tables hold
+ * the coefficients and shifts of the generated code for these vectors. Left shifts
+ * are folded into the coefficients, right shifts are applied to each product
+ * separately to truncate exactly like the generated code does.
+ */
+static const OI_INT32 synth80Coeff[5][2][8] = {
+    { { 0, -3263, -10385, -16457, 10445, -8443, -10337, -6087 },
+      { 8235, 29293, 24995, 19083, 0, 16913, 11167, 9293 } },
+    { { -23167, -5229, -309 * 16, -23641, -5297 * 2, -301 * 32, -30605, -2893 * 8 },
+      { 26479, 30835, 9161, -29015, 0, 3687 * 2, 1917 * 4, 1247 * 8 } },
+    { { -17397 * 2, -27021 * 2, -23063 * 2, -12889 * 4, 22299 * 4, 10255 * 4, 9553 * 4, 18055 * 2 },
+      { 9399 * 8, 31633 * 2, 27561 * 2, 6145 * 8, 0, 15447 * 4, 8317 * 8, 23671 * 4 } },
+    { { 17397 * 2, 17319 * 2, 2309 * 8, 24211, 10603, 9405, 16383, 1747 * 2 },
+      { 26479, 26663, 12705, 23469, 0, -18233, 22117, 11537 } },
+    { { 23167, 4555, 6239, 21223, 9539, 26189, 8603, 8721 },
+      { 8235, 12419, 9251, 26913, 0, 1499, 7543, 685 * 2 } },
+};
+
+static const OI_INT32 synth80Shift[5][2][8] = {
+    { { 0, 5, 6, 6, 4, 7, 4, 2 }, { 3, 5, 5, 5, 0, 5, 4, 3 } },
+    { { 3, 0, 0, 2, 0, 0, 1, 0 }, { 2, 3, 3, 4, 0, 0, 0, 0 } },
+    { { 0, 0, 0, 0, 0, 0, 0, 0 }, { 0, 0, 0, 0, 0, 0, 0, 0 } },
+    { { 0, 0, 0, 1, 0, 1, 2, 0 }, { 2, 2, 1, 2, 0, 3, 4, 1 } },
+    { { 3, 1, 3, 8, 4, 7, 6, 7 }, { 3, 4, 4, 6, 0, 1, 3, 0 } },
+};
+
+static void SynthWindowStore(OI_INT16 *pcm, const OI_INT16 *out, OI_UINT strideShift)
+{
+    OI_UINT k;
+
+    for (k = 0; k < 8; k++) {
+        pcm[k << strideShift] = out[k];
+    }
+}
+
+#endif
+
+#ifdef SBC_SYNTH_SIMD_X86
+
+__attribute__((target("avx2")))
+static void SynthWindow80_AVX2(OI_INT16 *pcm, SBC_BUFFER_T const * RESTRICT buffer, OI_UINT strideShift)
+{
+    const __m128i reverse = _mm_setr_epi8(14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1);
+    __m256i sum = _mm256_setzero_si256();
+    __m256i a, b;
+    __m128i out;
+    OI_INT16 tmp[8];
+    OI_UINT r;
+
+    for (r = 0; r < 5; r++) {
+        a = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(buffer + 16 * r + 4)));
+        b = _mm256_cvtepi16_epi32(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buffer + 16 * r + 5)), reverse));
+        a = _mm256_mullo_epi32(a, _mm256_loadu_si256((const __m256i *)synth80Coeff[r][0]));
+        b = _mm256_mullo_epi32(b, _mm256_loadu_si256((const __m256i *)synth80Coeff[r][1]));
+        sum = _mm256_add_epi32(sum, _mm256_srav_epi32(a, _mm256_loadu_si256((const __m256i *)synth80Shift[r][0])));
+        sum = _mm256_add_epi32(sum, _mm256_srav_epi32(b, _mm256_loadu_si256((const __m256i *)synth80Shift[r][1])));
+    }
+
+    /* sum / 32768 rounds towards zero, packs clips to 16 bit */
+    sum = _mm256_add_epi32(sum, _mm256_srli_epi32(_mm256_srai_epi32(sum, 31), 17));
+    sum = _mm256_srai_epi32(sum, 15);
+    out = _mm_packs_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+
+    if (strideShift == 0) {
+        _mm_storeu_si128((__m128i *)pcm, out);
+    } else {
+        _mm_storeu_si128((__m128i *)tmp, out);
+        SynthWindowStore(pcm, tmp, strideShift);
+    }
+}
+
+#endif /* SBC_SYNTH_SIMD_X86 */
+
+#ifdef SBC_SYNTH_SIMD_ARM
+
+static void SynthWindow80_NEON(OI_INT16 *pcm, SBC_BUFFER_T const * RESTRICT buffer, OI_UINT strideShift)
+{
+    int32x4_t sumLo = vdupq_n_s32(0);
+    int32x4_t sumHi = vdupq_n_s32(0);
+    int16x8_t a, b;
+    int16x8_t out;
+    OI_INT16 tmp[8];
+    OI_UINT r;
+
+    for (r = 0; r < 5; r++) {
+        a = vld1q_s16(buffer + 16 * r + 4);
+        b = vld1q_s16(buffer + 16 * r + 5);
+        b = vcombine_s16(vrev64_s16(vget_high_s16(b)), vrev64_s16(vget_low_s16(b)));
+        /* negative shift counts shift to the right */
+        sumLo = vaddq_s32(sumLo, vshlq_s32(vmulq_s32(vmovl_s16(vget_low_s16(a)),  vld1q_s32(&synth80Coeff[r][0][0])),
+                                           vnegq_s32(vld1q_s32(&synth80Shift[r][0][0]))));
+        sumHi = vaddq_s32(sumHi, vshlq_s32(vmulq_s32(vmovl_s16(vget_high_s16(a)), vld1q_s32(&synth80Coeff[r][0][4])),
+                                           vnegq_s32(vld1q_s32(&synth80Shift[r][0][4]))));
+        sumLo = vaddq_s32(sumLo, vshlq_s32(vmulq_s32(vmovl_s16(vget_low_s16(b)),  vld1q_s32(&synth80Coeff[r][1][0])),
+                                           vnegq_s32(vld1q_s32(&synth80Shift[r][1][0]))));
+        sumHi = vaddq_s32(sumHi, vshlq_s32(vmulq_s32(vmovl_s16(vget_high_s16(b)), vld1q_s32(&synth80Coeff[r][1][4])),
+                                           vnegq_s32(vld1q_s32(&synth80Shift[r][1][4]))));
+    }
+
+    /* sum / 32768 rounds towards zero, vqmovn clips to 16 bit */
+    sumLo = vaddq_s32(sumLo, vreinterpretq_s32_u32(vshrq_n_u32(vreinterpretq_u32_s32(vshrq_n_s32(sumLo, 31)), 17)));
+    sumHi = vaddq_s32(sumHi, vreinterpretq_s32_u32(vshrq_n_u32(vreinterpretq_u32_s32(vshrq_n_s32(sumHi, 31)), 17)));
+    out = vcombine_s16(vqmovn_s32(vshrq_n_s32(sumLo, 15)), vqmovn_s32(vshrq_n_s32(sumHi, 15)));
+
+    if (strideShift == 0) {
+        vst1q_s16(pcm, out);
+    } else {
+        vst1q_s16(tmp, out);
+        SynthWindowStore(pcm, tmp, strideShift);
+    }
+}
+
+#endif /* SBC_SYNTH_SIMD_ARM */
+
+#if defined(SBC_SYNTH_SIMD_X86) || defined(SBC_SYNTH_SIMD_ARM)
+
+/*
+ * Same as OI_SBC_SynthFrame_80, but the DCTs of all blocks between two shifts of
+ * the filter buffer are computed first, so that they can be done in parallel.
+ * This is safe, as the DCT of a block only writes the 8 values right below the
+ * part of the filter buffer read by the window of the previous block.
+ */
+PRIVATE void OI_SBC_SynthFrame_80_SIMD(OI_CODEC_SBC_DECODER_CONTEXT *context, OI_INT16 *pcm, OI_UINT blkstart, OI_UINT blkcount);
+PRIVATE void OI_SBC_SynthFrame_80_SIMD(OI_CODEC_SBC_DECODER_CONTEXT *context, OI_INT16 *pcm, OI_UINT blkstart, OI_UINT blkcount)
+{
+    void (*dct)(SBC_BUFFER_T *out, OI_INT32 const *in, OI_UINT inStride, OI_UINT count);
+    void (*window)(OI_INT16 *pcm, SBC_BUFFER_T const * RESTRICT buffer, OI_UINT strideShift);
+    OI_UINT blk;
+    OI_UINT ch;
+    OI_UINT run;
+    OI_UINT nrof_channels = context->common.frameInfo.nrof_channels;
+    OI_UINT pcmStrideShift = context->common.pcmStride == 1 ? 0 : 1;
+    OI_UINT offset = context->common.filterBufferOffset;
+    OI_INT32 *s = context->common.subdata + 8 * nrof_channels * blkstart;
+
+    switch (context->simdLevel) {
+#ifdef SBC_SYNTH_SIMD_X86
+    case OI_CODEC_SBC_SIMD_AVX2:
+        dct = dct2_8_batch_AVX2;
+        window = SynthWindow80_AVX2;
+        break;
+    default:
+        /* without per lane shifts, SSE2 is no faster than the generated window code */
+        dct = dct2_8_batch_SSE2;
+        window = SynthWindow80_generated;
+        break;
+#else
+    default:
+        dct = dct2_8_batch_NEON;
+        window = SynthWindow80_NEON;
+        break;
+#endif
+    }
+
+    while (blkcount > 0) {
+        if (offset == 0) {
+            COPY_BACKWARD_32BIT_ALIGNED_72_HALFWORDS(context->common.filterBuffer[0] + context->common.filterBufferLen - 72, context->common.filterBuffer[0]);
+            if (nrof_channels == 2) {
+                COPY_BACKWARD_32BIT_ALIGNED_72_HALFWORDS(context->common.filterBuffer[1] + context->common.filterBufferLen - 72, context->common.filterBuffer[1]);
+            }
+            /* the first block of the run uses filterBufferLen - 80 */
+            offset = context->common.filterBufferLen - 72;
+        }
+
+        /* blocks up to and including the one at offset 0 */
+        run = offset / 8;
+        if (run > blkcount) {
+            run = blkcount;
+        }
+
+        for (ch = 0; ch < nrof_channels; ch++) {
+            SBC_BUFFER_T *buffer = context->common.filterBuffer[ch] + offset - 8;
+            dct(buffer, s + 8 * ch, 8 * nrof_channels, run);
+            for (blk = 0; blk < run; blk++) {
+                window(pcm + ch + ((8 * blk) << pcmStrideShift), buffer - 8 * blk, pcmStrideShift);
+            }
+        }
+
+        s += 8 * nrof_channels * run;
+        pcm += (8 * run) << pcmStrideShift;
+        offset -= 8 * run;
+        blkcount -= run;
+    }
+    context->common.filterBufferOffset = offset;
+}
+
+#endif
+/* BK4BTSTACK_CHANGE END */
+
 PRIVATE void OI_SBC_SynthFrame_80(OI_CODEC_SBC_DECODER_CONTEXT *context, OI_INT16 *pcm, OI_UINT blkstart, OI_UINT blkcount);
 PRIVATE void OI_SBC_SynthFrame_80(OI_CODEC_SBC_DECODER_CONTEXT *context, OI_INT16 *pcm, OI_UINT blkstart, OI_UINT blkcount)
 {
@@ -267,6 +476,15 @@ PRIVATE void OI_SBC_SynthFrame_80(OI_CODEC_SBC_DECODER_CONTEXT *context, OI_INT1
     OI_INT32 *s = context->common.subdata + 8 * nrof_channels * blkstart;
     OI_UINT blkstop = blkstart + blkcount;
 
+/* BK4BTSTACK_CHANGE START */
+#if defined(SBC_SYNTH_SIMD_X86) || defined(SBC_SYNTH_SIMD_ARM)
+    if (context->simdLevel != OI_CODEC_SBC_SIMD_NONE) {
+        OI_SBC_SynthFrame_80_SIMD(context, pcm, blkstart, blkcount);
+        return;
+    }
+#endif
+/* BK4BTSTACK_CHANGE END */
+
     for (blk = blkstart; blk < blkstop; blk++) {
         if (offset == 0) {
             COPY_BACKWARD_32BIT_ALIGNED_72_HALFWORDS(context->common.filterBuffer[0] + context->common.filterBufferLen - 72, context->common.filterBuffer[0]);
@@ -391,6 +609,50 @@ PRIVATE void OI_SBC_SynthFrame(OI_CODEC_SBC_DECODER_CONTEXT *context, OI_INT16 *
     }
 }
 
+/* BK4BTSTACK_CHANGE START */
+/* -1: use best level supported by CPU, only written by OI_CODEC_SBC_SetSimdLevel */
+static OI_INT simdLevel = -1;
+
+static OI_BOOL simdLevelSupported(OI_UINT8 level)
+{
+    switch (level) {
+    case OI_CODEC_SBC_SIMD_NONE:
+        return TRUE;
+#ifdef SBC_SYNTH_SIMD_X86
+    case OI_CODEC_SBC_SIMD_SSE2:
+        return TRUE;
+    case OI_CODEC_SBC_SIMD_AVX2:
+        return __builtin_cpu_supports("avx2") ? TRUE : FALSE;
+#endif
+#ifdef SBC_SYNTH_SIMD_ARM
+    case OI_CODEC_SBC_SIMD_NEON:
+        return TRUE;
+#endif
+    default:
+        return FALSE;
+    }
+}
+
+static OI_UINT8 simdLevelBest(void)
+{
+    if (simdLevelSupported(OI_CODEC_SBC_SIMD_AVX2)) return OI_CODEC_SBC_SIMD_AVX2;
+    if (simdLevelSupported(OI_CODEC_SBC_SIMD_SSE2)) return OI_CODEC_SBC_SIMD_SSE2;
+    if (simdLevelSupported(OI_CODEC_SBC_SIMD_NEON)) return OI_CODEC_SBC_SIMD_NEON;
+    return OI_CODEC_SBC_SIMD_NONE;
+}
+
+OI_UINT8 OI_CODEC_SBC_SetSimdLevel(OI_UINT8 level)
+{
+    simdLevel = simdLevelSupported(level) ? level : simdLevelBest();
+    return (OI_UINT8) simdLevel;
+}
+
+PRIVATE OI_UINT8 OI_SBC_SynthSimdLevel(void)
+{
+    return (simdLevel < 0) ? simdLevelBest() : (OI_UINT8) simdLevel;
+}
+/* BK4BTSTACK_CHANGE END */
+
 
 void SynthWindow40_int32_int32_symmetry_with_sum(OI_INT16 *pcm, SBC_BUFFER_T buffer[80], OI_UINT strideShift)
 {
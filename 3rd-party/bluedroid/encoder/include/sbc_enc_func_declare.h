@@ -40,7 +40,9 @@ extern const SINT32 gas32CoeffFor8SBs[];
 extern void sbc_enc_bit_alloc_mono(SBC_ENC_PARAMS *CodecParams);
 extern void sbc_enc_bit_alloc_ste(SBC_ENC_PARAMS *CodecParams);
 
-extern void SbcAnalysisInit (void);
+/* BK4BTSTACK_CHANGE START */
+extern void SbcAnalysisInit (SBC_ENC_PARAMS *strEncParams);
+/* BK4BTSTACK_CHANGE END */
 
 extern void SbcAnalysisFilter4(SBC_ENC_PARAMS *strEncParams);
 extern void SbcAnalysisFilter8(SBC_ENC_PARAMS *strEncParams);
@@ -48,6 +50,34 @@ extern void SbcAnalysisFilter8(SBC_ENC_PARAMS *strEncParams);
 extern void SBC_FastIDCT8 (SINT32 *pInVect, SINT32 *pOutVect);
 extern void SBC_FastIDCT4 (SINT32 *x0, SINT32 *pOutVect);
 
+/* BK4BTSTACK_CHANGE START */
+/* SIMD kernels only reproduce the default 32 bit windowing and fast DCT */
+#if (SBC_USE_SIMD == TRUE) && (SBC_IPAQ_OPT == TRUE) && (SBC_ARM_ASM_OPT == FALSE) && \
+    (SBC_IS_64_MULT_IN_WINDOW_ACCU == FALSE) && (SBC_FAST_DCT == TRUE) && (SBC_IS_64_MULT_IN_IDCT == FALSE)
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define SBC_SIMD_X86 TRUE
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define SBC_SIMD_ARM TRUE
+#endif
+#endif
+
+#if (SBC_SIMD_X86 == TRUE)
+extern void SbcWindow4_SSE2(const SINT16 *ps16X, SINT32 *ps32DCTY);
+extern void SbcWindow8_SSE2(const SINT16 *ps16X, SINT32 *ps32DCTY);
+extern void SbcWindow8_AVX2(const SINT16 *ps16X, SINT32 *ps32DCTY);
+extern void SBC_FastIDCT4_SSE2(SINT32 *pInVect, SINT32 *pOutVect, SINT32 s32Count);
+extern void SBC_FastIDCT8_SSE2(SINT32 *pInVect, SINT32 *pOutVect, SINT32 s32Count);
+extern void SBC_FastIDCT4_AVX2(SINT32 *pInVect, SINT32 *pOutVect, SINT32 s32Count);
+extern void SBC_FastIDCT8_AVX2(SINT32 *pInVect, SINT32 *pOutVect, SINT32 s32Count);
+#endif
+#if (SBC_SIMD_ARM == TRUE)
+extern void SbcWindow4_NEON(const SINT16 *ps16X, SINT32 *ps32DCTY);
+extern void SbcWindow8_NEON(const SINT16 *ps16X, SINT32 *ps32DCTY);
+extern void SBC_FastIDCT4_NEON(SINT32 *pInVect, SINT32 *pOutVect, SINT32 s32Count);
+extern void SBC_FastIDCT8_NEON(SINT32 *pInVect, SINT32 *pOutVect, SINT32 s32Count);
+#endif
+/* BK4BTSTACK_CHANGE END */
+
 extern void EncPacking(SBC_ENC_PARAMS *strEncParams);
 extern void EncQuantizer(SBC_ENC_PARAMS *);
 #if (SBC_DSP_OPT==TRUE)
@@ -141,6 +141,22 @@
 #define SBC_NO_PCM_CPY_OPTION FALSE
 #endif
 
+/* BK4BTSTACK_CHANGE START */
+/* Set SBC_USE_SIMD to FALSE to disable the SSE2/AVX2 (x86) and NEON (ARM) kernels for windowing and DCT. */
+/* The kernels are bit-exact with the C code, the fastest one supported by the CPU is picked in SBC_Encoder_Init */
+#ifndef SBC_USE_SIMD
+#define SBC_USE_SIMD TRUE
+#endif
+
+#define SBC_SIMD_NONE   0
+#define SBC_SIMD_SSE2   1
+#define SBC_SIMD_AVX2   2
+#define SBC_SIMD_NEON   3
+
+/* max number of blocks windowed before a batch of DCTs is computed, one per SIMD lane */
+#define SBC_DCT_BATCH_MAX 8
+/* BK4BTSTACK_CHANGE END */
+
 #define MINIMUM_ENC_VX_BUFFER_SIZE (8*10*2)
 #ifndef ENC_VX_BUFFER_SIZE
 #define ENC_VX_BUFFER_SIZE (MINIMUM_ENC_VX_BUFFER_SIZE + 64)
@@ -196,6 +212,21 @@ typedef struct SBC_ENC_PARAMS_TAG
     UINT16 u16PacketLength;
     /* BK4BTSTACK_CHANGE START */
     UINT8  mSBCEnabled;
+
+    /* analysis filter and joint stereo state, formerly globals, to allow for multiple encoder instances */
+    SINT32 s32X[ENC_VX_BUFFER_SIZE/2];              /* s16X view must be 32 bits aligned cf SHIFTUP_X8_2 */
+    SINT32 s32DCTY[16*SBC_DCT_BATCH_MAX];
+    SINT16 s16ShiftCounter;
+    SINT16 s16EncMaxShiftCounter;
+
+    /* SIMD kernels selected by SbcAnalysisInit, NULL if the C code is used */
+    void (*pfnWindow)(const SINT16 *ps16X, SINT32 *ps32DCTY);
+    void (*pfnFastIDCT)(SINT32 *pInVect, SINT32 *pOutVect, SINT32 s32Count);
+    SINT16 s16DctBatch;
+#if (SBC_JOINT_STE_INCLUDED == TRUE)
+    SINT32 s32LRDiff[SBC_MAX_NUM_OF_BLOCKS];
+    SINT32 s32LRSum[SBC_MAX_NUM_OF_BLOCKS];
+#endif
     /* BK4BTSTACK_CHANGE END */
 }SBC_ENC_PARAMS;
 
@@ -205,6 +236,11 @@ extern "C"
 #endif
 SBC_API extern void SBC_Encoder(SBC_ENC_PARAMS *strEncParams);
 SBC_API extern void SBC_Encoder_Init(SBC_ENC_PARAMS *strEncParams);
+/* BK4BTSTACK_CHANGE START */
+/* Selects the SIMD kernels used by encoders initialized afterwards, e.g. SBC_SIMD_NONE for the C code. */
+/* Returns the selected level, which is the best one available if u8Level is not supported */
+SBC_API extern UINT8 SBC_Encoder_SetSimdLevel(UINT8 u8Level);
+/* BK4BTSTACK_CHANGE END */
 #ifdef __cplusplus
 }
 #endif
@@ -26,6 +26,14 @@
 #include "sbc_encoder.h"
 #include "sbc_enc_func_declare.h"
 /*#include <math.h>*/
+/* BK4BTSTACK_CHANGE START */
+#if (SBC_SIMD_X86 == TRUE)
+#include <immintrin.h>
+#endif
+#if (SBC_SIMD_ARM == TRUE)
+#include <arm_neon.h>
+#endif
+/* BK4BTSTACK_CHANGE END */
 
 #if (SBC_IS_64_MULT_IN_WINDOW_ACCU == TRUE)
 #define WIND_4_SUBBANDS_0_1 (SINT32)0x01659F45  /* gas32CoeffFor4SBs[8] = -gas32CoeffFor4SBs[32] = 0x01659F45 */
@@ -153,15 +161,9 @@
 #define WIND_8_SUBBANDS_8_2 (SINT16)0x12CF  /* 40 = 0x12CF6C75 */
 #endif
 
-#if (SBC_USE_ARM_PRAGMA==TRUE)
-#pragma arm section zidata = "sbc_s32_analysis_section"
-#endif
-static SINT32   s32DCTY[16]  = {0};
-static SINT32   s32X[ENC_VX_BUFFER_SIZE/2];
-static SINT16   *s16X=(SINT16*) s32X;      /* s16X must be 32 bits aligned cf  SHIFTUP_X8_2*/
-#if (SBC_USE_ARM_PRAGMA==TRUE)
-#pragma arm section zidata
-#endif
+/* BK4BTSTACK_CHANGE START */
+/* s32DCTY, s32X and s16X moved into SBC_ENC_PARAMS, see SbcAnalysisFilter4/8 */
+/* BK4BTSTACK_CHANGE END */
 
 /* This macro is for 4 subbands */
 #define SHIFTUP_X4                                                               \
@@ -897,8 +899,146 @@ static SINT16   *s16X=(SINT16*) s32X;      /* s16X must be 32 bits aligned cf  S
 #endif
 #endif
 
-static SINT16 ShiftCounter=0;
-extern SINT16 EncMaxShiftCounter;
+/* BK4BTSTACK_CHANGE START */
+/* ShiftCounter and EncMaxShiftCounter moved into SBC_ENC_PARAMS */
+
+#if (SBC_SIMD_X86 == TRUE) || (SBC_SIMD_ARM == TRUE)
+/* Windowing as a plain sum of products: s32DCTY[j] = sum over m of Coeff[m][j] * s16X[ChOffset + m*2*NumOfSubBands + j],
+   which is what WINDOW_PARTIAL_4/8 compute modulo 2^32, exploiting the symmetry of the window */
+static const SINT16 gas16SimdWindow4[5][8] =
+{
+    {0,                    WIND_4_SUBBANDS_1_0, WIND_4_SUBBANDS_2_0, WIND_4_SUBBANDS_3_0,
+     WIND_4_SUBBANDS_4_0,  WIND_4_SUBBANDS_3_4, WIND_4_SUBBANDS_2_4, WIND_4_SUBBANDS_1_4},
+    {WIND_4_SUBBANDS_0_1,  WIND_4_SUBBANDS_1_1, WIND_4_SUBBANDS_2_1, WIND_4_SUBBANDS_3_1,
+     WIND_4_SUBBANDS_4_1,  WIND_4_SUBBANDS_3_3, WIND_4_SUBBANDS_2_3, WIND_4_SUBBANDS_1_3},
+    {WIND_4_SUBBANDS_0_2,  WIND_4_SUBBANDS_1_2, WIND_4_SUBBANDS_2_2, WIND_4_SUBBANDS_3_2,
+     WIND_4_SUBBANDS_4_2,  WIND_4_SUBBANDS_3_2, WIND_4_SUBBANDS_2_2, WIND_4_SUBBANDS_1_2},
+    {-WIND_4_SUBBANDS_0_2, WIND_4_SUBBANDS_1_3, WIND_4_SUBBANDS_2_3, WIND_4_SUBBANDS_3_3,
+     WIND_4_SUBBANDS_4_1,  WIND_4_SUBBANDS_3_1, WIND_4_SUBBANDS_2_1, WIND_4_SUBBANDS_1_1},
+    {-WIND_4_SUBBANDS_0_1, WIND_4_SUBBANDS_1_4, WIND_4_SUBBANDS_2_4, WIND_4_SUBBANDS_3_4,
+     WIND_4_SUBBANDS_4_0,  WIND_4_SUBBANDS_3_0, WIND_4_SUBBANDS_2_0, WIND_4_SUBBANDS_1_0},
+};
+
+static const SINT16 gas16SimdWindow8[5][16] =
+{
+    {0,                    WIND_8_SUBBANDS_1_0, WIND_8_SUBBANDS_2_0, WIND_8_SUBBANDS_3_0,
+     WIND_8_SUBBANDS_4_0,  WIND_8_SUBBANDS_5_0, WIND_8_SUBBANDS_6_0, WIND_8_SUBBANDS_7_0,
+     WIND_8_SUBBANDS_8_0,  WIND_8_SUBBANDS_7_4, WIND_8_SUBBANDS_6_4, WIND_8_SUBBANDS_5_4,
+     WIND_8_SUBBANDS_4_4,  WIND_8_SUBBANDS_3_4, WIND_8_SUBBANDS_2_4, WIND_8_SUBBANDS_1_4},
+    {WIND_8_SUBBANDS_0_1,  WIND_8_SUBBANDS_1_1, WIND_8_SUBBANDS_2_1, WIND_8_SUBBANDS_3_1,
+     WIND_8_SUBBANDS_4_1,  WIND_8_SUBBANDS_5_1, WIND_8_SUBBANDS_6_1, WIND_8_SUBBANDS_7_1,
+     WIND_8_SUBBANDS_8_1,  WIND_8_SUBBANDS_7_3, WIND_8_SUBBANDS_6_3, WIND_8_SUBBANDS_5_3,
+     WIND_8_SUBBANDS_4_3,  WIND_8_SUBBANDS_3_3, WIND_8_SUBBANDS_2_3, WIND_8_SUBBANDS_1_3},
+    {WIND_8_SUBBANDS_0_2,  WIND_8_SUBBANDS_1_2, WIND_8_SUBBANDS_2_2, WIND_8_SUBBANDS_3_2,
+     WIND_8_SUBBANDS_4_2,  WIND_8_SUBBANDS_5_2, WIND_8_SUBBANDS_6_2, WIND_8_SUBBANDS_7_2,
+     WIND_8_SUBBANDS_8_2,  WIND_8_SUBBANDS_7_2, WIND_8_SUBBANDS_6_2, WIND_8_SUBBANDS_5_2,
+     WIND_8_SUBBANDS_4_2,  WIND_8_SUBBANDS_3_2, WIND_8_SUBBANDS_2_2, WIND_8_SUBBANDS_1_2},
+    {-WIND_8_SUBBANDS_0_2, WIND_8_SUBBANDS_1_3, WIND_8_SUBBANDS_2_3, WIND_8_SUBBANDS_3_3,
+     WIND_8_SUBBANDS_4_3,  WIND_8_SUBBANDS_5_3, WIND_8_SUBBANDS_6_3, WIND_8_SUBBANDS_7_3,
+     WIND_8_SUBBANDS_8_1,  WIND_8_SUBBANDS_7_1, WIND_8_SUBBANDS_6_1, WIND_8_SUBBANDS_5_1,
+     WIND_8_SUBBANDS_4_1,  WIND_8_SUBBANDS_3_1, WIND_8_SUBBANDS_2_1, WIND_8_SUBBANDS_1_1},
+    {-WIND_8_SUBBANDS_0_1, WIND_8_SUBBANDS_1_4, WIND_8_SUBBANDS_2_4, WIND_8_SUBBANDS_3_4,
+     WIND_8_SUBBANDS_4_4,  WIND_8_SUBBANDS_5_4, WIND_8_SUBBANDS_6_4, WIND_8_SUBBANDS_7_4,
+     WIND_8_SUBBANDS_8_0,  WIND_8_SUBBANDS_7_0, WIND_8_SUBBANDS_6_0, WIND_8_SUBBANDS_5_0,
+     WIND_8_SUBBANDS_4_0,  WIND_8_SUBBANDS_3_0, WIND_8_SUBBANDS_2_0, WIND_8_SUBBANDS_1_0},
+};
+#endif
+
+#if (SBC_SIMD_X86 == TRUE)
+/* 8 outputs: pmaddwd on interleaved samples and coefficients of rows m and m+1 */
+static void SbcWindowRows_SSE2(const SINT16 *ps16X, const SINT16 *ps16Coeff, SINT32 s32Stride, SINT32 s32CoeffStride, SINT32 *ps32DCTY)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i x0 = _mm_loadu_si128((const __m128i *) (ps16X));
+    __m128i x1 = _mm_loadu_si128((const __m128i *) (ps16X + s32Stride));
+    __m128i x2 = _mm_loadu_si128((const __m128i *) (ps16X + 2*s32Stride));
+    __m128i x3 = _mm_loadu_si128((const __m128i *) (ps16X + 3*s32Stride));
+    __m128i x4 = _mm_loadu_si128((const __m128i *) (ps16X + 4*s32Stride));
+    __m128i c0 = _mm_loadu_si128((const __m128i *) (ps16Coeff));
+    __m128i c1 = _mm_loadu_si128((const __m128i *) (ps16Coeff + s32CoeffStride));
+    __m128i c2 = _mm_loadu_si128((const __m128i *) (ps16Coeff + 2*s32CoeffStride));
+    __m128i c3 = _mm_loadu_si128((const __m128i *) (ps16Coeff + 3*s32CoeffStride));
+    __m128i c4 = _mm_loadu_si128((const __m128i *) (ps16Coeff + 4*s32CoeffStride));
+    __m128i lo, hi;
+
+    lo = _mm_madd_epi16(_mm_unpacklo_epi16(x0, x1), _mm_unpacklo_epi16(c0, c1));
+    hi = _mm_madd_epi16(_mm_unpackhi_epi16(x0, x1), _mm_unpackhi_epi16(c0, c1));
+    lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(x2, x3), _mm_unpacklo_epi16(c2, c3)));
+    hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(x2, x3), _mm_unpackhi_epi16(c2, c3)));
+    lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(x4, zero), _mm_unpacklo_epi16(c4, zero)));
+    hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(x4, zero), _mm_unpackhi_epi16(c4, zero)));
+    _mm_storeu_si128((__m128i *) ps32DCTY, lo);
+    _mm_storeu_si128((__m128i *) (ps32DCTY + 4), hi);
+}
+
+void SbcWindow4_SSE2(const SINT16 *ps16X, SINT32 *ps32DCTY)
+{
+    SbcWindowRows_SSE2(ps16X, gas16SimdWindow4[0], 8, 8, ps32DCTY);
+}
+
+void SbcWindow8_SSE2(const SINT16 *ps16X, SINT32 *ps32DCTY)
+{
+    SbcWindowRows_SSE2(ps16X,     gas16SimdWindow8[0],     16, 16, ps32DCTY);
+    SbcWindowRows_SSE2(ps16X + 8, gas16SimdWindow8[0] + 8, 16, 16, ps32DCTY + 8);
+}
+
+/* same as SbcWindow8_SSE2, 256 bit unpack works per 128 bit lane: lo holds outputs 0..3 and 8..11, hi 4..7 and 12..15 */
+__attribute__((target("avx2")))
+void SbcWindow8_AVX2(const SINT16 *ps16X, SINT32 *ps32DCTY)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i x0 = _mm256_loadu_si256((const __m256i *) (ps16X));
+    __m256i x1 = _mm256_loadu_si256((const __m256i *) (ps16X + 16));
+    __m256i x2 = _mm256_loadu_si256((const __m256i *) (ps16X + 32));
+    __m256i x3 = _mm256_loadu_si256((const __m256i *) (ps16X + 48));
+    __m256i x4 = _mm256_loadu_si256((const __m256i *) (ps16X + 64));
+    __m256i c0 = _mm256_loadu_si256((const __m256i *) gas16SimdWindow8[0]);
+    __m256i c1 = _mm256_loadu_si256((const __m256i *) gas16SimdWindow8[1]);
+    __m256i c2 = _mm256_loadu_si256((const __m256i *) gas16SimdWindow8[2]);
+    __m256i c3 = _mm256_loadu_si256((const __m256i *) gas16SimdWindow8[3]);
+    __m256i c4 = _mm256_loadu_si256((const __m256i *) gas16SimdWindow8[4]);
+    __m256i lo, hi;
+
+    lo = _mm256_madd_epi16(_mm256_unpacklo_epi16(x0, x1), _mm256_unpacklo_epi16(c0, c1));
+    hi = _mm256_madd_epi16(_mm256_unpackhi_epi16(x0, x1), _mm256_unpackhi_epi16(c0, c1));
+    lo = _mm256_add_epi32(lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(x2, x3), _mm256_unpacklo_epi16(c2, c3)));
+    hi = _mm256_add_epi32(hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(x2, x3), _mm256_unpackhi_epi16(c2, c3)));
+    lo = _mm256_add_epi32(lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(x4, zero), _mm256_unpacklo_epi16(c4, zero)));
+    hi = _mm256_add_epi32(hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(x4, zero), _mm256_unpackhi_epi16(c4, zero)));
+    _mm256_storeu_si256((__m256i *) ps32DCTY,       _mm256_permute2x128_si256(lo, hi, 0x20));
+    _mm256_storeu_si256((__m256i *) (ps32DCTY + 8), _mm256_permute2x128_si256(lo, hi, 0x31));
+}
+#endif
+
+#if (SBC_SIMD_ARM == TRUE)
+/* 4 outputs: widening multiply-accumulate over the 5 rows */
+static void SbcWindowRows_NEON(const SINT16 *ps16X, const SINT16 *ps16Coeff, SINT32 s32Stride, SINT32 s32CoeffStride, SINT32 *ps32DCTY)
+{
+    int32x4_t acc;
+    acc = vmull_s16(vld1_s16(ps16X), vld1_s16(ps16Coeff));
+    acc = vmlal_s16(acc, vld1_s16(ps16X + s32Stride),   vld1_s16(ps16Coeff + s32CoeffStride));
+    acc = vmlal_s16(acc, vld1_s16(ps16X + 2*s32Stride), vld1_s16(ps16Coeff + 2*s32CoeffStride));
+    acc = vmlal_s16(acc, vld1_s16(ps16X + 3*s32Stride), vld1_s16(ps16Coeff + 3*s32CoeffStride));
+    acc = vmlal_s16(acc, vld1_s16(ps16X + 4*s32Stride), vld1_s16(ps16Coeff + 4*s32CoeffStride));
+    vst1q_s32(ps32DCTY, acc);
+}
+
+void SbcWindow4_NEON(const SINT16 *ps16X, SINT32 *ps32DCTY)
+{
+    SbcWindowRows_NEON(ps16X,     gas16SimdWindow4[0],     8, 8, ps32DCTY);
+    SbcWindowRows_NEON(ps16X + 4, gas16SimdWindow4[0] + 4, 8, 8, ps32DCTY + 4);
+}
+
+void SbcWindow8_NEON(const SINT16 *ps16X, SINT32 *ps32DCTY)
+{
+    SINT32 j;
+    for (j = 0; j < 16; j += 4)
+    {
+        SbcWindowRows_NEON(ps16X + j, gas16SimdWindow8[0] + j, 16, 16, ps32DCTY + j);
+    }
+}
+#endif
+/* BK4BTSTACK_CHANGE END */
 /****************************************************************************
 * SbcAnalysisFilter - performs Analysis of the input audio stream
 *
@@ -930,6 +1070,14 @@ void SbcAnalysisFilter4(SBC_ENC_PARAMS *pstrEncParams)
 #endif
 #endif
 
+    /* BK4BTSTACK_CHANGE START */
+    SINT16 *s16X = (SINT16*) pstrEncParams->s32X;
+    SINT32 *s32DCTY = pstrEncParams->s32DCTY;
+    SINT16 ShiftCounter = pstrEncParams->s16ShiftCounter;
+    SINT16 EncMaxShiftCounter = pstrEncParams->s16EncMaxShiftCounter;
+    SINT32 s32Batch = 0;
+    /* BK4BTSTACK_CHANGE END */
+
     s32NumOfChannels = pstrEncParams->s16NumOfChannels;
     s32NumOfBlocks   = pstrEncParams->s16NumOfBlocks;
 
@@ -964,6 +1112,21 @@ void SbcAnalysisFilter4(SBC_ENC_PARAMS *pstrEncParams)
         for (s32Ch=0;s32Ch<s32NumOfChannels;s32Ch++)
         {
             ChOffset=s32Ch*Offset2+Offset;
+
+            /* BK4BTSTACK_CHANGE START */
+            if (pstrEncParams->pfnWindow)
+            {
+                /* s16X changes with the next block, the DCTs are done once a batch is complete */
+                pstrEncParams->pfnWindow(s16X+ChOffset, s32DCTY+s32Batch*SUB_BANDS_4*2);
+                if (++s32Batch == pstrEncParams->s16DctBatch)
+                {
+                    pstrEncParams->pfnFastIDCT(s32DCTY, ps32SbBuf, s32Batch);
+                    ps32SbBuf += s32Batch*SUB_BANDS_4;
+                    s32Batch = 0;
+                }
+                continue;
+            }
+            /* BK4BTSTACK_CHANGE END */
             
             WINDOW_PARTIAL_4
 
@@ -995,6 +1158,13 @@ void SbcAnalysisFilter4(SBC_ENC_PARAMS *pstrEncParams)
             }
         }
     }
+    /* BK4BTSTACK_CHANGE START */
+    if (s32Batch)
+    {
+        pstrEncParams->pfnFastIDCT(s32DCTY, ps32SbBuf, s32Batch);
+    }
+    pstrEncParams->s16ShiftCounter = ShiftCounter;
+    /* BK4BTSTACK_CHANGE END */
 }
 
 /* //////////////////////////////////////////////////////////////////////////////////////////////////////////////////// */
@@ -1023,6 +1193,14 @@ void SbcAnalysisFilter8 (SBC_ENC_PARAMS *pstrEncParams)
 #endif
 #endif
 
+    /* BK4BTSTACK_CHANGE START */
+    SINT16 *s16X = (SINT16*) pstrEncParams->s32X;
+    SINT32 *s32DCTY = pstrEncParams->s32DCTY;
+    SINT16 ShiftCounter = pstrEncParams->s16ShiftCounter;
+    SINT16 EncMaxShiftCounter = pstrEncParams->s16EncMaxShiftCounter;
+    SINT32 s32Batch = 0;
+    /* BK4BTSTACK_CHANGE END */
+
     s32NumOfChannels = pstrEncParams->s16NumOfChannels;
     s32NumOfBlocks   = pstrEncParams->s16NumOfBlocks;
 
@@ -1068,6 +1246,21 @@ void SbcAnalysisFilter8 (SBC_ENC_PARAMS *pstrEncParams)
         {
             ChOffset=s32Ch*Offset2+Offset;
 
+            /* BK4BTSTACK_CHANGE START */
+            if (pstrEncParams->pfnWindow)
+            {
+                /* s16X changes with the next block, the DCTs are done once a batch is complete */
+                pstrEncParams->pfnWindow(s16X+ChOffset, s32DCTY+s32Batch*SUB_BANDS_8*2);
+                if (++s32Batch == pstrEncParams->s16DctBatch)
+                {
+                    pstrEncParams->pfnFastIDCT(s32DCTY, ps32SbBuf, s32Batch);
+                    ps32SbBuf += s32Batch*SUB_BANDS_8;
+                    s32Batch = 0;
+                }
+                continue;
+            }
+            /* BK4BTSTACK_CHANGE END */
+
             WINDOW_PARTIAL_8
 
             SBC_FastIDCT8 (s32DCTY, ps32SbBuf);
@@ -1099,10 +1292,88 @@ void SbcAnalysisFilter8 (SBC_ENC_PARAMS *pstrEncParams)
             }
         }
     }
+    /* BK4BTSTACK_CHANGE START */
+    if (s32Batch)
+    {
+        pstrEncParams->pfnFastIDCT(s32DCTY, ps32SbBuf, s32Batch);
+    }
+    pstrEncParams->s16ShiftCounter = ShiftCounter;
+    /* BK4BTSTACK_CHANGE END */
+}
+
+/* BK4BTSTACK_CHANGE START */
+/* -1: use best level supported by CPU, only written by SBC_Encoder_SetSimdLevel */
+static SINT16 s16SimdLevel = -1;
+
+static UINT8 SbcSimdLevelSupported(UINT8 u8Level)
+{
+    switch (u8Level)
+    {
+    case SBC_SIMD_NONE:
+        return TRUE;
+#if (SBC_SIMD_X86 == TRUE)
+    case SBC_SIMD_SSE2:
+        return TRUE;
+    case SBC_SIMD_AVX2:
+        return __builtin_cpu_supports("avx2") ? TRUE : FALSE;
+#endif
+#if (SBC_SIMD_ARM == TRUE)
+    case SBC_SIMD_NEON:
+        return TRUE;
+#endif
+    default:
+        return FALSE;
+    }
 }
 
-void SbcAnalysisInit (void)
+static UINT8 SbcSimdLevelBest(void)
 {
-    memset(s16X,0,ENC_VX_BUFFER_SIZE*sizeof(SINT16));
-    ShiftCounter=0;
+    if (SbcSimdLevelSupported(SBC_SIMD_AVX2)) return SBC_SIMD_AVX2;
+    if (SbcSimdLevelSupported(SBC_SIMD_SSE2)) return SBC_SIMD_SSE2;
+    if (SbcSimdLevelSupported(SBC_SIMD_NEON)) return SBC_SIMD_NEON;
+    return SBC_SIMD_NONE;
+}
+
+UINT8 SBC_Encoder_SetSimdLevel(UINT8 u8Level)
+{
+    s16SimdLevel = SbcSimdLevelSupported(u8Level) ? u8Level : SbcSimdLevelBest();
+    return (UINT8) s16SimdLevel;
+}
+
+void SbcAnalysisInit (SBC_ENC_PARAMS *pstrEncParams)
+{
+    UINT8 u8Level = (s16SimdLevel < 0) ? SbcSimdLevelBest() : (UINT8) s16SimdLevel;
+
+    memset(pstrEncParams->s32X,0,ENC_VX_BUFFER_SIZE*sizeof(SINT16));
+    pstrEncParams->s16ShiftCounter=0;
+
+    pstrEncParams->pfnWindow = NULL;
+    pstrEncParams->pfnFastIDCT = NULL;
+    pstrEncParams->s16DctBatch = 1;
+    switch (u8Level)
+    {
+#if (SBC_SIMD_X86 == TRUE)
+    case SBC_SIMD_AVX2:
+        /* 4 subbands window is too short to gain from 256 bit */
+        pstrEncParams->pfnWindow   = (pstrEncParams->s16NumOfSubBands == SUB_BANDS_8) ? SbcWindow8_AVX2 : SbcWindow4_SSE2;
+        pstrEncParams->pfnFastIDCT = (pstrEncParams->s16NumOfSubBands == SUB_BANDS_8) ? SBC_FastIDCT8_AVX2 : SBC_FastIDCT4_AVX2;
+        pstrEncParams->s16DctBatch = 8;
+        break;
+    case SBC_SIMD_SSE2:
+        pstrEncParams->pfnWindow   = (pstrEncParams->s16NumOfSubBands == SUB_BANDS_8) ? SbcWindow8_SSE2 : SbcWindow4_SSE2;
+        pstrEncParams->pfnFastIDCT = (pstrEncParams->s16NumOfSubBands == SUB_BANDS_8) ? SBC_FastIDCT8_SSE2 : SBC_FastIDCT4_SSE2;
+        pstrEncParams->s16DctBatch = 4;
+        break;
+#endif
+#if (SBC_SIMD_ARM == TRUE)
+    case SBC_SIMD_NEON:
+        pstrEncParams->pfnWindow   = (pstrEncParams->s16NumOfSubBands == SUB_BANDS_8) ? SbcWindow8_NEON : SbcWindow4_NEON;
+        pstrEncParams->pfnFastIDCT = (pstrEncParams->s16NumOfSubBands == SUB_BANDS_8) ? SBC_FastIDCT8_NEON : SBC_FastIDCT4_NEON;
+        pstrEncParams->s16DctBatch = 4;
+        break;
+#endif
+    default:
+        break;
+    }
 }
+/* BK4BTSTACK_CHANGE END */
@@ -25,6 +25,15 @@
 #include "sbc_encoder.h"
 #include "sbc_enc_func_declare.h"
 #include "sbc_dct.h"
+/* BK4BTSTACK_CHANGE START */
+#include <string.h>
+#if (SBC_SIMD_X86 == TRUE)
+#include <immintrin.h>
+#endif
+#if (SBC_SIMD_ARM == TRUE)
+#include <arm_neon.h>
+#endif
+/* BK4BTSTACK_CHANGE END */
 
 
 
@@ -243,3 +252,362 @@ void SBC_FastIDCT4(SINT32 *pInVect, SINT32 *pOutVect)
     }
 #endif
 }
+
+/* BK4BTSTACK_CHANGE START */
+#if (SBC_SIMD_X86 == TRUE) || (SBC_SIMD_ARM == TRUE)
+/*******************************************************************************
+**
+** SIMD versions of SBC_FastIDCT8 and SBC_FastIDCT4 for a batch of input vectors,
+** one input vector per lane. The same operations are done in the same order,
+** the ISA specific SBC_V* macros are defined before each instantiation.
+**
+*******************************************************************************/
+#define SBC_FAST_IDCT8_SIMD(in, out)                                            \
+{                                                                               \
+    SBC_VEC x0, x1, x2, x3, x4, x5, x6, x7, temp;                               \
+    SBC_VEC res_even[4], res_odd[4];                                            \
+    x0 = SBC_VMULT(SBC_COS_PI_SUR_4, in[4]);                                    \
+    x1 = SBC_VSRA1(SBC_VADD(in[3], in[5]));                                     \
+    x2 = SBC_VSRA1(SBC_VADD(in[2], in[6]));                                     \
+    x3 = SBC_VSRA1(SBC_VADD(in[1], in[7]));                                     \
+    x4 = SBC_VSRA1(SBC_VADD(in[0], in[8]));                                     \
+    x5 = SBC_VSRA1(SBC_VSUB(in[9], in[15]));                                    \
+    x6 = SBC_VSRA1(SBC_VSUB(in[10], in[14]));                                   \
+    x7 = SBC_VSRA1(SBC_VSUB(in[11], in[13]));                                   \
+    temp = x0;                                                                  \
+    x0 = SBC_VMULT(SBC_COS_PI_SUR_4, SBC_VADD(x0, x4));                         \
+    x4 = SBC_VMULT(SBC_COS_PI_SUR_4, SBC_VSUB(temp, x4));                       \
+    x2 = SBC_VSUB(x2, x6);                                                      \
+    x6 = SBC_VSHL1(x6);                                                         \
+    x6 = SBC_VMULT(SBC_COS_PI_SUR_4, x6);                                       \
+    temp = x2;                                                                  \
+    x2 = SBC_VMULT(SBC_COS_PI_SUR_8, SBC_VADD(x2, x6));                         \
+    x6 = SBC_VMULT(SBC_COS_3PI_SUR_8, SBC_VSUB(temp, x6));                      \
+    res_even[0] = SBC_VADD(x0, x2);                                             \
+    res_even[1] = SBC_VADD(x4, x6);                                             \
+    res_even[2] = SBC_VSUB(x4, x6);                                             \
+    res_even[3] = SBC_VSUB(x0, x2);                                             \
+    x7 = SBC_VSHL1(x7);                                                         \
+    x5 = SBC_VSUB(SBC_VSHL1(x5), x7);                                           \
+    x3 = SBC_VSUB(SBC_VSHL1(x3), x5);                                           \
+    x1 = SBC_VSUB(x1, SBC_VSRA1(x3));                                           \
+    x5 = SBC_VMULT(SBC_COS_PI_SUR_4, x5);                                       \
+    temp = x1;                                                                  \
+    x1 = SBC_VADD(x1, x5);                                                      \
+    x5 = SBC_VSUB(temp, x5);                                                    \
+    x3 = SBC_VSUB(x3, x7);                                                      \
+    x7 = SBC_VSHL1(x7);                                                         \
+    x7 = SBC_VMULT(SBC_COS_PI_SUR_4, x7);                                       \
+    temp = x3;                                                                  \
+    x3 = SBC_VMULT(SBC_COS_PI_SUR_8, SBC_VADD(x3, x7));                         \
+    x7 = SBC_VMULT(SBC_COS_3PI_SUR_8, SBC_VSUB(temp, x7));                      \
+    res_odd[0] = SBC_VMULT(SBC_COS_PI_SUR_16,  SBC_VADD(x1, x3));               \
+    res_odd[1] = SBC_VMULT(SBC_COS_3PI_SUR_16, SBC_VADD(x5, x7));               \
+    res_odd[2] = SBC_VMULT(SBC_COS_5PI_SUR_16, SBC_VSUB(x5, x7));               \
+    res_odd[3] = SBC_VMULT(SBC_COS_7PI_SUR_16, SBC_VSUB(x1, x3));               \
+    out[0] = SBC_VADD(res_even[0], res_odd[0]);                                 \
+    out[1] = SBC_VADD(res_even[1], res_odd[1]);                                 \
+    out[2] = SBC_VADD(res_even[2], res_odd[2]);                                 \
+    out[3] = SBC_VADD(res_even[3], res_odd[3]);                                 \
+    out[7] = SBC_VSUB(res_even[0], res_odd[0]);                                 \
+    out[6] = SBC_VSUB(res_even[1], res_odd[1]);                                 \
+    out[5] = SBC_VSUB(res_even[2], res_odd[2]);                                 \
+    out[4] = SBC_VSUB(res_even[3], res_odd[3]);                                 \
+}
+
+#define SBC_FAST_IDCT4_SIMD(in, out)                                            \
+{                                                                               \
+    SBC_VEC temp, x2;                                                           \
+    SBC_VEC tmp[8];                                                             \
+    x2 = SBC_VSRA1(in[2]);                                                      \
+    temp = SBC_VADD(in[0], in[4]);                                              \
+    tmp[0] = SBC_VMULT((SBC_COS_PI_SUR_4>>1), temp);                            \
+    tmp[1] = SBC_VSUB(x2, tmp[0]);                                              \
+    tmp[0] = SBC_VADD(tmp[0], x2);                                              \
+    temp = SBC_VADD(in[1], in[3]);                                              \
+    tmp[3] = SBC_VMULT((SBC_COS_3PI_SUR_8>>1), temp);                           \
+    tmp[2] = SBC_VMULT((SBC_COS_PI_SUR_8>>1), temp);                            \
+    temp = SBC_VSUB(in[5], in[7]);                                              \
+    tmp[5] = SBC_VMULT((SBC_COS_3PI_SUR_8>>1), temp);                           \
+    tmp[4] = SBC_VMULT((SBC_COS_PI_SUR_8>>1), temp);                            \
+    tmp[6] = SBC_VADD(tmp[2], tmp[5]);                                          \
+    tmp[7] = SBC_VSUB(tmp[3], tmp[4]);                                          \
+    out[0] = SBC_VADD(tmp[0], tmp[6]);                                          \
+    out[1] = SBC_VADD(tmp[1], tmp[7]);                                          \
+    out[2] = SBC_VSUB(tmp[1], tmp[7]);                                          \
+    out[3] = SBC_VSUB(tmp[0], tmp[6]);                                          \
+}
+
+/* runs a kernel on batches of s32Lanes vectors, a partial last batch reads a full batch but writes to a scratch buffer */
+#define SBC_FAST_IDCT_BATCHES(kernel, s32Lanes, s32InLen, s32OutLen)            \
+{                                                                               \
+    SINT32 s32Out[SBC_DCT_BATCH_MAX * SBC_MAX_NUM_OF_SUBBANDS];                 \
+    for (; s32Count >= s32Lanes; s32Count -= s32Lanes)                          \
+    {                                                                           \
+        kernel(pInVect, pOutVect);                                              \
+        pInVect  += s32Lanes * s32InLen;                                        \
+        pOutVect += s32Lanes * s32OutLen;                                       \
+    }                                                                           \
+    if (s32Count > 0)                                                           \
+    {                                                                           \
+        kernel(pInVect, s32Out);                                                \
+        memcpy(pOutVect, s32Out, s32Count * s32OutLen * sizeof(SINT32));        \
+    }                                                                           \
+}
+#endif
+
+#if (SBC_SIMD_X86 == TRUE)
+/* SBC_MULT_32_16_SIMPLIFIED for c < 0x8000: c*(x>>16)*2 + ((c*(x&0xffff))>>15) */
+static inline __m128i SbcMult_SSE2(SINT32 c, __m128i x)
+{
+    const __m128i coeff = _mm_set1_epi32(c);    /* halfwords c, 0 */
+    __m128i hi = _mm_madd_epi16(_mm_srai_epi32(x, 16), coeff);
+    __m128i lo = _mm_and_si128(x, _mm_set1_epi32(0xffff));
+    lo = _mm_or_si128(_mm_mullo_epi16(lo, coeff), _mm_slli_epi32(_mm_mulhi_epu16(lo, coeff), 16));
+    return _mm_add_epi32(_mm_slli_epi32(hi, 1), _mm_srli_epi32(lo, 15));
+}
+
+/* transpose 4x4 32 bit, for 256 bit vectors in each 128 bit lane */
+#define SBC_TRANSPOSE4(ISA, r0, r1, r2, r3)                                     \
+{                                                                               \
+    t0 = ISA##_unpacklo_epi32(r0, r1);                                          \
+    t1 = ISA##_unpacklo_epi32(r2, r3);                                          \
+    t2 = ISA##_unpackhi_epi32(r0, r1);                                          \
+    t3 = ISA##_unpackhi_epi32(r2, r3);                                          \
+    r0 = ISA##_unpacklo_epi64(t0, t1);                                          \
+    r1 = ISA##_unpackhi_epi64(t0, t1);                                          \
+    r2 = ISA##_unpacklo_epi64(t2, t3);                                          \
+    r3 = ISA##_unpackhi_epi64(t2, t3);                                          \
+}
+
+#define SBC_VEC         __m128i
+#define SBC_VADD(a, b)  _mm_add_epi32(a, b)
+#define SBC_VSUB(a, b)  _mm_sub_epi32(a, b)
+#define SBC_VSRA1(a)    _mm_srai_epi32(a, 1)
+#define SBC_VSHL1(a)    _mm_slli_epi32(a, 1)
+#define SBC_VMULT(c, a) SbcMult_SSE2(c, a)
+
+/* loads element i of s32Len long vectors k..k+3 into v[i] */
+#define SBC_LOAD_SSE2(v, p, s32Len)                                             \
+{                                                                               \
+    for (i = 0; i < s32Len; i += 4)                                             \
+    {                                                                           \
+        v[i+0] = _mm_loadu_si128((const __m128i *) (p + 0*s32Len + i));         \
+        v[i+1] = _mm_loadu_si128((const __m128i *) (p + 1*s32Len + i));         \
+        v[i+2] = _mm_loadu_si128((const __m128i *) (p + 2*s32Len + i));         \
+        v[i+3] = _mm_loadu_si128((const __m128i *) (p + 3*s32Len + i));         \
+        SBC_TRANSPOSE4(_mm, v[i+0], v[i+1], v[i+2], v[i+3]);                    \
+    }                                                                           \
+}
+
+#define SBC_STORE_SSE2(v, p, s32Len)                                            \
+{                                                                               \
+    for (i = 0; i < s32Len; i += 4)                                             \
+    {                                                                           \
+        SBC_TRANSPOSE4(_mm, v[i+0], v[i+1], v[i+2], v[i+3]);                    \
+        _mm_storeu_si128((__m128i *) (p + 0*s32Len + i), v[i+0]);               \
+        _mm_storeu_si128((__m128i *) (p + 1*s32Len + i), v[i+1]);               \
+        _mm_storeu_si128((__m128i *) (p + 2*s32Len + i), v[i+2]);               \
+        _mm_storeu_si128((__m128i *) (p + 3*s32Len + i), v[i+3]);               \
+    }                                                                           \
+}
+
+static void SBC_FastIDCT8x4_SSE2(const SINT32 *pInVect, SINT32 *pOutVect)
+{
+    __m128i in[16], out[8], t0, t1, t2, t3;
+    SINT32 i;
+    SBC_LOAD_SSE2(in, pInVect, 16);
+    SBC_FAST_IDCT8_SIMD(in, out);
+    SBC_STORE_SSE2(out, pOutVect, 8);
+}
+
+static void SBC_FastIDCT4x4_SSE2(const SINT32 *pInVect, SINT32 *pOutVect)
+{
+    __m128i in[8], out[4], t0, t1, t2, t3;
+    SINT32 i;
+    SBC_LOAD_SSE2(in, pInVect, 8);
+    SBC_FAST_IDCT4_SIMD(in, out);
+    SBC_STORE_SSE2(out, pOutVect, 4);
+}
+
+void SBC_FastIDCT8_SSE2(SINT32 *pInVect, SINT32 *pOutVect, SINT32 s32Count)
+{
+    SBC_FAST_IDCT_BATCHES(SBC_FastIDCT8x4_SSE2, 4, 16, 8);
+}
+
+void SBC_FastIDCT4_SSE2(SINT32 *pInVect, SINT32 *pOutVect, SINT32 s32Count)
+{
+    SBC_FAST_IDCT_BATCHES(SBC_FastIDCT4x4_SSE2, 4, 8, 4);
+}
+
+#undef SBC_VEC
+#undef SBC_VADD
+#undef SBC_VSUB
+#undef SBC_VSRA1
+#undef SBC_VSHL1
+#undef SBC_VMULT
+
+/* exact 32x32->64 signed multiply on even lanes, low 32 bits of (product >> 15) re-interleaved */
+__attribute__((target("avx2")))
+static inline __m256i SbcMult_AVX2(SINT32 c, __m256i x)
+{
+    const __m256i coeff = _mm256_set1_epi32(c);
+    __m256i even = _mm256_srli_epi64(_mm256_mul_epi32(x, coeff), 15);
+    __m256i odd  = _mm256_slli_epi64(_mm256_mul_epi32(_mm256_srli_epi64(x, 32), coeff), 17);
+    return _mm256_blend_epi32(even, odd, 0xaa);
+}
+
+#define SBC_VEC         __m256i
+#define SBC_VADD(a, b)  _mm256_add_epi32(a, b)
+#define SBC_VSUB(a, b)  _mm256_sub_epi32(a, b)
+#define SBC_VSRA1(a)    _mm256_srai_epi32(a, 1)
+#define SBC_VSHL1(a)    _mm256_slli_epi32(a, 1)
+#define SBC_VMULT(c, a) SbcMult_AVX2(c, a)
+
+/* vectors k and k+4 share a 256 bit register, so that a per lane 4x4 transpose does the job */
+#define SBC_LOAD_AVX2(v, p, s32Len)                                             \
+{                                                                               \
+    for (i = 0; i < s32Len; i += 4)                                             \
+    {                                                                           \
+        for (k = 0; k < 4; k++)                                                 \
+        {                                                                       \
+            v[i+k] = _mm256_inserti128_si256(                                   \
+                _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *) (p + k*s32Len + i))), \
+                _mm_loadu_si128((const __m128i *) (p + (k+4)*s32Len + i)), 1);  \
+        }                                                                       \
+        SBC_TRANSPOSE4(_mm256, v[i+0], v[i+1], v[i+2], v[i+3]);                 \
+    }                                                                           \
+}
+
+#define SBC_STORE_AVX2(v, p, s32Len)                                            \
+{                                                                               \
+    for (i = 0; i < s32Len; i += 4)                                             \
+    {                                                                           \
+        SBC_TRANSPOSE4(_mm256, v[i+0], v[i+1], v[i+2], v[i+3]);                 \
+        for (k = 0; k < 4; k++)                                                 \
+        {                                                                       \
+            _mm_storeu_si128((__m128i *) (p + k*s32Len + i), _mm256_castsi256_si128(v[i+k]));         \
+            _mm_storeu_si128((__m128i *) (p + (k+4)*s32Len + i), _mm256_extracti128_si256(v[i+k], 1)); \
+        }                                                                       \
+    }                                                                           \
+}
+
+__attribute__((target("avx2")))
+static void SBC_FastIDCT8x8_AVX2(const SINT32 *pInVect, SINT32 *pOutVect)
+{
+    __m256i in[16], out[8], t0, t1, t2, t3;
+    SINT32 i, k;
+    SBC_LOAD_AVX2(in, pInVect, 16);
+    SBC_FAST_IDCT8_SIMD(in, out);
+    SBC_STORE_AVX2(out, pOutVect, 8);
+}
+
+__attribute__((target("avx2")))
+static void SBC_FastIDCT4x8_AVX2(const SINT32 *pInVect, SINT32 *pOutVect)
+{
+    __m256i in[8], out[4], t0, t1, t2, t3;
+    SINT32 i, k;
+    SBC_LOAD_AVX2(in, pInVect, 8);
+    SBC_FAST_IDCT4_SIMD(in, out);
+    SBC_STORE_AVX2(out, pOutVect, 4);
+}
+
+__attribute__((target("avx2")))
+void SBC_FastIDCT8_AVX2(SINT32 *pInVect, SINT32 *pOutVect, SINT32 s32Count)
+{
+    SBC_FAST_IDCT_BATCHES(SBC_FastIDCT8x8_AVX2, 8, 16, 8);
+}
+
+__attribute__((target("avx2")))
+void SBC_FastIDCT4_AVX2(SINT32 *pInVect, SINT32 *pOutVect, SINT32 s32Count)
+{
+    SBC_FAST_IDCT_BATCHES(SBC_FastIDCT4x8_AVX2, 8, 8, 4);
+}
+
+#undef SBC_VEC
+#undef SBC_VADD
+#undef SBC_VSUB
+#undef SBC_VSRA1
+#undef SBC_VSHL1
+#undef SBC_VMULT
+#endif
+
+#if (SBC_SIMD_ARM == TRUE)
+/* SBC_MULT_32_16_SIMPLIFIED: widening multiply, shift right and narrow */
+static inline int32x4_t SbcMult_NEON(SINT32 c, int32x4_t x)
+{
+    const int32x2_t coeff = vdup_n_s32(c);
+    return vcombine_s32(vshrn_n_s64(vmull_s32(vget_low_s32(x), coeff), 15),
+                        vshrn_n_s64(vmull_s32(vget_high_s32(x), coeff), 15));
+}
+
+#define SBC_TRANSPOSE4_NEON(r0, r1, r2, r3)                                     \
+{                                                                               \
+    int32x4x2_t t01 = vtrnq_s32(r0, r1);                                        \
+    int32x4x2_t t23 = vtrnq_s32(r2, r3);                                        \
+    r0 = vcombine_s32(vget_low_s32(t01.val[0]),  vget_low_s32(t23.val[0]));     \
+    r1 = vcombine_s32(vget_low_s32(t01.val[1]),  vget_low_s32(t23.val[1]));     \
+    r2 = vcombine_s32(vget_high_s32(t01.val[0]), vget_high_s32(t23.val[0]));    \
+    r3 = vcombine_s32(vget_high_s32(t01.val[1]), vget_high_s32(t23.val[1]));    \
+}
+
+#define SBC_VEC         int32x4_t
+#define SBC_VADD(a, b)  vaddq_s32(a, b)
+#define SBC_VSUB(a, b)  vsubq_s32(a, b)
+#define SBC_VSRA1(a)    vshrq_n_s32(a, 1)
+#define SBC_VSHL1(a)    vshlq_n_s32(a, 1)
+#define SBC_VMULT(c, a) SbcMult_NEON(c, a)
+
+#define SBC_LOAD_NEON(v, p, s32Len)                                             \
+{                                                                               \
+    for (i = 0; i < s32Len; i += 4)                                             \
+    {                                                                           \
+        v[i+0] = vld1q_s32(p + 0*s32Len + i);                                   \
+        v[i+1] = vld1q_s32(p + 1*s32Len + i);                                   \
+        v[i+2] = vld1q_s32(p + 2*s32Len + i);                                   \
+        v[i+3] = vld1q_s32(p + 3*s32Len + i);                                   \
+        SBC_TRANSPOSE4_NEON(v[i+0], v[i+1], v[i+2], v[i+3]);                    \
+    }                                                                           \
+}
+
+#define SBC_STORE_NEON(v, p, s32Len)                                            \
+{                                                                               \
+    for (i = 0; i < s32Len; i += 4)                                             \
+    {                                                                           \
+        SBC_TRANSPOSE4_NEON(v[i+0], v[i+1], v[i+2], v[i+3]);                    \
+        vst1q_s32(p + 0*s32Len + i, v[i+0]);                                    \
+        vst1q_s32(p + 1*s32Len + i, v[i+1]);                                    \
+        vst1q_s32(p + 2*s32Len + i, v[i+2]);                                    \
+        vst1q_s32(p + 3*s32Len + i, v[i+3]);                                    \
+    }                                                                           \
+}
+
+static void SBC_FastIDCT8x4_NEON(const SINT32 *pInVect, SINT32 *pOutVect)
+{
+    int32x4_t in[16], out[8];
+    SINT32 i;
+    SBC_LOAD_NEON(in, pInVect, 16);
+    SBC_FAST_IDCT8_SIMD(in, out);
+    SBC_STORE_NEON(out, pOutVect, 8);
+}
+
+static void SBC_FastIDCT4x4_NEON(const SINT32 *pInVect, SINT32 *pOutVect)
+{
+    int32x4_t in[8], out[4];
+    SINT32 i;
+    SBC_LOAD_NEON(in, pInVect, 8);
+    SBC_FAST_IDCT4_SIMD(in, out);
+    SBC_STORE_NEON(out, pOutVect, 4);
+}
+
+void SBC_FastIDCT8_NEON(SINT32 *pInVect, SINT32 *pOutVect, SINT32 s32Count)
+{
+    SBC_FAST_IDCT_BATCHES(SBC_FastIDCT8x4_NEON, 4, 16, 8);
+}
+
+void SBC_FastIDCT4_NEON(SINT32 *pInVect, SINT32 *pOutVect, SINT32 s32Count)
+{
+    SBC_FAST_IDCT_BATCHES(SBC_FastIDCT4x4_NEON, 4, 8, 4);
+}
+#endif
+/* BK4BTSTACK_CHANGE END */
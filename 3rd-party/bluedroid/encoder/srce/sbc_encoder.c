@@ -26,7 +26,9 @@
 #include "sbc_encoder.h"
 #include "sbc_enc_func_declare.h"
 
-SINT16 EncMaxShiftCounter;
+/* BK4BTSTACK_CHANGE START */
+/* EncMaxShiftCounter moved into SBC_ENC_PARAMS */
+/* BK4BTSTACK_CHANGE END */
 
 /*************************************************************************************************
  * SBC encoder scramble code
@@ -77,41 +79,13 @@ SINT16 EncMaxShiftCounter;
  *
  */
 
-#define SBC_PRTC_CRC_IDX        3
-#define SBC_PRTC_USE_MASK       0x64
-#define SBC_PRTC_SYNC_MASK      0x10
-#define SBC_PRTC_CIDX           0
-#define SBC_PRTC_LIDX           1
-typedef struct
-{
-    UINT8   use;
-    UINT8   idx;
-} tSBC_FR_CB;
-
-typedef struct
-{
-    tSBC_FR_CB      fr[2];
-    UINT8           init;
-    UINT8           index;
-    UINT8           base;
-} tSBC_PRTC_CB;
-tSBC_PRTC_CB sbc_prtc_cb;
-
-#define SBC_PRTC_IDX(sc) (((sc) & 0x3) + (((sc) & 0x30) >> 2))
-#define SBC_PRTC_CHK_INIT(ar) {if(sbc_prtc_cb.init == 0){sbc_prtc_cb.init=1; ar[0] &= ~SBC_PRTC_SYNC_MASK;}}
-#define SBC_PRTC_C2L() {p_last=&sbc_prtc_cb.fr[SBC_PRTC_LIDX]; p_cur=&sbc_prtc_cb.fr[SBC_PRTC_CIDX]; \
-                        p_last->idx = p_cur->idx; p_last->use = p_cur->use;}
-#define SBC_PRTC_GETC(ar) {p_cur->use = ar[SBC_PRTC_CRC_IDX] & SBC_PRTC_USE_MASK; \
-                           p_cur->idx = SBC_PRTC_IDX(ar[SBC_PRTC_CRC_IDX]);}
-#define SBC_PRTC_CHK_CRC(ar) {SBC_PRTC_C2L();SBC_PRTC_GETC(ar);sbc_prtc_cb.index = (p_cur->use)?SBC_PRTC_CIDX:SBC_PRTC_LIDX;}
-#define SBC_PRTC_SCRMB(ar) {idx = sbc_prtc_cb.fr[sbc_prtc_cb.index].idx; \
-    if(idx > 0){if((idx&1)&&(pstrEncParams->u16PacketLength > (sbc_prtc_cb.base+(idx<<1)))) {tmp2=idx<<1; tmp=ar[idx];ar[idx]=ar[tmp2];ar[tmp2]=tmp;} \
-                else{tmp2=ar[idx]; tmp=(tmp2>>5)+(tmp2<<3);ar[idx]=(UINT8)tmp;}}}
+/* BK4BTSTACK_CHANGE START */
+/* scrambling is not used, sbc_prtc_cb and the SBC_PRTC_* macros removed */
+/* BK4BTSTACK_CHANGE END */
 
-#if (SBC_JOINT_STE_INCLUDED == TRUE)
-SINT32   s32LRDiff[SBC_MAX_NUM_OF_BLOCKS]    = {0};
-SINT32   s32LRSum[SBC_MAX_NUM_OF_BLOCKS]     = {0};
-#endif
+/* BK4BTSTACK_CHANGE START */
+/* s32LRDiff and s32LRSum moved into SBC_ENC_PARAMS */
+/* BK4BTSTACK_CHANGE END */
 
 void SBC_Encoder(SBC_ENC_PARAMS *pstrEncParams)
 {
@@ -192,8 +166,8 @@ void SBC_Encoder(SBC_ENC_PARAMS *pstrEncParams)
                 SbBuffer=pstrEncParams->s32SbBuffer+s32Sb;
                 s32MaxValue2=0;
                 s32MaxValue=0;
-                pSum       = s32LRSum;
-                pDiff      = s32LRDiff;
+                pSum       = pstrEncParams->s32LRSum;
+                pDiff      = pstrEncParams->s32LRDiff;
                 for (s32Blk=0;s32Blk<s32NumOfBlocks;s32Blk++)
                 {
                     *pSum=(*SbBuffer+*(SbBuffer+s32NumOfSubBands))>>1;
@@ -233,8 +207,8 @@ void SBC_Encoder(SBC_ENC_PARAMS *pstrEncParams)
                     *(ps16ScfL+s32NumOfSubBands) = (SINT16)u32CountDiff;
 
                     SbBuffer=pstrEncParams->s32SbBuffer+s32Sb;
-                    pSum       = s32LRSum;
-                    pDiff      = s32LRDiff;
+                    pSum       = pstrEncParams->s32LRSum;
+                    pDiff      = pstrEncParams->s32LRDiff;
 
                     for (s32Blk = 0; s32Blk < s32NumOfBlocks; s32Blk++)
                     {
@@ -272,16 +246,7 @@ void SBC_Encoder(SBC_ENC_PARAMS *pstrEncParams)
         EncPacking(pstrEncParams);
 
 /* BK4BTSTACK_CHANGE START */
-        /* scramble the code */
-        //SBC_PRTC_CHK_INIT(pu8);
-        //SBC_PRTC_CHK_CRC(pu8);
-#if 0
-        if(pstrEncParams->u16PacketLength > ((sbc_prtc_cb.fr[sbc_prtc_cb.index].idx * 2) + sbc_prtc_cb.base))
-            printf("len: %d, idx: %d\n", pstrEncParams->u16PacketLength, sbc_prtc_cb.fr[sbc_prtc_cb.index].idx);
-        else
-            printf("len: %d, idx: %d!!!!\n", pstrEncParams->u16PacketLength, sbc_prtc_cb.fr[sbc_prtc_cb.index].idx);
-#endif
-        //SBC_PRTC_SCRMB((&pu8[sbc_prtc_cb.base]));
+        /* scrambling is not used */
 /* BK4BTSTACK_CHANGE STOP */
 
     }
@@ -393,23 +358,22 @@ void SBC_Encoder_Init(SBC_ENC_PARAMS *pstrEncParams)
     if (pstrEncParams->s16NumOfSubBands==4)
     {
         if (pstrEncParams->s16NumOfChannels==1)
-            EncMaxShiftCounter=((ENC_VX_BUFFER_SIZE-4*10)>>2)<<2;
+            pstrEncParams->s16EncMaxShiftCounter=((ENC_VX_BUFFER_SIZE-4*10)>>2)<<2;
         else
-            EncMaxShiftCounter=((ENC_VX_BUFFER_SIZE-4*10*2)>>3)<<2;
+            pstrEncParams->s16EncMaxShiftCounter=((ENC_VX_BUFFER_SIZE-4*10*2)>>3)<<2;
     }
     else
     {
         if (pstrEncParams->s16NumOfChannels==1)
-            EncMaxShiftCounter=((ENC_VX_BUFFER_SIZE-8*10)>>3)<<3;
+            pstrEncParams->s16EncMaxShiftCounter=((ENC_VX_BUFFER_SIZE-8*10)>>3)<<3;
         else
-            EncMaxShiftCounter=((ENC_VX_BUFFER_SIZE-8*10*2)>>4)<<3;
+            pstrEncParams->s16EncMaxShiftCounter=((ENC_VX_BUFFER_SIZE-8*10*2)>>4)<<3;
     }
 
     // APPL_TRACE_EVENT("SBC_Encoder_Init : bitrate %d, bitpool %d",
     //         pstrEncParams->u16BitRate, pstrEncParams->s16BitPool);
 
-    SbcAnalysisInit();
-
-    memset(&sbc_prtc_cb, 0, sizeof(tSBC_PRTC_CB));
-    sbc_prtc_cb.base = 6 + pstrEncParams->s16NumOfChannels*pstrEncParams->s16NumOfSubBands/2;
+    /* BK4BTSTACK_CHANGE START */
+    SbcAnalysisInit(pstrEncParams);
+    /* BK4BTSTACK_CHANGE END */
 }
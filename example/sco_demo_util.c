@@ -112,6 +112,7 @@ static int dump_data = 1;
 static int count_sent = 0;
 static int count_received = 0;
 static uint8_t negotiated_codec = 0; 
+static hfp_msbc_state_t msbc_encoder_state;
 #if SCO_DEMO_MODE != SCO_DEMO_MODE_55
 static int phase = 0;
 #endif
@@ -166,11 +167,11 @@ static void sco_demo_sine_wave_int16(int num_samples, int16_t * data){
 static int num_audio_frames = 0;
 
 static void sco_demo_fill_audio_frame(void){
-    if (!hfp_msbc_can_encode_audio_frame_now()) return;
-    int num_samples = hfp_msbc_num_audio_samples_per_frame();
+    if (!hfp_msbc_can_encode_audio_frame_now(&msbc_encoder_state)) return;
+    int num_samples = hfp_msbc_num_audio_samples_per_frame(&msbc_encoder_state);
     int16_t sample_buffer[num_samples];
     sco_demo_sine_wave_int16(num_samples, sample_buffer);
-    hfp_msbc_encode_audio_frame(sample_buffer);
+    hfp_msbc_encode_audio_frame(&msbc_encoder_state, sample_buffer);
     num_audio_frames++;
 }
 #ifdef SCO_WAV_FILENAME
@@ -247,7 +248,7 @@ static void sco_demo_init_mSBC(void){
 
     num_samples_to_write = sample_rate * SCO_WAV_DURATION_IN_SECONDS;
     
-    hfp_msbc_init();
+    hfp_msbc_init(&msbc_encoder_state);
     sco_demo_fill_audio_frame();
 
 #ifdef SCO_MSBC_IN_FILENAME
@@ -491,10 +492,10 @@ void sco_demo_send(hci_con_handle_t sco_handle){
 #if SCO_DEMO_MODE == SCO_DEMO_MODE_SINE
     if (negotiated_codec == HFP_CODEC_MSBC){
 
-        if (hfp_msbc_num_bytes_in_stream() < sco_payload_length){
+        if (hfp_msbc_num_bytes_in_stream(&msbc_encoder_state) < sco_payload_length){
             log_error("mSBC stream is empty.");
         }
-        hfp_msbc_read_from_stream(sco_packet + 3, sco_payload_length);
+        hfp_msbc_read_from_stream(&msbc_encoder_state, sco_packet + 3, sco_payload_length);
         if (msbc_file_out){
             // log outgoing mSBC data for testing
             fwrite(sco_packet + 3, sco_payload_length, 1, msbc_file_out);
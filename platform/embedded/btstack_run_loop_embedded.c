@@ -60,6 +60,7 @@
 #include "hal_cpu.h"
 
 #include "btstack_debug.h"
+#include "bluetooth.h"
 
 #include <stddef.h> // NULL
 
@@ -75,6 +76,11 @@
 #define TIMER_SUPPORT
 #endif
 
+// max number of pending callbacks for btstack_run_loop_execute_on_main_thread
+#ifndef MAX_NR_MAIN_THREAD_CALLBACKS
+#define MAX_NR_MAIN_THREAD_CALLBACKS 8
+#endif
+
 static const btstack_run_loop_t btstack_run_loop_embedded;
 
 // the run loop
@@ -90,6 +96,15 @@ static volatile uint32_t system_ticks;
 
 static int trigger_event_received = 0;
 
+// callbacks from interrupt handlers, protected by disabling irqs
+typedef struct {
+    void (*callback)(void * context);
+    void * context;
+} main_thread_callback_t;
+static main_thread_callback_t main_thread_callbacks[MAX_NR_MAIN_THREAD_CALLBACKS];
+static volatile uint16_t main_thread_callbacks_head;
+static volatile uint16_t main_thread_callbacks_count;
+
 /**
  * Add data_source to run_loop
  */
@@ -170,12 +185,41 @@ static void btstack_run_loop_embedded_disable_data_source_callbacks(btstack_data
     ds->flags &= ~callback_types;
 }
 
+static int btstack_run_loop_embedded_execute_on_main_thread(void (*callback)(void * context), void * context){
+    hal_cpu_disable_irqs();
+    if (main_thread_callbacks_count >= MAX_NR_MAIN_THREAD_CALLBACKS){
+        hal_cpu_enable_irqs();
+        return ERROR_CODE_MEMORY_CAPACITY_EXCEEDED;
+    }
+    uint16_t index = (main_thread_callbacks_head + main_thread_callbacks_count) % MAX_NR_MAIN_THREAD_CALLBACKS;
+    main_thread_callbacks[index].callback = callback;
+    main_thread_callbacks[index].context  = context;
+    main_thread_callbacks_count++;
+    trigger_event_received = 1;
+    hal_cpu_enable_irqs();
+    return 0;
+}
+
+static void btstack_run_loop_embedded_process_main_thread_callbacks(void){
+    while (main_thread_callbacks_count){
+        hal_cpu_disable_irqs();
+        main_thread_callback_t entry = main_thread_callbacks[main_thread_callbacks_head];
+        main_thread_callbacks_head = (main_thread_callbacks_head + 1) % MAX_NR_MAIN_THREAD_CALLBACKS;
+        main_thread_callbacks_count--;
+        hal_cpu_enable_irqs();
+        (*entry.callback)(entry.context);
+    }
+}
+
 /**
  * Execute run_loop once
  */
 void btstack_run_loop_embedded_execute_once(void) {
     btstack_data_source_t *ds;
 
+    // process callbacks from interrupt handlers
+    btstack_run_loop_embedded_process_main_thread_callbacks();
+
     // process data sources
     btstack_data_source_t *next;
     for (ds = (btstack_data_source_t *) data_sources; ds != NULL ; ds = next){
@@ -255,6 +299,8 @@ void btstack_run_loop_embedded_trigger(void){
 
 static void btstack_run_loop_embedded_init(void){
     data_sources = NULL;
+    main_thread_callbacks_head  = 0;
+    main_thread_callbacks_count = 0;
 
 #ifdef TIMER_SUPPORT
     timers = NULL;
@@ -286,4 +332,6 @@ static const btstack_run_loop_t btstack_run_loop_embedded = {
     &btstack_run_loop_embedded_execute,
     &btstack_run_loop_embedded_dump_timer,
     &btstack_run_loop_embedded_get_time_ms,
+    NULL,
+    &btstack_run_loop_embedded_execute_on_main_thread,
 };
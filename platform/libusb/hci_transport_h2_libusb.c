@@ -56,12 +56,16 @@
 #include <string.h>
 #include <unistd.h>   /* UNIX standard function definitions */
 #include <sys/types.h>
+#ifndef _WIN32
+#include <poll.h>
+#endif
 
 #include <libusb.h>
 
 #include "btstack_config.h"
 
 #include "btstack_debug.h"
+#include "btstack_instrumentation.h"
 #include "hci.h"
 #include "hci_transport.h"
 
@@ -69,9 +73,12 @@
 #define HAVE_USB_VENDOR_ID_AND_PRODUCT_ID
 #endif
 
-#define ASYNC_BUFFERS  3
-#define ISOC_BUFFERS  10
+// default number of transfers, can be changed with hci_transport_usb_set_num_buffers
+#define ASYNC_BUFFERS    3
+#define ISOC_BUFFERS    10
+#define ACL_OUT_BUFFERS  3
 
+// only used if libusb does not provide pollfds, e.g. on Windows
 #define ASYNC_POLLING_INTERVAL_MS 1
 
 //
@@ -122,6 +129,13 @@ typedef enum {
     H2_W4_PAYLOAD,
 } H2_SCO_STATE;
 
+// run loop data source for libusb pollfd
+typedef struct usb_pollfd {
+    struct usb_pollfd * next;
+    btstack_data_source_t data_source;
+    int active;
+} usb_pollfd_t;
+
 static libusb_state_t libusb_state = LIB_USB_CLOSED;
 
 // single instance
@@ -136,10 +150,23 @@ static libusb_device        * dev;
 #endif
 static libusb_device_handle * handle;
 
+// number of transfers
+static int num_async_buffers   = ASYNC_BUFFERS;
+static int num_acl_out_buffers = ACL_OUT_BUFFERS;
+#ifdef ENABLE_SCO_OVER_HCI
+static int num_isoc_buffers    = ISOC_BUFFERS;
+#endif
+
 static struct libusb_transfer *command_out_transfer;
-static struct libusb_transfer *acl_out_transfer;
-static struct libusb_transfer *event_in_transfer[ASYNC_BUFFERS];
-static struct libusb_transfer *acl_in_transfer[ASYNC_BUFFERS];
+static struct libusb_transfer **event_in_transfer;
+static struct libusb_transfer **acl_in_transfer;
+
+// outgoing ACL packets, copied into acl_out_buffer if more than one transfer is used
+static struct libusb_transfer **acl_out_transfers;
+static uint8_t *acl_out_transfers_in_flight;
+static uint8_t *acl_out_buffer;
+static int      acl_out_transfers_active;
+static int      acl_out_packet_sent_pending;
 
 #ifdef ENABLE_SCO_OVER_HCI
 
@@ -152,8 +179,8 @@ static H2_SCO_STATE sco_state;
 static uint8_t  sco_buffer[255+3 + SCO_PACKET_SIZE];
 static uint16_t sco_read_pos;
 static uint16_t sco_bytes_to_read;
-static struct  libusb_transfer *sco_in_transfer[ISOC_BUFFERS];
-static uint8_t hci_sco_in_buffer[ISOC_BUFFERS][SCO_PACKET_SIZE]; 
+static struct  libusb_transfer **sco_in_transfer;
+static uint8_t *hci_sco_in_buffer;
 
 // outgoing SCO
 static uint8_t  sco_ring_buffer[SCO_RING_BUFFER_SIZE];
@@ -166,20 +193,22 @@ static int      sco_ring_transfers_in_flight[SCO_RING_BUFFER_COUNT];
 // outgoing buffer for HCI Command packets
 static uint8_t hci_cmd_buffer[3 + 256 + LIBUSB_CONTROL_SETUP_SIZE];
 
-// incoming buffer for HCI Events and ACL Packets
-static uint8_t hci_event_in_buffer[ASYNC_BUFFERS][HCI_ACL_BUFFER_SIZE]; // bigger than largest packet
-static uint8_t hci_acl_in_buffer[ASYNC_BUFFERS][HCI_INCOMING_PRE_BUFFER_SIZE + HCI_ACL_BUFFER_SIZE]; 
+// incoming buffers for HCI Events and ACL Packets, HCI_ACL_BUFFER_SIZE is bigger than largest event
+#define EVENT_IN_BUFFER_SIZE (HCI_ACL_BUFFER_SIZE)
+#define ACL_IN_BUFFER_SIZE   (HCI_INCOMING_PRE_BUFFER_SIZE + HCI_ACL_BUFFER_SIZE)
+static uint8_t *hci_event_in_buffer;
+static uint8_t *hci_acl_in_buffer;
 
 // For (ab)use as a linked list of received packets
 static struct libusb_transfer *handle_packet;
 
+// pollfd data sources are not freed as the run loop might access them after removal in their callback
 static int doing_pollfds;
-static int num_pollfds;
-static btstack_data_source_t * pollfd_data_sources;
+static int pollfds_handle_timeouts;
+static usb_pollfd_t * usb_pollfds;
 static btstack_timer_source_t usb_timer;
 static int usb_timer_active;
 
-static int usb_acl_out_active = 0;
 static int usb_command_active = 0;
 
 // endpoint addresses
@@ -204,6 +233,81 @@ static int sco_ring_have_space(void){
 }
 #endif
 
+void hci_transport_usb_set_num_buffers(int async_buffers, int isoc_buffers, int acl_out_buffers){
+    if (libusb_state != LIB_USB_CLOSED){
+        log_error("hci_transport_usb_set_num_buffers: transport already open");
+        return;
+    }
+    if (async_buffers < 1 || isoc_buffers < 1 || acl_out_buffers < 1){
+        log_error("hci_transport_usb_set_num_buffers: at least one transfer of each type required");
+        return;
+    }
+    num_async_buffers   = async_buffers;
+    num_acl_out_buffers = acl_out_buffers;
+#ifdef ENABLE_SCO_OVER_HCI
+    num_isoc_buffers    = isoc_buffers;
+#else
+    UNUSED(isoc_buffers);
+#endif
+}
+
+static void usb_free_buffers(void){
+    free(event_in_transfer);
+    free(acl_in_transfer);
+    free(hci_event_in_buffer);
+    free(hci_acl_in_buffer);
+    free(acl_out_transfers);
+    free(acl_out_transfers_in_flight);
+    free(acl_out_buffer);
+    event_in_transfer = NULL;
+    acl_in_transfer = NULL;
+    hci_event_in_buffer = NULL;
+    hci_acl_in_buffer = NULL;
+    acl_out_transfers = NULL;
+    acl_out_transfers_in_flight = NULL;
+    acl_out_buffer = NULL;
+#ifdef ENABLE_SCO_OVER_HCI
+    free(sco_in_transfer);
+    free(hci_sco_in_buffer);
+    sco_in_transfer = NULL;
+    hci_sco_in_buffer = NULL;
+#endif
+}
+
+static int usb_alloc_buffers(void){
+    event_in_transfer   = (struct libusb_transfer **) calloc(num_async_buffers, sizeof(struct libusb_transfer *));
+    acl_in_transfer     = (struct libusb_transfer **) calloc(num_async_buffers, sizeof(struct libusb_transfer *));
+    hci_event_in_buffer = (uint8_t *) malloc(num_async_buffers * EVENT_IN_BUFFER_SIZE);
+    hci_acl_in_buffer   = (uint8_t *) malloc(num_async_buffers * ACL_IN_BUFFER_SIZE);
+    acl_out_transfers   = (struct libusb_transfer **) calloc(num_acl_out_buffers, sizeof(struct libusb_transfer *));
+    acl_out_transfers_in_flight = (uint8_t *) calloc(num_acl_out_buffers, 1);
+    int ok = event_in_transfer && acl_in_transfer && hci_event_in_buffer && hci_acl_in_buffer && acl_out_transfers && acl_out_transfers_in_flight;
+    // single transfer uses HCI packet buffer directly
+    if (num_acl_out_buffers > 1){
+        acl_out_buffer  = (uint8_t *) malloc(num_acl_out_buffers * HCI_ACL_BUFFER_SIZE);
+        ok = ok && acl_out_buffer;
+    }
+#ifdef ENABLE_SCO_OVER_HCI
+    sco_in_transfer     = (struct libusb_transfer **) calloc(num_isoc_buffers, sizeof(struct libusb_transfer *));
+    hci_sco_in_buffer   = (uint8_t *) malloc(num_isoc_buffers * SCO_PACKET_SIZE);
+    ok = ok && sco_in_transfer && hci_sco_in_buffer;
+#endif
+    if (!ok){
+        log_error("usb_alloc_buffers: not enough memory");
+        usb_free_buffers();
+        return -1;
+    }
+    return 0;
+}
+
+static int usb_acl_out_transfer_index(struct libusb_transfer *transfer){
+    int c;
+    for (c = 0 ; c < num_acl_out_buffers ; c++){
+        if (transfer == acl_out_transfers[c]) return c;
+    }
+    return -1;
+}
+
 void hci_transport_usb_set_path(int len, uint8_t * port_numbers){
     if (len > USB_MAX_PATH_LEN || !port_numbers){
         log_error("hci_transport_usb_set_path: len or port numbers invalid");
@@ -238,7 +342,14 @@ LIBUSB_CALL static void async_callback(struct libusb_transfer *transfer){
     // identify and free transfers as part of shutdown
     int c;
     if (libusb_state != LIB_USB_TRANSFERS_ALLOCATED) {
-        for (c=0;c<ASYNC_BUFFERS;c++){
+        c = usb_acl_out_transfer_index(transfer);
+        if (c >= 0){
+            acl_out_transfers_in_flight[c] = 0;
+            libusb_free_transfer(transfer);
+            acl_out_transfers[c] = 0;
+            return;
+        }
+        for (c=0;c<num_async_buffers;c++){
             if (transfer == event_in_transfer[c]){
                 libusb_free_transfer(transfer);
                 event_in_transfer[c] = 0;
@@ -251,7 +362,7 @@ LIBUSB_CALL static void async_callback(struct libusb_transfer *transfer){
             }
         }
 #ifdef ENABLE_SCO_OVER_HCI
-        for (c=0;c<ISOC_BUFFERS;c++){
+        for (c=0;c<num_isoc_buffers;c++){
             if (transfer == sco_in_transfer[c]){
                 libusb_free_transfer(transfer);
                 sco_in_transfer[c] = 0;
@@ -272,11 +383,13 @@ LIBUSB_CALL static void async_callback(struct libusb_transfer *transfer){
         return;
     }
 
+#ifdef ENABLE_SCO_OVER_HCI
     for (c=0;c<SCO_RING_BUFFER_COUNT;c++){
         if (transfer == sco_ring_transfers[c]){
             sco_ring_transfers_in_flight[c] = 0;
         }
     }
+#endif
 
 
     int r;
@@ -380,7 +493,9 @@ static void handle_isochronous_data(uint8_t * buffer, uint16_t size){
                 break;
             case H2_W4_PAYLOAD:
                 // packet complete
+                BTSTACK_INSTRUMENTATION_ENTER(BTSTACK_INSTRUMENTATION_LAYER_TRANSPORT, BTSTACK_INSTRUMENTATION_NO_CON_HANDLE, HCI_SCO_DATA_PACKET, sco_read_pos);
                 packet_handler(HCI_SCO_DATA_PACKET, sco_buffer, sco_read_pos);
+                BTSTACK_INSTRUMENTATION_EXIT();
                 sco_state_machine_init();
                 break;
         }
@@ -394,11 +509,15 @@ static void handle_completed_transfer(struct libusb_transfer *transfer){
     int signal_done = 0;
 
     if (transfer->endpoint == event_in_addr) {
+        BTSTACK_INSTRUMENTATION_ENTER(BTSTACK_INSTRUMENTATION_LAYER_TRANSPORT, BTSTACK_INSTRUMENTATION_NO_CON_HANDLE, HCI_EVENT_PACKET, transfer->actual_length);
         packet_handler(HCI_EVENT_PACKET, transfer-> buffer, transfer->actual_length);
+        BTSTACK_INSTRUMENTATION_EXIT();
         resubmit = 1;
     } else if (transfer->endpoint == acl_in_addr) {
         // log_info("-> acl");
+        BTSTACK_INSTRUMENTATION_ENTER(BTSTACK_INSTRUMENTATION_LAYER_TRANSPORT, BTSTACK_INSTRUMENTATION_NO_CON_HANDLE, HCI_ACL_DATA_PACKET, transfer->actual_length);
         packet_handler(HCI_ACL_DATA_PACKET, transfer-> buffer, transfer->actual_length);
+        BTSTACK_INSTRUMENTATION_EXIT();
         resubmit = 1;
     } else if (transfer->endpoint == 0){
         // log_info("command done, size %u", transfer->actual_length);
@@ -406,8 +525,16 @@ static void handle_completed_transfer(struct libusb_transfer *transfer){
         signal_done = 1;
     } else if (transfer->endpoint == acl_out_addr){
         // log_info("acl out done, size %u", transfer->actual_length);
-        usb_acl_out_active = 0;
-        signal_done = 1;
+        int c = usb_acl_out_transfer_index(transfer);
+        if (c >= 0 && acl_out_transfers_in_flight[c]){
+            acl_out_transfers_in_flight[c] = 0;
+            acl_out_transfers_active--;
+        }
+        // HCI_EVENT_TRANSPORT_PACKET_SENT was delayed as all transfers were in use or HCI packet buffer was used
+        if (acl_out_packet_sent_pending){
+            acl_out_packet_sent_pending = 0;
+            signal_done = 1;
+        }
 #ifdef ENABLE_SCO_OVER_HCI
     } else if (transfer->endpoint == sco_in_addr) {
         // log_info("handle_completed_transfer for SCO IN! num packets %u", transfer->NUM_ISO_PACKETS);
@@ -469,6 +596,29 @@ static void handle_completed_transfer(struct libusb_transfer *transfer){
     }   
 }
 
+// (re-)start timer for libusb timeouts, if not handled by libusb pollfds, or for polling without pollfds
+static void usb_update_timer(void){
+    if (usb_timer_active){
+        btstack_run_loop_remove_timer(&usb_timer);
+        usb_timer_active = 0;
+    }
+
+    if (libusb_state != LIB_USB_TRANSFERS_ALLOCATED) return;
+
+    uint32_t timeout_ms = ASYNC_POLLING_INTERVAL_MS;
+    if (doing_pollfds){
+        // e.g. Linux: libusb provides timerfd in its pollfds
+        if (pollfds_handle_timeouts) return;
+        struct timeval tv;
+        if (libusb_get_next_timeout(NULL, &tv) != 1) return;
+        timeout_ms = (uint32_t) tv.tv_sec * 1000 + (uint32_t) (tv.tv_usec + 999) / 1000;
+    }
+
+    btstack_run_loop_set_timer(&usb_timer, timeout_ms);
+    btstack_run_loop_add_timer(&usb_timer);
+    usb_timer_active = 1;
+}
+
 static void usb_process_ds(btstack_data_source_t *ds, btstack_data_source_callback_type_t callback_type) {
 
     UNUSED(ds);
@@ -497,6 +647,8 @@ static void usb_process_ds(btstack_data_source_t *ds, btstack_data_source_callba
             handle_packet = NULL;
         }
     }
+
+    usb_update_timer();
     // log_info("end usb_process_ds");
 }
 
@@ -511,20 +663,92 @@ static void usb_process_ts(btstack_timer_source_t *timer) {
 
     if (libusb_state != LIB_USB_TRANSFERS_ALLOCATED) return;
 
-    // actually handled the packet in the pollfds function
+    // handles events and restarts timer if needed
     usb_process_ds((struct btstack_data_source *) NULL, DATA_SOURCE_CALLBACK_READ);
+}
 
-    // Get the amount of time until next event is due
-    long msec = ASYNC_POLLING_INTERVAL_MS;
+#ifndef _WIN32
+static void usb_pollfd_add(int fd, short events){
+    // re-use inactive entry
+    usb_pollfd_t * entry;
+    for (entry = usb_pollfds; entry ; entry = entry->next){
+        if (!entry->active) break;
+    }
+    if (!entry){
+        entry = (usb_pollfd_t *) malloc(sizeof(usb_pollfd_t));
+        if (!entry){
+            log_error("Cannot allocate data source for pollfd %d", fd);
+            return;
+        }
+        entry->next = usb_pollfds;
+        usb_pollfds = entry;
+    }
+    entry->active = 1;
 
-    // Activate timer
-    btstack_run_loop_set_timer(&usb_timer, msec);
-    btstack_run_loop_add_timer(&usb_timer);
-    usb_timer_active = 1;
+    // Linux usbfs signals completed transfers with POLLOUT
+    uint16_t callback_types = 0;
+    if (events & POLLIN){
+        callback_types |= DATA_SOURCE_CALLBACK_READ;
+    }
+    if (events & POLLOUT){
+        callback_types |= DATA_SOURCE_CALLBACK_WRITE;
+    }
+
+    btstack_data_source_t *ds = &entry->data_source;
+    memset(ds, 0, sizeof(btstack_data_source_t));
+    btstack_run_loop_set_data_source_fd(ds, fd);
+    btstack_run_loop_set_data_source_handler(ds, &usb_process_ds);
+    btstack_run_loop_enable_data_source_callbacks(ds, callback_types);
+    btstack_run_loop_add_data_source(ds);
+    log_info("pollfd %d added, events %x", fd, events);
+}
+
+static void usb_pollfd_remove(int fd){
+    usb_pollfd_t * entry;
+    for (entry = usb_pollfds; entry ; entry = entry->next){
+        if (!entry->active) continue;
+        if (entry->data_source.fd != fd) continue;
+        btstack_run_loop_remove_data_source(&entry->data_source);
+        entry->active = 0;
+        log_info("pollfd %d removed", fd);
+        return;
+    }
+}
+
+LIBUSB_CALL static void usb_pollfd_added_callback(int fd, short events, void *user_data){
+    UNUSED(user_data);
+    usb_pollfd_add(fd, events);
+}
 
-    return;
+LIBUSB_CALL static void usb_pollfd_removed_callback(int fd, void *user_data){
+    UNUSED(user_data);
+    usb_pollfd_remove(fd);
 }
 
+static int usb_pollfds_init(void){
+    const struct libusb_pollfd ** pollfd = libusb_get_pollfds(NULL);
+    if (!pollfd) return 0;
+    int i;
+    for (i = 0 ; pollfd[i] ; i++){
+        usb_pollfd_add(pollfd[i]->fd, pollfd[i]->events);
+    }
+    free(pollfd);
+    // track pollfds added and removed by libusb, e.g. for timerfd
+    libusb_set_pollfd_notifiers(NULL, &usb_pollfd_added_callback, &usb_pollfd_removed_callback, NULL);
+    return 1;
+}
+
+static void usb_pollfds_deinit(void){
+    libusb_set_pollfd_notifiers(NULL, NULL, NULL, NULL);
+    usb_pollfd_t * entry;
+    for (entry = usb_pollfds; entry ; entry = entry->next){
+        if (!entry->active) continue;
+        btstack_run_loop_remove_data_source(&entry->data_source);
+        entry->active = 0;
+    }
+}
+#endif
+
 #ifndef HAVE_USB_VENDOR_ID_AND_PRODUCT_ID
 
 // list of known devices, using VendorID/ProductID tuples
@@ -762,6 +986,8 @@ static int usb_open(void){
 #endif
 
     handle_packet = NULL;
+    acl_out_transfers_active = 0;
+    acl_out_packet_sent_pending = 0;
 
     // default endpoint addresses
     event_in_addr = 0x81; // EP1, IN interrupt
@@ -770,9 +996,16 @@ static int usb_open(void){
     sco_in_addr  =  0x83; // EP3, IN isochronous
     sco_out_addr =  0x03; // EP3, OUT isochronous    
 
+    // allocate buffers and transfer lists
+    r = usb_alloc_buffers();
+    if (r < 0) return -1;
+
     // USB init
     r = libusb_init(NULL);
-    if (r < 0) return -1;
+    if (r < 0) {
+        usb_free_buffers();
+        return -1;
+    }
 
     libusb_state = LIB_USB_OPENED;
 
@@ -871,7 +1104,7 @@ static int usb_open(void){
     
     // allocate transfer handlers
     int c;
-    for (c = 0 ; c < ASYNC_BUFFERS ; c++) {
+    for (c = 0 ; c < num_async_buffers ; c++) {
         event_in_transfer[c] = libusb_alloc_transfer(0); // 0 isochronous transfers Events
         acl_in_transfer[c]  =  libusb_alloc_transfer(0); // 0 isochronous transfers ACL in
         if ( !event_in_transfer[c] || !acl_in_transfer[c]) {
@@ -881,7 +1114,10 @@ static int usb_open(void){
     }
 
     command_out_transfer = libusb_alloc_transfer(0);
-    acl_out_transfer     = libusb_alloc_transfer(0);
+    for (c = 0 ; c < num_acl_out_buffers ; c++){
+        acl_out_transfers[c] = libusb_alloc_transfer(0);
+        acl_out_transfers_in_flight[c] = 0;
+    }
 
     // TODO check for error
 
@@ -890,7 +1126,7 @@ static int usb_open(void){
 #ifdef ENABLE_SCO_OVER_HCI
 
     // incoming
-    for (c = 0 ; c < ISOC_BUFFERS ; c++) {
+    for (c = 0 ; c < num_isoc_buffers ; c++) {
         sco_in_transfer[c] = libusb_alloc_transfer(NUM_ISO_PACKETS); // isochronous transfers SCO in
         log_info("Alloc iso transfer");
         if (!sco_in_transfer[c]) {
@@ -899,7 +1135,7 @@ static int usb_open(void){
         }
         // configure sco_in handlers
         libusb_fill_iso_transfer(sco_in_transfer[c], handle, sco_in_addr, 
-            hci_sco_in_buffer[c], SCO_PACKET_SIZE, NUM_ISO_PACKETS, async_callback, NULL, 0);
+            &hci_sco_in_buffer[c * SCO_PACKET_SIZE], SCO_PACKET_SIZE, NUM_ISO_PACKETS, async_callback, NULL, 0);
         libusb_set_iso_packet_lengths(sco_in_transfer[c], ISO_PACKET_SIZE);
         r = libusb_submit_transfer(sco_in_transfer[c]);
         log_info("Submit iso transfer res = %d", r);
@@ -917,10 +1153,10 @@ static int usb_open(void){
     }
 #endif
 
-    for (c = 0 ; c < ASYNC_BUFFERS ; c++) {
+    for (c = 0 ; c < num_async_buffers ; c++) {
         // configure event_in handlers
         libusb_fill_interrupt_transfer(event_in_transfer[c], handle, event_in_addr, 
-                hci_event_in_buffer[c], HCI_ACL_BUFFER_SIZE, async_callback, NULL, 0) ;
+                &hci_event_in_buffer[c * EVENT_IN_BUFFER_SIZE], EVENT_IN_BUFFER_SIZE, async_callback, NULL, 0) ;
         r = libusb_submit_transfer(event_in_transfer[c]);
         if (r) {
             log_error("Error submitting interrupt transfer %d", r);
@@ -930,7 +1166,7 @@ static int usb_open(void){
  
         // configure acl_in handlers
         libusb_fill_bulk_transfer(acl_in_transfer[c], handle, acl_in_addr, 
-                hci_acl_in_buffer[c] + HCI_INCOMING_PRE_BUFFER_SIZE, HCI_ACL_BUFFER_SIZE, async_callback, NULL, 0) ;
+                &hci_acl_in_buffer[c * ACL_IN_BUFFER_SIZE + HCI_INCOMING_PRE_BUFFER_SIZE], HCI_ACL_BUFFER_SIZE, async_callback, NULL, 0) ;
         r = libusb_submit_transfer(acl_in_transfer[c]);
         if (r) {
             log_error("Error submitting bulk in transfer %d", r);
@@ -940,47 +1176,30 @@ static int usb_open(void){
  
      }
 
-    // Check for pollfds functionality
-    doing_pollfds = libusb_pollfds_handle_timeouts(NULL);
-    
-    // NOTE: using pollfds doesn't work on Linux, so it is disable until further investigation here
+    // Use libusb pollfds as data sources, fall back to polling if not supported
+#ifdef _WIN32
     doing_pollfds = 0;
+#else
+    doing_pollfds = usb_pollfds_init();
+#endif
+    pollfds_handle_timeouts = libusb_pollfds_handle_timeouts(NULL);
 
     if (doing_pollfds) {
-        log_info("Async using pollfds:");
-
-        const struct libusb_pollfd ** pollfd = libusb_get_pollfds(NULL);
-        for (num_pollfds = 0 ; pollfd[num_pollfds] ; num_pollfds++);
-        pollfd_data_sources = malloc(sizeof(btstack_data_source_t) * num_pollfds);
-        if (!pollfd_data_sources){
-            log_error("Cannot allocate data sources for pollfds");
-            usb_close();
-            return 1;            
-        }
-        for (r = 0 ; r < num_pollfds ; r++) {
-            btstack_data_source_t *ds = &pollfd_data_sources[r];
-            btstack_run_loop_set_data_source_fd(ds, pollfd[r]->fd);
-            btstack_run_loop_set_data_source_handler(ds, &usb_process_ds);
-            btstack_run_loop_enable_data_source_callbacks(ds, DATA_SOURCE_CALLBACK_READ);
-            btstack_run_loop_add_data_source(ds);
-            log_info("%u: %p fd: %u, events %x", r, pollfd[r], pollfd[r]->fd, pollfd[r]->events);
-        }
-        free(pollfd);
+        log_info("Async using pollfds, %s", pollfds_handle_timeouts ? "timeouts via pollfds" : "timeouts via timer");
     } else {
         log_info("Async using timers:");
-
-        usb_timer.process = usb_process_ts;
-        btstack_run_loop_set_timer(&usb_timer, ASYNC_POLLING_INTERVAL_MS);
-        btstack_run_loop_add_timer(&usb_timer);
-        usb_timer_active = 1;
     }
 
+    usb_timer.process = usb_process_ts;
+    usb_update_timer();
+
     return 0;
 }
 
 
 static int usb_close(void){
     int c;
+    int completed;
     switch (libusb_state){
         case LIB_USB_CLOSED:
             break;
@@ -993,27 +1212,30 @@ static int usb_close(void){
                 usb_timer_active = 0;
             }
 
+#ifndef _WIN32
             if (doing_pollfds){
-                int r;
-                for (r = 0 ; r < num_pollfds ; r++) {
-                    btstack_data_source_t *ds = &pollfd_data_sources[r];
-                    btstack_run_loop_remove_data_source(ds);
-                }
-                free(pollfd_data_sources);
-                pollfd_data_sources = NULL;
-                num_pollfds = 0;
+                usb_pollfds_deinit();
                 doing_pollfds = 0;
             }
+#endif
 
         case LIB_USB_INTERFACE_CLAIMED:
             // Cancel all transfers, ignore warnings for this
             libusb_set_debug(NULL, LIBUSB_LOG_LEVEL_ERROR);
-            for (c = 0 ; c < ASYNC_BUFFERS ; c++) {
+            for (c = 0 ; c < num_async_buffers ; c++) {
                 libusb_cancel_transfer(event_in_transfer[c]);
                 libusb_cancel_transfer(acl_in_transfer[c]);
             }
+            for (c = 0 ; c < num_acl_out_buffers ; c++){
+                if (acl_out_transfers_in_flight[c]) {
+                    libusb_cancel_transfer(acl_out_transfers[c]);
+                } else {
+                    libusb_free_transfer(acl_out_transfers[c]);
+                    acl_out_transfers[c] = 0;
+                }
+            }
 #ifdef ENABLE_SCO_OVER_HCI
-            for (c = 0 ; c < ISOC_BUFFERS ; c++) {
+            for (c = 0 ; c < num_isoc_buffers ; c++) {
                 libusb_cancel_transfer(sco_in_transfer[c]);
                 log_info("libusb_cancel_transfer sco_in_transfer[%d]", c);
             }
@@ -1032,24 +1254,30 @@ static int usb_close(void){
             libusb_set_debug(NULL, LIBUSB_LOG_LEVEL_WARNING);
 
             // wait until all transfers are completed
-            int completed = 0;
+            completed = 0;
             while (!completed){
                 struct timeval tv;
                 memset(&tv, 0, sizeof(struct timeval));
                 libusb_handle_events_timeout(NULL, &tv);
                 // check if all done
                 completed = 1;
-                for (c=0;c<ASYNC_BUFFERS;c++){
+                for (c=0;c<num_async_buffers;c++){
                     if (event_in_transfer[c] || acl_in_transfer[c]) {
                         completed = 0;
                         break;
                     }
                 }
+                for (c=0;c<num_acl_out_buffers;c++){
+                    if (acl_out_transfers[c]) {
+                        completed = 0;
+                        break;
+                    }
+                }
 #ifdef ENABLE_SCO_OVER_HCI
                 if (!completed) continue;
 
                 // Cancel all synchronous transfer
-                for (c = 0 ; c < ISOC_BUFFERS ; c++) {
+                for (c = 0 ; c < num_isoc_buffers ; c++) {
                     if (sco_in_transfer[c]){
                         completed = 0;
                         break;
@@ -1083,6 +1311,7 @@ static int usb_close(void){
 
     libusb_state = LIB_USB_CLOSED;
     handle = NULL;
+    usb_free_buffers();
 
     return 0;
 }
@@ -1122,23 +1351,48 @@ static int usb_send_acl_packet(uint8_t *packet, int size){
     if (libusb_state != LIB_USB_TRANSFERS_ALLOCATED) return -1;
 
     // log_info("usb_send_acl_packet enter, size %u", size);
-    
-    // prepare transfer
-    int completed = 0;
-    libusb_fill_bulk_transfer(acl_out_transfer, handle, acl_out_addr, packet, size,
-        async_callback, &completed, 0);
-    acl_out_transfer->type = LIBUSB_TRANSFER_TYPE_BULK;
 
-    // update stata before submitting transfer
-    usb_acl_out_active = 1;
+    if (size > HCI_ACL_BUFFER_SIZE) return -1;
 
-    r = libusb_submit_transfer(acl_out_transfer);
+    // get free transfer
+    int c;
+    for (c = 0 ; c < num_acl_out_buffers ; c++){
+        if (!acl_out_transfers_in_flight[c]) break;
+    }
+    if (c == num_acl_out_buffers){
+        log_error("usb_send_acl_packet: no free transfer");
+        return -1;
+    }
+
+    // copy packet, HCI can re-use its buffer after HCI_EVENT_TRANSPORT_PACKET_SENT
+    uint8_t * data = packet;
+    if (num_acl_out_buffers > 1){
+        data = &acl_out_buffer[c * HCI_ACL_BUFFER_SIZE];
+        memcpy(data, packet, size);
+    }
+
+    // prepare transfer
+    struct libusb_transfer * acl_transfer = acl_out_transfers[c];
+    libusb_fill_bulk_transfer(acl_transfer, handle, acl_out_addr, data, size, async_callback, NULL, 0);
+    acl_transfer->type = LIBUSB_TRANSFER_TYPE_BULK;
+
+    r = libusb_submit_transfer(acl_transfer);
     if (r < 0) {
-        usb_acl_out_active = 0;
         log_error("Error submitting acl transfer, %d", r);
         return -1;
     }
 
+    acl_out_transfers_in_flight[c] = 1;
+    acl_out_transfers_active++;
+
+    // notify upper stack that provided buffer can be used again, if packet was copied and there's space for another one
+    if (num_acl_out_buffers > 1 && acl_out_transfers_active < num_acl_out_buffers){
+        uint8_t event[] = { HCI_EVENT_TRANSPORT_PACKET_SENT, 0};
+        packet_handler(HCI_EVENT_PACKET, &event[0], sizeof(event));
+    } else {
+        acl_out_packet_sent_pending = 1;
+    }
+
     return 0;
 }
 
@@ -1147,7 +1401,7 @@ static int usb_can_send_packet_now(uint8_t packet_type){
         case HCI_COMMAND_DATA_PACKET:
             return !usb_command_active;
         case HCI_ACL_DATA_PACKET:
-            return !usb_acl_out_active;
+            return acl_out_transfers_active < num_acl_out_buffers;
 #ifdef ENABLE_SCO_OVER_HCI
         case HCI_SCO_DATA_PACKET:
             return sco_ring_have_space();
@@ -0,0 +1,384 @@
+/*
+ * Copyright (C) 2016 BlueKitchen GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 4. Any redistribution, use, or modification is done solely for
+ *    personal benefit and not for any commercial purpose or for
+ *    monetary gain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BLUEKITCHEN GMBH AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MATTHIAS
+ * RINGWALD OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Please inquire about commercial licensing options at 
+ * contact@bluekitchen-gmbh.com
+ *
+ */
+
+/*
+ *  btstack_run_loop_epoll.c
+ *
+ *  Run loop for Linux based on epoll: data sources are registered once
+ *  and only file descriptors that are ready get dispatched.
+ */
+
+#include "btstack_run_loop.h"
+#include "btstack_run_loop_epoll.h"
+#include "btstack_timer_wheel.h"
+#include "btstack_callback_queue.h"
+#include "btstack_debug.h"
+#include "bluetooth.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+
+// max number of events fetched per epoll_wait call
+#ifndef EPOLL_MAX_EVENTS
+#define EPOLL_MAX_EVENTS 64
+#endif
+
+// max number of pending callbacks for btstack_run_loop_execute_on_main_thread, must be power of two
+#ifndef MAX_NR_MAIN_THREAD_CALLBACKS
+#define MAX_NR_MAIN_THREAD_CALLBACKS 64
+#endif
+#if (MAX_NR_MAIN_THREAD_CALLBACKS & (MAX_NR_MAIN_THREAD_CALLBACKS - 1)) != 0
+#error "MAX_NR_MAIN_THREAD_CALLBACKS must be a power of two"
+#endif
+
+static void btstack_run_loop_epoll_dump_timer(void);
+
+// the run loop
+static btstack_timer_wheel_t timers;
+static int epoll_fd = -1;
+// events returned by last epoll_wait, entries are cleared if data source gets removed
+static struct epoll_event epoll_events[EPOLL_MAX_EVENTS];
+static int epoll_num_events;
+// start time in us, CLOCK_MONOTONIC
+static uint64_t init_us;
+// timerfd armed for the next timer, avoids rounding of the epoll_wait timeout to ms
+static btstack_data_source_t timer_fd_data_source;
+static int      timer_fd_armed;
+static uint64_t timer_fd_deadline_us;
+// callbacks from other threads, eventfd only written if no wakeup is pending
+static btstack_callback_queue_t       main_thread_callbacks;
+static btstack_callback_queue_entry_t main_thread_callback_entries[MAX_NR_MAIN_THREAD_CALLBACKS];
+static btstack_data_source_t          wakeup_data_source;
+static int                            wakeup_pending;
+
+static uint32_t btstack_run_loop_epoll_events_for_flags(uint16_t flags){
+    uint32_t events = 0;
+    if (flags & DATA_SOURCE_CALLBACK_READ){
+        events |= EPOLLIN;
+    }
+    if (flags & DATA_SOURCE_CALLBACK_WRITE){
+        events |= EPOLLOUT;
+    }
+    return events;
+}
+
+static int btstack_run_loop_epoll_update(btstack_data_source_t * ds, int op){
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events   = btstack_run_loop_epoll_events_for_flags(ds->flags);
+    event.data.ptr = ds;
+    return epoll_ctl(epoll_fd, op, ds->fd, &event);
+}
+
+/**
+ * Add data_source to run_loop. The data source is only tracked by epoll, no list walk needed
+ */
+static void btstack_run_loop_epoll_add_data_source(btstack_data_source_t *ds){
+    if (ds->fd < 0) return;
+    if (btstack_run_loop_epoll_update(ds, EPOLL_CTL_ADD) < 0 && errno != EEXIST){
+        log_error("btstack_run_loop_epoll_add_data_source: epoll_ctl for fd %u failed, errno %u", ds->fd, errno);
+    }
+}
+
+/**
+ * Remove data_source from run loop
+ */
+static int btstack_run_loop_epoll_remove_data_source(btstack_data_source_t *ds){
+    // don't dispatch pending events for removed data source
+    int i;
+    for (i = 0; i < epoll_num_events; i++){
+        if (epoll_events[i].data.ptr == ds){
+            epoll_events[i].data.ptr = NULL;
+        }
+    }
+    if (ds->fd < 0) return -1;
+    // fd already closed: kernel did remove it already
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_DEL, ds->fd, NULL) < 0 && errno != EBADF) return -1;
+    return 0;
+}
+
+/**
+ * Add timer to run_loop
+ */
+static void btstack_run_loop_epoll_add_timer(btstack_timer_source_t *ts){
+    btstack_timer_wheel_add(&timers, ts);
+    log_debug("Added timer %p at %u\n", ts, ts->timeout);
+}
+
+/**
+ * Remove timer from run loop
+ */
+static int btstack_run_loop_epoll_remove_timer(btstack_timer_source_t *ts){
+    return btstack_timer_wheel_remove(&timers, ts);
+}
+
+static void btstack_run_loop_epoll_dump_timer_entry(btstack_timer_source_t * ts){
+    log_info("timer %p, timeout %u\n", ts, ts->timeout);
+}
+
+static void btstack_run_loop_epoll_dump_timer(void){
+    btstack_timer_wheel_for_each(&timers, &btstack_run_loop_epoll_dump_timer_entry);
+}
+
+// update interest set. callbacks may be configured before the data source gets added
+static void btstack_run_loop_epoll_modify_data_source(btstack_data_source_t * ds){
+    if (ds->fd < 0) return;
+    if (btstack_run_loop_epoll_update(ds, EPOLL_CTL_MOD) < 0 && errno != ENOENT){
+        log_error("btstack_run_loop_epoll: epoll_ctl mod for fd %u failed, errno %u", ds->fd, errno);
+    }
+}
+
+static void btstack_run_loop_epoll_enable_data_source_callbacks(btstack_data_source_t * ds, uint16_t callback_types){
+    uint16_t old_flags = ds->flags;
+    ds->flags |= callback_types;
+    if (old_flags == ds->flags) return;
+    btstack_run_loop_epoll_modify_data_source(ds);
+}
+
+static void btstack_run_loop_epoll_disable_data_source_callbacks(btstack_data_source_t * ds, uint16_t callback_types){
+    uint16_t old_flags = ds->flags;
+    ds->flags &= ~callback_types;
+    if (old_flags == ds->flags) return;
+    btstack_run_loop_epoll_modify_data_source(ds);
+}
+
+static uint64_t btstack_run_loop_epoll_get_clock_us(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t) ts.tv_sec) * 1000000 + (ts.tv_nsec / 1000);
+}
+
+/**
+ * @brief Queries the current time in us since start
+ */
+static uint64_t btstack_run_loop_epoll_get_time_us(void){
+    return btstack_run_loop_epoll_get_clock_us() - init_us;
+}
+
+/**
+ * @brief Queries the current time in ms since start
+ */
+static uint32_t btstack_run_loop_epoll_get_time_ms(void){
+    return (uint32_t) (btstack_run_loop_epoll_get_time_us() / 1000);
+}
+
+static void btstack_run_loop_epoll_timer_fd_process(btstack_data_source_t * ds, btstack_data_source_callback_type_t callback_type){
+    UNUSED(callback_type);
+    // clear expiration count, timers get processed after all data sources
+    uint64_t expirations;
+    ssize_t res = read(ds->fd, &expirations, sizeof(expirations));
+    (void) res;
+    timer_fd_armed = 0;
+}
+
+// arm timerfd for the start of the ms the next timer expires in. @returns timeout for epoll_wait
+static int btstack_run_loop_epoll_prepare_wait(void){
+    uint64_t now_us = btstack_run_loop_epoll_get_time_us();
+    int32_t delta_ms = btstack_timer_wheel_get_time_until_next(&timers, (uint32_t) (now_us / 1000));
+    log_debug("btstack_run_loop_epoll_execute next timeout in %d ms", delta_ms);
+    if (delta_ms == 0) return 0;
+    if (timer_fd_data_source.fd < 0) return delta_ms;
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    if (delta_ms < 0){
+        // disarm
+        if (timer_fd_armed){
+            timerfd_settime(timer_fd_data_source.fd, 0, &spec, NULL);
+            timer_fd_armed = 0;
+        }
+        return -1;
+    }
+    uint64_t deadline_us = ((now_us / 1000) + delta_ms) * 1000;
+    if (timer_fd_armed && timer_fd_deadline_us == deadline_us) return -1;
+    uint64_t clock_us = init_us + deadline_us;
+    spec.it_value.tv_sec  = clock_us / 1000000;
+    spec.it_value.tv_nsec = (clock_us % 1000000) * 1000;
+    if (timerfd_settime(timer_fd_data_source.fd, TFD_TIMER_ABSTIME, &spec, NULL) < 0){
+        return delta_ms;
+    }
+    timer_fd_armed = 1;
+    timer_fd_deadline_us = deadline_us;
+    return -1;
+}
+
+static void btstack_run_loop_epoll_wakeup_process(btstack_data_source_t * ds, btstack_data_source_callback_type_t callback_type){
+    UNUSED(callback_type);
+    uint64_t counter;
+    ssize_t res = read(ds->fd, &counter, sizeof(counter));
+    (void) res;
+    // clear pending before draining queue, so that a callback added during drain triggers a new wakeup
+    __atomic_store_n(&wakeup_pending, 0, __ATOMIC_SEQ_CST);
+    void (*callback)(void * context);
+    void * context;
+    while (btstack_callback_queue_get(&main_thread_callbacks, &callback, &context)){
+        (*callback)(context);
+    }
+}
+
+static int btstack_run_loop_epoll_execute_on_main_thread(void (*callback)(void * context), void * context){
+    if (wakeup_data_source.fd < 0) return ERROR_CODE_COMMAND_DISALLOWED;
+    int status = btstack_callback_queue_add(&main_thread_callbacks, callback, context);
+    if (status) return status;
+    // coalesce wakeups
+    if (__atomic_exchange_n(&wakeup_pending, 1, __ATOMIC_SEQ_CST)) return 0;
+    uint64_t increment = 1;
+    ssize_t res = write(wakeup_data_source.fd, &increment, sizeof(increment));
+    (void) res;
+    return 0;
+}
+
+/**
+ * Execute run_loop
+ */
+static void btstack_run_loop_epoll_execute(void) {
+    btstack_timer_source_t *ts;
+    uint32_t now_ms;
+    int timeout_ms;
+    int i;
+
+    while (1) {
+        // get next timeout
+        timeout_ms = btstack_run_loop_epoll_prepare_wait();
+
+        // wait for ready FDs
+        epoll_num_events = epoll_wait(epoll_fd, epoll_events, EPOLL_MAX_EVENTS, timeout_ms);
+        if (epoll_num_events < 0){
+            if (errno != EINTR){
+                log_error("btstack_run_loop_epoll_execute: epoll_wait failed, errno %u", errno);
+            }
+            epoll_num_events = 0;
+        }
+
+        // process ready data sources. errors and hang-ups are reported as read to let the handler detect it
+        for (i = 0; i < epoll_num_events; i++){
+            btstack_data_source_t *ds = (btstack_data_source_t *) epoll_events[i].data.ptr;
+            if (!ds) continue;
+            uint32_t events = epoll_events[i].events;
+            if ((events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && (ds->flags & DATA_SOURCE_CALLBACK_READ)){
+                log_debug("btstack_run_loop_epoll_execute: process read ds %p with fd %u\n", ds, ds->fd);
+                ds->process(ds, DATA_SOURCE_CALLBACK_READ);
+            }
+            // data source might have been removed by read handler
+            if (!epoll_events[i].data.ptr) continue;
+            if ((events & EPOLLOUT) && (ds->flags & DATA_SOURCE_CALLBACK_WRITE)){
+                log_debug("btstack_run_loop_epoll_execute: process write ds %p with fd %u\n", ds, ds->fd);
+                ds->process(ds, DATA_SOURCE_CALLBACK_WRITE);
+            }
+        }
+        epoll_num_events = 0;
+
+        // process timers
+        now_ms = btstack_run_loop_epoll_get_time_ms();
+        while ((ts = btstack_timer_wheel_get_expired(&timers, now_ms)) != NULL) {
+            // timer has been removed before processing it to allow handler to re-register with run loop
+            log_debug("btstack_run_loop_epoll_execute: process timer %p\n", ts);
+            ts->process(ts);
+        }
+    }
+}
+
+// set timer
+static void btstack_run_loop_epoll_set_timer(btstack_timer_source_t *a, uint32_t timeout_in_ms){
+    uint32_t time_ms = btstack_run_loop_epoll_get_time_ms();
+    a->timeout = time_ms + timeout_in_ms;
+    log_debug("btstack_run_loop_epoll_set_timer to %u ms (now %u, timeout %u)", a->timeout, time_ms, timeout_in_ms);
+}
+
+static void btstack_run_loop_epoll_init(void){
+    epoll_num_events = 0;
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0){
+        log_error("btstack_run_loop_epoll_init: epoll_create1 failed, errno %u", errno);
+    }
+    init_us = btstack_run_loop_epoll_get_clock_us();
+    btstack_timer_wheel_init(&timers, btstack_run_loop_epoll_get_time_ms());
+
+    // wakeup for callbacks from other threads
+    btstack_callback_queue_init(&main_thread_callbacks, main_thread_callback_entries, MAX_NR_MAIN_THREAD_CALLBACKS);
+    wakeup_pending = 0;
+    memset(&wakeup_data_source, 0, sizeof(wakeup_data_source));
+    wakeup_data_source.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeup_data_source.fd < 0){
+        log_error("btstack_run_loop_epoll_init: eventfd failed, errno %u", errno);
+    } else {
+        btstack_run_loop_set_data_source_handler(&wakeup_data_source, &btstack_run_loop_epoll_wakeup_process);
+        wakeup_data_source.flags = DATA_SOURCE_CALLBACK_READ;
+        btstack_run_loop_epoll_add_data_source(&wakeup_data_source);
+    }
+
+    // wait for timers via timerfd, fall back to epoll_wait timeout if not available
+    timer_fd_armed = 0;
+    memset(&timer_fd_data_source, 0, sizeof(timer_fd_data_source));
+    timer_fd_data_source.fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd_data_source.fd < 0){
+        log_error("btstack_run_loop_epoll_init: timerfd_create failed, errno %u", errno);
+        return;
+    }
+    btstack_run_loop_set_data_source_handler(&timer_fd_data_source, &btstack_run_loop_epoll_timer_fd_process);
+    timer_fd_data_source.flags = DATA_SOURCE_CALLBACK_READ;
+    btstack_run_loop_epoll_add_data_source(&timer_fd_data_source);
+}
+
+static const btstack_run_loop_t btstack_run_loop_epoll = {
+    &btstack_run_loop_epoll_init,
+    &btstack_run_loop_epoll_add_data_source,
+    &btstack_run_loop_epoll_remove_data_source,
+    &btstack_run_loop_epoll_enable_data_source_callbacks,
+    &btstack_run_loop_epoll_disable_data_source_callbacks,
+    &btstack_run_loop_epoll_set_timer,
+    &btstack_run_loop_epoll_add_timer,
+    &btstack_run_loop_epoll_remove_timer,
+    &btstack_run_loop_epoll_execute,
+    &btstack_run_loop_epoll_dump_timer,
+    &btstack_run_loop_epoll_get_time_ms,
+    &btstack_run_loop_epoll_get_time_us,
+    &btstack_run_loop_epoll_execute_on_main_thread,
+};
+
+/**
+ * Provide btstack_run_loop_epoll instance
+ */
+const btstack_run_loop_t * btstack_run_loop_epoll_get_instance(void){
+    return &btstack_run_loop_epoll;
+}
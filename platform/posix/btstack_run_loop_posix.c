@@ -44,26 +44,52 @@
 #include "btstack_run_loop.h"
 #include "btstack_run_loop_posix.h"
 #include "btstack_linked_list.h"
+#include "btstack_timer_wheel.h"
+#include "btstack_callback_queue.h"
 #include "btstack_debug.h"
+#include "bluetooth.h"
 
 #ifdef _WIN32
 #include "Winsock2.h"
 #else
 #include <sys/select.h>
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+#ifdef __linux__
+#include <sys/eventfd.h>
 #endif
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/time.h>
+#include <time.h>
+
+// max number of pending callbacks for btstack_run_loop_execute_on_main_thread, must be power of two
+#ifndef MAX_NR_MAIN_THREAD_CALLBACKS
+#define MAX_NR_MAIN_THREAD_CALLBACKS 64
+#endif
+#if (MAX_NR_MAIN_THREAD_CALLBACKS & (MAX_NR_MAIN_THREAD_CALLBACKS - 1)) != 0
+#error "MAX_NR_MAIN_THREAD_CALLBACKS must be a power of two"
+#endif
 
 static void btstack_run_loop_posix_dump_timer(void);
 
 // the run loop
 static btstack_linked_list_t data_sources;
 static int data_sources_modified;
-static btstack_linked_list_t timers;
-// start time. tv_usec = 0
-static struct timeval init_tv;
+static btstack_timer_wheel_t timers;
+// start time in us
+static uint64_t init_us;
+// callbacks from other threads, wakeup fd only written if no wakeup is pending
+static btstack_callback_queue_t       main_thread_callbacks;
+static btstack_callback_queue_entry_t main_thread_callback_entries[MAX_NR_MAIN_THREAD_CALLBACKS];
+static btstack_data_source_t          wakeup_data_source;
+static int                            wakeup_pending;
+// eventfd on Linux, otherwise write end of self-pipe
+static int                            wakeup_write_fd = -1;
 
 /**
  * Add data_source to run_loop
@@ -84,42 +110,26 @@ static int btstack_run_loop_posix_remove_data_source(btstack_data_source_t *ds){
 }
 
 /**
- * Add timer to run_loop (keep list sorted)
+ * Add timer to run_loop
  */
 static void btstack_run_loop_posix_add_timer(btstack_timer_source_t *ts){
-    btstack_linked_item_t *it;
-    for (it = (btstack_linked_item_t *) &timers; it->next ; it = it->next){
-        btstack_timer_source_t * next = (btstack_timer_source_t *) it->next;
-        if (next == ts){
-            log_error( "btstack_run_loop_timer_add error: timer to add already in list!");
-            return;
-        }
-        if (next->timeout > ts->timeout) {
-            break;
-        }
-    }
-    ts->item.next = it->next;
-    it->next = (btstack_linked_item_t *) ts;
+    btstack_timer_wheel_add(&timers, ts);
     log_debug("Added timer %p at %u\n", ts, ts->timeout);
-    // btstack_run_loop_posix_dump_timer();
 }
 
 /**
  * Remove timer from run loop
  */
 static int btstack_run_loop_posix_remove_timer(btstack_timer_source_t *ts){
-    // log_info("Removed timer %x at %u\n", (int) ts, (unsigned int) ts->timeout.tv_sec);
-    // btstack_run_loop_posix_dump_timer();
-    return btstack_linked_list_remove(&timers, (btstack_linked_item_t *) ts);
+    return btstack_timer_wheel_remove(&timers, ts);
+}
+
+static void btstack_run_loop_posix_dump_timer_entry(btstack_timer_source_t * ts){
+    log_info("timer %p, timeout %u\n", ts, ts->timeout);
 }
 
 static void btstack_run_loop_posix_dump_timer(void){
-    btstack_linked_item_t *it;
-    int i = 0;
-    for (it = (btstack_linked_item_t *) timers; it ; it = it->next){
-        btstack_timer_source_t *ts = (btstack_timer_source_t*) it;
-        log_info("timer %u, timeout %u\n", i, ts->timeout);
-    }
+    btstack_timer_wheel_for_each(&timers, &btstack_run_loop_posix_dump_timer_entry);
 }
 
 static void btstack_run_loop_posix_enable_data_source_callbacks(btstack_data_source_t * ds, uint16_t callback_types){
@@ -130,15 +140,89 @@ static void btstack_run_loop_posix_disable_data_source_callbacks(btstack_data_so
     ds->flags &= ~callback_types;
 }
 
+// monotonic clock if available, not affected by NTP or wall-clock changes
+static uint64_t btstack_run_loop_posix_get_clock_us(void){
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t) ts.tv_sec) * 1000000 + (ts.tv_nsec / 1000);
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return ((uint64_t) tv.tv_sec) * 1000000 + tv.tv_usec;
+#endif
+}
+
+/**
+ * @brief Queries the current time in us since start
+ */
+static uint64_t btstack_run_loop_posix_get_time_us(void){
+    return btstack_run_loop_posix_get_clock_us() - init_us;
+}
+
 /**
  * @brief Queries the current time in ms since start
  */
 static uint32_t btstack_run_loop_posix_get_time_ms(void){
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    uint32_t time_ms = (uint32_t)((tv.tv_sec  - init_tv.tv_sec) * 1000) + (tv.tv_usec / 1000);
-    log_debug("btstack_run_loop_posix_get_time_ms: %u <- %u / %u", time_ms, (int) tv.tv_sec, (int) tv.tv_usec);
-    return time_ms;
+    return (uint32_t) (btstack_run_loop_posix_get_time_us() / 1000);
+}
+
+static void btstack_run_loop_posix_wakeup_process(btstack_data_source_t * ds, btstack_data_source_callback_type_t callback_type){
+    UNUSED(callback_type);
+#ifndef _WIN32
+    uint8_t buffer[8];
+    ssize_t res = read(ds->fd, buffer, sizeof(buffer));
+    (void) res;
+#endif
+    // clear pending before draining queue, so that a callback added during drain triggers a new wakeup
+    __atomic_store_n(&wakeup_pending, 0, __ATOMIC_SEQ_CST);
+    void (*callback)(void * context);
+    void * context;
+    while (btstack_callback_queue_get(&main_thread_callbacks, &callback, &context)){
+        (*callback)(context);
+    }
+}
+
+static int btstack_run_loop_posix_execute_on_main_thread(void (*callback)(void * context), void * context){
+    if (wakeup_write_fd < 0) return ERROR_CODE_COMMAND_DISALLOWED;
+    int status = btstack_callback_queue_add(&main_thread_callbacks, callback, context);
+    if (status) return status;
+    // coalesce wakeups
+    if (__atomic_exchange_n(&wakeup_pending, 1, __ATOMIC_SEQ_CST)) return 0;
+#ifndef _WIN32
+    // eventfd requires 8 byte write, pipe accepts any
+    uint64_t increment = 1;
+    ssize_t res = write(wakeup_write_fd, &increment, sizeof(increment));
+    (void) res;
+#endif
+    return 0;
+}
+
+static void btstack_run_loop_posix_wakeup_init(void){
+    btstack_callback_queue_init(&main_thread_callbacks, main_thread_callback_entries, MAX_NR_MAIN_THREAD_CALLBACKS);
+    wakeup_pending = 0;
+    wakeup_write_fd = -1;
+    memset(&wakeup_data_source, 0, sizeof(wakeup_data_source));
+    wakeup_data_source.fd = -1;
+#if defined(__linux__)
+    wakeup_data_source.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    wakeup_write_fd = wakeup_data_source.fd;
+#elif !defined(_WIN32)
+    int fds[2];
+    if (pipe(fds) == 0){
+        fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+        fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+        wakeup_data_source.fd = fds[0];
+        wakeup_write_fd = fds[1];
+    }
+#endif
+    if (wakeup_data_source.fd < 0){
+        log_error("btstack_run_loop_posix_init: cannot create wakeup fd");
+        return;
+    }
+    btstack_run_loop_set_data_source_handler(&wakeup_data_source, &btstack_run_loop_posix_wakeup_process);
+    wakeup_data_source.flags = DATA_SOURCE_CALLBACK_READ;
+    btstack_run_loop_posix_add_data_source(&wakeup_data_source);
 }
 
 /**
@@ -152,6 +236,7 @@ static void btstack_run_loop_posix_execute(void) {
     btstack_linked_list_iterator_t it;
     struct timeval * timeout;
     struct timeval tv;
+    uint64_t now_us;
     uint32_t now_ms;
 
     while (1) {
@@ -179,19 +264,19 @@ static void btstack_run_loop_posix_execute(void) {
             }
         }
         
-        // get next timeout
+        // get next timeout, wait until start of the ms the next timer expires in
         timeout = NULL;
-        if (timers) {
-            ts = (btstack_timer_source_t *) timers;
-            timeout = &tv;
-            now_ms = btstack_run_loop_posix_get_time_ms();
-            int delta = ts->timeout - now_ms;
-            if (delta < 0){
-                delta = 0;
+        now_us = btstack_run_loop_posix_get_time_us();
+        int32_t delta_ms = btstack_timer_wheel_get_time_until_next(&timers, (uint32_t) (now_us / 1000));
+        if (delta_ms >= 0) {
+            int64_t delta_us = ((int64_t) delta_ms) * 1000 - (int64_t) (now_us % 1000);
+            if (delta_us < 0){
+                delta_us = 0;
             }
-            tv.tv_sec  = delta / 1000;
-            tv.tv_usec = (int) (delta - (tv.tv_sec * 1000)) * 1000;
-            log_debug("btstack_run_loop_execute next timeout in %u ms", delta);
+            timeout = &tv;
+            tv.tv_sec  = delta_us / 1000000;
+            tv.tv_usec = delta_us % 1000000;
+            log_debug("btstack_run_loop_execute next timeout in %u us", (int) delta_us);
         }
                 
         // wait for ready FDs
@@ -216,13 +301,9 @@ static void btstack_run_loop_posix_execute(void) {
         
         // process timers
         now_ms = btstack_run_loop_posix_get_time_ms();
-        while (timers) {
-            ts = (btstack_timer_source_t *) timers;
-            if (ts->timeout > now_ms) break;
+        while ((ts = btstack_timer_wheel_get_expired(&timers, now_ms)) != NULL) {
+            // timer has been removed before processing it to allow handler to re-register with run loop
             log_debug("btstack_run_loop_posix_execute: process timer %p\n", ts);
-            
-            // remove timer before processing it to allow handler to re-register with run loop
-            btstack_run_loop_remove_timer(ts);
             ts->process(ts);
         }
     }
@@ -237,11 +318,9 @@ static void btstack_run_loop_posix_set_timer(btstack_timer_source_t *a, uint32_t
 
 static void btstack_run_loop_posix_init(void){
     data_sources = NULL;
-    timers = NULL;
-    // just assume that we started at tv_usec == 0
-    gettimeofday(&init_tv, NULL);
-    init_tv.tv_usec = 0;
-    log_debug("btstack_run_loop_posix_init at %u/%u", (int) init_tv.tv_sec, 0);
+    init_us = btstack_run_loop_posix_get_clock_us();
+    btstack_timer_wheel_init(&timers, btstack_run_loop_posix_get_time_ms());
+    btstack_run_loop_posix_wakeup_init();
 }
 
 
@@ -257,6 +336,8 @@ static const btstack_run_loop_t btstack_run_loop_posix = {
     &btstack_run_loop_posix_execute,
     &btstack_run_loop_posix_dump_timer,
     &btstack_run_loop_posix_get_time_ms,
+    &btstack_run_loop_posix_get_time_us,
+    &btstack_run_loop_posix_execute_on_main_thread,
 };
 
 /**
@@ -69,10 +69,13 @@ static const uint8_t * write_bytes_data;
 // block read
 static uint16_t  read_bytes_len;
 static uint8_t * read_bytes_data;
+// read returns as soon as some data is available
+static int       read_available;
 
 // callbacks
 static void (*block_sent)(void);
 static void (*block_received)(void);
+static void (*data_received)(uint16_t size);
 
 
 static int btstack_uart_posix_init(const btstack_uart_config_t * config){
@@ -131,6 +134,16 @@ static void btstack_uart_posix_process_read(btstack_data_source_t *ds) {
         log_info("h4_process: read took %u ms", end - start);
     }
     if (bytes_read < 0) return;
+
+    if (read_available){
+        if (bytes_read == 0) return;
+        read_bytes_len = 0;
+        btstack_run_loop_disable_data_source_callbacks(ds, DATA_SOURCE_CALLBACK_READ);
+        if (data_received){
+            data_received((uint16_t) bytes_read);
+        }
+        return;
+    }
     
     read_bytes_len   -= bytes_read;
     read_bytes_data  += bytes_read;
@@ -319,6 +332,10 @@ static void btstack_uart_posix_set_block_sent( void (*block_handler)(void)){
     block_sent = block_handler;
 }
 
+static void btstack_uart_posix_set_data_received( void (*data_handler)(uint16_t size)){
+    data_received = data_handler;
+}
+
 static int btstack_uart_posix_set_parity(int parity){
 
     int fd = transport_data_source.fd;
@@ -353,12 +370,20 @@ static void btstack_uart_posix_send_block(const uint8_t *data, uint16_t size){
 static void btstack_uart_posix_receive_block(uint8_t *buffer, uint16_t len){
     read_bytes_data = buffer;
     read_bytes_len = len;
+    read_available = 0;
     btstack_run_loop_enable_data_source_callbacks(&transport_data_source, DATA_SOURCE_CALLBACK_READ);
 
     // go
     // btstack_uart_posix_process_read(&transport_data_source);
 }
 
+static void btstack_uart_posix_receive_available(uint8_t *buffer, uint16_t max_len){
+    read_bytes_data = buffer;
+    read_bytes_len = max_len;
+    read_available = 1;
+    btstack_run_loop_enable_data_source_callbacks(&transport_data_source, DATA_SOURCE_CALLBACK_READ);
+}
+
 // static void btstack_uart_posix_set_sleep(uint8_t sleep){
 // }
 // static void btstack_uart_posix_set_csr_irq_handler( void (*csr_irq_handler)(void)){
@@ -375,7 +400,9 @@ static const btstack_uart_block_t btstack_uart_posix = {
     /* void (*receive_block)(uint8_t *buffer, uint16_t len); */       &btstack_uart_posix_receive_block,
     /* void (*send_block)(const uint8_t *buffer, uint16_t length); */ &btstack_uart_posix_send_block,
     /* int (*get_supported_sleep_modes); */                           NULL,
-    /* void (*set_sleep)(btstack_uart_sleep_mode_t sleep_mode); */    NULL
+    /* void (*set_sleep)(btstack_uart_sleep_mode_t sleep_mode); */    NULL,
+    /* void (*set_data_received)(void (*handler)(uint16_t size)); */  &btstack_uart_posix_set_data_received,
+    /* void (*receive_available)(uint8_t *buffer, uint16_t len); */   &btstack_uart_posix_receive_available,
 };
 
 const btstack_uart_block_t * btstack_uart_block_posix_instance(void){
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2017 BlueKitchen GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 4. Any redistribution, use, or modification is done solely for
+ *    personal benefit and not for any commercial purpose or for
+ *    monetary gain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BLUEKITCHEN GMBH AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MATTHIAS
+ * RINGWALD OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Please inquire about commercial licensing options at 
+ * contact@bluekitchen-gmbh.com
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "gatt_client_cache_db_fs.h"
+#include "btstack_debug.h"
+#include "btstack_util.h"
+
+// One file per bonded device, named after local address and le_device_db index. The cache is
+// written to a temporary file first and then renamed, so an interrupted write keeps the previous cache.
+#define CACHE_PATH_TEMPLATE "/tmp/btstack_at_%s_gatt_client_cache_%u.bin"
+#define CACHE_TEMP_SUFFIX   ".tmp"
+
+static bd_addr_t local_addr;
+static char cache_path[sizeof(CACHE_PATH_TEMPLATE) - 4 + 17 + 10 + 1];
+static char cache_temp_path[sizeof(cache_path) + sizeof(CACHE_TEMP_SUFFIX)];
+
+static char bd_addr_to_dash_str_buffer[6*3];  // 12-45-78-01-34-67\0
+static char * bd_addr_to_dash_str(bd_addr_t addr){
+    char * p = bd_addr_to_dash_str_buffer;
+    int i;
+    for (i = 0; i < 6 ; i++) {
+        *p++ = char_for_nibble((addr[i] >> 4) & 0x0F);
+        *p++ = char_for_nibble((addr[i] >> 0) & 0x0F);
+        *p++ = '-';
+    }
+    *--p = 0;
+    return (char *) bd_addr_to_dash_str_buffer;
+}
+
+static void set_path(int le_device_index){
+    snprintf(cache_path, sizeof(cache_path), CACHE_PATH_TEMPLATE, bd_addr_to_dash_str(local_addr), (unsigned int) le_device_index);
+}
+
+static void db_open(void){
+}
+
+static void db_set_local_bd_addr(bd_addr_t bd_addr){
+    memcpy(local_addr, bd_addr, 6);
+}
+
+static void db_close(void){
+}
+
+static int get_cache(int le_device_index, uint8_t * buffer, int buffer_size){
+    set_path(le_device_index);
+    if (access(cache_path, R_OK)) return 0;
+
+    FILE * rFile = fopen(cache_path, "rb");
+    if (!rFile) return 0;
+    size_t size = fread(buffer, 1, buffer_size, rFile);
+    // larger than buffer
+    if (size == (size_t) buffer_size && fgetc(rFile) != EOF){
+        size = 0;
+    }
+    fclose(rFile);
+    return (int) size;
+}
+
+static void put_cache(int le_device_index, const uint8_t * data, int size){
+    set_path(le_device_index);
+    snprintf(cache_temp_path, sizeof(cache_temp_path), "%s%s", cache_path, CACHE_TEMP_SUFFIX);
+
+    FILE * wFile = fopen(cache_temp_path, "wb");
+    if (!wFile){
+        log_error("gatt_client_cache_db_fs: cannot open %s", cache_temp_path);
+        return;
+    }
+    size_t written = fwrite(data, 1, size, wFile);
+    int err = fclose(wFile);
+    if (written != (size_t) size || err){
+        log_error("gatt_client_cache_db_fs: cannot write %s", cache_temp_path);
+        remove(cache_temp_path);
+        return;
+    }
+    if (rename(cache_temp_path, cache_path) != 0){
+        log_error("gatt_client_cache_db_fs: cannot rename %s", cache_temp_path);
+        remove(cache_temp_path);
+    }
+}
+
+static void delete_cache(int le_device_index){
+    set_path(le_device_index);
+    if (access(cache_path, R_OK)) return;
+
+    if (remove(cache_path) != 0){
+        log_error("File %s could not be deleted.\n", cache_path);
+    }
+}
+
+static const gatt_client_cache_db_t gatt_client_cache_db_fs = {
+    &db_open,
+    &db_set_local_bd_addr,
+    &db_close,
+    &get_cache,
+    &put_cache,
+    &delete_cache,
+};
+
+const gatt_client_cache_db_t * gatt_client_cache_db_fs_instance(void){
+    return &gatt_client_cache_db_fs;
+}
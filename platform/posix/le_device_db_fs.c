@@ -34,16 +34,29 @@
  * contact@bluekitchen-gmbh.com
  *
  */
- 
+
 #include "ble/le_device_db.h"
 
 #include "ble/core.h"
 
+#include <fcntl.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
+
 #include "btstack_debug.h"
+#include "btstack_run_loop.h"
+
+// Central Device db implemenation using static memory, persisted in binary file
+//
+// The file starts with a header followed by two slots per device. Each record has a sequence number and
+// a CRC-32. Updates write only the record of the changed device into the slot not holding the current
+// record. On read, the valid record with the higher sequence number is used. If a write is interrupted,
+// the previous record is still available.
+//
+// Signing counters get updated for every signed write. Counter updates are batched and written after
+// LE_DEVICE_DB_FS_FLUSH_DELAY_MS.
 
-// Central Device db implemenation using static memory
 typedef struct le_device_memory_db {
 
     // Identification
@@ -68,13 +81,48 @@ typedef struct le_device_memory_db {
     sm_key_t local_csrk;
     uint32_t local_counter;
 
+    // Persistence
+    uint32_t sequence_nr;
+    uint8_t  dirty;
+
 } le_device_memory_db_t;
 
 #define LE_DEVICE_MEMORY_SIZE 20
 #define INVALID_ENTRY_ADDR_TYPE 0xff
-#define DB_PATH_TEMPLATE "/tmp/btstack_at_%s_le_device_db.txt"
-const  char * csv_header = "# addr_type, addr, irk, ltk, ediv, rand[8], key_size, authenticated, authorized, remote_csrk, remote_counter, local_csrk, local_counter";
+#define DB_PATH_TEMPLATE "/tmp/btstack_at_%s_le_device_db.bin"
+
+#ifndef LE_DEVICE_DB_FS_FLUSH_DELAY_MS
+#define LE_DEVICE_DB_FS_FLUSH_DELAY_MS 1000
+#endif
+
+// file header: magic, version, number of devices
+#define DB_MAGIC "BTLEDB"
+#define DB_VERSION 1
+#define DB_HEADER_SIZE 8
+
+// record layout
+#define RECORD_POS_SEQUENCE_NR     0
+#define RECORD_POS_ADDR_TYPE       4
+#define RECORD_POS_ADDR            5
+#define RECORD_POS_IRK            11
+#define RECORD_POS_LTK            27
+#define RECORD_POS_EDIV           43
+#define RECORD_POS_RAND           45
+#define RECORD_POS_KEY_SIZE       53
+#define RECORD_POS_AUTHENTICATED  54
+#define RECORD_POS_AUTHORIZED     55
+#define RECORD_POS_REMOTE_CSRK    56
+#define RECORD_POS_REMOTE_COUNTER 72
+#define RECORD_POS_LOCAL_CSRK     76
+#define RECORD_POS_LOCAL_COUNTER  92
+#define RECORD_POS_CRC            96
+#define RECORD_SIZE              100
+
 static char db_path[sizeof(DB_PATH_TEMPLATE) - 2 + 17 + 1];
+static int  db_fd = -1;
+
+static btstack_timer_source_t db_flush_timer;
+static int db_flush_timer_active;
 
 static le_device_memory_db_t le_devices[LE_DEVICE_MEMORY_SIZE];
 
@@ -91,141 +139,178 @@ static char * bd_addr_to_dash_str(bd_addr_t addr){
     return (char *) bd_addr_to_dash_str_buffer;
 }
 
-static inline void write_delimiter(FILE * wFile){
-    fwrite(", ", 1, 1, wFile);
-}
-static inline void write_hex_byte(FILE * wFile, uint8_t value){
-    char buffer[2];
-    buffer[0] = char_for_nibble(value >>   4);
-    buffer[1] = char_for_nibble(value & 0x0f);
-    fwrite(buffer, 2, 1, wFile);
-}
+// CRC-32 (IEEE 802.3), nibble-wise
+static const uint32_t crc32_table[16] = {
+    0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+    0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+};
 
-static inline void write_str(FILE * wFile, const char * str){
-    fwrite(str, strlen(str), 1, wFile);
-    write_delimiter(wFile);
-}
-static void write_hex(FILE * wFile, const uint8_t * value, int len){
+static uint32_t le_device_db_fs_crc32(const uint8_t * data, int len){
+    uint32_t crc = 0xffffffff;
     int i;
     for (i = 0; i < len; i++){
-        write_hex_byte(wFile, value[i]);
+        crc = crc32_table[(crc ^ data[i]) & 0x0f] ^ (crc >> 4);
+        crc = crc32_table[(crc ^ (data[i] >> 4)) & 0x0f] ^ (crc >> 4);
     }
-    write_delimiter(wFile);
+    return ~crc;
 }
-static void write_value(FILE * wFile, uint32_t value, int len){
-    switch (len){
-        case 4:
-            write_hex_byte(wFile, value >> 24);
-        case 3:
-            write_hex_byte(wFile, value >> 16);
-        case 2:
-            write_hex_byte(wFile, value >> 8);
-        case 1:
-        default:
-            write_hex_byte(wFile, value);
-    }
-    write_delimiter(wFile);
+
+static off_t le_device_db_fs_record_offset(int index, uint32_t sequence_nr){
+    return DB_HEADER_SIZE + (off_t) (index * 2 + (sequence_nr & 1)) * RECORD_SIZE;
 }
 
-static void le_device_db_store(void) {
-    int i;
-    // open file
-    FILE * wFile = fopen(db_path,"w+");
-    if (wFile == NULL) return;
-    fwrite(csv_header, strlen(csv_header), 1, wFile);
-    fwrite("\n", 1, 1, wFile);
-    for (i=0;i<LE_DEVICE_MEMORY_SIZE;i++){
-        if (le_devices[i].addr_type == INVALID_ENTRY_ADDR_TYPE) continue;
-        write_value(wFile, le_devices[i].addr_type, 1);
-        write_str(wFile,   bd_addr_to_str(le_devices[i].addr));
-        write_hex(wFile,   le_devices[i].irk, 16);
-        write_hex(wFile,   le_devices[i].ltk, 16);
-        write_value(wFile, le_devices[i].ediv, 2);
-        write_hex(wFile,   le_devices[i].rand, 8);
-        write_value(wFile, le_devices[i].key_size, 1);
-        write_value(wFile, le_devices[i].authenticated, 1);
-        write_value(wFile, le_devices[i].authorized, 1);
-        write_hex(wFile,   le_devices[i].remote_csrk, 16);
-        write_value(wFile, le_devices[i].remote_counter, 2);
-        write_hex(wFile,   le_devices[i].local_csrk, 16);
-        write_value(wFile, le_devices[i].local_counter, 2);
-        fwrite("\n", 1, 1, wFile);
+static void le_device_db_fs_serialize(le_device_memory_db_t * device, uint8_t * record){
+    little_endian_store_32(record, RECORD_POS_SEQUENCE_NR, device->sequence_nr);
+    record[RECORD_POS_ADDR_TYPE] = (uint8_t) device->addr_type;
+    memcpy(&record[RECORD_POS_ADDR], device->addr, 6);
+    memcpy(&record[RECORD_POS_IRK], device->irk, 16);
+    memcpy(&record[RECORD_POS_LTK], device->ltk, 16);
+    little_endian_store_16(record, RECORD_POS_EDIV, device->ediv);
+    memcpy(&record[RECORD_POS_RAND], device->rand, 8);
+    record[RECORD_POS_KEY_SIZE]      = device->key_size;
+    record[RECORD_POS_AUTHENTICATED] = device->authenticated;
+    record[RECORD_POS_AUTHORIZED]    = device->authorized;
+    memcpy(&record[RECORD_POS_REMOTE_CSRK], device->remote_csrk, 16);
+    little_endian_store_32(record, RECORD_POS_REMOTE_COUNTER, device->remote_counter);
+    memcpy(&record[RECORD_POS_LOCAL_CSRK], device->local_csrk, 16);
+    little_endian_store_32(record, RECORD_POS_LOCAL_COUNTER, device->local_counter);
+    little_endian_store_32(record, RECORD_POS_CRC, le_device_db_fs_crc32(record, RECORD_POS_CRC));
+}
+
+static void le_device_db_fs_deserialize(const uint8_t * record, le_device_memory_db_t * device){
+    device->sequence_nr = little_endian_read_32(record, RECORD_POS_SEQUENCE_NR);
+    device->addr_type   = record[RECORD_POS_ADDR_TYPE];
+    memcpy(device->addr, &record[RECORD_POS_ADDR], 6);
+    memcpy(device->irk, &record[RECORD_POS_IRK], 16);
+    memcpy(device->ltk, &record[RECORD_POS_LTK], 16);
+    device->ediv = little_endian_read_16(record, RECORD_POS_EDIV);
+    memcpy(device->rand, &record[RECORD_POS_RAND], 8);
+    device->key_size      = record[RECORD_POS_KEY_SIZE];
+    device->authenticated = record[RECORD_POS_AUTHENTICATED];
+    device->authorized    = record[RECORD_POS_AUTHORIZED];
+    memcpy(device->remote_csrk, &record[RECORD_POS_REMOTE_CSRK], 16);
+    device->remote_counter = little_endian_read_32(record, RECORD_POS_REMOTE_COUNTER);
+    memcpy(device->local_csrk, &record[RECORD_POS_LOCAL_CSRK], 16);
+    device->local_counter = little_endian_read_32(record, RECORD_POS_LOCAL_COUNTER);
+    device->dirty = 0;
+}
+
+static int le_device_db_fs_record_valid(const uint8_t * record){
+    return little_endian_read_32(record, RECORD_POS_CRC) == le_device_db_fs_crc32(record, RECORD_POS_CRC);
+}
+
+static int le_device_db_fs_open(void){
+    if (db_fd >= 0) return 1;
+    db_fd = open(db_path, O_RDWR | O_CREAT, 0644);
+    if (db_fd < 0){
+        log_error("le_device_db_fs: cannot open %s", db_path);
+        return 0;
     }
-    fclose(wFile);
+    return 1;
 }
-static void read_delimiter(FILE * wFile){
-    fgetc(wFile);
+
+static void le_device_db_fs_write_header(void){
+    uint8_t header[DB_HEADER_SIZE];
+    memcpy(header, DB_MAGIC, 6);
+    header[6] = DB_VERSION;
+    header[7] = LE_DEVICE_MEMORY_SIZE;
+    if (pwrite(db_fd, header, DB_HEADER_SIZE, 0) != DB_HEADER_SIZE){
+        log_error("le_device_db_fs: writing header failed");
+    }
 }
 
-static uint8_t read_hex_byte(FILE * wFile){
-    int c = fgetc(wFile);
-    if (c == ':') {
-        c = fgetc(wFile);
+// write record into the slot not used by current record
+static void le_device_db_fs_store_device(int index){
+    le_device_memory_db_t * device = &le_devices[index];
+    device->dirty = 0;
+    if (!le_device_db_fs_open()) return;
+    device->sequence_nr++;
+    uint8_t record[RECORD_SIZE];
+    le_device_db_fs_serialize(device, record);
+    if (pwrite(db_fd, record, RECORD_SIZE, le_device_db_fs_record_offset(index, device->sequence_nr)) != RECORD_SIZE){
+        log_error("le_device_db_fs: writing record %u failed", index);
     }
-    int d = fgetc(wFile);
-    return nibble_for_char(c) << 4 | nibble_for_char(d);
 }
 
-static void read_hex(FILE * wFile, uint8_t * buffer, int len){
+static void le_device_db_fs_flush(void){
     int i;
-    for (i=0;i<len;i++){
-        buffer[i] = read_hex_byte(wFile);
+    for (i=0;i<LE_DEVICE_MEMORY_SIZE;i++){
+        if (!le_devices[i].dirty) continue;
+        le_device_db_fs_store_device(i);
     }
-    read_delimiter(wFile);
 }
 
-static uint32_t read_value(FILE * wFile, int len){
-    uint32_t res = 0;
-    int i;
-    for (i=0;i<len;i++){
-        res = res << 8 | read_hex_byte(wFile);
+static void le_device_db_fs_flush_timer_handler(btstack_timer_source_t * ts){
+    UNUSED(ts);
+    db_flush_timer_active = 0;
+    le_device_db_fs_flush();
+}
+
+// mark device for deferred write
+static void le_device_db_fs_store_device_deferred(int index){
+    le_devices[index].dirty = 1;
+    if (db_flush_timer_active) return;
+    btstack_run_loop_set_timer_handler(&db_flush_timer, &le_device_db_fs_flush_timer_handler);
+    btstack_run_loop_set_timer(&db_flush_timer, LE_DEVICE_DB_FS_FLUSH_DELAY_MS);
+    btstack_run_loop_add_timer(&db_flush_timer);
+    db_flush_timer_active = 1;
+}
+
+static void le_device_db_fs_close(void){
+    if (db_flush_timer_active){
+        btstack_run_loop_remove_timer(&db_flush_timer);
+        db_flush_timer_active = 0;
     }
-    read_delimiter(wFile);
-    return res;
+    if (db_fd < 0) return;
+    le_device_db_fs_flush();
+    close(db_fd);
+    db_fd = -1;
 }
 
 static void le_device_db_read(void){
-    // open file
-    FILE * wFile = fopen(db_path,"r");
-    if (wFile == NULL) return;
-    // skip header
-    while (1) {
-        int c = fgetc(wFile);
-        if (feof(wFile)) goto exit;
-        if (c == '\n') break;
+    if (!le_device_db_fs_open()) return;
+
+    // validate header, start with new file otherwise
+    uint8_t header[DB_HEADER_SIZE];
+    if (pread(db_fd, header, DB_HEADER_SIZE, 0) != DB_HEADER_SIZE
+        || memcmp(header, DB_MAGIC, 6) != 0 || header[6] != DB_VERSION || header[7] != LE_DEVICE_MEMORY_SIZE){
+        log_info("le_device_db_fs: create new db %s", db_path);
+        if (ftruncate(db_fd, 0) != 0){
+            log_error("le_device_db_fs: truncate failed");
+        }
+        le_device_db_fs_write_header();
+        return;
     }
-    // read entries
+
+    // read entries, use valid record with higher sequence number
     int i;
-    for (i=0;i<LE_DEVICE_MEMORY_SIZE && !feof(wFile);i++){
-        le_devices[i].addr_type = read_value(wFile, 1);
-        read_hex(wFile,   le_devices[i].addr, 6);
-        read_hex(wFile,   le_devices[i].irk, 16);
-        read_hex(wFile,   le_devices[i].ltk, 16);
-        le_devices[i].ediv = read_value(wFile, 2);
-        read_hex(wFile,   le_devices[i].rand, 8);
-        le_devices[i].key_size      = read_value(wFile, 1);
-        le_devices[i].authenticated = read_value(wFile, 1);
-        le_devices[i].authorized    = read_value(wFile, 1);
-        read_hex(wFile,   le_devices[i].remote_csrk, 16);
-        le_devices[i].remote_counter = read_value(wFile, 2);
-        read_hex(wFile,   le_devices[i].local_csrk, 16);
-        le_devices[i].local_counter = read_value(wFile, 2);
-        // read newling
-        fgetc(wFile);
+    for (i=0;i<LE_DEVICE_MEMORY_SIZE;i++){
+        uint8_t records[2][RECORD_SIZE];
+        if (pread(db_fd, records, sizeof(records), le_device_db_fs_record_offset(i, 0)) != sizeof(records)) break;
+        int valid_0 = le_device_db_fs_record_valid(records[0]);
+        int valid_1 = le_device_db_fs_record_valid(records[1]);
+        if (!valid_0 && !valid_1) continue;
+        int slot = valid_1 ? 1 : 0;
+        if (valid_0 && valid_1){
+            int32_t delta = (int32_t) (little_endian_read_32(records[1], RECORD_POS_SEQUENCE_NR) - little_endian_read_32(records[0], RECORD_POS_SEQUENCE_NR));
+            slot = delta > 0 ? 1 : 0;
+        }
+        le_device_db_fs_deserialize(records[slot], &le_devices[i]);
     }
-exit:
-    fclose(wFile);
 }
 
 void le_device_db_init(void){
+    le_device_db_fs_close();
     int i;
     for (i=0;i<LE_DEVICE_MEMORY_SIZE;i++){
+        memset(&le_devices[i], 0, sizeof(le_device_memory_db_t));
         le_devices[i].addr_type = INVALID_ENTRY_ADDR_TYPE;
     }
     sprintf(db_path, DB_PATH_TEMPLATE, "00-00-00-00-00-00");
 }
 
 void le_device_db_set_local_bd_addr(bd_addr_t addr){
+    le_device_db_fs_close();
     sprintf(db_path, DB_PATH_TEMPLATE, bd_addr_to_dash_str(addr));
     log_info("le_device_db_fs: path %s", db_path);
     le_device_db_read();
@@ -245,7 +330,7 @@ int le_device_db_count(void){
 // free device
 void le_device_db_remove(int index){
     le_devices[index].addr_type = INVALID_ENTRY_ADDR_TYPE;
-    le_device_db_store();
+    le_device_db_fs_store_device(index);
 }
 
 int le_device_db_add(int addr_type, bd_addr_t addr, sm_key_t irk){
@@ -268,7 +353,7 @@ int le_device_db_add(int addr_type, bd_addr_t addr, sm_key_t irk){
     memcpy(le_devices[index].irk, irk, 16);
     le_devices[index].remote_counter = 0; 
 
-    le_device_db_store();
+    le_device_db_fs_store_device(index);
 
     return index;
 }
@@ -292,7 +377,7 @@ void le_device_db_encryption_set(int index, uint16_t ediv, uint8_t rand[8], sm_k
     device->authenticated = authenticated;
     device->authorized = authorized;
 
-    le_device_db_store();
+    le_device_db_fs_store_device(index);
 }
 
 void le_device_db_encryption_get(int index, uint16_t * ediv, uint8_t rand[8], sm_key_t ltk, int * key_size, int * authenticated, int * authorized){
@@ -323,7 +408,7 @@ void le_device_db_remote_csrk_set(int index, sm_key_t csrk){
     }
     if (csrk) memcpy(le_devices[index].remote_csrk, csrk, 16);
 
-    le_device_db_store();
+    le_device_db_fs_store_device(index);
 }
 
 void le_device_db_local_csrk_get(int index, sm_key_t csrk){
@@ -341,7 +426,7 @@ void le_device_db_local_csrk_set(int index, sm_key_t csrk){
     }
     if (csrk) memcpy(le_devices[index].local_csrk, csrk, 16);
 
-    le_device_db_store();
+    le_device_db_fs_store_device(index);
 }
 
 // query last used/seen signing counter
@@ -353,7 +438,7 @@ uint32_t le_device_db_remote_counter_get(int index){
 void le_device_db_remote_counter_set(int index, uint32_t counter){
     le_devices[index].remote_counter = counter;
 
-    le_device_db_store();
+    le_device_db_fs_store_device_deferred(index);
 }
 
 // query last used/seen signing counter
@@ -365,7 +450,7 @@ uint32_t le_device_db_local_counter_get(int index){
 void le_device_db_local_counter_set(int index, uint32_t counter){
     le_devices[index].local_counter = counter;
 
-    le_device_db_store();
+    le_device_db_fs_store_device_deferred(index);
 }
 
 void le_device_db_dump(void){
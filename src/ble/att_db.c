@@ -37,6 +37,7 @@
 
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "ble/att_db.h"
@@ -56,7 +57,7 @@ static int is_Bluetooth_Base_UUID(uint8_t const *uuid){
     
 }
 
-static uint16_t uuid16_from_uuid(uint16_t uuid_len, uint8_t * uuid){
+static uint16_t uuid16_from_uuid(uint16_t uuid_len, uint8_t const * uuid){
     if (uuid_len == 2) return little_endian_read_16(uuid, 0);
     if (!is_Bluetooth_Base_UUID(uuid)) return 0;
     return little_endian_read_16(uuid, 12);
@@ -70,11 +71,49 @@ static uint8_t  att_prepare_write_error_code   = 0;
 static uint16_t att_prepare_write_error_handle = 0x0000;
 
 static btstack_linked_list_t service_handlers;
+static att_service_handler_t * att_service_handler_last_used;
+
+#ifdef ENABLE_ATT_DB_INDEX
+
+// ATT DB index, built by att_set_db or generated by compile_gatt.py, see att_set_db_index
+// - number of attributes, services and UUID16 entries
+// - handle and offset in att_db for each attribute, ascending by handle
+// - start and end handle for each service
+// - UUID16 and handle for each attribute with UUID16 or Bluetooth Base UUID128, sorted by UUID16 and handle
+#define ATT_DB_INDEX_HEADER_SIZE 3
+
+// without storage for an index built at runtime, only generated indices can be used
+#if defined(MAX_NR_ATT_DB_INDEX_ENTRIES) || defined(HAVE_MALLOC)
+#define ATT_DB_INDEX_BUILD
+#endif
+
+#ifdef MAX_NR_ATT_DB_INDEX_ENTRIES
+// number of services and UUID16 entries is limited by number of attributes
+static uint16_t   att_db_index_storage[ATT_DB_INDEX_HEADER_SIZE + 6 * MAX_NR_ATT_DB_INDEX_ENTRIES];
+#elif defined(HAVE_MALLOC)
+static uint16_t * att_db_index_storage;
+#endif
+
+// 0 if no index available -> linear scan
+static uint16_t         att_db_index_num_attributes;
+static uint16_t         att_db_index_num_services;
+static uint16_t         att_db_index_num_uuid16s;
+static const uint16_t * att_db_index_attributes;
+static const uint16_t * att_db_index_services;
+static const uint16_t * att_db_index_uuid16s;
+static uint16_t         att_db_index_end_offset;
+// handles without gaps allow direct lookup
+static int              att_db_index_contiguous;
+
+#endif
 
 // new java-style iterator
 typedef struct att_iterator {
     // private
     uint8_t const * att_ptr;
+#ifdef ENABLE_ATT_DB_INDEX
+    uint16_t index_pos;
+#endif
     // public
     uint16_t size;
     uint16_t flags;
@@ -142,25 +181,311 @@ static int att_iterator_match_uuid(att_iterator_t *it, uint8_t *uuid, uint16_t u
     return little_endian_read_16(uuid, 12) == little_endian_read_16(it->uuid, 0);
 }
 
+static int att_iterator_match_service_declaration(att_iterator_t *it){
+    return att_iterator_match_uuid16(it, GATT_PRIMARY_SERVICE_UUID) || att_iterator_match_uuid16(it, GATT_SECONDARY_SERVICE_UUID);
+}
 
-static int att_find_handle(att_iterator_t *it, uint16_t handle){
-    if (handle == 0) return 0;
+#ifdef ENABLE_ATT_DB_INDEX
+
+// generated index could be out of sync with db
+static int att_db_index_matches_db(const uint16_t * db_index){
+    const uint16_t * attributes = &db_index[ATT_DB_INDEX_HEADER_SIZE];
+    uint16_t pos = 0;
+    att_iterator_t it;
+    att_iterator_init(&it);
+    while (att_iterator_has_next(&it)){
+        uint16_t offset = it.att_ptr - att_db;
+        att_iterator_fetch_next(&it);
+        if (it.handle == 0) break;
+        if (pos >= db_index[0]) return 0;
+        if (attributes[2 * pos] != it.handle || attributes[2 * pos + 1] != offset) return 0;
+        pos++;
+    }
+    return pos == db_index[0];
+}
+
+static void att_db_index_activate(const uint16_t * db_index){
+    att_db_index_num_attributes = 0;
+    if (db_index == NULL || att_db == NULL) return;
+
+    uint16_t num_attributes = db_index[0];
+    if (num_attributes == 0) return;
+    const uint16_t * attributes = &db_index[ATT_DB_INDEX_HEADER_SIZE];
+    uint16_t first_handle = attributes[0];
+    uint16_t last_handle  = attributes[2 * (num_attributes - 1)];
+    uint16_t last_offset  = attributes[2 * (num_attributes - 1) + 1];
+
+    att_db_index_num_services = db_index[1];
+    att_db_index_num_uuid16s  = db_index[2];
+    att_db_index_attributes   = attributes;
+    att_db_index_services     = &attributes[2 * num_attributes];
+    att_db_index_uuid16s      = &att_db_index_services[2 * att_db_index_num_services];
+    att_db_index_end_offset   = last_offset + little_endian_read_16(att_db, last_offset);
+    att_db_index_contiguous   = (last_handle - first_handle) == (num_attributes - 1);
+    att_db_index_num_attributes = num_attributes;
+    log_info("att_db_index: %u attributes, %u services, contiguous %u", num_attributes, att_db_index_num_services, att_db_index_contiguous);
+}
+
+#ifdef ATT_DB_INDEX_BUILD
+static uint16_t * att_db_index_allocate(uint16_t num_attributes, uint16_t num_services, uint16_t num_uuid16s){
+#ifdef MAX_NR_ATT_DB_INDEX_ENTRIES
+    UNUSED(num_services);
+    UNUSED(num_uuid16s);
+    if (num_attributes > MAX_NR_ATT_DB_INDEX_ENTRIES) {
+        log_error("att_db_index: %u attributes > MAX_NR_ATT_DB_INDEX_ENTRIES, using linear scan", num_attributes);
+        return NULL;
+    }
+    return att_db_index_storage;
+#else
+    free(att_db_index_storage);
+    uint32_t size = ATT_DB_INDEX_HEADER_SIZE + 2 * (num_attributes + num_services + num_uuid16s);
+    att_db_index_storage = (uint16_t *) malloc(size * sizeof(uint16_t));
+    if (att_db_index_storage == NULL){
+        log_error("att_db_index: malloc failed, using linear scan");
+    }
+    return att_db_index_storage;
+#endif
+}
+
+static void att_db_index_build(void){
+    att_db_index_num_attributes = 0;
+
+    // count attributes, validate that handles are ascending and all offsets fit into 16 bit
+    uint16_t num_attributes = 0;
+    uint16_t num_services   = 0;
+    uint16_t num_uuid16s    = 0;
+    uint16_t last_handle    = 0;
+    att_iterator_t it;
+    att_iterator_init(&it);
+    while (att_iterator_has_next(&it)){
+        att_iterator_fetch_next(&it);
+        if (it.handle == 0) break;
+        if (it.handle <= last_handle){
+            log_error("att_db_index: handle 0x%04x not ascending, using linear scan", it.handle);
+            return;
+        }
+        if (it.value + it.value_len - att_db > 0xffff){
+            log_error("att_db_index: db larger than 64 kB, using linear scan");
+            return;
+        }
+        last_handle = it.handle;
+        num_attributes++;
+        if (att_iterator_match_service_declaration(&it)) num_services++;
+        if (uuid16_from_uuid((it.flags & ATT_PROPERTY_UUID128) ? 16 : 2, it.uuid)) num_uuid16s++;
+    }
+    if (num_attributes == 0) return;
+
+    uint16_t * db_index = att_db_index_allocate(num_attributes, num_services, num_uuid16s);
+    if (db_index == NULL) return;
+    db_index[0] = num_attributes;
+    db_index[1] = num_services;
+    db_index[2] = num_uuid16s;
+    uint16_t * attributes = &db_index[ATT_DB_INDEX_HEADER_SIZE];
+    uint16_t * services   = &attributes[2 * num_attributes];
+    uint16_t * uuid16s    = &services[2 * num_services];
+
+    // collect attributes and close service groups
+    uint16_t attribute_pos = 0;
+    uint16_t service_pos   = 0;
+    uint16_t uuid16_pos    = 0;
+    last_handle = 0;
+    att_iterator_init(&it);
+    while (attribute_pos < num_attributes){
+        uint16_t offset = it.att_ptr - att_db;
+        att_iterator_fetch_next(&it);
+        attributes[2 * attribute_pos]     = it.handle;
+        attributes[2 * attribute_pos + 1] = offset;
+        attribute_pos++;
+        if (att_iterator_match_service_declaration(&it)){
+            if (service_pos > 0){
+                services[2 * service_pos - 1] = last_handle;
+            }
+            services[2 * service_pos] = it.handle;
+            service_pos++;
+        }
+        uint16_t uuid16 = uuid16_from_uuid((it.flags & ATT_PROPERTY_UUID128) ? 16 : 2, it.uuid);
+        if (uuid16){
+            // insertion sort is stable and keeps handle order for each UUID16
+            uint16_t pos = uuid16_pos;
+            while (pos > 0 && uuid16s[2 * pos - 2] > uuid16){
+                uuid16s[2 * pos]     = uuid16s[2 * pos - 2];
+                uuid16s[2 * pos + 1] = uuid16s[2 * pos - 1];
+                pos--;
+            }
+            uuid16s[2 * pos]     = uuid16;
+            uuid16s[2 * pos + 1] = it.handle;
+            uuid16_pos++;
+        }
+        last_handle = it.handle;
+    }
+    if (service_pos > 0){
+        services[2 * service_pos - 1] = last_handle;
+    }
+
+    att_db_index_activate(db_index);
+}
+#endif
+
+// returns position of first attribute with handle >= given handle, or att_db_index_num_attributes
+static uint16_t att_db_index_lower_bound(uint16_t handle){
+    uint16_t first_handle = att_db_index_attributes[0];
+    if (att_db_index_contiguous){
+        if (handle <= first_handle) return 0;
+        if (handle - first_handle >= att_db_index_num_attributes) return att_db_index_num_attributes;
+        return handle - first_handle;
+    }
+    uint16_t low  = 0;
+    uint16_t high = att_db_index_num_attributes;
+    while (low < high){
+        uint16_t mid = (low + high) / 2;
+        if (att_db_index_attributes[2 * mid] < handle){
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// returns position of first UUID16 entry with (uuid16, handle) >= given (uuid16, handle)
+static uint16_t att_db_index_lower_bound_uuid16(uint16_t uuid16, uint16_t handle){
+    uint16_t low  = 0;
+    uint16_t high = att_db_index_num_uuid16s;
+    while (low < high){
+        uint16_t mid = (low + high) / 2;
+        uint16_t entry_uuid16 = att_db_index_uuid16s[2 * mid];
+        if (entry_uuid16 < uuid16 || (entry_uuid16 == uuid16 && att_db_index_uuid16s[2 * mid + 1] < handle)){
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+static uint16_t att_db_index_group_end_handle(uint16_t handle){
+    // find last service that starts at or before handle
+    uint16_t low  = 0;
+    uint16_t high = att_db_index_num_services;
+    while (low < high){
+        uint16_t mid = (low + high) / 2;
+        if (att_db_index_services[2 * mid] <= handle){
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (low > 0) return att_db_index_services[2 * low - 1];
+    // attributes before first service
+    uint16_t pos = att_db_index_num_attributes;
+    if (att_db_index_num_services){
+        pos = att_db_index_lower_bound(att_db_index_services[0]);
+    }
+    return att_db_index_attributes[2 * (pos - 1)];
+}
+#endif
+
+// position iterator on first attribute with handle >= start_handle
+static void att_iterator_init_at_handle(att_iterator_t *it, uint16_t start_handle){
+#ifdef ENABLE_ATT_DB_INDEX
+    if (att_db_index_num_attributes){
+        uint16_t pos = att_db_index_lower_bound(start_handle);
+        if (pos < att_db_index_num_attributes){
+            it->att_ptr = att_db + att_db_index_attributes[2 * pos + 1];
+        } else {
+            it->att_ptr = att_db + att_db_index_end_offset;
+        }
+        return;
+    }
+#endif
     att_iterator_init(it);
     while (att_iterator_has_next(it)){
+        uint16_t size = little_endian_read_16(it->att_ptr, 0);
+        if (size == 0) return;
+        if (little_endian_read_16(it->att_ptr, 4) >= start_handle) return;
+        it->att_ptr += size;
+    }
+}
+
+// iterate over attributes with given type in handle range, use with att_iterator_fetch_next_for_uuid
+static void att_iterator_init_for_uuid(att_iterator_t *it, uint16_t start_handle, uint8_t *uuid, uint16_t uuid_len){
+#ifdef ENABLE_ATT_DB_INDEX
+    uint16_t uuid16 = uuid16_from_uuid(uuid_len, uuid);
+    if (att_db_index_num_attributes && uuid16){
+        it->index_pos = att_db_index_lower_bound_uuid16(uuid16, start_handle);
+        return;
+    }
+#else
+    UNUSED(uuid);
+    UNUSED(uuid_len);
+#endif
+    att_iterator_init_at_handle(it, start_handle);
+}
+
+// returns 1 if another attribute with given type up to end_handle was found
+static int att_iterator_fetch_next_for_uuid(att_iterator_t *it, uint16_t end_handle, uint8_t *uuid, uint16_t uuid_len){
+#ifdef ENABLE_ATT_DB_INDEX
+    // UUID128 not based on Bluetooth Base UUID are not indexed
+    uint16_t uuid16 = uuid16_from_uuid(uuid_len, uuid);
+    if (att_db_index_num_attributes && uuid16){
+        if (it->index_pos >= att_db_index_num_uuid16s) return 0;
+        if (att_db_index_uuid16s[2 * it->index_pos] != uuid16) return 0;
+        uint16_t handle = att_db_index_uuid16s[2 * it->index_pos + 1];
+        if (handle > end_handle) return 0;
+        it->index_pos++;
+        att_iterator_init_at_handle(it, handle);
         att_iterator_fetch_next(it);
-        if (it->handle != handle) continue;
         return 1;
     }
+#endif
+    while (att_iterator_has_next(it)){
+        att_iterator_fetch_next(it);
+        if (it->handle == 0) return 0;
+        if (it->handle > end_handle) return 0;
+        if (att_iterator_match_uuid(it, uuid, uuid_len)) return 1;
+    }
     return 0;
 }
 
+// returns last handle before next service declaration or end of db for the attribute just fetched
+static uint16_t att_iterator_group_end_handle(att_iterator_t *it){
+#ifdef ENABLE_ATT_DB_INDEX
+    if (att_db_index_num_attributes){
+        return att_db_index_group_end_handle(it->handle);
+    }
+#endif
+    uint16_t group_end_handle = it->handle;
+    att_iterator_t next = *it;
+    while (att_iterator_has_next(&next)){
+        att_iterator_fetch_next(&next);
+        if (next.handle == 0) break;
+        if (att_iterator_match_service_declaration(&next)) break;
+        group_end_handle = next.handle;
+    }
+    return group_end_handle;
+}
+
+static int att_find_handle(att_iterator_t *it, uint16_t handle){
+    if (handle == 0) return 0;
+    att_iterator_init_at_handle(it, handle);
+    if (!att_iterator_has_next(it)) return 0;
+    att_iterator_fetch_next(it);
+    return it->handle == handle;
+}
+
 static att_service_handler_t * att_service_handler_for_handle(uint16_t handle){
+    // consecutive requests usually target the same service
+    att_service_handler_t * last_used = att_service_handler_last_used;
+    if (last_used && last_used->start_handle <= handle && handle <= last_used->end_handle){
+        return last_used;
+    }
     btstack_linked_list_iterator_t it;
     btstack_linked_list_iterator_init(&it, &service_handlers);
     while (btstack_linked_list_iterator_has_next(&it)){
         att_service_handler_t * handler = (att_service_handler_t*) btstack_linked_list_iterator_next(&it);
         if (handler->start_handle > handle) continue;
         if (handler->end_handle   < handle) continue;
+        att_service_handler_last_used = handler;
         return handler;
     }
     return NULL;
@@ -217,6 +542,27 @@ static int att_copy_value(att_iterator_t *it, uint16_t offset, uint8_t * buffer,
 
 void att_set_db(uint8_t const * db){
     att_db = db;
+#ifdef ENABLE_ATT_DB_INDEX
+#ifdef ATT_DB_INDEX_BUILD
+    att_db_index_build();
+#else
+    att_db_index_num_attributes = 0;
+#endif
+#endif
+}
+
+void att_set_db_index(const uint16_t * db_index){
+#ifdef ENABLE_ATT_DB_INDEX
+    if (db_index && !att_db_index_matches_db(db_index)){
+        log_error("att_set_db_index: index does not match db, using linear scan");
+        att_db_index_num_attributes = 0;
+        return;
+    }
+    att_db_index_activate(db_index);
+#else
+    UNUSED(db_index);
+    log_error("att_set_db_index: ENABLE_ATT_DB_INDEX not defined");
+#endif
 }
 
 void att_set_read_callback(att_read_callback_t callback){
@@ -361,12 +707,11 @@ static uint16_t handle_find_information_request2(att_connection_t * att_connecti
     uint16_t uuid_len = 0;
     
     att_iterator_t it;
-    att_iterator_init(&it);
+    att_iterator_init_at_handle(&it, start_handle);
     while (att_iterator_has_next(&it)){
         att_iterator_fetch_next(&it);
         if (!it.handle) break;
         if (it.handle > end_handle) break;
-        if (it.handle < start_handle) continue;
                 
         // log_info("Handle 0x%04x", it.handle);
         
@@ -438,43 +783,27 @@ static uint16_t handle_find_by_type_value_request2(att_connection_t * att_connec
         return setup_error_invalid_handle(response_buffer, request_type, start_handle);
     }
 
-    uint16_t offset      = 1;
-    uint16_t in_group    = 0;
-    uint16_t prev_handle = 0;
-    
+    uint16_t offset = 1;
+    uint8_t  attribute_type_uuid[2];
+    little_endian_store_16(attribute_type_uuid, 0, attribute_type);
+
     att_iterator_t it;
-    att_iterator_init(&it);
-    while (att_iterator_has_next(&it)){
-        att_iterator_fetch_next(&it);
-        
-        if (it.handle && it.handle < start_handle) continue;
-        if (it.handle > end_handle) break;  // (1)
-        
-        // close current tag, if within a group and a new service definition starts or we reach end of att db
-        if (in_group &&
-            (it.handle == 0 || att_iterator_match_uuid16(&it, GATT_PRIMARY_SERVICE_UUID) || att_iterator_match_uuid16(&it, GATT_SECONDARY_SERVICE_UUID))){
-            
-            log_info("End of group, handle 0x%04x", prev_handle);
-            little_endian_store_16(response_buffer, offset, prev_handle);
-            offset += 2;
-            in_group = 0;
-            
-            // check if space for another handle pair available
-            if (offset + 4 > response_buffer_size){
-                break;
-            }
-        }
-        
-        // keep track of previous handle
-        prev_handle = it.handle;
-        
+    att_iterator_init_for_uuid(&it, start_handle, attribute_type_uuid, sizeof(attribute_type_uuid));
+    while (att_iterator_fetch_next_for_uuid(&it, end_handle, attribute_type_uuid, sizeof(attribute_type_uuid))){  // (1)
+
         // does current attribute match
-        if (it.handle && att_iterator_match_uuid16(&it, attribute_type) && attribute_len == it.value_len && memcmp(attribute_value, it.value, it.value_len) == 0){
-            log_info("Begin of group, handle 0x%04x", it.handle);
-            little_endian_store_16(response_buffer, offset, it.handle);
-            offset += 2;
-            in_group = 1;
-        }
+        if (attribute_len != it.value_len || memcmp(attribute_value, it.value, it.value_len) != 0) continue;
+
+        // check if space for another handle pair available
+        if (offset + 4 > response_buffer_size) break;
+
+        // group ends before next service definition starts or at end of att db
+        uint16_t group_end_handle = att_iterator_group_end_handle(&it);
+        log_info("Group 0x%04x - 0x%04x", it.handle, group_end_handle);
+        little_endian_store_16(response_buffer, offset, it.handle);
+        offset += 2;
+        little_endian_store_16(response_buffer, offset, group_end_handle);
+        offset += 2;
     }
     
     if (offset == 1){
@@ -511,20 +840,12 @@ static uint16_t handle_read_by_type_request2(att_connection_t * att_connection,
     uint16_t pair_len = 0;
 
     att_iterator_t it;
-    att_iterator_init(&it);
     uint8_t error_code = 0;
     uint16_t first_matching_but_unreadable_handle = 0;
 
-    while (att_iterator_has_next(&it)){
-        att_iterator_fetch_next(&it);
-        
-        if (!it.handle) break;
-        if (it.handle < start_handle) continue;
-        if (it.handle > end_handle) break;  // (1)
+    att_iterator_init_for_uuid(&it, start_handle, attribute_type, attribute_type_len);
+    while (att_iterator_fetch_next_for_uuid(&it, end_handle, attribute_type, attribute_type_len)){  // (1)
 
-        // does current attribute match
-        if (!att_iterator_match_uuid(&it, attribute_type, attribute_type_len)) continue;
-        
         // skip handles that cannot be read but rembember that there has been at least one
         if ((it.flags & ATT_PROPERTY_READ) == 0) {
             if (first_matching_but_unreadable_handle == 0) {
@@ -800,69 +1121,39 @@ static uint16_t handle_read_by_group_type_request2(att_connection_t * att_connec
 
     uint16_t offset   = 1;
     uint16_t pair_len = 0;
-    uint16_t in_group = 0;
-    uint16_t group_start_handle = 0;
-    uint8_t const * group_start_value = NULL;
-    uint16_t prev_handle = 0;
 
     att_iterator_t it;
-    att_iterator_init(&it);
-    while (att_iterator_has_next(&it)){
-        att_iterator_fetch_next(&it);
-        
-        if (it.handle && it.handle < start_handle) continue;
-        if (it.handle > end_handle) break;  // (1)
+    att_iterator_init_for_uuid(&it, start_handle, attribute_type, attribute_type_len);
+    while (att_iterator_fetch_next_for_uuid(&it, end_handle, attribute_type, attribute_type_len)){  // (1)
 
-        // log_info("Handle 0x%04x", it.handle);
-        
-        // close current tag, if within a group and a new service definition starts or we reach end of att db
-        if (in_group &&
-            (it.handle == 0 || att_iterator_match_uuid16(&it, GATT_PRIMARY_SERVICE_UUID) || att_iterator_match_uuid16(&it, GATT_SECONDARY_SERVICE_UUID))){
-            // log_info("End of group, handle 0x%04x, val_len: %u", prev_handle, pair_len - 4);
-            
-            little_endian_store_16(response_buffer, offset, group_start_handle);
-            offset += 2;
-            little_endian_store_16(response_buffer, offset, prev_handle);
-            offset += 2;
-            memcpy(response_buffer + offset, group_start_value, pair_len - 4);
-            offset += pair_len - 4;
-            in_group = 0;
-            
-            // check if space for another handle pair available
-            if (offset + pair_len > response_buffer_size){
+        // check if value has same len as last one
+        uint16_t this_pair_len = 4 + it.value_len;
+        if (offset > 1){
+            if (this_pair_len != pair_len) {
                 break;
             }
         }
-        
-        // keep track of previous handle
-        prev_handle = it.handle;
-        
-        // does current attribute match
-        // log_info("compare: %04x == %04x", *(uint16_t*) context->attribute_type, *(uint16_t*) uuid);
-        if (it.handle && att_iterator_match_uuid(&it, attribute_type, attribute_type_len)) {
-            
-            // check if value has same len as last one
-            uint16_t this_pair_len = 4 + it.value_len;
-            if (offset > 1){
-                if (this_pair_len != pair_len) {
-                    break;
-                }
-            }
-            
-            // log_info("Begin of group, handle 0x%04x", it.handle);
-            
-            // first
-            if (offset == 1) {
-                pair_len = this_pair_len;
-                response_buffer[offset] = this_pair_len;
-                offset++;
-            }
-            
-            group_start_handle = it.handle;
-            group_start_value  = it.value;
-            in_group = 1;
+
+        // first
+        if (offset == 1) {
+            pair_len = this_pair_len;
+            response_buffer[offset] = this_pair_len;
+            offset++;
         }
-    }        
+
+        // check if space for another handle pair available
+        if (offset + pair_len > response_buffer_size){
+            break;
+        }
+
+        // group ends before next service definition starts or at end of att db
+        little_endian_store_16(response_buffer, offset, it.handle);
+        offset += 2;
+        little_endian_store_16(response_buffer, offset, att_iterator_group_end_handle(&it));
+        offset += 2;
+        memcpy(response_buffer + offset, it.value, it.value_len);
+        offset += it.value_len;
+    }
     
     if (offset == 1){
         return setup_error_atribute_not_found(response_buffer, request_type, start_handle);
@@ -1144,70 +1435,56 @@ void att_register_service_handler(att_service_handler_t * handler){
     btstack_linked_list_add(&service_handlers, (btstack_linked_item_t*) handler);
 }
 
-// returns 1 if service found. only primary service.
-int gatt_server_get_get_handle_range_for_service_with_uuid16(uint16_t uuid16, uint16_t * start_handle, uint16_t * end_handle){
-    uint16_t in_group    = 0;
-    uint16_t prev_handle = 0;
+static int gatt_server_get_handle_range_for_service_declaration(uint16_t service_type, uint16_t uuid16, uint16_t * start_handle, uint16_t * end_handle){
+    uint8_t attribute_type[2];
+    little_endian_store_16(attribute_type, 0, service_type);
 
     uint8_t attribute_value[2];
     int attribute_len = sizeof(attribute_value);
     little_endian_store_16(attribute_value, 0, uuid16);
 
     att_iterator_t it;
-    att_iterator_init(&it);
-    while (att_iterator_has_next(&it)){
-        att_iterator_fetch_next(&it);
-        int new_service_started = att_iterator_match_uuid16(&it, GATT_PRIMARY_SERVICE_UUID) || att_iterator_match_uuid16(&it, GATT_SECONDARY_SERVICE_UUID);
-
-        // close current tag, if within a group and a new service definition starts or we reach end of att db
-        if (in_group &&
-            (it.handle == 0 || new_service_started)){
-            *end_handle = prev_handle;
-            return 1;
-        }
-        
-        // keep track of previous handle
-        prev_handle = it.handle;
-        
-        // check if found
-        if (it.handle && new_service_started && attribute_len == it.value_len && memcmp(attribute_value, it.value, it.value_len) == 0){
-            *start_handle = it.handle;
-            in_group = 1;
-        }
+    att_iterator_init_for_uuid(&it, 0x0001, attribute_type, sizeof(attribute_type));
+    while (att_iterator_fetch_next_for_uuid(&it, 0xffff, attribute_type, sizeof(attribute_type))){
+        if (attribute_len != it.value_len || memcmp(attribute_value, it.value, it.value_len) != 0) continue;
+        *start_handle = it.handle;
+        *end_handle   = att_iterator_group_end_handle(&it);
+        return 1;
     }
     return 0;
 }
 
+// returns 1 if service found. primary services are checked before secondary ones.
+int gatt_server_get_get_handle_range_for_service_with_uuid16(uint16_t uuid16, uint16_t * start_handle, uint16_t * end_handle){
+    if (gatt_server_get_handle_range_for_service_declaration(GATT_PRIMARY_SERVICE_UUID, uuid16, start_handle, end_handle)) return 1;
+    return gatt_server_get_handle_range_for_service_declaration(GATT_SECONDARY_SERVICE_UUID, uuid16, start_handle, end_handle);
+}
+
 // returns 0 if not found
 uint16_t gatt_server_get_value_handle_for_characteristic_with_uuid16(uint16_t start_handle, uint16_t end_handle, uint16_t uuid16){
+    uint8_t attribute_type[2];
+    little_endian_store_16(attribute_type, 0, uuid16);
+
     att_iterator_t it;
-    att_iterator_init(&it);
-    while (att_iterator_has_next(&it)){
-        att_iterator_fetch_next(&it);
-        if (it.handle && it.handle < start_handle) continue;
-        if (it.handle > end_handle) break;  // (1)
-        if (it.handle == 0) break;
-        if (att_iterator_match_uuid16(&it, uuid16)) return it.handle;
-    }
+    att_iterator_init_for_uuid(&it, start_handle, attribute_type, sizeof(attribute_type));
+    if (att_iterator_fetch_next_for_uuid(&it, end_handle, attribute_type, sizeof(attribute_type))) return it.handle;  // (1)
     return 0;
 }
 
 // returns 0 if not found
 uint16_t gatt_server_get_client_configuration_handle_for_characteristic_with_uuid16(uint16_t start_handle, uint16_t end_handle, uint16_t uuid16){
     att_iterator_t it;
-    att_iterator_init(&it);
+    att_iterator_init_at_handle(&it, start_handle);
     int characteristic_found = 0;
     while (att_iterator_has_next(&it)){
         att_iterator_fetch_next(&it);
-        if (it.handle && it.handle < start_handle) continue;
         if (it.handle > end_handle) break;  // (1)
         if (it.handle == 0) break;
         if (att_iterator_match_uuid16(&it, uuid16)){
             characteristic_found = 1;
             continue;
         }
-        if (att_iterator_match_uuid16(&it, GATT_PRIMARY_SERVICE_UUID) 
-         || att_iterator_match_uuid16(&it, GATT_SECONDARY_SERVICE_UUID)
+        if (att_iterator_match_service_declaration(&it)
          || att_iterator_match_uuid16(&it, GATT_CHARACTERISTICS_UUID)){
             if (characteristic_found) break;
             continue;
@@ -98,9 +98,17 @@ typedef struct att_service_handler {
 
 /*
  * @brief setup ATT database
+ * @note with ENABLE_ATT_DB_INDEX, an index for handle and UUID lookups is built. Call again after modifying the database.
  */
 void att_set_db(uint8_t const * db);
 
+/*
+ * @brief use index generated by compile_gatt.py instead of building it at runtime, e.g. att_set_db_index(profile_data_index)
+ * @note requires ENABLE_ATT_DB_INDEX. Call after att_set_db. NULL disables the index.
+ * @param db_index
+ */
+void att_set_db_index(const uint16_t * db_index);
+
 /*
  * @brief set callback for read of dynamic attributes
  * @param callback
@@ -64,11 +64,25 @@ static btstack_linked_list_t gatt_client_connections;
 static btstack_linked_list_t gatt_client_value_listeners;
 static btstack_packet_callback_registration_t hci_event_callback_registration;
 static uint8_t  pts_suppress_mtu_exchange;
+static uint8_t  gatt_client_requesting_can_send_now;
+
+// active request of a connection while a new request is set up for the queue
+static gatt_client_t *       gatt_client_request_parked_peripheral;
+static gatt_client_request_t gatt_client_request_parked;
 
 static void gatt_client_att_packet_handler(uint8_t packet_type, uint16_t handle, uint8_t *packet, uint16_t size);
 static void gatt_client_hci_event_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *packet, uint16_t size);
 static void gatt_client_report_error_if_pending(gatt_client_t *peripheral, uint8_t error_code);
 static void att_signed_write_handle_cmac_result(uint8_t hash[8]);
+static void gatt_client_run(void);
+
+#ifdef ENABLE_GATT_CLIENT_CACHE
+static void gatt_client_cache_request_activated(gatt_client_t * peripheral);
+static void gatt_client_cache_record_service(gatt_client_t * peripheral, uint16_t start_group_handle, uint16_t end_group_handle, const uint8_t * uuid128);
+static void gatt_client_cache_record_characteristic(gatt_client_t * peripheral, uint16_t start_handle, uint16_t value_handle, uint16_t end_handle, uint16_t properties, const uint8_t * uuid128);
+static void gatt_client_cache_record_descriptor(gatt_client_t * peripheral, uint16_t descriptor_handle, const uint8_t * uuid128);
+static void gatt_client_cache_record_complete(gatt_client_t * peripheral, uint8_t status);
+#endif
 
 static uint16_t peripheral_mtu(gatt_client_t *peripheral){
     if (peripheral->mtu > l2cap_max_le_mtu()){
@@ -107,6 +121,7 @@ static void gatt_client_timeout_handler(btstack_timer_source_t * timer){
     if (!peripheral) return;
     log_info("GATT client timeout handle, handle 0x%02x", peripheral->con_handle);
     gatt_client_report_error_if_pending(peripheral, ATT_ERROR_TIMEOUT);           
+    gatt_client_run();
 }
 
 static void gatt_client_timeout_start(gatt_client_t * peripheral){
@@ -122,6 +137,14 @@ static void gatt_client_timeout_stop(gatt_client_t * peripheral){
     btstack_run_loop_remove_timer(&peripheral->gc_timeout);
 }
 
+// request in context becomes active
+static void gatt_client_request_activate(gatt_client_t * peripheral){
+    gatt_client_timeout_start(peripheral);
+#ifdef ENABLE_GATT_CLIENT_CACHE
+    gatt_client_cache_request_activated(peripheral);
+#endif
+}
+
 static gatt_client_t * get_gatt_client_context_for_handle(uint16_t handle){
     btstack_linked_item_t *it;
     for (it = (btstack_linked_item_t *) gatt_client_connections; it ; it = it->next){
@@ -157,13 +180,6 @@ static gatt_client_t * provide_context_for_conn_handle(hci_con_handle_t con_hand
     return context;
 }
 
-static gatt_client_t * provide_context_for_conn_handle_and_start_timer(hci_con_handle_t con_handle){
-    gatt_client_t * context = provide_context_for_conn_handle(con_handle);
-    if (!context) return NULL;
-    gatt_client_timeout_start(context);
-    return context;
-}
-
 static int is_ready(gatt_client_t * context){
     return context->gatt_client_state == P_READY;
 }
@@ -171,7 +187,81 @@ static int is_ready(gatt_client_t * context){
 int gatt_client_is_ready(hci_con_handle_t con_handle){
     gatt_client_t * context = provide_context_for_conn_handle(con_handle);
     if (!context) return 0;
-    return is_ready(context);
+    return is_ready(context) && (context->request_queue_count == 0);
+}
+
+static void gatt_client_request_store(gatt_client_request_t * request, gatt_client_t * peripheral){
+    request->gatt_client_state = peripheral->gatt_client_state;
+    request->callback = peripheral->callback;
+    request->uuid16 = peripheral->uuid16;
+    memcpy(request->uuid128, peripheral->uuid128, 16);
+    request->start_group_handle = peripheral->start_group_handle;
+    request->end_group_handle = peripheral->end_group_handle;
+    request->query_start_handle = peripheral->query_start_handle;
+    request->query_end_handle = peripheral->query_end_handle;
+    request->characteristic_start_handle = peripheral->characteristic_start_handle;
+    request->attribute_handle = peripheral->attribute_handle;
+    request->attribute_offset = peripheral->attribute_offset;
+    request->attribute_length = peripheral->attribute_length;
+    request->attribute_value = peripheral->attribute_value;
+    request->read_multiple_handle_count = peripheral->read_multiple_handle_count;
+    request->read_multiple_handles = peripheral->read_multiple_handles;
+    memcpy(request->client_characteristic_configuration_value, peripheral->client_characteristic_configuration_value, 2);
+    request->filter_with_uuid = peripheral->filter_with_uuid;
+    request->le_device_index = peripheral->le_device_index;
+}
+
+static void gatt_client_request_load(gatt_client_t * peripheral, gatt_client_request_t * request){
+    peripheral->gatt_client_state = request->gatt_client_state;
+    peripheral->callback = request->callback;
+    peripheral->uuid16 = request->uuid16;
+    memcpy(peripheral->uuid128, request->uuid128, 16);
+    peripheral->start_group_handle = request->start_group_handle;
+    peripheral->end_group_handle = request->end_group_handle;
+    peripheral->query_start_handle = request->query_start_handle;
+    peripheral->query_end_handle = request->query_end_handle;
+    peripheral->characteristic_start_handle = request->characteristic_start_handle;
+    peripheral->attribute_handle = request->attribute_handle;
+    peripheral->attribute_offset = request->attribute_offset;
+    peripheral->attribute_length = request->attribute_length;
+    peripheral->attribute_value = request->attribute_value;
+    peripheral->read_multiple_handle_count = request->read_multiple_handle_count;
+    peripheral->read_multiple_handles = request->read_multiple_handles;
+    memcpy(peripheral->client_characteristic_configuration_value, request->client_characteristic_configuration_value, 2);
+    peripheral->filter_with_uuid = request->filter_with_uuid;
+    peripheral->le_device_index = request->le_device_index;
+}
+
+// prepare context for a new request, returns 0 if the request queue is full
+static int gatt_client_request_start(gatt_client_t * peripheral){
+    if (is_ready(peripheral) && (peripheral->request_queue_count == 0)) return 1;
+    if (peripheral->request_queue_count >= GATT_CLIENT_REQUEST_QUEUE_DEPTH) return 0;
+    // park active request, new request is set up in context and queued by gatt_client_request_submit
+    gatt_client_request_store(&gatt_client_request_parked, peripheral);
+    gatt_client_request_parked_peripheral = peripheral;
+    return 1;
+}
+
+static void gatt_client_request_submit(gatt_client_t * peripheral){
+    if (gatt_client_request_parked_peripheral == peripheral){
+        gatt_client_request_parked_peripheral = NULL;
+        int index = (peripheral->request_queue_head + peripheral->request_queue_count) % GATT_CLIENT_REQUEST_QUEUE_DEPTH;
+        gatt_client_request_store(&peripheral->request_queue[index], peripheral);
+        peripheral->request_queue_count++;
+        gatt_client_request_load(peripheral, &gatt_client_request_parked);
+    } else {
+        gatt_client_request_activate(peripheral);
+    }
+    gatt_client_run();
+}
+
+// load next queued request into context, returns 0 if queue is empty
+static int gatt_client_request_dequeue(gatt_client_t * peripheral){
+    if (peripheral->request_queue_count == 0) return 0;
+    gatt_client_request_load(peripheral, &peripheral->request_queue[peripheral->request_queue_head]);
+    peripheral->request_queue_head = (peripheral->request_queue_head + 1) % GATT_CLIENT_REQUEST_QUEUE_DEPTH;
+    peripheral->request_queue_count--;
+    return 1;
 }
 
 uint8_t gatt_client_get_mtu(hci_con_handle_t con_handle, uint16_t * mtu){
@@ -479,6 +569,12 @@ static void emit_gatt_complete_event(gatt_client_t * peripheral, uint8_t status)
     packet[1] = 3;
     little_endian_store_16(packet, 2, peripheral->con_handle);
     packet[4] = status;
+#ifdef ENABLE_GATT_CLIENT_CACHE
+    // complete event for the active request
+    if (is_ready(peripheral)){
+        gatt_client_cache_record_complete(peripheral, status);
+    }
+#endif
     emit_event_new(peripheral->callback, packet, sizeof(packet));
 }
 
@@ -492,6 +588,9 @@ static void emit_gatt_service_query_result_event(gatt_client_t * peripheral, uin
     little_endian_store_16(packet, 4, start_group_handle);
     little_endian_store_16(packet, 6, end_group_handle);
     reverse_128(uuid128, &packet[8]);
+#ifdef ENABLE_GATT_CLIENT_CACHE
+    gatt_client_cache_record_service(peripheral, start_group_handle, end_group_handle, uuid128);
+#endif
     emit_event_new(peripheral->callback, packet, sizeof(packet));
 }
 
@@ -523,6 +622,9 @@ static void emit_gatt_characteristic_query_result_event(gatt_client_t * peripher
     little_endian_store_16(packet, 8,  end_handle);
     little_endian_store_16(packet, 10, properties);
     reverse_128(uuid128, &packet[12]);
+#ifdef ENABLE_GATT_CLIENT_CACHE
+    gatt_client_cache_record_characteristic(peripheral, start_handle, value_handle, end_handle, properties, uuid128);
+#endif
     emit_event_new(peripheral->callback, packet, sizeof(packet));
 }
 
@@ -536,9 +638,445 @@ static void emit_gatt_all_characteristic_descriptors_result_event(
     ///
     little_endian_store_16(packet, 4,  descriptor_handle);
     reverse_128(uuid128, &packet[6]);
+#ifdef ENABLE_GATT_CLIENT_CACHE
+    gatt_client_cache_record_descriptor(peripheral, descriptor_handle, uuid128);
+#endif
     emit_event_new(peripheral->callback, packet, sizeof(packet));
 }
 ///
+#ifdef ENABLE_GATT_CLIENT_CACHE
+
+// serialized cache: version, identity address type and address, services complete flag,
+// number of services, characteristics and descriptors, followed by the entries
+#define GATT_CLIENT_CACHE_VERSION               1
+#define GATT_CLIENT_CACHE_HEADER_SIZE          12
+#define GATT_CLIENT_CACHE_SERVICE_SIZE         21
+#define GATT_CLIENT_CACHE_CHARACTERISTIC_SIZE  25
+#define GATT_CLIENT_CACHE_DESCRIPTOR_SIZE      18
+#define GATT_CLIENT_CACHE_MAX_SIZE (GATT_CLIENT_CACHE_HEADER_SIZE \
+    + GATT_CLIENT_CACHE_MAX_SERVICES        * GATT_CLIENT_CACHE_SERVICE_SIZE \
+    + GATT_CLIENT_CACHE_MAX_CHARACTERISTICS * GATT_CLIENT_CACHE_CHARACTERISTIC_SIZE \
+    + GATT_CLIENT_CACHE_MAX_DESCRIPTORS     * GATT_CLIENT_CACHE_DESCRIPTOR_SIZE)
+
+static const gatt_client_cache_db_t * gatt_client_cache_db;
+static btstack_timer_source_t gatt_client_cache_answer_timer;
+static uint8_t gatt_client_cache_buffer[GATT_CLIENT_CACHE_MAX_SIZE];
+
+static void gatt_client_cache_clear(gatt_client_cache_t * cache){
+    cache->services_complete = 0;
+    cache->num_services = 0;
+    cache->num_characteristics = 0;
+    cache->num_descriptors = 0;
+}
+
+static int gatt_client_cache_serialize(gatt_client_cache_t * cache, uint8_t * buffer){
+    int addr_type;
+    bd_addr_t addr;
+    sm_key_t irk;
+    le_device_db_info(cache->le_device_index, &addr_type, addr, irk);
+
+    buffer[0] = GATT_CLIENT_CACHE_VERSION;
+    buffer[1] = addr_type;
+    memcpy(&buffer[2], addr, 6);
+    buffer[8]  = cache->services_complete;
+    buffer[9]  = cache->num_services;
+    buffer[10] = cache->num_characteristics;
+    buffer[11] = cache->num_descriptors;
+    int pos = GATT_CLIENT_CACHE_HEADER_SIZE;
+    int i;
+    for (i=0;i<cache->num_services;i++){
+        gatt_client_cache_service_t * service = &cache->services[i];
+        little_endian_store_16(buffer, pos, service->start_group_handle);
+        little_endian_store_16(buffer, pos + 2, service->end_group_handle);
+        memcpy(&buffer[pos + 4], service->uuid128, 16);
+        buffer[pos + 20] = service->characteristics_complete;
+        pos += GATT_CLIENT_CACHE_SERVICE_SIZE;
+    }
+    for (i=0;i<cache->num_characteristics;i++){
+        gatt_client_cache_characteristic_t * characteristic = &cache->characteristics[i];
+        little_endian_store_16(buffer, pos, characteristic->start_handle);
+        little_endian_store_16(buffer, pos + 2, characteristic->value_handle);
+        little_endian_store_16(buffer, pos + 4, characteristic->end_handle);
+        little_endian_store_16(buffer, pos + 6, characteristic->properties);
+        memcpy(&buffer[pos + 8], characteristic->uuid128, 16);
+        buffer[pos + 24] = characteristic->descriptors_complete;
+        pos += GATT_CLIENT_CACHE_CHARACTERISTIC_SIZE;
+    }
+    for (i=0;i<cache->num_descriptors;i++){
+        gatt_client_cache_descriptor_t * descriptor = &cache->descriptors[i];
+        little_endian_store_16(buffer, pos, descriptor->handle);
+        memcpy(&buffer[pos + 2], descriptor->uuid128, 16);
+        pos += GATT_CLIENT_CACHE_DESCRIPTOR_SIZE;
+    }
+    return pos;
+}
+
+// returns 0 if data is invalid or belongs to a different identity
+static int gatt_client_cache_deserialize(gatt_client_cache_t * cache, const uint8_t * buffer, int size){
+    if (size < GATT_CLIENT_CACHE_HEADER_SIZE) return 0;
+    if (buffer[0] != GATT_CLIENT_CACHE_VERSION) return 0;
+
+    int addr_type;
+    bd_addr_t addr;
+    sm_key_t irk;
+    le_device_db_info(cache->le_device_index, &addr_type, addr, irk);
+    if (buffer[1] != addr_type) return 0;
+    if (memcmp(&buffer[2], addr, 6) != 0) return 0;
+
+    int num_services        = buffer[9];
+    int num_characteristics = buffer[10];
+    int num_descriptors     = buffer[11];
+    if (num_services > GATT_CLIENT_CACHE_MAX_SERVICES) return 0;
+    if (num_characteristics > GATT_CLIENT_CACHE_MAX_CHARACTERISTICS) return 0;
+    if (num_descriptors > GATT_CLIENT_CACHE_MAX_DESCRIPTORS) return 0;
+    if (size != GATT_CLIENT_CACHE_HEADER_SIZE + num_services * GATT_CLIENT_CACHE_SERVICE_SIZE
+        + num_characteristics * GATT_CLIENT_CACHE_CHARACTERISTIC_SIZE + num_descriptors * GATT_CLIENT_CACHE_DESCRIPTOR_SIZE) return 0;
+
+    cache->services_complete   = buffer[8];
+    cache->num_services        = num_services;
+    cache->num_characteristics = num_characteristics;
+    cache->num_descriptors     = num_descriptors;
+    int pos = GATT_CLIENT_CACHE_HEADER_SIZE;
+    int i;
+    for (i=0;i<num_services;i++){
+        gatt_client_cache_service_t * service = &cache->services[i];
+        service->start_group_handle = little_endian_read_16(buffer, pos);
+        service->end_group_handle   = little_endian_read_16(buffer, pos + 2);
+        memcpy(service->uuid128, &buffer[pos + 4], 16);
+        service->characteristics_complete = buffer[pos + 20];
+        pos += GATT_CLIENT_CACHE_SERVICE_SIZE;
+    }
+    for (i=0;i<num_characteristics;i++){
+        gatt_client_cache_characteristic_t * characteristic = &cache->characteristics[i];
+        characteristic->start_handle = little_endian_read_16(buffer, pos);
+        characteristic->value_handle = little_endian_read_16(buffer, pos + 2);
+        characteristic->end_handle   = little_endian_read_16(buffer, pos + 4);
+        characteristic->properties   = little_endian_read_16(buffer, pos + 6);
+        memcpy(characteristic->uuid128, &buffer[pos + 8], 16);
+        characteristic->descriptors_complete = buffer[pos + 24];
+        pos += GATT_CLIENT_CACHE_CHARACTERISTIC_SIZE;
+    }
+    for (i=0;i<num_descriptors;i++){
+        gatt_client_cache_descriptor_t * descriptor = &cache->descriptors[i];
+        descriptor->handle = little_endian_read_16(buffer, pos);
+        memcpy(descriptor->uuid128, &buffer[pos + 2], 16);
+        pos += GATT_CLIENT_CACHE_DESCRIPTOR_SIZE;
+    }
+    return 1;
+}
+
+// provide cache for bonded device, loaded from cache db on first use
+static void gatt_client_cache_load(gatt_client_t * peripheral){
+    if (peripheral->cache) return;
+    int le_device_index = sm_le_device_index(peripheral->con_handle);
+    if (le_device_index < 0) return;
+
+    gatt_client_cache_t * cache = btstack_memory_gatt_client_cache_get();
+    if (!cache) return;
+    memset(cache, 0, sizeof(gatt_client_cache_t));
+    cache->le_device_index = le_device_index;
+    peripheral->cache = cache;
+
+    if (!gatt_client_cache_db) return;
+    int size = gatt_client_cache_db->get_cache(le_device_index, gatt_client_cache_buffer, sizeof(gatt_client_cache_buffer));
+    if (size == 0) return;
+    if (gatt_client_cache_deserialize(cache, gatt_client_cache_buffer, size)) {
+        log_info("GATT client cache: loaded %u services for device %u", cache->num_services, le_device_index);
+        return;
+    }
+    log_info("GATT client cache: discard stored cache for device %u", le_device_index);
+    gatt_client_cache_clear(cache);
+    gatt_client_cache_db->delete_cache(le_device_index);
+}
+
+static void gatt_client_cache_store(gatt_client_cache_t * cache){
+    if (!gatt_client_cache_db) return;
+    int size = gatt_client_cache_serialize(cache, gatt_client_cache_buffer);
+    gatt_client_cache_db->put_cache(cache->le_device_index, gatt_client_cache_buffer, size);
+}
+
+static void gatt_client_cache_invalidate(gatt_client_t * peripheral){
+    gatt_client_cache_t * cache = peripheral->cache;
+    log_info("GATT client cache: invalidate cache for device %u", cache->le_device_index);
+    gatt_client_cache_clear(cache);
+    peripheral->cache_record = GATT_CLIENT_CACHE_RECORD_NONE;
+    if (!gatt_client_cache_db) return;
+    gatt_client_cache_db->delete_cache(cache->le_device_index);
+}
+
+static gatt_client_cache_service_t * gatt_client_cache_get_service_for_range(gatt_client_cache_t * cache, uint16_t start_handle, uint16_t end_handle){
+    int i;
+    for (i=0;i<cache->num_services;i++){
+        gatt_client_cache_service_t * service = &cache->services[i];
+        if (start_handle < service->start_group_handle) continue;
+        if (end_handle   > service->end_group_handle)   continue;
+        return service;
+    }
+    return NULL;
+}
+
+// characteristic for descriptor range [value handle + 1, end handle]
+static gatt_client_cache_characteristic_t * gatt_client_cache_get_characteristic_for_range(gatt_client_cache_t * cache, uint16_t start_handle, uint16_t end_handle){
+    int i;
+    for (i=0;i<cache->num_characteristics;i++){
+        gatt_client_cache_characteristic_t * characteristic = &cache->characteristics[i];
+        if (characteristic->value_handle + 1 != start_handle) continue;
+        if (characteristic->end_handle != end_handle) continue;
+        return characteristic;
+    }
+    return NULL;
+}
+
+static void gatt_client_cache_remove_characteristics(gatt_client_cache_t * cache, uint16_t start_handle, uint16_t end_handle){
+    int i;
+    int num_characteristics = 0;
+    for (i=0;i<cache->num_characteristics;i++){
+        uint16_t handle = cache->characteristics[i].start_handle;
+        if (handle >= start_handle && handle <= end_handle) continue;
+        cache->characteristics[num_characteristics++] = cache->characteristics[i];
+    }
+    cache->num_characteristics = num_characteristics;
+}
+
+static void gatt_client_cache_remove_descriptors(gatt_client_cache_t * cache, uint16_t start_handle, uint16_t end_handle){
+    int i;
+    int num_descriptors = 0;
+    for (i=0;i<cache->num_descriptors;i++){
+        uint16_t handle = cache->descriptors[i].handle;
+        if (handle >= start_handle && handle <= end_handle) continue;
+        cache->descriptors[num_descriptors++] = cache->descriptors[i];
+    }
+    cache->num_descriptors = num_descriptors;
+}
+
+// active query can be answered from cache
+static int gatt_client_cache_can_answer(gatt_client_t * peripheral){
+    gatt_client_cache_t * cache = peripheral->cache;
+    if (!cache) return 0;
+    switch (peripheral->gatt_client_state){
+        case P_W2_SEND_SERVICE_QUERY:
+        case P_W2_SEND_SERVICE_WITH_UUID_QUERY:
+            return cache->services_complete;
+        case P_W2_SEND_ALL_CHARACTERISTICS_OF_SERVICE_QUERY:
+        case P_W2_SEND_CHARACTERISTIC_WITH_UUID_QUERY: {
+            gatt_client_cache_service_t * service = gatt_client_cache_get_service_for_range(cache, peripheral->start_group_handle, peripheral->end_group_handle);
+            return service && service->characteristics_complete;
+        }
+        case P_W2_SEND_ALL_CHARACTERISTIC_DESCRIPTORS_QUERY: {
+            gatt_client_cache_characteristic_t * characteristic = gatt_client_cache_get_characteristic_for_range(cache, peripheral->start_group_handle, peripheral->end_group_handle);
+            return characteristic && characteristic->descriptors_complete;
+        }
+        default:
+            return 0;
+    }
+}
+
+// record results of complete discovery queries, partial results are dropped
+static void gatt_client_cache_record_start(gatt_client_t * peripheral){
+    gatt_client_cache_t * cache = peripheral->cache;
+    peripheral->cache_record_overflow = 0;
+    switch (peripheral->gatt_client_state){
+        case P_W2_SEND_SERVICE_QUERY:
+            gatt_client_cache_clear(cache);
+            peripheral->cache_record = GATT_CLIENT_CACHE_RECORD_SERVICES;
+            break;
+        case P_W2_SEND_ALL_CHARACTERISTICS_OF_SERVICE_QUERY: {
+            gatt_client_cache_service_t * service = gatt_client_cache_get_service_for_range(cache, peripheral->start_group_handle, peripheral->end_group_handle);
+            if (!service) break;
+            if (service->start_group_handle != peripheral->start_group_handle) break;
+            if (service->end_group_handle   != peripheral->end_group_handle)   break;
+            gatt_client_cache_remove_characteristics(cache, service->start_group_handle, service->end_group_handle);
+            gatt_client_cache_remove_descriptors(cache, service->start_group_handle, service->end_group_handle);
+            peripheral->cache_record = GATT_CLIENT_CACHE_RECORD_CHARACTERISTICS;
+            break;
+        }
+        case P_W2_SEND_ALL_CHARACTERISTIC_DESCRIPTORS_QUERY:
+            if (!gatt_client_cache_get_characteristic_for_range(cache, peripheral->start_group_handle, peripheral->end_group_handle)) break;
+            gatt_client_cache_remove_descriptors(cache, peripheral->start_group_handle, peripheral->end_group_handle);
+            peripheral->cache_record = GATT_CLIENT_CACHE_RECORD_DESCRIPTORS;
+            break;
+        default:
+            break;
+    }
+}
+
+static void gatt_client_cache_record_service(gatt_client_t * peripheral, uint16_t start_group_handle, uint16_t end_group_handle, const uint8_t * uuid128){
+    if (peripheral->cache_record != GATT_CLIENT_CACHE_RECORD_SERVICES) return;
+    gatt_client_cache_t * cache = peripheral->cache;
+    if (cache->num_services >= GATT_CLIENT_CACHE_MAX_SERVICES){
+        peripheral->cache_record_overflow = 1;
+        return;
+    }
+    // services are reported in ascending order
+    gatt_client_cache_service_t * service = &cache->services[cache->num_services++];
+    service->start_group_handle = start_group_handle;
+    service->end_group_handle   = end_group_handle;
+    memcpy(service->uuid128, uuid128, 16);
+    service->characteristics_complete = 0;
+}
+
+static void gatt_client_cache_record_characteristic(gatt_client_t * peripheral, uint16_t start_handle, uint16_t value_handle, uint16_t end_handle, uint16_t properties, const uint8_t * uuid128){
+    if (peripheral->cache_record != GATT_CLIENT_CACHE_RECORD_CHARACTERISTICS) return;
+    gatt_client_cache_t * cache = peripheral->cache;
+    if (cache->num_characteristics >= GATT_CLIENT_CACHE_MAX_CHARACTERISTICS){
+        peripheral->cache_record_overflow = 1;
+        return;
+    }
+    // keep sorted by handle, services may be discovered in any order
+    int pos = cache->num_characteristics;
+    while (pos > 0 && cache->characteristics[pos-1].start_handle > start_handle){
+        cache->characteristics[pos] = cache->characteristics[pos-1];
+        pos--;
+    }
+    cache->num_characteristics++;
+    gatt_client_cache_characteristic_t * characteristic = &cache->characteristics[pos];
+    characteristic->start_handle = start_handle;
+    characteristic->value_handle = value_handle;
+    characteristic->end_handle   = end_handle;
+    characteristic->properties   = properties;
+    memcpy(characteristic->uuid128, uuid128, 16);
+    characteristic->descriptors_complete = 0;
+}
+
+static void gatt_client_cache_record_descriptor(gatt_client_t * peripheral, uint16_t descriptor_handle, const uint8_t * uuid128){
+    if (peripheral->cache_record != GATT_CLIENT_CACHE_RECORD_DESCRIPTORS) return;
+    gatt_client_cache_t * cache = peripheral->cache;
+    if (cache->num_descriptors >= GATT_CLIENT_CACHE_MAX_DESCRIPTORS){
+        peripheral->cache_record_overflow = 1;
+        return;
+    }
+    int pos = cache->num_descriptors;
+    while (pos > 0 && cache->descriptors[pos-1].handle > descriptor_handle){
+        cache->descriptors[pos] = cache->descriptors[pos-1];
+        pos--;
+    }
+    cache->num_descriptors++;
+    cache->descriptors[pos].handle = descriptor_handle;
+    memcpy(cache->descriptors[pos].uuid128, uuid128, 16);
+}
+
+static void gatt_client_cache_record_complete(gatt_client_t * peripheral, uint8_t status){
+    gatt_client_cache_record_t record = peripheral->cache_record;
+    peripheral->cache_record = GATT_CLIENT_CACHE_RECORD_NONE;
+    if (record == GATT_CLIENT_CACHE_RECORD_NONE) return;
+    if (status || peripheral->cache_record_overflow) return;
+
+    // end handle of the query range identifies service and characteristic
+    gatt_client_cache_t * cache = peripheral->cache;
+    int i;
+    switch (record){
+        case GATT_CLIENT_CACHE_RECORD_SERVICES:
+            cache->services_complete = 1;
+            break;
+        case GATT_CLIENT_CACHE_RECORD_CHARACTERISTICS:
+            for (i=0;i<cache->num_services;i++){
+                if (cache->services[i].end_group_handle != peripheral->end_group_handle) continue;
+                cache->services[i].characteristics_complete = 1;
+            }
+            break;
+        case GATT_CLIENT_CACHE_RECORD_DESCRIPTORS:
+            for (i=0;i<cache->num_characteristics;i++){
+                if (cache->characteristics[i].end_handle != peripheral->end_group_handle) continue;
+                cache->characteristics[i].descriptors_complete = 1;
+            }
+            break;
+        default:
+            break;
+    }
+    gatt_client_cache_store(cache);
+}
+
+static void gatt_client_cache_answer(gatt_client_t * peripheral){
+    peripheral->cache_answer_pending = 0;
+    // cache might have been invalidated in the meantime, query remote device then
+    if (!gatt_client_cache_can_answer(peripheral)) return;
+
+    gatt_client_cache_t * cache = peripheral->cache;
+    uint16_t start_handle = peripheral->start_group_handle;
+    uint16_t end_handle   = peripheral->end_group_handle;
+    int i;
+    switch (peripheral->gatt_client_state){
+        case P_W2_SEND_SERVICE_QUERY:
+        case P_W2_SEND_SERVICE_WITH_UUID_QUERY:
+            for (i=0;i<cache->num_services;i++){
+                gatt_client_cache_service_t * service = &cache->services[i];
+                if (peripheral->gatt_client_state == P_W2_SEND_SERVICE_WITH_UUID_QUERY && memcmp(service->uuid128, peripheral->uuid128, 16) != 0) continue;
+                emit_gatt_service_query_result_event(peripheral, service->start_group_handle, service->end_group_handle, service->uuid128);
+            }
+            break;
+        case P_W2_SEND_ALL_CHARACTERISTICS_OF_SERVICE_QUERY:
+        case P_W2_SEND_CHARACTERISTIC_WITH_UUID_QUERY:
+            for (i=0;i<cache->num_characteristics;i++){
+                gatt_client_cache_characteristic_t * characteristic = &cache->characteristics[i];
+                if (characteristic->start_handle < start_handle) continue;
+                if (characteristic->start_handle > end_handle) break;
+                if (peripheral->filter_with_uuid && memcmp(characteristic->uuid128, peripheral->uuid128, 16) != 0) continue;
+                // last characteristic ends with query range
+                uint16_t characteristic_end_handle = characteristic->end_handle < end_handle ? characteristic->end_handle : end_handle;
+                emit_gatt_characteristic_query_result_event(peripheral, characteristic->start_handle, characteristic->value_handle,
+                    characteristic_end_handle, characteristic->properties, characteristic->uuid128);
+            }
+            break;
+        case P_W2_SEND_ALL_CHARACTERISTIC_DESCRIPTORS_QUERY:
+            for (i=0;i<cache->num_descriptors;i++){
+                gatt_client_cache_descriptor_t * descriptor = &cache->descriptors[i];
+                if (descriptor->handle < start_handle) continue;
+                if (descriptor->handle > end_handle) break;
+                emit_gatt_all_characteristic_descriptors_result_event(peripheral, descriptor->handle, descriptor->uuid128);
+            }
+            break;
+        default:
+            break;
+    }
+    gatt_client_handle_transaction_complete(peripheral);
+    emit_gatt_complete_event(peripheral, 0);
+}
+
+static void gatt_client_cache_answer_handler(btstack_timer_source_t * ts){
+    UNUSED(ts);
+    btstack_linked_list_iterator_t it;
+    btstack_linked_list_iterator_init(&it, &gatt_client_connections);
+    while (btstack_linked_list_iterator_has_next(&it)){
+        gatt_client_t * peripheral = (gatt_client_t *) btstack_linked_list_iterator_next(&it);
+        if (!peripheral->cache_answer_pending) continue;
+        gatt_client_cache_answer(peripheral);
+    }
+    gatt_client_run();
+}
+
+static void gatt_client_cache_request_activated(gatt_client_t * peripheral){
+    peripheral->cache_record = GATT_CLIENT_CACHE_RECORD_NONE;
+    gatt_client_cache_load(peripheral);
+    if (!peripheral->cache) return;
+    if (!gatt_client_cache_can_answer(peripheral)){
+        gatt_client_cache_record_start(peripheral);
+        return;
+    }
+    // answer from run loop, results are not expected before the API call returns
+    peripheral->cache_answer_pending = 1;
+    btstack_run_loop_remove_timer(&gatt_client_cache_answer_timer);
+    btstack_run_loop_set_timer_handler(&gatt_client_cache_answer_timer, gatt_client_cache_answer_handler);
+    btstack_run_loop_set_timer(&gatt_client_cache_answer_timer, 0);
+    btstack_run_loop_add_timer(&gatt_client_cache_answer_timer);
+}
+
+// attribute table of remote device changed, see Service Changed characteristic
+static void gatt_client_cache_handle_indication(gatt_client_t * peripheral, uint16_t value_handle){
+    gatt_client_cache_load(peripheral);
+    gatt_client_cache_t * cache = peripheral->cache;
+    if (!cache) return;
+    uint8_t service_changed_uuid128[16];
+    uuid_add_bluetooth_prefix(service_changed_uuid128, GAP_SERVICE_CHANGED);
+    int i;
+    for (i=0;i<cache->num_characteristics;i++){
+        gatt_client_cache_characteristic_t * characteristic = &cache->characteristics[i];
+        if (characteristic->value_handle != value_handle) continue;
+        if (memcmp(characteristic->uuid128, service_changed_uuid128, 16) != 0) return;
+        gatt_client_cache_invalidate(peripheral);
+        return;
+    }
+}
+#endif
 
 static void report_gatt_services(gatt_client_t * peripheral, uint8_t * packet,  uint16_t size){
     uint8_t attr_length = packet[1];
@@ -788,206 +1326,236 @@ static int is_value_valid(gatt_client_t *peripheral, uint8_t *packet, uint16_t s
 }
 
 
-static void gatt_client_run(void){
+// precondition: can_send_packet_now == TRUE, sends at most one PDU
+static void gatt_client_run_for_peripheral(gatt_client_t * peripheral){
 
-    btstack_linked_item_t *it;
-    for (it = (btstack_linked_item_t *) gatt_client_connections; it ; it = it->next){
+    // log_info("- handle_peripheral_list, mtu state %u, client state %u", peripheral->mtu_state, peripheral->gatt_client_state);
+    
+    switch (peripheral->mtu_state) {
+        case SEND_MTU_EXCHANGE:{
+            peripheral->mtu_state = SENT_MTU_EXCHANGE;
+            att_exchange_mtu_request(peripheral->con_handle);
+            return;
+        }
+        case SENT_MTU_EXCHANGE:
+            return;
+        default:
+            break;
+    }
+    
+    if (peripheral->send_confirmation){
+        peripheral->send_confirmation = 0;
+        att_confirmation(peripheral->con_handle);
+        return;
+    }
+    
+    // check MTU for writes
+    switch (peripheral->gatt_client_state){
+        case P_W2_SEND_WRITE_CHARACTERISTIC_VALUE:
+        case P_W2_SEND_WRITE_CHARACTERISTIC_DESCRIPTOR:
+            if (peripheral->attribute_length <= peripheral_mtu(peripheral) - 3) break;
+            log_error("gatt_client_run: value len %u > MTU %u - 3\n", peripheral->attribute_length, peripheral_mtu(peripheral));
+            gatt_client_handle_transaction_complete(peripheral);
+            emit_gatt_complete_event(peripheral, ATT_ERROR_INVALID_ATTRIBUTE_VALUE_LENGTH);
+            return;
+        default:
+            break;
+    }
 
-        gatt_client_t * peripheral = (gatt_client_t *) it;
+#ifdef ENABLE_GATT_CLIENT_CACHE
+    // query is answered from cache by gatt_client_cache_answer_handler
+    if (peripheral->cache_answer_pending) return;
+#endif
 
-        if (!att_dispatch_client_can_send_now(peripheral->con_handle)) {
-            att_dispatch_client_request_can_send_now_event(peripheral->con_handle);
+    // log_info("gatt_client_state %u", peripheral->gatt_client_state);
+    switch (peripheral->gatt_client_state){
+        case P_W2_SEND_SERVICE_QUERY:
+            peripheral->gatt_client_state = P_W4_SERVICE_QUERY_RESULT;
+            send_gatt_services_request(peripheral);
             return;
-        }
+            
+        case P_W2_SEND_SERVICE_WITH_UUID_QUERY:
+            peripheral->gatt_client_state = P_W4_SERVICE_WITH_UUID_RESULT;
+            send_gatt_services_by_uuid_request(peripheral);
+            return;
+            
+        case P_W2_SEND_ALL_CHARACTERISTICS_OF_SERVICE_QUERY:
+            peripheral->gatt_client_state = P_W4_ALL_CHARACTERISTICS_OF_SERVICE_QUERY_RESULT;
+            send_gatt_characteristic_request(peripheral);
+            return;
+            
+        case P_W2_SEND_CHARACTERISTIC_WITH_UUID_QUERY:
+            peripheral->gatt_client_state = P_W4_CHARACTERISTIC_WITH_UUID_QUERY_RESULT;
+            send_gatt_characteristic_request(peripheral);
+            return;
+            
+        case P_W2_SEND_ALL_CHARACTERISTIC_DESCRIPTORS_QUERY:
+            peripheral->gatt_client_state = P_W4_CHARACTERISTIC_WITH_UUID_QUERY_RESULT;
+            send_gatt_characteristic_descriptor_request(peripheral);
+            return;
+            
+        case P_W2_SEND_INCLUDED_SERVICE_QUERY:
+            peripheral->gatt_client_state = P_W4_INCLUDED_SERVICE_QUERY_RESULT;
+            send_gatt_included_service_request(peripheral);
+            return;
+            
+        case P_W2_SEND_INCLUDED_SERVICE_WITH_UUID_QUERY:
+            peripheral->gatt_client_state = P_W4_INCLUDED_SERVICE_UUID_WITH_QUERY_RESULT;
+            send_gatt_included_service_uuid_request(peripheral);
+            return;
+            
+        case P_W2_SEND_READ_CHARACTERISTIC_VALUE_QUERY:
+            peripheral->gatt_client_state = P_W4_READ_CHARACTERISTIC_VALUE_RESULT;
+            send_gatt_read_characteristic_value_request(peripheral);
+            return;
+            
+        case P_W2_SEND_READ_BLOB_QUERY:
+            peripheral->gatt_client_state = P_W4_READ_BLOB_RESULT;
+            send_gatt_read_blob_request(peripheral);
+            return;
+            
+        case P_W2_SEND_READ_BY_TYPE_REQUEST:
+            peripheral->gatt_client_state = P_W4_READ_BY_TYPE_RESPONSE;
+            send_gatt_read_by_type_request(peripheral);
+            break;
+
+        case P_W2_SEND_READ_MULTIPLE_REQUEST:
+            peripheral->gatt_client_state = P_W4_READ_MULTIPLE_RESPONSE;
+            send_gatt_read_multiple_request(peripheral);
+            break;
 
-        // log_info("- handle_peripheral_list, mtu state %u, client state %u", peripheral->mtu_state, peripheral->gatt_client_state);
+        case P_W2_SEND_WRITE_CHARACTERISTIC_VALUE:
+            peripheral->gatt_client_state = P_W4_WRITE_CHARACTERISTIC_VALUE_RESULT;
+            send_gatt_write_attribute_value_request(peripheral);
+            return;
+            
+        case P_W2_PREPARE_WRITE:
+            peripheral->gatt_client_state = P_W4_PREPARE_WRITE_RESULT;
+            send_gatt_prepare_write_request(peripheral);
+            return;
+            
+        case P_W2_PREPARE_WRITE_SINGLE:
+            peripheral->gatt_client_state = P_W4_PREPARE_WRITE_SINGLE_RESULT;
+            send_gatt_prepare_write_request(peripheral);
+            return;
         
-        switch (peripheral->mtu_state) {
-            case SEND_MTU_EXCHANGE:{
-                peripheral->mtu_state = SENT_MTU_EXCHANGE;
-                att_exchange_mtu_request(peripheral->con_handle);
-                return;
+        case P_W2_PREPARE_RELIABLE_WRITE:
+            peripheral->gatt_client_state = P_W4_PREPARE_RELIABLE_WRITE_RESULT;
+            send_gatt_prepare_write_request(peripheral);
+            return;
+            
+        case P_W2_EXECUTE_PREPARED_WRITE:
+            peripheral->gatt_client_state = P_W4_EXECUTE_PREPARED_WRITE_RESULT;
+            send_gatt_execute_write_request(peripheral);
+            return;
+            
+        case P_W2_CANCEL_PREPARED_WRITE:
+            peripheral->gatt_client_state = P_W4_CANCEL_PREPARED_WRITE_RESULT;
+            send_gatt_cancel_prepared_write_request(peripheral);
+            return;
+            
+        case P_W2_CANCEL_PREPARED_WRITE_DATA_MISMATCH:
+            peripheral->gatt_client_state = P_W4_CANCEL_PREPARED_WRITE_DATA_MISMATCH_RESULT;
+            send_gatt_cancel_prepared_write_request(peripheral);
+            return;
+
+        case P_W2_SEND_READ_CLIENT_CHARACTERISTIC_CONFIGURATION_QUERY:
+            peripheral->gatt_client_state = P_W4_READ_CLIENT_CHARACTERISTIC_CONFIGURATION_QUERY_RESULT;
+            send_gatt_read_client_characteristic_configuration_request(peripheral);
+            return;
+            
+        case P_W2_SEND_READ_CHARACTERISTIC_DESCRIPTOR_QUERY:
+            peripheral->gatt_client_state = P_W4_READ_CHARACTERISTIC_DESCRIPTOR_RESULT;
+            send_gatt_read_characteristic_descriptor_request(peripheral);
+            return;
+            
+        case P_W2_SEND_READ_BLOB_CHARACTERISTIC_DESCRIPTOR_QUERY:
+            peripheral->gatt_client_state = P_W4_READ_BLOB_CHARACTERISTIC_DESCRIPTOR_RESULT;
+            send_gatt_read_blob_request(peripheral);
+            return;
+            
+        case P_W2_SEND_WRITE_CHARACTERISTIC_DESCRIPTOR:
+            peripheral->gatt_client_state = P_W4_WRITE_CHARACTERISTIC_DESCRIPTOR_RESULT;
+            send_gatt_write_attribute_value_request(peripheral);
+            return;
+            
+        case P_W2_WRITE_CLIENT_CHARACTERISTIC_CONFIGURATION:
+            peripheral->gatt_client_state = P_W4_CLIENT_CHARACTERISTIC_CONFIGURATION_RESULT;
+            send_gatt_write_client_characteristic_configuration_request(peripheral);
+            return;
+            
+        case P_W2_PREPARE_WRITE_CHARACTERISTIC_DESCRIPTOR:
+            peripheral->gatt_client_state = P_W4_PREPARE_WRITE_CHARACTERISTIC_DESCRIPTOR_RESULT;
+            send_gatt_prepare_write_request(peripheral);
+            return;
+            
+        case P_W2_EXECUTE_PREPARED_WRITE_CHARACTERISTIC_DESCRIPTOR:
+            peripheral->gatt_client_state = P_W4_EXECUTE_PREPARED_WRITE_CHARACTERISTIC_DESCRIPTOR_RESULT;
+            send_gatt_execute_write_request(peripheral);
+            return;
+
+        case P_W4_CMAC_READY:
+            if (sm_cmac_ready()){
+                sm_key_t csrk;
+                le_device_db_local_csrk_get(peripheral->le_device_index, csrk);
+                uint32_t sign_counter = le_device_db_local_counter_get(peripheral->le_device_index); 
+                peripheral->gatt_client_state = P_W4_CMAC_RESULT;
+                sm_cmac_signed_write_start(csrk, ATT_SIGNED_WRITE_COMMAND, peripheral->attribute_handle, peripheral->attribute_length, peripheral->attribute_value, sign_counter, att_signed_write_handle_cmac_result);
             }
-            case SENT_MTU_EXCHANGE:
-                return;
-            default:
-                break;
-        }
-        
-        if (peripheral->send_confirmation){
-            peripheral->send_confirmation = 0;
-            att_confirmation(peripheral->con_handle);
+            return;
+
+        case P_W2_SEND_SIGNED_WRITE: {
+            peripheral->gatt_client_state = P_W4_SEND_SINGED_WRITE_DONE;
+            // bump local signing counter
+            uint32_t sign_counter = le_device_db_local_counter_get(peripheral->le_device_index);
+            le_device_db_local_counter_set(peripheral->le_device_index, sign_counter + 1);
+
+            send_gatt_signed_write_request(peripheral, sign_counter);
+            peripheral->gatt_client_state = P_READY;
+            // finally, notifiy client that write is complete
+            gatt_client_handle_transaction_complete(peripheral);
             return;
         }
-        
-        // check MTU for writes
-        switch (peripheral->gatt_client_state){
-            case P_W2_SEND_WRITE_CHARACTERISTIC_VALUE:
-            case P_W2_SEND_WRITE_CHARACTERISTIC_DESCRIPTOR:
-                if (peripheral->attribute_length <= peripheral_mtu(peripheral) - 3) break;
-                log_error("gatt_client_run: value len %u > MTU %u - 3\n", peripheral->attribute_length, peripheral_mtu(peripheral));
-                gatt_client_handle_transaction_complete(peripheral);
-                emit_gatt_complete_event(peripheral, ATT_ERROR_INVALID_ATTRIBUTE_VALUE_LENGTH);
-                return;
-            default:
-                break;
+
+        default:
+            break;
+    }
+}
+
+static void gatt_client_run(void){
+
+    int blocked = 0;
+    hci_con_handle_t blocked_con_handle = 0;
+
+    btstack_linked_item_t *it;
+    for (it = (btstack_linked_item_t *) gatt_client_connections; it ; it = it->next){
+
+        gatt_client_t * peripheral = (gatt_client_t *) it;
+
+        // start next queued request
+        if (is_ready(peripheral) && gatt_client_request_dequeue(peripheral)){
+            gatt_client_request_activate(peripheral);
         }
 
-        // log_info("gatt_client_state %u", peripheral->gatt_client_state);
-        switch (peripheral->gatt_client_state){
-            case P_W2_SEND_SERVICE_QUERY:
-                peripheral->gatt_client_state = P_W4_SERVICE_QUERY_RESULT;
-                send_gatt_services_request(peripheral);
-                return;
-                
-            case P_W2_SEND_SERVICE_WITH_UUID_QUERY:
-                peripheral->gatt_client_state = P_W4_SERVICE_WITH_UUID_RESULT;
-                send_gatt_services_by_uuid_request(peripheral);
-                return;
-                
-            case P_W2_SEND_ALL_CHARACTERISTICS_OF_SERVICE_QUERY:
-                peripheral->gatt_client_state = P_W4_ALL_CHARACTERISTICS_OF_SERVICE_QUERY_RESULT;
-                send_gatt_characteristic_request(peripheral);
-                return;
-                
-            case P_W2_SEND_CHARACTERISTIC_WITH_UUID_QUERY:
-                peripheral->gatt_client_state = P_W4_CHARACTERISTIC_WITH_UUID_QUERY_RESULT;
-                send_gatt_characteristic_request(peripheral);
-                return;
-                
-            case P_W2_SEND_ALL_CHARACTERISTIC_DESCRIPTORS_QUERY:
-                peripheral->gatt_client_state = P_W4_CHARACTERISTIC_WITH_UUID_QUERY_RESULT;
-                send_gatt_characteristic_descriptor_request(peripheral);
-                return;
-                
-            case P_W2_SEND_INCLUDED_SERVICE_QUERY:
-                peripheral->gatt_client_state = P_W4_INCLUDED_SERVICE_QUERY_RESULT;
-                send_gatt_included_service_request(peripheral);
-                return;
-                
-            case P_W2_SEND_INCLUDED_SERVICE_WITH_UUID_QUERY:
-                peripheral->gatt_client_state = P_W4_INCLUDED_SERVICE_UUID_WITH_QUERY_RESULT;
-                send_gatt_included_service_uuid_request(peripheral);
-                return;
-                
-            case P_W2_SEND_READ_CHARACTERISTIC_VALUE_QUERY:
-                peripheral->gatt_client_state = P_W4_READ_CHARACTERISTIC_VALUE_RESULT;
-                send_gatt_read_characteristic_value_request(peripheral);
-                return;
-                
-            case P_W2_SEND_READ_BLOB_QUERY:
-                peripheral->gatt_client_state = P_W4_READ_BLOB_RESULT;
-                send_gatt_read_blob_request(peripheral);
-                return;
-                
-            case P_W2_SEND_READ_BY_TYPE_REQUEST:
-                peripheral->gatt_client_state = P_W4_READ_BY_TYPE_RESPONSE;
-                send_gatt_read_by_type_request(peripheral);
-                break;
-
-            case P_W2_SEND_READ_MULTIPLE_REQUEST:
-                peripheral->gatt_client_state = P_W4_READ_MULTIPLE_RESPONSE;
-                send_gatt_read_multiple_request(peripheral);
-                break;
-
-            case P_W2_SEND_WRITE_CHARACTERISTIC_VALUE:
-                peripheral->gatt_client_state = P_W4_WRITE_CHARACTERISTIC_VALUE_RESULT;
-                send_gatt_write_attribute_value_request(peripheral);
-                return;
-                
-            case P_W2_PREPARE_WRITE:
-                peripheral->gatt_client_state = P_W4_PREPARE_WRITE_RESULT;
-                send_gatt_prepare_write_request(peripheral);
-                return;
-                
-            case P_W2_PREPARE_WRITE_SINGLE:
-                peripheral->gatt_client_state = P_W4_PREPARE_WRITE_SINGLE_RESULT;
-                send_gatt_prepare_write_request(peripheral);
-                return;
-            
-            case P_W2_PREPARE_RELIABLE_WRITE:
-                peripheral->gatt_client_state = P_W4_PREPARE_RELIABLE_WRITE_RESULT;
-                send_gatt_prepare_write_request(peripheral);
-                return;
-                
-            case P_W2_EXECUTE_PREPARED_WRITE:
-                peripheral->gatt_client_state = P_W4_EXECUTE_PREPARED_WRITE_RESULT;
-                send_gatt_execute_write_request(peripheral);
-                return;
-                
-            case P_W2_CANCEL_PREPARED_WRITE:
-                peripheral->gatt_client_state = P_W4_CANCEL_PREPARED_WRITE_RESULT;
-                send_gatt_cancel_prepared_write_request(peripheral);
-                return;
-                
-            case P_W2_CANCEL_PREPARED_WRITE_DATA_MISMATCH:
-                peripheral->gatt_client_state = P_W4_CANCEL_PREPARED_WRITE_DATA_MISMATCH_RESULT;
-                send_gatt_cancel_prepared_write_request(peripheral);
-                return;
-
-            case P_W2_SEND_READ_CLIENT_CHARACTERISTIC_CONFIGURATION_QUERY:
-                peripheral->gatt_client_state = P_W4_READ_CLIENT_CHARACTERISTIC_CONFIGURATION_QUERY_RESULT;
-                send_gatt_read_client_characteristic_configuration_request(peripheral);
-                return;
-                
-            case P_W2_SEND_READ_CHARACTERISTIC_DESCRIPTOR_QUERY:
-                peripheral->gatt_client_state = P_W4_READ_CHARACTERISTIC_DESCRIPTOR_RESULT;
-                send_gatt_read_characteristic_descriptor_request(peripheral);
-                return;
-                
-            case P_W2_SEND_READ_BLOB_CHARACTERISTIC_DESCRIPTOR_QUERY:
-                peripheral->gatt_client_state = P_W4_READ_BLOB_CHARACTERISTIC_DESCRIPTOR_RESULT;
-                send_gatt_read_blob_request(peripheral);
-                return;
-                
-            case P_W2_SEND_WRITE_CHARACTERISTIC_DESCRIPTOR:
-                peripheral->gatt_client_state = P_W4_WRITE_CHARACTERISTIC_DESCRIPTOR_RESULT;
-                send_gatt_write_attribute_value_request(peripheral);
-                return;
-                
-            case P_W2_WRITE_CLIENT_CHARACTERISTIC_CONFIGURATION:
-                peripheral->gatt_client_state = P_W4_CLIENT_CHARACTERISTIC_CONFIGURATION_RESULT;
-                send_gatt_write_client_characteristic_configuration_request(peripheral);
-                return;
-                
-            case P_W2_PREPARE_WRITE_CHARACTERISTIC_DESCRIPTOR:
-                peripheral->gatt_client_state = P_W4_PREPARE_WRITE_CHARACTERISTIC_DESCRIPTOR_RESULT;
-                send_gatt_prepare_write_request(peripheral);
-                return;
-                
-            case P_W2_EXECUTE_PREPARED_WRITE_CHARACTERISTIC_DESCRIPTOR:
-                peripheral->gatt_client_state = P_W4_EXECUTE_PREPARED_WRITE_CHARACTERISTIC_DESCRIPTOR_RESULT;
-                send_gatt_execute_write_request(peripheral);
-                return;
-
-            case P_W4_CMAC_READY:
-                if (sm_cmac_ready()){
-                    sm_key_t csrk;
-                    le_device_db_local_csrk_get(peripheral->le_device_index, csrk);
-                    uint32_t sign_counter = le_device_db_local_counter_get(peripheral->le_device_index); 
-                    peripheral->gatt_client_state = P_W4_CMAC_RESULT;
-                    sm_cmac_signed_write_start(csrk, ATT_SIGNED_WRITE_COMMAND, peripheral->attribute_handle, peripheral->attribute_length, peripheral->attribute_value, sign_counter, att_signed_write_handle_cmac_result);
-                }
-                return;
-
-            case P_W2_SEND_SIGNED_WRITE: {
-                peripheral->gatt_client_state = P_W4_SEND_SINGED_WRITE_DONE;
-                // bump local signing counter
-                uint32_t sign_counter = le_device_db_local_counter_get(peripheral->le_device_index);
-                le_device_db_local_counter_set(peripheral->le_device_index, sign_counter + 1);
-
-                send_gatt_signed_write_request(peripheral, sign_counter);
-                peripheral->gatt_client_state = P_READY;
-                // finally, notifiy client that write is complete
-                gatt_client_handle_transaction_complete(peripheral);
-                return;
+        // skip congested connection, other connections can still make progress
+        if (!att_dispatch_client_can_send_now(peripheral->con_handle)) {
+            if (!blocked){
+                blocked = 1;
+                blocked_con_handle = peripheral->con_handle;
             }
-
-            default:
-                break;
+            continue;
         }
+
+        gatt_client_run_for_peripheral(peripheral);
     }
-    
+
+    if (!blocked) return;
+
+    // L2CAP_EVENT_CAN_SEND_NOW is emitted right away if any other LE connection can send. Ignore it to avoid recursion,
+    // the congested connection is served again on the next HCI event, e.g. Number Of Completed Packets
+    gatt_client_requesting_can_send_now = 1;
+    att_dispatch_client_request_can_send_now_event(blocked_con_handle);
+    gatt_client_requesting_can_send_now = 0;
 }
 
 static void gatt_client_report_error_if_pending(gatt_client_t *peripheral, uint8_t error_code) {
@@ -1010,11 +1578,32 @@ static void gatt_client_hci_event_packet_handler(uint8_t packet_type, uint16_t c
             gatt_client_t * peripheral = get_gatt_client_context_for_handle(con_handle);
             if (!peripheral) break;
             gatt_client_report_error_if_pending(peripheral, ATT_ERROR_HCI_DISCONNECT_RECEIVED);
+            // fail queued requests, too
+            while (gatt_client_request_dequeue(peripheral)){
+                emit_gatt_complete_event(peripheral, ATT_ERROR_HCI_DISCONNECT_RECEIVED);
+            }
+#ifdef ENABLE_GATT_CLIENT_CACHE
+            // cache has been stored when it was updated
+            if (peripheral->cache){
+                btstack_memory_gatt_client_cache_free(peripheral->cache);
+            }
+#endif
             
             btstack_linked_list_remove(&gatt_client_connections, (btstack_linked_item_t *) peripheral);
             btstack_memory_gatt_client_free(peripheral);
             break;
         }
+#ifdef ENABLE_GATT_CLIENT_CACHE
+        case BTSTACK_EVENT_STATE:
+            if (btstack_event_state_get_state(packet) != HCI_STATE_WORKING) break;
+            if (!gatt_client_cache_db) break;
+            {
+                bd_addr_t local_bd_addr;
+                gap_local_bd_addr(local_bd_addr);
+                gatt_client_cache_db->set_local_bd_addr(local_bd_addr);
+            }
+            break;
+#endif
         default:
             break;
     }
@@ -1025,6 +1614,7 @@ static void gatt_client_hci_event_packet_handler(uint8_t packet_type, uint16_t c
 static void gatt_client_att_packet_handler(uint8_t packet_type, uint16_t handle, uint8_t *packet, uint16_t size){
 
     if (packet_type == HCI_EVENT_PACKET && packet[0] == L2CAP_EVENT_CAN_SEND_NOW){
+        if (gatt_client_requesting_can_send_now) return;
         gatt_client_run();
     }
 
@@ -1068,6 +1658,9 @@ static void gatt_client_att_packet_handler(uint8_t packet_type, uint16_t handle,
             }
             break;
         case ATT_HANDLE_VALUE_INDICATION:
+#ifdef ENABLE_GATT_CLIENT_CACHE
+            gatt_client_cache_handle_indication(peripheral, little_endian_read_16(packet,1));
+#endif
             report_gatt_indication(handle, little_endian_read_16(packet,1), &packet[3], size-3);
             peripheral->send_confirmation = 1;
             break;
@@ -1364,40 +1957,42 @@ static void att_signed_write_handle_cmac_result(uint8_t hash[8]){
 
 uint8_t gatt_client_signed_write_without_response(btstack_packet_handler_t callback, hci_con_handle_t con_handle, uint16_t handle, uint16_t message_len, uint8_t * message){
     gatt_client_t * peripheral = provide_context_for_conn_handle(con_handle);
-    if (!is_ready(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
-    peripheral->le_device_index = sm_le_device_index(con_handle);
-    if (peripheral->le_device_index < 0) return GATT_CLIENT_IN_WRONG_STATE; // device lookup not done / no stored bonding information
+    if (!peripheral) return BTSTACK_MEMORY_ALLOC_FAILED; 
+    int le_device_index = sm_le_device_index(con_handle);
+    if (le_device_index < 0) return GATT_CLIENT_IN_WRONG_STATE; // device lookup not done / no stored bonding information
+    if (!gatt_client_request_start(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
 
+    peripheral->le_device_index = le_device_index;
     peripheral->callback = callback;
     peripheral->attribute_handle = handle;
     peripheral->attribute_length = message_len;
     peripheral->attribute_value = message;
     peripheral->gatt_client_state = P_W4_CMAC_READY;
 
-    gatt_client_run();
+    gatt_client_request_submit(peripheral);
     return 0; 
 }
 
 uint8_t gatt_client_discover_primary_services(btstack_packet_handler_t callback, hci_con_handle_t con_handle){
-    gatt_client_t * peripheral = provide_context_for_conn_handle_and_start_timer(con_handle);
+    gatt_client_t * peripheral = provide_context_for_conn_handle(con_handle);
     if (!peripheral) return BTSTACK_MEMORY_ALLOC_FAILED; 
-    if (!is_ready(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
+    if (!gatt_client_request_start(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
 
     peripheral->callback = callback;
     peripheral->start_group_handle = 0x0001;
     peripheral->end_group_handle   = 0xffff;
     peripheral->gatt_client_state = P_W2_SEND_SERVICE_QUERY;
     peripheral->uuid16 = 0;
-    gatt_client_run();
+    gatt_client_request_submit(peripheral);
     return 0;
 }
 
 
 uint8_t gatt_client_discover_primary_services_by_uuid16(btstack_packet_handler_t callback, hci_con_handle_t con_handle, uint16_t uuid16){
-    gatt_client_t * peripheral = provide_context_for_conn_handle_and_start_timer(con_handle);
+    gatt_client_t * peripheral = provide_context_for_conn_handle(con_handle);
     
     if (!peripheral) return BTSTACK_MEMORY_ALLOC_FAILED; 
-    if (!is_ready(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
+    if (!gatt_client_request_start(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
 
     peripheral->callback = callback;
     peripheral->start_group_handle = 0x0001;
@@ -1405,15 +2000,15 @@ uint8_t gatt_client_discover_primary_services_by_uuid16(btstack_packet_handler_t
     peripheral->gatt_client_state = P_W2_SEND_SERVICE_WITH_UUID_QUERY;
     peripheral->uuid16 = uuid16;
     uuid_add_bluetooth_prefix((uint8_t*) &(peripheral->uuid128), peripheral->uuid16);
-    gatt_client_run();
+    gatt_client_request_submit(peripheral);
     return 0;
 }
 
 uint8_t gatt_client_discover_primary_services_by_uuid128(btstack_packet_handler_t callback, hci_con_handle_t con_handle, const uint8_t * uuid128){
-    gatt_client_t * peripheral = provide_context_for_conn_handle_and_start_timer(con_handle);
+    gatt_client_t * peripheral = provide_context_for_conn_handle(con_handle);
     
     if (!peripheral) return BTSTACK_MEMORY_ALLOC_FAILED; 
-    if (!is_ready(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
+    if (!gatt_client_request_start(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
 
     peripheral->callback = callback;
     peripheral->start_group_handle = 0x0001;
@@ -1421,15 +2016,15 @@ uint8_t gatt_client_discover_primary_services_by_uuid128(btstack_packet_handler_
     peripheral->uuid16 = 0;
     memcpy(peripheral->uuid128, uuid128, 16);
     peripheral->gatt_client_state = P_W2_SEND_SERVICE_WITH_UUID_QUERY;
-    gatt_client_run();
+    gatt_client_request_submit(peripheral);
     return 0;
 }
 
 uint8_t gatt_client_discover_characteristics_for_service(btstack_packet_handler_t callback, hci_con_handle_t con_handle, gatt_client_service_t *service){
-    gatt_client_t * peripheral = provide_context_for_conn_handle_and_start_timer(con_handle);
+    gatt_client_t * peripheral = provide_context_for_conn_handle(con_handle);
     
     if (!peripheral) return BTSTACK_MEMORY_ALLOC_FAILED; 
-    if (!is_ready(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
+    if (!gatt_client_request_start(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
 
     peripheral->callback = callback;
     peripheral->start_group_handle = service->start_group_handle;
@@ -1437,30 +2032,30 @@ uint8_t gatt_client_discover_characteristics_for_service(btstack_packet_handler_
     peripheral->filter_with_uuid = 0;
     peripheral->characteristic_start_handle = 0;
     peripheral->gatt_client_state = P_W2_SEND_ALL_CHARACTERISTICS_OF_SERVICE_QUERY;
-    gatt_client_run();
+    gatt_client_request_submit(peripheral);
     return 0;
 }
 
 uint8_t gatt_client_find_included_services_for_service(btstack_packet_handler_t callback, hci_con_handle_t con_handle, gatt_client_service_t *service){
-    gatt_client_t * peripheral = provide_context_for_conn_handle_and_start_timer(con_handle);
+    gatt_client_t * peripheral = provide_context_for_conn_handle(con_handle);
     
     if (!peripheral) return BTSTACK_MEMORY_ALLOC_FAILED; 
-    if (!is_ready(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
+    if (!gatt_client_request_start(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
     
     peripheral->callback = callback;
     peripheral->start_group_handle = service->start_group_handle;
     peripheral->end_group_handle   = service->end_group_handle;
     peripheral->gatt_client_state = P_W2_SEND_INCLUDED_SERVICE_QUERY;
     
-    gatt_client_run();
+    gatt_client_request_submit(peripheral);
     return 0;
 }
 
 uint8_t gatt_client_discover_characteristics_for_handle_range_by_uuid16(btstack_packet_handler_t callback, hci_con_handle_t con_handle, uint16_t start_handle, uint16_t end_handle, uint16_t uuid16){
-    gatt_client_t * peripheral = provide_context_for_conn_handle_and_start_timer(con_handle);
+    gatt_client_t * peripheral = provide_context_for_conn_handle(con_handle);
     
     if (!peripheral) return BTSTACK_MEMORY_ALLOC_FAILED; 
-    if (!is_ready(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
+    if (!gatt_client_request_start(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
     
     peripheral->callback = callback;
     peripheral->start_group_handle = start_handle;
@@ -1471,15 +2066,15 @@ uint8_t gatt_client_discover_characteristics_for_handle_range_by_uuid16(btstack_
     peripheral->characteristic_start_handle = 0;
     peripheral->gatt_client_state = P_W2_SEND_CHARACTERISTIC_WITH_UUID_QUERY;
     
-    gatt_client_run();
+    gatt_client_request_submit(peripheral);
     return 0;
 }
 
 uint8_t gatt_client_discover_characteristics_for_handle_range_by_uuid128(btstack_packet_handler_t callback, hci_con_handle_t con_handle, uint16_t start_handle, uint16_t end_handle, uint8_t * uuid128){
-    gatt_client_t * peripheral = provide_context_for_conn_handle_and_start_timer(con_handle);
+    gatt_client_t * peripheral = provide_context_for_conn_handle(con_handle);
     
     if (!peripheral) return BTSTACK_MEMORY_ALLOC_FAILED; 
-    if (!is_ready(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
+    if (!gatt_client_request_start(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
     
     peripheral->callback = callback;
     peripheral->start_group_handle = start_handle;
@@ -1490,7 +2085,7 @@ uint8_t gatt_client_discover_characteristics_for_handle_range_by_uuid128(btstack
     peripheral->characteristic_start_handle = 0;
     peripheral->gatt_client_state = P_W2_SEND_CHARACTERISTIC_WITH_UUID_QUERY;
     
-    gatt_client_run();
+    gatt_client_request_submit(peripheral);
     return 0;
 }
 
@@ -1504,43 +2099,43 @@ uint8_t gatt_client_discover_characteristics_for_service_by_uuid128(btstack_pack
 }
 
 uint8_t gatt_client_discover_characteristic_descriptors(btstack_packet_handler_t callback, hci_con_handle_t con_handle, gatt_client_characteristic_t *characteristic){
-    gatt_client_t * peripheral = provide_context_for_conn_handle_and_start_timer(con_handle);
+    gatt_client_t * peripheral = provide_context_for_conn_handle(con_handle);
     
     if (!peripheral) return BTSTACK_MEMORY_ALLOC_FAILED; 
-    if (!is_ready(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
-    
     if (characteristic->value_handle == characteristic->end_handle){
         emit_gatt_complete_event(peripheral, 0);
         return 0;
     }
+    if (!gatt_client_request_start(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
+    
     peripheral->callback = callback;
     peripheral->start_group_handle = characteristic->value_handle + 1;
     peripheral->end_group_handle   = characteristic->end_handle;
     peripheral->gatt_client_state = P_W2_SEND_ALL_CHARACTERISTIC_DESCRIPTORS_QUERY;
     
-    gatt_client_run();
+    gatt_client_request_submit(peripheral);
     return 0;
 }
 
 uint8_t gatt_client_read_value_of_characteristic_using_value_handle(btstack_packet_handler_t callback, hci_con_handle_t con_handle, uint16_t value_handle){
-    gatt_client_t * peripheral = provide_context_for_conn_handle_and_start_timer(con_handle);
+    gatt_client_t * peripheral = provide_context_for_conn_handle(con_handle);
     
     if (!peripheral) return BTSTACK_MEMORY_ALLOC_FAILED; 
-    if (!is_ready(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
+    if (!gatt_client_request_start(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
     
     peripheral->callback = callback;
     peripheral->attribute_handle = value_handle;
     peripheral->attribute_offset = 0;
     peripheral->gatt_client_state = P_W2_SEND_READ_CHARACTERISTIC_VALUE_QUERY;
-    gatt_client_run();
+    gatt_client_request_submit(peripheral);
     return 0;
 }
 
 uint8_t gatt_client_read_value_of_characteristics_by_uuid16(btstack_packet_handler_t callback, hci_con_handle_t con_handle, uint16_t start_handle, uint16_t end_handle, uint16_t uuid16){
-    gatt_client_t * peripheral = provide_context_for_conn_handle_and_start_timer(con_handle);
+    gatt_client_t * peripheral = provide_context_for_conn_handle(con_handle);
     
     if (!peripheral) return BTSTACK_MEMORY_ALLOC_FAILED; 
-    if (!is_ready(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
+    if (!gatt_client_request_start(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
     
     peripheral->callback = callback;
     peripheral->start_group_handle = start_handle;
@@ -1550,15 +2145,15 @@ uint8_t gatt_client_read_value_of_characteristics_by_uuid16(btstack_packet_handl
     peripheral->uuid16 = uuid16;
     uuid_add_bluetooth_prefix((uint8_t*) &(peripheral->uuid128), uuid16);
     peripheral->gatt_client_state = P_W2_SEND_READ_BY_TYPE_REQUEST;
-    gatt_client_run();
+    gatt_client_request_submit(peripheral);
     return 0;
 }
 
 uint8_t gatt_client_read_value_of_characteristics_by_uuid128(btstack_packet_handler_t callback, hci_con_handle_t con_handle, uint16_t start_handle, uint16_t end_handle, uint8_t * uuid128){
-    gatt_client_t * peripheral = provide_context_for_conn_handle_and_start_timer(con_handle);
+    gatt_client_t * peripheral = provide_context_for_conn_handle(con_handle);
     
     if (!peripheral) return BTSTACK_MEMORY_ALLOC_FAILED; 
-    if (!is_ready(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
+    if (!gatt_client_request_start(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
     
     peripheral->callback = callback;
     peripheral->start_group_handle = start_handle;
@@ -1568,7 +2163,7 @@ uint8_t gatt_client_read_value_of_characteristics_by_uuid128(btstack_packet_hand
     peripheral->uuid16 = 0;
     memcpy(peripheral->uuid128, uuid128, 16);
     peripheral->gatt_client_state = P_W2_SEND_READ_BY_TYPE_REQUEST;
-    gatt_client_run();
+    gatt_client_request_submit(peripheral);
     return 0;
 }
 
@@ -1578,16 +2173,16 @@ uint8_t gatt_client_read_value_of_characteristic(btstack_packet_handler_t callba
 }
 
 uint8_t gatt_client_read_long_value_of_characteristic_using_value_handle_with_offset(btstack_packet_handler_t callback, hci_con_handle_t con_handle, uint16_t characteristic_value_handle, uint16_t offset){
-    gatt_client_t * peripheral = provide_context_for_conn_handle_and_start_timer(con_handle);
+    gatt_client_t * peripheral = provide_context_for_conn_handle(con_handle);
     
     if (!peripheral) return BTSTACK_MEMORY_ALLOC_FAILED; 
-    if (!is_ready(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
+    if (!gatt_client_request_start(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
     
     peripheral->callback = callback;
     peripheral->attribute_handle = characteristic_value_handle;
     peripheral->attribute_offset = offset;
     peripheral->gatt_client_state = P_W2_SEND_READ_BLOB_QUERY;
-    gatt_client_run();
+    gatt_client_request_submit(peripheral);
     return 0;
 }
 
@@ -1600,16 +2195,16 @@ uint8_t gatt_client_read_long_value_of_characteristic(btstack_packet_handler_t c
 }
 
 uint8_t gatt_client_read_multiple_characteristic_values(btstack_packet_handler_t callback, hci_con_handle_t con_handle, int num_value_handles, uint16_t * value_handles){
-    gatt_client_t * peripheral = provide_context_for_conn_handle_and_start_timer(con_handle);
+    gatt_client_t * peripheral = provide_context_for_conn_handle(con_handle);
     
     if (!peripheral) return BTSTACK_MEMORY_ALLOC_FAILED; 
-    if (!is_ready(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
+    if (!gatt_client_request_start(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
     
     peripheral->callback = callback;
     peripheral->read_multiple_handle_count = num_value_handles;
     peripheral->read_multiple_handles = value_handles;
     peripheral->gatt_client_state = P_W2_SEND_READ_MULTIPLE_REQUEST;
-    gatt_client_run();
+    gatt_client_request_submit(peripheral);
     return 0;
 }
 
@@ -1627,25 +2222,25 @@ uint8_t gatt_client_write_value_of_characteristic_without_response(hci_con_handl
 }
 
 uint8_t gatt_client_write_value_of_characteristic(btstack_packet_handler_t callback, hci_con_handle_t con_handle, uint16_t value_handle, uint16_t value_length, uint8_t * data){
-    gatt_client_t * peripheral = provide_context_for_conn_handle_and_start_timer(con_handle);
+    gatt_client_t * peripheral = provide_context_for_conn_handle(con_handle);
     
     if (!peripheral) return BTSTACK_MEMORY_ALLOC_FAILED; 
-    if (!is_ready(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
+    if (!gatt_client_request_start(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
     
     peripheral->callback = callback;
     peripheral->attribute_handle = value_handle;
     peripheral->attribute_length = value_length;
     peripheral->attribute_value = data;
     peripheral->gatt_client_state = P_W2_SEND_WRITE_CHARACTERISTIC_VALUE;
-    gatt_client_run();
+    gatt_client_request_submit(peripheral);
     return 0;
 }
 
 uint8_t gatt_client_write_long_value_of_characteristic_with_offset(btstack_packet_handler_t callback, hci_con_handle_t con_handle, uint16_t value_handle, uint16_t offset, uint16_t value_length, uint8_t  * data){
-    gatt_client_t * peripheral = provide_context_for_conn_handle_and_start_timer(con_handle);
+    gatt_client_t * peripheral = provide_context_for_conn_handle(con_handle);
     
     if (!peripheral) return BTSTACK_MEMORY_ALLOC_FAILED; 
-    if (!is_ready(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
+    if (!gatt_client_request_start(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
     
     peripheral->callback = callback;
     peripheral->attribute_handle = value_handle;
@@ -1653,7 +2248,7 @@ uint8_t gatt_client_write_long_value_of_characteristic_with_offset(btstack_packe
     peripheral->attribute_offset = offset;
     peripheral->attribute_value = data;
     peripheral->gatt_client_state = P_W2_PREPARE_WRITE;
-    gatt_client_run();
+    gatt_client_request_submit(peripheral);
     return 0;
 }
 
@@ -1662,10 +2257,10 @@ uint8_t gatt_client_write_long_value_of_characteristic(btstack_packet_handler_t
 }
 
 uint8_t gatt_client_reliable_write_long_value_of_characteristic(btstack_packet_handler_t callback, hci_con_handle_t con_handle, uint16_t value_handle, uint16_t value_length, uint8_t * value){
-    gatt_client_t * peripheral = provide_context_for_conn_handle_and_start_timer(con_handle);
+    gatt_client_t * peripheral = provide_context_for_conn_handle(con_handle);
     
     if (!peripheral) return BTSTACK_MEMORY_ALLOC_FAILED; 
-    if (!is_ready(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
+    if (!gatt_client_request_start(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
     
     peripheral->callback = callback;
     peripheral->attribute_handle = value_handle;
@@ -1673,16 +2268,14 @@ uint8_t gatt_client_reliable_write_long_value_of_characteristic(btstack_packet_h
     peripheral->attribute_offset = 0;
     peripheral->attribute_value = value;
     peripheral->gatt_client_state = P_W2_PREPARE_RELIABLE_WRITE;
-    gatt_client_run();
+    gatt_client_request_submit(peripheral);
     return 0;
 }
 
 uint8_t gatt_client_write_client_characteristic_configuration(btstack_packet_handler_t callback, hci_con_handle_t con_handle, gatt_client_characteristic_t * characteristic, uint16_t configuration){
-    gatt_client_t * peripheral = provide_context_for_conn_handle_and_start_timer(con_handle);
+    gatt_client_t * peripheral = provide_context_for_conn_handle(con_handle);
     
     if (!peripheral) return BTSTACK_MEMORY_ALLOC_FAILED; 
-    if (!is_ready(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
-    
     if ( (configuration & GATT_CLIENT_CHARACTERISTICS_CONFIGURATION_NOTIFICATION) &&
         (characteristic->properties & ATT_PROPERTY_NOTIFY) == 0) {
         log_info("gatt_client_write_client_characteristic_configuration: GATT_CLIENT_CHARACTERISTIC_NOTIFICATION_NOT_SUPPORTED");
@@ -1692,6 +2285,7 @@ uint8_t gatt_client_write_client_characteristic_configuration(btstack_packet_han
         log_info("gatt_client_write_client_characteristic_configuration: GATT_CLIENT_CHARACTERISTIC_INDICATION_NOT_SUPPORTED");
         return GATT_CLIENT_CHARACTERISTIC_INDICATION_NOT_SUPPORTED;
     }
+    if (!gatt_client_request_start(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
     
     peripheral->callback = callback;
     peripheral->start_group_handle = characteristic->value_handle;
@@ -1699,21 +2293,21 @@ uint8_t gatt_client_write_client_characteristic_configuration(btstack_packet_han
     little_endian_store_16(peripheral->client_characteristic_configuration_value, 0, configuration);
     
     peripheral->gatt_client_state = P_W2_SEND_READ_CLIENT_CHARACTERISTIC_CONFIGURATION_QUERY;
-    gatt_client_run();
+    gatt_client_request_submit(peripheral);
     return 0;
 }
 
 uint8_t gatt_client_read_characteristic_descriptor_using_descriptor_handle(btstack_packet_handler_t callback, hci_con_handle_t con_handle, uint16_t descriptor_handle){
-    gatt_client_t * peripheral = provide_context_for_conn_handle_and_start_timer(con_handle);
+    gatt_client_t * peripheral = provide_context_for_conn_handle(con_handle);
     
     if (!peripheral) return BTSTACK_MEMORY_ALLOC_FAILED; 
-    if (!is_ready(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
+    if (!gatt_client_request_start(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
     
     peripheral->callback = callback;
     peripheral->attribute_handle = descriptor_handle;
     
     peripheral->gatt_client_state = P_W2_SEND_READ_CHARACTERISTIC_DESCRIPTOR_QUERY;
-    gatt_client_run();
+    gatt_client_request_submit(peripheral);
     return 0;
 }
 
@@ -1722,16 +2316,16 @@ uint8_t gatt_client_read_characteristic_descriptor(btstack_packet_handler_t call
 }
 
 uint8_t gatt_client_read_long_characteristic_descriptor_using_descriptor_handle_with_offset(btstack_packet_handler_t callback, hci_con_handle_t con_handle, uint16_t descriptor_handle, uint16_t offset){
-    gatt_client_t * peripheral = provide_context_for_conn_handle_and_start_timer(con_handle);
+    gatt_client_t * peripheral = provide_context_for_conn_handle(con_handle);
     
     if (!peripheral) return BTSTACK_MEMORY_ALLOC_FAILED; 
-    if (!is_ready(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
+    if (!gatt_client_request_start(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
     
     peripheral->callback = callback;
     peripheral->attribute_handle = descriptor_handle;
     peripheral->attribute_offset = offset;
     peripheral->gatt_client_state = P_W2_SEND_READ_BLOB_CHARACTERISTIC_DESCRIPTOR_QUERY;
-    gatt_client_run();
+    gatt_client_request_submit(peripheral);
     return 0;
 }
 
@@ -1744,10 +2338,10 @@ uint8_t gatt_client_read_long_characteristic_descriptor(btstack_packet_handler_t
 }
 
 uint8_t gatt_client_write_characteristic_descriptor_using_descriptor_handle(btstack_packet_handler_t callback, hci_con_handle_t con_handle, uint16_t descriptor_handle, uint16_t length, uint8_t  * data){
-    gatt_client_t * peripheral = provide_context_for_conn_handle_and_start_timer(con_handle);
+    gatt_client_t * peripheral = provide_context_for_conn_handle(con_handle);
     
     if (!peripheral) return BTSTACK_MEMORY_ALLOC_FAILED; 
-    if (!is_ready(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
+    if (!gatt_client_request_start(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
     
     peripheral->callback = callback;
     peripheral->attribute_handle = descriptor_handle;
@@ -1755,7 +2349,7 @@ uint8_t gatt_client_write_characteristic_descriptor_using_descriptor_handle(btst
     peripheral->attribute_offset = 0;
     peripheral->attribute_value = data;
     peripheral->gatt_client_state = P_W2_SEND_WRITE_CHARACTERISTIC_DESCRIPTOR;
-    gatt_client_run();
+    gatt_client_request_submit(peripheral);
     return 0;
 }
 
@@ -1764,10 +2358,10 @@ uint8_t gatt_client_write_characteristic_descriptor(btstack_packet_handler_t cal
 }
 
 uint8_t gatt_client_write_long_characteristic_descriptor_using_descriptor_handle_with_offset(btstack_packet_handler_t callback, hci_con_handle_t con_handle, uint16_t descriptor_handle, uint16_t offset, uint16_t length, uint8_t  * data){
-    gatt_client_t * peripheral = provide_context_for_conn_handle_and_start_timer(con_handle);
+    gatt_client_t * peripheral = provide_context_for_conn_handle(con_handle);
     
     if (!peripheral) return BTSTACK_MEMORY_ALLOC_FAILED; 
-    if (!is_ready(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
+    if (!gatt_client_request_start(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
     
     peripheral->callback = callback;
     peripheral->attribute_handle = descriptor_handle;
@@ -1775,7 +2369,7 @@ uint8_t gatt_client_write_long_characteristic_descriptor_using_descriptor_handle
     peripheral->attribute_offset = offset;
     peripheral->attribute_value = data;
     peripheral->gatt_client_state = P_W2_PREPARE_WRITE_CHARACTERISTIC_DESCRIPTOR;
-    gatt_client_run();
+    gatt_client_request_submit(peripheral);
     return 0;
 }
 
@@ -1791,10 +2385,10 @@ uint8_t gatt_client_write_long_characteristic_descriptor(btstack_packet_handler_
  * @brief -> gatt complete event
  */
 uint8_t gatt_client_prepare_write(btstack_packet_handler_t callback, hci_con_handle_t con_handle, uint16_t attribute_handle, uint16_t offset, uint16_t length, uint8_t * data){
-    gatt_client_t * peripheral = provide_context_for_conn_handle_and_start_timer(con_handle);
+    gatt_client_t * peripheral = provide_context_for_conn_handle(con_handle);
     
     if (!peripheral) return BTSTACK_MEMORY_ALLOC_FAILED; 
-    if (!is_ready(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
+    if (!gatt_client_request_start(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
     
     peripheral->callback = callback;
     peripheral->attribute_handle = attribute_handle;
@@ -1802,7 +2396,7 @@ uint8_t gatt_client_prepare_write(btstack_packet_handler_t callback, hci_con_han
     peripheral->attribute_offset = offset;
     peripheral->attribute_value = data;
     peripheral->gatt_client_state = P_W2_PREPARE_WRITE_SINGLE;
-    gatt_client_run();
+    gatt_client_request_submit(peripheral);
     return 0;
 }
 
@@ -1810,14 +2404,14 @@ uint8_t gatt_client_prepare_write(btstack_packet_handler_t callback, hci_con_han
  * @brief -> gatt complete event
  */
 uint8_t gatt_client_execute_write(btstack_packet_handler_t callback, hci_con_handle_t con_handle){
-    gatt_client_t * peripheral = provide_context_for_conn_handle_and_start_timer(con_handle);
+    gatt_client_t * peripheral = provide_context_for_conn_handle(con_handle);
 
     if (!peripheral) return BTSTACK_MEMORY_ALLOC_FAILED; 
-    if (!is_ready(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
+    if (!gatt_client_request_start(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
     
     peripheral->callback = callback;
     peripheral->gatt_client_state = P_W2_EXECUTE_PREPARED_WRITE;
-    gatt_client_run();
+    gatt_client_request_submit(peripheral);
     return 0;
 }
 
@@ -1825,15 +2419,27 @@ uint8_t gatt_client_execute_write(btstack_packet_handler_t callback, hci_con_han
  * @brief -> gatt complete event
  */
 uint8_t gatt_client_cancel_write(btstack_packet_handler_t callback, hci_con_handle_t con_handle){
-    gatt_client_t * peripheral = provide_context_for_conn_handle_and_start_timer(con_handle);
+    gatt_client_t * peripheral = provide_context_for_conn_handle(con_handle);
     
     if (!peripheral) return BTSTACK_MEMORY_ALLOC_FAILED; 
-    if (!is_ready(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
+    if (!gatt_client_request_start(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
     
     peripheral->callback = callback;
     peripheral->gatt_client_state = P_W2_CANCEL_PREPARED_WRITE;
-    gatt_client_run();
-    return 0;    
+    gatt_client_request_submit(peripheral);
+    return 0;
+}
+
+void gatt_client_set_cache_db(const gatt_client_cache_db_t * cache_db){
+#ifdef ENABLE_GATT_CLIENT_CACHE
+    gatt_client_cache_db = cache_db;
+    if (gatt_client_cache_db){
+        gatt_client_cache_db->open();
+    }
+#else
+    UNUSED(cache_db);
+    log_error("gatt_client_set_cache_db: ENABLE_GATT_CLIENT_CACHE not defined");
+#endif
 }
 
 void gatt_client_pts_suppress_mtu_exchange(void){
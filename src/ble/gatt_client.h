@@ -40,6 +40,7 @@
 #define btstack_gatt_client_h
 
 #include "hci.h"
+#include "ble/gatt_client_cache_db.h"
 
 #if defined __cplusplus
 extern "C" {
@@ -129,6 +130,92 @@ typedef enum{
     MTU_EXCHANGED
 } gatt_client_mtu_t;
 
+// max number of GATT client requests queued per connection while another request is active
+#ifndef GATT_CLIENT_REQUEST_QUEUE_DEPTH
+#define GATT_CLIENT_REQUEST_QUEUE_DEPTH 2
+#endif
+
+// parameters of a GATT client request waiting for the active one to complete
+typedef struct {
+    gatt_client_state_t gatt_client_state;
+    btstack_packet_handler_t callback;
+
+    uint16_t uuid16;
+    uint8_t  uuid128[16];
+
+    uint16_t start_group_handle;
+    uint16_t end_group_handle;
+
+    uint16_t query_start_handle;
+    uint16_t query_end_handle;
+
+    uint16_t characteristic_start_handle;
+
+    uint16_t attribute_handle;
+    uint16_t attribute_offset;
+    uint16_t attribute_length;
+    uint8_t* attribute_value;
+
+    uint16_t    read_multiple_handle_count;
+    uint16_t  * read_multiple_handles;
+
+    uint8_t  client_characteristic_configuration_value[2];
+    uint8_t  filter_with_uuid;
+    int      le_device_index;
+} gatt_client_request_t;
+
+// max number of attributes in the GATT client discovery cache of a bonded device, see ENABLE_GATT_CLIENT_CACHE
+#ifndef GATT_CLIENT_CACHE_MAX_SERVICES
+#define GATT_CLIENT_CACHE_MAX_SERVICES 8
+#endif
+#ifndef GATT_CLIENT_CACHE_MAX_CHARACTERISTICS
+#define GATT_CLIENT_CACHE_MAX_CHARACTERISTICS 24
+#endif
+#ifndef GATT_CLIENT_CACHE_MAX_DESCRIPTORS
+#define GATT_CLIENT_CACHE_MAX_DESCRIPTORS 24
+#endif
+
+typedef struct {
+    uint16_t start_group_handle;
+    uint16_t end_group_handle;
+    uint8_t  uuid128[16];
+    uint8_t  characteristics_complete;
+} gatt_client_cache_service_t;
+
+typedef struct {
+    uint16_t start_handle;
+    uint16_t value_handle;
+    uint16_t end_handle;
+    uint16_t properties;
+    uint8_t  uuid128[16];
+    uint8_t  descriptors_complete;
+} gatt_client_cache_characteristic_t;
+
+typedef struct {
+    uint16_t handle;
+    uint8_t  uuid128[16];
+} gatt_client_cache_descriptor_t;
+
+// services, characteristics and descriptors of a bonded device learned by complete discovery queries,
+// characteristics and descriptors are sorted by handle
+typedef struct {
+    int      le_device_index;
+    uint8_t  services_complete;
+    uint8_t  num_services;
+    uint8_t  num_characteristics;
+    uint8_t  num_descriptors;
+    gatt_client_cache_service_t        services[GATT_CLIENT_CACHE_MAX_SERVICES];
+    gatt_client_cache_characteristic_t characteristics[GATT_CLIENT_CACHE_MAX_CHARACTERISTICS];
+    gatt_client_cache_descriptor_t     descriptors[GATT_CLIENT_CACHE_MAX_DESCRIPTORS];
+} gatt_client_cache_t;
+
+typedef enum {
+    GATT_CLIENT_CACHE_RECORD_NONE,
+    GATT_CLIENT_CACHE_RECORD_SERVICES,
+    GATT_CLIENT_CACHE_RECORD_CHARACTERISTICS,
+    GATT_CLIENT_CACHE_RECORD_DESCRIPTORS,
+} gatt_client_cache_record_t;
+
 typedef struct gatt_client{
     btstack_linked_item_t    item;
     // TODO: rename gatt_client_state -> state
@@ -175,6 +262,19 @@ typedef struct gatt_client{
     uint8_t  cmac[8];
 
     btstack_timer_source_t gc_timeout;
+
+    // requests issued while another one was active, served in order
+    gatt_client_request_t request_queue[GATT_CLIENT_REQUEST_QUEUE_DEPTH];
+    uint8_t  request_queue_head;
+    uint8_t  request_queue_count;
+
+#ifdef ENABLE_GATT_CLIENT_CACHE
+    // discovery cache of bonded device, answer active query from cache or record its results
+    gatt_client_cache_t *      cache;
+    uint8_t                    cache_answer_pending;
+    gatt_client_cache_record_t cache_record;
+    uint8_t                    cache_record_overflow;
+#endif
 } gatt_client_t;
 
 typedef struct gatt_client_notification {
@@ -210,6 +310,9 @@ typedef struct {
 
 /** 
  * @brief Set up GATT client.
+ * @note Queries issued while another query on the same connection is active are queued, up to GATT_CLIENT_REQUEST_QUEUE_DEPTH
+ *       per connection, and started in order. Each query reports its GATT_EVENT_QUERY_COMPLETE to its own callback. Buffers
+ *       passed to a query must stay valid until then. GATT_CLIENT_IN_WRONG_STATE is returned if the queue is full.
  */
 void gatt_client_init(void);
 
@@ -219,7 +322,7 @@ void gatt_client_init(void);
 uint8_t gatt_client_get_mtu(hci_con_handle_t con_handle, uint16_t * mtu);
 
 /** 
- * @brief Returns if the GATT client is ready to receive a query. It is used with daemon. 
+ * @brief Returns if the GATT client is ready to receive a query, i.e. no query is active or queued. It is used with daemon. 
  */
 int gatt_client_is_ready(hci_con_handle_t con_handle);
 
@@ -356,6 +459,15 @@ uint8_t gatt_client_execute_write(btstack_packet_handler_t callback, hci_con_han
  */
 uint8_t gatt_client_cancel_write(btstack_packet_handler_t callback, hci_con_handle_t con_handle);
 
+/**
+ * @brief Set storage for the discovery cache of bonded devices. Complete service, characteristic and
+ *        descriptor discoveries are recorded and answered locally on later connections until the
+ *        Service Changed characteristic of the remote device is indicated.
+ * @note requires ENABLE_GATT_CLIENT_CACHE. NULL keeps the cache only for the current connection.
+ * @param cache_db
+ */
+void gatt_client_set_cache_db(const gatt_client_cache_db_t * cache_db);
+
 /* API_END */
 
 // used by generated btstack_event.c
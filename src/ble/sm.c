@@ -43,6 +43,9 @@
 #include "ble/core.h"
 #include "ble/sm.h"
 #include "btstack_debug.h"
+#ifdef ENABLE_SOFTWARE_AES128
+#include "btstack_aes128.h"
+#endif
 #include "btstack_event.h"
 #include "btstack_linked_list.h"
 #include "btstack_memory.h"
@@ -60,6 +63,11 @@
 #endif
 
 
+// number of recently resolved addresses whose device is tested first, min 1
+#ifndef SM_RESOLVED_ADDRESS_CACHE_SIZE
+#define SM_RESOLVED_ADDRESS_CACHE_SIZE 4
+#endif
+
 // Software ECDH implementation provided by mbedtls
 #ifdef USE_MBEDTLS_FOR_ECDH
 #include "mbedtls/config.h"
@@ -210,6 +218,18 @@ static void *    sm_address_resolution_context;
 static address_resolution_mode_t sm_address_resolution_mode;
 static btstack_linked_list_t sm_address_resolution_general_queue;
 
+// resolved address cache, replaced round-robin
+typedef struct {
+    uint8_t   valid;
+    uint8_t   addr_type;
+    bd_addr_t addr;
+    int       le_device_index;
+} sm_resolved_address_t;
+
+static sm_resolved_address_t sm_resolved_addresses[SM_RESOLVED_ADDRESS_CACHE_SIZE];
+static int                   sm_resolved_addresses_next;
+static int                   sm_address_resolution_cache_hit;
+
 // aes128 crypto engine. store current sm_connection_t in sm_aes128_context
 static sm_aes128_state_t  sm_aes128_state;
 static void *             sm_aes128_context;
@@ -498,6 +518,17 @@ static void sm_ah_r_prime(uint8_t r[3], uint8_t * r_prime){
     memcpy(&r_prime[13], r, 3);
 }
 
+#ifdef ENABLE_SOFTWARE_AES128
+// check if resolvable private address prand || hash matches irk: ah(irk, prand) == hash
+static int sm_ah_matches(sm_key_t irk, bd_addr_t address){
+    sm_key_t r_prime;
+    sm_key_t ah;
+    sm_ah_r_prime(address, r_prime);
+    btstack_aes128_calc(irk, r_prime, ah);
+    return memcmp(&address[3], &ah[13], 3) == 0;
+}
+#endif
+
 // d1 helper
 // d' = padding || r || d
 // d,r - 16 bit values
@@ -811,10 +842,57 @@ static int sm_address_resolution_idle(void){
     return sm_address_resolution_mode == ADDRESS_RESOLUTION_IDLE;
 }
 
+static sm_resolved_address_t * sm_resolved_address_cache_get(uint8_t addr_type, bd_addr_t addr){
+    int i;
+    for (i=0;i<SM_RESOLVED_ADDRESS_CACHE_SIZE;i++){
+        sm_resolved_address_t * entry = &sm_resolved_addresses[i];
+        if (!entry->valid) continue;
+        if (entry->addr_type != addr_type) continue;
+        if (memcmp(entry->addr, addr, 6) != 0) continue;
+        return entry;
+    }
+    return NULL;
+}
+
+static void sm_resolved_address_cache_add(uint8_t addr_type, bd_addr_t addr, int le_device_index){
+    sm_resolved_address_t * entry = sm_resolved_address_cache_get(addr_type, addr);
+    if (!entry){
+        entry = &sm_resolved_addresses[sm_resolved_addresses_next];
+        sm_resolved_addresses_next = (sm_resolved_addresses_next + 1) % SM_RESOLVED_ADDRESS_CACHE_SIZE;
+    }
+    entry->valid = 1;
+    entry->addr_type = addr_type;
+    memcpy(entry->addr, addr, 6);
+    entry->le_device_index = le_device_index;
+}
+
+static void sm_resolved_address_cache_remove(uint8_t addr_type, bd_addr_t addr){
+    sm_resolved_address_t * entry = sm_resolved_address_cache_get(addr_type, addr);
+    if (!entry) return;
+    entry->valid = 0;
+}
+
+// after testing the cached device, test all devices
+static void sm_address_resolution_test_next(void){
+    if (sm_address_resolution_cache_hit){
+        sm_address_resolution_cache_hit = 0;
+        sm_address_resolution_test = 0;
+        return;
+    }
+    sm_address_resolution_test++;
+}
+
 static void sm_address_resolution_start_lookup(uint8_t addr_type, hci_con_handle_t con_handle, bd_addr_t addr, address_resolution_mode_t mode, void * context){
     memcpy(sm_address_resolution_address, addr, 6);
     sm_address_resolution_addr_type = addr_type;
     sm_address_resolution_test = 0;
+    sm_address_resolution_cache_hit = 0;
+    // repeated advertisements and reconnects: test device that resolved this address before first
+    sm_resolved_address_t * entry = sm_resolved_address_cache_get(addr_type, addr);
+    if (entry && entry->le_device_index < le_device_db_count()){
+        sm_address_resolution_test = entry->le_device_index;
+        sm_address_resolution_cache_hit = 1;
+    }
     sm_address_resolution_mode = mode;
     sm_address_resolution_context = context;
     sm_notify_client_base(SM_EVENT_IDENTITY_RESOLVING_STARTED, con_handle, addr_type, addr);
@@ -1193,8 +1271,19 @@ static void sm_address_resolution_handle_event(address_resolution_event_t event)
     sm_address_resolution_mode = ADDRESS_RESOLUTION_IDLE;
     sm_address_resolution_context = NULL;
     sm_address_resolution_test = -1;
+    sm_address_resolution_cache_hit = 0;
     hci_con_handle_t con_handle = 0;
 
+    // update resolved address cache
+    switch (event){
+        case ADDRESS_RESOLUTION_SUCEEDED:
+            sm_resolved_address_cache_add(sm_address_resolution_addr_type, sm_address_resolution_address, matched_device_id);
+            break;
+        case ADDRESS_RESOLUTION_FAILED:
+            sm_resolved_address_cache_remove(sm_address_resolution_addr_type, sm_address_resolution_address);
+            break;
+    }
+
     sm_connection_t * sm_connection;
     sm_key_t ltk;
     switch (mode){
@@ -1913,10 +2002,20 @@ static void sm_run(void){
             }
 
             if (sm_address_resolution_addr_type == 0){
-                sm_address_resolution_test++;
+                sm_address_resolution_test_next();
                 continue;
             }
 
+#ifdef ENABLE_SOFTWARE_AES128
+            // resolve on host, all IRKs are tested in this pass without HCI LE Encrypt round-trips
+            if (sm_ah_matches(irk, sm_address_resolution_address)){
+                log_info("LE Device Lookup: matched resolvable private address");
+                sm_address_resolution_handle_event(ADDRESS_RESOLUTION_SUCEEDED);
+                break;
+            }
+            sm_address_resolution_test_next();
+            continue;
+#else
             if (sm_aes128_state == SM_AES128_ACTIVE) break;
 
             log_info("LE Device Lookup: calculate AH");
@@ -1927,6 +2026,7 @@ static void sm_run(void){
             sm_address_resolution_ah_calculation_active = 1;
             sm_aes128_start(irk, r_prime, sm_address_resolution_context);   // keep context
             return;
+#endif
         }
 
         if (sm_address_resolution_test >= le_device_db_count()){
@@ -2554,7 +2654,7 @@ static void sm_handle_encryption_result(uint8_t * data){
             return;
         }
         // no match, try next
-        sm_address_resolution_test++;
+        sm_address_resolution_test_next();
         return;
     }
 
@@ -3643,6 +3743,7 @@ void sm_init(void){
     sm_address_resolution_ah_calculation_active = 0;
     sm_address_resolution_mode = ADDRESS_RESOLUTION_IDLE;
     sm_address_resolution_general_queue = NULL;
+    memset(sm_resolved_addresses, 0, sizeof(sm_resolved_addresses));
     
     gap_random_adress_update_period = 15 * 60 * 1000L;
     sm_active_connection = 0;
@@ -656,7 +656,26 @@ typedef enum {
 #define L2CAP_CID_SECURITY_MANAGER_PROTOCOL 0x0006
 
 // L2CAP Configuration Result Codes
-#define L2CAP_CONF_RESULT_UNKNOWN_OPTIONS   0x0003
+#define L2CAP_CONF_RESULT_SUCCESS                  0x0000
+#define L2CAP_CONF_RESULT_UNACCEPTABLE_PARAMETERS  0x0001
+#define L2CAP_CONF_RESULT_UNKNOWN_OPTIONS          0x0003
+
+// L2CAP Configuration Option Types
+#define L2CAP_CONFIG_OPTION_TYPE_MAX_TRANSMISSION_UNIT                  0x01
+#define L2CAP_CONFIG_OPTION_TYPE_FLUSH_TIMEOUT                          0x02
+#define L2CAP_CONFIG_OPTION_TYPE_RETRANSMISSION_AND_FLOW_CONTROL        0x04
+#define L2CAP_CONFIG_OPTION_TYPE_FRAME_CHECK_SEQUENCE                   0x05
+
+// L2CAP Extended Features Mask bits
+#define L2CAP_EXTENDED_FEATURE_ENHANCED_RETRANSMISSION_MODE   0x0008
+#define L2CAP_EXTENDED_FEATURE_STREAMING_MODE                 0x0010
+#define L2CAP_EXTENDED_FEATURE_FCS_OPTION                     0x0020
+#define L2CAP_EXTENDED_FEATURE_FIXED_CHANNELS                 0x0080
+#define L2CAP_EXTENDED_FEATURE_UNICAST_CONNECTIONLESS_DATA    0x0200
+
+// Enhanced Retransmission Mode default timeouts, see Core spec Vol 3, Part A, 8.6.2
+#define L2CAP_ERTM_DEFAULT_RETRANSMISSION_TIMEOUT_MS  2000
+#define L2CAP_ERTM_DEFAULT_MONITOR_TIMEOUT_MS        12000
 
 // L2CAP Reject Result Codes
 #define L2CAP_REJ_CMD_UNKNOWN               0x0000
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2016 BlueKitchen GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 4. Any redistribution, use, or modification is done solely for
+ *    personal benefit and not for any commercial purpose or for
+ *    monetary gain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BLUEKITCHEN GMBH AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MATTHIAS
+ * RINGWALD OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Please inquire about commercial licensing options at 
+ * contact@bluekitchen-gmbh.com
+ *
+ */
+
+/*
+ *  btstack_callback_queue.c
+ *
+ *  Bounded MPSC queue: each entry has a sequence number that tells producers and the consumer
+ *  if the entry is free (sequence == position) or filled (sequence == position + 1).
+ *  Producers reserve an entry by compare-and-swap on the enqueue position.
+ */
+
+#include "btstack_callback_queue.h"
+#include "bluetooth.h"
+
+#include <stddef.h> // NULL
+
+#if !defined(__GNUC__)
+#error "btstack_callback_queue requires GCC compatible __atomic builtins"
+#endif
+
+void btstack_callback_queue_init(btstack_callback_queue_t * callback_queue, btstack_callback_queue_entry_t * entries, uint32_t num_entries){
+    uint32_t i;
+    callback_queue->entries = entries;
+    callback_queue->mask = num_entries - 1;
+    callback_queue->enqueue_pos = 0;
+    callback_queue->dequeue_pos = 0;
+    for (i = 0; i < num_entries; i++){
+        entries[i].callback = NULL;
+        entries[i].context = NULL;
+        __atomic_store_n(&entries[i].sequence, i, __ATOMIC_RELAXED);
+    }
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+int btstack_callback_queue_add(btstack_callback_queue_t * callback_queue, void (*callback)(void * context), void * context){
+    btstack_callback_queue_entry_t * entry;
+    uint32_t pos = __atomic_load_n(&callback_queue->enqueue_pos, __ATOMIC_RELAXED);
+    while (1){
+        entry = &callback_queue->entries[pos & callback_queue->mask];
+        uint32_t sequence = __atomic_load_n(&entry->sequence, __ATOMIC_ACQUIRE);
+        int32_t diff = (int32_t) (sequence - pos);
+        if (diff == 0){
+            // entry is free, try to reserve it. on failure, pos is updated
+            if (__atomic_compare_exchange_n(&callback_queue->enqueue_pos, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+        } else if (diff < 0){
+            // entry still used by consumer
+            return ERROR_CODE_MEMORY_CAPACITY_EXCEEDED;
+        } else {
+            // other producer was faster
+            pos = __atomic_load_n(&callback_queue->enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+    entry->callback = callback;
+    entry->context  = context;
+    // publish
+    __atomic_store_n(&entry->sequence, pos + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+int btstack_callback_queue_get(btstack_callback_queue_t * callback_queue, void (**callback)(void * context), void ** context){
+    uint32_t pos = callback_queue->dequeue_pos;
+    btstack_callback_queue_entry_t * entry = &callback_queue->entries[pos & callback_queue->mask];
+    uint32_t sequence = __atomic_load_n(&entry->sequence, __ATOMIC_ACQUIRE);
+    if ((int32_t) (sequence - (pos + 1)) < 0) return 0;
+    *callback = entry->callback;
+    *context  = entry->context;
+    callback_queue->dequeue_pos = pos + 1;
+    // release entry for next round
+    __atomic_store_n(&entry->sequence, pos + callback_queue->mask + 1, __ATOMIC_RELEASE);
+    return 1;
+}
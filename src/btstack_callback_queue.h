@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2016 BlueKitchen GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 4. Any redistribution, use, or modification is done solely for
+ *    personal benefit and not for any commercial purpose or for
+ *    monetary gain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BLUEKITCHEN GMBH AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MATTHIAS
+ * RINGWALD OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Please inquire about commercial licensing options at 
+ * contact@bluekitchen-gmbh.com
+ *
+ */
+
+/*
+ *  btstack_callback_queue.h
+ *
+ *  Bounded lock-free multi-producer single-consumer queue of callbacks with context,
+ *  used by run loops to execute code on the main thread
+ */
+
+#ifndef __BTSTACK_CALLBACK_QUEUE_H
+#define __BTSTACK_CALLBACK_QUEUE_H
+
+#include <stdint.h>
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+typedef struct btstack_callback_queue_entry {
+    uint32_t sequence;
+    void (*callback)(void * context);
+    void * context;
+} btstack_callback_queue_entry_t;
+
+typedef struct btstack_callback_queue {
+    btstack_callback_queue_entry_t * entries;
+    uint32_t mask;
+    // next entry to write, shared by producers
+    uint32_t enqueue_pos;
+    // next entry to read, only used by consumer
+    uint32_t dequeue_pos;
+} btstack_callback_queue_t;
+
+/**
+ * Init callback queue
+ * @param callback_queue object
+ * @param entries storage
+ * @param num_entries has to be a power of two
+ */
+void btstack_callback_queue_init(btstack_callback_queue_t * callback_queue, btstack_callback_queue_entry_t * entries, uint32_t num_entries);
+
+/**
+ * Add callback to queue. Lock-free, can be called from any thread
+ * @param callback_queue object
+ * @param callback
+ * @param context
+ * @return 0 if ok, ERROR_CODE_MEMORY_CAPACITY_EXCEEDED if queue is full
+ */
+int btstack_callback_queue_add(btstack_callback_queue_t * callback_queue, void (*callback)(void * context), void * context);
+
+/**
+ * Get next callback from queue. Must only be called by the consumer thread
+ * @param callback_queue object
+ * @param callback
+ * @param context
+ * @return 1 if callback was returned, 0 if queue is empty
+ */
+int btstack_callback_queue_get(btstack_callback_queue_t * callback_queue, void (**callback)(void * context), void ** context);
+
+#if defined __cplusplus
+}
+#endif
+
+#endif // __BTSTACK_CALLBACK_QUEUE_H
@@ -131,6 +131,7 @@ typedef uint8_t sm_key_t[16];
 #define L2CAP_DATA_LEN_EXCEEDS_REMOTE_MTU                  0x6A
 #define L2CAP_SERVICE_DOES_NOT_EXIST                       0x6B
 #define L2CAP_LOCAL_CID_DOES_NOT_EXIST                     0x6C
+#define L2CAP_CHANNEL_MODE_NOT_SUPPORTED_BY_REMOTE         0x6D
     
 #define RFCOMM_MULTIPLEXER_STOPPED                         0x70
 #define RFCOMM_CHANNEL_ALREADY_REGISTERED                  0x71
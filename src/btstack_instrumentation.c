@@ -0,0 +1,254 @@
+/*
+ * Copyright (C) 2016 BlueKitchen GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 4. Any redistribution, use, or modification is done solely for
+ *    personal benefit and not for any commercial purpose or for
+ *    monetary gain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BLUEKITCHEN GMBH AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MATTHIAS
+ * RINGWALD OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Please inquire about commercial licensing options at 
+ * contact@bluekitchen-gmbh.com
+ *
+ */
+
+
+/*
+ *  btstack_instrumentation.c
+ *
+ *  Per-layer latency and throughput counters for received packets
+ */
+
+#include "btstack_instrumentation.h"
+
+#include "btstack_debug.h"
+#include "btstack_run_loop.h"
+
+#include <string.h>
+
+// max nesting of layer handlers
+#define BTSTACK_INSTRUMENTATION_MAX_DEPTH 8
+
+#define BTSTACK_INSTRUMENTATION_SUB_BUCKETS (1 << BTSTACK_INSTRUMENTATION_HISTOGRAM_SUB_BUCKET_BITS)
+
+typedef struct {
+    btstack_instrumentation_entry_t * entry;
+    uint64_t start_us;
+} btstack_instrumentation_frame_t;
+
+static btstack_instrumentation_entry_t instrumentation_entries[BTSTACK_INSTRUMENTATION_MAX_ENTRIES];
+static int                             instrumentation_num_entries;
+
+// handlers currently active, outermost one is transport
+static btstack_instrumentation_frame_t instrumentation_stack[BTSTACK_INSTRUMENTATION_MAX_DEPTH];
+static int                             instrumentation_depth;
+static uint64_t                        instrumentation_received_us;
+
+static btstack_timer_source_t instrumentation_report_timer;
+static uint32_t               instrumentation_report_interval_ms;
+
+static const char * instrumentation_layer_names[] = {
+    "Transport", "HCI", "L2CAP", "ATT", "RFCOMM"
+};
+
+static int btstack_instrumentation_bucket_for_value(uint32_t value){
+    if (value < BTSTACK_INSTRUMENTATION_SUB_BUCKETS) return value;
+    int msb = BTSTACK_INSTRUMENTATION_HISTOGRAM_SUB_BUCKET_BITS;
+    while ((value >> (msb + 1)) != 0){
+        msb++;
+    }
+    int index = (msb - BTSTACK_INSTRUMENTATION_HISTOGRAM_SUB_BUCKET_BITS + 1) * BTSTACK_INSTRUMENTATION_SUB_BUCKETS
+              + ((value >> (msb - BTSTACK_INSTRUMENTATION_HISTOGRAM_SUB_BUCKET_BITS)) & (BTSTACK_INSTRUMENTATION_SUB_BUCKETS - 1));
+    if (index >= BTSTACK_INSTRUMENTATION_HISTOGRAM_BUCKETS){
+        index = BTSTACK_INSTRUMENTATION_HISTOGRAM_BUCKETS - 1;
+    }
+    return index;
+}
+
+// largest value counted in bucket
+static uint32_t btstack_instrumentation_value_for_bucket(int index){
+    if (index < BTSTACK_INSTRUMENTATION_SUB_BUCKETS) return index;
+    int msb = index / BTSTACK_INSTRUMENTATION_SUB_BUCKETS + BTSTACK_INSTRUMENTATION_HISTOGRAM_SUB_BUCKET_BITS - 1;
+    int shift = msb - BTSTACK_INSTRUMENTATION_HISTOGRAM_SUB_BUCKET_BITS;
+    uint32_t sub_bucket = index & (BTSTACK_INSTRUMENTATION_SUB_BUCKETS - 1);
+    return ((BTSTACK_INSTRUMENTATION_SUB_BUCKETS + sub_bucket + 1) << shift) - 1;
+}
+
+static void btstack_instrumentation_histogram_add(btstack_instrumentation_histogram_t * histogram, uint64_t value_us){
+    uint32_t value = value_us > 0xffffffff ? 0xffffffff : (uint32_t) value_us;
+    histogram->buckets[btstack_instrumentation_bucket_for_value(value)]++;
+    histogram->count++;
+    histogram->total_us += value;
+    if (value > histogram->max_us){
+        histogram->max_us = value;
+    }
+}
+
+static btstack_instrumentation_entry_t * btstack_instrumentation_get_or_create_entry(btstack_instrumentation_layer_t layer, hci_con_handle_t con_handle, uint16_t channel, uint64_t now_us){
+    int i;
+    for (i = 0; i < instrumentation_num_entries; i++){
+        btstack_instrumentation_entry_t * entry = &instrumentation_entries[i];
+        if (entry->layer != layer) continue;
+        if (entry->con_handle != con_handle) continue;
+        if (entry->channel != channel) continue;
+        return entry;
+    }
+    if (instrumentation_num_entries >= BTSTACK_INSTRUMENTATION_MAX_ENTRIES) return NULL;
+    btstack_instrumentation_entry_t * entry = &instrumentation_entries[instrumentation_num_entries];
+    memset(entry, 0, sizeof(btstack_instrumentation_entry_t));
+    entry->layer = layer;
+    entry->con_handle = con_handle;
+    entry->channel = channel;
+    entry->window_start_us = now_us;
+    // publish after entry is initialized
+    instrumentation_num_entries++;
+    return entry;
+}
+
+static void btstack_instrumentation_update_throughput(btstack_instrumentation_entry_t * entry, uint64_t now_us, uint16_t size){
+    uint64_t elapsed_us = now_us - entry->window_start_us;
+    if (elapsed_us >= 1000000){
+        entry->bytes_per_second = (uint32_t) (((uint64_t) entry->window_bytes * 1000000) / elapsed_us);
+        if (entry->bytes_per_second > entry->bytes_per_second_max){
+            entry->bytes_per_second_max = entry->bytes_per_second;
+        }
+        entry->window_start_us = now_us;
+        entry->window_bytes = 0;
+    }
+    entry->window_bytes += size;
+}
+
+void btstack_instrumentation_init(void){
+    btstack_instrumentation_reset();
+    instrumentation_depth = 0;
+    instrumentation_report_interval_ms = 0;
+}
+
+void btstack_instrumentation_reset(void){
+    instrumentation_num_entries = 0;
+    memset(instrumentation_entries, 0, sizeof(instrumentation_entries));
+    // entries of active handlers are gone
+    int i;
+    for (i = 0; i < BTSTACK_INSTRUMENTATION_MAX_DEPTH; i++){
+        instrumentation_stack[i].entry = NULL;
+    }
+}
+
+void btstack_instrumentation_enter(btstack_instrumentation_layer_t layer, hci_con_handle_t con_handle, uint16_t channel, uint16_t size){
+    uint64_t now_us = btstack_run_loop_get_time_us();
+    if (instrumentation_depth == 0){
+        instrumentation_received_us = now_us;
+    }
+    btstack_instrumentation_entry_t * entry = btstack_instrumentation_get_or_create_entry(layer, con_handle, channel, now_us);
+    if (entry){
+        entry->num_packets++;
+        entry->num_bytes += size;
+        btstack_instrumentation_update_throughput(entry, now_us, size);
+        if (instrumentation_depth > 0){
+            btstack_instrumentation_histogram_add(&entry->queueing_delay, now_us - instrumentation_received_us);
+        }
+    }
+    if (instrumentation_depth < BTSTACK_INSTRUMENTATION_MAX_DEPTH){
+        instrumentation_stack[instrumentation_depth].entry = entry;
+        instrumentation_stack[instrumentation_depth].start_us = now_us;
+    }
+    instrumentation_depth++;
+}
+
+void btstack_instrumentation_exit(void){
+    if (instrumentation_depth == 0) return;
+    instrumentation_depth--;
+    if (instrumentation_depth >= BTSTACK_INSTRUMENTATION_MAX_DEPTH) return;
+    btstack_instrumentation_frame_t * frame = &instrumentation_stack[instrumentation_depth];
+    if (!frame->entry) return;
+    btstack_instrumentation_histogram_add(&frame->entry->handler_time, btstack_run_loop_get_time_us() - frame->start_us);
+}
+
+int btstack_instrumentation_get_num_entries(void){
+    return instrumentation_num_entries;
+}
+
+int btstack_instrumentation_get_entry(int index, btstack_instrumentation_entry_t * entry){
+    if (index < 0) return 0;
+    if (index >= instrumentation_num_entries) return 0;
+    memcpy(entry, &instrumentation_entries[index], sizeof(btstack_instrumentation_entry_t));
+    return 1;
+}
+
+uint32_t btstack_instrumentation_histogram_get_percentile(const btstack_instrumentation_histogram_t * histogram, uint8_t percentile){
+    if (histogram->count == 0) return 0;
+    if (percentile > 100){
+        percentile = 100;
+    }
+    uint32_t target = (uint32_t) (((uint64_t) histogram->count * percentile + 99) / 100);
+    if (target == 0){
+        target = 1;
+    }
+    uint32_t count = 0;
+    int i;
+    for (i = 0; i < BTSTACK_INSTRUMENTATION_HISTOGRAM_BUCKETS - 1; i++){
+        count += histogram->buckets[i];
+        if (count >= target) break;
+    }
+    // last bucket also counts larger values
+    if (i == BTSTACK_INSTRUMENTATION_HISTOGRAM_BUCKETS - 1) return histogram->max_us;
+    uint32_t value = btstack_instrumentation_value_for_bucket(i);
+    if (value > histogram->max_us){
+        value = histogram->max_us;
+    }
+    return value;
+}
+
+void btstack_instrumentation_log_report(void){
+    int i;
+    for (i = 0; i < instrumentation_num_entries; i++){
+        btstack_instrumentation_entry_t * entry = &instrumentation_entries[i];
+        log_info("instrumentation %s handle 0x%04x channel 0x%04x: %u packets, %u bytes, %u B/s (max %u), delay p50 %u p99 %u max %u us, handler p50 %u p99 %u max %u us",
+            instrumentation_layer_names[entry->layer], entry->con_handle, entry->channel,
+            entry->num_packets, entry->num_bytes, entry->bytes_per_second, entry->bytes_per_second_max,
+            btstack_instrumentation_histogram_get_percentile(&entry->queueing_delay, 50),
+            btstack_instrumentation_histogram_get_percentile(&entry->queueing_delay, 99),
+            entry->queueing_delay.max_us,
+            btstack_instrumentation_histogram_get_percentile(&entry->handler_time, 50),
+            btstack_instrumentation_histogram_get_percentile(&entry->handler_time, 99),
+            entry->handler_time.max_us);
+    }
+}
+
+static void btstack_instrumentation_report_timer_handler(btstack_timer_source_t * ts){
+    btstack_instrumentation_log_report();
+    btstack_run_loop_set_timer(ts, instrumentation_report_interval_ms);
+    btstack_run_loop_add_timer(ts);
+}
+
+void btstack_instrumentation_set_report_interval(uint32_t interval_ms){
+    btstack_run_loop_remove_timer(&instrumentation_report_timer);
+    instrumentation_report_interval_ms = interval_ms;
+    if (interval_ms == 0) return;
+    btstack_run_loop_set_timer_handler(&instrumentation_report_timer, &btstack_instrumentation_report_timer_handler);
+    btstack_run_loop_set_timer(&instrumentation_report_timer, interval_ms);
+    btstack_run_loop_add_timer(&instrumentation_report_timer);
+}
@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2016 BlueKitchen GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 4. Any redistribution, use, or modification is done solely for
+ *    personal benefit and not for any commercial purpose or for
+ *    monetary gain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BLUEKITCHEN GMBH AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MATTHIAS
+ * RINGWALD OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Please inquire about commercial licensing options at 
+ * contact@bluekitchen-gmbh.com
+ *
+ */
+
+
+/*
+ *  btstack_instrumentation.h
+ *
+ *  Per-layer latency and throughput counters for received packets
+ *
+ *  Each layer reports a packet with BTSTACK_INSTRUMENTATION_ENTER before handling it and BTSTACK_INSTRUMENTATION_EXIT
+ *  afterwards. For each layer, connection and channel, the time since the packet was received from the transport
+ *  (queueing delay), the time spent in the handler incl. upper layers and the throughput are recorded.
+ *
+ *  Counters are only written from the BTstack thread and are read without locking. 
+ */
+
+#ifndef __BTSTACK_INSTRUMENTATION_H
+#define __BTSTACK_INSTRUMENTATION_H
+
+#include "btstack_config.h"
+#include "bluetooth.h"
+
+#include <stdint.h>
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+// max number of layer/connection/channel tuples, further tuples are not recorded
+#ifndef BTSTACK_INSTRUMENTATION_MAX_ENTRIES
+#define BTSTACK_INSTRUMENTATION_MAX_ENTRIES 16
+#endif
+
+// con_handle for packets not related to a connection, e.g. HCI events
+#define BTSTACK_INSTRUMENTATION_NO_CON_HANDLE 0xffff
+
+// histogram with 4 buckets per power of two, values in us up to ~2 s, larger values are counted in the last bucket
+#define BTSTACK_INSTRUMENTATION_HISTOGRAM_SUB_BUCKET_BITS 2
+#define BTSTACK_INSTRUMENTATION_HISTOGRAM_BUCKETS 80
+
+typedef enum {
+    BTSTACK_INSTRUMENTATION_LAYER_TRANSPORT = 0,
+    BTSTACK_INSTRUMENTATION_LAYER_HCI,
+    BTSTACK_INSTRUMENTATION_LAYER_L2CAP,
+    BTSTACK_INSTRUMENTATION_LAYER_ATT,
+    BTSTACK_INSTRUMENTATION_LAYER_RFCOMM,
+} btstack_instrumentation_layer_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t max_us;
+    uint64_t total_us;
+    uint32_t buckets[BTSTACK_INSTRUMENTATION_HISTOGRAM_BUCKETS];
+} btstack_instrumentation_histogram_t;
+
+typedef struct {
+    btstack_instrumentation_layer_t layer;
+    hci_con_handle_t con_handle;
+    // packet type for transport, L2CAP cid for L2CAP and ATT, RFCOMM cid for RFCOMM
+    uint16_t channel;
+
+    uint32_t num_packets;
+    uint32_t num_bytes;
+    // throughput over last completed one second window and max
+    uint32_t bytes_per_second;
+    uint32_t bytes_per_second_max;
+
+    // time from reception by transport until layer handler is called
+    btstack_instrumentation_histogram_t queueing_delay;
+    // time spent in layer handler
+    btstack_instrumentation_histogram_t handler_time;
+
+    // internal
+    uint64_t window_start_us;
+    uint32_t window_bytes;
+} btstack_instrumentation_entry_t;
+
+#ifdef ENABLE_INSTRUMENTATION
+#define BTSTACK_INSTRUMENTATION_ENTER(layer, con_handle, channel, size) btstack_instrumentation_enter(layer, con_handle, channel, size)
+#define BTSTACK_INSTRUMENTATION_EXIT()                                  btstack_instrumentation_exit()
+#else
+#define BTSTACK_INSTRUMENTATION_ENTER(layer, con_handle, channel, size)
+#define BTSTACK_INSTRUMENTATION_EXIT()
+#endif
+
+/* API_START */
+
+/**
+ * @brief Init instrumentation, reset all counters
+ */
+void btstack_instrumentation_init(void);
+
+/**
+ * @brief Reset all counters
+ */
+void btstack_instrumentation_reset(void);
+
+/**
+ * @brief Packet is passed to layer handler. Calls can be nested, outermost call marks reception by transport
+ * @param layer
+ * @param con_handle or BTSTACK_INSTRUMENTATION_NO_CON_HANDLE
+ * @param channel
+ * @param size of packet
+ */
+void btstack_instrumentation_enter(btstack_instrumentation_layer_t layer, hci_con_handle_t con_handle, uint16_t channel, uint16_t size);
+
+/**
+ * @brief Layer handler returned for most recent btstack_instrumentation_enter
+ */
+void btstack_instrumentation_exit(void);
+
+/**
+ * @brief Get number of recorded layer/connection/channel tuples
+ */
+int btstack_instrumentation_get_num_entries(void);
+
+/**
+ * @brief Copy counters of recorded tuple
+ * @param index < btstack_instrumentation_get_num_entries()
+ * @param entry
+ * @returns 1 if index valid
+ */
+int btstack_instrumentation_get_entry(int index, btstack_instrumentation_entry_t * entry);
+
+/**
+ * @brief Get value in us below which the given percentage of samples fall, resolution of histogram buckets
+ * @param histogram
+ * @param percentile 0..100
+ */
+uint32_t btstack_instrumentation_histogram_get_percentile(const btstack_instrumentation_histogram_t * histogram, uint8_t percentile);
+
+/**
+ * @brief Log summary of all entries via log_info
+ */
+void btstack_instrumentation_log_report(void);
+
+/**
+ * @brief Periodically log summary of all entries
+ * @param interval_ms or 0 to stop
+ */
+void btstack_instrumentation_set_report_interval(uint32_t interval_ms);
+
+/* API_END */
+
+#if defined __cplusplus
+}
+#endif
+
+#endif // __BTSTACK_INSTRUMENTATION_H
@@ -47,6 +47,7 @@
 
 #include "btstack_memory.h"
 #include "btstack_memory_pool.h"
+#include "btstack_debug.h"
 
 #include <stdlib.h>
 
@@ -90,6 +91,82 @@ void btstack_memory_hci_connection_free(hci_connection_t *hci_connection){
 #endif
 
 
+// MARK: hci_acl_buffer_t
+#if !defined(HAVE_MALLOC) && !defined(MAX_NR_HCI_ACL_BUFFERS)
+    #if defined(MAX_NO_HCI_ACL_BUFFERS)
+        #error "Deprecated MAX_NO_HCI_ACL_BUFFERS defined instead of MAX_NR_HCI_ACL_BUFFERS. Please update your btstack_config.h to use MAX_NR_HCI_ACL_BUFFERS"
+    #else
+        #define MAX_NR_HCI_ACL_BUFFERS 0
+    #endif
+#endif
+
+#ifdef MAX_NR_HCI_ACL_BUFFERS
+#if MAX_NR_HCI_ACL_BUFFERS > 0
+static hci_acl_buffer_t hci_acl_buffer_storage[MAX_NR_HCI_ACL_BUFFERS];
+static btstack_memory_pool_t hci_acl_buffer_pool;
+hci_acl_buffer_t * btstack_memory_hci_acl_buffer_get(void){
+    return (hci_acl_buffer_t *) btstack_memory_pool_get(&hci_acl_buffer_pool);
+}
+void btstack_memory_hci_acl_buffer_free(hci_acl_buffer_t *hci_acl_buffer){
+    btstack_memory_pool_free(&hci_acl_buffer_pool, hci_acl_buffer);
+}
+#else
+hci_acl_buffer_t * btstack_memory_hci_acl_buffer_get(void){
+    return NULL;
+}
+void btstack_memory_hci_acl_buffer_free(hci_acl_buffer_t *hci_acl_buffer){
+    // silence compiler warning about unused parameter in a portable way
+    (void) hci_acl_buffer;
+};
+#endif
+#elif defined(HAVE_MALLOC)
+hci_acl_buffer_t * btstack_memory_hci_acl_buffer_get(void){
+    return (hci_acl_buffer_t*) malloc(sizeof(hci_acl_buffer_t));
+}
+void btstack_memory_hci_acl_buffer_free(hci_acl_buffer_t *hci_acl_buffer){
+    free(hci_acl_buffer);
+}
+#endif
+
+
+// MARK: hci_acl_reassembly_buffer_t
+#if !defined(HAVE_MALLOC) && !defined(MAX_NR_HCI_ACL_REASSEMBLY_BUFFERS)
+    #if defined(MAX_NO_HCI_ACL_REASSEMBLY_BUFFERS)
+        #error "Deprecated MAX_NO_HCI_ACL_REASSEMBLY_BUFFERS defined instead of MAX_NR_HCI_ACL_REASSEMBLY_BUFFERS. Please update your btstack_config.h to use MAX_NR_HCI_ACL_REASSEMBLY_BUFFERS"
+    #else
+        #define MAX_NR_HCI_ACL_REASSEMBLY_BUFFERS 0
+    #endif
+#endif
+
+#ifdef MAX_NR_HCI_ACL_REASSEMBLY_BUFFERS
+#if MAX_NR_HCI_ACL_REASSEMBLY_BUFFERS > 0
+static hci_acl_reassembly_buffer_t hci_acl_reassembly_buffer_storage[MAX_NR_HCI_ACL_REASSEMBLY_BUFFERS];
+static btstack_memory_pool_t hci_acl_reassembly_buffer_pool;
+hci_acl_reassembly_buffer_t * btstack_memory_hci_acl_reassembly_buffer_get(void){
+    return (hci_acl_reassembly_buffer_t *) btstack_memory_pool_get(&hci_acl_reassembly_buffer_pool);
+}
+void btstack_memory_hci_acl_reassembly_buffer_free(hci_acl_reassembly_buffer_t *hci_acl_reassembly_buffer){
+    btstack_memory_pool_free(&hci_acl_reassembly_buffer_pool, hci_acl_reassembly_buffer);
+}
+#else
+hci_acl_reassembly_buffer_t * btstack_memory_hci_acl_reassembly_buffer_get(void){
+    return NULL;
+}
+void btstack_memory_hci_acl_reassembly_buffer_free(hci_acl_reassembly_buffer_t *hci_acl_reassembly_buffer){
+    // silence compiler warning about unused parameter in a portable way
+    (void) hci_acl_reassembly_buffer;
+};
+#endif
+#elif defined(HAVE_MALLOC)
+hci_acl_reassembly_buffer_t * btstack_memory_hci_acl_reassembly_buffer_get(void){
+    return (hci_acl_reassembly_buffer_t*) malloc(sizeof(hci_acl_reassembly_buffer_t));
+}
+void btstack_memory_hci_acl_reassembly_buffer_free(hci_acl_reassembly_buffer_t *hci_acl_reassembly_buffer){
+    free(hci_acl_reassembly_buffer);
+}
+#endif
+
+
 
 // MARK: l2cap_service_t
 #if !defined(HAVE_MALLOC) && !defined(MAX_NR_L2CAP_SERVICES)
@@ -516,6 +593,44 @@ void btstack_memory_gatt_client_free(gatt_client_t *gatt_client){
 #endif
 
 
+// MARK: gatt_client_cache_t
+#if !defined(HAVE_MALLOC) && !defined(MAX_NR_GATT_CLIENT_CACHES)
+    #if defined(MAX_NO_GATT_CLIENT_CACHES)
+        #error "Deprecated MAX_NO_GATT_CLIENT_CACHES defined instead of MAX_NR_GATT_CLIENT_CACHES. Please update your btstack_config.h to use MAX_NR_GATT_CLIENT_CACHES"
+    #else
+        #define MAX_NR_GATT_CLIENT_CACHES 0
+    #endif
+#endif
+
+#ifdef MAX_NR_GATT_CLIENT_CACHES
+#if MAX_NR_GATT_CLIENT_CACHES > 0
+static gatt_client_cache_t gatt_client_cache_storage[MAX_NR_GATT_CLIENT_CACHES];
+static btstack_memory_pool_t gatt_client_cache_pool;
+gatt_client_cache_t * btstack_memory_gatt_client_cache_get(void){
+    return (gatt_client_cache_t *) btstack_memory_pool_get(&gatt_client_cache_pool);
+}
+void btstack_memory_gatt_client_cache_free(gatt_client_cache_t *gatt_client_cache){
+    btstack_memory_pool_free(&gatt_client_cache_pool, gatt_client_cache);
+}
+#else
+gatt_client_cache_t * btstack_memory_gatt_client_cache_get(void){
+    return NULL;
+}
+void btstack_memory_gatt_client_cache_free(gatt_client_cache_t *gatt_client_cache){
+    // silence compiler warning about unused parameter in a portable way
+    (void) gatt_client_cache;
+};
+#endif
+#elif defined(HAVE_MALLOC)
+gatt_client_cache_t * btstack_memory_gatt_client_cache_get(void){
+    return (gatt_client_cache_t*) malloc(sizeof(gatt_client_cache_t));
+}
+void btstack_memory_gatt_client_cache_free(gatt_client_cache_t *gatt_client_cache){
+    free(gatt_client_cache);
+}
+#endif
+
+
 // MARK: whitelist_entry_t
 #if !defined(HAVE_MALLOC) && !defined(MAX_NR_WHITELIST_ENTRIES)
     #if defined(MAX_NO_WHITELIST_ENTRIES)
@@ -598,6 +713,12 @@ void btstack_memory_init(void){
 #if MAX_NR_HCI_CONNECTIONS > 0
     btstack_memory_pool_create(&hci_connection_pool, hci_connection_storage, MAX_NR_HCI_CONNECTIONS, sizeof(hci_connection_t));
 #endif
+#if MAX_NR_HCI_ACL_BUFFERS > 0
+    btstack_memory_pool_create(&hci_acl_buffer_pool, hci_acl_buffer_storage, MAX_NR_HCI_ACL_BUFFERS, sizeof(hci_acl_buffer_t));
+#endif
+#if MAX_NR_HCI_ACL_REASSEMBLY_BUFFERS > 0
+    btstack_memory_pool_create(&hci_acl_reassembly_buffer_pool, hci_acl_reassembly_buffer_storage, MAX_NR_HCI_ACL_REASSEMBLY_BUFFERS, sizeof(hci_acl_reassembly_buffer_t));
+#endif
 #if MAX_NR_L2CAP_SERVICES > 0
     btstack_memory_pool_create(&l2cap_service_pool, l2cap_service_storage, MAX_NR_L2CAP_SERVICES, sizeof(l2cap_service_t));
 #endif
@@ -632,6 +753,9 @@ void btstack_memory_init(void){
 #if MAX_NR_GATT_CLIENTS > 0
     btstack_memory_pool_create(&gatt_client_pool, gatt_client_storage, MAX_NR_GATT_CLIENTS, sizeof(gatt_client_t));
 #endif
+#if MAX_NR_GATT_CLIENT_CACHES > 0
+    btstack_memory_pool_create(&gatt_client_cache_pool, gatt_client_cache_storage, MAX_NR_GATT_CLIENT_CACHES, sizeof(gatt_client_cache_t));
+#endif
 #if MAX_NR_WHITELIST_ENTRIES > 0
     btstack_memory_pool_create(&whitelist_entry_pool, whitelist_entry_storage, MAX_NR_WHITELIST_ENTRIES, sizeof(whitelist_entry_t));
 #endif
@@ -640,3 +764,80 @@ void btstack_memory_init(void){
 #endif
 #endif
 }
+
+// statistics
+void btstack_memory_log_statistics(void){
+    btstack_memory_pool_statistics_t statistics;
+    // silence compiler warning if no pools are configured
+    (void) statistics;
+#if MAX_NR_HCI_CONNECTIONS > 0
+    btstack_memory_pool_get_statistics(&hci_connection_pool, &statistics);
+    log_info("hci_connection: used %u, max %u of %u, failed gets %u", statistics.blocks_used, statistics.blocks_used_max, statistics.blocks_total, statistics.failed_gets);
+#endif
+#if MAX_NR_HCI_ACL_BUFFERS > 0
+    btstack_memory_pool_get_statistics(&hci_acl_buffer_pool, &statistics);
+    log_info("hci_acl_buffer: used %u, max %u of %u, failed gets %u", statistics.blocks_used, statistics.blocks_used_max, statistics.blocks_total, statistics.failed_gets);
+#endif
+#if MAX_NR_HCI_ACL_REASSEMBLY_BUFFERS > 0
+    btstack_memory_pool_get_statistics(&hci_acl_reassembly_buffer_pool, &statistics);
+    log_info("hci_acl_reassembly_buffer: used %u, max %u of %u, failed gets %u", statistics.blocks_used, statistics.blocks_used_max, statistics.blocks_total, statistics.failed_gets);
+#endif
+#if MAX_NR_L2CAP_SERVICES > 0
+    btstack_memory_pool_get_statistics(&l2cap_service_pool, &statistics);
+    log_info("l2cap_service: used %u, max %u of %u, failed gets %u", statistics.blocks_used, statistics.blocks_used_max, statistics.blocks_total, statistics.failed_gets);
+#endif
+#if MAX_NR_L2CAP_CHANNELS > 0
+    btstack_memory_pool_get_statistics(&l2cap_channel_pool, &statistics);
+    log_info("l2cap_channel: used %u, max %u of %u, failed gets %u", statistics.blocks_used, statistics.blocks_used_max, statistics.blocks_total, statistics.failed_gets);
+#endif
+#if MAX_NR_RFCOMM_MULTIPLEXERS > 0
+    btstack_memory_pool_get_statistics(&rfcomm_multiplexer_pool, &statistics);
+    log_info("rfcomm_multiplexer: used %u, max %u of %u, failed gets %u", statistics.blocks_used, statistics.blocks_used_max, statistics.blocks_total, statistics.failed_gets);
+#endif
+#if MAX_NR_RFCOMM_SERVICES > 0
+    btstack_memory_pool_get_statistics(&rfcomm_service_pool, &statistics);
+    log_info("rfcomm_service: used %u, max %u of %u, failed gets %u", statistics.blocks_used, statistics.blocks_used_max, statistics.blocks_total, statistics.failed_gets);
+#endif
+#if MAX_NR_RFCOMM_CHANNELS > 0
+    btstack_memory_pool_get_statistics(&rfcomm_channel_pool, &statistics);
+    log_info("rfcomm_channel: used %u, max %u of %u, failed gets %u", statistics.blocks_used, statistics.blocks_used_max, statistics.blocks_total, statistics.failed_gets);
+#endif
+#if MAX_NR_BTSTACK_LINK_KEY_DB_MEMORY_ENTRIES > 0
+    btstack_memory_pool_get_statistics(&btstack_link_key_db_memory_entry_pool, &statistics);
+    log_info("btstack_link_key_db_memory_entry: used %u, max %u of %u, failed gets %u", statistics.blocks_used, statistics.blocks_used_max, statistics.blocks_total, statistics.failed_gets);
+#endif
+#if MAX_NR_BNEP_SERVICES > 0
+    btstack_memory_pool_get_statistics(&bnep_service_pool, &statistics);
+    log_info("bnep_service: used %u, max %u of %u, failed gets %u", statistics.blocks_used, statistics.blocks_used_max, statistics.blocks_total, statistics.failed_gets);
+#endif
+#if MAX_NR_BNEP_CHANNELS > 0
+    btstack_memory_pool_get_statistics(&bnep_channel_pool, &statistics);
+    log_info("bnep_channel: used %u, max %u of %u, failed gets %u", statistics.blocks_used, statistics.blocks_used_max, statistics.blocks_total, statistics.failed_gets);
+#endif
+#if MAX_NR_HFP_CONNECTIONS > 0
+    btstack_memory_pool_get_statistics(&hfp_connection_pool, &statistics);
+    log_info("hfp_connection: used %u, max %u of %u, failed gets %u", statistics.blocks_used, statistics.blocks_used_max, statistics.blocks_total, statistics.failed_gets);
+#endif
+#if MAX_NR_SERVICE_RECORD_ITEMS > 0
+    btstack_memory_pool_get_statistics(&service_record_item_pool, &statistics);
+    log_info("service_record_item: used %u, max %u of %u, failed gets %u", statistics.blocks_used, statistics.blocks_used_max, statistics.blocks_total, statistics.failed_gets);
+#endif
+#ifdef ENABLE_BLE
+#if MAX_NR_GATT_CLIENTS > 0
+    btstack_memory_pool_get_statistics(&gatt_client_pool, &statistics);
+    log_info("gatt_client: used %u, max %u of %u, failed gets %u", statistics.blocks_used, statistics.blocks_used_max, statistics.blocks_total, statistics.failed_gets);
+#endif
+#if MAX_NR_GATT_CLIENT_CACHES > 0
+    btstack_memory_pool_get_statistics(&gatt_client_cache_pool, &statistics);
+    log_info("gatt_client_cache: used %u, max %u of %u, failed gets %u", statistics.blocks_used, statistics.blocks_used_max, statistics.blocks_total, statistics.failed_gets);
+#endif
+#if MAX_NR_WHITELIST_ENTRIES > 0
+    btstack_memory_pool_get_statistics(&whitelist_entry_pool, &statistics);
+    log_info("whitelist_entry: used %u, max %u of %u, failed gets %u", statistics.blocks_used, statistics.blocks_used_max, statistics.blocks_total, statistics.failed_gets);
+#endif
+#if MAX_NR_SM_LOOKUP_ENTRIES > 0
+    btstack_memory_pool_get_statistics(&sm_lookup_entry_pool, &statistics);
+    log_info("sm_lookup_entry: used %u, max %u of %u, failed gets %u", statistics.blocks_used, statistics.blocks_used_max, statistics.blocks_total, statistics.failed_gets);
+#endif
+#endif
+}
@@ -78,11 +78,20 @@ extern "C" {
  */
 void btstack_memory_init(void);
 
+/**
+ * @brief Log usage statistics of all memory pools (current use, high-water mark, failed gets) to size MAX_NR_* values.
+ */
+void btstack_memory_log_statistics(void);
+
 /* API_END */
 
-// hci_connection
+// hci_connection, hci_acl_buffer, hci_acl_reassembly_buffer
 hci_connection_t * btstack_memory_hci_connection_get(void);
 void   btstack_memory_hci_connection_free(hci_connection_t *hci_connection);
+hci_acl_buffer_t * btstack_memory_hci_acl_buffer_get(void);
+void   btstack_memory_hci_acl_buffer_free(hci_acl_buffer_t *hci_acl_buffer);
+hci_acl_reassembly_buffer_t * btstack_memory_hci_acl_reassembly_buffer_get(void);
+void   btstack_memory_hci_acl_reassembly_buffer_free(hci_acl_reassembly_buffer_t *hci_acl_reassembly_buffer);
 
 // l2cap_service, l2cap_channel
 l2cap_service_t * btstack_memory_l2cap_service_get(void);
@@ -117,9 +126,11 @@ service_record_item_t * btstack_memory_service_record_item_get(void);
 void   btstack_memory_service_record_item_free(service_record_item_t *service_record_item);
 
 #ifdef ENABLE_BLE
-// gatt_client, whitelist_entry, sm_lookup_entry
+// gatt_client, gatt_client_cache, whitelist_entry, sm_lookup_entry
 gatt_client_t * btstack_memory_gatt_client_get(void);
 void   btstack_memory_gatt_client_free(gatt_client_t *gatt_client);
+gatt_client_cache_t * btstack_memory_gatt_client_cache_get(void);
+void   btstack_memory_gatt_client_cache_free(gatt_client_cache_t *gatt_client_cache);
 whitelist_entry_t * btstack_memory_whitelist_entry_get(void);
 void   btstack_memory_whitelist_entry_free(whitelist_entry_t *whitelist_entry);
 sm_lookup_entry_t * btstack_memory_sm_lookup_entry_get(void);
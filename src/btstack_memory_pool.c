@@ -40,26 +40,55 @@
  *
  *  Fixed-size block allocation
  *
- *  Free blocks are kept in singly linked list
+ *  Free blocks are kept in singly linked list. Free blocks are tagged with a
+ *  pool specific value in the second word, which allows to detect a double free
+ *  without walking the list of free blocks. As an allocated block might contain
+ *  the tag by chance, the list is only checked if the tag matches.
  *
  */
 
 #include "btstack_memory_pool.h"
 
 #include <stddef.h>
+#include <stdint.h>
 #include "btstack_debug.h"
 
 typedef struct node {
     struct node * next;
+    uintptr_t     tag;
 } node_t;
 
+#define FREE_BLOCK_TAG 0x5a5aa5a5u
+
+static uintptr_t btstack_memory_pool_tag(btstack_memory_pool_t *pool){
+    return ((uintptr_t) pool) ^ FREE_BLOCK_TAG;
+}
+
+static int btstack_memory_pool_tag_supported(btstack_memory_pool_t *pool){
+    return pool->block_size >= (int) sizeof(node_t);
+}
+
+static int btstack_memory_pool_in_free_list(btstack_memory_pool_t *pool, node_t * node){
+    node_t * it;
+    for (it = (node_t *) pool->free_list; it ; it = it->next){
+        if (it == node) return 1;
+    }
+    return 0;
+}
+
 void btstack_memory_pool_create(btstack_memory_pool_t *pool, void * storage, int count, int block_size){
-    node_t *free_blocks = (node_t*) pool;
     char   *mem_ptr = (char *) storage;
     int i;
-    
+
+    pool->free_list       = NULL;
+    pool->storage         = (char *) storage;
+    pool->count           = count;
+    pool->block_size      = block_size;
+    pool->blocks_used     = count;
+    pool->blocks_used_max = 0;
+    pool->failed_gets     = 0;
+
     // create singly linked list of all available blocks
-    free_blocks->next = NULL;
     for (i = 0 ; i < count ; i++){
         btstack_memory_pool_free(pool, mem_ptr);
         mem_ptr += block_size;
@@ -67,31 +96,58 @@ void btstack_memory_pool_create(btstack_memory_pool_t *pool, void * storage, int
 }
 
 void * btstack_memory_pool_get(btstack_memory_pool_t *pool){
-    node_t *free_blocks = (node_t*) pool;
-    
-    if (!free_blocks->next) return NULL;
-    
+    node_t *node = (node_t *) pool->free_list;
+
+    if (!node) {
+        pool->failed_gets++;
+        return NULL;
+    }
+
     // remove first
-    node_t *node      = free_blocks->next;
-    free_blocks->next = node->next;
-    
+    pool->free_list = node->next;
+    if (btstack_memory_pool_tag_supported(pool)){
+        node->tag = 0;
+    }
+
+    pool->blocks_used++;
+    if (pool->blocks_used > pool->blocks_used_max){
+        pool->blocks_used_max = pool->blocks_used;
+    }
     return (void*) node;
 }
 
 void btstack_memory_pool_free(btstack_memory_pool_t *pool, void * block){
-    node_t *free_blocks = (node_t*) pool;
-    node_t *node        = (node_t*) block;
+    node_t *node = (node_t*) block;
+
+    // raise error and abort if block doesn't belong to pool
+    char * mem_ptr = (char *) block;
+    if (mem_ptr < pool->storage || mem_ptr >= pool->storage + (pool->count * pool->block_size)
+    || ((mem_ptr - pool->storage) % pool->block_size) != 0){
+        log_error("btstack_memory_pool_free: block %p not part of pool %p", block, pool);
+        return;
+    }
 
     // raise error and abort if node already in list
-    node_t * it;
-    for (it = free_blocks->next; it ; it = it->next){
-        if (it == node) {
+    if (btstack_memory_pool_tag_supported(pool)){
+        if (node->tag == btstack_memory_pool_tag(pool) && btstack_memory_pool_in_free_list(pool, node)){
             log_error("btstack_memory_pool_free: block %p freed twice for pool %p", block, pool);
             return;
         }
+        node->tag = btstack_memory_pool_tag(pool);
+    } else if (btstack_memory_pool_in_free_list(pool, node)){
+        log_error("btstack_memory_pool_free: block %p freed twice for pool %p", block, pool);
+        return;
     }
 
     // add block as node to list
-    node->next          = free_blocks->next;
-    free_blocks->next   = node;
+    node->next      = (node_t *) pool->free_list;
+    pool->free_list = node;
+    pool->blocks_used--;
+}
+
+void btstack_memory_pool_get_statistics(btstack_memory_pool_t *pool, btstack_memory_pool_statistics_t * statistics){
+    statistics->blocks_total    = pool->count;
+    statistics->blocks_used     = pool->blocks_used;
+    statistics->blocks_used_max = pool->blocks_used_max;
+    statistics->failed_gets     = pool->failed_gets;
 }
@@ -43,7 +43,7 @@
  *  @Assumption block_size >= sizeof(void *)
  *  @Assumption size of storage >= count * block_size
  *
- *  @Note minimal implementation, no error checking/handling
+ *  @Note double free and free of foreign blocks are detected in O(1) and logged
  */
 
 #ifndef __btstack_memory_pool_H
@@ -53,7 +53,27 @@
 extern "C" {
 #endif
 
-typedef void * btstack_memory_pool_t;
+typedef struct {
+    // singly linked list of free blocks
+    void * free_list;
+    // storage for range check
+    char * storage;
+    int    count;
+    int    block_size;
+    // statistics
+    int    blocks_used;
+    int    blocks_used_max;
+    int    failed_gets;
+} btstack_memory_pool_t;
+
+typedef struct {
+    int blocks_total;
+    int blocks_used;
+    // high-water mark
+    int blocks_used_max;
+    // number of get calls that returned NULL
+    int failed_gets;
+} btstack_memory_pool_statistics_t;
 
 // initialize memory pool with with given storage, block size and count
 void   btstack_memory_pool_create(btstack_memory_pool_t *pool, void * storage, int count, int block_size);
@@ -64,6 +84,9 @@ void * btstack_memory_pool_get(btstack_memory_pool_t *pool);
 // return previously reserved block to memory pool
 void   btstack_memory_pool_free(btstack_memory_pool_t *pool, void * block);
 
+// get usage statistics of memory pool
+void   btstack_memory_pool_get_statistics(btstack_memory_pool_t *pool, btstack_memory_pool_statistics_t * statistics);
+
 #if defined __cplusplus
 }
 #endif
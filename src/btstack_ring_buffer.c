@@ -42,31 +42,53 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "btstack_ring_buffer.h"
 
 #define ERROR_CODE_MEMORY_CAPACITY_EXCEEDED 0x07
 
+static inline uint32_t btstack_ring_buffer_advance(btstack_ring_buffer_t * ring_buffer, uint32_t position, uint32_t length){
+    position += length;
+    if (ring_buffer->position_mask) return position & ring_buffer->position_mask;
+    if (position >= 2 * ring_buffer->size){
+        position -= 2 * ring_buffer->size;
+    }
+    return position;
+}
+
+static inline uint32_t btstack_ring_buffer_index(btstack_ring_buffer_t * ring_buffer, uint32_t position){
+    if (ring_buffer->position_mask) return position & (ring_buffer->size - 1);
+    if (position >= ring_buffer->size){
+        position -= ring_buffer->size;
+    }
+    return position;
+}
 
 // init ring buffer
 void btstack_ring_buffer_init(btstack_ring_buffer_t * ring_buffer, uint8_t * storage, uint32_t storage_size){
     ring_buffer->storage = storage;
     ring_buffer->size = storage_size;
-    ring_buffer->last_read_index = 0;
-    ring_buffer->last_written_index = 0;   
-    ring_buffer->full = 0;
+    ring_buffer->read_position = 0;
+    ring_buffer->write_position = 0;
+    ring_buffer->position_mask = 0;
+    if (storage_size && (storage_size & (storage_size - 1)) == 0){
+        ring_buffer->position_mask = 2 * storage_size - 1;
+    }
 }
 
 int btstack_ring_buffer_bytes_available(btstack_ring_buffer_t * ring_buffer){
-    if (ring_buffer->full) return ring_buffer->size;
-    int diff = ring_buffer->last_written_index - ring_buffer->last_read_index;
-    if (diff >= 0) return diff;
-    return diff + ring_buffer->size;
+    uint32_t diff = ring_buffer->write_position - ring_buffer->read_position;
+    if (ring_buffer->position_mask) return diff & ring_buffer->position_mask;
+    if (ring_buffer->write_position < ring_buffer->read_position){
+        diff += 2 * ring_buffer->size;
+    }
+    return diff;
 }
 
 // test if ring buffer is empty
 int btstack_ring_buffer_empty(btstack_ring_buffer_t * ring_buffer){
-    return btstack_ring_buffer_bytes_available(ring_buffer) == 0;
+    return ring_buffer->read_position == ring_buffer->write_position;
 }
 
 // 
@@ -74,42 +96,62 @@ int btstack_ring_buffer_bytes_free(btstack_ring_buffer_t * ring_buffer){
     return ring_buffer->size - btstack_ring_buffer_bytes_available(ring_buffer);
 }
 
+uint32_t btstack_ring_buffer_peek_read(btstack_ring_buffer_t * ring_buffer, uint8_t ** data){
+    uint32_t index = btstack_ring_buffer_index(ring_buffer, ring_buffer->read_position);
+    uint32_t available = btstack_ring_buffer_bytes_available(ring_buffer);
+    uint32_t contiguous = ring_buffer->size - index;
+    *data = &ring_buffer->storage[index];
+    return available < contiguous ? available : contiguous;
+}
+
+void btstack_ring_buffer_commit_read(btstack_ring_buffer_t * ring_buffer, uint32_t length){
+    ring_buffer->read_position = btstack_ring_buffer_advance(ring_buffer, ring_buffer->read_position, length);
+}
+
+uint32_t btstack_ring_buffer_peek_write(btstack_ring_buffer_t * ring_buffer, uint8_t ** data){
+    uint32_t index = btstack_ring_buffer_index(ring_buffer, ring_buffer->write_position);
+    uint32_t free_space = btstack_ring_buffer_bytes_free(ring_buffer);
+    uint32_t contiguous = ring_buffer->size - index;
+    *data = &ring_buffer->storage[index];
+    return free_space < contiguous ? free_space : contiguous;
+}
+
+void btstack_ring_buffer_commit_write(btstack_ring_buffer_t * ring_buffer, uint32_t length){
+    ring_buffer->write_position = btstack_ring_buffer_advance(ring_buffer, ring_buffer->write_position, length);
+}
+
 // add byte block to ring buffer, 
 int btstack_ring_buffer_write(btstack_ring_buffer_t * ring_buffer, uint8_t * data, uint32_t data_length){
-    if (btstack_ring_buffer_bytes_free(ring_buffer) < data_length){
+    if ((uint32_t) btstack_ring_buffer_bytes_free(ring_buffer) < data_length){
         return ERROR_CODE_MEMORY_CAPACITY_EXCEEDED;
     }
-    int count = 0;
-    while (count < data_length){
-        if (ring_buffer->last_written_index < ring_buffer->size - 1){
-            ring_buffer->last_written_index++;
-        } else {
-            ring_buffer->last_written_index = 0;
-        }
-        ring_buffer->storage[ring_buffer->last_written_index] = data[count++];
-    }
-    if (ring_buffer->last_written_index == ring_buffer->last_read_index){
-        ring_buffer->full = 1;
+    // copy in at most two segments
+    uint8_t * span;
+    uint32_t span_length = btstack_ring_buffer_peek_write(ring_buffer, &span);
+    if (span_length > data_length){
+        span_length = data_length;
     }
+    memcpy(span, data, span_length);
+    memcpy(ring_buffer->storage, &data[span_length], data_length - span_length);
+    btstack_ring_buffer_commit_write(ring_buffer, data_length);
     return 0;
 } 
 
 // fetch data_length bytes from ring buffer
 void btstack_ring_buffer_read(btstack_ring_buffer_t * ring_buffer, uint8_t * data, uint32_t data_length, uint32_t * number_of_bytes_read){
-    uint32_t count = 0;
-    while (count < data_length && btstack_ring_buffer_bytes_available(ring_buffer)){
-        if (ring_buffer->last_read_index < ring_buffer->last_written_index ) {
-            ring_buffer->last_read_index++;
-        } else {
-            if (ring_buffer->last_read_index < ring_buffer->size - 1){
-                ring_buffer->last_read_index++;
-            } else {
-                ring_buffer->last_read_index = 0;
-            }
-        }
-        ring_buffer->full = 0;
-        data[count++] = ring_buffer->storage[ring_buffer->last_read_index];
+    uint32_t available = btstack_ring_buffer_bytes_available(ring_buffer);
+    if (data_length > available){
+        data_length = available;
+    }
+    // copy in at most two segments
+    uint8_t * span;
+    uint32_t span_length = btstack_ring_buffer_peek_read(ring_buffer, &span);
+    if (span_length > data_length){
+        span_length = data_length;
     }
-    *number_of_bytes_read = count;
+    memcpy(data, span, span_length);
+    memcpy(&data[span_length], ring_buffer->storage, data_length - span_length);
+    btstack_ring_buffer_commit_read(ring_buffer, data_length);
+    *number_of_bytes_read = data_length;
 } 
 
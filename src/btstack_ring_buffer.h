@@ -51,9 +51,11 @@ extern "C" {
 typedef struct btstack_ring_buffer {
     uint8_t  * storage;
     uint32_t size;    
-    uint32_t last_read_index;
-    uint32_t last_written_index;
-    uint8_t  full;
+    // read and write positions in range [0, 2 * size) to distinguish full from empty
+    uint32_t read_position;
+    uint32_t write_position;
+    // 2 * size - 1 if size is a power of two, 0 otherwise
+    uint32_t position_mask;
 } btstack_ring_buffer_t;
 
 /**
@@ -61,6 +63,7 @@ typedef struct btstack_ring_buffer {
  * @param ring_buffer object
  * @param storage
  * @param storage_size in bytes
+ * @note If storage_size is a power of two, positions are wrapped by masking instead of compare and subtract
  */
 void btstack_ring_buffer_init(btstack_ring_buffer_t * ring_buffer, uint8_t * storage, uint32_t storage_size);
 
@@ -103,6 +106,36 @@ int btstack_ring_buffer_write(btstack_ring_buffer_t * ring_buffer, uint8_t * dat
  */
 void btstack_ring_buffer_read(btstack_ring_buffer_t * ring_buffer, uint8_t * buffer, uint32_t length, uint32_t * number_of_bytes_read); 
 
+/**
+ * Get contiguous span of data available for read without copying it
+ * @param ring_buffer object
+ * @param data pointer to first byte
+ * @return number of bytes in span, might be less than bytes available if data wraps around
+ */
+uint32_t btstack_ring_buffer_peek_read(btstack_ring_buffer_t * ring_buffer, uint8_t ** data);
+
+/**
+ * Mark data returned by btstack_ring_buffer_peek_read as read
+ * @param ring_buffer object
+ * @param length has to be <= length of last span
+ */
+void btstack_ring_buffer_commit_read(btstack_ring_buffer_t * ring_buffer, uint32_t length);
+
+/**
+ * Get contiguous span of free space to write into directly
+ * @param ring_buffer object
+ * @param data pointer to first free byte
+ * @return number of bytes in span, might be less than bytes free if space wraps around
+ */
+uint32_t btstack_ring_buffer_peek_write(btstack_ring_buffer_t * ring_buffer, uint8_t ** data);
+
+/**
+ * Mark data written into span returned by btstack_ring_buffer_peek_write as available for read
+ * @param ring_buffer object
+ * @param length has to be <= length of last span
+ */
+void btstack_ring_buffer_commit_write(btstack_ring_buffer_t * ring_buffer, uint32_t length);
+
 #if defined __cplusplus
 }
 #endif
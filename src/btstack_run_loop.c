@@ -42,6 +42,7 @@
  */
 
 #include "btstack_run_loop.h"
+#include "bluetooth.h"
 
 #include <stdio.h>
 #include <stdlib.h>  // exit()
@@ -165,6 +166,29 @@ uint32_t btstack_run_loop_get_time_ms(void){
     return the_run_loop->get_time_ms();
 }
 
+/**
+ * @brief Get current time in us
+ */
+uint64_t btstack_run_loop_get_time_us(void){
+    btstack_run_loop_assert();
+    if (the_run_loop->get_time_us){
+        return the_run_loop->get_time_us();
+    }
+    return ((uint64_t) the_run_loop->get_time_ms()) * 1000;
+}
+
+/**
+ * @brief Execute callback on main thread
+ */
+int btstack_run_loop_execute_on_main_thread(void (*callback)(void * context), void * context){
+    btstack_run_loop_assert();
+    if (!the_run_loop->execute_on_main_thread){
+        log_error("btstack_run_loop_execute_on_main_thread not supported by run loop");
+        return ERROR_CODE_COMMAND_DISALLOWED;
+    }
+    return the_run_loop->execute_on_main_thread(callback, context);
+}
+
 
 void btstack_run_loop_timer_dump(void){
     btstack_run_loop_assert();
@@ -77,6 +77,8 @@ typedef struct btstack_data_source {
 
 typedef struct btstack_timer_source {
     btstack_linked_item_t item; 
+    // link to previous next pointer for O(1) removal, NULL if not in timer wheel
+    btstack_linked_item_t ** pprev;
     // timeout in system ticks (HAVE_EMBEDDED_TICK) or milliseconds (HAVE_EMBEDDED_TIME_MS)
     uint32_t timeout;
     // will be called when timer fired
@@ -96,6 +98,8 @@ typedef struct btstack_run_loop {
 	void (*execute)(void);
 	void (*dump_timer)(void);
 	uint32_t (*get_time_ms)(void);
+	uint64_t (*get_time_us)(void);
+	int  (*execute_on_main_thread)(void (*callback)(void * context), void * context);
 } btstack_run_loop_t;
 
 void btstack_run_loop_timer_dump(void);
@@ -145,6 +149,23 @@ int  btstack_run_loop_remove_timer(btstack_timer_source_t * timer);
  */
 uint32_t btstack_run_loop_get_time_ms(void);
 
+/**
+ * @brief Get current time in us
+ * @note 64-bit us counter based on a monotonic clock where available. 
+ * @note Falls back to ms resolution and 32-bit ms range if not provided by the run loop
+ */
+uint64_t btstack_run_loop_get_time_us(void);
+
+/**
+ * @brief Execute callback with context on the thread that runs the run loop. 
+ * @note Can be called from any thread (or interrupt handler for the embedded run loop). Callbacks are executed in FIFO order.
+ * @note Multiple requests before the run loop wakes up are handled with a single wakeup.
+ * @param callback
+ * @param context
+ * @return 0 if ok, ERROR_CODE_MEMORY_CAPACITY_EXCEEDED if queue is full, ERROR_CODE_COMMAND_DISALLOWED if not supported by run loop
+ */
+int btstack_run_loop_execute_on_main_thread(void (*callback)(void * context), void * context);
+
 /**
  * @brief Set data source callback.
  */
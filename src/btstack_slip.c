@@ -43,6 +43,8 @@
 #include "btstack_slip.h"
 #include "btstack_debug.h"
 
+#include <string.h>
+
 typedef enum {
 	SLIP_ENCODER_DEFAULT,
 	SLIP_ENCODER_SEND_DC,
@@ -216,6 +218,68 @@ void btstack_slip_decoder_process(uint8_t input){
     }
 }
 
+// find next SOF or escape byte, checks 4 bytes at once using the "has zero byte" trick
+static const uint8_t * btstack_slip_decoder_find_special_byte(const uint8_t * pos, const uint8_t * end){
+    while ((end - pos) >= 4){
+        uint32_t word;
+        memcpy(&word, pos, 4);
+        uint32_t sof = word ^ 0xc0c0c0c0u;
+        uint32_t esc = word ^ 0xdbdbdbdbu;
+        if ((((sof - 0x01010101u) & ~sof) | ((esc - 0x01010101u) & ~esc)) & 0x80808080u) break;
+        pos += 4;
+    }
+    while ((pos < end) && (*pos != BTSTACK_SLIP_SOF) && (*pos != 0xdb)){
+        pos++;
+    }
+    return pos;
+}
+
+/**
+ * @brief Process block of received bytes. Stops after a complete frame
+ * @param data
+ * @param len
+ * @return number of bytes processed
+ */
+uint16_t btstack_slip_decoder_process_block(const uint8_t * data, uint16_t len){
+    const uint8_t * pos = data;
+    const uint8_t * end = data + len;
+    while ((pos < end) && (decoder_state != SLIP_DECODER_COMPLETE)){
+        switch (decoder_state){
+            case SLIP_DECODER_UNKNOWN: {
+                // skip everything until next SOF
+                const uint8_t * sof = (const uint8_t *) memchr(pos, BTSTACK_SLIP_SOF, end - pos);
+                if (!sof) return len;
+                pos = sof;
+                btstack_slip_decoder_process(*pos++);
+                break;
+            }
+            case SLIP_DECODER_ACTIVE: {
+                // copy run of regular bytes
+                const uint8_t * run = pos;
+                pos = btstack_slip_decoder_find_special_byte(pos, end);
+                uint16_t run_len = pos - run;
+                if (run_len){
+                    if (decoder_pos + run_len > decoder_max_size){
+                        log_error("btstack_slip_decoder_process_block: packet to long");
+                        btstack_slip_decoder_reset();
+                        break;
+                    }
+                    memcpy(&decoder_buffer[decoder_pos], run, run_len);
+                    decoder_pos += run_len;
+                }
+                if (pos < end){
+                    btstack_slip_decoder_process(*pos++);
+                }
+                break;
+            }
+            default:
+                btstack_slip_decoder_process(*pos++);
+                break;
+        }
+    }
+    return pos - data;
+}
+
 /**
  * @brief Get size of decoded frame
  * @return size of frame. Size = 0 => frame not complete
@@ -0,0 +1,264 @@
+/*
+ * Copyright (C) 2016 BlueKitchen GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 4. Any redistribution, use, or modification is done solely for
+ *    personal benefit and not for any commercial purpose or for
+ *    monetary gain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BLUEKITCHEN GMBH AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MATTHIAS
+ * RINGWALD OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Please inquire about commercial licensing options at 
+ * contact@bluekitchen-gmbh.com
+ *
+ */
+
+/*
+ *  btstack_timer_wheel.c
+ *
+ *  Hierarchical timer wheel: level 0 has one slot per ms, each following level covers
+ *  64 times the range of the previous one. Timers are kept in doubly linked lists per slot,
+ *  so add and remove are O(1). When time reaches the start of a slot on a higher level,
+ *  its timers are moved down (cascaded) to the lower levels. The next event is found by
+ *  looking at the bitmap of non-empty slots per level.
+ */
+
+#include "btstack_timer_wheel.h"
+
+#include <stddef.h> // NULL
+
+#define SLOT_MASK (BTSTACK_TIMER_WHEEL_SLOTS - 1)
+
+// count trailing zeros, value must not be 0
+static int btstack_timer_wheel_ctz(uint64_t value){
+#ifdef __GNUC__
+    return __builtin_ctzll(value);
+#else
+    int count = 0;
+    while ((value & 1) == 0){
+        value >>= 1;
+        count++;
+    }
+    return count;
+#endif
+}
+
+// distance from start to the next non-empty slot, -1 if all slots are empty
+static int btstack_timer_wheel_next_occupied(uint64_t occupied, int start){
+    if (!occupied) return -1;
+    uint64_t rotated = occupied;
+    if (start){
+        rotated = (occupied >> start) | (occupied << (BTSTACK_TIMER_WHEEL_SLOTS - start));
+    }
+    return btstack_timer_wheel_ctz(rotated);
+}
+
+static void btstack_timer_wheel_link(btstack_linked_item_t ** head, btstack_timer_source_t * timer){
+    timer->item.next = *head;
+    if (*head){
+        ((btstack_timer_source_t *) *head)->pprev = &timer->item.next;
+    }
+    *head = (btstack_linked_item_t *) timer;
+    timer->pprev = head;
+}
+
+static void btstack_timer_wheel_unlink(btstack_timer_wheel_t * timer_wheel, btstack_timer_source_t * timer){
+    btstack_linked_item_t ** pprev = timer->pprev;
+    btstack_linked_item_t *  next  = timer->item.next;
+    *pprev = next;
+    if (next){
+        ((btstack_timer_source_t *) next)->pprev = pprev;
+    }
+    timer->pprev = NULL;
+    timer->item.next = NULL;
+    if (*pprev) return;
+    // list is empty now, if it is a slot, mark as free
+    btstack_linked_item_t ** first_slot = &timer_wheel->slots[0][0];
+    if (pprev < first_slot || pprev >= first_slot + BTSTACK_TIMER_WHEEL_LEVELS * BTSTACK_TIMER_WHEEL_SLOTS) return;
+    int index = pprev - first_slot;
+    timer_wheel->occupied[index / BTSTACK_TIMER_WHEEL_SLOTS] &= ~(((uint64_t) 1) << (index & SLOT_MASK));
+}
+
+static void btstack_timer_wheel_insert(btstack_timer_wheel_t * timer_wheel, btstack_timer_source_t * timer){
+    int32_t delta = (int32_t) (timer->timeout - (uint32_t) timer_wheel->now);
+    if (delta < 0){
+        // time already processed
+        btstack_timer_wheel_link(&timer_wheel->expired, timer);
+        return;
+    }
+    uint64_t expires = timer_wheel->now + delta;
+    int level = 0;
+    while (level < BTSTACK_TIMER_WHEEL_LEVELS - 1 && ((uint64_t) delta) >= (((uint64_t) 1) << (BTSTACK_TIMER_WHEEL_SLOT_BITS * (level + 1)))){
+        level++;
+    }
+    int slot = (expires >> (BTSTACK_TIMER_WHEEL_SLOT_BITS * level)) & SLOT_MASK;
+    btstack_timer_wheel_link(&timer_wheel->slots[level][slot], timer);
+    timer_wheel->occupied[level] |= ((uint64_t) 1) << slot;
+}
+
+// move timers of current slot on given level down to lower levels
+static void btstack_timer_wheel_cascade(btstack_timer_wheel_t * timer_wheel, int level){
+    int slot = (timer_wheel->now >> (BTSTACK_TIMER_WHEEL_SLOT_BITS * level)) & SLOT_MASK;
+    btstack_linked_item_t * it = timer_wheel->slots[level][slot];
+    timer_wheel->slots[level][slot] = NULL;
+    timer_wheel->occupied[level] &= ~(((uint64_t) 1) << slot);
+    while (it){
+        btstack_timer_source_t * timer = (btstack_timer_source_t *) it;
+        it = it->next;
+        btstack_timer_wheel_insert(timer_wheel, timer);
+    }
+}
+
+// process current time: cascade higher levels at their slot boundaries and move expired timers
+static void btstack_timer_wheel_process_tick(btstack_timer_wheel_t * timer_wheel){
+    int level = 1;
+    while (level < BTSTACK_TIMER_WHEEL_LEVELS && (timer_wheel->now & ((((uint64_t) 1) << (BTSTACK_TIMER_WHEEL_SLOT_BITS * level)) - 1)) == 0){
+        level++;
+    }
+    for (level = level - 1; level > 0; level--){
+        btstack_timer_wheel_cascade(timer_wheel, level);
+    }
+    int slot = timer_wheel->now & SLOT_MASK;
+    btstack_linked_item_t * head = timer_wheel->slots[0][slot];
+    if (head){
+        // expired list is empty while processing ticks
+        timer_wheel->slots[0][slot] = NULL;
+        timer_wheel->occupied[0] &= ~(((uint64_t) 1) << slot);
+        timer_wheel->expired = head;
+        ((btstack_timer_source_t *) head)->pprev = &timer_wheel->expired;
+    }
+    timer_wheel->now++;
+}
+
+// earliest time that needs processing: exact for level 0, start of next non-empty slot for higher levels
+static int btstack_timer_wheel_get_next_event(btstack_timer_wheel_t * timer_wheel, uint64_t * next_event){
+    int found = 0;
+    uint64_t now = timer_wheel->now;
+    int offset = btstack_timer_wheel_next_occupied(timer_wheel->occupied[0], now & SLOT_MASK);
+    if (offset >= 0){
+        *next_event = now + offset;
+        found = 1;
+    }
+    int level;
+    for (level = 1; level < BTSTACK_TIMER_WHEEL_LEVELS; level++){
+        int shift = BTSTACK_TIMER_WHEEL_SLOT_BITS * level;
+        // current slot is cascaded when now reaches its start, afterwards it holds timers for the next round
+        uint64_t block = now >> shift;
+        if (now & ((((uint64_t) 1) << shift) - 1)){
+            block++;
+        }
+        offset = btstack_timer_wheel_next_occupied(timer_wheel->occupied[level], block & SLOT_MASK);
+        if (offset < 0) continue;
+        uint64_t slot_start = (block + offset) << shift;
+        if (!found || slot_start < *next_event){
+            *next_event = slot_start;
+            found = 1;
+        }
+    }
+    return found;
+}
+
+void btstack_timer_wheel_init(btstack_timer_wheel_t * timer_wheel, uint32_t now_ms){
+    int level;
+    int slot;
+    timer_wheel->now = now_ms;
+    timer_wheel->expired = NULL;
+    for (level = 0; level < BTSTACK_TIMER_WHEEL_LEVELS; level++){
+        timer_wheel->occupied[level] = 0;
+        for (slot = 0; slot < BTSTACK_TIMER_WHEEL_SLOTS; slot++){
+            timer_wheel->slots[level][slot] = NULL;
+        }
+    }
+}
+
+void btstack_timer_wheel_add(btstack_timer_wheel_t * timer_wheel, btstack_timer_source_t * timer){
+    // re-arm
+    if (timer->pprev){
+        btstack_timer_wheel_unlink(timer_wheel, timer);
+    }
+    btstack_timer_wheel_insert(timer_wheel, timer);
+}
+
+int btstack_timer_wheel_remove(btstack_timer_wheel_t * timer_wheel, btstack_timer_source_t * timer){
+    if (!timer->pprev) return -1;
+    btstack_timer_wheel_unlink(timer_wheel, timer);
+    return 0;
+}
+
+int btstack_timer_wheel_empty(btstack_timer_wheel_t * timer_wheel){
+    if (timer_wheel->expired) return 0;
+    int level;
+    for (level = 0; level < BTSTACK_TIMER_WHEEL_LEVELS; level++){
+        if (timer_wheel->occupied[level]) return 0;
+    }
+    return 1;
+}
+
+int32_t btstack_timer_wheel_get_time_until_next(btstack_timer_wheel_t * timer_wheel, uint32_t now_ms){
+    if (timer_wheel->expired) return 0;
+    uint64_t next_event;
+    if (!btstack_timer_wheel_get_next_event(timer_wheel, &next_event)) return -1;
+    int64_t delta = (int64_t) (next_event - timer_wheel->now) - (int32_t) (now_ms - (uint32_t) timer_wheel->now);
+    if (delta < 0) return 0;
+    if (delta > 0x7fffffff) return 0x7fffffff;
+    return (int32_t) delta;
+}
+
+btstack_timer_source_t * btstack_timer_wheel_get_expired(btstack_timer_wheel_t * timer_wheel, uint32_t now_ms){
+    while (1){
+        if (timer_wheel->expired){
+            btstack_timer_source_t * timer = (btstack_timer_source_t *) timer_wheel->expired;
+            btstack_timer_wheel_unlink(timer_wheel, timer);
+            return timer;
+        }
+        int32_t delta = (int32_t) (now_ms - (uint32_t) timer_wheel->now);
+        if (delta < 0) return NULL;
+        uint64_t target = timer_wheel->now + delta;
+        uint64_t next_event;
+        if (!btstack_timer_wheel_get_next_event(timer_wheel, &next_event) || next_event > target){
+            // nothing to do until now_ms
+            timer_wheel->now = target + 1;
+            return NULL;
+        }
+        timer_wheel->now = next_event;
+        btstack_timer_wheel_process_tick(timer_wheel);
+    }
+}
+
+void btstack_timer_wheel_for_each(btstack_timer_wheel_t * timer_wheel, void (*callback)(btstack_timer_source_t * timer)){
+    btstack_linked_item_t * it;
+    int level;
+    int slot;
+    for (it = timer_wheel->expired; it ; it = it->next){
+        (*callback)((btstack_timer_source_t *) it);
+    }
+    for (level = 0; level < BTSTACK_TIMER_WHEEL_LEVELS; level++){
+        for (slot = 0; slot < BTSTACK_TIMER_WHEEL_SLOTS; slot++){
+            for (it = timer_wheel->slots[level][slot]; it ; it = it->next){
+                (*callback)((btstack_timer_source_t *) it);
+            }
+        }
+    }
+}
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2016 BlueKitchen GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 4. Any redistribution, use, or modification is done solely for
+ *    personal benefit and not for any commercial purpose or for
+ *    monetary gain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BLUEKITCHEN GMBH AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MATTHIAS
+ * RINGWALD OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Please inquire about commercial licensing options at 
+ * contact@bluekitchen-gmbh.com
+ *
+ */
+
+/*
+ *  btstack_timer_wheel.h
+ *
+ *  Hierarchical timer wheel for btstack_timer_source_t with O(1) add and remove
+ */
+
+#ifndef __BTSTACK_TIMER_WHEEL_H
+#define __BTSTACK_TIMER_WHEEL_H
+
+#include "btstack_run_loop.h"
+
+#include <stdint.h>
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+// 6 levels with 64 slots each cover the full 32-bit timeout range
+#define BTSTACK_TIMER_WHEEL_LEVELS    6
+#define BTSTACK_TIMER_WHEEL_SLOT_BITS 6
+#define BTSTACK_TIMER_WHEEL_SLOTS     (1 << BTSTACK_TIMER_WHEEL_SLOT_BITS)
+
+typedef struct btstack_timer_wheel {
+    // next time to process, extended to 64 bit to avoid wrap-around
+    uint64_t now;
+    // list of timers ready to be processed
+    btstack_linked_item_t * expired;
+    // bitmap of non-empty slots per level
+    uint64_t occupied[BTSTACK_TIMER_WHEEL_LEVELS];
+    // timers per slot, level 0 has a resolution of 1 ms, each following level is 64 times coarser
+    btstack_linked_item_t * slots[BTSTACK_TIMER_WHEEL_LEVELS][BTSTACK_TIMER_WHEEL_SLOTS];
+} btstack_timer_wheel_t;
+
+/**
+ * Init timer wheel
+ * @param timer_wheel object
+ * @param now_ms current time
+ */
+void btstack_timer_wheel_init(btstack_timer_wheel_t * timer_wheel, uint32_t now_ms);
+
+/**
+ * Add timer. If the timer is already in the timer wheel, it gets re-armed with its current timeout
+ * @param timer_wheel object
+ * @param timer with timeout in ms
+ * @note timer has to be zero initialized before first use
+ */
+void btstack_timer_wheel_add(btstack_timer_wheel_t * timer_wheel, btstack_timer_source_t * timer);
+
+/**
+ * Remove timer
+ * @param timer_wheel object
+ * @param timer
+ * @return 0 if timer was removed, -1 if timer was not in timer wheel
+ */
+int btstack_timer_wheel_remove(btstack_timer_wheel_t * timer_wheel, btstack_timer_source_t * timer);
+
+/**
+ * Check if timer wheel is empty
+ * @param timer_wheel object
+ * @return TRUE if empty
+ */
+int btstack_timer_wheel_empty(btstack_timer_wheel_t * timer_wheel);
+
+/**
+ * Get time until the next timer needs to be processed
+ * @param timer_wheel object
+ * @param now_ms current time
+ * @return ms until next timer might expire, or -1 if timer wheel is empty
+ * @note might be earlier than the actual timeout of the next timer. The caller should just process expired timers then
+ */
+int32_t btstack_timer_wheel_get_time_until_next(btstack_timer_wheel_t * timer_wheel, uint32_t now_ms);
+
+/**
+ * Get next expired timer. The returned timer is removed from the timer wheel
+ * @param timer_wheel object
+ * @param now_ms current time
+ * @return timer or NULL if no timer has expired
+ */
+btstack_timer_source_t * btstack_timer_wheel_get_expired(btstack_timer_wheel_t * timer_wheel, uint32_t now_ms);
+
+/**
+ * Call process function for each timer in timer wheel, e.g. for dump_timer implementations
+ * @param timer_wheel object
+ * @param callback
+ */
+void btstack_timer_wheel_for_each(btstack_timer_wheel_t * timer_wheel, void (*callback)(btstack_timer_source_t * timer));
+
+#if defined __cplusplus
+}
+#endif
+
+#endif // __BTSTACK_TIMER_WHEEL_H
@@ -132,6 +132,18 @@ typedef struct {
      */
     void (*set_sleep)(btstack_uart_sleep_mode_t sleep_mode);
 
+    // optional support for variable size reads
+
+    /**
+     * set callback for data received via receive_available
+     */
+    void (*set_data_received)(void (*data_handler)(uint16_t size));
+
+    /**
+     * receive up to max_len bytes, data handler is called as soon as some data has been received
+     */
+    void (*receive_available)(uint8_t *buffer, uint16_t max_len);
+
 } btstack_uart_block_t;
 
 // common implementations
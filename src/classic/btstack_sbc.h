@@ -45,6 +45,7 @@
 
 #include <stdint.h>
 #include "btstack_sbc_plc.h"
+#include "sbc_encoder.h"
 
 #if defined __cplusplus
 extern "C" {
@@ -69,10 +70,14 @@ typedef struct {
     int zero_frames_nr;
 } btstack_sbc_decoder_state_t;
 
+// size of SBC frame buffer
+#define BTSTACK_SBC_ENCODER_MAX_FRAME_LEN 1000
+
 typedef struct {
     // private
-    void * encoder_state;
     btstack_sbc_mode_t mode;
+    SBC_ENC_PARAMS context;
+    uint8_t sbc_buffer[BTSTACK_SBC_ENCODER_MAX_FRAME_LEN];
 } btstack_sbc_encoder_state_t;
 
 /* API_START */
@@ -115,7 +120,8 @@ int btstack_sbc_decoder_sample_rate(btstack_sbc_decoder_state_t * state);
 
 /* BTstack SBC Encoder */
 /**
- * @brief Init SBC encoder
+ * @brief Init SBC encoder. All encoder state is kept in state, so multiple encoders
+ *        can be used at the same time, also from different threads
  * @param state
  * @param mode 
  * @param blocks
@@ -128,25 +134,29 @@ void btstack_sbc_encoder_init(btstack_sbc_encoder_state_t * state, btstack_sbc_m
                         int blocks, int subbands, int allocation_method, int sample_rate, int bitpool);
 
 /**
- * @brief Process received PCM data
- * @param buffer
+ * @brief Encode PCM data into SBC frame
+ * @param state
+ * @param buffer with btstack_sbc_encoder_num_audio_samples samples
  */
-void btstack_sbc_encoder_process_data(int16_t * input_buffer);
+void btstack_sbc_encoder_process_data(btstack_sbc_encoder_state_t * state, int16_t * input_buffer);
 
 /**
  * @brief Return SBC frame
+ * @param state
  */
-uint8_t * btstack_sbc_encoder_sbc_buffer(void);
+uint8_t * btstack_sbc_encoder_sbc_buffer(btstack_sbc_encoder_state_t * state);
 
 /**
  * @brief Return SBC frame length
+ * @param state
  */
-uint16_t  btstack_sbc_encoder_sbc_buffer_length(void);
+uint16_t  btstack_sbc_encoder_sbc_buffer_length(btstack_sbc_encoder_state_t * state);
 
 /**
  * @brief Return number of audio samples in one PCM frame
+ * @param state
  */
-int  btstack_sbc_encoder_num_audio_samples(void);
+int  btstack_sbc_encoder_num_audio_samples(btstack_sbc_encoder_state_t * state);
 
 /* API_END */
 
@@ -46,6 +46,7 @@
 
 #include "btstack_debug.h"
 #include "btstack_event.h"
+#include "btstack_instrumentation.h"
 #include "btstack_memory.h"
 #include "btstack_util.h"
 #include "classic/core.h"
@@ -1304,8 +1305,10 @@ static void rfcomm_channel_packet_handler_uih(rfcomm_multiplexer_t *multiplexer,
         }
         
         // deliver payload
+        BTSTACK_INSTRUMENTATION_ENTER(BTSTACK_INSTRUMENTATION_LAYER_RFCOMM, channel->multiplexer->con_handle, channel->rfcomm_cid, size-payload_offset-1);
         (channel->packet_handler)(RFCOMM_DATA_PACKET, channel->rfcomm_cid,
                               &packet[payload_offset], size-payload_offset-1);
+        BTSTACK_INSTRUMENTATION_EXIT();
     }
     
     // automatically provide new credits to remote device, if no incoming flow control
@@ -66,6 +66,7 @@
 
 #include "btstack_debug.h"
 #include "btstack_event.h"
+#include "btstack_instrumentation.h"
 #include "btstack_linked_list.h"
 #include "btstack_memory.h"
 #include "gap.h"
@@ -103,6 +104,9 @@ static void hci_emit_acl_packet(uint8_t * packet, uint16_t size);
 static void hci_run(void);
 static int  hci_is_le_connection(hci_connection_t * connection);
 static int  hci_number_free_acl_slots_for_connection_type( bd_addr_type_t address_type);
+static void hci_acl_tx_drop_queue(hci_connection_t * connection);
+static void hci_acl_tx_reset(void);
+static void hci_acl_recombination_reset(hci_connection_t * conn);
 
 #ifdef ENABLE_BLE
 // called from test/ble_client/advertising_data_parser.c
@@ -119,6 +123,59 @@ static hci_stack_t * hci_stack = NULL;
 // test helper
 static uint8_t disable_l2cap_timeouts = 0;
 
+static inline hci_connection_t ** hci_connection_bucket_for_handle(hci_con_handle_t con_handle){
+    return &hci_stack->connections_by_handle[con_handle & (HCI_CONNECTION_HASH_SIZE - 1)];
+}
+
+static void hci_connection_remove_from_bucket(hci_connection_t * conn){
+    hci_connection_t ** it;
+    for (it = hci_connection_bucket_for_handle(conn->con_handle); *it ; it = &(*it)->next_for_handle){
+        if (*it != conn) continue;
+        *it = conn->next_for_handle;
+        conn->next_for_handle = NULL;
+        return;
+    }
+}
+
+// update con handle and connections_by_handle
+static void hci_connection_set_handle(hci_connection_t * conn, hci_con_handle_t con_handle){
+    hci_connection_remove_from_bucket(conn);
+    conn->con_handle = con_handle;
+    hci_connection_t ** bucket = hci_connection_bucket_for_handle(con_handle);
+    conn->next_for_handle = *bucket;
+    *bucket = conn;
+}
+
+// track packets sent to controller per connection and in total
+static void hci_connection_add_acl_packets_sent(hci_connection_t * conn, int num_packets){
+    conn->num_acl_packets_sent += num_packets;
+    if (conn->address_type == BD_ADDR_TYPE_CLASSIC){
+        hci_stack->acl_packets_sent_classic += num_packets;
+    } else {
+        hci_stack->acl_packets_sent_le += num_packets;
+    }
+}
+
+#ifdef ENABLE_CLASSIC
+static void hci_connection_add_sco_packets_sent(hci_connection_t * conn, int num_packets){
+    conn->num_sco_packets_sent += num_packets;
+    hci_stack->sco_packets_sent += num_packets;
+}
+#endif
+
+// remove connection from lists, packets in flight are not counted anymore
+static void hci_connection_free(hci_connection_t * conn){
+    hci_connection_remove_from_bucket(conn);
+    hci_acl_tx_drop_queue(conn);
+    hci_acl_recombination_reset(conn);
+    hci_connection_add_acl_packets_sent(conn, - (int) conn->num_acl_packets_sent);
+#ifdef ENABLE_CLASSIC
+    hci_connection_add_sco_packets_sent(conn, - (int) conn->num_sco_packets_sent);
+#endif
+    btstack_linked_list_remove(&hci_stack->connections, (btstack_linked_item_t *) conn);
+    btstack_memory_hci_connection_free( conn );
+}
+
 /**
  * create connection for given address
  *
@@ -144,8 +201,10 @@ static hci_connection_t * create_connection_for_bd_addr_and_type(bd_addr_t addr,
     conn->acl_recombination_pos = 0;
     conn->num_acl_packets_sent = 0;
     conn->num_sco_packets_sent = 0;
+    conn->acl_tx_weight = 1;
     conn->le_con_parameter_update_state = CON_PARAMETER_UPDATE_NONE;
     btstack_linked_list_add(&hci_stack->connections, (btstack_linked_item_t *) conn);
+    hci_connection_set_handle(conn, 0xffff);
     return conn;
 }
 
@@ -184,10 +243,8 @@ void hci_connections_get_iterator(btstack_linked_list_iterator_t *it){
  * @return connection OR NULL, if not found
  */
 hci_connection_t * hci_connection_for_handle(hci_con_handle_t con_handle){
-    btstack_linked_list_iterator_t it;
-    btstack_linked_list_iterator_init(&it, &hci_stack->connections);
-    while (btstack_linked_list_iterator_has_next(&it)){
-        hci_connection_t * item = (hci_connection_t *) btstack_linked_list_iterator_next(&it);
+    hci_connection_t * item;
+    for (item = *hci_connection_bucket_for_handle(con_handle); item ; item = item->next_for_handle){
         if ( item->con_handle == con_handle ) {
             return item;
         }
@@ -300,18 +357,9 @@ static int nr_hci_connections(void){
 
 static int hci_number_free_acl_slots_for_connection_type(bd_addr_type_t address_type){
     
-    unsigned int num_packets_sent_classic = 0;
-    unsigned int num_packets_sent_le = 0;
+    unsigned int num_packets_sent_classic = hci_stack->acl_packets_sent_classic;
+    unsigned int num_packets_sent_le = hci_stack->acl_packets_sent_le;
 
-    btstack_linked_item_t *it;
-    for (it = (btstack_linked_item_t *) hci_stack->connections; it ; it = it->next){
-        hci_connection_t * connection = (hci_connection_t *) it;
-        if (connection->address_type == BD_ADDR_TYPE_CLASSIC){
-            num_packets_sent_classic += connection->num_acl_packets_sent;
-        } else {
-            num_packets_sent_le += connection->num_acl_packets_sent;
-        }
-    }
     log_debug("ACL classic buffers: %u used of %u", num_packets_sent_classic, hci_stack->acl_packets_total_num);
     int free_slots_classic = hci_stack->acl_packets_total_num - num_packets_sent_classic;
     int free_slots_le = 0;
@@ -365,12 +413,7 @@ int hci_number_free_acl_slots_for_handle(hci_con_handle_t con_handle){
 
 #ifdef ENABLE_CLASSIC
 static int hci_number_free_sco_slots(void){
-    unsigned int num_sco_packets_sent  = 0;
-    btstack_linked_item_t *it;
-    for (it = (btstack_linked_item_t *) hci_stack->connections; it ; it = it->next){
-        hci_connection_t * connection = (hci_connection_t *) it;
-        num_sco_packets_sent += connection->num_sco_packets_sent;
-    }
+    unsigned int num_sco_packets_sent  = hci_stack->sco_packets_sent;
     if (num_sco_packets_sent > hci_stack->sco_packets_total_num){
         log_info("hci_number_free_sco_slots:packets (%u) > total packets (%u)", num_sco_packets_sent, hci_stack->sco_packets_total_num);
         return 0;
@@ -405,16 +448,48 @@ static int hci_can_send_prepared_acl_packet_for_address_type(bd_addr_type_t addr
     return hci_number_free_acl_slots_for_connection_type(address_type) > 0;
 }
 
+// ACL scheduler has room for another packet of this connection
+static int hci_acl_tx_queue_available(hci_connection_t * connection){
+    if (connection->acl_tx_stats.queue_depth >= HCI_ACL_TX_QUEUE_DEPTH) return 0;
+    if (!hci_stack->acl_tx_buffer_spare){
+        hci_stack->acl_tx_buffer_spare = btstack_memory_hci_acl_buffer_get();
+    }
+    return hci_stack->acl_tx_buffer_spare != NULL;
+}
+
+// ACL scheduler has room for another packet for all connections of this type
+static int hci_acl_tx_queues_available_for_address_type(bd_addr_type_t address_type){
+    btstack_linked_item_t * it;
+    for (it = (btstack_linked_item_t *) hci_stack->connections; it ; it = it->next){
+        hci_connection_t * connection = (hci_connection_t *) it;
+        if (connection->address_type == BD_ADDR_TYPE_SCO) continue;
+        if (hci_is_le_connection(connection) != (address_type != BD_ADDR_TYPE_CLASSIC)) continue;
+        if (!hci_acl_tx_queue_available(connection)) return 0;
+    }
+    return hci_stack->connections != NULL;
+}
+
 int hci_can_send_acl_le_packet_now(void){
     if (hci_stack->hci_packet_buffer_reserved) return 0;
+    if (hci_acl_tx_queues_available_for_address_type(BD_ADDR_TYPE_LE_PUBLIC)) return 1;
     return hci_can_send_prepared_acl_packet_for_address_type(BD_ADDR_TYPE_LE_PUBLIC);
 }
 
-int hci_can_send_prepared_acl_packet_now(hci_con_handle_t con_handle) {
+// controller and transport can take another ACL fragment for this connection
+static int hci_can_send_acl_fragment_now(hci_con_handle_t con_handle){
     if (!hci_transport_can_send_prepared_packet_now(HCI_ACL_DATA_PACKET)) return 0;
     return hci_number_free_acl_slots_for_handle(con_handle) > 0;
 }
 
+int hci_can_send_prepared_acl_packet_now(hci_con_handle_t con_handle) {
+    hci_connection_t * connection = hci_connection_for_handle(con_handle);
+    if (!connection) return 0;
+    if (hci_acl_tx_queue_available(connection)) return 1;
+    // send directly only if nothing is queued for this connection
+    if (connection->acl_tx_queue) return 0;
+    return hci_can_send_acl_fragment_now(con_handle);
+}
+
 int hci_can_send_acl_packet_now(hci_con_handle_t con_handle){
     if (hci_stack->hci_packet_buffer_reserved) return 0;
     return hci_can_send_prepared_acl_packet_now(con_handle);
@@ -423,6 +498,7 @@ int hci_can_send_acl_packet_now(hci_con_handle_t con_handle){
 #ifdef ENABLE_CLASSIC
 int hci_can_send_acl_classic_packet_now(void){
     if (hci_stack->hci_packet_buffer_reserved) return 0;
+    if (hci_acl_tx_queues_available_for_address_type(BD_ADDR_TYPE_CLASSIC)) return 1;
     return hci_can_send_prepared_acl_packet_for_address_type(BD_ADDR_TYPE_CLASSIC);
 }
 
@@ -467,15 +543,207 @@ static int hci_transport_synchronous(void){
     return hci_stack->hci_transport->can_send_packet_now == NULL;
 }
 
+// max ACL data packet length depends on connection type (LE vs. Classic) and available buffers
+static uint16_t hci_max_acl_data_packet_length_for_connection(hci_connection_t * connection){
+    if (hci_is_le_connection(connection) && hci_stack->le_data_packets_length > 0){
+        return hci_stack->le_data_packets_length;
+    }
+    return hci_stack->acl_data_packet_length;
+}
+
+// ACL scheduler: packets are copied into per-connection queues and their fragments are sent
+// round-robin over all connections, each connection may send acl_tx_weight fragments per turn
+
+static void hci_acl_tx_free_buffer(hci_acl_buffer_t * acl_buffer){
+    // asynchronous transport might still send from it
+    if (acl_buffer == hci_stack->acl_tx_buffer_in_transport){
+        hci_stack->acl_tx_buffer_free_on_sent = 1;
+        return;
+    }
+    btstack_memory_hci_acl_buffer_free(acl_buffer);
+}
+
+static void hci_acl_tx_drop_queue(hci_connection_t * connection){
+    if (hci_stack->acl_tx_cursor == connection){
+        hci_stack->acl_tx_cursor = NULL;
+    }
+    while (connection->acl_tx_queue){
+        hci_acl_buffer_t * acl_buffer = (hci_acl_buffer_t *) btstack_linked_list_pop(&connection->acl_tx_queue);
+        hci_stack->acl_tx_packets_queued--;
+        hci_acl_tx_free_buffer(acl_buffer);
+    }
+    connection->acl_tx_stats.queue_depth = 0;
+}
+
+static void hci_acl_tx_reset(void){
+    // fragment held by transport won't be reported as sent anymore
+    if (hci_stack->acl_tx_buffer_in_transport && hci_stack->acl_tx_buffer_free_on_sent){
+        btstack_memory_hci_acl_buffer_free(hci_stack->acl_tx_buffer_in_transport);
+    }
+    hci_stack->acl_tx_buffer_in_transport = NULL;
+    hci_stack->acl_tx_buffer_free_on_sent = 0;
+    hci_stack->acl_tx_packets_queued = 0;
+    hci_stack->acl_tx_cursor = NULL;
+}
+
+// pre: hci_acl_tx_queue_available(connection)
+static void hci_acl_tx_enqueue(hci_connection_t * connection, int size){
+    hci_acl_buffer_t * acl_buffer = hci_stack->acl_tx_buffer_spare;
+    hci_stack->acl_tx_buffer_spare = NULL;
+    memcpy(&acl_buffer->buffer[HCI_OUTGOING_PRE_BUFFER_SIZE], hci_stack->hci_packet_buffer, size);
+    acl_buffer->size = size;
+    acl_buffer->pos  = 4;   // start of L2CAP packet
+    acl_buffer->enqueue_time_ms = btstack_run_loop_get_time_ms();
+    btstack_linked_list_add_tail(&connection->acl_tx_queue, (btstack_linked_item_t *) acl_buffer);
+    hci_stack->acl_tx_packets_queued++;
+
+    hci_acl_tx_stats_t * stats = &connection->acl_tx_stats;
+    stats->queue_depth++;
+    if (stats->queue_depth > stats->queue_depth_max){
+        stats->queue_depth_max = stats->queue_depth;
+    }
+}
+
+static int hci_acl_tx_can_send_fragment(hci_connection_t * connection){
+    if (!connection->acl_tx_queue) return 0;
+    return hci_number_free_acl_slots_for_connection_type(connection->address_type) > 0;
+}
+
+static hci_connection_t * hci_acl_tx_next_connection(void){
+    // connection served last may continue until its weight is used up
+    hci_connection_t * cursor = hci_stack->acl_tx_cursor;
+    if (cursor && cursor->acl_tx_burst < cursor->acl_tx_weight && hci_acl_tx_can_send_fragment(cursor)){
+        return cursor;
+    }
+
+    // otherwise, find next connection after cursor that can send, wrap around
+    btstack_linked_item_t * start = cursor ? cursor->item.next : NULL;
+    btstack_linked_item_t * it;
+    for (it = start; it ; it = it->next){
+        if (hci_acl_tx_can_send_fragment((hci_connection_t *) it)) break;
+    }
+    if (!it){
+        for (it = (btstack_linked_item_t *) hci_stack->connections; it != start; it = it->next){
+            if (hci_acl_tx_can_send_fragment((hci_connection_t *) it)) break;
+        }
+        if (it == start) return NULL;
+    }
+
+    hci_connection_t * connection = (hci_connection_t *) it;
+    connection->acl_tx_burst = 0;
+    hci_stack->acl_tx_cursor = connection;
+    return connection;
+}
+
+static void hci_acl_tx_send_fragment(hci_connection_t * connection){
+    hci_acl_buffer_t * acl_buffer = (hci_acl_buffer_t *) connection->acl_tx_queue;
+    uint8_t * acl_packet = &acl_buffer->buffer[HCI_OUTGOING_PRE_BUFFER_SIZE];
+    hci_acl_tx_stats_t * stats = &connection->acl_tx_stats;
+
+    // get current data
+    const uint16_t acl_header_pos = acl_buffer->pos - 4;
+    uint16_t current_acl_data_packet_length = acl_buffer->size - acl_buffer->pos;
+    uint16_t max_acl_data_packet_length = hci_max_acl_data_packet_length_for_connection(connection);
+    int more_fragments = 0;
+    if (current_acl_data_packet_length > max_acl_data_packet_length){
+        more_fragments = 1;
+        current_acl_data_packet_length = max_acl_data_packet_length;
+    }
+
+    // copy handle_and_flags if not first fragment and update packet boundary flags to be 01 (continuing fragmnent)
+    if (acl_header_pos > 0){
+        uint16_t handle_and_flags = little_endian_read_16(acl_packet, 0);
+        handle_and_flags = (handle_and_flags & 0xcfff) | (1 << 12);
+        little_endian_store_16(acl_packet, acl_header_pos, handle_and_flags);
+    }
+
+    // update header len
+    little_endian_store_16(acl_packet, acl_header_pos + 2, current_acl_data_packet_length);
+
+    // count packet
+    hci_connection_add_acl_packets_sent(connection, 1);
+    connection->acl_tx_burst++;
+    stats->fragments_sent++;
+
+    // update state for next fragment (if any) as "transport done" might be sent during send_packet already
+    if (more_fragments){
+        acl_buffer->pos += current_acl_data_packet_length;
+    } else {
+        btstack_linked_list_pop(&connection->acl_tx_queue);
+        hci_stack->acl_tx_packets_queued--;
+        stats->queue_depth--;
+        stats->packets_sent++;
+        uint32_t latency_ms = btstack_run_loop_get_time_ms() - acl_buffer->enqueue_time_ms;
+        stats->latency_ms_total += latency_ms;
+        if (latency_ms > stats->latency_ms_max){
+            stats->latency_ms_max = latency_ms;
+        }
+    }
+    int synchronous = hci_transport_synchronous();
+    if (!synchronous){
+        hci_stack->acl_tx_buffer_in_transport = acl_buffer;
+        hci_stack->acl_tx_buffer_free_on_sent = 0;
+    }
+
+    // send packet
+    uint8_t * packet = &acl_packet[acl_header_pos];
+    const int size = current_acl_data_packet_length + 4;
+    hci_dump_packet(HCI_ACL_DATA_PACKET, 0, packet, size);
+    hci_stack->hci_transport->send_packet(HCI_ACL_DATA_PACKET, packet, size);
+
+    if (more_fragments) return;
+
+    hci_acl_tx_free_buffer(acl_buffer);
+    if (synchronous){
+        // notify upper stack that it might be possible to send again
+        uint8_t event[] = { HCI_EVENT_TRANSPORT_PACKET_SENT, 0};
+        hci_emit_event(&event[0], sizeof(event), 0);  // don't dump
+    }
+}
+
+static void hci_acl_tx_run(void){
+    // called again from upper layer on packet sent event
+    if (hci_stack->acl_tx_running) return;
+    hci_stack->acl_tx_running = 1;
+    while (hci_stack->acl_tx_packets_queued){
+        // only a single fragment tracked in asynchronous transport, continue on HCI_EVENT_TRANSPORT_PACKET_SENT
+        if (hci_stack->acl_tx_buffer_in_transport) break;
+        if (!hci_transport_can_send_prepared_packet_now(HCI_ACL_DATA_PACKET)) break;
+        hci_connection_t * connection = hci_acl_tx_next_connection();
+        if (!connection) break;
+        hci_acl_tx_send_fragment(connection);
+    }
+    hci_stack->acl_tx_running = 0;
+}
+
+// fragment sent by asynchronous transport
+static void hci_acl_tx_packet_sent(void){
+    if (hci_stack->acl_tx_buffer_free_on_sent){
+        btstack_memory_hci_acl_buffer_free(hci_stack->acl_tx_buffer_in_transport);
+    }
+    hci_stack->acl_tx_buffer_in_transport = NULL;
+    hci_stack->acl_tx_buffer_free_on_sent = 0;
+    hci_acl_tx_run();
+}
+
+void hci_set_acl_tx_weight(hci_con_handle_t con_handle, uint8_t weight){
+    hci_connection_t * connection = hci_connection_for_handle(con_handle);
+    if (!connection) return;
+    connection->acl_tx_weight = weight ? weight : 1;
+}
+
+int hci_get_acl_tx_stats(hci_con_handle_t con_handle, hci_acl_tx_stats_t * stats){
+    hci_connection_t * connection = hci_connection_for_handle(con_handle);
+    if (!connection) return 0;
+    *stats = connection->acl_tx_stats;
+    return 1;
+}
+
 static int hci_send_acl_packet_fragments(hci_connection_t *connection){
 
     // log_info("hci_send_acl_packet_fragments  %u/%u (con 0x%04x)", hci_stack->acl_fragmentation_pos, hci_stack->acl_fragmentation_total_size, connection->con_handle);
 
-    // max ACL data packet length depends on connection type (LE vs. Classic) and available buffers
-    uint16_t max_acl_data_packet_length = hci_stack->acl_data_packet_length;
-    if (hci_is_le_connection(connection) && hci_stack->le_data_packets_length > 0){
-        max_acl_data_packet_length = hci_stack->le_data_packets_length;
-    }
+    uint16_t max_acl_data_packet_length = hci_max_acl_data_packet_length_for_connection(connection);
 
     // testing: reduce buffer to minimum
     // max_acl_data_packet_length = 52;
@@ -510,7 +778,8 @@ static int hci_send_acl_packet_fragments(hci_connection_t *connection){
         little_endian_store_16(hci_stack->hci_packet_buffer, acl_header_pos + 2, current_acl_data_packet_length);
 
         // count packet
-        connection->num_acl_packets_sent++;
+        hci_connection_add_acl_packets_sent(connection, 1);
+        connection->acl_tx_stats.fragments_sent++;
         log_debug("hci_send_acl_packet_fragments loop before send (more fragments %d)", more_fragments);
 
         // update state for next fragment (if any) as "transport done" might be sent during send_packet already
@@ -521,6 +790,7 @@ static int hci_send_acl_packet_fragments(hci_connection_t *connection){
             // done
             hci_stack->acl_fragmentation_pos = 0;
             hci_stack->acl_fragmentation_total_size = 0;
+            connection->acl_tx_stats.packets_sent++;
         }
 
         // send packet
@@ -535,7 +805,7 @@ static int hci_send_acl_packet_fragments(hci_connection_t *connection){
         if (!more_fragments) break;
 
         // can send more?
-        if (!hci_can_send_prepared_acl_packet_now(connection->con_handle)) return err;
+        if (!hci_can_send_acl_fragment_now(connection->con_handle)) return err;
     }
 
     log_debug("hci_send_acl_packet_fragments loop over");
@@ -564,13 +834,6 @@ int hci_send_acl_packet_buffer(int size){
     uint8_t * packet = hci_stack->hci_packet_buffer;
     hci_con_handle_t con_handle = READ_ACL_CONNECTION_HANDLE(packet);
 
-    // check for free places on Bluetooth module
-    if (!hci_can_send_prepared_acl_packet_now(con_handle)) {
-        log_error("hci_send_acl_packet_buffer called but no free ACL buffers on controller");
-        hci_release_packet_buffer();
-        return BTSTACK_ACL_BUFFERS_FULL;
-    }
-
     hci_connection_t *connection = hci_connection_for_handle( con_handle);
     if (!connection) {
         log_error("hci_send_acl_packet_buffer called but no connection for handle 0x%04x", con_handle);
@@ -578,6 +841,28 @@ int hci_send_acl_packet_buffer(int size){
         return 0;
     }
 
+    // send single fragment directly if nothing is queued for this connection, otherwise
+    // queue packet for ACL scheduler and free packet buffer again
+    int send_directly = connection->acl_tx_queue == NULL
+        && size - 4 <= hci_max_acl_data_packet_length_for_connection(connection)
+        && hci_can_send_acl_fragment_now(con_handle);
+    if (!send_directly && size <= HCI_ACL_BUFFER_SIZE && hci_acl_tx_queue_available(connection)){
+#ifdef ENABLE_CLASSIC
+        hci_connection_timestamp(connection);
+#endif
+        hci_acl_tx_enqueue(connection, size);
+        hci_release_packet_buffer();
+        hci_acl_tx_run();
+        return 0;
+    }
+
+    // check for free places on Bluetooth module
+    if (!send_directly && (connection->acl_tx_queue || !hci_can_send_acl_fragment_now(con_handle))) {
+        log_error("hci_send_acl_packet_buffer called but no free ACL buffers on controller");
+        hci_release_packet_buffer();
+        return BTSTACK_ACL_BUFFERS_FULL;
+    }
+
 #ifdef ENABLE_CLASSIC
     hci_connection_timestamp(connection);
 #endif
@@ -622,7 +907,7 @@ int hci_send_sco_packet_buffer(int size){
             hci_release_packet_buffer();
             return 0;
         }
-        connection->num_sco_packets_sent++;
+        hci_connection_add_sco_packets_sent(connection, 1);
     }
 
     hci_dump_packet( HCI_SCO_DATA_PACKET, 0, packet, size);
@@ -639,6 +924,61 @@ int hci_send_sco_packet_buffer(int size){
 }
 #endif
 
+#ifdef ENABLE_ACL_REASSEMBLY_POOL
+
+static void hci_acl_reassembly_free(hci_connection_t * conn){
+    if (!conn->acl_reassembly_buffer) return;
+    btstack_memory_hci_acl_reassembly_buffer_free(conn->acl_reassembly_buffer);
+    conn->acl_reassembly_buffer = NULL;
+}
+
+static uint8_t * hci_acl_reassembly_get(hci_connection_t * conn){
+    if (!conn->acl_reassembly_buffer){
+        conn->acl_reassembly_buffer = btstack_memory_hci_acl_reassembly_buffer_get();
+        if (!conn->acl_reassembly_buffer) return NULL;
+    }
+    return conn->acl_reassembly_buffer->buffer;
+}
+
+// reset recombination, buffer is returned to pool
+static void hci_acl_recombination_reset(hci_connection_t * conn){
+    conn->acl_recombination_length = 0;
+    conn->acl_recombination_pos = 0;
+    hci_acl_reassembly_free(conn);
+}
+
+uint8_t * hci_acl_reassembly_buffer_for_fragment(const uint8_t * acl_header){
+    // only continuation fragments of a started packet
+    if ((READ_ACL_FLAGS(acl_header) & 0x03) != 0x01) return NULL;
+    uint16_t acl_length = READ_ACL_LENGTH(acl_header);
+    if (acl_length == 0) return NULL;
+    hci_connection_t * conn = hci_connection_for_handle(READ_ACL_CONNECTION_HANDLE(acl_header));
+    if (!conn || !conn->acl_reassembly_buffer || conn->acl_recombination_pos == 0) return NULL;
+    if (conn->acl_recombination_pos + acl_length > 4 + HCI_ACL_BUFFER_SIZE) return NULL;
+    // ACL header goes in front of the payload, save end of previous fragment
+    uint8_t * fragment = &conn->acl_reassembly_buffer->buffer[HCI_INCOMING_PRE_BUFFER_SIZE + conn->acl_recombination_pos - 4];
+    memcpy(conn->acl_reassembly_saved, fragment, 4);
+    return fragment;
+}
+
+#else
+
+static uint8_t * hci_acl_reassembly_get(hci_connection_t * conn){
+    return conn->acl_recombination_buffer;
+}
+
+static void hci_acl_recombination_reset(hci_connection_t * conn){
+    conn->acl_recombination_length = 0;
+    conn->acl_recombination_pos = 0;
+}
+
+uint8_t * hci_acl_reassembly_buffer_for_fragment(const uint8_t * acl_header){
+    UNUSED(acl_header);
+    return NULL;
+}
+
+#endif
+
 static void acl_handler(uint8_t *packet, int size){
 
     // log_info("acl_handler: size %u", size);
@@ -648,6 +988,7 @@ static void acl_handler(uint8_t *packet, int size){
     hci_connection_t *conn      = hci_connection_for_handle(con_handle);
     uint8_t  acl_flags          = READ_ACL_FLAGS(packet);
     uint16_t acl_length         = READ_ACL_LENGTH(packet);
+    uint8_t * recombination_buffer;
 
     // ignore non-registered handle
     if (!conn){
@@ -679,12 +1020,21 @@ static void acl_handler(uint8_t *packet, int size){
             if (conn->acl_recombination_pos + acl_length > 4 + HCI_ACL_BUFFER_SIZE){
                 log_error( "ACL Cont Fragment to large: combined packet %u > buffer size %u for handle 0x%02x",
                     conn->acl_recombination_pos + acl_length, 4 + HCI_ACL_BUFFER_SIZE, con_handle);
-                conn->acl_recombination_pos = 0;
+                hci_acl_recombination_reset(conn);
                 return;
             }
 
             // append fragment payload (header already stored)
-            memcpy(&conn->acl_recombination_buffer[HCI_INCOMING_PRE_BUFFER_SIZE + conn->acl_recombination_pos], &packet[4], acl_length );
+            recombination_buffer = hci_acl_reassembly_get(conn);
+#ifdef ENABLE_ACL_REASSEMBLY_POOL
+            if (packet == &recombination_buffer[HCI_INCOMING_PRE_BUFFER_SIZE + conn->acl_recombination_pos - 4]){
+                // payload received in place, restore end of previous fragment
+                memcpy(packet, conn->acl_reassembly_saved, 4);
+            } else
+#endif
+            {
+                memcpy(&recombination_buffer[HCI_INCOMING_PRE_BUFFER_SIZE + conn->acl_recombination_pos], &packet[4], acl_length );
+            }
             conn->acl_recombination_pos += acl_length;
             
             // log_error( "ACL Cont Fragment: acl_len %u, combined_len %u, l2cap_len %u", acl_length,
@@ -692,10 +1042,9 @@ static void acl_handler(uint8_t *packet, int size){
             
             // forward complete L2CAP packet if complete. 
             if (conn->acl_recombination_pos >= conn->acl_recombination_length + 4 + 4){ // pos already incl. ACL header
-                hci_emit_acl_packet(&conn->acl_recombination_buffer[HCI_INCOMING_PRE_BUFFER_SIZE], conn->acl_recombination_pos);
+                hci_emit_acl_packet(&recombination_buffer[HCI_INCOMING_PRE_BUFFER_SIZE], conn->acl_recombination_pos);
                 // reset recombination buffer
-                conn->acl_recombination_length = 0;
-                conn->acl_recombination_pos = 0;
+                hci_acl_recombination_reset(conn);
             }
             break;
             
@@ -704,7 +1053,7 @@ static void acl_handler(uint8_t *packet, int size){
             // sanity check
             if (conn->acl_recombination_pos) {
                 log_error( "ACL First Fragment but data in buffer for handle 0x%02x, dropping stale fragments", con_handle);
-                conn->acl_recombination_pos = 0;
+                hci_acl_recombination_reset(conn);
             }
 
             // peek into L2CAP packet!
@@ -724,11 +1073,17 @@ static void acl_handler(uint8_t *packet, int size){
                     return;
                 }
 
+                recombination_buffer = hci_acl_reassembly_get(conn);
+                if (!recombination_buffer){
+                    log_error( "ACL First Fragment but no reassembly buffer for handle 0x%02x", con_handle);
+                    return;
+                }
+
                 // store first fragment and tweak acl length for complete package
-                memcpy(&conn->acl_recombination_buffer[HCI_INCOMING_PRE_BUFFER_SIZE], packet, acl_length + 4);
+                memcpy(&recombination_buffer[HCI_INCOMING_PRE_BUFFER_SIZE], packet, acl_length + 4);
                 conn->acl_recombination_pos    = acl_length + 4;
                 conn->acl_recombination_length = l2cap_length;
-                little_endian_store_16(conn->acl_recombination_buffer, HCI_INCOMING_PRE_BUFFER_SIZE + 2, l2cap_length +4);
+                little_endian_store_16(recombination_buffer, HCI_INCOMING_PRE_BUFFER_SIZE + 2, l2cap_length +4);
             }
             break;
             
@@ -747,8 +1102,7 @@ static void hci_shutdown_connection(hci_connection_t *conn){
 
     btstack_run_loop_remove_timer(&conn->timeout);
     
-    btstack_linked_list_remove(&hci_stack->connections, (btstack_linked_item_t *) conn);
-    btstack_memory_hci_connection_free( conn );
+    hci_connection_free(conn);
     
     // now it's gone
     hci_emit_nr_connections_changed();
@@ -1598,23 +1952,25 @@ static void event_handler(uint8_t *packet, int size){
                 if (conn->address_type == BD_ADDR_TYPE_SCO){
 #ifdef ENABLE_CLASSIC
                     if (conn->num_sco_packets_sent >= num_packets){
-                        conn->num_sco_packets_sent -= num_packets;
+                        hci_connection_add_sco_packets_sent(conn, - (int) num_packets);
                     } else {
                         log_error("hci_number_completed_packets, more sco slots freed then sent.");
-                        conn->num_sco_packets_sent = 0;
+                        hci_connection_add_sco_packets_sent(conn, - (int) conn->num_sco_packets_sent);
                     }
                     hci_notify_if_sco_can_send_now();
 #endif
                 } else {
                     if (conn->num_acl_packets_sent >= num_packets){
-                        conn->num_acl_packets_sent -= num_packets;
+                        hci_connection_add_acl_packets_sent(conn, - (int) num_packets);
                     } else {
                         log_error("hci_number_completed_packets, more acl slots freed then sent.");
-                        conn->num_acl_packets_sent = 0;
+                        hci_connection_add_acl_packets_sent(conn, - (int) conn->num_acl_packets_sent);
                     }
                 }
                 // log_info("hci_number_completed_packet %u processed for handle %u, outstanding %u", num_packets, handle, conn->num_acl_packets_sent);
             }
+            // send queued fragments before upper layers get notified
+            hci_acl_tx_run();
             break;
         }
 
@@ -1653,7 +2009,7 @@ static void event_handler(uint8_t *packet, int size){
             if (conn) {
                 if (!packet[2]){
                     conn->state = OPEN;
-                    conn->con_handle = little_endian_read_16(packet, 3);
+                    hci_connection_set_handle(conn, little_endian_read_16(packet, 3));
                     conn->bonding_flags |= BONDING_REQUEST_REMOTE_FEATURES;
 
                     // restart timer
@@ -1670,8 +2026,7 @@ static void event_handler(uint8_t *packet, int size){
                     memcpy(&bd_address, conn->address, 6);
 
                     // connection failed, remove entry
-                    btstack_linked_list_remove(&hci_stack->connections, (btstack_linked_item_t *) conn);
-                    btstack_memory_hci_connection_free( conn );
+                    hci_connection_free(conn);
                     
                     // notify client if dedicated bonding
                     if (notify_dedicated_bonding_failed){
@@ -1702,7 +2057,7 @@ static void event_handler(uint8_t *packet, int size){
                 break;
             }
             conn->state = OPEN;
-            conn->con_handle = little_endian_read_16(packet, 3);            
+            hci_connection_set_handle(conn, little_endian_read_16(packet, 3));
             break;
 
         case HCI_EVENT_READ_REMOTE_SUPPORTED_FEATURES_COMPLETE:
@@ -1873,8 +2228,13 @@ static void event_handler(uint8_t *packet, int size){
                 log_error("Synchronous HCI Transport shouldn't send HCI_EVENT_TRANSPORT_PACKET_SENT");
                 return; // instead of break: to avoid re-entering hci_run()
             }
-            if (hci_stack->acl_fragmentation_total_size) break;
-            hci_release_packet_buffer();
+            // fragment from ACL scheduler or packet buffer
+            if (hci_stack->acl_tx_buffer_in_transport){
+                hci_acl_tx_packet_sent();
+            } else {
+                if (hci_stack->acl_fragmentation_total_size) break;
+                hci_release_packet_buffer();
+            }
             
             // L2CAP receives this event via the hci_emit_event below
 
@@ -1915,8 +2275,7 @@ static void event_handler(uint8_t *packet, int size){
                         hci_stack->le_connecting_state = LE_CONNECTING_IDLE;
                         // remove entry
                         if (conn){
-                            btstack_linked_list_remove(&hci_stack->connections, (btstack_linked_item_t *) conn);
-                            btstack_memory_hci_connection_free( conn );
+                            hci_connection_free(conn);
                         }
                         break;
                     }
@@ -1941,7 +2300,7 @@ static void event_handler(uint8_t *packet, int size){
                     
                     conn->state = OPEN;
                     conn->role  = packet[6];
-                    conn->con_handle = little_endian_read_16(packet, 4);
+                    hci_connection_set_handle(conn, little_endian_read_16(packet, 4));
                     
                     // TODO: store - role, peer address type, conn_interval, conn_latency, supervision timeout, master clock
 
@@ -2014,10 +2373,14 @@ static void packet_handler(uint8_t packet_type, uint8_t *packet, uint16_t size){
     hci_dump_packet(packet_type, 1, packet, size);
     switch (packet_type) {
         case HCI_EVENT_PACKET:
+            BTSTACK_INSTRUMENTATION_ENTER(BTSTACK_INSTRUMENTATION_LAYER_HCI, BTSTACK_INSTRUMENTATION_NO_CON_HANDLE, HCI_EVENT_PACKET, size);
             event_handler(packet, size);
+            BTSTACK_INSTRUMENTATION_EXIT();
             break;
         case HCI_ACL_DATA_PACKET:
+            BTSTACK_INSTRUMENTATION_ENTER(BTSTACK_INSTRUMENTATION_LAYER_HCI, READ_ACL_CONNECTION_HANDLE(packet), HCI_ACL_DATA_PACKET, size);
             acl_handler(packet, size);
+            BTSTACK_INSTRUMENTATION_EXIT();
             break;
 #ifdef ENABLE_CLASSIC
         case HCI_SCO_DATA_PACKET:
@@ -2054,6 +2417,11 @@ void hci_register_sco_packet_handler(btstack_packet_handler_t handler){
 static void hci_state_reset(void){
     // no connections yet
     hci_stack->connections = NULL;
+    memset(hci_stack->connections_by_handle, 0, sizeof(hci_stack->connections_by_handle));
+    hci_stack->acl_packets_sent_classic = 0;
+    hci_stack->acl_packets_sent_le = 0;
+    hci_stack->sco_packets_sent = 0;
+    hci_acl_tx_reset();
 
     // keep discoverable/connectable as this has been requested by the client(s)
     // hci_stack->discoverable = 0;
@@ -2181,6 +2549,10 @@ void hci_close(void){
     }
 
     hci_power_control(HCI_POWER_OFF);
+
+    if (hci_stack->acl_tx_buffer_spare){
+        btstack_memory_hci_acl_buffer_free(hci_stack->acl_tx_buffer_spare);
+    }
     
 #ifdef HAVE_MALLOC
     free(hci_stack);
@@ -2500,7 +2872,7 @@ static void hci_run(void){
         hci_con_handle_t con_handle = READ_ACL_CONNECTION_HANDLE(hci_stack->hci_packet_buffer);
         hci_connection_t *connection = hci_connection_for_handle(con_handle);
         if (connection) {
-            if (hci_can_send_prepared_acl_packet_now(con_handle)){
+            if (hci_can_send_acl_fragment_now(con_handle)){
                 hci_send_acl_packet_fragments(connection);
                 return;
             }
@@ -2512,6 +2884,9 @@ static void hci_run(void){
         }
     }
 
+    // send queued ACL fragments
+    hci_acl_tx_run();
+
     if (!hci_can_send_command_packet_now()) return;
 
     // global/non-connection oriented commands
@@ -3506,8 +3881,7 @@ uint8_t gap_connect_cancel(void){
         case SEND_CREATE_CONNECTION:
             // skip sending create connection and emit event instead
             hci_emit_le_connection_complete(conn->address_type, conn->address, 0, ERROR_CODE_UNKNOWN_CONNECTION_IDENTIFIER);
-            btstack_linked_list_remove(&hci_stack->connections, (btstack_linked_item_t *) conn);
-            btstack_memory_hci_connection_free( conn );
+            hci_connection_free(conn);
             break;            
         case SENT_CREATE_CONNECTION:
             // request to send cancel connection
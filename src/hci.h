@@ -421,11 +421,63 @@ typedef struct {
 
 #endif
 
-//
+// number of buckets for connection lookup by handle, power of two
+#ifndef HCI_CONNECTION_HASH_SIZE
+#define HCI_CONNECTION_HASH_SIZE 16
+#endif
+#if (HCI_CONNECTION_HASH_SIZE & (HCI_CONNECTION_HASH_SIZE - 1)) != 0
+#error "HCI_CONNECTION_HASH_SIZE must be a power of two"
+#endif
+
+// max number of outgoing ACL packets queued per connection by the ACL scheduler
+#ifndef HCI_ACL_TX_QUEUE_DEPTH
+#define HCI_ACL_TX_QUEUE_DEPTH 2
+#endif
+
+// outgoing ACL packet queued by the ACL scheduler, allocated via btstack_memory (MAX_NR_HCI_ACL_BUFFERS)
+typedef struct {
+    // linked list - assert: first field
+    btstack_linked_item_t item;
+
+    // time of enqueue for latency statistics
+    uint32_t enqueue_time_ms;
+
+    // size of ACL packet incl. header and start of next fragment
+    uint16_t size;
+    uint16_t pos;
+
+    // prebuffer for H4 drivers + ACL packet
+    uint8_t  buffer[HCI_OUTGOING_PRE_BUFFER_SIZE + HCI_ACL_BUFFER_SIZE];
+} hci_acl_buffer_t;
+
+// incoming ACL packet reassembly buffer, allocated via btstack_memory (MAX_NR_HCI_ACL_REASSEMBLY_BUFFERS)
+// while a fragmented packet is received if ENABLE_ACL_REASSEMBLY_POOL is defined
 typedef struct {
+    // PRE_BUFFER + ACL Header + ACL payload
+    uint8_t  buffer[HCI_INCOMING_PRE_BUFFER_SIZE + 4 + HCI_ACL_BUFFER_SIZE];
+} hci_acl_reassembly_buffer_t;
+
+// outgoing ACL statistics per connection
+typedef struct {
+    // ACL packets currently queued and high-water mark
+    uint16_t queue_depth;
+    uint16_t queue_depth_max;
+    // ACL packets and fragments handed to HCI transport
+    uint32_t packets_sent;
+    uint32_t fragments_sent;
+    // time from enqueue until last fragment was handed to HCI transport
+    uint32_t latency_ms_total;
+    uint32_t latency_ms_max;
+} hci_acl_tx_stats_t;
+
+//
+typedef struct hci_connection {
     // linked list - assert: first field
     btstack_linked_item_t    item;
     
+    // next connection in same bucket of connections_by_handle
+    struct hci_connection * next_for_handle;
+
     // remote side
     bd_addr_t address;
     
@@ -462,7 +514,13 @@ typedef struct {
     uint32_t timestamp;
 
     // ACL packet recombination - PRE_BUFFER + ACL Header + ACL payload
+#ifdef ENABLE_ACL_REASSEMBLY_POOL
+    hci_acl_reassembly_buffer_t * acl_reassembly_buffer;
+    // end of previous fragment overwritten by ACL header of fragment received in place
+    uint8_t  acl_reassembly_saved[4];
+#else
     uint8_t  acl_recombination_buffer[HCI_INCOMING_PRE_BUFFER_SIZE + 4 + HCI_ACL_BUFFER_SIZE];
+#endif
     uint16_t acl_recombination_pos;
     uint16_t acl_recombination_length;
     
@@ -470,6 +528,12 @@ typedef struct {
     uint8_t num_acl_packets_sent;
     uint8_t num_sco_packets_sent;
 
+    // ACL scheduler: queued outgoing packets, fragments per round-robin turn, statistics
+    btstack_linked_list_t acl_tx_queue;
+    uint8_t  acl_tx_weight;
+    uint8_t  acl_tx_burst;
+    hci_acl_tx_stats_t acl_tx_stats;
+
     // LE Connection parameter update
     le_con_parameter_update_state_t le_con_parameter_update_state;
     uint8_t  le_con_param_update_identifier;
@@ -611,6 +675,9 @@ typedef struct {
     // list of existing baseband connections
     btstack_linked_list_t     connections;
 
+    // existing baseband connections hashed by con handle
+    hci_connection_t *        connections_by_handle[HCI_CONNECTION_HASH_SIZE];
+
     /* callback to L2CAP layer */
     btstack_packet_handler_t acl_packet_handler;
 
@@ -640,6 +707,14 @@ typedef struct {
     uint8_t   hci_packet_buffer_reserved;
     uint16_t  acl_fragmentation_pos;
     uint16_t  acl_fragmentation_total_size;
+
+    // ACL scheduler
+    hci_acl_buffer_t * acl_tx_buffer_spare;         // allocated for can send now checks
+    hci_acl_buffer_t * acl_tx_buffer_in_transport;  // fragment held by asynchronous HCI transport
+    uint8_t            acl_tx_buffer_free_on_sent;  // free buffer on HCI_EVENT_TRANSPORT_PACKET_SENT
+    uint8_t            acl_tx_running;
+    uint16_t           acl_tx_packets_queued;
+    hci_connection_t * acl_tx_cursor;               // connection served last
      
     /* host to controller flow control */
     uint8_t  num_cmd_packets;
@@ -652,6 +727,11 @@ typedef struct {
     uint16_t le_data_packets_length;
     uint8_t  sco_waiting_for_can_send_now;
 
+    // packets sent to controller and not completed yet, for all connections
+    uint16_t acl_packets_sent_classic;
+    uint16_t acl_packets_sent_le;
+    uint16_t sco_packets_sent;
+
     /* local supported features */
     uint8_t local_supported_features[8];
 
@@ -887,6 +967,21 @@ uint8_t* hci_get_outgoing_packet_buffer(void);
  */
 void hci_release_packet_buffer(void);
 
+/**
+ * @brief Set weight of connection for outgoing ACL scheduler
+ * @param con_handle
+ * @param weight number of ACL fragments sent per round-robin turn, default 1
+ */
+void hci_set_acl_tx_weight(hci_con_handle_t con_handle, uint8_t weight);
+
+/**
+ * @brief Get outgoing ACL queue depth and latency statistics for connection
+ * @param con_handle
+ * @param stats
+ * @return 1 if connection exists
+ */
+int hci_get_acl_tx_stats(hci_con_handle_t con_handle, hci_acl_tx_stats_t * stats);
+
 
 /* API_END */
 
@@ -917,22 +1012,22 @@ hci_connection_t * hci_connection_for_bd_addr_and_type(bd_addr_t addr, bd_addr_t
 int hci_is_packet_buffer_reserved(void);
 
 /**
- * Check hci packet buffer is free and a classic acl packet can be sent to controller
+ * Check hci packet buffer is free and a classic acl packet can be sent to controller or queued for all classic connections
  */
 int hci_can_send_acl_classic_packet_now(void);
 
 /**
- * Check hci packet buffer is free and an LE acl packet can be sent to controller
+ * Check hci packet buffer is free and an LE acl packet can be sent to controller or queued for all LE connections
  */
 int hci_can_send_acl_le_packet_now(void);
 
 /**
- * Check hci packet buffer is free and an acl packet for the given handle can be sent to controller
+ * Check hci packet buffer is free and an acl packet for the given handle can be sent to controller or queued
  */
 int hci_can_send_acl_packet_now(hci_con_handle_t con_handle);
 
 /**
- * Check if acl packet for the given handle can be sent to controller
+ * Check if acl packet for the given handle can be sent to controller or queued
  */
 int hci_can_send_prepared_acl_packet_now(hci_con_handle_t con_handle);
 
@@ -941,6 +1036,14 @@ int hci_can_send_prepared_acl_packet_now(hci_con_handle_t con_handle);
  */
 int hci_send_acl_packet_buffer(int size);
 
+/**
+ * Get buffer to receive ACL fragment into. Used by HCI transports to read continuation fragments directly
+ * into the reassembly buffer, ACL header followed by acl length bytes payload. Requires ENABLE_ACL_REASSEMBLY_POOL
+ * @param acl_header of received fragment
+ * @return buffer or NULL if fragment has to be received into the transport buffer
+ */
+uint8_t * hci_acl_reassembly_buffer_for_fragment(const uint8_t * acl_header);
+
 /**
  * Check if authentication is active. It delays automatic disconnect while no L2CAP connection
  * Called by l2cap.
@@ -59,11 +59,24 @@
 #ifdef HAVE_POSIX_FILE_IO
 #include <fcntl.h>        // open
 #include <unistd.h>       // write 
+#include <string.h>
 #include <time.h>
 #include <sys/time.h>     // for timestamps
 #include <sys/stat.h>     // for mode flags
 #endif
 
+#ifdef ENABLE_HCI_DUMP_DEFERRED_LOG
+#include <stddef.h>       // ptrdiff_t
+#endif
+
+#ifdef ENABLE_HCI_DUMP_ASYNC
+#ifndef HAVE_POSIX_FILE_IO
+#error "ENABLE_HCI_DUMP_ASYNC requires HAVE_POSIX_FILE_IO"
+#endif
+#include <pthread.h>
+#include <sys/uio.h>      // writev
+#endif
+
 // BLUEZ hcidump - struct not used directly, but left here as documentation
 typedef struct {
     uint16_t    len;
@@ -86,6 +99,21 @@ typedef struct {
 pktlog_hdr;
 #define PKTLOG_HDR_SIZE 13
 
+// size of record buffer between BTstack and writer thread, power of two
+#ifndef HCI_DUMP_ASYNC_BUFFER_SIZE
+#define HCI_DUMP_ASYNC_BUFFER_SIZE 65536
+#endif
+
+// interval in which the writer thread flushes the record buffer
+#ifndef HCI_DUMP_ASYNC_FLUSH_INTERVAL_MS
+#define HCI_DUMP_ASYNC_FLUSH_INTERVAL_MS 20
+#endif
+
+// max number of different log format strings for deferred formatting, power of two
+#ifndef HCI_DUMP_DEFERRED_LOG_MAX_FORMATS
+#define HCI_DUMP_DEFERRED_LOG_MAX_FORMATS 512
+#endif
+
 static int dump_file = -1;
 #ifdef HAVE_POSIX_FILE_IO
 static int dump_format;
@@ -95,27 +123,252 @@ static char time_string[40];
 static int  max_nr_packets = -1;
 static int  nr_packets = 0;
 static char log_message_buffer[256];
+
+// size-based rotation: filename -> filename.1 -> ... -> filename.<max_nr_files-1>
+static char     dump_file_name[256];
+static uint32_t max_file_size;
+static int      max_nr_files;
+static uint32_t dump_file_size;
+#endif
+
+#ifdef ENABLE_HCI_DUMP_DEFERRED_LOG
+#ifndef HAVE_POSIX_FILE_IO
+#error "ENABLE_HCI_DUMP_DEFERRED_LOG requires HAVE_POSIX_FILE_IO"
+#endif
+// PacketLogger record type for deferred log messages, see tool/decode_deferred_log.py
+#define HCI_DUMP_DEFERRED_LOG_PACKET 0xf0
+#define DEFERRED_LOG_FORMAT  0
+#define DEFERRED_LOG_MESSAGE 1
+#define DEFERRED_LOG_MAX_STRING_LEN 255
+
+// format strings are interned by address, the slot index is used as format id
+static const char * deferred_log_formats[HCI_DUMP_DEFERRED_LOG_MAX_FORMATS];
+static int          deferred_log_num_formats;
+static uint8_t      deferred_log_buffer[256];
+#endif
+
+#ifdef ENABLE_HCI_DUMP_ASYNC
+// single producer (BTstack thread), single consumer (writer thread) ring buffer of complete records
+// positions are free-running, only written by their owner and published with release semantics
+static uint8_t   async_buffer[HCI_DUMP_ASYNC_BUFFER_SIZE];
+static uint32_t  async_write_pos;
+static uint32_t  async_read_pos;
+static uint32_t  async_dropped_records;
+// max_nr_packets reached: writer discards records before async_truncate_pos and truncates file
+static uint32_t  async_truncate_pos;
+static uint32_t  async_truncate_requests;
+static uint32_t  async_truncate_requests_handled;
+static int       async_stop;
+static int       async_writer_active;
+static pthread_t async_writer;
+// owned by writer thread while active as rotation replaces it, dump_file only indicates that logging is enabled
+static int       async_file;
 #endif
 
 // levels: debug, info, error
 static int log_level_enabled[3] = { 1, 1, 1};
 
+#ifdef HAVE_POSIX_FILE_IO
+static int hci_dump_open_file(const char * filename){
+    int oflags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef _WIN32
+    oflags |= O_BINARY;
+#endif
+    return open(filename, oflags, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH );
+}
+
+#ifdef ENABLE_HCI_DUMP_DEFERRED_LOG
+static int hci_dump_deferred_log_setup_format(uint8_t * buffer, uint16_t format_id, const char * format){
+    int len = strlen(format);
+    buffer[0] = DEFERRED_LOG_FORMAT;
+    little_endian_store_16(buffer, 1, format_id);
+    memcpy(&buffer[3], format, len);
+    return 3 + len;
+}
+
+// start of new file: repeat all known format strings, called from writer thread in async mode
+static void hci_dump_deferred_log_write_formats(int fd){
+    uint8_t record[PKTLOG_HDR_SIZE + sizeof(deferred_log_buffer)];
+    struct timeval curr_time;
+    gettimeofday(&curr_time, NULL);
+    int i;
+    for (i = 0; i < HCI_DUMP_DEFERRED_LOG_MAX_FORMATS; i++){
+        const char * format = __atomic_load_n(&deferred_log_formats[i], __ATOMIC_ACQUIRE);
+        if (!format) continue;
+        int len = hci_dump_deferred_log_setup_format(&record[PKTLOG_HDR_SIZE], i, format);
+        big_endian_store_32(record, 0, PKTLOG_HDR_SIZE - 4 + len);
+        big_endian_store_32(record, 4, (uint32_t) curr_time.tv_sec);
+        big_endian_store_32(record, 8, curr_time.tv_usec);
+        record[12] = HCI_DUMP_DEFERRED_LOG_PACKET;
+        write(fd, record, PKTLOG_HDR_SIZE + len);
+        dump_file_size += PKTLOG_HDR_SIZE + len;
+    }
+}
+#endif
+
+static void hci_dump_truncate_file(int fd){
+    lseek(fd, 0, SEEK_SET);
+    ftruncate(fd, 0);
+    dump_file_size = 0;
+#ifdef ENABLE_HCI_DUMP_DEFERRED_LOG
+    hci_dump_deferred_log_write_formats(fd);
+#endif
+}
+
+// @returns file descriptor of new file
+static int hci_dump_rotate_file(int fd){
+    close(fd);
+    char old_name[sizeof(dump_file_name) + 12];
+    char new_name[sizeof(dump_file_name) + 12];
+    int i;
+    for (i = max_nr_files - 1; i > 0; i--){
+        if (i == 1){
+            strcpy(old_name, dump_file_name);
+        } else {
+            snprintf(old_name, sizeof(old_name), "%s.%u", dump_file_name, i - 1);
+        }
+        snprintf(new_name, sizeof(new_name), "%s.%u", dump_file_name, i);
+        rename(old_name, new_name);
+    }
+    fd = hci_dump_open_file(dump_file_name);
+    dump_file_size = 0;
+#ifdef ENABLE_HCI_DUMP_DEFERRED_LOG
+    hci_dump_deferred_log_write_formats(fd);
+#endif
+    return fd;
+}
+
+// rotate before appending len bytes would exceed max_file_size. @returns file descriptor to write to
+static int hci_dump_rotate_file_if_needed(int fd, uint32_t len){
+    if (max_file_size == 0) return fd;
+    if (dump_file_size == 0) return fd;
+    if (dump_file_size + len <= max_file_size) return fd;
+    return hci_dump_rotate_file(fd);
+}
+#endif
+
+#ifdef ENABLE_HCI_DUMP_ASYNC
+static void hci_dump_async_flush(void){
+    uint32_t truncate_requests = __atomic_load_n(&async_truncate_requests, __ATOMIC_ACQUIRE);
+    if (truncate_requests != async_truncate_requests_handled){
+        async_truncate_requests_handled = truncate_requests;
+        // records up to async_truncate_pos might have been written already, never move read pos backwards
+        uint32_t truncate_pos = __atomic_load_n(&async_truncate_pos, __ATOMIC_ACQUIRE);
+        if (truncate_pos - async_read_pos < HCI_DUMP_ASYNC_BUFFER_SIZE){
+            __atomic_store_n(&async_read_pos, truncate_pos, __ATOMIC_RELEASE);
+        }
+        hci_dump_truncate_file(async_file);
+    }
+
+    uint32_t write_pos = __atomic_load_n(&async_write_pos, __ATOMIC_ACQUIRE);
+    uint32_t len = write_pos - async_read_pos;
+    if (len == 0) return;
+
+    async_file = hci_dump_rotate_file_if_needed(async_file, len);
+
+    // pending records are contiguous or wrap around once
+    struct iovec iov[2];
+    int iovcnt = 1;
+    uint32_t offset = async_read_pos & (HCI_DUMP_ASYNC_BUFFER_SIZE - 1);
+    iov[0].iov_base = &async_buffer[offset];
+    iov[0].iov_len  = len;
+    if (offset + len > HCI_DUMP_ASYNC_BUFFER_SIZE){
+        iov[0].iov_len  = HCI_DUMP_ASYNC_BUFFER_SIZE - offset;
+        iov[1].iov_base = async_buffer;
+        iov[1].iov_len  = len - iov[0].iov_len;
+        iovcnt = 2;
+    }
+    writev(async_file, iov, iovcnt);
+    dump_file_size += len;
+
+    __atomic_store_n(&async_read_pos, write_pos, __ATOMIC_RELEASE);
+}
+
+static void * hci_dump_async_writer_thread(void * context){
+    UNUSED(context);
+    struct timespec interval;
+    interval.tv_sec  = HCI_DUMP_ASYNC_FLUSH_INTERVAL_MS / 1000;
+    interval.tv_nsec = (HCI_DUMP_ASYNC_FLUSH_INTERVAL_MS % 1000) * 1000000L;
+    while (1){
+        // records stored before stop was requested are flushed by this pass
+        int stop = __atomic_load_n(&async_stop, __ATOMIC_ACQUIRE);
+        hci_dump_async_flush();
+        if (stop) break;
+        nanosleep(&interval, NULL);
+    }
+    return NULL;
+}
+
+static void hci_dump_async_copy(uint32_t pos, const uint8_t * data, uint16_t len){
+    uint32_t offset = pos & (HCI_DUMP_ASYNC_BUFFER_SIZE - 1);
+    uint32_t bytes_to_end = HCI_DUMP_ASYNC_BUFFER_SIZE - offset;
+    if (len <= bytes_to_end){
+        memcpy(&async_buffer[offset], data, len);
+        return;
+    }
+    memcpy(&async_buffer[offset], data, bytes_to_end);
+    memcpy(async_buffer, &data[bytes_to_end], len - bytes_to_end);
+}
+
+// @returns 0 if record does not fit into buffer
+static int hci_dump_async_store(const uint8_t * header, uint16_t header_len, const uint8_t * packet, uint16_t len){
+    uint32_t read_pos = __atomic_load_n(&async_read_pos, __ATOMIC_ACQUIRE);
+    uint32_t buffer_free = HCI_DUMP_ASYNC_BUFFER_SIZE - (async_write_pos - read_pos);
+    if ((uint32_t) header_len + len > buffer_free) return 0;
+    hci_dump_async_copy(async_write_pos, header, header_len);
+    hci_dump_async_copy(async_write_pos + header_len, packet, len);
+    __atomic_store_n(&async_write_pos, async_write_pos + header_len + len, __ATOMIC_RELEASE);
+    return 1;
+}
+
+static void hci_dump_async_start(void){
+    async_write_pos = 0;
+    async_read_pos = 0;
+    async_dropped_records = 0;
+    async_truncate_requests = 0;
+    async_truncate_requests_handled = 0;
+    async_stop = 0;
+    async_file = dump_file;
+    async_writer_active = pthread_create(&async_writer, NULL, &hci_dump_async_writer_thread, NULL) == 0;
+    if (!async_writer_active){
+        printf("hci_dump_open: failed to start writer thread, writing synchronously\n");
+    }
+}
+
+static void hci_dump_async_stop(void){
+    if (!async_writer_active) return;
+    __atomic_store_n(&async_stop, 1, __ATOMIC_RELEASE);
+    pthread_join(async_writer, NULL);
+    async_writer_active = 0;
+    dump_file = async_file;
+    if (async_dropped_records){
+        printf("hci_dump_close: %u records dropped\n", async_dropped_records);
+    }
+}
+#endif
+
 void hci_dump_open(const char *filename, hci_dump_format_t format){
 #ifdef HAVE_POSIX_FILE_IO
     dump_format = format;
+    dump_file_size = 0;
+#ifdef ENABLE_HCI_DUMP_DEFERRED_LOG
+    memset(deferred_log_formats, 0, sizeof(deferred_log_formats));
+    deferred_log_num_formats = 0;
+#endif
     if (dump_format == HCI_DUMP_STDOUT) {
         dump_file = fileno(stdout);
     } else {
-
-        int oflags = O_WRONLY | O_CREAT | O_TRUNC;
-#ifdef _WIN32
-        oflags |= O_BINARY;
-#endif
-
-        dump_file = open(filename, oflags, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH );
+        strncpy(dump_file_name, filename, sizeof(dump_file_name) - 1);
+        dump_file_name[sizeof(dump_file_name) - 1] = 0;
+        dump_file = hci_dump_open_file(filename);
         if (dump_file < 0){
             printf("hci_dump_open: failed to open file %s\n", filename);
         }
+#ifdef ENABLE_HCI_DUMP_ASYNC
+        else {
+            hci_dump_async_start();
+        }
+#endif
     }
 #else
     UNUSED(filename);
@@ -129,6 +382,11 @@ void hci_dump_open(const char *filename, hci_dump_format_t format){
 void hci_dump_set_max_packets(int packets){
     max_nr_packets = packets;
 }
+
+void hci_dump_set_max_file_size(uint32_t max_size, int max_files){
+    max_file_size = max_size;
+    max_nr_files  = max_files;
+}
 #endif
 
 static void printf_packet(uint8_t packet_type, uint8_t in, uint8_t * packet, uint16_t len){
@@ -176,59 +434,23 @@ static void printf_timestamp(void){
 }
 #endif
 
-void hci_dump_packet(uint8_t packet_type, uint8_t in, uint8_t *packet, uint16_t len) {
-
-    if (dump_file < 0) return; // not activated yet
-
 #ifdef HAVE_POSIX_FILE_IO
-
-    // don't grow bigger than max_nr_packets
-    if (dump_format != HCI_DUMP_STDOUT && max_nr_packets > 0){
-        if (nr_packets >= max_nr_packets){
-            lseek(dump_file, 0, SEEK_SET);
-            ftruncate(dump_file, 0);
-            nr_packets = 0;
-        }
-        nr_packets++;
-    }
-    
-    // get time
-    struct timeval curr_time;
-    struct tm* ptm;
-    gettimeofday(&curr_time, NULL);
-    time_t curr_time_secs = curr_time.tv_sec;
-
+// @returns header for file formats or NULL if packet type is not logged
+static uint8_t * hci_dump_setup_header(uint8_t packet_type, uint8_t in, uint16_t len, struct timeval * curr_time){
     switch (dump_format){
-        case HCI_DUMP_STDOUT: {
-            /* Obtain the time of day, and convert it to a tm struct. */
-            ptm = localtime (&curr_time_secs);
-            /* assert localtime was successful */
-            if (!ptm) break;
-            /* Format the date and time, down to a single second. */
-            strftime (time_string, sizeof (time_string), "[%Y-%m-%d %H:%M:%S", ptm);
-            /* Compute milliseconds from microseconds. */
-            uint16_t milliseconds = curr_time.tv_usec / 1000;
-            /* Print the formatted time, in seconds, followed by a decimal point and the milliseconds. */
-            printf ("%s.%03u] ", time_string, milliseconds);
-            printf_packet(packet_type, in, packet, len);
-            break;
-        }
-            
         case HCI_DUMP_BLUEZ:
             little_endian_store_16( header_bluez, 0, 1 + len);
             header_bluez[2] = in;
             header_bluez[3] = 0;
-            little_endian_store_32( header_bluez, 4, (uint32_t) curr_time.tv_sec);
-            little_endian_store_32( header_bluez, 8,            curr_time.tv_usec);
+            little_endian_store_32( header_bluez, 4, (uint32_t) curr_time->tv_sec);
+            little_endian_store_32( header_bluez, 8,            curr_time->tv_usec);
             header_bluez[12] = packet_type;
-            write (dump_file, header_bluez, HCIDUMP_HDR_SIZE);
-            write (dump_file, packet, len );
-            break;
+            return header_bluez;
             
         case HCI_DUMP_PACKETLOGGER:
             big_endian_store_32( header_packetlogger, 0, PKTLOG_HDR_SIZE - 4 + len);
-            big_endian_store_32( header_packetlogger, 4,  (uint32_t) curr_time.tv_sec);
-            big_endian_store_32( header_packetlogger, 8, curr_time.tv_usec);
+            big_endian_store_32( header_packetlogger, 4,  (uint32_t) curr_time->tv_sec);
+            big_endian_store_32( header_packetlogger, 8, curr_time->tv_usec);
             switch (packet_type){
                 case HCI_COMMAND_DATA_PACKET:
                     header_packetlogger[12] = 0x00;
@@ -253,16 +475,83 @@ void hci_dump_packet(uint8_t packet_type, uint8_t in, uint8_t *packet, uint16_t
                 case LOG_MESSAGE_PACKET:
                     header_packetlogger[12] = 0xfc;
                     break;
+#ifdef ENABLE_HCI_DUMP_DEFERRED_LOG
+                case HCI_DUMP_DEFERRED_LOG_PACKET:
+                    header_packetlogger[12] = HCI_DUMP_DEFERRED_LOG_PACKET;
+                    break;
+#endif
                 default:
-                    return;
+                    return NULL;
             }
-            write (dump_file, &header_packetlogger, PKTLOG_HDR_SIZE);
-            write (dump_file, packet, len );
-            break;
+            return header_packetlogger;
             
         default:
-            break;
+            return NULL;
+    }
+}
+#endif
+
+void hci_dump_packet(uint8_t packet_type, uint8_t in, uint8_t *packet, uint16_t len) {
+
+    if (dump_file < 0) return; // not activated yet
+
+#ifdef HAVE_POSIX_FILE_IO
+
+    // don't grow bigger than max_nr_packets
+    int truncate_file = 0;
+    if (dump_format != HCI_DUMP_STDOUT && max_nr_packets > 0){
+        if (nr_packets >= max_nr_packets){
+            truncate_file = 1;
+            nr_packets = 0;
+        }
+        nr_packets++;
+    }
+    
+    // get time
+    struct timeval curr_time;
+    struct tm* ptm;
+    gettimeofday(&curr_time, NULL);
+    time_t curr_time_secs = curr_time.tv_sec;
+
+    if (dump_format == HCI_DUMP_STDOUT){
+        /* Obtain the time of day, and convert it to a tm struct. */
+        ptm = localtime (&curr_time_secs);
+        /* assert localtime was successful */
+        if (!ptm) return;
+        /* Format the date and time, down to a single second. */
+        strftime (time_string, sizeof (time_string), "[%Y-%m-%d %H:%M:%S", ptm);
+        /* Compute milliseconds from microseconds. */
+        uint16_t milliseconds = curr_time.tv_usec / 1000;
+        /* Print the formatted time, in seconds, followed by a decimal point and the milliseconds. */
+        printf ("%s.%03u] ", time_string, milliseconds);
+        printf_packet(packet_type, in, packet, len);
+        return;
+    }
+
+    // BlueZ and PacketLogger headers have the same size
+    uint8_t * header = hci_dump_setup_header(packet_type, in, len, &curr_time);
+    if (!header) return;
+
+#ifdef ENABLE_HCI_DUMP_ASYNC
+    if (async_writer_active){
+        if (truncate_file){
+            __atomic_store_n(&async_truncate_pos, async_write_pos, __ATOMIC_RELEASE);
+            __atomic_add_fetch(&async_truncate_requests, 1, __ATOMIC_RELEASE);
+        }
+        if (!hci_dump_async_store(header, HCIDUMP_HDR_SIZE, packet, len)){
+            async_dropped_records++;
+        }
+        return;
+    }
+#endif
+
+    if (truncate_file){
+        hci_dump_truncate_file(dump_file);
     }
+    dump_file = hci_dump_rotate_file_if_needed(dump_file, HCIDUMP_HDR_SIZE + len);
+    write (dump_file, header, HCIDUMP_HDR_SIZE);
+    write (dump_file, packet, len );
+    dump_file_size += HCIDUMP_HDR_SIZE + len;
 #else
 
     printf_timestamp();
@@ -277,9 +566,167 @@ static int hci_dump_log_level_active(int log_level){
     return log_level_enabled[log_level];
 }
 
+#ifdef ENABLE_HCI_DUMP_DEFERRED_LOG
+// @returns format id or -1 if table is full or format string too long
+static int hci_dump_deferred_log_format_id(const char * format){
+    uint32_t hash = (uint32_t) (((uintptr_t) format) >> 2) * 2654435761u;
+    int i = hash & (HCI_DUMP_DEFERRED_LOG_MAX_FORMATS - 1);
+    while (deferred_log_formats[i]){
+        if (deferred_log_formats[i] == format) return i;
+        i = (i + 1) & (HCI_DUMP_DEFERRED_LOG_MAX_FORMATS - 1);
+    }
+    // keep table sparse
+    if (deferred_log_num_formats >= HCI_DUMP_DEFERRED_LOG_MAX_FORMATS * 3 / 4) return -1;
+    if (strlen(format) > sizeof(deferred_log_buffer) - 3) return -1;
+    __atomic_store_n(&deferred_log_formats[i], format, __ATOMIC_RELEASE);
+    deferred_log_num_formats++;
+    int len = hci_dump_deferred_log_setup_format(deferred_log_buffer, i, format);
+    hci_dump_packet(HCI_DUMP_DEFERRED_LOG_PACKET, 0, deferred_log_buffer, len);
+    return i;
+}
+
+static int hci_dump_deferred_log_store_64(int pos, uint64_t value){
+    if (pos + 8 > (int) sizeof(deferred_log_buffer)) return -1;
+    little_endian_store_32(deferred_log_buffer, pos,     (uint32_t) value);
+    little_endian_store_32(deferred_log_buffer, pos + 4, (uint32_t) (value >> 32));
+    return pos + 8;
+}
+
+static int hci_dump_deferred_log_store_32(int pos, uint32_t value){
+    if (pos + 4 > (int) sizeof(deferred_log_buffer)) return -1;
+    little_endian_store_32(deferred_log_buffer, pos, value);
+    return pos + 4;
+}
+
+static int hci_dump_deferred_log_store_string(int pos, const char * string){
+    if (!string) {
+        string = "(null)";
+    }
+    int len = strlen(string);
+    if (len > DEFERRED_LOG_MAX_STRING_LEN){
+        len = DEFERRED_LOG_MAX_STRING_LEN;
+    }
+    if (pos + 1 + len > (int) sizeof(deferred_log_buffer)) return -1;
+    deferred_log_buffer[pos] = len;
+    memcpy(&deferred_log_buffer[pos+1], string, len);
+    return pos + 1 + len;
+}
+
+// store raw arguments: int as 32 bit, long/size_t/pointers/double as 64 bit, strings with 8 bit length
+// @returns size of record or 0 if conversion is not supported or arguments do not fit
+static int hci_dump_deferred_log_encode(uint16_t format_id, const char * format, va_list argptr){
+    int pos = 0;
+    deferred_log_buffer[pos++] = DEFERRED_LOG_MESSAGE;
+    little_endian_store_16(deferred_log_buffer, pos, format_id);
+    pos += 2;
+    while (*format){
+        if (*format++ != '%') continue;
+        // flags, width and precision
+        while (1){
+            char c = *format;
+            if (c == '*'){
+                pos = hci_dump_deferred_log_store_32(pos, (uint32_t) va_arg(argptr, int));
+                if (pos < 0) return 0;
+            } else if ((c < '0' || c > '9') && c != '.' && c != '-' && c != '+' && c != ' ' && c != '#'){
+                break;
+            }
+            format++;
+        }
+        // length modifier, 'q' for 'll'
+        char length = 0;
+        while (1){
+            char c = *format;
+            if (c == 'l' && length == 'l'){
+                length = 'q';
+            } else if (c == 'l' || c == 'z' || c == 'j' || c == 't'){
+                length = c;
+            } else if (c != 'h'){
+                break;
+            }
+            format++;
+        }
+        char conversion = *format;
+        if (!conversion) break;
+        format++;
+        uint64_t value;
+        switch (conversion){
+            case '%':
+                continue;
+            case 'd':
+            case 'i':
+            case 'u':
+            case 'x':
+            case 'X':
+            case 'o':
+            case 'c':
+                switch (length){
+                    case 0:
+                        pos = hci_dump_deferred_log_store_32(pos, (uint32_t) va_arg(argptr, int));
+                        break;
+                    case 'l':
+                        pos = hci_dump_deferred_log_store_64(pos, (uint64_t) va_arg(argptr, long));
+                        break;
+                    case 'q':
+                        pos = hci_dump_deferred_log_store_64(pos, (uint64_t) va_arg(argptr, long long));
+                        break;
+                    case 'z':
+                        pos = hci_dump_deferred_log_store_64(pos, (uint64_t) va_arg(argptr, size_t));
+                        break;
+                    case 'j':
+                        pos = hci_dump_deferred_log_store_64(pos, (uint64_t) va_arg(argptr, intmax_t));
+                        break;
+                    default:
+                        pos = hci_dump_deferred_log_store_64(pos, (uint64_t) va_arg(argptr, ptrdiff_t));
+                        break;
+                }
+                break;
+            case 'p':
+                pos = hci_dump_deferred_log_store_64(pos, (uint64_t) (uintptr_t) va_arg(argptr, void *));
+                break;
+            case 's':
+                pos = hci_dump_deferred_log_store_string(pos, va_arg(argptr, const char *));
+                break;
+            case 'e':
+            case 'E':
+            case 'f':
+            case 'F':
+            case 'g':
+            case 'G': {
+                double double_value = va_arg(argptr, double);
+                memcpy(&value, &double_value, sizeof(value));
+                pos = hci_dump_deferred_log_store_64(pos, value);
+                break;
+            }
+            default:
+                return 0;
+        }
+        if (pos < 0) return 0;
+    }
+    return pos;
+}
+
+// @returns 1 if message was logged as deferred log record
+static int hci_dump_deferred_log(const char * format, va_list argptr){
+    if (dump_format != HCI_DUMP_PACKETLOGGER) return 0;
+    if (dump_file < 0) return 0;
+    int format_id = hci_dump_deferred_log_format_id(format);
+    if (format_id < 0) return 0;
+    va_list args;
+    va_copy(args, argptr);
+    int len = hci_dump_deferred_log_encode(format_id, format, args);
+    va_end(args);
+    if (len == 0) return 0;
+    hci_dump_packet(HCI_DUMP_DEFERRED_LOG_PACKET, 0, deferred_log_buffer, len);
+    return 1;
+}
+#endif
+
 void hci_dump_log_va_arg(int log_level, const char * format, va_list argptr){
     if (hci_dump_log_level_active(log_level)) {
 #ifdef HAVE_POSIX_FILE_IO
+#ifdef ENABLE_HCI_DUMP_DEFERRED_LOG
+        if (hci_dump_deferred_log(format, argptr)) return;
+#endif
         int len = vsnprintf(log_message_buffer, sizeof(log_message_buffer), format, argptr);
         hci_dump_packet(LOG_MESSAGE_PACKET, 0, (uint8_t*) log_message_buffer, len);
 #else
@@ -311,6 +758,9 @@ void hci_dump_log_P(int log_level, PGM_P format, ...){
 #endif
 
 void hci_dump_close(void){
+#ifdef ENABLE_HCI_DUMP_ASYNC
+    hci_dump_async_stop();
+#endif
 #ifdef HAVE_POSIX_FILE_IO
     close(dump_file);
 #endif
@@ -79,6 +79,15 @@ void hci_dump_open(const char *filename, hci_dump_format_t format);
  */
 void hci_dump_set_max_packets(int packets); // -1 for unlimited
 
+/*
+ * @brief Rotate dump file when it would grow beyond max_size bytes: filename is renamed to filename.1,
+ *        filename.1 to filename.2, ... up to max_files - 1 old files. With ENABLE_HCI_DUMP_ASYNC, a file
+ *        can exceed max_size by up to one flush. 
+ * @param max_size in bytes, 0 for unlimited
+ * @param max_files including current file
+ */
+void hci_dump_set_max_file_size(uint32_t max_size, int max_files);
+
 /*
  * @brief 
  */
@@ -154,6 +154,15 @@ const hci_transport_t * hci_transport_usb_instance(void);
  */
 void hci_transport_usb_set_path(int len, uint8_t * port_numbers);
 
+/**
+ * @brief Set number of USB transfers for HCI Events and ACL Data In, SCO Data In and ACL Data Out. Call before power on
+ * @note With more than one ACL Data Out transfer, outgoing packets are copied to allow for several packets in flight
+ * @param async_buffers for HCI Events and ACL Data In (default 3)
+ * @param isoc_buffers for SCO Data In (default 10)
+ * @param acl_out_buffers for ACL Data Out (default 3)
+ */
+void hci_transport_usb_set_num_buffers(int async_buffers, int isoc_buffers, int acl_out_buffers);
+
 /* API_END */
     
 #if defined __cplusplus
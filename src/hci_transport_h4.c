@@ -46,6 +46,7 @@
 #include "btstack_config.h"
 
 #include "btstack_debug.h"
+#include "btstack_instrumentation.h"
 #include "hci.h"
 #include "hci_transport.h"
 #include "btstack_uart_block.h"
@@ -103,6 +104,9 @@ typedef enum {
     H4_W4_ACL_HEADER,
     H4_W4_SCO_HEADER,
     H4_W4_PAYLOAD,
+#ifdef ENABLE_ACL_REASSEMBLY_POOL
+    H4_W4_ACL_PAYLOAD_IN_PLACE,
+#endif
 } H4_STATE;
 
 typedef enum {
@@ -137,6 +141,11 @@ static int read_pos;
 static uint8_t hci_packet_with_pre_buffer[HCI_INCOMING_PRE_BUFFER_SIZE + 1 + HCI_PACKET_BUFFER_SIZE]; // packet type + max(acl header + acl payload, event header + event data)
 static uint8_t * hci_packet = &hci_packet_with_pre_buffer[HCI_INCOMING_PRE_BUFFER_SIZE];
 
+#ifdef ENABLE_ACL_REASSEMBLY_POOL
+// ACL continuation fragment received directly into HCI reassembly buffer
+static uint8_t * acl_fragment_buffer;
+#endif
+
 static int hci_transport_h4_set_baudrate(uint32_t baudrate){
     log_info("hci_transport_h4_set_baudrate %u", baudrate);
     return btstack_uart->set_baudrate(baudrate);
@@ -150,6 +159,12 @@ static void hci_transport_h4_reset_statemachine(void){
 
 static void hci_transport_h4_trigger_next_read(void){
     // log_info("hci_transport_h4_trigger_next_read: %u bytes", bytes_to_read);
+#ifdef ENABLE_ACL_REASSEMBLY_POOL
+    if (h4_state == H4_W4_ACL_PAYLOAD_IN_PLACE){
+        btstack_uart->receive_block(&acl_fragment_buffer[HCI_ACL_HEADER_SIZE], bytes_to_read);
+        return;
+    }
+#endif
     btstack_uart->receive_block(&hci_packet[read_pos], bytes_to_read);  
 }
 
@@ -202,6 +217,14 @@ static void hci_transport_h4_block_read(void){
                 break;              
             }
             h4_state = H4_W4_PAYLOAD;
+#ifdef ENABLE_ACL_REASSEMBLY_POOL
+            // read payload of continuation fragment directly into reassembly buffer
+            acl_fragment_buffer = hci_acl_reassembly_buffer_for_fragment(&hci_packet[1]);
+            if (acl_fragment_buffer){
+                memcpy(acl_fragment_buffer, &hci_packet[1], HCI_ACL_HEADER_SIZE);
+                h4_state = H4_W4_ACL_PAYLOAD_IN_PLACE;
+            }
+#endif
             break;
             
         case H4_W4_SCO_HEADER:
@@ -210,9 +233,19 @@ static void hci_transport_h4_block_read(void){
             break;
 
         case H4_W4_PAYLOAD:
+            BTSTACK_INSTRUMENTATION_ENTER(BTSTACK_INSTRUMENTATION_LAYER_TRANSPORT, BTSTACK_INSTRUMENTATION_NO_CON_HANDLE, hci_packet[0], read_pos-1);
             packet_handler(hci_packet[0], &hci_packet[1], read_pos-1);
+            BTSTACK_INSTRUMENTATION_EXIT();
             hci_transport_h4_reset_statemachine();
             break;
+#ifdef ENABLE_ACL_REASSEMBLY_POOL
+        case H4_W4_ACL_PAYLOAD_IN_PLACE:
+            BTSTACK_INSTRUMENTATION_ENTER(BTSTACK_INSTRUMENTATION_LAYER_TRANSPORT, BTSTACK_INSTRUMENTATION_NO_CON_HANDLE, HCI_ACL_DATA_PACKET, read_pos-1);
+            packet_handler(HCI_ACL_DATA_PACKET, acl_fragment_buffer, read_pos-1);
+            BTSTACK_INSTRUMENTATION_EXIT();
+            hci_transport_h4_reset_statemachine();
+            break;
+#endif
         default:
             break;
     }
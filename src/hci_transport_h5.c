@@ -46,6 +46,7 @@
 #include "hci.h"
 #include "btstack_slip.h"
 #include "btstack_debug.h"
+#include "btstack_instrumentation.h"
 #include "hci_transport.h"
 #include "btstack_uart_block.h"
 
@@ -69,10 +70,23 @@ typedef enum {
 
 } hci_transport_link_actions_t;
 
-// Configuration Field. No packet buffers -> sliding window = 1, no OOF flow control, no data integrity check
-#define LINK_CONFIG_SLIDING_WINDOW_SIZE 1
+// Sliding window size 1..7. For window size > 1, outgoing packets are copied into the retransmit queue
+// Default 1 (stop-and-wait) does not require additional packet buffers
+#ifndef HCI_TRANSPORT_H5_SLIDING_WINDOW_SIZE
+#define HCI_TRANSPORT_H5_SLIDING_WINDOW_SIZE 1
+#endif
+#if (HCI_TRANSPORT_H5_SLIDING_WINDOW_SIZE < 1) || (HCI_TRANSPORT_H5_SLIDING_WINDOW_SIZE > 7)
+#error "HCI_TRANSPORT_H5_SLIDING_WINDOW_SIZE must be in range 1..7"
+#endif
+
+// Configuration Field. No OOF flow control, CRC16 data integrity check if ENABLE_H5_DATA_INTEGRITY_CHECK
+#define LINK_CONFIG_SLIDING_WINDOW_SIZE HCI_TRANSPORT_H5_SLIDING_WINDOW_SIZE
 #define LINK_CONFIG_OOF_FLOW_CONTROL 0
+#ifdef ENABLE_H5_DATA_INTEGRITY_CHECK
+#define LINK_CONFIG_DATA_INTEGRITY_CHECK 1
+#else
 #define LINK_CONFIG_DATA_INTEGRITY_CHECK 0
+#endif
 #define LINK_CONFIG_VERSION_NR 0
 #define LINK_CONFIG_FIELD (LINK_CONFIG_SLIDING_WINDOW_SIZE | (LINK_CONFIG_OOF_FLOW_CONTROL << 3) | (LINK_CONFIG_DATA_INTEGRITY_CHECK << 4) | (LINK_CONFIG_VERSION_NR << 5))
 
@@ -89,6 +103,9 @@ typedef enum {
 // max size of write requests
 #define LINK_SLIP_TX_CHUNK_LEN 64
 
+// max size of read requests, if UART driver supports receive_available
+#define LINK_SLIP_RX_CHUNK_LEN 128
+
 // ---
 static const uint8_t link_control_sync[] =   { 0x01, 0x7e};
 static const uint8_t link_control_sync_response[] = { 0x02, 0x7d};
@@ -106,6 +123,9 @@ static uint8_t   hci_packet_with_pre_buffer[HCI_INCOMING_PRE_BUFFER_SIZE + 6 + H
 // outgoing slip encoded buffer. +1 to assert that last SOF fits in buffer
 static uint8_t slip_outgoing_buffer[LINK_SLIP_TX_CHUNK_LEN+1];
 static int     slip_write_active;
+// data integrity check is encoded after packet
+static uint8_t slip_outgoing_dic[2];
+static int     slip_outgoing_dic_pending;
 
 // H5 Link State
 static hci_transport_link_state_t link_state;
@@ -114,15 +134,33 @@ static uint8_t  link_seq_nr;
 static uint8_t  link_ack_nr;
 static uint16_t link_resend_timeout_ms;
 static uint8_t  link_peer_asleep;
+// negotiated during config
+static uint8_t  link_window_size;
+static uint8_t  link_data_integrity_check;
 
 // auto sleep-mode
 static btstack_timer_source_t inactivity_timer;
 static uint16_t link_inactivity_timeout_ms; // auto-sleep if set
 
-// Outgoing packet
-static uint8_t   hci_packet_type;
-static uint16_t  hci_packet_size;
-static uint8_t * hci_packet;
+// Retransmit queue of reliable packets. link_seq_nr is the sequence number of the oldest unacknowledged packet
+typedef struct {
+    uint8_t   packet_type;
+    uint16_t  size;
+    uint8_t * packet;
+} hci_transport_link_queue_entry_t;
+
+static hci_transport_link_queue_entry_t link_queue[HCI_TRANSPORT_H5_SLIDING_WINDOW_SIZE];
+#if HCI_TRANSPORT_H5_SLIDING_WINDOW_SIZE > 1
+static uint8_t link_queue_storage[HCI_TRANSPORT_H5_SLIDING_WINDOW_SIZE][HCI_PACKET_BUFFER_SIZE];
+#endif
+static uint8_t link_queue_head;
+static uint8_t link_queue_count;
+// number of queued packets to skip when sending, reset to 0 for retransmission
+static uint8_t link_queue_sent;
+// number of queued packets that have been sent at least once
+static uint8_t link_queue_transmitted;
+// HCI_EVENT_TRANSPORT_PACKET_SENT has to be emitted when space in queue is available
+static uint8_t link_packet_sent_event_pending;
 
 // hci packet handler
 static  void (*packet_handler)(uint8_t packet_type, uint8_t *packet, uint16_t size);
@@ -163,15 +201,83 @@ static void hci_transport_inactivity_timer_set(void){
     btstack_run_loop_add_timer(&inactivity_timer);
 }
 
+// -----------------------------
+// CRC-CCITT for data integrity check, LSB first, as used by BCSP
+
+static const uint16_t crc16_ccitt_table[256] = {
+    0x0000, 0x1189, 0x2312, 0x329b, 0x4624, 0x57ad, 0x6536, 0x74bf,
+    0x8c48, 0x9dc1, 0xaf5a, 0xbed3, 0xca6c, 0xdbe5, 0xe97e, 0xf8f7,
+    0x1081, 0x0108, 0x3393, 0x221a, 0x56a5, 0x472c, 0x75b7, 0x643e,
+    0x9cc9, 0x8d40, 0xbfdb, 0xae52, 0xdaed, 0xcb64, 0xf9ff, 0xe876,
+    0x2102, 0x308b, 0x0210, 0x1399, 0x6726, 0x76af, 0x4434, 0x55bd,
+    0xad4a, 0xbcc3, 0x8e58, 0x9fd1, 0xeb6e, 0xfae7, 0xc87c, 0xd9f5,
+    0x3183, 0x200a, 0x1291, 0x0318, 0x77a7, 0x662e, 0x54b5, 0x453c,
+    0xbdcb, 0xac42, 0x9ed9, 0x8f50, 0xfbef, 0xea66, 0xd8fd, 0xc974,
+    0x4204, 0x538d, 0x6116, 0x709f, 0x0420, 0x15a9, 0x2732, 0x36bb,
+    0xce4c, 0xdfc5, 0xed5e, 0xfcd7, 0x8868, 0x99e1, 0xab7a, 0xbaf3,
+    0x5285, 0x430c, 0x7197, 0x601e, 0x14a1, 0x0528, 0x37b3, 0x263a,
+    0xdecd, 0xcf44, 0xfddf, 0xec56, 0x98e9, 0x8960, 0xbbfb, 0xaa72,
+    0x6306, 0x728f, 0x4014, 0x519d, 0x2522, 0x34ab, 0x0630, 0x17b9,
+    0xef4e, 0xfec7, 0xcc5c, 0xddd5, 0xa96a, 0xb8e3, 0x8a78, 0x9bf1,
+    0x7387, 0x620e, 0x5095, 0x411c, 0x35a3, 0x242a, 0x16b1, 0x0738,
+    0xffcf, 0xee46, 0xdcdd, 0xcd54, 0xb9eb, 0xa862, 0x9af9, 0x8b70,
+    0x8408, 0x9581, 0xa71a, 0xb693, 0xc22c, 0xd3a5, 0xe13e, 0xf0b7,
+    0x0840, 0x19c9, 0x2b52, 0x3adb, 0x4e64, 0x5fed, 0x6d76, 0x7cff,
+    0x9489, 0x8500, 0xb79b, 0xa612, 0xd2ad, 0xc324, 0xf1bf, 0xe036,
+    0x18c1, 0x0948, 0x3bd3, 0x2a5a, 0x5ee5, 0x4f6c, 0x7df7, 0x6c7e,
+    0xa50a, 0xb483, 0x8618, 0x9791, 0xe32e, 0xf2a7, 0xc03c, 0xd1b5,
+    0x2942, 0x38cb, 0x0a50, 0x1bd9, 0x6f66, 0x7eef, 0x4c74, 0x5dfd,
+    0xb58b, 0xa402, 0x9699, 0x8710, 0xf3af, 0xe226, 0xd0bd, 0xc134,
+    0x39c3, 0x284a, 0x1ad1, 0x0b58, 0x7fe7, 0x6e6e, 0x5cf5, 0x4d7c,
+    0xc60c, 0xd785, 0xe51e, 0xf497, 0x8028, 0x91a1, 0xa33a, 0xb2b3,
+    0x4a44, 0x5bcd, 0x6956, 0x78df, 0x0c60, 0x1de9, 0x2f72, 0x3efb,
+    0xd68d, 0xc704, 0xf59f, 0xe416, 0x90a9, 0x8120, 0xb3bb, 0xa232,
+    0x5ac5, 0x4b4c, 0x79d7, 0x685e, 0x1ce1, 0x0d68, 0x3ff3, 0x2e7a,
+    0xe70e, 0xf687, 0xc41c, 0xd595, 0xa12a, 0xb0a3, 0x8238, 0x93b1,
+    0x6b46, 0x7acf, 0x4854, 0x59dd, 0x2d62, 0x3ceb, 0x0e70, 0x1ff9,
+    0xf78f, 0xe606, 0xd49d, 0xc514, 0xb1ab, 0xa022, 0x92b9, 0x8330,
+    0x7bc7, 0x6a4e, 0x58d5, 0x495c, 0x3de3, 0x2c6a, 0x1ef1, 0x0f78,
+};
+
+static uint16_t hci_transport_link_crc16_update(uint16_t crc, const uint8_t * data, uint16_t len){
+    while (len--){
+        crc = (crc >> 8) ^ crc16_ccitt_table[(crc ^ *data++) & 0xff];
+    }
+    return crc;
+}
+
+// CRC is transmitted bit reversed, MSB first
+static uint16_t hci_transport_link_calc_dic(const uint8_t * header, const uint8_t * payload, uint16_t payload_len){
+    uint16_t crc = hci_transport_link_crc16_update(0xffff, header, 4);
+    crc = hci_transport_link_crc16_update(crc, payload, payload_len);
+    uint16_t reversed = 0;
+    int i;
+    for (i = 0; i < 16; i++){
+        reversed = (reversed << 1) | (crc & 1);
+        crc >>= 1;
+    }
+    return reversed;
+}
+
 // -----------------------------
 // SLIP Outgoing
 
 // Fill chunk and write
+static int hci_transport_slip_has_data(void){
+    return btstack_slip_encoder_has_data() || slip_outgoing_dic_pending;
+}
+
 static void hci_transport_slip_encode_chunk_and_send(int pos){
-    while (btstack_slip_encoder_has_data() & (pos < LINK_SLIP_TX_CHUNK_LEN)) {
+    while (pos < LINK_SLIP_TX_CHUNK_LEN) {
+        if (!btstack_slip_encoder_has_data()){
+            if (!slip_outgoing_dic_pending) break;
+            // append data integrity check after packet
+            slip_outgoing_dic_pending = 0;
+            btstack_slip_encoder_start(slip_outgoing_dic, 2);
+        }
         slip_outgoing_buffer[pos++] = btstack_slip_encoder_get_byte();
     }
-    if (!btstack_slip_encoder_has_data()){
+    if (!hci_transport_slip_has_data()){
         // Start of Frame
         slip_outgoing_buffer[pos++] = BTSTACK_SLIP_SOF;
     }
@@ -202,6 +308,14 @@ static void hci_transport_slip_send_frame(const uint8_t * header, const uint8_t
     // Packet
     btstack_slip_encoder_start(packet, packet_size);
 
+    // Data Integrity Check
+    slip_outgoing_dic_pending = (header[0] & 0x40) != 0;
+    if (slip_outgoing_dic_pending){
+        uint16_t dic = hci_transport_link_calc_dic(header, packet, packet_size);
+        slip_outgoing_dic[0] = dic >> 8;
+        slip_outgoing_dic[1] = dic & 0xff;
+    }
+
     // Fill rest of chunk from packet and send
     hci_transport_slip_encode_chunk_and_send(pos);
 }
@@ -222,12 +336,6 @@ static void hci_transport_link_calc_header(uint8_t * header,
     uint8_t  packet_type,
     uint16_t payload_length){
 
-    // reset data integrity flag
-    if (data_integrity_check_present){
-        log_error("hci_transport_link_calc_header: data integrity not supported, dropping flag");
-        data_integrity_check_present = 0;
-    }
-
     header[0] = sequence_nr | (acknowledgement_nr << 3) | (data_integrity_check_present << 6) | (reliable_packet << 7);
     header[1] = packet_type | ((payload_length & 0x0f) << 4);
     header[2] = payload_length >> 4;
@@ -275,13 +383,21 @@ static void hci_transport_link_send_sleep(void){
     hci_transport_link_send_control(link_control_sleep, sizeof(link_control_sleep));
 }
 
+// send next queued packet that hasn't been sent yet
 static void hci_transport_link_send_queued_packet(void){
-    log_info("hci_transport_link_send_queued_packet: seq %u, ack %u, size %u", link_seq_nr, link_ack_nr, hci_packet_size);
-    log_info_hexdump(hci_packet, hci_packet_size);
+    hci_transport_link_queue_entry_t * entry = &link_queue[(link_queue_head + link_queue_sent) % HCI_TRANSPORT_H5_SLIDING_WINDOW_SIZE];
+    uint8_t seq_nr = (link_seq_nr + link_queue_sent) & 0x07;
+    link_queue_sent++;
+    if (link_queue_sent > link_queue_transmitted){
+        link_queue_transmitted = link_queue_sent;
+    }
+
+    log_info("hci_transport_link_send_queued_packet: seq %u, ack %u, size %u", seq_nr, link_ack_nr, entry->size);
+    log_info_hexdump(entry->packet, entry->size);
 
     uint8_t header[4];
-    hci_transport_link_calc_header(header, link_seq_nr, link_ack_nr, 0, 1, hci_packet_type, hci_packet_size);
-    hci_transport_slip_send_frame(header, hci_packet, hci_packet_size);
+    hci_transport_link_calc_header(header, seq_nr, link_ack_nr, link_data_integrity_check, 1, entry->packet_type, entry->size);
+    hci_transport_slip_send_frame(header, entry->packet, entry->size);
 
     // reset inactvitiy timer
     hci_transport_inactivity_timer_set();
@@ -330,11 +446,18 @@ static void hci_transport_link_run(void){
         return;
     }
     if (hci_transport_link_actions & HCI_TRANSPORT_LINK_SEND_QUEUED_PACKET){
-        hci_transport_link_actions &= ~HCI_TRANSPORT_LINK_SEND_QUEUED_PACKET;
-        // packet already contains ack, no need to send addtitional one
-        hci_transport_link_actions &= ~HCI_TRANSPORT_LINK_SEND_ACK_PACKET;
-        hci_transport_link_send_queued_packet();
-        return;
+        if (link_queue_sent >= link_queue_count){
+            hci_transport_link_actions &= ~HCI_TRANSPORT_LINK_SEND_QUEUED_PACKET;
+        } else if (!link_peer_asleep){
+            // packet already contains ack, no need to send addtitional one
+            hci_transport_link_actions &= ~HCI_TRANSPORT_LINK_SEND_ACK_PACKET;
+            hci_transport_link_send_queued_packet();
+            // keep action if more packets are ready to send
+            if (link_queue_sent >= link_queue_count){
+                hci_transport_link_actions &= ~HCI_TRANSPORT_LINK_SEND_QUEUED_PACKET;
+            }
+            return;
+        }
     }
     if (hci_transport_link_actions & HCI_TRANSPORT_LINK_SEND_ACK_PACKET){
         hci_transport_link_actions &= ~HCI_TRANSPORT_LINK_SEND_ACK_PACKET;
@@ -376,7 +499,8 @@ static void hci_transport_link_timeout_handler(btstack_timer_source_t * timer){
                 hci_transport_link_set_timer(LINK_WAKEUP_MS);
                 return;
             }
-            // resend packet
+            // resend all unacknowledged packets
+            link_queue_sent = 0;
             hci_transport_link_actions |= HCI_TRANSPORT_LINK_SEND_QUEUED_PACKET;
             hci_transport_link_set_timer(link_resend_timeout_ms);
             break;
@@ -390,6 +514,8 @@ static void hci_transport_link_timeout_handler(btstack_timer_source_t * timer){
 static void hci_transport_link_init(void){
     link_state = LINK_UNINITIALIZED;
     link_peer_asleep = 0;
+    link_window_size = 1;
+    link_data_integrity_check = 0;
  
     // get started
     hci_transport_link_actions |= HCI_TRANSPORT_LINK_SEND_SYNC;
@@ -402,18 +528,65 @@ static int hci_transport_link_inc_seq_nr(int seq_nr){
 }
 
 static int hci_transport_link_have_outgoing_packet(void){
-    return hci_packet != 0;
+    return link_queue_count > 0;
 }
 
 static void hci_transport_link_clear_queue(void){
     btstack_run_loop_remove_timer(&link_timer);
-    hci_packet = NULL;
+    link_queue_head  = 0;
+    link_queue_count = 0;
+    link_queue_sent  = 0;
+    link_queue_transmitted = 0;
+    link_packet_sent_event_pending = 0;
 }
 
 static void hci_transport_h5_queue_packet(uint8_t packet_type, uint8_t *packet, int size){
-    hci_packet = packet;
-    hci_packet_type = packet_type;
-    hci_packet_size = size;
+    hci_transport_link_queue_entry_t * entry = &link_queue[(link_queue_head + link_queue_count) % HCI_TRANSPORT_H5_SLIDING_WINDOW_SIZE];
+#if HCI_TRANSPORT_H5_SLIDING_WINDOW_SIZE > 1
+    // copy packet, HCI can re-use its buffer after HCI_EVENT_TRANSPORT_PACKET_SENT
+    uint8_t * storage = link_queue_storage[(link_queue_head + link_queue_count) % HCI_TRANSPORT_H5_SLIDING_WINDOW_SIZE];
+    memcpy(storage, packet, size);
+    packet = storage;
+#endif
+    entry->packet_type = packet_type;
+    entry->packet = packet;
+    entry->size = size;
+    link_queue_count++;
+    link_packet_sent_event_pending = 1;
+}
+
+// notify upper stack that it can send again. not called from send_packet to avoid re-entering HCI
+static void hci_transport_link_emit_packet_sent_if_ready(void){
+    if (!link_packet_sent_event_pending) return;
+    if (link_queue_count >= link_window_size) return;
+    link_packet_sent_event_pending = 0;
+    uint8_t event[] = { HCI_EVENT_TRANSPORT_PACKET_SENT, 0};
+    packet_handler(HCI_EVENT_PACKET, &event[0], sizeof(event));
+}
+
+// remove acknowledged packets from retransmit queue. ack_nr is the next sequence number expected by the peer
+static void hci_transport_link_process_ack(uint8_t ack_nr){
+    uint8_t num_acked = (ack_nr - link_seq_nr) & 0x07;
+    if (num_acked == 0) return;
+    if (num_acked > link_queue_transmitted){
+        log_info("h5: ack %u for packets not sent yet, seq nr %u, sent %u", ack_nr, link_seq_nr, link_queue_transmitted);
+        return;
+    }
+    log_info("h5: %u outgoing packet(s) up to seq %u ack'ed", num_acked, (ack_nr - 1) & 0x07);
+    link_seq_nr      = ack_nr;
+    link_queue_head  = (link_queue_head + num_acked) % HCI_TRANSPORT_H5_SLIDING_WINDOW_SIZE;
+    link_queue_count -= num_acked;
+    link_queue_transmitted -= num_acked;
+    // packets acked while being retransmitted
+    link_queue_sent  = (link_queue_sent > num_acked) ? (link_queue_sent - num_acked) : 0;
+
+    // restart resend timer for oldest unacknowledged packet
+    btstack_run_loop_remove_timer(&link_timer);
+    if (link_queue_count){
+        hci_transport_link_set_timer(link_resend_timeout_ms);
+    }
+
+    hci_transport_link_emit_packet_sent_if_ready();
 }
 
 static void hci_transport_h5_process_frame(uint16_t frame_size){
@@ -459,7 +632,15 @@ static void hci_transport_h5_process_frame(uint16_t frame_size){
         return;
     }
 
-    // (TODO data integrity check)
+    // validate data integrity check
+    if (data_integrity_check_present){
+        uint16_t dic = hci_transport_link_calc_dic(slip_header, slip_payload, link_payload_len);
+        uint16_t received_dic = (slip_payload[link_payload_len] << 8) | slip_payload[link_payload_len + 1];
+        if (dic != received_dic){
+            log_info("h5: data integrity check 0x%04x (instead of 0x%04x)", received_dic, dic);
+            return;
+        }
+    }
 
     switch (link_state){
         case LINK_UNINITIALIZED:
@@ -489,13 +670,24 @@ static void hci_transport_h5_process_frame(uint16_t frame_size){
                 hci_transport_link_actions |= HCI_TRANSPORT_LINK_SEND_CONFIG_RESPONSE;
             }
             if (memcmp(slip_payload, link_control_config_response, link_control_config_response_prefix_len) == 0){
-                log_info("link: received config response");
+                // use window size and data integrity check as confirmed by controller, but not more than supported
+                uint8_t config_field = 0;
+                if (link_payload_len > link_control_config_response_prefix_len){
+                    config_field = slip_payload[link_control_config_response_prefix_len];
+                }
+                link_window_size = config_field & 0x07;
+                if (link_window_size == 0 || link_window_size > LINK_CONFIG_SLIDING_WINDOW_SIZE){
+                    link_window_size = link_window_size ? LINK_CONFIG_SLIDING_WINDOW_SIZE : 1;
+                }
+                link_data_integrity_check = LINK_CONFIG_DATA_INTEGRITY_CHECK && ((config_field >> 4) & 1);
+                log_info("link: received config response, window size %u, data integrity check %u", link_window_size, link_data_integrity_check);
                 link_state = LINK_ACTIVE;
                 btstack_run_loop_remove_timer(&link_timer);
                 log_info("link activated");
                 // 
                 link_seq_nr = 0;
                 link_ack_nr = 0;
+                hci_transport_link_clear_queue();
                 // notify upper stack that it can start
                 uint8_t event[] = { HCI_EVENT_TRANSPORT_PACKET_SENT, 0};
                 packet_handler(HCI_EVENT_PACKET, &event[0], sizeof(event));
@@ -517,22 +709,12 @@ static void hci_transport_h5_process_frame(uint16_t frame_size){
           
             // Process ACKs in reliable packet and explicit ack packets
             if (reliable_packet || link_packet_type == LINK_ACKNOWLEDGEMENT_TYPE){
-                // our packet is good if the remote expects our seq nr + 1
-                int next_seq_nr = hci_transport_link_inc_seq_nr(link_seq_nr);
-                if (hci_transport_link_have_outgoing_packet() && next_seq_nr == ack_nr){
-                    log_info("h5: outoing packet with seq %u ack'ed", link_seq_nr);
-                    link_seq_nr = next_seq_nr;
-                    hci_transport_link_clear_queue();
-
-                    // notify upper stack that it can send again
-                    uint8_t event[] = { HCI_EVENT_TRANSPORT_PACKET_SENT, 0};
-                    packet_handler(HCI_EVENT_PACKET, &event[0], sizeof(event));
-                }
+                hci_transport_link_process_ack(ack_nr);
             } 
 
             switch (link_packet_type){
                 case LINK_CONTROL_PACKET_TYPE:
-                    if (memcmp(slip_payload, link_control_config, sizeof(link_control_config)) == 0){
+                    if (memcmp(slip_payload, link_control_config, link_control_config_prefix_len) == 0){
                         log_info("link: received config");
                         hci_transport_link_actions |= HCI_TRANSPORT_LINK_SEND_CONFIG_RESPONSE;
                         break;
@@ -561,7 +743,11 @@ static void hci_transport_h5_process_frame(uint16_t frame_size){
                     if (memcmp(slip_payload, link_control_woken, sizeof(link_control_woken)) == 0){
                         log_info("link: received woken message");
                         link_peer_asleep = 0;
-                        // queued packet will be sent in hci_transport_link_run if needed
+                        // queued packets will be sent in hci_transport_link_run
+                        if (hci_transport_link_have_outgoing_packet()){
+                            hci_transport_link_actions |= HCI_TRANSPORT_LINK_SEND_QUEUED_PACKET;
+                            hci_transport_link_set_timer(link_resend_timeout_ms);
+                        }
                         break;
                     }
                     break;
@@ -571,7 +757,9 @@ static void hci_transport_h5_process_frame(uint16_t frame_size){
                     // seems like peer is awake
                     link_peer_asleep = 0;
                     // forward packet to stack
+                    BTSTACK_INSTRUMENTATION_ENTER(BTSTACK_INSTRUMENTATION_LAYER_TRANSPORT, BTSTACK_INSTRUMENTATION_NO_CON_HANDLE, link_packet_type, link_payload_len);
                     packet_handler(link_packet_type, slip_payload, link_payload_len);
+                    BTSTACK_INSTRUMENTATION_EXIT();
                     // reset inactvitiy timer
                     hci_transport_inactivity_timer_set();
                     break;
@@ -599,28 +787,39 @@ static void hci_transport_link_update_resend_timeout(uint32_t baudrate){
 
 /// H5 Interface
 
-static uint8_t hci_transport_link_read_byte;
+static uint8_t hci_transport_link_read_buffer[LINK_SLIP_RX_CHUNK_LEN];
 
-static void hci_transport_h5_read_next_byte(void){
-    log_debug("h5: rx nxt");
-    btstack_uart->receive_block(&hci_transport_link_read_byte, 1);    
+// read whatever is available if supported by UART driver, otherwise byte by byte
+static void hci_transport_h5_read_next_block(void){
+    if (btstack_uart->receive_available){
+        btstack_uart->receive_available(hci_transport_link_read_buffer, sizeof(hci_transport_link_read_buffer));
+    } else {
+        btstack_uart->receive_block(hci_transport_link_read_buffer, 1);
+    }
 }
 
-static void hci_transport_h5_block_received(){
-    log_debug("slip: process 0x%02x", hci_transport_link_read_byte);
-    btstack_slip_decoder_process(hci_transport_link_read_byte);
-    uint16_t frame_size = btstack_slip_decoder_frame_size();
-    if (frame_size) {
-        hci_transport_h5_process_frame(frame_size);
-        hci_transport_slip_init();
+static void hci_transport_h5_data_received(uint16_t size){
+    log_debug("slip: process %u bytes", size);
+    uint16_t pos = 0;
+    while (pos < size){
+        pos += btstack_slip_decoder_process_block(&hci_transport_link_read_buffer[pos], size - pos);
+        uint16_t frame_size = btstack_slip_decoder_frame_size();
+        if (frame_size) {
+            hci_transport_h5_process_frame(frame_size);
+            hci_transport_slip_init();
+        }
     }
-    hci_transport_h5_read_next_byte();
+    hci_transport_h5_read_next_block();
+}
+
+static void hci_transport_h5_block_received(void){
+    hci_transport_h5_data_received(1);
 }
 
 static void hci_transport_h5_block_sent(void){
 
     // check if more data to send
-    if (btstack_slip_encoder_has_data()){
+    if (hci_transport_slip_has_data()){
         hci_transport_slip_send_next_chunk();
         return;
     }
@@ -628,6 +827,9 @@ static void hci_transport_h5_block_sent(void){
     // done
     slip_write_active = 0;
 
+    // queue might have space for next packet
+    hci_transport_link_emit_packet_sent_if_ready();
+
     // enter sleep mode after sending sleep message
     if (hci_transport_link_actions & HCI_TRANSPORT_LINK_ENTER_SLEEP){
         hci_transport_link_actions &= ~HCI_TRANSPORT_LINK_ENTER_SLEEP;
@@ -663,6 +865,9 @@ static void hci_transport_h5_init(const void * transport_config){
     btstack_uart->init(&uart_config);
     btstack_uart->set_block_received(&hci_transport_h5_block_received);
     btstack_uart->set_block_sent(&hci_transport_h5_block_sent);
+    if (btstack_uart->set_data_received){
+        btstack_uart->set_data_received(&hci_transport_h5_data_received);
+    }
 }
 
 static int hci_transport_h5_open(void){
@@ -694,7 +899,7 @@ static int hci_transport_h5_open(void){
     hci_transport_link_init();
 
     // start receiving
-    hci_transport_h5_read_next_byte();
+    hci_transport_h5_read_next_block();
 
     return 0;
 }
@@ -709,7 +914,7 @@ static void hci_transport_h5_register_packet_handler(void (*handler)(uint8_t pac
 }
 
 static int hci_transport_h5_can_send_packet_now(uint8_t packet_type){
-    int res = !hci_transport_link_have_outgoing_packet() && link_state == LINK_ACTIVE;
+    int res = (link_queue_count < link_window_size) && link_state == LINK_ACTIVE;
     // log_info("hci_transport_h5_can_send_packet_now: %u", res);
     return res;
 }
@@ -733,7 +938,10 @@ static int hci_transport_h5_send_packet(uint8_t packet_type, uint8_t *packet, in
         hci_transport_link_set_timer(LINK_WAKEUP_MS);
     } else {
         hci_transport_link_actions |= HCI_TRANSPORT_LINK_SEND_QUEUED_PACKET;
-        hci_transport_link_set_timer(link_resend_timeout_ms);
+        // resend timer runs for oldest unacknowledged packet
+        if (link_queue_count == 1){
+            hci_transport_link_set_timer(link_resend_timeout_ms);
+        }
     }
     hci_transport_link_run();
     return 0;
@@ -48,6 +48,7 @@
 #include "hci_dump.h"
 #include "btstack_debug.h"
 #include "btstack_event.h"
+#include "btstack_instrumentation.h"
 #include "btstack_memory.h"
 
 #ifdef ENABLE_LE_DATA_CHANNELS
@@ -65,9 +66,15 @@
 // used to cache l2cap rejects, echo, and informational requests
 #define NR_PENDING_SIGNALING_RESPONSES 3
 
-// nr of credits provided to remote if credits fall below watermark
-#define L2CAP_LE_DATA_CHANNELS_AUTOMATIC_CREDITS_WATERMARK 5
-#define L2CAP_LE_DATA_CHANNELS_AUTOMATIC_CREDITS_INCREMENT 5
+// automatic credits: initial nr of credits, max nr of outstanding credits and interval for measuring consumption
+#define L2CAP_LE_DATA_CHANNELS_AUTOMATIC_CREDITS_INITIAL 5
+#ifndef L2CAP_LE_DATA_CHANNELS_AUTOMATIC_CREDITS_MAX
+#define L2CAP_LE_DATA_CHANNELS_AUTOMATIC_CREDITS_MAX 32
+#endif
+#define L2CAP_LE_DATA_CHANNELS_AUTOMATIC_CREDITS_INTERVAL_MS 100
+
+// max PDU size of incoming LE Data Channel packets
+#define L2CAP_LE_DATA_CHANNELS_LOCAL_MPS 23
 
 // offsets for L2CAP SIGNALING COMMANDS
 #define L2CAP_SIGNALING_COMMAND_CODE_OFFSET   0
@@ -85,6 +92,31 @@
 #define L2CAP_USES_CHANNELS
 #endif
 
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+// pending S-frames
+#define L2CAP_ERTM_SEND_RECEIVER_READY          0x01
+#define L2CAP_ERTM_SEND_RECEIVER_READY_POLL     0x02
+#define L2CAP_ERTM_SEND_RECEIVER_READY_FINAL    0x04
+#define L2CAP_ERTM_SEND_REJECT                  0x08
+
+// max delay for acknowledgement of received I-frames
+#define L2CAP_ERTM_ACK_TIMEOUT_MS 200
+
+typedef enum {
+    L2CAP_SEGMENTATION_AND_REASSEMBLY_UNSEGMENTED_L2CAP_SDU = 0,
+    L2CAP_SEGMENTATION_AND_REASSEMBLY_START_OF_L2CAP_SDU,
+    L2CAP_SEGMENTATION_AND_REASSEMBLY_END_OF_L2CAP_SDU,
+    L2CAP_SEGMENTATION_AND_REASSEMBLY_CONTINUATION_OF_L2CAP_SDU
+} l2cap_segmentation_and_reassembly_t;
+
+typedef enum {
+    L2CAP_SUPERVISORY_FUNCTION_RR_RECEIVER_READY = 0,
+    L2CAP_SUPERVISORY_FUNCTION_REJ_REJECT,
+    L2CAP_SUPERVISORY_FUNCTION_RNR_RECEIVER_NOT_READY,
+    L2CAP_SUPERVISORY_FUNCTION_SREJ_SELECTIVE_REJECT
+} l2cap_supervisory_function_t;
+#endif
+
 // prototypes
 static void l2cap_hci_event_handler(uint8_t packet_type, uint16_t channel, uint8_t *packet, uint16_t size);
 static void l2cap_acl_handler(uint8_t packet_type, uint16_t channel, uint8_t *packet, uint16_t size );
@@ -97,6 +129,12 @@ static void l2cap_emit_channel_opened(l2cap_channel_t *channel, uint8_t status);
 static void l2cap_emit_channel_closed(l2cap_channel_t *channel);
 static void l2cap_emit_incoming_connection(l2cap_channel_t *channel);
 static int  l2cap_channel_ready_for_open(l2cap_channel_t *channel);
+static void l2cap_run(void);
+static void l2cap_start_outgoing_channel(l2cap_channel_t * channel, uint16_t * out_local_cid);
+#endif
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+static int  l2cap_ertm_can_store_packet_now(l2cap_channel_t * channel);
+static int  l2cap_ertm_store_sdu(l2cap_channel_t * channel, uint8_t * data, uint16_t len);
 #endif
 #ifdef ENABLE_LE_DATA_CHANNELS
 static void l2cap_emit_le_channel_opened(l2cap_channel_t *channel, uint8_t status);
@@ -104,6 +142,10 @@ static void l2cap_emit_le_incoming_connection(l2cap_channel_t *channel);
 static l2cap_channel_t * l2cap_le_get_channel_for_local_cid(uint16_t local_cid);
 static void l2cap_le_notify_channel_can_send(l2cap_channel_t *channel);
 static void l2cap_le_finialize_channel_close(l2cap_channel_t *channel);
+static void l2cap_le_setup_automatic_credits(l2cap_channel_t * channel, uint16_t initial_credits);
+static void l2cap_le_update_automatic_credits(l2cap_channel_t * channel);
+static void l2cap_le_update_credit_starvation(l2cap_channel_t * channel);
+static void l2cap_le_send_sdu_complete(l2cap_channel_t * channel);
 static inline l2cap_service_t * l2cap_le_get_service(uint16_t psm);
 #endif
 
@@ -359,15 +401,30 @@ void l2cap_request_can_send_now_event(uint16_t local_cid){
     l2cap_notify_channel_can_send();
 }
 
+static int l2cap_channel_can_send_packet_now(l2cap_channel_t * channel){
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+    if (channel->mode != L2CAP_CHANNEL_MODE_BASIC){
+        // I-frames are stored in channel buffers, outgoing buffer is only needed for l2cap_send_prepared
+        return l2cap_ertm_can_store_packet_now(channel) && !hci_is_packet_buffer_reserved();
+    }
+#endif
+    return hci_can_send_acl_packet_now(channel->con_handle);
+}
+
 int  l2cap_can_send_packet_now(uint16_t local_cid){
     l2cap_channel_t *channel = l2cap_get_channel_for_local_cid(local_cid);
     if (!channel) return 0;
-    return hci_can_send_acl_packet_now(channel->con_handle);
+    return l2cap_channel_can_send_packet_now(channel);
 }
 
 int  l2cap_can_send_prepared_packet_now(uint16_t local_cid){
     l2cap_channel_t *channel = l2cap_get_channel_for_local_cid(local_cid);
     if (!channel) return 0;
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+    if (channel->mode != L2CAP_CHANNEL_MODE_BASIC){
+        return l2cap_ertm_can_store_packet_now(channel);
+    }
+#endif
     return hci_can_send_prepared_acl_packet_now(channel->con_handle);
 }
 uint16_t l2cap_get_remote_mtu_for_local_cid(uint16_t local_cid){
@@ -467,6 +524,16 @@ int l2cap_send_prepared(uint16_t local_cid, uint16_t len){
         return -1;   // TODO: define error
     }
 
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+    // I-frames are sent from their own buffers
+    if (channel->mode != L2CAP_CHANNEL_MODE_BASIC){
+        int status = l2cap_ertm_store_sdu(channel, hci_get_outgoing_packet_buffer() + COMPLETE_L2CAP_HEADER, len);
+        hci_release_packet_buffer();
+        l2cap_run();
+        return status;
+    }
+#endif
+
     if (!hci_can_send_prepared_acl_packet_now(channel->con_handle)){
         log_info("l2cap_send_prepared cid 0x%02x, cannot send", local_cid);
         return BTSTACK_ACL_BUFFERS_FULL;
@@ -491,6 +558,14 @@ int l2cap_send(uint16_t local_cid, uint8_t *data, uint16_t len){
         return -1;   // TODO: define error
     }
 
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+    if (channel->mode != L2CAP_CHANNEL_MODE_BASIC){
+        int status = l2cap_ertm_store_sdu(channel, data, len);
+        l2cap_run();
+        return status;
+    }
+#endif
+
     if (len > channel->remote_mtu){
         log_error("l2cap_send cid 0x%02x, data length exceeds remote MTU.", local_cid);
         return L2CAP_DATA_LEN_EXCEEDS_REMOTE_MTU;
@@ -520,6 +595,549 @@ static inline void channelStateVarSetFlag(l2cap_channel_t *channel, L2CAP_CHANNE
 static inline void channelStateVarClearFlag(l2cap_channel_t *channel, L2CAP_CHANNEL_STATE_VAR flag){
     channel->state_var = (L2CAP_CHANNEL_STATE_VAR) (channel->state_var & ~flag);
 }
+
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+
+// CRC-16 (x^16 + x^15 + x^2 + 1) lookup table, LSB first, as used for the L2CAP Frame Check Sequence
+static const uint16_t crc16_table[256] = {
+    0x0000, 0xC0C1, 0xC181, 0x0140, 0xC301, 0x03C0, 0x0280, 0xC241,
+    0xC601, 0x06C0, 0x0780, 0xC741, 0x0500, 0xC5C1, 0xC481, 0x0440,
+    0xCC01, 0x0CC0, 0x0D80, 0xCD41, 0x0F00, 0xCFC1, 0xCE81, 0x0E40,
+    0x0A00, 0xCAC1, 0xCB81, 0x0B40, 0xC901, 0x09C0, 0x0880, 0xC841,
+    0xD801, 0x18C0, 0x1980, 0xD941, 0x1B00, 0xDBC1, 0xDA81, 0x1A40,
+    0x1E00, 0xDEC1, 0xDF81, 0x1F40, 0xDD01, 0x1DC0, 0x1C80, 0xDC41,
+    0x1400, 0xD4C1, 0xD581, 0x1540, 0xD701, 0x17C0, 0x1680, 0xD641,
+    0xD201, 0x12C0, 0x1380, 0xD341, 0x1100, 0xD1C1, 0xD081, 0x1040,
+    0xF001, 0x30C0, 0x3180, 0xF141, 0x3300, 0xF3C1, 0xF281, 0x3240,
+    0x3600, 0xF6C1, 0xF781, 0x3740, 0xF501, 0x35C0, 0x3480, 0xF441,
+    0x3C00, 0xFCC1, 0xFD81, 0x3D40, 0xFF01, 0x3FC0, 0x3E80, 0xFE41,
+    0xFA01, 0x3AC0, 0x3B80, 0xFB41, 0x3900, 0xF9C1, 0xF881, 0x3840,
+    0x2800, 0xE8C1, 0xE981, 0x2940, 0xEB01, 0x2BC0, 0x2A80, 0xEA41,
+    0xEE01, 0x2EC0, 0x2F80, 0xEF41, 0x2D00, 0xEDC1, 0xEC81, 0x2C40,
+    0xE401, 0x24C0, 0x2580, 0xE541, 0x2700, 0xE7C1, 0xE681, 0x2640,
+    0x2200, 0xE2C1, 0xE381, 0x2340, 0xE101, 0x21C0, 0x2080, 0xE041,
+    0xA001, 0x60C0, 0x6180, 0xA141, 0x6300, 0xA3C1, 0xA281, 0x6240,
+    0x6600, 0xA6C1, 0xA781, 0x6740, 0xA501, 0x65C0, 0x6480, 0xA441,
+    0x6C00, 0xACC1, 0xAD81, 0x6D40, 0xAF01, 0x6FC0, 0x6E80, 0xAE41,
+    0xAA01, 0x6AC0, 0x6B80, 0xAB41, 0x6900, 0xA9C1, 0xA881, 0x6840,
+    0x7800, 0xB8C1, 0xB981, 0x7940, 0xBB01, 0x7BC0, 0x7A80, 0xBA41,
+    0xBE01, 0x7EC0, 0x7F80, 0xBF41, 0x7D00, 0xBDC1, 0xBC81, 0x7C40,
+    0xB401, 0x74C0, 0x7580, 0xB541, 0x7700, 0xB7C1, 0xB681, 0x7640,
+    0x7200, 0xB2C1, 0xB381, 0x7340, 0xB101, 0x71C0, 0x7080, 0xB041,
+    0x5000, 0x90C1, 0x9181, 0x5140, 0x9301, 0x53C0, 0x5280, 0x9241,
+    0x9601, 0x56C0, 0x5780, 0x9741, 0x5500, 0x95C1, 0x9481, 0x5440,
+    0x9C01, 0x5CC0, 0x5D80, 0x9D41, 0x5F00, 0x9FC1, 0x9E81, 0x5E40,
+    0x5A00, 0x9AC1, 0x9B81, 0x5B40, 0x9901, 0x59C0, 0x5880, 0x9841,
+    0x8801, 0x48C0, 0x4980, 0x8941, 0x4B00, 0x8BC1, 0x8A81, 0x4A40,
+    0x4E00, 0x8EC1, 0x8F81, 0x4F40, 0x8D01, 0x4DC0, 0x4C80, 0x8C41,
+    0x4400, 0x84C1, 0x8581, 0x4540, 0x8701, 0x47C0, 0x4680, 0x8641,
+    0x8201, 0x42C0, 0x4380, 0x8341, 0x4100, 0x81C1, 0x8081, 0x4040,
+};
+
+static uint16_t crc16_calc(const uint8_t * data, uint16_t len){
+    uint16_t crc = 0;
+    while (len--){
+        crc = (crc >> 8) ^ crc16_table[(crc ^ *data++) & 0xff];
+    }
+    return crc;
+}
+
+static inline uint16_t l2cap_enhanced_control_field_for_information_frame(uint8_t tx_seq, int final, uint8_t req_seq, l2cap_segmentation_and_reassembly_t sar){
+    return (((uint16_t) sar) << 14) | (req_seq << 8) | (final << 7) | (tx_seq << 1) | 0;
+}
+
+static inline uint16_t l2cap_enhanced_control_field_for_supervisor_frame(l2cap_supervisory_function_t supervisory_function, int poll, int final, uint8_t req_seq){
+    return (req_seq << 8) | (final << 7) | (poll << 4) | (((int) supervisory_function) << 2) | 1;
+}
+
+static int l2cap_ertm_fcs_used(l2cap_channel_t * channel){
+    // FCS can only be omitted if both sides agree
+    return channel->local_fcs_option || channel->remote_fcs_option;
+}
+
+static inline uint8_t l2cap_ertm_tx_index(l2cap_channel_t * channel, uint8_t offset){
+    return (channel->tx_read_index + offset) % channel->num_tx_buffers;
+}
+
+static int l2cap_ertm_num_segments(l2cap_channel_t * channel, uint16_t len){
+    uint16_t mps = btstack_min(channel->remote_mps, L2CAP_ERTM_MAX_MPS);
+    if (len <= mps) return 1;
+    // start of SDU contains SDU length
+    return 1 + (len - (mps - 2) + mps - 1) / mps;
+}
+
+static int l2cap_ertm_can_store_packet_now(l2cap_channel_t * channel){
+    int num_free_tx_buffers = channel->num_tx_buffers - channel->num_stored_tx_frames;
+    return l2cap_ertm_num_segments(channel, channel->remote_mtu) <= num_free_tx_buffers;
+}
+
+static void l2cap_ertm_start_timer(l2cap_channel_t * channel, btstack_timer_source_t * timer, void (*handler)(btstack_timer_source_t * ts), uint16_t timeout_ms){
+    btstack_run_loop_remove_timer(timer);
+    btstack_run_loop_set_timer_handler(timer, handler);
+    btstack_run_loop_set_timer_context(timer, channel);
+    btstack_run_loop_set_timer(timer, timeout_ms);
+    btstack_run_loop_add_timer(timer);
+}
+
+static void l2cap_ertm_stop_timers(l2cap_channel_t * channel){
+    if (channel->mode == L2CAP_CHANNEL_MODE_BASIC) return;
+    btstack_run_loop_remove_timer(&channel->retransmission_timer);
+    btstack_run_loop_remove_timer(&channel->monitor_timer);
+    btstack_run_loop_remove_timer(&channel->ack_timer);
+}
+
+static void l2cap_ertm_retransmission_timeout(btstack_timer_source_t * ts){
+    l2cap_channel_t * channel = (l2cap_channel_t *) btstack_run_loop_get_timer_context(ts);
+    log_info("l2cap_ertm_retransmission_timeout local cid 0x%02x", channel->local_cid);
+    // ask remote for its receive state
+    channel->poll_count = 0;
+    channel->wait_for_final = 1;
+    channel->send_supervisor_frames |= L2CAP_ERTM_SEND_RECEIVER_READY_POLL;
+    l2cap_run();
+}
+
+static void l2cap_ertm_monitor_timeout(btstack_timer_source_t * ts){
+    l2cap_channel_t * channel = (l2cap_channel_t *) btstack_run_loop_get_timer_context(ts);
+    log_info("l2cap_ertm_monitor_timeout local cid 0x%02x, poll count %u", channel->local_cid, channel->poll_count);
+    if (channel->local_max_transmit && channel->poll_count >= channel->local_max_transmit){
+        channel->state = L2CAP_STATE_WILL_SEND_DISCONNECT_REQUEST;
+    } else {
+        channel->send_supervisor_frames |= L2CAP_ERTM_SEND_RECEIVER_READY_POLL;
+    }
+    l2cap_run();
+}
+
+static void l2cap_ertm_ack_timeout(btstack_timer_source_t * ts){
+    l2cap_channel_t * channel = (l2cap_channel_t *) btstack_run_loop_get_timer_context(ts);
+    channel->send_supervisor_frames |= L2CAP_ERTM_SEND_RECEIVER_READY;
+    l2cap_run();
+}
+
+// send frame with control field and payload of given len prepared in outgoing buffer
+static void l2cap_ertm_send_prepared_frame(l2cap_channel_t * channel, uint16_t len){
+    uint8_t * acl_buffer = hci_get_outgoing_packet_buffer();
+    // Streaming Mode data can be flushed by the Controller
+    uint8_t packet_boundary_flag = 0x02;
+    if (channel->mode == L2CAP_CHANNEL_MODE_ENHANCED_RETRANSMISSION && hci_non_flushable_packet_boundary_flag_supported()){
+        packet_boundary_flag = 0x00;
+    }
+    if (l2cap_ertm_fcs_used(channel)){
+        l2cap_setup_header(acl_buffer, channel->con_handle, packet_boundary_flag, channel->remote_cid, len + 2);
+        little_endian_store_16(acl_buffer, COMPLETE_L2CAP_HEADER + len, crc16_calc(&acl_buffer[HCI_ACL_HEADER_SIZE], L2CAP_HEADER_SIZE + len));
+        len += 2;
+    } else {
+        l2cap_setup_header(acl_buffer, channel->con_handle, packet_boundary_flag, channel->remote_cid, len);
+    }
+    hci_send_acl_packet_buffer(COMPLETE_L2CAP_HEADER + len);
+}
+
+// S-frames and I-frames acknowledge all received I-frames
+static uint8_t l2cap_ertm_next_req_seq(l2cap_channel_t * channel){
+    channel->num_unacked_rx_frames = 0;
+    channel->send_supervisor_frames &= ~L2CAP_ERTM_SEND_RECEIVER_READY;
+    btstack_run_loop_remove_timer(&channel->ack_timer);
+    return channel->expected_tx_seq;
+}
+
+static void l2cap_ertm_send_supervisor_frame(l2cap_channel_t * channel, l2cap_supervisory_function_t supervisory_function, int poll, int final){
+    hci_reserve_packet_buffer();
+    uint8_t * acl_buffer = hci_get_outgoing_packet_buffer();
+    uint16_t control = l2cap_enhanced_control_field_for_supervisor_frame(supervisory_function, poll, final, l2cap_ertm_next_req_seq(channel));
+    little_endian_store_16(acl_buffer, COMPLETE_L2CAP_HEADER, control);
+    l2cap_ertm_send_prepared_frame(channel, 2);
+}
+
+static void l2cap_ertm_send_information_frame(l2cap_channel_t * channel, int index){
+    l2cap_ertm_tx_packet_state_t * tx_state = &channel->tx_packets_state[index];
+    tx_state->retry_count++;
+    hci_reserve_packet_buffer();
+    uint8_t * acl_buffer = hci_get_outgoing_packet_buffer();
+    // ReqSeq is not used in Streaming Mode
+    uint8_t req_seq = 0;
+    if (channel->mode == L2CAP_CHANNEL_MODE_ENHANCED_RETRANSMISSION){
+        req_seq = l2cap_ertm_next_req_seq(channel);
+    }
+    uint16_t control = l2cap_enhanced_control_field_for_information_frame(tx_state->tx_seq, 0, req_seq, (l2cap_segmentation_and_reassembly_t) tx_state->sar);
+    little_endian_store_16(acl_buffer, COMPLETE_L2CAP_HEADER, control);
+    memcpy(&acl_buffer[COMPLETE_L2CAP_HEADER + 2], &channel->tx_packets_data[index * L2CAP_ERTM_MAX_MPS], tx_state->len);
+    l2cap_ertm_send_prepared_frame(channel, 2 + tx_state->len);
+}
+
+static int l2cap_ertm_can_send_information_frame(l2cap_channel_t * channel){
+    if (channel->num_unacked_tx_frames >= channel->num_stored_tx_frames) return 0;
+    if (channel->mode == L2CAP_CHANNEL_MODE_STREAMING) return 1;
+    if (channel->remote_busy) return 0;
+    if (channel->wait_for_final) return 0;
+    return channel->num_unacked_tx_frames < channel->remote_tx_window_size;
+}
+
+// send pending S-frames and as many I-frames as tx window and ACL scheduler allow
+static void l2cap_ertm_run(l2cap_channel_t * channel){
+    // state is updated before sending as packet sent events can trigger l2cap_run again
+    while (hci_can_send_acl_packet_now(channel->con_handle)){
+        if (channel->send_supervisor_frames & L2CAP_ERTM_SEND_RECEIVER_READY_FINAL){
+            channel->send_supervisor_frames &= ~L2CAP_ERTM_SEND_RECEIVER_READY_FINAL;
+            l2cap_ertm_send_supervisor_frame(channel, L2CAP_SUPERVISORY_FUNCTION_RR_RECEIVER_READY, 0, 1);
+            continue;
+        }
+        if (channel->send_supervisor_frames & L2CAP_ERTM_SEND_RECEIVER_READY_POLL){
+            channel->send_supervisor_frames &= ~L2CAP_ERTM_SEND_RECEIVER_READY_POLL;
+            channel->poll_count++;
+            btstack_run_loop_remove_timer(&channel->retransmission_timer);
+            l2cap_ertm_start_timer(channel, &channel->monitor_timer, &l2cap_ertm_monitor_timeout, channel->monitor_timeout_ms);
+            l2cap_ertm_send_supervisor_frame(channel, L2CAP_SUPERVISORY_FUNCTION_RR_RECEIVER_READY, 1, 0);
+            continue;
+        }
+        if (channel->send_supervisor_frames & L2CAP_ERTM_SEND_REJECT){
+            channel->send_supervisor_frames &= ~L2CAP_ERTM_SEND_REJECT;
+            l2cap_ertm_send_supervisor_frame(channel, L2CAP_SUPERVISORY_FUNCTION_REJ_REJECT, 0, 0);
+            continue;
+        }
+        if (l2cap_ertm_can_send_information_frame(channel)){
+            int index = l2cap_ertm_tx_index(channel, channel->num_unacked_tx_frames);
+            if (channel->mode == L2CAP_CHANNEL_MODE_STREAMING){
+                // frame is not kept for retransmission, buffer is reused after it has been copied
+                channel->tx_read_index = l2cap_ertm_tx_index(channel, 1);
+                channel->expected_ack_seq = (channel->expected_ack_seq + 1) & 0x3f;
+                channel->num_stored_tx_frames--;
+                l2cap_ertm_send_information_frame(channel, index);
+                l2cap_notify_channel_can_send();
+                continue;
+            }
+            if (channel->local_max_transmit && channel->tx_packets_state[index].retry_count >= channel->local_max_transmit){
+                log_info("l2cap_ertm_run local cid 0x%02x, max transmit reached", channel->local_cid);
+                channel->state = L2CAP_STATE_WILL_SEND_DISCONNECT_REQUEST;
+                return;
+            }
+            channel->num_unacked_tx_frames++;
+            if (channel->num_unacked_tx_frames == 1){
+                l2cap_ertm_start_timer(channel, &channel->retransmission_timer, &l2cap_ertm_retransmission_timeout, channel->retransmission_timeout_ms);
+            }
+            l2cap_ertm_send_information_frame(channel, index);
+            continue;
+        }
+        if (channel->send_supervisor_frames & L2CAP_ERTM_SEND_RECEIVER_READY){
+            l2cap_ertm_send_supervisor_frame(channel, L2CAP_SUPERVISORY_FUNCTION_RR_RECEIVER_READY, 0, 0);
+            continue;
+        }
+        break;
+    }
+}
+
+// copy SDU into I-frame buffers
+static int l2cap_ertm_store_sdu(l2cap_channel_t * channel, uint8_t * data, uint16_t len){
+    if (len > channel->remote_mtu){
+        log_error("l2cap_send cid 0x%02x, data length exceeds remote MTU.", channel->local_cid);
+        return L2CAP_DATA_LEN_EXCEEDS_REMOTE_MTU;
+    }
+    int num_segments = l2cap_ertm_num_segments(channel, len);
+    if (num_segments > channel->num_tx_buffers - channel->num_stored_tx_frames){
+        log_info("l2cap_send cid 0x%02x, cannot send", channel->local_cid);
+        return BTSTACK_ACL_BUFFERS_FULL;
+    }
+    uint16_t mps = btstack_min(channel->remote_mps, L2CAP_ERTM_MAX_MPS);
+    uint16_t pos = 0;
+    int segment;
+    for (segment = 0; segment < num_segments; segment++){
+        int index = l2cap_ertm_tx_index(channel, channel->num_stored_tx_frames);
+        l2cap_ertm_tx_packet_state_t * tx_state = &channel->tx_packets_state[index];
+        uint8_t * tx_packet = &channel->tx_packets_data[index * L2CAP_ERTM_MAX_MPS];
+        uint16_t sdu_len_size = 0;
+        if (num_segments == 1){
+            tx_state->sar = L2CAP_SEGMENTATION_AND_REASSEMBLY_UNSEGMENTED_L2CAP_SDU;
+        } else if (segment == 0){
+            tx_state->sar = L2CAP_SEGMENTATION_AND_REASSEMBLY_START_OF_L2CAP_SDU;
+            little_endian_store_16(tx_packet, 0, len);
+            sdu_len_size = 2;
+        } else if (segment == num_segments - 1){
+            tx_state->sar = L2CAP_SEGMENTATION_AND_REASSEMBLY_END_OF_L2CAP_SDU;
+        } else {
+            tx_state->sar = L2CAP_SEGMENTATION_AND_REASSEMBLY_CONTINUATION_OF_L2CAP_SDU;
+        }
+        uint16_t payload_len = btstack_min(len - pos, mps - sdu_len_size);
+        memcpy(&tx_packet[sdu_len_size], &data[pos], payload_len);
+        pos += payload_len;
+        tx_state->len = sdu_len_size + payload_len;
+        tx_state->tx_seq = (channel->expected_ack_seq + channel->num_stored_tx_frames) & 0x3f;
+        tx_state->retry_count = 0;
+        channel->num_stored_tx_frames++;
+    }
+    return 0;
+}
+
+// ReqSeq acknowledges all I-frames up to ReqSeq - 1
+static void l2cap_ertm_process_req_seq(l2cap_channel_t * channel, uint8_t req_seq){
+    uint8_t num_acked = (req_seq - channel->expected_ack_seq) & 0x3f;
+    if (num_acked == 0) return;
+    if (num_acked > channel->num_stored_tx_frames){
+        log_error("l2cap_ertm_process_req_seq local cid 0x%02x, invalid ReqSeq %u", channel->local_cid, req_seq);
+        return;
+    }
+    channel->expected_ack_seq = req_seq;
+    channel->tx_read_index = l2cap_ertm_tx_index(channel, num_acked);
+    channel->num_stored_tx_frames -= num_acked;
+    if (num_acked < channel->num_unacked_tx_frames){
+        channel->num_unacked_tx_frames -= num_acked;
+    } else {
+        channel->num_unacked_tx_frames = 0;
+    }
+    if (channel->wait_for_final) return;
+    if (channel->num_unacked_tx_frames){
+        l2cap_ertm_start_timer(channel, &channel->retransmission_timer, &l2cap_ertm_retransmission_timeout, channel->retransmission_timeout_ms);
+    } else {
+        btstack_run_loop_remove_timer(&channel->retransmission_timer);
+    }
+}
+
+// go back to I-frame with given TxSeq, it and all following frames are sent again
+static void l2cap_ertm_retransmit_from(l2cap_channel_t * channel, uint8_t tx_seq){
+    uint8_t offset = (tx_seq - channel->expected_ack_seq) & 0x3f;
+    if (offset >= channel->num_unacked_tx_frames) return;
+    log_info("l2cap_ertm_retransmit_from local cid 0x%02x, TxSeq %u", channel->local_cid, tx_seq);
+    channel->num_unacked_tx_frames = offset;
+}
+
+static void l2cap_ertm_handle_sdu_segment(l2cap_channel_t * channel, l2cap_segmentation_and_reassembly_t sar, uint8_t * payload, uint16_t len){
+    switch (sar){
+        case L2CAP_SEGMENTATION_AND_REASSEMBLY_UNSEGMENTED_L2CAP_SDU:
+            channel->receive_sdu_len = 0;
+            if (len > channel->local_mtu) break;
+            l2cap_dispatch_to_channel(channel, L2CAP_DATA_PACKET, payload, len);
+            break;
+        case L2CAP_SEGMENTATION_AND_REASSEMBLY_START_OF_L2CAP_SDU:
+            channel->receive_sdu_len = 0;
+            if (len < 2) break;
+            if (little_endian_read_16(payload, 0) > channel->local_mtu) break;
+            if (len - 2 > little_endian_read_16(payload, 0)) break;
+            channel->receive_sdu_len = little_endian_read_16(payload, 0);
+            channel->receive_sdu_pos = len - 2;
+            memcpy(channel->receive_sdu_buffer, &payload[2], len - 2);
+            break;
+        case L2CAP_SEGMENTATION_AND_REASSEMBLY_CONTINUATION_OF_L2CAP_SDU:
+        case L2CAP_SEGMENTATION_AND_REASSEMBLY_END_OF_L2CAP_SDU:
+            // drop segments without start
+            if (!channel->receive_sdu_len) break;
+            if (channel->receive_sdu_pos + len > channel->receive_sdu_len){
+                log_error("l2cap_ertm_handle_sdu_segment local cid 0x%02x, SDU too long", channel->local_cid);
+                channel->receive_sdu_len = 0;
+                break;
+            }
+            memcpy(&channel->receive_sdu_buffer[channel->receive_sdu_pos], payload, len);
+            channel->receive_sdu_pos += len;
+            if (sar == L2CAP_SEGMENTATION_AND_REASSEMBLY_CONTINUATION_OF_L2CAP_SDU) break;
+            if (channel->receive_sdu_pos == channel->receive_sdu_len){
+                l2cap_dispatch_to_channel(channel, L2CAP_DATA_PACKET, channel->receive_sdu_buffer, channel->receive_sdu_len);
+            }
+            channel->receive_sdu_len = 0;
+            break;
+        default:
+            break;
+    }
+}
+
+static void l2cap_ertm_handle_information_frame(l2cap_channel_t * channel, uint16_t control, uint8_t * payload, uint16_t len){
+    uint8_t tx_seq = (control >> 1) & 0x3f;
+    l2cap_segmentation_and_reassembly_t sar = (l2cap_segmentation_and_reassembly_t) (control >> 14);
+
+    if (channel->mode == L2CAP_CHANNEL_MODE_STREAMING){
+        // missing frames are not retransmitted, drop incomplete SDU
+        if (tx_seq != channel->expected_tx_seq){
+            channel->receive_sdu_len = 0;
+        }
+        channel->expected_tx_seq = (tx_seq + 1) & 0x3f;
+        l2cap_ertm_handle_sdu_segment(channel, sar, payload, len);
+        return;
+    }
+
+    if (tx_seq != channel->expected_tx_seq){
+        // frames after a missing one: request retransmission once, duplicates are ignored
+        uint8_t offset = (tx_seq - channel->expected_tx_seq) & 0x3f;
+        if (offset < channel->local_tx_window_size && !channel->reject_sent){
+            log_info("l2cap_ertm local cid 0x%02x, TxSeq %u but expected %u", channel->local_cid, tx_seq, channel->expected_tx_seq);
+            channel->reject_sent = 1;
+            channel->send_supervisor_frames |= L2CAP_ERTM_SEND_REJECT;
+        }
+        return;
+    }
+    channel->expected_tx_seq = (tx_seq + 1) & 0x3f;
+    channel->reject_sent = 0;
+    l2cap_ertm_handle_sdu_segment(channel, sar, payload, len);
+
+    // acknowledge when half of the tx window is used or after ack timeout
+    channel->num_unacked_rx_frames++;
+    if (channel->num_unacked_rx_frames >= (channel->local_tx_window_size + 1) / 2){
+        channel->send_supervisor_frames |= L2CAP_ERTM_SEND_RECEIVER_READY;
+    } else if (channel->num_unacked_rx_frames == 1){
+        l2cap_ertm_start_timer(channel, &channel->ack_timer, &l2cap_ertm_ack_timeout, L2CAP_ERTM_ACK_TIMEOUT_MS);
+    }
+}
+
+static void l2cap_ertm_handle_pdu(l2cap_channel_t * channel, uint8_t * packet, uint16_t size){
+    uint16_t fcs_size = l2cap_ertm_fcs_used(channel) ? 2 : 0;
+    if (size < COMPLETE_L2CAP_HEADER + 2 + fcs_size) return;
+    if (fcs_size){
+        uint16_t fcs = little_endian_read_16(packet, size - 2);
+        if (crc16_calc(&packet[HCI_ACL_HEADER_SIZE], size - HCI_ACL_HEADER_SIZE - 2) != fcs){
+            // corrupted frames are handled like missing ones
+            log_info("l2cap_ertm_handle_pdu local cid 0x%02x, FCS error", channel->local_cid);
+            return;
+        }
+    }
+    uint16_t control     = little_endian_read_16(packet, COMPLETE_L2CAP_HEADER);
+    uint8_t  req_seq     = (control >> 8) & 0x3f;
+    int      final       = (control >> 7) & 0x01;
+    uint8_t * payload    = &packet[COMPLETE_L2CAP_HEADER + 2];
+    uint16_t payload_len = size - COMPLETE_L2CAP_HEADER - 2 - fcs_size;
+
+    if (channel->mode == L2CAP_CHANNEL_MODE_STREAMING){
+        // S-frames are not used in Streaming Mode
+        if (control & 1) return;
+        l2cap_ertm_handle_information_frame(channel, control, payload, payload_len);
+        return;
+    }
+
+    // response to our poll, retransmit all frames that are still unacknowledged
+    int retransmit = 0;
+    if (final && channel->wait_for_final){
+        channel->wait_for_final = 0;
+        channel->poll_count = 0;
+        btstack_run_loop_remove_timer(&channel->monitor_timer);
+        retransmit = 1;
+    }
+
+    if (control & 1){
+        l2cap_supervisory_function_t supervisory_function = (l2cap_supervisory_function_t) ((control >> 2) & 0x03);
+        if (supervisory_function == L2CAP_SUPERVISORY_FUNCTION_SREJ_SELECTIVE_REJECT){
+            // ReqSeq is the missing frame and does not acknowledge it, send missing and all following frames again
+            retransmit = 1;
+        } else {
+            l2cap_ertm_process_req_seq(channel, req_seq);
+            channel->remote_busy = supervisory_function == L2CAP_SUPERVISORY_FUNCTION_RNR_RECEIVER_NOT_READY;
+            if (supervisory_function == L2CAP_SUPERVISORY_FUNCTION_REJ_REJECT){
+                retransmit = 1;
+            }
+        }
+        if ((control >> 4) & 0x01){
+            channel->send_supervisor_frames |= L2CAP_ERTM_SEND_RECEIVER_READY_FINAL;
+        }
+        if (retransmit){
+            l2cap_ertm_retransmit_from(channel, req_seq);
+        }
+    } else {
+        l2cap_ertm_process_req_seq(channel, req_seq);
+        if (retransmit){
+            l2cap_ertm_retransmit_from(channel, req_seq);
+        }
+        l2cap_ertm_handle_information_frame(channel, control, payload, payload_len);
+    }
+
+    l2cap_run();
+    l2cap_notify_channel_can_send();
+}
+
+// Retransmission and Flow Control option with own parameters, and FCS option
+static uint16_t l2cap_ertm_setup_options(l2cap_channel_t * channel, uint8_t * config_options){
+    int ertm = channel->mode == L2CAP_CHANNEL_MODE_ENHANCED_RETRANSMISSION;
+    config_options[0] = L2CAP_CONFIG_OPTION_TYPE_RETRANSMISSION_AND_FLOW_CONTROL;
+    config_options[1] = 9;
+    config_options[2] = channel->mode;
+    config_options[3] = ertm ? channel->local_tx_window_size : 0;
+    config_options[4] = ertm ? channel->local_max_transmit   : 0;
+    little_endian_store_16(config_options, 5, 0);
+    little_endian_store_16(config_options, 7, 0);
+    little_endian_store_16(config_options, 9, channel->mode == L2CAP_CHANNEL_MODE_BASIC ? 0 : L2CAP_ERTM_MAX_MPS);
+    if (channel->mode == L2CAP_CHANNEL_MODE_BASIC) return 11;
+    config_options[11] = L2CAP_CONFIG_OPTION_TYPE_FRAME_CHECK_SEQUENCE;
+    config_options[12] = 1;
+    config_options[13] = channel->local_fcs_option;
+    return 14;
+}
+
+// Retransmission and Flow Control option accepting remote parameters, with timeouts we're going to use
+static uint16_t l2cap_ertm_setup_options_response(l2cap_channel_t * channel, uint8_t * config_options){
+    int ertm = channel->mode == L2CAP_CHANNEL_MODE_ENHANCED_RETRANSMISSION;
+    config_options[0] = L2CAP_CONFIG_OPTION_TYPE_RETRANSMISSION_AND_FLOW_CONTROL;
+    config_options[1] = 9;
+    config_options[2] = channel->mode;
+    config_options[3] = ertm ? channel->remote_tx_window_size : 0;
+    config_options[4] = 0;
+    little_endian_store_16(config_options, 5, ertm ? channel->retransmission_timeout_ms : 0);
+    little_endian_store_16(config_options, 7, ertm ? channel->monitor_timeout_ms : 0);
+    little_endian_store_16(config_options, 9, channel->remote_mps);
+    return 11;
+}
+
+static void l2cap_ertm_mode_not_supported(l2cap_channel_t * channel){
+    log_info("l2cap cid 0x%02x, mode %u not accepted by remote", channel->local_cid, channel->mode);
+    l2cap_emit_channel_opened(channel, L2CAP_CHANNEL_MODE_NOT_SUPPORTED_BY_REMOTE);
+    channel->state = L2CAP_STATE_WILL_SEND_DISCONNECT_REQUEST;
+}
+
+static void l2cap_ertm_handle_remote_mode(l2cap_channel_t * channel, l2cap_channel_mode_t remote_mode){
+    if (remote_mode == channel->mode){
+        if (remote_mode == L2CAP_CHANNEL_MODE_BASIC) return;
+        channelStateVarSetFlag(channel, L2CAP_CHANNEL_STATE_VAR_SEND_CONF_RSP_RFC);
+        // limit outgoing SDU size to what fits into our I-frame buffers
+        uint16_t mps = btstack_min(channel->remote_mps, L2CAP_ERTM_MAX_MPS);
+        uint32_t max_sdu_len = channel->num_tx_buffers == 1 ? mps : channel->num_tx_buffers * mps - 2;
+        if (channel->remote_mtu > max_sdu_len){
+            channel->remote_mtu = max_sdu_len;
+        }
+        return;
+    }
+    if (remote_mode == L2CAP_CHANNEL_MODE_BASIC){
+        if (channel->mode_mandatory){
+            l2cap_ertm_mode_not_supported(channel);
+            return;
+        }
+        // fall back to Basic mode, our config request will be rejected and sent again
+        log_info("l2cap cid 0x%02x, fall back to Basic mode", channel->local_cid);
+        channel->mode = L2CAP_CHANNEL_MODE_BASIC;
+        return;
+    }
+    // remote requested other mode, propose our mode
+    channelStateVarSetFlag(channel, L2CAP_CHANNEL_STATE_VAR_SEND_CONF_RSP_UNACCEPTABLE);
+}
+
+static uint8_t l2cap_ertm_setup_channel(l2cap_channel_t * channel, l2cap_ertm_config_t * ertm_config, uint8_t * buffer, uint32_t size){
+    if (ertm_config->mode != L2CAP_CHANNEL_MODE_ENHANCED_RETRANSMISSION && ertm_config->mode != L2CAP_CHANNEL_MODE_STREAMING){
+        return ERROR_CODE_INVALID_HCI_COMMAND_PARAMETERS;
+    }
+
+    // align buffer for tx state array
+    uint32_t bytes_till_alignment = (4 - ((uintptr_t) buffer & 3)) & 3;
+    if (size < bytes_till_alignment + ertm_config->local_mtu) return ERROR_CODE_MEMORY_CAPACITY_EXCEEDED;
+    buffer += bytes_till_alignment;
+    size   -= bytes_till_alignment + ertm_config->local_mtu;
+
+    // as many I-frame buffers as requested and fit
+    uint32_t num_tx_buffers = size / (sizeof(l2cap_ertm_tx_packet_state_t) + L2CAP_ERTM_MAX_MPS);
+    num_tx_buffers = btstack_min(num_tx_buffers, btstack_min(ertm_config->num_tx_buffers, 63));
+    if (num_tx_buffers == 0) return ERROR_CODE_MEMORY_CAPACITY_EXCEEDED;
+
+    channel->tx_packets_state   = (l2cap_ertm_tx_packet_state_t *) buffer;
+    buffer += num_tx_buffers * sizeof(l2cap_ertm_tx_packet_state_t);
+    channel->tx_packets_data    = buffer;
+    buffer += num_tx_buffers * L2CAP_ERTM_MAX_MPS;
+    channel->receive_sdu_buffer = buffer;
+    channel->num_tx_buffers     = num_tx_buffers;
+
+    channel->mode                      = ertm_config->mode;
+    channel->mode_mandatory            = ertm_config->mode_mandatory;
+    channel->local_mtu                 = ertm_config->local_mtu;
+    channel->local_max_transmit        = ertm_config->max_transmit;
+    channel->local_tx_window_size      = btstack_max(1, btstack_min(ertm_config->tx_window_size, 63));
+    channel->local_fcs_option          = ertm_config->fcs_option;
+    channel->retransmission_timeout_ms = ertm_config->retransmission_timeout_ms ? ertm_config->retransmission_timeout_ms : L2CAP_ERTM_DEFAULT_RETRANSMISSION_TIMEOUT_MS;
+    channel->monitor_timeout_ms        = ertm_config->monitor_timeout_ms ? ertm_config->monitor_timeout_ms : L2CAP_ERTM_DEFAULT_MONITOR_TIMEOUT_MS;
+
+    // defaults until remote config request is received
+    channel->remote_fcs_option     = 1;
+    channel->remote_tx_window_size = 1;
+    channel->remote_mps            = L2CAP_ERTM_MAX_MPS;
+    return 0;
+}
+#endif
 #endif
 
 
@@ -599,7 +1217,10 @@ static void l2cap_run(void){
                         break;
                     case 2: { // Extended Features Supported
                             // extended features request supported, features: fixed channels, unicast connectionless data reception
-                            uint32_t features = 0x280;
+                            uint32_t features = L2CAP_EXTENDED_FEATURE_FIXED_CHANNELS | L2CAP_EXTENDED_FEATURE_UNICAST_CONNECTIONLESS_DATA;
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+                            features |= L2CAP_EXTENDED_FEATURE_ENHANCED_RETRANSMISSION_MODE | L2CAP_EXTENDED_FEATURE_STREAMING_MODE | L2CAP_EXTENDED_FEATURE_FCS_OPTION;
+#endif
                             l2cap_send_signaling_packet(handle, INFORMATION_RESPONSE, sig_id, infoType, 0, sizeof(features), &features);
                         }
                         break;
@@ -638,7 +1259,8 @@ static void l2cap_run(void){
     UNUSED(it);
 
 #ifdef ENABLE_CLASSIC
-    uint8_t  config_options[4];
+    uint8_t  config_options[18];
+    uint16_t options_size;
     btstack_linked_list_iterator_init(&it, &l2cap_channels);
     while (btstack_linked_list_iterator_has_next(&it)){
 
@@ -701,12 +1323,31 @@ static void l2cap_run(void){
                     }
                     if (channel->state_var & L2CAP_CHANNEL_STATE_VAR_SEND_CONF_RSP_INVALID){
                         l2cap_send_signaling_packet(channel->con_handle, CONFIGURE_RESPONSE, channel->remote_sig_id, channel->remote_cid, flags, L2CAP_CONF_RESULT_UNKNOWN_OPTIONS, 0, NULL);
-                    } else if (channel->state_var & L2CAP_CHANNEL_STATE_VAR_SEND_CONF_RSP_MTU){
-                        config_options[0] = 1; // MTU
-                        config_options[1] = 2; // len param
-                        little_endian_store_16( (uint8_t*)&config_options, 2, channel->remote_mtu);
-                        l2cap_send_signaling_packet(channel->con_handle, CONFIGURE_RESPONSE, channel->remote_sig_id, channel->remote_cid, flags, 0, 4, &config_options);
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+                    } else if (channel->state_var & L2CAP_CHANNEL_STATE_VAR_SEND_CONF_RSP_UNACCEPTABLE){
+                        // propose our mode, remote sends new config request
+                        channelStateVarClearFlag(channel, L2CAP_CHANNEL_STATE_VAR_SEND_CONF_RSP_UNACCEPTABLE);
+                        channelStateVarClearFlag(channel, L2CAP_CHANNEL_STATE_VAR_SENT_CONF_RSP);
+                        channelStateVarClearFlag(channel, L2CAP_CHANNEL_STATE_VAR_SEND_CONF_RSP_MTU);
+                        options_size = l2cap_ertm_setup_options(channel, config_options);
+                        l2cap_send_signaling_packet(channel->con_handle, CONFIGURE_RESPONSE, channel->remote_sig_id, channel->remote_cid, flags, L2CAP_CONF_RESULT_UNACCEPTABLE_PARAMETERS, options_size, &config_options);
+#endif
+                    } else if (channel->state_var & (L2CAP_CHANNEL_STATE_VAR_SEND_CONF_RSP_MTU | L2CAP_CHANNEL_STATE_VAR_SEND_CONF_RSP_RFC)){
+                        options_size = 0;
+                        if (channel->state_var & L2CAP_CHANNEL_STATE_VAR_SEND_CONF_RSP_MTU){
+                            config_options[0] = 1; // MTU
+                            config_options[1] = 2; // len param
+                            little_endian_store_16( (uint8_t*)&config_options, 2, channel->remote_mtu);
+                            options_size = 4;
+                        }
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+                        if (channel->state_var & L2CAP_CHANNEL_STATE_VAR_SEND_CONF_RSP_RFC){
+                            options_size += l2cap_ertm_setup_options_response(channel, &config_options[options_size]);
+                        }
+#endif
+                        l2cap_send_signaling_packet(channel->con_handle, CONFIGURE_RESPONSE, channel->remote_sig_id, channel->remote_cid, flags, 0, options_size, &config_options);
                         channelStateVarClearFlag(channel,L2CAP_CHANNEL_STATE_VAR_SEND_CONF_RSP_MTU);
+                        channelStateVarClearFlag(channel,L2CAP_CHANNEL_STATE_VAR_SEND_CONF_RSP_RFC);
                     } else {
                         l2cap_send_signaling_packet(channel->con_handle, CONFIGURE_RESPONSE, channel->remote_sig_id, channel->remote_cid, flags, 0, 0, NULL);
                     }
@@ -719,7 +1360,13 @@ static void l2cap_run(void){
                     config_options[0] = 1; // MTU
                     config_options[1] = 2; // len param
                     little_endian_store_16( (uint8_t*)&config_options, 2, channel->local_mtu);
-                    l2cap_send_signaling_packet(channel->con_handle, CONFIGURE_REQUEST, channel->local_sig_id, channel->remote_cid, 0, 4, &config_options);
+                    options_size = 4;
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+                    if (channel->mode != L2CAP_CHANNEL_MODE_BASIC){
+                        options_size += l2cap_ertm_setup_options(channel, &config_options[options_size]);
+                    }
+#endif
+                    l2cap_send_signaling_packet(channel->con_handle, CONFIGURE_REQUEST, channel->local_sig_id, channel->remote_cid, 0, options_size, &config_options);
                     l2cap_start_rtx(channel);
                 }
                 if (l2cap_channel_ready_for_open(channel)){
@@ -736,6 +1383,15 @@ static void l2cap_run(void){
                 l2cap_finialize_channel_close(channel);  // -- remove from list
                 break;
                 
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+            case L2CAP_STATE_OPEN:
+                if (channel->mode == L2CAP_CHANNEL_MODE_BASIC) break;
+                l2cap_ertm_run(channel);
+                // max transmit reached
+                if (channel->state != L2CAP_STATE_WILL_SEND_DISCONNECT_REQUEST) break;
+                /* fall through */
+#endif
+
             case L2CAP_STATE_WILL_SEND_DISCONNECT_REQUEST:
                 if (!hci_can_send_acl_packet_now(channel->con_handle)) break;
                 channel->local_sig_id = l2cap_next_sig_id();
@@ -765,7 +1421,7 @@ static void l2cap_run(void){
                 channel->local_sig_id = l2cap_next_sig_id();
                 channel->credits_incoming =  channel->new_credits_incoming;
                 channel->new_credits_incoming = 0;
-                l2cap_send_le_signaling_packet( channel->con_handle, LE_CREDIT_BASED_CONNECTION_REQUEST, channel->local_sig_id, channel->psm, channel->local_cid, channel->local_mtu, 23, channel->credits_incoming);
+                l2cap_send_le_signaling_packet( channel->con_handle, LE_CREDIT_BASED_CONNECTION_REQUEST, channel->local_sig_id, channel->psm, channel->local_cid, channel->local_mtu, L2CAP_LE_DATA_CHANNELS_LOCAL_MPS, channel->credits_incoming);
                 break;
             case L2CAP_STATE_WILL_SEND_LE_CONNECTION_RESPONSE_ACCEPT:
                 if (!hci_can_send_acl_packet_now(channel->con_handle)) break;
@@ -773,7 +1429,7 @@ static void l2cap_run(void){
                 channel->state = L2CAP_STATE_OPEN;
                 channel->credits_incoming =  channel->new_credits_incoming;
                 channel->new_credits_incoming = 0;
-                l2cap_send_le_signaling_packet(channel->con_handle, LE_CREDIT_BASED_CONNECTION_RESPONSE, channel->remote_sig_id, channel->local_cid, channel->local_mtu, 23, channel->credits_incoming, 0);
+                l2cap_send_le_signaling_packet(channel->con_handle, LE_CREDIT_BASED_CONNECTION_RESPONSE, channel->remote_sig_id, channel->local_cid, channel->local_mtu, L2CAP_LE_DATA_CHANNELS_LOCAL_MPS, channel->credits_incoming, 0);
                 // notify client
                 l2cap_emit_le_channel_opened(channel, 0);
                 break;                       
@@ -796,6 +1452,7 @@ static void l2cap_run(void){
                     uint16_t new_credits = channel->new_credits_incoming;
                     channel->new_credits_incoming = 0;
                     channel->credits_incoming += new_credits;
+                    channel->le_statistics.num_credit_grants++;
                     l2cap_send_le_signaling_packet(channel->con_handle, LE_FLOW_CONTROL_CREDIT, channel->local_sig_id, channel->remote_cid, new_credits);
                     break;
                 }
@@ -826,12 +1483,9 @@ static void l2cap_run(void){
                 channel->credits_outgoing--;
 
                 if (channel->send_sdu_pos >= channel->send_sdu_len + 2){
-                    channel->send_sdu_buffer = NULL;
-                    // send done event
-                    l2cap_emit_simple_event_with_cid(channel, L2CAP_EVENT_LE_PACKET_SENT);
-                    // inform about can send now
-                    l2cap_le_notify_channel_can_send(channel);
+                    l2cap_le_send_sdu_complete(channel);
                 }
+                l2cap_le_update_credit_starvation(channel);
                 hci_send_acl_packet_buffer(8 + pos);
                 break;
             case L2CAP_STATE_WILL_SEND_DISCONNECT_REQUEST:
@@ -966,6 +1620,33 @@ uint8_t l2cap_create_channel(btstack_packet_handler_t channel_packet_handler, bd
         return BTSTACK_MEMORY_ALLOC_FAILED;
     }
 
+    l2cap_start_outgoing_channel(channel, out_local_cid);
+    return 0;
+}
+
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+uint8_t l2cap_create_ertm_channel(btstack_packet_handler_t packet_handler, bd_addr_t address, uint16_t psm,
+    l2cap_ertm_config_t * ertm_config, uint8_t * buffer, uint32_t size, uint16_t * out_local_cid){
+
+    log_info("L2CAP_CREATE_ERTM_CHANNEL addr %s psm 0x%x mode %u", bd_addr_to_str(address), psm, ertm_config->mode);
+
+    l2cap_channel_t * channel = l2cap_create_channel_entry(packet_handler, address, BD_ADDR_TYPE_CLASSIC, psm, ertm_config->local_mtu, LEVEL_0);
+    if (!channel) {
+        return BTSTACK_MEMORY_ALLOC_FAILED;
+    }
+
+    uint8_t status = l2cap_ertm_setup_channel(channel, ertm_config, buffer, size);
+    if (status){
+        btstack_memory_l2cap_channel_free(channel);
+        return status;
+    }
+
+    l2cap_start_outgoing_channel(channel, out_local_cid);
+    return 0;
+}
+#endif
+
+static void l2cap_start_outgoing_channel(l2cap_channel_t * channel, uint16_t * out_local_cid){
     // add to connections list
     btstack_linked_list_add(&l2cap_channels, (btstack_linked_item_t *) channel);
 
@@ -975,7 +1656,7 @@ uint8_t l2cap_create_channel(btstack_packet_handler_t channel_packet_handler, bd
     }
 
     // check if hci connection is already usable
-    hci_connection_t * conn = hci_connection_for_bd_addr_and_type(address, BD_ADDR_TYPE_CLASSIC);
+    hci_connection_t * conn = hci_connection_for_bd_addr_and_type(channel->address, BD_ADDR_TYPE_CLASSIC);
     if (conn){
         log_info("l2cap_create_channel, hci connection already exists");
         l2cap_handle_connection_complete(conn->con_handle, channel);
@@ -986,8 +1667,6 @@ uint8_t l2cap_create_channel(btstack_packet_handler_t channel_packet_handler, bd
     }
 
     l2cap_run();
-
-    return 0;
 }
 
 void 
@@ -1042,12 +1721,16 @@ static void l2cap_handle_connection_success_for_addr(bd_addr_t address, hci_con_
 static void l2cap_notify_channel_can_send(void){
 
 #ifdef ENABLE_CLASSIC
+    // channels that get to send are moved to the end of the list to serve waiting channels round-robin
+    int num_channels = btstack_linked_list_count(&l2cap_channels);
     btstack_linked_list_iterator_t it;
     btstack_linked_list_iterator_init(&it, &l2cap_channels);
-    while (btstack_linked_list_iterator_has_next(&it)){
+    while (num_channels-- && btstack_linked_list_iterator_has_next(&it)){
         l2cap_channel_t * channel = (l2cap_channel_t *) btstack_linked_list_iterator_next(&it);
         if (!channel->waiting_for_can_send_now) continue;
-        if (!hci_can_send_acl_packet_now(channel->con_handle)) continue;
+        if (!l2cap_channel_can_send_packet_now(channel)) continue;
+        btstack_linked_list_remove(&l2cap_channels, (btstack_linked_item_t *) channel);
+        btstack_linked_list_add_tail(&l2cap_channels, (btstack_linked_item_t *) channel);
         channel->waiting_for_can_send_now = 0;
         l2cap_emit_can_send_now(channel->packet_handler, channel->local_cid);
     }
@@ -1139,6 +1822,9 @@ static void l2cap_hci_event_handler(uint8_t packet_type, uint16_t cid, uint8_t *
                 if (channel->con_handle != handle) continue;
                 l2cap_emit_channel_closed(channel);
                 l2cap_stop_rtx(channel);
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+                l2cap_ertm_stop_timers(channel);
+#endif
                 btstack_linked_list_iterator_remove(&it);
                 btstack_memory_l2cap_channel_free(channel);
             }
@@ -1313,6 +1999,23 @@ void l2cap_accept_connection(uint16_t local_cid){
     l2cap_run();
 }
 
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+uint8_t l2cap_accept_ertm_connection(uint16_t local_cid, l2cap_ertm_config_t * ertm_config, uint8_t * buffer, uint32_t size){
+    log_info("L2CAP_ACCEPT_ERTM_CONNECTION local_cid 0x%x mode %u", local_cid, ertm_config->mode);
+    l2cap_channel_t * channel = l2cap_get_channel_for_local_cid(local_cid);
+    if (!channel) {
+        log_error("l2cap_accept_ertm_connection called but local_cid 0x%x not found", local_cid);
+        return L2CAP_LOCAL_CID_DOES_NOT_EXIST;
+    }
+
+    uint8_t status = l2cap_ertm_setup_channel(channel, ertm_config, buffer, size);
+    if (status) return status;
+
+    l2cap_accept_connection(local_cid);
+    return 0;
+}
+#endif
+
 void l2cap_decline_connection(uint16_t local_cid){
     log_info("L2CAP_DECLINE_CONNECTION local_cid 0x%x", local_cid);
     l2cap_channel_t * channel = l2cap_get_channel_for_local_cid( local_cid);
@@ -1334,6 +2037,12 @@ static void l2cap_signaling_handle_configure_request(l2cap_channel_t *channel, u
         channelStateVarSetFlag(channel, L2CAP_CHANNEL_STATE_VAR_SEND_CONF_RSP_CONT);
     }
 
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+    // Basic mode if not specified otherwise
+    l2cap_channel_mode_t remote_mode = L2CAP_CHANNEL_MODE_BASIC;
+    int remote_mps_unacceptable = 0;
+#endif
+
     // accept the other's configuration options
     uint16_t end_pos = 4 + little_endian_read_16(command, L2CAP_SIGNALING_COMMAND_LENGTH_OFFSET);
     uint16_t pos     = 8;
@@ -1353,6 +2062,28 @@ static void l2cap_signaling_handle_configure_request(l2cap_channel_t *channel, u
         if (option_type == 2 && length == 2){
             channel->flush_timeout = little_endian_read_16(command, pos);
         }
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+        // Retransmission and Flow Control { type(8):4, len(8): 9, Mode, TxWindow, MaxTransmit, Retransmission Timeout(16), Monitor Timeout(16), MPS(16) }
+        if (option_type == L2CAP_CONFIG_OPTION_TYPE_RETRANSMISSION_AND_FLOW_CONTROL && length == 9){
+            remote_mode = (l2cap_channel_mode_t) command[pos];
+            if (remote_mode == L2CAP_CHANNEL_MODE_ENHANCED_RETRANSMISSION){
+                channel->remote_tx_window_size = command[pos+1];
+            }
+            if (remote_mode == L2CAP_CHANNEL_MODE_ENHANCED_RETRANSMISSION || remote_mode == L2CAP_CHANNEL_MODE_STREAMING){
+                uint16_t remote_mps = little_endian_read_16(command, pos+7);
+                if (remote_mps < L2CAP_ERTM_MIN_MPS){
+                    log_info("l2cap cid 0x%02x, remote mps %u too small", channel->local_cid, remote_mps);
+                    remote_mps_unacceptable = 1;
+                } else {
+                    channel->remote_mps = remote_mps;
+                }
+            }
+        }
+        // Frame Check Sequence { type(8):5, len(8): 1, FCS }
+        if (option_type == L2CAP_CONFIG_OPTION_TYPE_FRAME_CHECK_SEQUENCE && length == 1){
+            channel->remote_fcs_option = command[pos];
+        }
+#endif
         // check for unknown options
         if (option_hint == 0 && (option_type == 0 || option_type >= 0x07)){
             log_info("l2cap cid %u, unknown options", channel->local_cid);
@@ -1360,7 +2091,41 @@ static void l2cap_signaling_handle_configure_request(l2cap_channel_t *channel, u
         }
         pos += length;
     }
+
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+    // reject and propose our parameters, remote sends new config request
+    if (remote_mps_unacceptable){
+        channelStateVarSetFlag(channel, L2CAP_CHANNEL_STATE_VAR_SEND_CONF_RSP_UNACCEPTABLE);
+        return;
+    }
+    l2cap_ertm_handle_remote_mode(channel, remote_mode);
+#endif
+}
+
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+// on unacceptable parameters, check if remote proposes another mode
+static void l2cap_signaling_handle_configure_response(l2cap_channel_t *channel, uint8_t *command){
+    uint16_t end_pos = 4 + little_endian_read_16(command, L2CAP_SIGNALING_COMMAND_LENGTH_OFFSET);
+    uint16_t pos     = 10;
+    while (pos < end_pos){
+        uint8_t option_type = command[pos] & 0x7f;
+        uint8_t length      = command[pos+1];
+        pos += 2;
+        if (option_type == L2CAP_CONFIG_OPTION_TYPE_RETRANSMISSION_AND_FLOW_CONTROL && length == 9){
+            l2cap_channel_mode_t mode = (l2cap_channel_mode_t) command[pos];
+            if (mode == L2CAP_CHANNEL_MODE_BASIC && channel->mode != L2CAP_CHANNEL_MODE_BASIC){
+                if (channel->mode_mandatory){
+                    l2cap_ertm_mode_not_supported(channel);
+                    return;
+                }
+                log_info("l2cap cid 0x%02x, remote proposes Basic mode", channel->local_cid);
+                channel->mode = L2CAP_CHANNEL_MODE_BASIC;
+            }
+        }
+        pos += length;
+    }
 }
+#endif
 
 static int l2cap_channel_ready_for_open(l2cap_channel_t *channel){
     // log_info("l2cap_channel_ready_for_open 0x%02x", channel->state_var);
@@ -1460,6 +2225,13 @@ static void l2cap_signaling_handler_channel(l2cap_channel_t *channel, uint8_t *c
                         case 4: // pending
                             l2cap_start_ertx(channel);
                             break;
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+                        case L2CAP_CONF_RESULT_UNACCEPTABLE_PARAMETERS:
+                            l2cap_signaling_handle_configure_response(channel, command);
+                            if (channel->state != L2CAP_STATE_CONFIG) break;
+                            channelStateVarSetFlag(channel, L2CAP_CHANNEL_STATE_VAR_SEND_CONF_REQ);
+                            break;
+#endif
                         default:
                             // retry on negative result
                             channelStateVarSetFlag(channel, L2CAP_CHANNEL_STATE_VAR_SEND_CONF_REQ);
@@ -1824,6 +2596,7 @@ static int l2cap_le_signaling_handler_dispatch(hci_con_handle_t handle, uint8_t
                 break;
             }            
             log_info("l2cap: %u credits for 0x%02x, now %u", new_credits, local_cid, channel->credits_outgoing);
+            l2cap_le_update_credit_starvation(channel);
             break;
 
         case DISCONNECTION_REQUEST:
@@ -1862,6 +2635,8 @@ static void l2cap_acl_handler(uint8_t packet_type, uint16_t channel, uint8_t *pa
     uint16_t channel_id = READ_L2CAP_CHANNEL_ID(packet); 
     hci_con_handle_t handle = READ_ACL_CONNECTION_HANDLE(packet);
 
+    BTSTACK_INSTRUMENTATION_ENTER(BTSTACK_INSTRUMENTATION_LAYER_L2CAP, handle, channel_id, size);
+
     switch (channel_id) {
             
 #ifdef ENABLE_CLASSIC
@@ -1891,7 +2666,9 @@ static void l2cap_acl_handler(uint8_t packet_type, uint16_t channel, uint8_t *pa
 
         case L2CAP_CID_ATTRIBUTE_PROTOCOL:
             if (fixed_channels[L2CAP_FIXED_CHANNEL_TABLE_INDEX_ATTRIBUTE_PROTOCOL].callback) {
+                BTSTACK_INSTRUMENTATION_ENTER(BTSTACK_INSTRUMENTATION_LAYER_ATT, handle, channel_id, size-COMPLETE_L2CAP_HEADER);
                 (*fixed_channels[L2CAP_FIXED_CHANNEL_TABLE_INDEX_ATTRIBUTE_PROTOCOL].callback)(ATT_DATA_PACKET, handle, &packet[COMPLETE_L2CAP_HEADER], size-COMPLETE_L2CAP_HEADER);
+                BTSTACK_INSTRUMENTATION_EXIT();
             }
             break;
 
@@ -1912,6 +2689,14 @@ static void l2cap_acl_handler(uint8_t packet_type, uint16_t channel, uint8_t *pa
             // Find channel for this channel_id and connection handle
             l2cap_channel = l2cap_get_channel_for_local_cid(channel_id);
             if (l2cap_channel) {
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+                if (l2cap_channel->mode != L2CAP_CHANNEL_MODE_BASIC){
+                    if (l2cap_channel->state == L2CAP_STATE_OPEN){
+                        l2cap_ertm_handle_pdu(l2cap_channel, packet, size);
+                    }
+                    break;
+                }
+#endif
                 l2cap_dispatch_to_channel(l2cap_channel, L2CAP_DATA_PACKET, &packet[COMPLETE_L2CAP_HEADER], size-COMPLETE_L2CAP_HEADER);
             }
 #endif
@@ -1927,8 +2712,8 @@ static void l2cap_acl_handler(uint8_t packet_type, uint16_t channel, uint8_t *pa
                 l2cap_channel->credits_incoming--;
 
                 // automatic credits
-                if (l2cap_channel->credits_incoming < L2CAP_LE_DATA_CHANNELS_AUTOMATIC_CREDITS_WATERMARK && l2cap_channel->automatic_credits){
-                    l2cap_channel->new_credits_incoming = L2CAP_LE_DATA_CHANNELS_AUTOMATIC_CREDITS_INCREMENT;
+                if (l2cap_channel->automatic_credits){
+                    l2cap_le_update_automatic_credits(l2cap_channel);
                 }
 
                 // first fragment
@@ -1954,6 +2739,8 @@ static void l2cap_acl_handler(uint8_t packet_type, uint16_t channel, uint8_t *pa
             break;
     }
 
+    BTSTACK_INSTRUMENTATION_EXIT();
+
     l2cap_run();
 }
 
@@ -1971,6 +2758,9 @@ void l2cap_finialize_channel_close(l2cap_channel_t * channel){
     l2cap_emit_channel_closed(channel);
     // discard channel
     l2cap_stop_rtx(channel);
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+    l2cap_ertm_stop_timers(channel);
+#endif
     btstack_linked_list_remove(&l2cap_channels, (btstack_linked_item_t *) channel);
     btstack_memory_l2cap_channel_free(channel);
 }
@@ -2047,12 +2837,95 @@ uint8_t l2cap_unregister_service(uint16_t psm){
 
 static void l2cap_le_notify_channel_can_send(l2cap_channel_t *channel){
     if (!channel->waiting_for_can_send_now) return;
-    if (channel->send_sdu_buffer) return;
+    if (channel->send_sdu_queue_count >= L2CAP_LE_DATA_CHANNELS_SEND_QUEUE_SIZE) return;
     channel->waiting_for_can_send_now = 0;
     log_info("L2CAP_EVENT_CHANNEL_LE_CAN_SEND_NOW local_cid 0x%x", channel->local_cid);
     l2cap_emit_simple_event_with_cid(channel, L2CAP_EVENT_LE_CAN_SEND_NOW);
 }
 
+// last PDU of current SDU passed to HCI: account latency, emit event and continue with next queued SDU
+static void l2cap_le_send_sdu_complete(l2cap_channel_t * channel){
+    uint32_t latency_ms = btstack_run_loop_get_time_ms() - channel->send_sdu_timestamp_ms;
+    channel->le_statistics.num_sdus_sent++;
+    channel->le_statistics.sdu_latency_total_ms += latency_ms;
+    if (latency_ms > channel->le_statistics.sdu_latency_max_ms){
+        channel->le_statistics.sdu_latency_max_ms = latency_ms;
+    }
+
+    channel->send_sdu_buffer = NULL;
+    if (channel->send_sdu_queue_count){
+        int index = channel->send_sdu_queue_head;
+        channel->send_sdu_buffer = channel->send_sdu_queue[index].data;
+        channel->send_sdu_len    = channel->send_sdu_queue[index].len;
+        channel->send_sdu_pos    = 0;
+        channel->send_sdu_timestamp_ms = channel->send_sdu_queue[index].timestamp_ms;
+        channel->send_sdu_queue_head = (index + 1) % L2CAP_LE_DATA_CHANNELS_SEND_QUEUE_SIZE;
+        channel->send_sdu_queue_count--;
+    }
+
+    // send done event
+    l2cap_emit_simple_event_with_cid(channel, L2CAP_EVENT_LE_PACKET_SENT);
+    // inform about can send now
+    l2cap_le_notify_channel_can_send(channel);
+}
+
+// track time with pending outgoing SDU but no credits
+static void l2cap_le_update_credit_starvation(l2cap_channel_t * channel){
+    int starved = channel->send_sdu_buffer != NULL && channel->credits_outgoing == 0;
+    if (starved == channel->credit_starvation) return;
+    uint32_t now = btstack_run_loop_get_time_ms();
+    if (starved){
+        channel->credit_starvation_start_ms = now;
+    } else {
+        channel->le_statistics.credit_starvation_ms += now - channel->credit_starvation_start_ms;
+    }
+    channel->credit_starvation = starved;
+}
+
+// nr of PDUs for a complete SDU in the receive buffer
+static uint16_t l2cap_le_credits_for_sdu(l2cap_channel_t * channel){
+    return (channel->local_mtu + 2 + L2CAP_LE_DATA_CHANNELS_LOCAL_MPS - 1) / L2CAP_LE_DATA_CHANNELS_LOCAL_MPS;
+}
+
+static void l2cap_le_setup_automatic_credits(l2cap_channel_t * channel, uint16_t initial_credits){
+    channel->automatic_credits = initial_credits == L2CAP_LE_AUTOMATIC_CREDITS;
+    if (!channel->automatic_credits){
+        channel->new_credits_incoming = initial_credits;
+        return;
+    }
+    uint16_t target = btstack_max(L2CAP_LE_DATA_CHANNELS_AUTOMATIC_CREDITS_INITIAL, l2cap_le_credits_for_sdu(channel));
+    channel->automatic_credits_target = btstack_min(target, L2CAP_LE_DATA_CHANNELS_AUTOMATIC_CREDITS_MAX);
+    channel->automatic_credits_consumed = 0;
+    channel->automatic_credits_interval_start_ms = btstack_run_loop_get_time_ms();
+    channel->new_credits_incoming = channel->automatic_credits_target;
+}
+
+// called for each received PDU: adapt target to consumption and top up outstanding credits in batches
+static void l2cap_le_update_automatic_credits(l2cap_channel_t * channel){
+    uint16_t min_credits = btstack_min(l2cap_le_credits_for_sdu(channel), L2CAP_LE_DATA_CHANNELS_AUTOMATIC_CREDITS_MAX);
+    uint32_t target = channel->automatic_credits_target;
+    uint32_t now = btstack_run_loop_get_time_ms();
+    channel->automatic_credits_consumed++;
+
+    if (channel->credits_incoming == 0 && channel->new_credits_incoming == 0){
+        // remote used up all credits before we granted new ones: it is probably waiting
+        target *= 2;
+    } else if (now - channel->automatic_credits_interval_start_ms >= L2CAP_LE_DATA_CHANNELS_AUTOMATIC_CREDITS_INTERVAL_MS){
+        // follow PDUs consumed per interval
+        target = (target + channel->automatic_credits_consumed) / 2;
+        channel->automatic_credits_consumed = 0;
+        channel->automatic_credits_interval_start_ms = now;
+    }
+    target = btstack_max(target, min_credits);
+    target = btstack_min(target, L2CAP_LE_DATA_CHANNELS_AUTOMATIC_CREDITS_MAX);
+    channel->automatic_credits_target = target;
+
+    uint32_t outstanding = channel->credits_incoming + channel->new_credits_incoming;
+    if (outstanding * 2 <= target){
+        channel->new_credits_incoming = target - channel->credits_incoming;
+    }
+}
+
 // 1BH2222
 static void l2cap_emit_le_incoming_connection(l2cap_channel_t *channel) {
     log_info("L2CAP_EVENT_LE_INCOMING_CONNECTION addr_type %u, addr %s handle 0x%x psm 0x%x local_cid 0x%x remote_cid 0x%x, remote_mtu %u",
@@ -2171,8 +3044,7 @@ uint8_t l2cap_le_accept_connection(uint16_t local_cid, uint8_t * receive_sdu_buf
     channel->state = L2CAP_STATE_WILL_SEND_LE_CONNECTION_RESPONSE_ACCEPT;
     channel->receive_sdu_buffer = receive_sdu_buffer;
     channel->local_mtu = mtu;
-    channel->new_credits_incoming = initial_credits;
-    channel->automatic_credits  = initial_credits == L2CAP_LE_AUTOMATIC_CREDITS;
+    l2cap_le_setup_automatic_credits(channel, initial_credits);
 
     // test
     // channel->new_credits_incoming = 1;
@@ -2232,8 +3104,7 @@ uint8_t l2cap_le_create_channel(btstack_packet_handler_t packet_handler, hci_con
     channel->con_handle = con_handle;
     channel->receive_sdu_buffer = receive_sdu_buffer;
     channel->state = L2CAP_STATE_WILL_SEND_LE_CONNECTION_REQUEST;
-    channel->new_credits_incoming = initial_credits;
-    channel->automatic_credits    = initial_credits == L2CAP_LE_AUTOMATIC_CREDITS;
+    l2cap_le_setup_automatic_credits(channel, initial_credits);
 
     // add to connections list
     btstack_linked_list_add(&l2cap_le_channels, (btstack_linked_item_t *) channel);
@@ -2293,7 +3164,7 @@ int l2cap_le_can_send_now(uint16_t local_cid){
     if (channel->state != L2CAP_STATE_OPEN) return 0;
 
     // check queue
-    if (channel->send_sdu_buffer) return 0;    
+    if (channel->send_sdu_queue_count >= L2CAP_LE_DATA_CHANNELS_SEND_QUEUE_SIZE) return 0;
 
     // fine, go ahead
     return 1;
@@ -2336,19 +3207,51 @@ uint8_t l2cap_le_send_data(uint16_t local_cid, uint8_t * data, uint16_t len){
         return L2CAP_DATA_LEN_EXCEEDS_REMOTE_MTU;
     }
 
-    if (channel->send_sdu_buffer){
+    if (channel->send_sdu_queue_count >= L2CAP_LE_DATA_CHANNELS_SEND_QUEUE_SIZE){
         log_info("l2cap_send cid 0x%02x, cannot send", local_cid);
         return BTSTACK_ACL_BUFFERS_FULL;
     }
 
-    channel->send_sdu_buffer = data;
-    channel->send_sdu_len    = len;
-    channel->send_sdu_pos    = 0;
+    uint32_t now = btstack_run_loop_get_time_ms();
+    if (channel->send_sdu_buffer){
+        // queue behind current SDU
+        int index = (channel->send_sdu_queue_head + channel->send_sdu_queue_count) % L2CAP_LE_DATA_CHANNELS_SEND_QUEUE_SIZE;
+        channel->send_sdu_queue[index].data = data;
+        channel->send_sdu_queue[index].len  = len;
+        channel->send_sdu_queue[index].timestamp_ms = now;
+        channel->send_sdu_queue_count++;
+    } else {
+        channel->send_sdu_buffer = data;
+        channel->send_sdu_len    = len;
+        channel->send_sdu_pos    = 0;
+        channel->send_sdu_timestamp_ms = now;
+        l2cap_le_update_credit_starvation(channel);
+    }
 
     l2cap_run();
     return 0;
 }
 
+/**
+ * @brief Get flow control counters of LE Data Channel
+ * @param local_cid             L2CAP LE Data Channel Identifier
+ * @param statistics            counters are stored here
+ */
+uint8_t l2cap_le_get_channel_statistics(uint16_t local_cid, l2cap_le_channel_statistics_t * statistics){
+    l2cap_channel_t * channel = l2cap_le_get_channel_for_local_cid(local_cid);
+    if (!channel) {
+        log_error("l2cap_le_get_channel_statistics no channel for cid 0x%02x", local_cid);
+        return L2CAP_LOCAL_CID_DOES_NOT_EXIST;
+    }
+    *statistics = channel->le_statistics;
+    statistics->automatic_credits_target = channel->automatic_credits ? channel->automatic_credits_target : 0;
+    // include ongoing starvation
+    if (channel->credit_starvation){
+        statistics->credit_starvation_ms += btstack_run_loop_get_time_ms() - channel->credit_starvation_start_ms;
+    }
+    return 0;
+}
+
 /**
  * @brief Disconnect from LE Data Channel
  * @param local_cid             L2CAP LE Data Channel Identifier
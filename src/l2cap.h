@@ -62,6 +62,73 @@ extern "C" {
 
 #define L2CAP_LE_AUTOMATIC_CREDITS 0xffff
 
+// number of outgoing SDUs that can be queued per LE Data Channel in addition to the one being sent
+#ifndef L2CAP_LE_DATA_CHANNELS_SEND_QUEUE_SIZE
+#define L2CAP_LE_DATA_CHANNELS_SEND_QUEUE_SIZE 4
+#endif
+
+// counters for tuning of LE Data Channel flow control
+typedef struct {
+    // outgoing SDUs completely passed to HCI
+    uint32_t num_sdus_sent;
+    // time from l2cap_le_send_data until last PDU of SDU has been passed to HCI
+    uint32_t sdu_latency_total_ms;
+    uint32_t sdu_latency_max_ms;
+    // time with outgoing SDU pending but no credits from remote
+    uint32_t credit_starvation_ms;
+    // number of LE Flow Control Credit packets sent to remote
+    uint32_t num_credit_grants;
+    // current number of outstanding credits targeted by automatic credits
+    uint16_t automatic_credits_target;
+} l2cap_le_channel_statistics_t;
+
+// L2CAP channel modes, values as used in Retransmission and Flow Control option
+typedef enum {
+    L2CAP_CHANNEL_MODE_BASIC                   = 0,
+    L2CAP_CHANNEL_MODE_ENHANCED_RETRANSMISSION = 3,
+    L2CAP_CHANNEL_MODE_STREAMING               = 4,
+} l2cap_channel_mode_t;
+
+// configuration for channels in Enhanced Retransmission or Streaming Mode
+typedef struct {
+    // L2CAP_CHANNEL_MODE_ENHANCED_RETRANSMISSION or L2CAP_CHANNEL_MODE_STREAMING
+    l2cap_channel_mode_t mode;
+    // close channel if remote does not accept mode, otherwise fall back to Basic mode
+    uint8_t  mode_mandatory;
+    // max number of transmissions of a single I-frame (ERTM), 0 = infinite
+    uint8_t  max_transmit;
+    uint16_t retransmission_timeout_ms;
+    uint16_t monitor_timeout_ms;
+    // max incoming SDU size
+    uint16_t local_mtu;
+    // number of I-frames that remote can send before waiting for acknowledgement
+    uint8_t  tx_window_size;
+    // number of outgoing I-frames that can be stored for (re-)transmission
+    uint8_t  num_tx_buffers;
+    // request Frame Check Sequence
+    uint8_t  fcs_option;
+} l2cap_ertm_config_t;
+
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+// outgoing I-frame kept until acknowledged
+typedef struct {
+    uint16_t len;           // payload incl. SDU length field
+    uint8_t  sar;
+    uint8_t  tx_seq;
+    uint8_t  retry_count;
+} l2cap_ertm_tx_packet_state_t;
+
+// max I-frame payload: ACL payload without L2CAP header, control field and FCS
+#define L2CAP_ERTM_MAX_MPS (HCI_ACL_PAYLOAD_SIZE - L2CAP_HEADER_SIZE - 4)
+
+// min remote MPS: start of segmented SDU carries 2 byte SDU length and at least one byte of data
+#define L2CAP_ERTM_MIN_MPS 3
+
+// buffer size required for given number of outgoing I-frames and incoming SDU size
+#define L2CAP_ERTM_BUFFER_SIZE(num_tx_buffers, local_mtu) \
+    (3 + (num_tx_buffers) * (sizeof(l2cap_ertm_tx_packet_state_t) + L2CAP_ERTM_MAX_MPS) + (local_mtu))
+#endif
+
 // private structs
 typedef enum {
     L2CAP_STATE_CLOSED = 1,           // no baseband
@@ -101,6 +168,8 @@ typedef enum {
     L2CAP_CHANNEL_STATE_VAR_SEND_CONF_RSP_INVALID = 1 << 8,   // in CONF RSP, send UNKNOWN OPTIONS
     L2CAP_CHANNEL_STATE_VAR_SEND_CMD_REJ_UNKNOWN  = 1 << 9,   // send CMD_REJ with reason unknown
     L2CAP_CHANNEL_STATE_VAR_SEND_CONN_RESP_PEND   = 1 << 10,  // send Connection Respond with pending
+    L2CAP_CHANNEL_STATE_VAR_SEND_CONF_RSP_RFC     = 1 << 11,  // in CONF RSP, add Retransmission and Flow Control field
+    L2CAP_CHANNEL_STATE_VAR_SEND_CONF_RSP_UNACCEPTABLE = 1 << 12, // in CONF RSP, send UNACCEPTABLE PARAMETERS with own mode
     L2CAP_CHANNEL_STATE_VAR_INCOMING              = 1 << 15,  // channel is incoming
 } L2CAP_CHANNEL_STATE_VAR;
 
@@ -169,6 +238,66 @@ typedef struct {
     // automatic credits incoming
     uint16_t automatic_credits;
 
+#ifdef ENABLE_LE_DATA_CHANNELS
+    // outgoing SDUs queued after current one, ring buffer
+    struct {
+        uint8_t * data;
+        uint16_t  len;
+        uint32_t  timestamp_ms;
+    } send_sdu_queue[L2CAP_LE_DATA_CHANNELS_SEND_QUEUE_SIZE];
+    uint8_t   send_sdu_queue_head;
+    uint8_t   send_sdu_queue_count;
+    uint32_t  send_sdu_timestamp_ms;
+
+    // adaptive automatic credits: PDUs consumed in current measurement interval
+    uint16_t  automatic_credits_target;
+    uint16_t  automatic_credits_consumed;
+    uint32_t  automatic_credits_interval_start_ms;
+
+    uint8_t   credit_starvation;
+    uint32_t  credit_starvation_start_ms;
+
+    l2cap_le_channel_statistics_t le_statistics;
+#endif
+
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+    // Enhanced Retransmission and Streaming Mode
+    l2cap_channel_mode_t mode;
+    uint8_t  mode_mandatory;
+    uint8_t  local_fcs_option;
+    uint8_t  remote_fcs_option;
+
+    btstack_timer_source_t retransmission_timer;
+    btstack_timer_source_t monitor_timer;
+    btstack_timer_source_t ack_timer;
+    uint16_t retransmission_timeout_ms;
+    uint16_t monitor_timeout_ms;
+
+    uint8_t  local_max_transmit;
+    uint8_t  local_tx_window_size;
+    uint8_t  remote_tx_window_size;
+
+    // outgoing I-frames: ring buffer, oldest unacknowledged frame first
+    l2cap_ertm_tx_packet_state_t * tx_packets_state;
+    uint8_t  * tx_packets_data;
+    uint8_t  num_tx_buffers;
+    uint8_t  tx_read_index;
+    uint8_t  num_stored_tx_frames;
+    uint8_t  num_unacked_tx_frames;     // stored frames that have been sent
+    uint8_t  expected_ack_seq;          // TxSeq of oldest stored frame
+    uint8_t  poll_count;
+    uint8_t  remote_busy;
+    uint8_t  wait_for_final;
+
+    // incoming I-frames
+    uint8_t  expected_tx_seq;
+    uint8_t  num_unacked_rx_frames;
+    uint8_t  reject_sent;
+
+    // pending S-frames, see L2CAP_ERTM_SEND_*
+    uint8_t  send_supervisor_frames;
+#endif
+
 } l2cap_channel_t;
 
 // info regarding potential connections
@@ -245,6 +374,21 @@ uint16_t l2cap_max_le_mtu(void);
  */
 uint8_t l2cap_create_channel(btstack_packet_handler_t packet_handler, bd_addr_t address, uint16_t psm, uint16_t mtu, uint16_t * out_local_cid);
 
+/**
+ * @brief Creates L2CAP channel in Enhanced Retransmission or Streaming Mode to the PSM of a remote device
+ * @note Requires ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE. Data is sent with l2cap_send as for Basic mode channels
+ * @param packet_handler
+ * @param address
+ * @param psm
+ * @param ertm_config
+ * @param buffer used for outgoing I-frames and reassembly of incoming SDUs, needs to stay valid until channel is closed
+ * @param size of buffer, see L2CAP_ERTM_BUFFER_SIZE
+ * @param out_local_cid
+ * @return status
+ */
+uint8_t l2cap_create_ertm_channel(btstack_packet_handler_t packet_handler, bd_addr_t address, uint16_t psm,
+    l2cap_ertm_config_t * ertm_config, uint8_t * buffer, uint32_t size, uint16_t * out_local_cid);
+
 /** 
  * @brief Disconnects L2CAP channel with given identifier. 
  */
@@ -275,6 +419,17 @@ uint8_t l2cap_unregister_service(uint16_t psm);
  */
 void l2cap_accept_connection(uint16_t local_cid);
 
+/**
+ * @brief Accepts incoming L2CAP connection in Enhanced Retransmission or Streaming Mode
+ * @note Requires ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+ * @param local_cid
+ * @param ertm_config
+ * @param buffer used for outgoing I-frames and reassembly of incoming SDUs, needs to stay valid until channel is closed
+ * @param size of buffer, see L2CAP_ERTM_BUFFER_SIZE
+ * @return status
+ */
+uint8_t l2cap_accept_ertm_connection(uint16_t local_cid, l2cap_ertm_config_t * ertm_config, uint8_t * buffer, uint32_t size);
+
 /** 
  * @brief Deny incoming L2CAP connection.
  */
@@ -390,13 +545,21 @@ uint8_t l2cap_le_request_can_send_now_event(uint16_t cid);
 
 /**
  * @brief Send data via LE Data Channel
- * @note Since data larger then the maximum PDU needs to be segmented into multiple PDUs, data needs to stay valid until ... event
+ * @note Since data larger then the maximum PDU needs to be segmented into multiple PDUs, data needs to stay valid until L2CAP_EVENT_LE_PACKET_SENT
+ *       Up to L2CAP_LE_DATA_CHANNELS_SEND_QUEUE_SIZE SDUs can be queued while another one is sent, one L2CAP_EVENT_LE_PACKET_SENT is emitted per SDU
  * @param local_cid             L2CAP LE Data Channel Identifier
  * @param data                  data to send
  * @param size                  data size
  */
 uint8_t l2cap_le_send_data(uint16_t cid, uint8_t * data, uint16_t size);
 
+/**
+ * @brief Get flow control counters of LE Data Channel
+ * @param local_cid             L2CAP LE Data Channel Identifier
+ * @param statistics            counters are stored here
+ */
+uint8_t l2cap_le_get_channel_statistics(uint16_t cid, l2cap_le_channel_statistics_t * statistics);
+
 /**
  * @brief Disconnect from LE Data Channel
  * @param local_cid             L2CAP LE Data Channel Identifier
@@ -0,0 +1,80 @@
+// Measures the cost of resolving a resolvable private address on the host with btstack_aes128_calc:
+// time per AES-128 block and per full resolution pass over a growing number of IRKs,
+// with the matching IRK stored last as the worst case.
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "btstack_aes128.h"
+#include "btstack_util.h"
+
+#define NUM_ITERATIONS 100000
+#define MAX_IRKS 128
+
+static uint8_t irks[MAX_IRKS][16];
+
+static uint64_t get_time_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// ah(k, r) = e(k, r') mod 2^24, compared against hash part of address
+static int ah_matches(const uint8_t * irk, const uint8_t * address){
+    uint8_t r_prime[16];
+    uint8_t ciphertext[16];
+    memset(r_prime, 0, 13);
+    memcpy(&r_prime[13], address, 3);
+    btstack_aes128_calc(irk, r_prime, ciphertext);
+    return memcmp(&ciphertext[13], &address[3], 3) == 0;
+}
+
+static void run(int num_irks){
+    // address resolvable with last IRK
+    uint8_t address[6] = { 0x70, 0x81, 0x94, 0, 0, 0 };
+    uint8_t r_prime[16];
+    uint8_t ciphertext[16];
+    memset(r_prime, 0, 13);
+    memcpy(&r_prime[13], address, 3);
+    btstack_aes128_calc(irks[num_irks-1], r_prime, ciphertext);
+    memcpy(&address[3], &ciphertext[13], 3);
+
+    int resolved = 0;
+    int iterations = NUM_ITERATIONS / num_irks;
+    uint64_t start = get_time_ns();
+    int i;
+    for (i = 0; i < iterations; i++){
+        int j;
+        for (j = 0; j < num_irks; j++){
+            if (ah_matches(irks[j], address)) break;
+        }
+        if (j == num_irks - 1){
+            resolved++;
+        }
+    }
+    uint64_t duration = get_time_ns() - start;
+
+    printf("%3u IRKs: %9.1f ns per resolution, %6.1f ns per block (%u resolved)\n", num_irks,
+        (double) duration / iterations, (double) duration / (iterations * num_irks), resolved);
+}
+
+int main(int argc, const char * argv[]){
+    UNUSED(argc);
+    (void) argv;
+
+    int i;
+    for (i = 0; i < MAX_IRKS; i++){
+        int j;
+        for (j = 0; j < 16; j++){
+            irks[i][j] = (uint8_t) (i * 31 + j * 7 + 1);
+        }
+    }
+
+    const int num_irks[] = { 1, 8, 32, 128 };
+    unsigned int k;
+    for (k = 0; k < sizeof(num_irks) / sizeof(int); k++){
+        run(num_irks[k]);
+    }
+    return 0;
+}
@@ -0,0 +1,75 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "CppUTest/TestHarness.h"
+#include "CppUTest/CommandLineTestRunner.h"
+
+#include "btstack_aes128.h"
+#include "btstack_util.h"
+
+static void parse_hex(uint8_t * buffer, const char * hex_string){
+    while (*hex_string){
+        int high_nibble = nibble_for_char(*hex_string++);
+        int low_nibble  = nibble_for_char(*hex_string++);
+        *buffer++ = (high_nibble << 4) | low_nibble;
+    }
+}
+
+static void check_aes128(const char * key_string, const char * plaintext_string, const char * ciphertext_string){
+    uint8_t key[16];
+    uint8_t plaintext[16];
+    uint8_t expected[16];
+    uint8_t ciphertext[16];
+    parse_hex(key, key_string);
+    parse_hex(plaintext, plaintext_string);
+    parse_hex(expected, ciphertext_string);
+    btstack_aes128_calc(key, plaintext, ciphertext);
+    MEMCMP_EQUAL(expected, ciphertext, 16);
+}
+
+TEST_GROUP(AES128){
+};
+
+// FIPS-197, Appendix C.1
+TEST(AES128, FIPS197){
+    check_aes128("000102030405060708090a0b0c0d0e0f", "00112233445566778899aabbccddeeff", "69c4e0d86a7b0430d8cdb78070b4c55a");
+}
+
+// NIST SP 800-38A, F.1.1 ECB-AES128.Encrypt
+TEST(AES128, SP800_38A){
+    check_aes128("2b7e151628aed2a6abf7158809cf4f3c", "6bc1bee22e409f96e93d7e117393172a", "3ad77bb40d7a3660a89ecaf32466ef97");
+    check_aes128("2b7e151628aed2a6abf7158809cf4f3c", "ae2d8a571e03ac9c9eb76fac45af8e51", "f5d3d58503b9699de785895a96fdbaaf");
+    check_aes128("2b7e151628aed2a6abf7158809cf4f3c", "30c81c46a35ce411e5fbc1191a0a52ef", "43b1cd7f598ece23881b00e3ed030688");
+    check_aes128("2b7e151628aed2a6abf7158809cf4f3c", "f69f2445df4f9b17ad2b417be66c3710", "7b0c785e27e8ad3f8223207104725dd4");
+}
+
+// Bluetooth Core Spec, Vol 3, Part H, Appendix D.7 - random address hash function ah
+TEST(AES128, AH){
+    uint8_t irk[16];
+    uint8_t r_prime[16];
+    uint8_t ciphertext[16];
+    parse_hex(irk, "ec0234a357c8ad05341010a60a397d9b");
+    memset(r_prime, 0, 16);
+    r_prime[13] = 0x70;
+    r_prime[14] = 0x81;
+    r_prime[15] = 0x94;
+    btstack_aes128_calc(irk, r_prime, ciphertext);
+    const uint8_t expected_hash[] = { 0x0d, 0xfb, 0xaa };
+    MEMCMP_EQUAL(expected_hash, &ciphertext[13], 3);
+}
+
+TEST(AES128, InPlace){
+    uint8_t key[16];
+    uint8_t block[16];
+    uint8_t expected[16];
+    parse_hex(key, "000102030405060708090a0b0c0d0e0f");
+    parse_hex(block, "00112233445566778899aabbccddeeff");
+    parse_hex(expected, "69c4e0d86a7b0430d8cdb78070b4c55a");
+    btstack_aes128_calc(key, block, block);
+    MEMCMP_EQUAL(expected, block, 16);
+}
+
+int main (int argc, const char * argv[]){
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
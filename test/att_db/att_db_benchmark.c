@@ -0,0 +1,130 @@
+// Measures cost of a full primary service discovery followed by characteristic
+// discovery for each service, using linear scan, the index built by att_set_db
+// and the index generated by compile_gatt.py for example/profile.gatt, as well
+// as for a large database created with att_db_util.
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "ble/att_db.h"
+#include "ble/att_db_util.h"
+#include "bluetooth.h"
+#include "btstack_util.h"
+
+#include "profile.h"
+
+#define NUM_ITERATIONS 20000
+#define MAX_SERVICES   64
+
+static att_connection_t att_connection;
+static uint8_t response[ATT_DEFAULT_MTU];
+
+static uint64_t get_time_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint16_t att_request(uint8_t request_type, uint16_t start_handle, uint16_t end_handle, uint16_t uuid16){
+    uint8_t request[7];
+    request[0] = request_type;
+    little_endian_store_16(request, 1, start_handle);
+    little_endian_store_16(request, 3, end_handle);
+    little_endian_store_16(request, 5, uuid16);
+    return att_handle_request(&att_connection, request, sizeof(request), response);
+}
+
+// returns number of ATT requests
+static int discover(void){
+    uint16_t service_ranges[2 * MAX_SERVICES];
+    int num_services = 0;
+    int num_requests = 0;
+
+    // primary services
+    uint16_t start_handle = 0x0001;
+    while (1){
+        uint16_t len = att_request(ATT_READ_BY_GROUP_TYPE_REQUEST, start_handle, 0xffff, GATT_PRIMARY_SERVICE_UUID);
+        num_requests++;
+        if (response[0] != ATT_READ_BY_GROUP_TYPE_RESPONSE) break;
+        uint16_t pair_len = response[1];
+        uint16_t pos;
+        uint16_t end_handle = 0;
+        for (pos = 2; pos + pair_len <= len; pos += pair_len){
+            end_handle = little_endian_read_16(response, pos + 2);
+            if (num_services < MAX_SERVICES){
+                service_ranges[2 * num_services]     = little_endian_read_16(response, pos);
+                service_ranges[2 * num_services + 1] = end_handle;
+                num_services++;
+            }
+        }
+        if (end_handle == 0xffff) break;
+        start_handle = end_handle + 1;
+    }
+
+    // characteristics of each service
+    int i;
+    for (i = 0; i < num_services; i++){
+        start_handle = service_ranges[2 * i];
+        uint16_t end_handle = service_ranges[2 * i + 1];
+        while (start_handle <= end_handle){
+            uint16_t len = att_request(ATT_READ_BY_TYPE_REQUEST, start_handle, end_handle, GATT_CHARACTERISTICS_UUID);
+            num_requests++;
+            if (response[0] != ATT_READ_BY_TYPE_RESPONSE) break;
+            uint16_t pair_len = response[1];
+            uint16_t last_handle = little_endian_read_16(response, len - pair_len);
+            if (last_handle == 0xffff) break;
+            start_handle = last_handle + 1;
+        }
+    }
+    return num_requests;
+}
+
+static void run(const char * name){
+    int num_requests = 0;
+    uint64_t start = get_time_ns();
+    int i;
+    for (i = 0; i < NUM_ITERATIONS; i++){
+        num_requests += discover();
+    }
+    uint64_t duration = get_time_ns() - start;
+    printf("%-32s %8.1f ns per discovery, %6.1f ns per request\n", name,
+        (double) duration / NUM_ITERATIONS, (double) duration / num_requests);
+}
+
+int main(int argc, const char * argv[]){
+    UNUSED(argc);
+    (void) argv;
+
+    memset(&att_connection, 0, sizeof(att_connection));
+    att_connection.mtu = ATT_DEFAULT_MTU;
+    att_connection.max_mtu = ATT_DEFAULT_MTU;
+
+    printf("example/profile.gatt:\n");
+    att_set_db(profile_data);
+    att_set_db_index(NULL);
+    run("linear scan");
+    att_set_db(profile_data);
+    run("index built by att_set_db");
+    att_set_db_index(profile_data_index);
+    run("index from compile_gatt.py");
+
+    // 40 services with 4 notifiable characteristics each = 520 attributes
+    att_db_util_init();
+    int i;
+    for (i = 0; i < 40; i++){
+        att_db_util_add_service_uuid16(0x1800 + i);
+        int j;
+        for (j = 0; j < 4; j++){
+            uint8_t value[2] = { 0, 0 };
+            att_db_util_add_characteristic_uuid16(0x2a00 + i * 4 + j, ATT_PROPERTY_READ | ATT_PROPERTY_NOTIFY, value, sizeof(value));
+        }
+    }
+    printf("att_db_util, 520 attributes:\n");
+    att_set_db(att_db_util_get_address());
+    att_set_db_index(NULL);
+    run("linear scan");
+    att_set_db(att_db_util_get_address());
+    run("index built by att_set_db");
+    return 0;
+}
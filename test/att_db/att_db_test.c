@@ -0,0 +1,372 @@
+/*
+ * Copyright (C) 2014 BlueKitchen GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 4. Any redistribution, use, or modification is done solely for
+ *    personal benefit and not for any commercial purpose or for
+ *    monetary gain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BLUEKITCHEN GMBH AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MATTHIAS
+ * RINGWALD OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Please inquire about commercial licensing options at 
+ * contact@bluekitchen-gmbh.com
+ *
+ */
+ 
+// *****************************************************************************
+//
+// test ATT requests against ATT DB, built with and without ENABLE_ATT_DB_INDEX
+//
+// *****************************************************************************
+
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "CppUTest/TestHarness.h"
+#include "CppUTest/CommandLineTestRunner.h"
+
+#include "ble/att_db.h"
+#include "ble/att_db_util.h"
+#include "btstack_util.h"
+#include "bluetooth.h"
+
+#ifdef ENABLE_ATT_DB_INDEX
+// generated from example/profile.gatt
+#include "profile.h"
+#endif
+
+// 12345678-1234-5678-1234-56789ABCDEF0
+static uint8_t custom_service_uuid[] = { 0x12, 0x34, 0x56, 0x78, 0x12, 0x34, 0x56, 0x78, 0x12, 0x34, 0x56, 0x78, 0x9A, 0xBC, 0xDE, 0xF0};
+// 12345678-1234-5678-1234-56789ABCDEF1
+static uint8_t custom_characteristic_uuid[] = { 0x12, 0x34, 0x56, 0x78, 0x12, 0x34, 0x56, 0x78, 0x12, 0x34, 0x56, 0x78, 0x9A, 0xBC, 0xDE, 0xF1};
+
+// handles with gaps, db from compile_gatt.py with manually assigned handles
+static const uint8_t sparse_db[] = {
+    // 0x0001 PRIMARY_SERVICE-GAP_SERVICE
+    0x0a, 0x00, 0x02, 0x00, 0x01, 0x00, 0x00, 0x28, 0x00, 0x18,
+    // 0x0002 CHARACTERISTIC-GAP_DEVICE_NAME-READ
+    0x0d, 0x00, 0x02, 0x00, 0x02, 0x00, 0x03, 0x28, 0x02, 0x05, 0x00, 0x00, 0x2a,
+    // 0x0005 VALUE-GAP_DEVICE_NAME-READ-'A'
+    0x09, 0x00, 0x02, 0x00, 0x05, 0x00, 0x00, 0x2a, 0x41,
+    // 0x0009 PRIMARY_SERVICE-GATT_SERVICE
+    0x0a, 0x00, 0x02, 0x00, 0x09, 0x00, 0x00, 0x28, 0x01, 0x18,
+    // END
+    0x00, 0x00,
+};
+
+static att_connection_t att_connection;
+static uint8_t att_response[ATT_DEFAULT_MTU];
+static uint16_t att_response_len;
+
+static uint16_t att_read_callback(hci_con_handle_t con_handle, uint16_t attribute_handle, uint16_t offset, uint8_t * buffer, uint16_t buffer_size){
+    UNUSED(con_handle);
+    UNUSED(offset);
+    if (buffer && buffer_size >= 2){
+        little_endian_store_16(buffer, 0, attribute_handle);
+    }
+    return 2;
+}
+
+static void att_request(const uint8_t * request, uint16_t request_len){
+    uint8_t request_buffer[ATT_DEFAULT_MTU];
+    memcpy(request_buffer, request, request_len);
+    att_response_len = att_handle_request(&att_connection, request_buffer, request_len, att_response);
+}
+
+static void CHECK_RESPONSE(const uint8_t * expected, uint16_t expected_len){
+    CHECK_EQUAL(expected_len, att_response_len);
+    for (int i=0; i<expected_len; i++){
+        BYTES_EQUAL(expected[i], att_response[i]);
+    }
+}
+
+TEST_GROUP(AttDb){
+    void setup(void){
+        memset(&att_connection, 0, sizeof(att_connection));
+        att_connection.mtu = ATT_DEFAULT_MTU;
+        att_connection.max_mtu = ATT_DEFAULT_MTU;
+
+        // 0x0001 - 0x0003: GAP service, device name
+        // 0x0004 - 0x0007: Battery service, battery level + CCC
+        // 0x0008 - 0x000d: custom service, custom characteristic, heart rate measurement + CCC
+        att_db_util_init();
+        att_db_util_add_service_uuid16(GAP_SERVICE_UUID);
+        att_db_util_add_characteristic_uuid16(GAP_DEVICE_NAME_UUID, ATT_PROPERTY_READ, (uint8_t*)"BTstack", 7);
+        att_db_util_add_service_uuid16(0x180f);
+        uint8_t battery_level = 100;
+        att_db_util_add_characteristic_uuid16(0x2a19, ATT_PROPERTY_READ | ATT_PROPERTY_NOTIFY, &battery_level, 1);
+        att_db_util_add_service_uuid128(custom_service_uuid);
+        uint8_t custom_value[] = { 1, 2, 3, 4 };
+        att_db_util_add_characteristic_uuid128(custom_characteristic_uuid, ATT_PROPERTY_READ, custom_value, sizeof(custom_value));
+        uint8_t heart_rate = 0;
+        att_db_util_add_characteristic_uuid16(0x2a37, ATT_PROPERTY_READ | ATT_PROPERTY_NOTIFY, &heart_rate, 1);
+        att_set_db(att_db_util_get_address());
+        att_set_read_callback(&att_read_callback);
+    }
+};
+
+TEST(AttDb, ReadRequest){
+    const uint8_t request[] = { ATT_READ_REQUEST, 0x03, 0x00 };
+    att_request(request, sizeof(request));
+    const uint8_t expected[] = { ATT_READ_RESPONSE, 'B', 'T', 's', 't', 'a', 'c', 'k' };
+    CHECK_RESPONSE(expected, sizeof(expected));
+}
+
+TEST(AttDb, ReadRequestDynamic){
+    const uint8_t request[] = { ATT_READ_REQUEST, 0x0d, 0x00 };
+    att_request(request, sizeof(request));
+    const uint8_t expected[] = { ATT_READ_RESPONSE, 0x0d, 0x00 };
+    CHECK_RESPONSE(expected, sizeof(expected));
+}
+
+TEST(AttDb, ReadRequestInvalidHandle){
+    const uint8_t request[] = { ATT_READ_REQUEST, 0x0e, 0x00 };
+    att_request(request, sizeof(request));
+    const uint8_t expected[] = { ATT_ERROR_RESPONSE, ATT_READ_REQUEST, 0x0e, 0x00, ATT_ERROR_INVALID_HANDLE };
+    CHECK_RESPONSE(expected, sizeof(expected));
+}
+
+TEST(AttDb, ReadByGroupTypePrimaryServices){
+    const uint8_t request[] = { ATT_READ_BY_GROUP_TYPE_REQUEST, 0x01, 0x00, 0xff, 0xff, 0x00, 0x28 };
+    att_request(request, sizeof(request));
+    // stops before custom service as value length differs
+    const uint8_t expected[] = { ATT_READ_BY_GROUP_TYPE_RESPONSE, 6,
+        0x01, 0x00, 0x03, 0x00, 0x00, 0x18,
+        0x04, 0x00, 0x07, 0x00, 0x0f, 0x18 };
+    CHECK_RESPONSE(expected, sizeof(expected));
+}
+
+TEST(AttDb, ReadByGroupTypePrimaryServicesUUID128){
+    const uint8_t request[] = { ATT_READ_BY_GROUP_TYPE_REQUEST, 0x08, 0x00, 0xff, 0xff, 0x00, 0x28 };
+    att_request(request, sizeof(request));
+    uint8_t expected[22] = { ATT_READ_BY_GROUP_TYPE_RESPONSE, 20, 0x08, 0x00, 0x0d, 0x00 };
+    reverse_128(custom_service_uuid, &expected[6]);
+    CHECK_RESPONSE(expected, sizeof(expected));
+}
+
+TEST(AttDb, ReadByGroupTypeGroupEndsAfterRange){
+    const uint8_t request[] = { ATT_READ_BY_GROUP_TYPE_REQUEST, 0x02, 0x00, 0x05, 0x00, 0x00, 0x28 };
+    att_request(request, sizeof(request));
+    const uint8_t expected[] = { ATT_READ_BY_GROUP_TYPE_RESPONSE, 6,
+        0x04, 0x00, 0x07, 0x00, 0x0f, 0x18 };
+    CHECK_RESPONSE(expected, sizeof(expected));
+}
+
+TEST(AttDb, ReadByGroupTypeUnsupportedGroupType){
+    const uint8_t request[] = { ATT_READ_BY_GROUP_TYPE_REQUEST, 0x01, 0x00, 0xff, 0xff, 0x03, 0x28 };
+    att_request(request, sizeof(request));
+    const uint8_t expected[] = { ATT_ERROR_RESPONSE, ATT_READ_BY_GROUP_TYPE_REQUEST, 0x01, 0x00, ATT_ERROR_UNSUPPORTED_GROUP_TYPE };
+    CHECK_RESPONSE(expected, sizeof(expected));
+}
+
+TEST(AttDb, FindByTypeValue){
+    const uint8_t request[] = { ATT_FIND_BY_TYPE_VALUE_REQUEST, 0x01, 0x00, 0xff, 0xff, 0x00, 0x28, 0x0f, 0x18 };
+    att_request(request, sizeof(request));
+    const uint8_t expected[] = { ATT_FIND_BY_TYPE_VALUE_RESPONSE, 0x04, 0x00, 0x07, 0x00 };
+    CHECK_RESPONSE(expected, sizeof(expected));
+}
+
+TEST(AttDb, FindByTypeValueNotFound){
+    const uint8_t request[] = { ATT_FIND_BY_TYPE_VALUE_REQUEST, 0x02, 0x00, 0xff, 0xff, 0x00, 0x28, 0x00, 0x18 };
+    att_request(request, sizeof(request));
+    const uint8_t expected[] = { ATT_ERROR_RESPONSE, ATT_FIND_BY_TYPE_VALUE_REQUEST, 0x02, 0x00, ATT_ERROR_ATTRIBUTE_NOT_FOUND };
+    CHECK_RESPONSE(expected, sizeof(expected));
+}
+
+TEST(AttDb, ReadByTypeCharacteristics){
+    const uint8_t request[] = { ATT_READ_BY_TYPE_REQUEST, 0x01, 0x00, 0xff, 0xff, 0x03, 0x28 };
+    att_request(request, sizeof(request));
+    // stops before custom characteristic as value length differs
+    const uint8_t expected[] = { ATT_READ_BY_TYPE_RESPONSE, 7,
+        0x02, 0x00, ATT_PROPERTY_READ, 0x03, 0x00, 0x00, 0x2a,
+        0x05, 0x00, ATT_PROPERTY_READ | ATT_PROPERTY_NOTIFY, 0x06, 0x00, 0x19, 0x2a };
+    CHECK_RESPONSE(expected, sizeof(expected));
+}
+
+TEST(AttDb, ReadByTypeCharacteristicsInRange){
+    const uint8_t request[] = { ATT_READ_BY_TYPE_REQUEST, 0x0b, 0x00, 0x0d, 0x00, 0x03, 0x28 };
+    att_request(request, sizeof(request));
+    const uint8_t expected[] = { ATT_READ_BY_TYPE_RESPONSE, 7,
+        0x0b, 0x00, ATT_PROPERTY_READ | ATT_PROPERTY_NOTIFY, 0x0c, 0x00, 0x37, 0x2a };
+    CHECK_RESPONSE(expected, sizeof(expected));
+}
+
+TEST(AttDb, ReadByTypeUUID128){
+    uint8_t request[21] = { ATT_READ_BY_TYPE_REQUEST, 0x01, 0x00, 0xff, 0xff };
+    reverse_128(custom_characteristic_uuid, &request[5]);
+    att_request(request, sizeof(request));
+    const uint8_t expected[] = { ATT_READ_BY_TYPE_RESPONSE, 6, 0x0a, 0x00, 1, 2, 3, 4 };
+    CHECK_RESPONSE(expected, sizeof(expected));
+}
+
+TEST(AttDb, ReadByTypeBluetoothBaseUUID128){
+    // 00002A19-0000-1000-8000-00805F9B34FB
+    uint8_t uuid128[16];
+    uuid_add_bluetooth_prefix(uuid128, 0x2a19);
+    uint8_t request[21] = { ATT_READ_BY_TYPE_REQUEST, 0x01, 0x00, 0xff, 0xff };
+    reverse_128(uuid128, &request[5]);
+    att_request(request, sizeof(request));
+    const uint8_t expected[] = { ATT_READ_BY_TYPE_RESPONSE, 3, 0x06, 0x00, 100 };
+    CHECK_RESPONSE(expected, sizeof(expected));
+}
+
+TEST(AttDb, ReadByTypeDynamic){
+    const uint8_t request[] = { ATT_READ_BY_TYPE_REQUEST, 0x01, 0x00, 0xff, 0xff, 0x02, 0x29 };
+    att_request(request, sizeof(request));
+    const uint8_t expected[] = { ATT_READ_BY_TYPE_RESPONSE, 4, 0x07, 0x00, 0x07, 0x00, 0x0d, 0x00, 0x0d, 0x00 };
+    CHECK_RESPONSE(expected, sizeof(expected));
+}
+
+TEST(AttDb, ReadByTypeNotFound){
+    const uint8_t request[] = { ATT_READ_BY_TYPE_REQUEST, 0x08, 0x00, 0x0a, 0x00, 0x19, 0x2a };
+    att_request(request, sizeof(request));
+    const uint8_t expected[] = { ATT_ERROR_RESPONSE, ATT_READ_BY_TYPE_REQUEST, 0x08, 0x00, ATT_ERROR_ATTRIBUTE_NOT_FOUND };
+    CHECK_RESPONSE(expected, sizeof(expected));
+}
+
+TEST(AttDb, FindInformation){
+    const uint8_t request[] = { ATT_FIND_INFORMATION_REQUEST, 0x05, 0x00, 0x09, 0x00 };
+    att_request(request, sizeof(request));
+    // stops before custom characteristic with UUID128
+    const uint8_t expected[] = { ATT_FIND_INFORMATION_REPLY, 0x01,
+        0x05, 0x00, 0x03, 0x28,
+        0x06, 0x00, 0x19, 0x2a,
+        0x07, 0x00, 0x02, 0x29,
+        0x08, 0x00, 0x00, 0x28,
+        0x09, 0x00, 0x03, 0x28 };
+    CHECK_RESPONSE(expected, sizeof(expected));
+}
+
+TEST(AttDb, FindInformationUUID128){
+    const uint8_t request[] = { ATT_FIND_INFORMATION_REQUEST, 0x0a, 0x00, 0xff, 0xff };
+    att_request(request, sizeof(request));
+    uint8_t expected[20] = { ATT_FIND_INFORMATION_REPLY, 0x02, 0x0a, 0x00 };
+    reverse_128(custom_characteristic_uuid, &expected[4]);
+    CHECK_RESPONSE(expected, sizeof(expected));
+}
+
+TEST(AttDb, GattServerHelpers){
+    uint16_t start_handle = 0;
+    uint16_t end_handle = 0;
+    CHECK_EQUAL(1, gatt_server_get_get_handle_range_for_service_with_uuid16(0x180f, &start_handle, &end_handle));
+    CHECK_EQUAL(0x0004, start_handle);
+    CHECK_EQUAL(0x0007, end_handle);
+    CHECK_EQUAL(0x0006, gatt_server_get_value_handle_for_characteristic_with_uuid16(start_handle, end_handle, 0x2a19));
+    CHECK_EQUAL(0x0007, gatt_server_get_client_configuration_handle_for_characteristic_with_uuid16(start_handle, end_handle, 0x2a19));
+    CHECK_EQUAL(0x000c, gatt_server_get_value_handle_for_characteristic_with_uuid16(0x0008, 0xffff, 0x2a37));
+    CHECK_EQUAL(0x000d, gatt_server_get_client_configuration_handle_for_characteristic_with_uuid16(0x0008, 0xffff, 0x2a37));
+    CHECK_EQUAL(0, gatt_server_get_value_handle_for_characteristic_with_uuid16(0x0008, 0xffff, 0x2a19));
+    CHECK_EQUAL(0, gatt_server_get_get_handle_range_for_service_with_uuid16(0x180d, &start_handle, &end_handle));
+}
+
+TEST(AttDb, UUIDForHandle){
+    CHECK_EQUAL(0x2a19, att_uuid_for_handle(0x0006));
+    CHECK_EQUAL(0, att_uuid_for_handle(0x000a));
+    CHECK_EQUAL(0, att_uuid_for_handle(0x0020));
+}
+
+static void check_sparse_db(void){
+
+    const uint8_t read_request[] = { ATT_READ_REQUEST, 0x05, 0x00 };
+    att_request(read_request, sizeof(read_request));
+    const uint8_t read_expected[] = { ATT_READ_RESPONSE, 'A' };
+    CHECK_RESPONSE(read_expected, sizeof(read_expected));
+
+    const uint8_t invalid_request[] = { ATT_READ_REQUEST, 0x04, 0x00 };
+    att_request(invalid_request, sizeof(invalid_request));
+    const uint8_t invalid_expected[] = { ATT_ERROR_RESPONSE, ATT_READ_REQUEST, 0x04, 0x00, ATT_ERROR_INVALID_HANDLE };
+    CHECK_RESPONSE(invalid_expected, sizeof(invalid_expected));
+
+    const uint8_t info_request[] = { ATT_FIND_INFORMATION_REQUEST, 0x03, 0x00, 0x08, 0x00 };
+    att_request(info_request, sizeof(info_request));
+    const uint8_t info_expected[] = { ATT_FIND_INFORMATION_REPLY, 0x01, 0x05, 0x00, 0x00, 0x2a };
+    CHECK_RESPONSE(info_expected, sizeof(info_expected));
+
+    const uint8_t group_request[] = { ATT_READ_BY_GROUP_TYPE_REQUEST, 0x01, 0x00, 0xff, 0xff, 0x00, 0x28 };
+    att_request(group_request, sizeof(group_request));
+    const uint8_t group_expected[] = { ATT_READ_BY_GROUP_TYPE_RESPONSE, 6,
+        0x01, 0x00, 0x05, 0x00, 0x00, 0x18,
+        0x09, 0x00, 0x09, 0x00, 0x01, 0x18 };
+    CHECK_RESPONSE(group_expected, sizeof(group_expected));
+}
+
+TEST(AttDb, SparseHandles){
+    att_set_db(sparse_db);
+    check_sparse_db();
+}
+
+#ifdef ENABLE_ATT_DB_INDEX
+TEST(AttDb, GeneratedIndexDiscovery){
+    att_set_db(profile_data);
+    att_set_db_index(profile_data_index);
+
+    const uint8_t services_request[] = { ATT_READ_BY_GROUP_TYPE_REQUEST, 0x01, 0x00, 0xff, 0xff, 0x00, 0x28 };
+    att_request(services_request, sizeof(services_request));
+    const uint8_t services_expected[] = { ATT_READ_BY_GROUP_TYPE_RESPONSE, 6,
+        0x01, 0x00, 0x05, 0x00, 0x00, 0x18,
+        0x06, 0x00, 0x08, 0x00, 0x01, 0x18,
+        0x09, 0x00, 0x0f, 0x00, 0xf0, 0xff };
+    CHECK_RESPONSE(services_expected, sizeof(services_expected));
+
+    // stops before characteristic with UUID128
+    const uint8_t characteristics_request[] = { ATT_READ_BY_TYPE_REQUEST, 0x09, 0x00, 0x0f, 0x00, 0x03, 0x28 };
+    att_request(characteristics_request, sizeof(characteristics_request));
+    const uint8_t characteristics_expected[] = { ATT_READ_BY_TYPE_RESPONSE, 7,
+        0x0a, 0x00, ATT_PROPERTY_READ | ATT_PROPERTY_WRITE, 0x0b, 0x00, 0xf1, 0xff,
+        0x0c, 0x00, ATT_PROPERTY_READ | ATT_PROPERTY_WRITE, 0x0d, 0x00, 0xf2, 0xff };
+    CHECK_RESPONSE(characteristics_expected, sizeof(characteristics_expected));
+
+    // UUID128 based on Bluetooth Base UUID is found by its UUID16
+    const uint8_t value_request[] = { ATT_READ_BY_TYPE_REQUEST, 0x01, 0x00, 0xff, 0xff, 0x34, 0x12 };
+    att_request(value_request, sizeof(value_request));
+    const uint8_t value_expected[] = { ATT_READ_BY_TYPE_RESPONSE, 4, 0x0f, 0x00, 0x0f, 0x00 };
+    CHECK_RESPONSE(value_expected, sizeof(value_expected));
+
+    const uint8_t find_request[] = { ATT_FIND_BY_TYPE_VALUE_REQUEST, 0x01, 0x00, 0xff, 0xff, 0x00, 0x28, 0x01, 0x18 };
+    att_request(find_request, sizeof(find_request));
+    const uint8_t find_expected[] = { ATT_FIND_BY_TYPE_VALUE_RESPONSE, 0x06, 0x00, 0x08, 0x00 };
+    CHECK_RESPONSE(find_expected, sizeof(find_expected));
+}
+
+TEST(AttDb, GeneratedIndexMismatch){
+    // index is ignored if it doesn't match db
+    att_set_db(sparse_db);
+    att_set_db_index(profile_data_index);
+    check_sparse_db();
+}
+
+TEST(AttDb, IndexDisabled){
+    att_set_db(sparse_db);
+    att_set_db_index(NULL);
+    check_sparse_db();
+}
+#endif
+
+int main (int argc, const char * argv[]){
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
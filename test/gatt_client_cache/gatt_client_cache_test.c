@@ -0,0 +1,557 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "CppUTest/TestHarness.h"
+#include "CppUTest/CommandLineTestRunner.h"
+
+#include "btstack_config.h"
+#include "btstack_event.h"
+#include "btstack_memory.h"
+#include "btstack_run_loop.h"
+#include "btstack_util.h"
+#include "gap.h"
+#include "hci.h"
+#include "hci_dump.h"
+#include "l2cap.h"
+#include "ble/gatt_client.h"
+#include "ble/le_device_db.h"
+#include "ble/sm.h"
+
+#define HANDLE_A 0x0040
+
+// mock GATT server: GAP service with Device Name and Appearance, GATT service with Service Changed
+
+typedef struct {
+    uint16_t handle;
+    uint16_t type;
+    uint16_t value_handle;  // characteristic declaration
+    uint16_t uuid16;        // service or characteristic uuid
+    uint16_t end_handle;    // service
+} attribute_t;
+
+static const attribute_t attributes[] = {
+    { 0x0001, GATT_PRIMARY_SERVICE_UUID,          0,      GAP_SERVICE_UUID,     0x0005 },
+    { 0x0002, GATT_CHARACTERISTICS_UUID,          0x0003, GAP_DEVICE_NAME_UUID, 0 },
+    { 0x0003, GAP_DEVICE_NAME_UUID,               0,      0,                    0 },
+    { 0x0004, GATT_CHARACTERISTICS_UUID,          0x0005, GAP_APPEARANCE_UUID,  0 },
+    { 0x0005, GAP_APPEARANCE_UUID,                0,      0,                    0 },
+    { 0x0006, GATT_PRIMARY_SERVICE_UUID,          0,      0x1801,               0x0009 },
+    { 0x0007, GATT_CHARACTERISTICS_UUID,          0x0008, GAP_SERVICE_CHANGED,  0 },
+    { 0x0008, GAP_SERVICE_CHANGED,                0,      0,                    0 },
+    { 0x0009, GATT_CLIENT_CHARACTERISTICS_CONFIGURATION, 0, 0,                  0 },
+};
+#define NUM_ATTRIBUTES (sizeof(attributes) / sizeof(attribute_t))
+
+// mock L2CAP
+
+static btstack_packet_handler_t att_packet_handler;
+static btstack_packet_handler_t hci_event_handler;
+static uint8_t l2cap_outgoing_buffer[HCI_INCOMING_PRE_BUFFER_SIZE + 8 + ATT_DEFAULT_MTU];
+static uint8_t request_pdu[ATT_DEFAULT_MTU];
+static int     request_len;
+static int     num_discovery_requests;
+
+void hci_add_event_handler(btstack_packet_callback_registration_t * callback_handler){
+    hci_event_handler = callback_handler->callback;
+}
+
+int hci_can_send_acl_le_packet_now(void){
+    return 1;
+}
+
+void gap_local_bd_addr(bd_addr_t address_buffer){
+    memset(address_buffer, 0x11, 6);
+}
+
+void l2cap_register_fixed_channel(btstack_packet_handler_t packet_handler, uint16_t channel_id){
+    (void) channel_id;
+    att_packet_handler = packet_handler;
+}
+
+uint16_t l2cap_max_le_mtu(void){
+    return ATT_DEFAULT_MTU;
+}
+
+int l2cap_reserve_packet_buffer(void){
+    return 1;
+}
+
+uint8_t * l2cap_get_outgoing_buffer(void){
+    return l2cap_outgoing_buffer;
+}
+
+int l2cap_can_send_fixed_channel_packet_now(hci_con_handle_t con_handle, uint16_t channel_id){
+    (void) con_handle;
+    (void) channel_id;
+    return 1;
+}
+
+void l2cap_request_can_send_fix_channel_now_event(hci_con_handle_t con_handle, uint16_t channel_id){
+    (void) con_handle;
+    (void) channel_id;
+}
+
+int l2cap_send_prepared_connectionless(hci_con_handle_t con_handle, uint16_t cid, uint16_t len){
+    (void) con_handle;
+    (void) cid;
+    memcpy(request_pdu, l2cap_outgoing_buffer, len);
+    request_len = len;
+    if (request_pdu[0] != ATT_EXCHANGE_MTU_REQUEST && request_pdu[0] != ATT_HANDLE_VALUE_CONFIRMATION){
+        num_discovery_requests++;
+    }
+    return 0;
+}
+
+void hci_dump_packet(uint8_t packet_type, uint8_t in, uint8_t *packet, uint16_t len){
+    (void) packet_type;
+    (void) in;
+    (void) packet;
+    (void) len;
+}
+
+// mock run loop: timers with zero timeout are fired by run_loop_process
+
+#define MAX_TIMERS 4
+static btstack_timer_source_t * timers[MAX_TIMERS];
+
+void btstack_run_loop_set_timer(btstack_timer_source_t * timer, uint32_t timeout_in_ms){
+    timer->timeout = timeout_in_ms;
+}
+
+void btstack_run_loop_set_timer_handler(btstack_timer_source_t * timer, void (*process)(btstack_timer_source_t * _timer)){
+    timer->process = process;
+}
+
+int btstack_run_loop_remove_timer(btstack_timer_source_t * timer){
+    int i;
+    for (i=0;i<MAX_TIMERS;i++){
+        if (timers[i] != timer) continue;
+        timers[i] = NULL;
+        return 1;
+    }
+    return 0;
+}
+
+void btstack_run_loop_add_timer(btstack_timer_source_t * timer){
+    int i;
+    btstack_run_loop_remove_timer(timer);
+    for (i=0;i<MAX_TIMERS;i++){
+        if (timers[i]) continue;
+        timers[i] = timer;
+        return;
+    }
+}
+
+static void run_loop_process(void){
+    int i;
+    for (i=0;i<MAX_TIMERS;i++){
+        btstack_timer_source_t * timer = timers[i];
+        if (!timer || timer->timeout) continue;
+        timers[i] = NULL;
+        timer->process(timer);
+    }
+}
+
+// mock SM and LE Device DB
+
+static int       le_device_index;
+static bd_addr_t peer_addr;
+
+int sm_le_device_index(hci_con_handle_t con_handle){
+    (void) con_handle;
+    return le_device_index;
+}
+
+int sm_cmac_ready(void){
+    return 1;
+}
+
+void sm_cmac_signed_write_start(const sm_key_t key, uint8_t opcode, uint16_t attribute_handle, uint16_t message_len, const uint8_t * message, uint32_t sign_counter, void (*done_callback)(uint8_t * hash)){
+    (void) key;
+    (void) opcode;
+    (void) attribute_handle;
+    (void) message_len;
+    (void) message;
+    (void) sign_counter;
+    (void) done_callback;
+}
+
+void le_device_db_info(int index, int * addr_type, bd_addr_t addr, sm_key_t irk){
+    (void) index;
+    *addr_type = 0;
+    memcpy(addr, peer_addr, 6);
+    memset(irk, 0, 16);
+}
+
+void le_device_db_local_csrk_get(int index, sm_key_t csrk){
+    (void) index;
+    memset(csrk, 0, 16);
+}
+
+uint32_t le_device_db_local_counter_get(int index){
+    (void) index;
+    return 0;
+}
+
+void le_device_db_local_counter_set(int index, uint32_t counter){
+    (void) index;
+    (void) counter;
+}
+
+// cache db in memory, single device
+
+static uint8_t cache_db_data[2000];
+static int     cache_db_size;
+static int     cache_db_num_puts;
+static int     cache_db_num_deletes;
+
+static void cache_db_open(void){
+}
+
+static void cache_db_set_local_bd_addr(bd_addr_t bd_addr){
+    (void) bd_addr;
+}
+
+static void cache_db_close(void){
+}
+
+static int cache_db_get_cache(int index, uint8_t * buffer, int buffer_size){
+    (void) index;
+    if (cache_db_size > buffer_size) return 0;
+    memcpy(buffer, cache_db_data, cache_db_size);
+    return cache_db_size;
+}
+
+static void cache_db_put_cache(int index, const uint8_t * data, int size){
+    (void) index;
+    memcpy(cache_db_data, data, size);
+    cache_db_size = size;
+    cache_db_num_puts++;
+}
+
+static void cache_db_delete_cache(int index){
+    (void) index;
+    cache_db_size = 0;
+    cache_db_num_deletes++;
+}
+
+static const gatt_client_cache_db_t cache_db_memory = {
+    &cache_db_open,
+    &cache_db_set_local_bd_addr,
+    &cache_db_close,
+    &cache_db_get_cache,
+    &cache_db_put_cache,
+    &cache_db_delete_cache,
+};
+
+// mock GATT server: answer recorded request
+
+static void respond_error(uint8_t * request){
+    uint8_t response[5];
+    response[0] = ATT_ERROR_RESPONSE;
+    response[1] = request[0];
+    little_endian_store_16(response, 2, little_endian_read_16(request, 1));
+    response[4] = ATT_ERROR_ATTRIBUTE_NOT_FOUND;
+    att_packet_handler(ATT_DATA_PACKET, HANDLE_A, response, sizeof(response));
+}
+
+static void respond(void){
+    CHECK(request_len > 0);
+    request_len = 0;
+    uint8_t * request = request_pdu;
+    uint8_t response[ATT_DEFAULT_MTU];
+    uint16_t pos = 2;
+    uint16_t start_handle = little_endian_read_16(request, 1);
+    uint16_t end_handle   = little_endian_read_16(request, 3);
+    unsigned int i;
+    switch (request[0]){
+        case ATT_EXCHANGE_MTU_REQUEST:
+            response[0] = ATT_EXCHANGE_MTU_RESPONSE;
+            little_endian_store_16(response, 1, ATT_DEFAULT_MTU);
+            att_packet_handler(ATT_DATA_PACKET, HANDLE_A, response, 3);
+            return;
+        case ATT_READ_BY_GROUP_TYPE_REQUEST:
+            response[0] = ATT_READ_BY_GROUP_TYPE_RESPONSE;
+            response[1] = 6;
+            for (i=0;i<NUM_ATTRIBUTES;i++){
+                const attribute_t * attribute = &attributes[i];
+                if (attribute->type != GATT_PRIMARY_SERVICE_UUID) continue;
+                if (attribute->handle < start_handle || attribute->handle > end_handle) continue;
+                little_endian_store_16(response, pos, attribute->handle);
+                little_endian_store_16(response, pos + 2, attribute->end_handle);
+                little_endian_store_16(response, pos + 4, attribute->uuid16);
+                pos += 6;
+            }
+            break;
+        case ATT_READ_BY_TYPE_REQUEST:
+            response[0] = ATT_READ_BY_TYPE_RESPONSE;
+            response[1] = 7;
+            for (i=0;i<NUM_ATTRIBUTES;i++){
+                const attribute_t * attribute = &attributes[i];
+                if (attribute->type != GATT_CHARACTERISTICS_UUID) continue;
+                if (attribute->handle < start_handle || attribute->handle > end_handle) continue;
+                little_endian_store_16(response, pos, attribute->handle);
+                response[pos + 2] = ATT_PROPERTY_READ;
+                little_endian_store_16(response, pos + 3, attribute->value_handle);
+                little_endian_store_16(response, pos + 5, attribute->uuid16);
+                pos += 7;
+            }
+            break;
+        case ATT_FIND_INFORMATION_REQUEST:
+            response[0] = ATT_FIND_INFORMATION_REPLY;
+            response[1] = 1;
+            for (i=0;i<NUM_ATTRIBUTES;i++){
+                const attribute_t * attribute = &attributes[i];
+                if (attribute->handle < start_handle || attribute->handle > end_handle) continue;
+                little_endian_store_16(response, pos, attribute->handle);
+                little_endian_store_16(response, pos + 2, attribute->type);
+                pos += 4;
+            }
+            break;
+        default:
+            break;
+    }
+    if (pos == 2){
+        respond_error(request);
+        return;
+    }
+    att_packet_handler(ATT_DATA_PACKET, HANDLE_A, response, pos);
+}
+
+static void respond_all(void){
+    while (request_len){
+        respond();
+    }
+}
+
+static void disconnect(void){
+    uint8_t event[] = { HCI_EVENT_DISCONNECTION_COMPLETE, 4, 0, 0, 0, 0x13};
+    little_endian_store_16(event, 3, HANDLE_A);
+    hci_event_handler(HCI_EVENT_PACKET, 0, event, sizeof(event));
+    // pending request is dropped
+    request_len = 0;
+    num_discovery_requests = 0;
+}
+
+static void indicate(uint16_t value_handle){
+    uint8_t indication[4];
+    indication[0] = ATT_HANDLE_VALUE_INDICATION;
+    little_endian_store_16(indication, 1, value_handle);
+    indication[3] = 0;
+    att_packet_handler(ATT_DATA_PACKET, HANDLE_A, indication, sizeof(indication));
+    respond_all();
+}
+
+// log of GATT events: event type and handle of result or status of complete event
+
+#define MAX_LOG_ENTRIES 16
+typedef struct {
+    uint8_t  type;
+    uint16_t data;
+} log_entry_t;
+
+static log_entry_t log_entries[MAX_LOG_ENTRIES];
+static int num_log_entries;
+static gatt_client_service_t gatt_service;
+static gatt_client_characteristic_t service_changed_characteristic;
+
+static void handle_gatt_event(uint8_t packet_type, uint16_t channel, uint8_t *packet, uint16_t size){
+    (void) channel;
+    (void) size;
+    if (packet_type != HCI_EVENT_PACKET) return;
+    if (num_log_entries >= MAX_LOG_ENTRIES) return;
+    gatt_client_service_t service;
+    gatt_client_characteristic_t characteristic;
+    gatt_client_characteristic_descriptor_t descriptor;
+    log_entry_t * entry = &log_entries[num_log_entries++];
+    entry->type = hci_event_packet_get_type(packet);
+    switch (entry->type){
+        case GATT_EVENT_SERVICE_QUERY_RESULT:
+            gatt_event_service_query_result_get_service(packet, &service);
+            entry->data = service.start_group_handle;
+            if (service.uuid16 == 0x1801){
+                gatt_service = service;
+            }
+            break;
+        case GATT_EVENT_CHARACTERISTIC_QUERY_RESULT:
+            gatt_event_characteristic_query_result_get_characteristic(packet, &characteristic);
+            entry->data = characteristic.value_handle;
+            if (characteristic.uuid16 == GAP_SERVICE_CHANGED){
+                service_changed_characteristic = characteristic;
+            }
+            break;
+        case GATT_EVENT_ALL_CHARACTERISTIC_DESCRIPTORS_QUERY_RESULT:
+            gatt_event_all_characteristic_descriptors_query_result_get_characteristic_descriptor(packet, &descriptor);
+            entry->data = descriptor.handle;
+            break;
+        case GATT_EVENT_QUERY_COMPLETE:
+            entry->data = gatt_event_query_complete_get_status(packet);
+            break;
+        default:
+            break;
+    }
+}
+
+static void check_log_entry(int index, uint8_t type, uint16_t data){
+    CHECK(index < num_log_entries);
+    CHECK_EQUAL(type, log_entries[index].type);
+    CHECK_EQUAL(data, log_entries[index].data);
+}
+
+static void check_services(void){
+    CHECK_EQUAL(3, num_log_entries);
+    check_log_entry(0, GATT_EVENT_SERVICE_QUERY_RESULT, 0x0001);
+    check_log_entry(1, GATT_EVENT_SERVICE_QUERY_RESULT, 0x0006);
+    check_log_entry(2, GATT_EVENT_QUERY_COMPLETE, 0);
+}
+
+// run query against mock server and return number of ATT requests since last query, MTU exchange not counted
+static int run_query(void){
+    num_log_entries = 0;
+    respond_all();
+    run_loop_process();
+    respond_all();
+    int num_requests = num_discovery_requests;
+    num_discovery_requests = 0;
+    return num_requests;
+}
+
+static void discover_all(void){
+    CHECK_EQUAL(0, gatt_client_discover_primary_services(handle_gatt_event, HANDLE_A));
+    run_query();
+    CHECK_EQUAL(0, gatt_client_discover_characteristics_for_service(handle_gatt_event, HANDLE_A, &gatt_service));
+    run_query();
+    CHECK_EQUAL(0, gatt_client_discover_characteristic_descriptors(handle_gatt_event, HANDLE_A, &service_changed_characteristic));
+    run_query();
+}
+
+TEST_GROUP(GATTClientCache){
+    void setup(void){
+        request_len = 0;
+        num_discovery_requests = 0;
+        num_log_entries = 0;
+        memset(timers, 0, sizeof(timers));
+        memset(peer_addr, 0x22, 6);
+        le_device_index = 0;
+        cache_db_size = 0;
+        cache_db_num_puts = 0;
+        cache_db_num_deletes = 0;
+        btstack_memory_init();
+        gatt_client_init();
+        gatt_client_set_cache_db(&cache_db_memory);
+    }
+    void teardown(void){
+        disconnect();
+    }
+};
+
+TEST(GATTClientCache, ServicesAnsweredFromCacheAfterReconnect){
+    CHECK_EQUAL(0, gatt_client_discover_primary_services(handle_gatt_event, HANDLE_A));
+    CHECK_EQUAL(2, run_query());
+    check_services();
+    CHECK_EQUAL(1, cache_db_num_puts);
+    disconnect();
+
+    num_log_entries = 0;
+    CHECK_EQUAL(0, gatt_client_discover_primary_services(handle_gatt_event, HANDLE_A));
+    // results are emitted from run loop
+    CHECK_EQUAL(0, num_log_entries);
+    CHECK_EQUAL(0, run_query());
+    check_services();
+}
+
+TEST(GATTClientCache, CharacteristicsAndDescriptorsAnsweredFromCache){
+    discover_all();
+    CHECK_EQUAL(3, cache_db_num_puts);
+    disconnect();
+
+    CHECK_EQUAL(0, gatt_client_discover_primary_services(handle_gatt_event, HANDLE_A));
+    CHECK_EQUAL(0, run_query());
+    check_services();
+
+    CHECK_EQUAL(0, gatt_client_discover_characteristics_for_service(handle_gatt_event, HANDLE_A, &gatt_service));
+    CHECK_EQUAL(0, run_query());
+    CHECK_EQUAL(2, num_log_entries);
+    check_log_entry(0, GATT_EVENT_CHARACTERISTIC_QUERY_RESULT, 0x0008);
+    check_log_entry(1, GATT_EVENT_QUERY_COMPLETE, 0);
+    CHECK_EQUAL(0x0009, service_changed_characteristic.end_handle);
+
+    CHECK_EQUAL(0, gatt_client_discover_characteristic_descriptors(handle_gatt_event, HANDLE_A, &service_changed_characteristic));
+    CHECK_EQUAL(0, run_query());
+    CHECK_EQUAL(2, num_log_entries);
+    check_log_entry(0, GATT_EVENT_ALL_CHARACTERISTIC_DESCRIPTORS_QUERY_RESULT, 0x0009);
+    check_log_entry(1, GATT_EVENT_QUERY_COMPLETE, 0);
+}
+
+TEST(GATTClientCache, FilteredQueriesAnsweredFromCache){
+    discover_all();
+
+    CHECK_EQUAL(0, gatt_client_discover_primary_services_by_uuid16(handle_gatt_event, HANDLE_A, 0x1801));
+    CHECK_EQUAL(0, run_query());
+    CHECK_EQUAL(2, num_log_entries);
+    check_log_entry(0, GATT_EVENT_SERVICE_QUERY_RESULT, 0x0006);
+
+    CHECK_EQUAL(0, gatt_client_discover_characteristics_for_service_by_uuid16(handle_gatt_event, HANDLE_A, &gatt_service, GAP_SERVICE_CHANGED));
+    CHECK_EQUAL(0, run_query());
+    CHECK_EQUAL(2, num_log_entries);
+    check_log_entry(0, GATT_EVENT_CHARACTERISTIC_QUERY_RESULT, 0x0008);
+}
+
+TEST(GATTClientCache, ServiceChangedInvalidatesCache){
+    discover_all();
+
+    indicate(0x0008);
+    CHECK_EQUAL(1, cache_db_num_deletes);
+    CHECK_EQUAL(0, cache_db_size);
+
+    CHECK_EQUAL(0, gatt_client_discover_primary_services(handle_gatt_event, HANDLE_A));
+    CHECK_EQUAL(2, run_query());
+    check_services();
+}
+
+TEST(GATTClientCache, OtherIndicationKeepsCache){
+    discover_all();
+
+    indicate(0x0003);
+    CHECK_EQUAL(0, cache_db_num_deletes);
+
+    CHECK_EQUAL(0, gatt_client_discover_primary_services(handle_gatt_event, HANDLE_A));
+    CHECK_EQUAL(0, run_query());
+}
+
+TEST(GATTClientCache, UnbondedDeviceNotCached){
+    le_device_index = -1;
+    CHECK_EQUAL(0, gatt_client_discover_primary_services(handle_gatt_event, HANDLE_A));
+    CHECK_EQUAL(2, run_query());
+    CHECK_EQUAL(0, gatt_client_discover_primary_services(handle_gatt_event, HANDLE_A));
+    CHECK_EQUAL(2, run_query());
+    check_services();
+    CHECK_EQUAL(0, cache_db_num_puts);
+}
+
+TEST(GATTClientCache, CacheOfOtherIdentityDiscarded){
+    CHECK_EQUAL(0, gatt_client_discover_primary_services(handle_gatt_event, HANDLE_A));
+    run_query();
+    disconnect();
+
+    // le_device_db entry now used by another device
+    memset(peer_addr, 0x33, 6);
+    CHECK_EQUAL(0, gatt_client_discover_primary_services(handle_gatt_event, HANDLE_A));
+    CHECK_EQUAL(2, run_query());
+    check_services();
+    CHECK_EQUAL(1, cache_db_num_deletes);
+}
+
+TEST(GATTClientCache, FailedDiscoveryNotCached){
+    CHECK_EQUAL(0, gatt_client_discover_primary_services(handle_gatt_event, HANDLE_A));
+    respond();
+    disconnect();
+    CHECK_EQUAL(0, cache_db_num_puts);
+
+    CHECK_EQUAL(0, gatt_client_discover_primary_services(handle_gatt_event, HANDLE_A));
+    CHECK_EQUAL(2, run_query());
+}
+
+int main (int argc, const char * argv[]){
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
@@ -0,0 +1,383 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "CppUTest/TestHarness.h"
+#include "CppUTest/CommandLineTestRunner.h"
+
+#include "btstack_config.h"
+#include "btstack_event.h"
+#include "btstack_memory.h"
+#include "btstack_run_loop.h"
+#include "btstack_util.h"
+#include "hci.h"
+#include "hci_dump.h"
+#include "l2cap.h"
+#include "ble/gatt_client.h"
+#include "ble/le_device_db.h"
+#include "ble/sm.h"
+
+#define HANDLE_A 0x0040
+#define HANDLE_B 0x0041
+
+// mock L2CAP: per connection flow control and one recorded ATT request per connection
+
+static btstack_packet_handler_t att_packet_handler;
+static btstack_packet_handler_t hci_event_handler;
+static uint8_t l2cap_outgoing_buffer[HCI_INCOMING_PRE_BUFFER_SIZE + 8 + ATT_DEFAULT_MTU];
+
+static int     blocked[2];
+static uint8_t request_pdu[2][ATT_DEFAULT_MTU];
+static int     request_len[2];
+static int     num_requests_sent[2];
+static int     num_overlapping_requests;
+static int     num_requests_sent_while_blocked;
+static int     waiting_for_can_send_now;
+
+static int index_for_handle(hci_con_handle_t con_handle){
+    return con_handle == HANDLE_A ? 0 : 1;
+}
+
+int hci_can_send_acl_le_packet_now(void){
+    return !blocked[0] || !blocked[1];
+}
+
+void hci_add_event_handler(btstack_packet_callback_registration_t * callback_handler){
+    hci_event_handler = callback_handler->callback;
+}
+
+void l2cap_register_fixed_channel(btstack_packet_handler_t packet_handler, uint16_t channel_id){
+    (void) channel_id;
+    att_packet_handler = packet_handler;
+}
+
+uint16_t l2cap_max_le_mtu(void){
+    return ATT_DEFAULT_MTU;
+}
+
+int l2cap_reserve_packet_buffer(void){
+    return 1;
+}
+
+uint8_t * l2cap_get_outgoing_buffer(void){
+    return l2cap_outgoing_buffer;
+}
+
+int l2cap_can_send_fixed_channel_packet_now(hci_con_handle_t con_handle, uint16_t channel_id){
+    (void) channel_id;
+    return !blocked[index_for_handle(con_handle)];
+}
+
+static void emit_can_send_now(void){
+    uint8_t event[] = { L2CAP_EVENT_CAN_SEND_NOW, 2, 4, 0};
+    waiting_for_can_send_now = 0;
+    att_packet_handler(HCI_EVENT_PACKET, 0, event, sizeof(event));
+}
+
+// like L2CAP, the event is emitted right away if any LE connection can send
+void l2cap_request_can_send_fix_channel_now_event(hci_con_handle_t con_handle, uint16_t channel_id){
+    (void) con_handle;
+    (void) channel_id;
+    waiting_for_can_send_now = 1;
+    if (!hci_can_send_acl_le_packet_now()) return;
+    emit_can_send_now();
+}
+
+int l2cap_send_prepared_connectionless(hci_con_handle_t con_handle, uint16_t cid, uint16_t len){
+    (void) cid;
+    int index = index_for_handle(con_handle);
+    if (blocked[index]) num_requests_sent_while_blocked++;
+    if (request_len[index]) num_overlapping_requests++;
+    memcpy(request_pdu[index], l2cap_outgoing_buffer, len);
+    request_len[index] = len;
+    num_requests_sent[index]++;
+    return 0;
+}
+
+void hci_dump_packet(uint8_t packet_type, uint8_t in, uint8_t *packet, uint16_t len){
+    (void) packet_type;
+    (void) in;
+    (void) packet;
+    (void) len;
+}
+
+void btstack_run_loop_set_timer(btstack_timer_source_t * timer, uint32_t timeout_in_ms){
+    (void) timer;
+    (void) timeout_in_ms;
+}
+
+void btstack_run_loop_set_timer_handler(btstack_timer_source_t * timer, void (*process)(btstack_timer_source_t * _timer)){
+    (void) timer;
+    (void) process;
+}
+
+void btstack_run_loop_add_timer(btstack_timer_source_t * timer){
+    (void) timer;
+}
+
+int btstack_run_loop_remove_timer(btstack_timer_source_t * timer){
+    (void) timer;
+    return 1;
+}
+
+int sm_cmac_ready(void){
+    return 1;
+}
+
+void sm_cmac_signed_write_start(const sm_key_t key, uint8_t opcode, uint16_t attribute_handle, uint16_t message_len, const uint8_t * message, uint32_t sign_counter, void (*done_callback)(uint8_t * hash)){
+    (void) key;
+    (void) opcode;
+    (void) attribute_handle;
+    (void) message_len;
+    (void) message;
+    (void) sign_counter;
+    (void) done_callback;
+}
+
+int sm_le_device_index(hci_con_handle_t con_handle){
+    (void) con_handle;
+    return -1;
+}
+
+void le_device_db_local_csrk_get(int index, sm_key_t csrk){
+    (void) index;
+    memset(csrk, 0, 16);
+}
+
+uint32_t le_device_db_local_counter_get(int index){
+    (void) index;
+    return 0;
+}
+
+void le_device_db_local_counter_set(int index, uint32_t counter){
+    (void) index;
+    (void) counter;
+}
+
+// mock GATT server: answer recorded request of a connection
+
+static void respond(hci_con_handle_t con_handle){
+    int index = index_for_handle(con_handle);
+    CHECK(request_len[index] > 0);
+    uint8_t * request = request_pdu[index];
+    uint8_t response[5];
+    uint16_t response_len = 0;
+    switch (request[0]){
+        case ATT_EXCHANGE_MTU_REQUEST:
+            response[0] = ATT_EXCHANGE_MTU_RESPONSE;
+            little_endian_store_16(response, 1, ATT_DEFAULT_MTU);
+            response_len = 3;
+            break;
+        case ATT_READ_REQUEST:
+            // value is lower byte of attribute handle
+            response[0] = ATT_READ_RESPONSE;
+            response[1] = request[1];
+            response_len = 2;
+            break;
+        case ATT_WRITE_REQUEST:
+            response[0] = ATT_WRITE_RESPONSE;
+            response_len = 1;
+            break;
+        default:
+            // e.g. service discovery: nothing found
+            response[0] = ATT_ERROR_RESPONSE;
+            response[1] = request[0];
+            little_endian_store_16(response, 2, little_endian_read_16(request, 1));
+            response[4] = ATT_ERROR_ATTRIBUTE_NOT_FOUND;
+            response_len = 5;
+            break;
+    }
+    request_len[index] = 0;
+    att_packet_handler(ATT_DATA_PACKET, con_handle, response, response_len);
+}
+
+static void respond_all(hci_con_handle_t con_handle){
+    while (request_len[index_for_handle(con_handle)]){
+        respond(con_handle);
+    }
+}
+
+static void unblock(hci_con_handle_t con_handle){
+    blocked[index_for_handle(con_handle)] = 0;
+    if (waiting_for_can_send_now){
+        emit_can_send_now();
+    }
+    // GATT Client also retries on HCI events, e.g. Number Of Completed Packets
+    uint8_t event[] = { HCI_EVENT_NUMBER_OF_COMPLETED_PACKETS, 5, 1, 0, 0, 1, 0};
+    little_endian_store_16(event, 3, con_handle);
+    hci_event_handler(HCI_EVENT_PACKET, 0, event, sizeof(event));
+}
+
+static void disconnect(hci_con_handle_t con_handle){
+    uint8_t event[] = { HCI_EVENT_DISCONNECTION_COMPLETE, 4, 0, 0, 0, 0x13};
+    little_endian_store_16(event, 3, con_handle);
+    hci_event_handler(HCI_EVENT_PACKET, 0, event, sizeof(event));
+}
+
+// log of GATT events: receiving handler, event type, connection, status or value
+
+#define MAX_LOG_ENTRIES 16
+typedef struct {
+    int      handler;
+    uint8_t  type;
+    uint16_t con_handle;
+    uint8_t  data;
+} log_entry_t;
+
+static log_entry_t log_entries[MAX_LOG_ENTRIES];
+static int num_log_entries;
+
+static void log_event(int handler, uint8_t * packet){
+    if (num_log_entries >= MAX_LOG_ENTRIES) return;
+    log_entry_t * entry = &log_entries[num_log_entries++];
+    entry->handler = handler;
+    entry->type = hci_event_packet_get_type(packet);
+    switch (entry->type){
+        case GATT_EVENT_QUERY_COMPLETE:
+            entry->con_handle = gatt_event_query_complete_get_handle(packet);
+            entry->data = gatt_event_query_complete_get_status(packet);
+            break;
+        case GATT_EVENT_CHARACTERISTIC_VALUE_QUERY_RESULT:
+            entry->con_handle = gatt_event_characteristic_value_query_result_get_handle(packet);
+            entry->data = gatt_event_characteristic_value_query_result_get_value(packet)[0];
+            break;
+        default:
+            break;
+    }
+}
+
+static void handler_1(uint8_t packet_type, uint16_t channel, uint8_t *packet, uint16_t size){
+    (void) channel;
+    (void) size;
+    if (packet_type != HCI_EVENT_PACKET) return;
+    log_event(1, packet);
+}
+
+static void handler_2(uint8_t packet_type, uint16_t channel, uint8_t *packet, uint16_t size){
+    (void) channel;
+    (void) size;
+    if (packet_type != HCI_EVENT_PACKET) return;
+    log_event(2, packet);
+}
+
+static void check_log_entry(int index, int handler, uint8_t type, uint16_t con_handle, uint8_t data){
+    CHECK(index < num_log_entries);
+    CHECK_EQUAL(handler, log_entries[index].handler);
+    CHECK_EQUAL(type, log_entries[index].type);
+    CHECK_EQUAL(con_handle, log_entries[index].con_handle);
+    CHECK_EQUAL(data, log_entries[index].data);
+}
+
+TEST_GROUP(GATTClientQueue){
+    void setup(void){
+        memset(blocked, 0, sizeof(blocked));
+        memset(request_len, 0, sizeof(request_len));
+        memset(num_requests_sent, 0, sizeof(num_requests_sent));
+        num_overlapping_requests = 0;
+        num_requests_sent_while_blocked = 0;
+        waiting_for_can_send_now = 0;
+        num_log_entries = 0;
+        btstack_memory_init();
+        gatt_client_init();
+    }
+    void teardown(void){
+        CHECK_EQUAL(0, num_requests_sent_while_blocked);
+    }
+};
+
+TEST(GATTClientQueue, CongestedConnectionDoesNotBlockOthers){
+    // contexts are prepended, A is served first
+    gatt_client_is_ready(HANDLE_B);
+    gatt_client_is_ready(HANDLE_A);
+    blocked[0] = 1;
+
+    CHECK_EQUAL(0, gatt_client_read_value_of_characteristic_using_value_handle(handler_1, HANDLE_A, 0x10));
+    CHECK_EQUAL(0, gatt_client_read_value_of_characteristic_using_value_handle(handler_2, HANDLE_B, 0x20));
+
+    // B exchanges MTU and reads value while A is congested
+    respond_all(HANDLE_B);
+    CHECK_EQUAL(2, num_requests_sent[1]);
+    CHECK_EQUAL(0, num_requests_sent[0]);
+    CHECK_EQUAL(2, num_log_entries);
+    check_log_entry(0, 2, GATT_EVENT_CHARACTERISTIC_VALUE_QUERY_RESULT, HANDLE_B, 0x20);
+    check_log_entry(1, 2, GATT_EVENT_QUERY_COMPLETE, HANDLE_B, 0);
+
+    // A continues when it can send again
+    unblock(HANDLE_A);
+    respond_all(HANDLE_A);
+    CHECK_EQUAL(2, num_requests_sent[0]);
+    CHECK_EQUAL(4, num_log_entries);
+    check_log_entry(2, 1, GATT_EVENT_CHARACTERISTIC_VALUE_QUERY_RESULT, HANDLE_A, 0x10);
+    check_log_entry(3, 1, GATT_EVENT_QUERY_COMPLETE, HANDLE_A, 0);
+}
+
+TEST(GATTClientQueue, BothConnectionsServedInOnePass){
+    gatt_client_is_ready(HANDLE_A);
+    gatt_client_is_ready(HANDLE_B);
+    blocked[0] = 1;
+    blocked[1] = 1;
+
+    CHECK_EQUAL(0, gatt_client_read_value_of_characteristic_using_value_handle(handler_1, HANDLE_A, 0x10));
+    CHECK_EQUAL(0, gatt_client_read_value_of_characteristic_using_value_handle(handler_2, HANDLE_B, 0x20));
+    CHECK_EQUAL(0, num_requests_sent[0] + num_requests_sent[1]);
+
+    blocked[0] = 0;
+    blocked[1] = 0;
+    emit_can_send_now();
+    CHECK_EQUAL(1, num_requests_sent[0]);
+    CHECK_EQUAL(1, num_requests_sent[1]);
+}
+
+TEST(GATTClientQueue, QueuedRequestsCompleteInOrder){
+    uint8_t value[] = { 0x01, 0x00 };
+    CHECK_EQUAL(0, gatt_client_discover_primary_services(handler_1, HANDLE_A));
+    CHECK_EQUAL(0, gatt_client_read_value_of_characteristic_using_value_handle(handler_2, HANDLE_A, 0x10));
+    CHECK_EQUAL(0, gatt_client_write_value_of_characteristic(handler_1, HANDLE_A, 0x11, sizeof(value), value));
+    CHECK_EQUAL(0, gatt_client_is_ready(HANDLE_A));
+
+    respond_all(HANDLE_A);
+
+    // MTU exchange, service discovery, read, write
+    CHECK_EQUAL(4, num_requests_sent[0]);
+    CHECK_EQUAL(0, num_overlapping_requests);
+    CHECK_EQUAL(4, num_log_entries);
+    check_log_entry(0, 1, GATT_EVENT_QUERY_COMPLETE, HANDLE_A, 0);
+    check_log_entry(1, 2, GATT_EVENT_CHARACTERISTIC_VALUE_QUERY_RESULT, HANDLE_A, 0x10);
+    check_log_entry(2, 2, GATT_EVENT_QUERY_COMPLETE, HANDLE_A, 0);
+    check_log_entry(3, 1, GATT_EVENT_QUERY_COMPLETE, HANDLE_A, 0);
+    CHECK_EQUAL(1, gatt_client_is_ready(HANDLE_A));
+}
+
+TEST(GATTClientQueue, QueueFull){
+    int i;
+    CHECK_EQUAL(0, gatt_client_read_value_of_characteristic_using_value_handle(handler_1, HANDLE_A, 0x10));
+    for (i=0;i<GATT_CLIENT_REQUEST_QUEUE_DEPTH;i++){
+        CHECK_EQUAL(0, gatt_client_read_value_of_characteristic_using_value_handle(handler_1, HANDLE_A, 0x11 + i));
+    }
+    CHECK_EQUAL(GATT_CLIENT_IN_WRONG_STATE, gatt_client_read_value_of_characteristic_using_value_handle(handler_1, HANDLE_A, 0x20));
+
+    // other connections are not affected
+    CHECK_EQUAL(0, gatt_client_read_value_of_characteristic_using_value_handle(handler_2, HANDLE_B, 0x20));
+
+    respond_all(HANDLE_A);
+    CHECK_EQUAL(2 * (1 + GATT_CLIENT_REQUEST_QUEUE_DEPTH), num_log_entries);
+    for (i=0;i<=GATT_CLIENT_REQUEST_QUEUE_DEPTH;i++){
+        check_log_entry(2*i, 1, GATT_EVENT_CHARACTERISTIC_VALUE_QUERY_RESULT, HANDLE_A, 0x10 + i);
+    }
+}
+
+TEST(GATTClientQueue, DisconnectFailsQueuedRequests){
+    CHECK_EQUAL(0, gatt_client_read_value_of_characteristic_using_value_handle(handler_1, HANDLE_A, 0x10));
+    CHECK_EQUAL(0, gatt_client_read_value_of_characteristic_using_value_handle(handler_2, HANDLE_A, 0x11));
+    CHECK_EQUAL(0, gatt_client_read_value_of_characteristic_using_value_handle(handler_1, HANDLE_A, 0x12));
+
+    disconnect(HANDLE_A);
+
+    CHECK_EQUAL(3, num_log_entries);
+    check_log_entry(0, 1, GATT_EVENT_QUERY_COMPLETE, HANDLE_A, ATT_ERROR_HCI_DISCONNECT_RECEIVED);
+    check_log_entry(1, 2, GATT_EVENT_QUERY_COMPLETE, HANDLE_A, ATT_ERROR_HCI_DISCONNECT_RECEIVED);
+    check_log_entry(2, 1, GATT_EVENT_QUERY_COMPLETE, HANDLE_A, ATT_ERROR_HCI_DISCONNECT_RECEIVED);
+}
+
+int main (int argc, const char * argv[]){
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
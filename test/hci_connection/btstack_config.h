@@ -0,0 +1,24 @@
+//
+// btstack_config.h for hci connection test and benchmark
+//
+#ifndef __BTSTACK_CONFIG
+#define __BTSTACK_CONFIG
+
+// Port related features
+#define HAVE_MALLOC
+#define HAVE_POSIX_TIME
+
+// BTstack features that can be enabled
+#define ENABLE_BLE
+#define ENABLE_CLASSIC
+#define ENABLE_LOG_ERROR
+#define ENABLE_ACL_REASSEMBLY_POOL
+
+// BTstack configuration. buffers, sizes, ...
+#define HCI_ACL_PAYLOAD_SIZE 104
+#define HCI_INCOMING_PRE_BUFFER_SIZE 4
+
+// ACL scheduler buffers from pool to check for leaks
+#define MAX_NR_HCI_ACL_BUFFERS 8
+
+#endif
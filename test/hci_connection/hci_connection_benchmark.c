@@ -0,0 +1,120 @@
+// Measures per-packet cost of connection lookup and ACL slot accounting in hci.c
+// for a growing number of LE connections: incoming ACL packet, can send check,
+// outgoing ACL packet and Number Of Completed Packets event.
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "btstack_memory.h"
+#include "btstack_run_loop.h"
+#include "btstack_run_loop_posix.h"
+#include "btstack_util.h"
+#include "hci.h"
+#include "hci_transport.h"
+
+#define NUM_ITERATIONS 1000000
+
+static void (*transport_packet_handler)(uint8_t packet_type, uint8_t *packet, uint16_t size);
+
+static void transport_register_packet_handler(void (*handler)(uint8_t packet_type, uint8_t *packet, uint16_t size)){
+    transport_packet_handler = handler;
+}
+
+static int transport_send_packet(uint8_t packet_type, uint8_t * packet, int size){
+    UNUSED(packet_type);
+    UNUSED(packet);
+    UNUSED(size);
+    return 0;
+}
+
+static void acl_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *packet, uint16_t size){
+    UNUSED(packet_type);
+    UNUSED(channel);
+    UNUSED(packet);
+    UNUSED(size);
+}
+
+static hci_transport_t transport;
+
+static uint64_t get_time_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void setup(int num_connections){
+    memset(&transport, 0, sizeof(transport));
+    transport.name = "BENCHMARK";
+    transport.register_packet_handler = &transport_register_packet_handler;
+    transport.send_packet = &transport_send_packet;
+    hci_init(&transport, NULL);
+    hci_register_acl_packet_handler(&acl_packet_handler);
+
+    // LE Read Buffer Size Complete: 8 packets
+    uint8_t buffer_size[] = { HCI_EVENT_COMMAND_COMPLETE, 7, 1, 0x02, 0x20, 0, 27, 0, 8};
+    transport_packet_handler(HCI_EVENT_PACKET, buffer_size, sizeof(buffer_size));
+
+    // LE Connection Complete events with sequential handles
+    int i;
+    for (i = 0; i < num_connections; i++){
+        uint8_t event[] = { HCI_EVENT_LE_META, 19, HCI_SUBEVENT_LE_CONNECTION_COMPLETE, 0, 0, 0, HCI_ROLE_MASTER, 0,
+            0, 0, 0, 0, 0, 0, 0x28, 0, 0, 0, 0x48, 0, 0};
+        little_endian_store_16(event, 4, 0x40 + i);
+        little_endian_store_16(event, 8, 0x40 + i);
+        transport_packet_handler(HCI_EVENT_PACKET, event, sizeof(event));
+    }
+}
+
+static void run(int num_connections){
+    setup(num_connections);
+
+    uint8_t acl_in[] = { 0, 0x20, 4, 0, 0, 0, 0x04, 0};
+    uint8_t completed[] = { HCI_EVENT_NUMBER_OF_COMPLETED_PACKETS, 5, 1, 0, 0, 1, 0};
+    int sent = 0;
+
+    uint64_t start = get_time_ns();
+    int i;
+    for (i = 0; i < NUM_ITERATIONS; i++){
+        // most recently connected device is the worst case for a list walk
+        hci_con_handle_t con_handle = 0x40 + num_connections - 1 - (i % num_connections);
+
+        // incoming
+        little_endian_store_16(acl_in, 0, con_handle | (2 << 12));
+        transport_packet_handler(HCI_ACL_DATA_PACKET, acl_in, sizeof(acl_in));
+
+        // outgoing
+        if (hci_can_send_acl_packet_now(con_handle)){
+            hci_reserve_packet_buffer();
+            uint8_t * packet = hci_get_outgoing_packet_buffer();
+            little_endian_store_16(packet, 0, con_handle | (2 << 12));
+            little_endian_store_16(packet, 2, 4);
+            little_endian_store_16(packet, 4, 0);
+            little_endian_store_16(packet, 6, 0x0004);
+            hci_send_acl_packet_buffer(8);
+            sent++;
+        }
+
+        // controller completed packet
+        little_endian_store_16(completed, 3, con_handle);
+        transport_packet_handler(HCI_EVENT_PACKET, completed, sizeof(completed));
+    }
+    uint64_t duration = get_time_ns() - start;
+
+    printf("%2u connections: %6.1f ns per packet (%u sent)\n", num_connections, (double) duration / NUM_ITERATIONS, sent);
+    hci_close();
+}
+
+int main(int argc, const char * argv[]){
+    UNUSED(argc);
+    (void) argv;
+    btstack_memory_init();
+    btstack_run_loop_init(btstack_run_loop_posix_get_instance());
+
+    const int num_connections[] = { 1, 8, 32, 64 };
+    unsigned int i;
+    for (i = 0; i < sizeof(num_connections) / sizeof(int); i++){
+        run(num_connections[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,404 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "CppUTest/TestHarness.h"
+#include "CppUTest/CommandLineTestRunner.h"
+
+#include "btstack_memory.h"
+#include "btstack_run_loop.h"
+#include "btstack_run_loop_posix.h"
+#include "btstack_util.h"
+#include "hci.h"
+#include "hci_transport.h"
+
+static void (*transport_packet_handler)(uint8_t packet_type, uint8_t *packet, uint16_t size);
+
+static void transport_register_packet_handler(void (*handler)(uint8_t packet_type, uint8_t *packet, uint16_t size)){
+    transport_packet_handler = handler;
+}
+
+// log of sent ACL fragments: handle and size
+#define MAX_SENT_FRAGMENTS 32
+static hci_con_handle_t sent_handles[MAX_SENT_FRAGMENTS];
+static int sent_sizes[MAX_SENT_FRAGMENTS];
+static int num_sent_fragments;
+
+static int transport_send_packet(uint8_t packet_type, uint8_t * packet, int size){
+    if (packet_type != HCI_ACL_DATA_PACKET) return 0;
+    if (num_sent_fragments >= MAX_SENT_FRAGMENTS) return 0;
+    sent_handles[num_sent_fragments] = READ_ACL_CONNECTION_HANDLE(packet);
+    sent_sizes[num_sent_fragments] = size;
+    num_sent_fragments++;
+    return 0;
+}
+
+static hci_transport_t transport;
+
+static void le_read_buffer_size_complete(uint8_t num_packets){
+    uint8_t event[] = { HCI_EVENT_COMMAND_COMPLETE, 7, 1, 0x02, 0x20, 0, 27, 0, 0};
+    event[8] = num_packets;
+    transport_packet_handler(HCI_EVENT_PACKET, event, sizeof(event));
+}
+
+static void le_connection_complete(hci_con_handle_t con_handle){
+    uint8_t event[] = { HCI_EVENT_LE_META, 19, HCI_SUBEVENT_LE_CONNECTION_COMPLETE, 0, 0, 0, HCI_ROLE_MASTER, 0, 
+        0, 0, 0, 0, 0, 0, 0x28, 0, 0, 0, 0x48, 0, 0};
+    little_endian_store_16(event, 4, con_handle);
+    // use con handle as address
+    little_endian_store_16(event, 8, con_handle);
+    transport_packet_handler(HCI_EVENT_PACKET, event, sizeof(event));
+}
+
+static void disconnection_complete(hci_con_handle_t con_handle){
+    uint8_t event[] = { HCI_EVENT_DISCONNECTION_COMPLETE, 4, 0, 0, 0, 0x13};
+    little_endian_store_16(event, 3, con_handle);
+    transport_packet_handler(HCI_EVENT_PACKET, event, sizeof(event));
+}
+
+static void number_of_completed_packets(hci_con_handle_t con_handle, uint16_t num_packets){
+    uint8_t event[] = { HCI_EVENT_NUMBER_OF_COMPLETED_PACKETS, 5, 1, 0, 0, 0, 0};
+    little_endian_store_16(event, 3, con_handle);
+    little_endian_store_16(event, 5, num_packets);
+    transport_packet_handler(HCI_EVENT_PACKET, event, sizeof(event));
+}
+
+static int send_acl_packet_with_payload(hci_con_handle_t con_handle, uint16_t payload_len){
+    if (!hci_can_send_acl_packet_now(con_handle)) return 0;
+    hci_reserve_packet_buffer();
+    uint8_t * packet = hci_get_outgoing_packet_buffer();
+    little_endian_store_16(packet, 0, con_handle | (2 << 12));
+    little_endian_store_16(packet, 2, 4 + payload_len);
+    little_endian_store_16(packet, 4, payload_len);
+    little_endian_store_16(packet, 6, 0x0004);
+    memset(&packet[8], 0x55, payload_len);
+    hci_send_acl_packet_buffer(8 + payload_len);
+    return 1;
+}
+
+static int send_acl_packet(hci_con_handle_t con_handle){
+    return send_acl_packet_with_payload(con_handle, 0);
+}
+
+TEST_GROUP(HCIConnection){
+    void setup(void){
+        memset(&transport, 0, sizeof(transport));
+        transport.name = "TEST";
+        transport.register_packet_handler = &transport_register_packet_handler;
+        transport.send_packet = &transport_send_packet;
+        hci_init(&transport, NULL);
+        le_read_buffer_size_complete(4);
+        num_sent_fragments = 0;
+    }
+    void teardown(void){
+        hci_close();
+    }
+};
+
+TEST(HCIConnection, LookupByHandle){
+    int i;
+    // handles colliding in connection hash and sequential ones
+    for (i = 0; i < 40; i++){
+        le_connection_complete(0x40 + i * (i & 1 ? 1 : HCI_CONNECTION_HASH_SIZE));
+    }
+    for (i = 0; i < 40; i++){
+        hci_con_handle_t con_handle = 0x40 + i * (i & 1 ? 1 : HCI_CONNECTION_HASH_SIZE);
+        hci_connection_t * conn = hci_connection_for_handle(con_handle);
+        CHECK(conn != NULL);
+        CHECK_EQUAL(con_handle, conn->con_handle);
+        CHECK_EQUAL(con_handle, big_endian_read_16(conn->address, 4));
+    }
+    CHECK(hci_connection_for_handle(0x0fff) == NULL);
+}
+
+TEST(HCIConnection, DisconnectRemovesHandle){
+    le_connection_complete(0x0040);
+    le_connection_complete(0x0040 + HCI_CONNECTION_HASH_SIZE);
+    le_connection_complete(0x0040 + 2 * HCI_CONNECTION_HASH_SIZE);
+    disconnection_complete(0x0040 + HCI_CONNECTION_HASH_SIZE);
+    CHECK(hci_connection_for_handle(0x0040) != NULL);
+    CHECK(hci_connection_for_handle(0x0040 + HCI_CONNECTION_HASH_SIZE) == NULL);
+    CHECK(hci_connection_for_handle(0x0040 + 2 * HCI_CONNECTION_HASH_SIZE) != NULL);
+}
+
+TEST(HCIConnection, SlotAccounting){
+    le_connection_complete(0x0040);
+    le_connection_complete(0x0041);
+    CHECK_EQUAL(1, send_acl_packet(0x0040));
+    CHECK_EQUAL(1, send_acl_packet(0x0040));
+    CHECK_EQUAL(1, send_acl_packet(0x0041));
+    CHECK_EQUAL(1, hci_number_free_acl_slots_for_handle(0x0040));
+    CHECK_EQUAL(1, send_acl_packet(0x0041));
+    CHECK_EQUAL(0, hci_number_free_acl_slots_for_handle(0x0040));
+    number_of_completed_packets(0x0040, 1);
+    CHECK_EQUAL(1, hci_number_free_acl_slots_for_handle(0x0041));
+    // packets in flight of closed connection don't count anymore
+    disconnection_complete(0x0041);
+    CHECK_EQUAL(3, hci_number_free_acl_slots_for_handle(0x0040));
+    // more packets completed than sent
+    number_of_completed_packets(0x0040, 5);
+    CHECK_EQUAL(4, hci_number_free_acl_slots_for_handle(0x0040));
+}
+
+TEST_GROUP(ACLScheduler){
+    void setup(void){
+        memset(&transport, 0, sizeof(transport));
+        transport.name = "TEST";
+        transport.register_packet_handler = &transport_register_packet_handler;
+        transport.send_packet = &transport_send_packet;
+        hci_init(&transport, NULL);
+        // single LE buffer with 27 bytes in controller
+        le_read_buffer_size_complete(1);
+        le_connection_complete(0x0040);
+        le_connection_complete(0x0041);
+        num_sent_fragments = 0;
+    }
+    void teardown(void){
+        hci_close();
+    }
+    void complete_last_fragment(void){
+        number_of_completed_packets(sent_handles[num_sent_fragments-1], 1);
+    }
+};
+
+TEST(ACLScheduler, InterleaveFragments){
+    // 4 fragments for 0x0040, 1 for 0x0041
+    CHECK_EQUAL(1, send_acl_packet_with_payload(0x0040, 80));
+    CHECK_EQUAL(1, send_acl_packet(0x0041));
+    CHECK_EQUAL(1, num_sent_fragments);
+    while (num_sent_fragments < 5){
+        int num_sent = num_sent_fragments;
+        complete_last_fragment();
+        CHECK_EQUAL(num_sent + 1, num_sent_fragments);
+    }
+    const hci_con_handle_t expected_handles[] = { 0x0040, 0x0041, 0x0040, 0x0040, 0x0040 };
+    const int expected_sizes[] = { 31, 8, 31, 31, 4 + 84 - 3 * 27};
+    int i;
+    for (i = 0; i < 5; i++){
+        CHECK_EQUAL(expected_handles[i], sent_handles[i]);
+        CHECK_EQUAL(expected_sizes[i], sent_sizes[i]);
+    }
+}
+
+TEST(ACLScheduler, Weight){
+    hci_set_acl_tx_weight(0x0040, 2);
+    CHECK_EQUAL(1, send_acl_packet_with_payload(0x0040, 80));
+    CHECK_EQUAL(1, send_acl_packet_with_payload(0x0041, 40));
+    while (num_sent_fragments < 6){
+        complete_last_fragment();
+    }
+    const hci_con_handle_t expected_handles[] = { 0x0040, 0x0040, 0x0041, 0x0040, 0x0040, 0x0041 };
+    int i;
+    for (i = 0; i < 6; i++){
+        CHECK_EQUAL(expected_handles[i], sent_handles[i]);
+    }
+}
+
+TEST(ACLScheduler, QueueDepthAndStats){
+    int i;
+    // first packet sent directly, then queue fills up
+    for (i = 0; i <= HCI_ACL_TX_QUEUE_DEPTH; i++){
+        CHECK_EQUAL(1, send_acl_packet(0x0040));
+    }
+    CHECK_EQUAL(0, hci_can_send_acl_packet_now(0x0040));
+    CHECK_EQUAL(1, hci_can_send_acl_packet_now(0x0041));
+    hci_acl_tx_stats_t stats;
+    CHECK_EQUAL(1, hci_get_acl_tx_stats(0x0040, &stats));
+    CHECK_EQUAL(HCI_ACL_TX_QUEUE_DEPTH, stats.queue_depth);
+    CHECK_EQUAL(HCI_ACL_TX_QUEUE_DEPTH, stats.queue_depth_max);
+    CHECK_EQUAL(1, stats.packets_sent);
+    for (i = 0; i < HCI_ACL_TX_QUEUE_DEPTH; i++){
+        complete_last_fragment();
+    }
+    CHECK_EQUAL(1, hci_can_send_acl_packet_now(0x0040));
+    hci_get_acl_tx_stats(0x0040, &stats);
+    CHECK_EQUAL(0, stats.queue_depth);
+    CHECK_EQUAL(HCI_ACL_TX_QUEUE_DEPTH + 1, stats.packets_sent);
+    CHECK_EQUAL(HCI_ACL_TX_QUEUE_DEPTH + 1, stats.fragments_sent);
+    CHECK_EQUAL(0, hci_get_acl_tx_stats(0x0fff, &stats));
+}
+
+TEST(ACLScheduler, DisconnectDropsQueue){
+    CHECK_EQUAL(1, send_acl_packet(0x0040));
+    CHECK_EQUAL(1, send_acl_packet(0x0041));
+    CHECK_EQUAL(1, send_acl_packet(0x0041));
+    disconnection_complete(0x0041);
+    complete_last_fragment();
+    CHECK_EQUAL(1, num_sent_fragments);
+    CHECK_EQUAL(1, send_acl_packet(0x0040));
+    CHECK_EQUAL(2, num_sent_fragments);
+}
+
+// asynchronous transport that accepts transport_window packets before it reports them sent with a single event
+static int transport_window;
+static int transport_packets_accepted;
+
+static int transport_can_send_packet_now(uint8_t packet_type){
+    UNUSED(packet_type);
+    return transport_packets_accepted < transport_window;
+}
+
+static int transport_send_packet_async(uint8_t packet_type, uint8_t * packet, int size){
+    transport_packets_accepted++;
+    return transport_send_packet(packet_type, packet, size);
+}
+
+static void transport_packets_sent(void){
+    transport_packets_accepted = 0;
+    uint8_t event[] = { HCI_EVENT_TRANSPORT_PACKET_SENT, 0};
+    transport_packet_handler(HCI_EVENT_PACKET, event, sizeof(event));
+}
+
+static int num_free_acl_buffers(void){
+    hci_acl_buffer_t * acl_buffers[MAX_NR_HCI_ACL_BUFFERS];
+    int num = 0;
+    while (num < MAX_NR_HCI_ACL_BUFFERS){
+        acl_buffers[num] = btstack_memory_hci_acl_buffer_get();
+        if (!acl_buffers[num]) break;
+        num++;
+    }
+    int i;
+    for (i = 0; i < num; i++){
+        btstack_memory_hci_acl_buffer_free(acl_buffers[i]);
+    }
+    return num;
+}
+
+TEST_GROUP(ACLSchedulerAsync){
+    void setup(void){
+        memset(&transport, 0, sizeof(transport));
+        transport.name = "TEST_ASYNC";
+        transport.register_packet_handler = &transport_register_packet_handler;
+        transport.send_packet = &transport_send_packet_async;
+        transport.can_send_packet_now = &transport_can_send_packet_now;
+        transport_window = 2;
+        transport_packets_accepted = 0;
+        hci_init(&transport, NULL);
+        le_read_buffer_size_complete(2);
+        le_connection_complete(0x0040);
+        le_connection_complete(0x0041);
+        num_sent_fragments = 0;
+    }
+    void teardown(void){
+        hci_close();
+    }
+};
+
+TEST(ACLSchedulerAsync, FragmentsReportedSentTogetherAreFreed){
+    // spare buffer for can send now checks is allocated
+    CHECK_EQUAL(1, hci_can_send_acl_packet_now(0x0040));
+    int num_free = num_free_acl_buffers();
+
+    // use up controller buffers with packets sent directly from HCI packet buffer
+    CHECK_EQUAL(1, send_acl_packet(0x0040));
+    transport_packets_sent();
+    CHECK_EQUAL(1, send_acl_packet(0x0040));
+    transport_packets_sent();
+    CHECK_EQUAL(2, num_sent_fragments);
+
+    // queued until controller has space
+    CHECK_EQUAL(1, send_acl_packet(0x0040));
+    CHECK_EQUAL(1, send_acl_packet(0x0041));
+    CHECK_EQUAL(2, num_sent_fragments);
+
+    // transport could take both, but only one fragment is handed over until it is reported sent
+    number_of_completed_packets(0x0040, 2);
+    CHECK_EQUAL(3, num_sent_fragments);
+    transport_packets_sent();
+    CHECK_EQUAL(4, num_sent_fragments);
+    transport_packets_sent();
+    CHECK(sent_handles[2] != sent_handles[3]);
+
+    CHECK_EQUAL(1, hci_can_send_acl_packet_now(0x0040));
+    CHECK_EQUAL(num_free, num_free_acl_buffers());
+}
+
+static uint8_t received_packet[200];
+static int received_size;
+
+static void acl_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *packet, uint16_t size){
+    UNUSED(packet_type);
+    UNUSED(channel);
+    memcpy(received_packet, packet, size);
+    received_size = size;
+}
+
+TEST_GROUP(ACLReassembly){
+    uint8_t l2cap_packet[100];
+    void setup(void){
+        memset(&transport, 0, sizeof(transport));
+        transport.name = "TEST";
+        transport.register_packet_handler = &transport_register_packet_handler;
+        transport.send_packet = &transport_send_packet;
+        hci_init(&transport, NULL);
+        hci_register_acl_packet_handler(&acl_packet_handler);
+        le_read_buffer_size_complete(4);
+        le_connection_complete(0x0040);
+        received_size = 0;
+        // L2CAP packet with 96 bytes payload
+        int i;
+        little_endian_store_16(l2cap_packet, 0, sizeof(l2cap_packet) - 4);
+        little_endian_store_16(l2cap_packet, 2, 0x0040);
+        for (i = 4; i < (int) sizeof(l2cap_packet); i++){
+            l2cap_packet[i] = i;
+        }
+    }
+    void teardown(void){
+        hci_close();
+    }
+    void receive_fragment(uint8_t * buffer, int offset, int len){
+        little_endian_store_16(buffer, 0, 0x0040 | ((offset ? 1 : 2) << 12));
+        little_endian_store_16(buffer, 2, len);
+        memcpy(&buffer[4], &l2cap_packet[offset], len);
+        transport_packet_handler(HCI_ACL_DATA_PACKET, buffer, len + 4);
+    }
+    void check_received(void){
+        CHECK_EQUAL(4 + sizeof(l2cap_packet), received_size);
+        CHECK_EQUAL(sizeof(l2cap_packet), little_endian_read_16(received_packet, 2));
+        MEMCMP_EQUAL(l2cap_packet, &received_packet[4], sizeof(l2cap_packet));
+    }
+};
+
+TEST(ACLReassembly, Copy){
+    uint8_t fragment[4 + 40];
+    receive_fragment(fragment, 0, 40);
+    receive_fragment(fragment, 40, 40);
+    CHECK_EQUAL(0, received_size);
+    receive_fragment(fragment, 80, 20);
+    check_received();
+}
+
+TEST(ACLReassembly, InPlace){
+    uint8_t fragment[4 + 40];
+    uint8_t acl_header[4];
+    receive_fragment(fragment, 0, 40);
+    // transport reads continuation fragments into reassembly buffer
+    int offset;
+    for (offset = 40; offset < (int) sizeof(l2cap_packet); offset += 30){
+        little_endian_store_16(acl_header, 0, 0x0040 | (1 << 12));
+        little_endian_store_16(acl_header, 2, 30);
+        uint8_t * buffer = hci_acl_reassembly_buffer_for_fragment(acl_header);
+        CHECK(buffer != NULL);
+        receive_fragment(buffer, offset, offset + 30 > (int) sizeof(l2cap_packet) ? sizeof(l2cap_packet) - offset : 30);
+    }
+    check_received();
+    // not for first fragments or without packet in progress
+    little_endian_store_16(acl_header, 0, 0x0040 | (2 << 12));
+    CHECK(hci_acl_reassembly_buffer_for_fragment(acl_header) == NULL);
+    little_endian_store_16(acl_header, 0, 0x0040 | (1 << 12));
+    CHECK(hci_acl_reassembly_buffer_for_fragment(acl_header) == NULL);
+}
+
+TEST(ACLReassembly, DropStaleFragments){
+    uint8_t fragment[4 + 40];
+    receive_fragment(fragment, 0, 40);
+    receive_fragment(fragment, 0, 40);
+    receive_fragment(fragment, 40, 40);
+    receive_fragment(fragment, 80, 20);
+    check_received();
+}
+
+int main (int argc, const char * argv[]){
+    btstack_memory_init();
+    btstack_run_loop_init(btstack_run_loop_posix_get_instance());
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
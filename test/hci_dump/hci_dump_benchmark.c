@@ -0,0 +1,91 @@
+// Measures the cost of hci_dump_packet and hci_dump_log on the calling thread when logging in
+// PacketLogger format to a file, for different packet sizes. Built with synchronous writes,
+// with ENABLE_HCI_DUMP_ASYNC, and with ENABLE_HCI_DUMP_ASYNC and ENABLE_HCI_DUMP_DEFERRED_LOG. Packets are dumped in bursts followed by a pause, similar to
+// Bluetooth traffic, so that the async writer can keep up.
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "btstack_util.h"
+#include "hci.h"
+#include "hci_dump.h"
+
+#define DUMP_FILE "/tmp/btstack_hci_dump_benchmark.pklg"
+#define TOTAL_BYTES  (1024 * 1024)
+#define BURST_BYTES  (16 * 1024)
+#define BURST_PAUSE_US 25000
+
+static uint64_t get_time_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void run(uint16_t packet_len){
+    uint8_t packet[1024];
+    memset(packet, 0x55, sizeof(packet));
+
+    int packets_per_burst = BURST_BYTES / (13 + packet_len);
+    int num_bursts = TOTAL_BYTES / BURST_BYTES;
+    uint64_t duration = 0;
+
+    hci_dump_open(DUMP_FILE, HCI_DUMP_PACKETLOGGER);
+    int i;
+    for (i = 0; i < num_bursts; i++){
+        uint64_t start = get_time_ns();
+        int j;
+        for (j = 0; j < packets_per_burst; j++){
+            hci_dump_packet(HCI_ACL_DATA_PACKET, j & 1, packet, packet_len);
+        }
+        duration += get_time_ns() - start;
+        usleep(BURST_PAUSE_US);
+    }
+    hci_dump_close();
+    unlink(DUMP_FILE);
+
+    printf("%4u bytes: %6.1f ns per packet\n", packet_len, (double) duration / (num_bursts * packets_per_burst));
+}
+
+static void run_log(void){
+    int messages_per_burst = BURST_BYTES / 64;
+    int num_bursts = TOTAL_BYTES / BURST_BYTES;
+    uint64_t duration = 0;
+
+    hci_dump_open(DUMP_FILE, HCI_DUMP_PACKETLOGGER);
+    int i;
+    for (i = 0; i < num_bursts; i++){
+        uint64_t start = get_time_ns();
+        int j;
+        for (j = 0; j < messages_per_burst; j++){
+            hci_dump_log(LOG_LEVEL_INFO, "le packet pos %u, len %u, cid 0x%02x", j, 27, 0x40);
+        }
+        duration += get_time_ns() - start;
+        usleep(BURST_PAUSE_US);
+    }
+    hci_dump_close();
+    unlink(DUMP_FILE);
+
+    printf(" log message: %6.1f ns per message\n", (double) duration / (num_bursts * messages_per_burst));
+}
+
+int main(int argc, const char * argv[]){
+    UNUSED(argc);
+    (void) argv;
+
+#if defined(ENABLE_HCI_DUMP_ASYNC) && defined(ENABLE_HCI_DUMP_DEFERRED_LOG)
+    printf("asynchronous writer, deferred log formatting\n");
+#elif defined(ENABLE_HCI_DUMP_ASYNC)
+    printf("asynchronous writer\n");
+#else
+    printf("synchronous writes\n");
+#endif
+    const uint16_t packet_lens[] = { 8, 27, 251, 1021 };
+    unsigned int i;
+    for (i = 0; i < sizeof(packet_lens) / sizeof(uint16_t); i++){
+        run(packet_lens[i]);
+    }
+    run_log();
+    return 0;
+}
@@ -0,0 +1,161 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "CppUTest/TestHarness.h"
+#include "CppUTest/CommandLineTestRunner.h"
+
+#include "btstack_util.h"
+#include "hci.h"
+#include "hci_dump.h"
+
+#define DUMP_FILE "/tmp/btstack_hci_dump_deferred_log_test.pklg"
+#define RECORD_HEADER_SIZE 13
+#define DEFERRED_LOG_PACKET 0xf0
+
+// records parsed from dump file
+#define MAX_RECORDS 64
+static uint8_t   record_types[MAX_RECORDS];
+static uint16_t  record_lens[MAX_RECORDS];
+static uint8_t * record_data[MAX_RECORDS];
+static int       num_records;
+
+static uint8_t file_data[16384];
+
+static void parse_packetlogger(const char * name){
+    num_records = 0;
+    FILE * f = fopen(name, "rb");
+    if (!f) return;
+    int len = fread(file_data, 1, sizeof(file_data), f);
+    fclose(f);
+    int pos = 0;
+    while (pos + RECORD_HEADER_SIZE <= len && num_records < MAX_RECORDS){
+        uint32_t record_len = big_endian_read_32(file_data, pos);
+        record_types[num_records] = file_data[pos + 12];
+        record_lens[num_records] = record_len - 9;
+        record_data[num_records] = &file_data[pos + RECORD_HEADER_SIZE];
+        num_records++;
+        pos += 4 + record_len;
+    }
+}
+
+static void remove_files(void){
+    unlink(DUMP_FILE);
+    unlink(DUMP_FILE ".1");
+}
+
+TEST_GROUP(DeferredLog){
+    void setup(void){
+        remove_files();
+        hci_dump_set_max_packets(-1);
+        hci_dump_set_max_file_size(0, 0);
+    }
+    void teardown(void){
+        remove_files();
+    }
+};
+
+TEST(DeferredLog, FormatAndMessage){
+    const char * format = "le packet pos %u, len %d, %s";
+    hci_dump_open(DUMP_FILE, HCI_DUMP_PACKETLOGGER);
+    hci_dump_log(LOG_LEVEL_INFO, format, 5, -3, "abc");
+    hci_dump_log(LOG_LEVEL_INFO, format, 6, 4, "");
+    hci_dump_close();
+
+    parse_packetlogger(DUMP_FILE);
+    CHECK_EQUAL(3, num_records);
+
+    // format definition
+    CHECK_EQUAL(DEFERRED_LOG_PACKET, record_types[0]);
+    CHECK_EQUAL(3 + strlen(format), record_lens[0]);
+    CHECK_EQUAL(0, record_data[0][0]);
+    uint16_t format_id = little_endian_read_16(record_data[0], 1);
+    MEMCMP_EQUAL(format, &record_data[0][3], strlen(format));
+
+    // messages
+    const uint8_t arguments_1[] = { 1, 0, 0, 5, 0, 0, 0, 0xfd, 0xff, 0xff, 0xff, 3, 'a', 'b', 'c'};
+    little_endian_store_16((uint8_t *) arguments_1, 1, format_id);
+    CHECK_EQUAL(DEFERRED_LOG_PACKET, record_types[1]);
+    CHECK_EQUAL(sizeof(arguments_1), record_lens[1]);
+    MEMCMP_EQUAL(arguments_1, record_data[1], sizeof(arguments_1));
+
+    const uint8_t arguments_2[] = { 1, 0, 0, 6, 0, 0, 0, 4, 0, 0, 0, 0};
+    little_endian_store_16((uint8_t *) arguments_2, 1, format_id);
+    CHECK_EQUAL(sizeof(arguments_2), record_lens[2]);
+    MEMCMP_EQUAL(arguments_2, record_data[2], sizeof(arguments_2));
+}
+
+TEST(DeferredLog, WideArguments){
+    hci_dump_open(DUMP_FILE, HCI_DUMP_PACKETLOGGER);
+    hci_dump_log(LOG_LEVEL_INFO, "%lu %llx %*u %.1f %%", 1UL, 0x1122334455667788ULL, 4, 7, 0.5);
+    hci_dump_close();
+
+    parse_packetlogger(DUMP_FILE);
+    CHECK_EQUAL(2, num_records);
+    // id, 2 x 64 bit, width, 32 bit, double
+    CHECK_EQUAL(3 + 8 + 8 + 4 + 4 + 8, record_lens[1]);
+    CHECK_EQUAL(1, little_endian_read_32(record_data[1], 3));
+    CHECK_EQUAL(0x55667788, little_endian_read_32(record_data[1], 11));
+    CHECK_EQUAL(0x11223344, little_endian_read_32(record_data[1], 15));
+    CHECK_EQUAL(4, little_endian_read_32(record_data[1], 19));
+    CHECK_EQUAL(7, little_endian_read_32(record_data[1], 23));
+}
+
+TEST(DeferredLog, UnsupportedConversion){
+    hci_dump_open(DUMP_FILE, HCI_DUMP_PACKETLOGGER);
+    hci_dump_log(LOG_LEVEL_INFO, "hex float %a", 1.0);
+    hci_dump_close();
+
+    // formatted as text
+    parse_packetlogger(DUMP_FILE);
+    CHECK_EQUAL(2, num_records);
+    CHECK_EQUAL(LOG_MESSAGE_PACKET, record_types[1]);
+    MEMCMP_EQUAL("hex float 0x1p+0", record_data[1], record_lens[1]);
+}
+
+TEST(DeferredLog, BlueZ){
+    hci_dump_open(DUMP_FILE, HCI_DUMP_BLUEZ);
+    hci_dump_log(LOG_LEVEL_INFO, "value %u", 1);
+    hci_dump_close();
+
+    // formatted as text
+    FILE * f = fopen(DUMP_FILE, "rb");
+    int len = fread(file_data, 1, sizeof(file_data), f);
+    fclose(f);
+    CHECK_EQUAL(RECORD_HEADER_SIZE + 7, len);
+    CHECK_EQUAL(LOG_MESSAGE_PACKET, file_data[12]);
+}
+
+TEST(DeferredLog, FormatsRepeatedAfterRotation){
+    uint8_t packet[100];
+    memset(packet, 0, sizeof(packet));
+    hci_dump_set_max_file_size(1000, 2);
+    hci_dump_open(DUMP_FILE, HCI_DUMP_PACKETLOGGER);
+    hci_dump_log(LOG_LEVEL_INFO, "first %u", 1);
+    hci_dump_log(LOG_LEVEL_INFO, "second %u", 2);
+    // let async writer flush in between
+    usleep(50000);
+    int i;
+    for (i=0;i<10;i++){
+        hci_dump_packet(HCI_ACL_DATA_PACKET, 0, packet, sizeof(packet));
+    }
+    usleep(50000);
+    hci_dump_log(LOG_LEVEL_INFO, "second %u", 3);
+    hci_dump_close();
+
+    // new file starts with both format definitions
+    parse_packetlogger(DUMP_FILE);
+    CHECK(num_records >= 3);
+    CHECK_EQUAL(DEFERRED_LOG_PACKET, record_types[0]);
+    CHECK_EQUAL(0, record_data[0][0]);
+    CHECK_EQUAL(DEFERRED_LOG_PACKET, record_types[1]);
+    CHECK_EQUAL(0, record_data[1][0]);
+    CHECK_EQUAL(DEFERRED_LOG_PACKET, record_types[num_records-1]);
+    CHECK_EQUAL(1, record_data[num_records-1][0]);
+}
+
+int main (int argc, const char * argv[]){
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
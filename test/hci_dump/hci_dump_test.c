@@ -0,0 +1,166 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "CppUTest/TestHarness.h"
+#include "CppUTest/CommandLineTestRunner.h"
+
+#include "btstack_util.h"
+#include "hci.h"
+#include "hci_dump.h"
+
+#define DUMP_FILE "/tmp/btstack_hci_dump_test.pklg"
+#define RECORD_HEADER_SIZE 13
+
+// records parsed from dump file
+#define MAX_RECORDS 64
+static uint8_t  record_types[MAX_RECORDS];
+static uint16_t record_lens[MAX_RECORDS];
+static uint8_t  record_first_bytes[MAX_RECORDS];
+static int      num_records;
+
+static uint8_t file_data[16384];
+
+static int read_file(const char * name){
+    FILE * f = fopen(name, "rb");
+    if (!f) return -1;
+    int len = fread(file_data, 1, sizeof(file_data), f);
+    fclose(f);
+    return len;
+}
+
+// @returns number of bytes not part of a complete record
+static int parse_packetlogger(const char * name){
+    num_records = 0;
+    int len = read_file(name);
+    if (len < 0) return -1;
+    int pos = 0;
+    while (pos + RECORD_HEADER_SIZE <= len && num_records < MAX_RECORDS){
+        uint32_t record_len = big_endian_read_32(file_data, pos);
+        if (pos + 4 + (int) record_len > len) break;
+        record_types[num_records] = file_data[pos + 12];
+        record_lens[num_records] = record_len - 9;
+        record_first_bytes[num_records] = file_data[pos + RECORD_HEADER_SIZE];
+        num_records++;
+        pos += 4 + record_len;
+    }
+    return len - pos;
+}
+
+static void remove_files(void){
+    char name[64];
+    int i;
+    unlink(DUMP_FILE);
+    for (i=1;i<4;i++){
+        snprintf(name, sizeof(name), "%s.%u", DUMP_FILE, i);
+        unlink(name);
+    }
+}
+
+static void dump_acl_packets(int count, uint16_t len){
+    uint8_t packet[1024];
+    int i;
+    for (i=0;i<count;i++){
+        memset(packet, i, len);
+        hci_dump_packet(HCI_ACL_DATA_PACKET, 0, packet, len);
+    }
+}
+
+TEST_GROUP(HCIDump){
+    void setup(void){
+        remove_files();
+        hci_dump_set_max_packets(-1);
+        hci_dump_set_max_file_size(0, 0);
+    }
+    void teardown(void){
+        remove_files();
+    }
+};
+
+TEST(HCIDump, PacketLogger){
+    uint8_t command[] = { 0x03, 0x0c, 0x00 };
+    uint8_t event[]   = { 0x0e, 0x04, 0x01, 0x03, 0x0c, 0x00 };
+    uint8_t acl[]     = { 0x40, 0x20, 0x04, 0x00, 0x00, 0x00, 0x04, 0x00 };
+    hci_dump_open(DUMP_FILE, HCI_DUMP_PACKETLOGGER);
+    hci_dump_packet(HCI_COMMAND_DATA_PACKET, 0, command, sizeof(command));
+    hci_dump_packet(HCI_EVENT_PACKET, 1, event, sizeof(event));
+    hci_dump_packet(HCI_ACL_DATA_PACKET, 0, acl, sizeof(acl));
+    hci_dump_packet(HCI_ACL_DATA_PACKET, 1, acl, sizeof(acl));
+    hci_dump_log(LOG_LEVEL_INFO, "test %u", 42);
+    hci_dump_close();
+
+    CHECK_EQUAL(0, parse_packetlogger(DUMP_FILE));
+    CHECK_EQUAL(5, num_records);
+    CHECK_EQUAL(0x00, record_types[0]);
+    CHECK_EQUAL(0x01, record_types[1]);
+    CHECK_EQUAL(0x02, record_types[2]);
+    CHECK_EQUAL(0x03, record_types[3]);
+    CHECK_EQUAL(0xfc, record_types[4]);
+    CHECK_EQUAL(sizeof(command), record_lens[0]);
+    CHECK_EQUAL(sizeof(event), record_lens[1]);
+    CHECK_EQUAL(sizeof(acl), record_lens[2]);
+    CHECK_EQUAL(7, record_lens[4]);
+    MEMCMP_EQUAL(event, &file_data[RECORD_HEADER_SIZE + sizeof(command) + RECORD_HEADER_SIZE], sizeof(event));
+}
+
+TEST(HCIDump, BlueZ){
+    uint8_t event[] = { 0x0e, 0x04, 0x01, 0x03, 0x0c, 0x00 };
+    hci_dump_open(DUMP_FILE, HCI_DUMP_BLUEZ);
+    hci_dump_packet(HCI_EVENT_PACKET, 1, event, sizeof(event));
+    hci_dump_close();
+
+    int len = read_file(DUMP_FILE);
+    CHECK_EQUAL(RECORD_HEADER_SIZE + (int) sizeof(event), len);
+    CHECK_EQUAL(1 + sizeof(event), little_endian_read_16(file_data, 0));
+    CHECK_EQUAL(1, file_data[2]);
+    CHECK_EQUAL(HCI_EVENT_PACKET, file_data[12]);
+    MEMCMP_EQUAL(event, &file_data[RECORD_HEADER_SIZE], sizeof(event));
+}
+
+TEST(HCIDump, MaxPackets){
+    hci_dump_set_max_packets(4);
+    hci_dump_open(DUMP_FILE, HCI_DUMP_PACKETLOGGER);
+    dump_acl_packets(10, 8);
+    hci_dump_close();
+
+    // truncated before packets 4 and 8
+    CHECK_EQUAL(0, parse_packetlogger(DUMP_FILE));
+    CHECK_EQUAL(2, num_records);
+    CHECK_EQUAL(8, record_first_bytes[0]);
+    CHECK_EQUAL(9, record_first_bytes[1]);
+}
+
+TEST(HCIDump, Rotation){
+    const int record_size = RECORD_HEADER_SIZE + 100;
+    hci_dump_set_max_file_size(4 * record_size, 3);
+    hci_dump_open(DUMP_FILE, HCI_DUMP_PACKETLOGGER);
+    int i;
+    for (i=0;i<6;i++){
+        dump_acl_packets(2, 100);
+        // let async writer flush in between
+        usleep(50000);
+    }
+    hci_dump_close();
+
+    // all files contain complete records, no more than 3 files
+    int total_records = 0;
+    CHECK_EQUAL(0, parse_packetlogger(DUMP_FILE));
+    CHECK(num_records <= 4);
+    total_records += num_records;
+    char name[64];
+    for (i=1;i<3;i++){
+        snprintf(name, sizeof(name), "%s.%u", DUMP_FILE, i);
+        CHECK_EQUAL(0, parse_packetlogger(name));
+        CHECK(num_records <= 4);
+        total_records += num_records;
+    }
+    CHECK_EQUAL(12, total_records);
+    snprintf(name, sizeof(name), "%s.%u", DUMP_FILE, 3);
+    CHECK_EQUAL(-1, read_file(name));
+}
+
+int main (int argc, const char * argv[]){
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
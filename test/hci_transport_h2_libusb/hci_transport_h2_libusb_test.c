@@ -0,0 +1,724 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <poll.h>
+#include "CppUTest/TestHarness.h"
+#include "CppUTest/CommandLineTestRunner.h"
+
+#include <libusb.h>
+
+#include "btstack_config.h"
+#include "btstack_defines.h"
+#include "btstack_run_loop.h"
+#include "hci.h"
+#include "hci_transport.h"
+
+#define EVENT_IN_ADDR 0x81
+#define ACL_IN_ADDR   0x82
+#define ACL_OUT_ADDR  0x02
+
+#define MAX_TRANSFERS 32
+#define MAX_EVENTS    16
+#define MAX_POLLFDS   4
+#define MAX_DATA_SOURCES 8
+
+// stub libusb: submitted transfers stay pending until the test completes them,
+// completed transfers are reported by libusb_handle_events_timeout in the order they were completed
+
+struct libusb_device_handle {
+    int dummy;
+};
+
+static libusb_device_handle       device_handle;
+static struct libusb_transfer *   submitted[MAX_TRANSFERS];
+static int                        num_submitted;
+static struct libusb_transfer *   completed[MAX_TRANSFERS];
+static int                        num_completed;
+static int                        num_allocated;
+static int                        num_handle_events_calls;
+
+// pollfds reported by libusb_get_pollfds, none for polling with timer
+static struct libusb_pollfd       pollfds[MAX_POLLFDS];
+static int                        num_pollfds;
+static int                        pollfds_handle_timeouts;
+static libusb_pollfd_added_cb     pollfd_added_cb;
+static libusb_pollfd_removed_cb   pollfd_removed_cb;
+// next timeout reported by libusb_get_next_timeout if pollfds don't handle timeouts
+static int                        next_timeout_ms;
+
+static int find_submitted(struct libusb_transfer * transfer){
+    int i;
+    for (i = 0; i < num_submitted; i++){
+        if (submitted[i] == transfer) return i;
+    }
+    return -1;
+}
+
+static void check_not_submitted(struct libusb_transfer * transfer){
+    CHECK_EQUAL(-1, find_submitted(transfer));
+    CHECK(num_submitted < MAX_TRANSFERS);
+}
+
+static void check_device(uint16_t vendor_id, uint16_t product_id){
+    CHECK_EQUAL(USB_VENDOR_ID, vendor_id);
+    CHECK_EQUAL(USB_PRODUCT_ID, product_id);
+}
+
+static void unexpected_call(const char * name){
+    FAIL(name);
+}
+
+static void remove_submitted(int index){
+    num_submitted--;
+    memmove(&submitted[index], &submitted[index+1], (num_submitted - index) * sizeof(struct libusb_transfer *));
+}
+
+int libusb_init(libusb_context **ctx){
+    UNUSED(ctx);
+    return 0;
+}
+
+void libusb_exit(libusb_context *ctx){
+    UNUSED(ctx);
+}
+
+void libusb_set_debug(libusb_context *ctx, int level){
+    UNUSED(ctx);
+    UNUSED(level);
+}
+
+const char * libusb_error_name(int errcode){
+    UNUSED(errcode);
+    return "LIBUSB_ERROR";
+}
+
+// device list scan not used with USB_VENDOR_ID and USB_PRODUCT_ID
+int libusb_open(libusb_device *dev, libusb_device_handle **dev_handle){
+    UNUSED(dev);
+    UNUSED(dev_handle);
+    unexpected_call("libusb_open");
+    return LIBUSB_ERROR_IO;
+}
+
+libusb_device_handle * libusb_open_device_with_vid_pid(libusb_context *ctx, uint16_t vendor_id, uint16_t product_id){
+    UNUSED(ctx);
+    check_device(vendor_id, product_id);
+    return &device_handle;
+}
+
+void libusb_close(libusb_device_handle *dev_handle){
+    UNUSED(dev_handle);
+}
+
+libusb_device * libusb_get_device(libusb_device_handle *dev_handle){
+    UNUSED(dev_handle);
+    return NULL;
+}
+
+int libusb_get_port_numbers(libusb_device *dev, uint8_t *port_numbers, int port_numbers_len){
+    UNUSED(dev);
+    UNUSED(port_numbers);
+    UNUSED(port_numbers_len);
+    return 0;
+}
+
+int libusb_reset_device(libusb_device_handle *dev_handle){
+    UNUSED(dev_handle);
+    return 0;
+}
+
+int libusb_kernel_driver_active(libusb_device_handle *dev_handle, int interface_number){
+    UNUSED(dev_handle);
+    UNUSED(interface_number);
+    return 0;
+}
+
+int libusb_detach_kernel_driver(libusb_device_handle *dev_handle, int interface_number){
+    UNUSED(dev_handle);
+    UNUSED(interface_number);
+    return 0;
+}
+
+int libusb_attach_kernel_driver(libusb_device_handle *dev_handle, int interface_number){
+    UNUSED(dev_handle);
+    UNUSED(interface_number);
+    return 0;
+}
+
+int libusb_set_configuration(libusb_device_handle *dev_handle, int configuration){
+    UNUSED(dev_handle);
+    UNUSED(configuration);
+    return 0;
+}
+
+int libusb_claim_interface(libusb_device_handle *dev_handle, int interface_number){
+    UNUSED(dev_handle);
+    UNUSED(interface_number);
+    return 0;
+}
+
+int libusb_release_interface(libusb_device_handle *dev_handle, int interface_number){
+    UNUSED(dev_handle);
+    UNUSED(interface_number);
+    return 0;
+}
+
+int libusb_clear_halt(libusb_device_handle *dev_handle, unsigned char endpoint){
+    UNUSED(dev_handle);
+    UNUSED(endpoint);
+    return 0;
+}
+
+struct libusb_transfer * libusb_alloc_transfer(int iso_packets){
+    num_allocated++;
+    return (struct libusb_transfer *) calloc(1, sizeof(struct libusb_transfer) + iso_packets * sizeof(struct libusb_iso_packet_descriptor));
+}
+
+void libusb_free_transfer(struct libusb_transfer *transfer){
+    if (!transfer) return;
+    check_not_submitted(transfer);
+    num_allocated--;
+    free(transfer);
+}
+
+int libusb_submit_transfer(struct libusb_transfer *transfer){
+    check_not_submitted(transfer);
+    submitted[num_submitted++] = transfer;
+    return 0;
+}
+
+int libusb_cancel_transfer(struct libusb_transfer *transfer){
+    int index = find_submitted(transfer);
+    if (index < 0) return LIBUSB_ERROR_NOT_FOUND;
+    remove_submitted(index);
+    transfer->status = LIBUSB_TRANSFER_CANCELLED;
+    transfer->actual_length = 0;
+    completed[num_completed++] = transfer;
+    return 0;
+}
+
+int libusb_handle_events_timeout(libusb_context *ctx, struct timeval *tv){
+    UNUSED(ctx);
+    UNUSED(tv);
+    num_handle_events_calls++;
+    // callbacks may submit or cancel transfers
+    int i;
+    int count = num_completed;
+    struct libusb_transfer * transfers[MAX_TRANSFERS];
+    memcpy(transfers, completed, count * sizeof(struct libusb_transfer *));
+    num_completed = 0;
+    for (i = 0; i < count; i++){
+        transfers[i]->callback(transfers[i]);
+    }
+    return 0;
+}
+
+int libusb_get_next_timeout(libusb_context *ctx, struct timeval *tv){
+    UNUSED(ctx);
+    if (next_timeout_ms == 0) return 0;
+    tv->tv_sec  = next_timeout_ms / 1000;
+    tv->tv_usec = (next_timeout_ms % 1000) * 1000;
+    return 1;
+}
+
+int libusb_pollfds_handle_timeouts(libusb_context *ctx){
+    UNUSED(ctx);
+    return pollfds_handle_timeouts;
+}
+
+// list is freed by caller
+const struct libusb_pollfd ** libusb_get_pollfds(libusb_context *ctx){
+    UNUSED(ctx);
+    if (num_pollfds == 0) return NULL;
+    const struct libusb_pollfd ** list = (const struct libusb_pollfd **) calloc(num_pollfds + 1, sizeof(struct libusb_pollfd *));
+    int i;
+    for (i = 0; i < num_pollfds; i++){
+        list[i] = &pollfds[i];
+    }
+    return list;
+}
+
+void libusb_set_pollfd_notifiers(libusb_context *ctx, libusb_pollfd_added_cb added_cb, libusb_pollfd_removed_cb removed_cb, void *user_data){
+    UNUSED(ctx);
+    UNUSED(user_data);
+    pollfd_added_cb   = added_cb;
+    pollfd_removed_cb = removed_cb;
+}
+
+// mock run loop: the polling timer is only fired by the test, data sources are only called by the test
+
+static btstack_timer_source_t * usb_timer;
+
+void btstack_run_loop_set_timer(btstack_timer_source_t * timer, uint32_t timeout_in_ms){
+    timer->timeout = timeout_in_ms;
+}
+
+int btstack_run_loop_remove_timer(btstack_timer_source_t * timer){
+    if (usb_timer != timer) return 0;
+    usb_timer = NULL;
+    return 1;
+}
+
+void btstack_run_loop_add_timer(btstack_timer_source_t * timer){
+    usb_timer = timer;
+}
+
+void btstack_run_loop_set_data_source_fd(btstack_data_source_t * data_source, int fd){
+    data_source->fd = fd;
+}
+
+void btstack_run_loop_set_data_source_handler(btstack_data_source_t * data_source, void (*process)(btstack_data_source_t *_ds, btstack_data_source_callback_type_t callback_type)){
+    data_source->process = process;
+}
+
+void btstack_run_loop_enable_data_source_callbacks(btstack_data_source_t * data_source, uint16_t callbacks){
+    data_source->flags |= callbacks;
+}
+
+static btstack_data_source_t * data_sources[MAX_DATA_SOURCES];
+static int                     num_data_sources;
+
+static int find_data_source(btstack_data_source_t * data_source){
+    int i;
+    for (i = 0; i < num_data_sources; i++){
+        if (data_sources[i] == data_source) return i;
+    }
+    return -1;
+}
+
+static void check_data_source_not_added(btstack_data_source_t * data_source){
+    CHECK_EQUAL(-1, find_data_source(data_source));
+    CHECK(num_data_sources < MAX_DATA_SOURCES);
+}
+
+void btstack_run_loop_add_data_source(btstack_data_source_t * data_source){
+    check_data_source_not_added(data_source);
+    data_sources[num_data_sources++] = data_source;
+}
+
+int btstack_run_loop_remove_data_source(btstack_data_source_t * data_source){
+    int index = find_data_source(data_source);
+    if (index < 0) return 0;
+    num_data_sources--;
+    memmove(&data_sources[index], &data_sources[index+1], (num_data_sources - index) * sizeof(btstack_data_source_t *));
+    return 1;
+}
+
+static btstack_data_source_t * data_source_for_fd(int fd){
+    int i;
+    for (i = 0; i < num_data_sources; i++){
+        if (data_sources[i]->fd == fd) return data_sources[i];
+    }
+    return NULL;
+}
+
+// packet handler
+
+static int     num_packet_sent_events;
+static uint8_t received_types[MAX_EVENTS];
+static uint8_t received_first_bytes[MAX_EVENTS];
+static int     num_received_packets;
+
+static void packet_handler(uint8_t packet_type, uint8_t * packet, uint16_t size){
+    UNUSED(size);
+    if (packet_type == HCI_EVENT_PACKET && packet[0] == HCI_EVENT_TRANSPORT_PACKET_SENT){
+        num_packet_sent_events++;
+        return;
+    }
+    CHECK(num_received_packets < MAX_EVENTS);
+    received_types[num_received_packets] = packet_type;
+    received_first_bytes[num_received_packets] = packet[0];
+    num_received_packets++;
+}
+
+// test helpers
+
+static struct libusb_transfer * submitted_transfer(unsigned char endpoint, int nr){
+    int i;
+    for (i = 0; i < num_submitted; i++){
+        if (submitted[i]->endpoint != endpoint) continue;
+        if (nr-- == 0) return submitted[i];
+    }
+    return NULL;
+}
+
+static int num_submitted_transfers(unsigned char endpoint){
+    int i;
+    int num = 0;
+    for (i = 0; i < num_submitted; i++){
+        if (submitted[i]->endpoint == endpoint) num++;
+    }
+    return num;
+}
+
+static void complete_transfer(struct libusb_transfer * transfer, int actual_length){
+    int index = find_submitted(transfer);
+    CHECK(index >= 0);
+    remove_submitted(index);
+    transfer->status = LIBUSB_TRANSFER_COMPLETED;
+    transfer->actual_length = actual_length;
+    completed[num_completed++] = transfer;
+}
+
+static void receive(unsigned char endpoint, const uint8_t * data, int len){
+    struct libusb_transfer * transfer = submitted_transfer(endpoint, 0);
+    CHECK(transfer != NULL);
+    memcpy(transfer->buffer, data, len);
+    complete_transfer(transfer, len);
+}
+
+// polling timer calls libusb_handle_events_timeout and processes completed transfers
+static void process_events(void){
+    CHECK(usb_timer != NULL);
+    btstack_timer_source_t * timer = usb_timer;
+    usb_timer = NULL;
+    timer->process(timer);
+}
+
+static void fill_packet(uint8_t * packet, int len, uint8_t first){
+    int i;
+    for (i = 0; i < len; i++){
+        packet[i] = (uint8_t) (first + i);
+    }
+}
+
+static int transfer_contains_packet(struct libusb_transfer * transfer, int len, uint8_t first){
+    uint8_t packet[HCI_ACL_BUFFER_SIZE];
+    fill_packet(packet, len, first);
+    return transfer->length == len && memcmp(transfer->buffer, packet, len) == 0;
+}
+
+static void reset_stubs(void){
+    num_submitted = 0;
+    num_completed = 0;
+    num_allocated = 0;
+    num_handle_events_calls = 0;
+    num_pollfds = 0;
+    pollfds_handle_timeouts = 0;
+    pollfd_added_cb = NULL;
+    pollfd_removed_cb = NULL;
+    next_timeout_ms = 0;
+    usb_timer = NULL;
+    num_data_sources = 0;
+    num_packet_sent_events = 0;
+    num_received_packets = 0;
+}
+
+static void check_closed(void){
+    CHECK_EQUAL(0, num_submitted);
+    CHECK_EQUAL(0, num_completed);
+    CHECK_EQUAL(0, num_data_sources);
+    CHECK(usb_timer == NULL);
+}
+
+// without pollfds, libusb is polled by a timer
+TEST_GROUP(H2LibusbTransport){
+    const hci_transport_t * transport;
+    uint8_t hci_packet_buffer[HCI_ACL_BUFFER_SIZE];
+
+    void setup(void){
+        reset_stubs();
+        transport = hci_transport_usb_instance();
+        transport->register_packet_handler(&packet_handler);
+    }
+
+    void teardown(void){
+        transport->close();
+        check_closed();
+        hci_transport_usb_set_num_buffers(3, 10, 3);
+    }
+
+    void open(void){
+        CHECK_EQUAL(0, transport->open());
+        CHECK_EQUAL(3, num_submitted_transfers(EVENT_IN_ADDR));
+        CHECK_EQUAL(3, num_submitted_transfers(ACL_IN_ADDR));
+        CHECK_EQUAL(0, num_submitted_transfers(ACL_OUT_ADDR));
+    }
+
+    // HCI re-uses its single packet buffer after HCI_EVENT_TRANSPORT_PACKET_SENT
+    int send_acl_packet(int len, uint8_t first){
+        fill_packet(hci_packet_buffer, len, first);
+        return transport->send_packet(HCI_ACL_DATA_PACKET, hci_packet_buffer, len);
+    }
+};
+
+TEST(H2LibusbTransport, AclOutPacketsCopiedIntoSeparateTransfers){
+    open();
+    CHECK(transport->can_send_packet_now(HCI_ACL_DATA_PACKET));
+    CHECK_EQUAL(0, send_acl_packet(20, 0x10));
+    CHECK_EQUAL(1, num_packet_sent_events);
+    CHECK_EQUAL(0, send_acl_packet(HCI_ACL_BUFFER_SIZE, 0x20));
+    CHECK_EQUAL(2, num_packet_sent_events);
+    CHECK_EQUAL(0, send_acl_packet(8, 0x30));
+
+    CHECK_EQUAL(3, num_submitted_transfers(ACL_OUT_ADDR));
+    struct libusb_transfer * first  = submitted_transfer(ACL_OUT_ADDR, 0);
+    struct libusb_transfer * second = submitted_transfer(ACL_OUT_ADDR, 1);
+    struct libusb_transfer * third  = submitted_transfer(ACL_OUT_ADDR, 2);
+    CHECK(first != second && second != third && first != third);
+    CHECK(first->buffer  != hci_packet_buffer);
+    CHECK(second->buffer != hci_packet_buffer);
+    CHECK(third->buffer  != hci_packet_buffer);
+    CHECK_EQUAL(LIBUSB_TRANSFER_TYPE_BULK, first->type);
+    CHECK(transfer_contains_packet(first,  20, 0x10));
+    CHECK(transfer_contains_packet(second, HCI_ACL_BUFFER_SIZE, 0x20));
+    CHECK(transfer_contains_packet(third,  8, 0x30));
+
+    // packets larger than an HCI ACL buffer are rejected
+    CHECK_EQUAL(-1, transport->send_packet(HCI_ACL_DATA_PACKET, hci_packet_buffer, HCI_ACL_BUFFER_SIZE + 1));
+}
+
+TEST(H2LibusbTransport, CanSendNowUnderBackPressure){
+    open();
+    CHECK_EQUAL(0, send_acl_packet(20, 0x10));
+    CHECK_EQUAL(0, send_acl_packet(20, 0x20));
+    CHECK(transport->can_send_packet_now(HCI_ACL_DATA_PACKET));
+    CHECK_EQUAL(0, send_acl_packet(20, 0x30));
+
+    // all transfers in flight: HCI_EVENT_TRANSPORT_PACKET_SENT delayed and further packets rejected
+    CHECK_EQUAL(2, num_packet_sent_events);
+    CHECK_FALSE(transport->can_send_packet_now(HCI_ACL_DATA_PACKET));
+    CHECK(transport->can_send_packet_now(HCI_COMMAND_DATA_PACKET));
+    CHECK_EQUAL(-1, send_acl_packet(20, 0x40));
+    CHECK_EQUAL(3, num_submitted_transfers(ACL_OUT_ADDR));
+
+    // completed transfer releases HCI packet buffer and frees a slot
+    complete_transfer(submitted_transfer(ACL_OUT_ADDR, 0), 20);
+    CHECK_FALSE(transport->can_send_packet_now(HCI_ACL_DATA_PACKET));
+    process_events();
+    CHECK_EQUAL(3, num_packet_sent_events);
+    CHECK(transport->can_send_packet_now(HCI_ACL_DATA_PACKET));
+
+    // back-pressure again after next packet, no extra events for further completions
+    CHECK_EQUAL(0, send_acl_packet(20, 0x40));
+    CHECK_EQUAL(3, num_packet_sent_events);
+    CHECK_FALSE(transport->can_send_packet_now(HCI_ACL_DATA_PACKET));
+    complete_transfer(submitted_transfer(ACL_OUT_ADDR, 0), 20);
+    complete_transfer(submitted_transfer(ACL_OUT_ADDR, 0), 20);
+    process_events();
+    CHECK_EQUAL(4, num_packet_sent_events);
+    CHECK(transport->can_send_packet_now(HCI_ACL_DATA_PACKET));
+    CHECK_EQUAL(1, num_submitted_transfers(ACL_OUT_ADDR));
+}
+
+TEST(H2LibusbTransport, OutOfOrderAclOutCompletionReusesFreedTransfer){
+    open();
+    CHECK_EQUAL(0, send_acl_packet(20, 0x10));
+    CHECK_EQUAL(0, send_acl_packet(20, 0x20));
+    CHECK_EQUAL(0, send_acl_packet(20, 0x30));
+    struct libusb_transfer * first  = submitted_transfer(ACL_OUT_ADDR, 0);
+    struct libusb_transfer * second = submitted_transfer(ACL_OUT_ADDR, 1);
+    struct libusb_transfer * third  = submitted_transfer(ACL_OUT_ADDR, 2);
+
+    // second packet completes before the first one
+    complete_transfer(second, 20);
+    process_events();
+    CHECK_EQUAL(3, num_packet_sent_events);
+
+    // next packet goes into the freed transfer without touching packets still in flight
+    CHECK_EQUAL(0, send_acl_packet(20, 0x40));
+    CHECK_EQUAL(3, num_submitted_transfers(ACL_OUT_ADDR));
+    POINTERS_EQUAL(second, submitted_transfer(ACL_OUT_ADDR, 2));
+    CHECK(transfer_contains_packet(first,  20, 0x10));
+    CHECK(transfer_contains_packet(second, 20, 0x40));
+    CHECK(transfer_contains_packet(third,  20, 0x30));
+    CHECK_FALSE(transport->can_send_packet_now(HCI_ACL_DATA_PACKET));
+}
+
+TEST(H2LibusbTransport, CompletedTransfersHandledInCompletionOrder){
+    const uint8_t event_1[] = { 0x0e, 0x00 };
+    const uint8_t event_2[] = { 0x0f, 0x00 };
+    const uint8_t acl[]     = { 0x01, 0x20, 0x00, 0x00 };
+    open();
+
+    receive(ACL_IN_ADDR,   acl,     sizeof(acl));
+    receive(EVENT_IN_ADDR, event_1, sizeof(event_1));
+    receive(EVENT_IN_ADDR, event_2, sizeof(event_2));
+    process_events();
+    CHECK_EQUAL(3, num_received_packets);
+    CHECK_EQUAL(HCI_ACL_DATA_PACKET, received_types[0]);
+    CHECK_EQUAL(0x01, received_first_bytes[0]);
+    CHECK_EQUAL(HCI_EVENT_PACKET, received_types[1]);
+    CHECK_EQUAL(0x0e, received_first_bytes[1]);
+    CHECK_EQUAL(HCI_EVENT_PACKET, received_types[2]);
+    CHECK_EQUAL(0x0f, received_first_bytes[2]);
+
+    // incoming transfers are re-submitted
+    CHECK_EQUAL(3, num_submitted_transfers(EVENT_IN_ADDR));
+    CHECK_EQUAL(3, num_submitted_transfers(ACL_IN_ADDR));
+
+    // ACL out completion signalled between incoming packets
+    CHECK_EQUAL(0, send_acl_packet(20, 0x10));
+    CHECK_EQUAL(0, send_acl_packet(20, 0x20));
+    CHECK_EQUAL(0, send_acl_packet(20, 0x30));
+    num_received_packets = 0;
+    receive(EVENT_IN_ADDR, event_2, sizeof(event_2));
+    complete_transfer(submitted_transfer(ACL_OUT_ADDR, 0), 20);
+    receive(EVENT_IN_ADDR, event_1, sizeof(event_1));
+    process_events();
+    CHECK_EQUAL(2, num_received_packets);
+    CHECK_EQUAL(0x0f, received_first_bytes[0]);
+    CHECK_EQUAL(0x0e, received_first_bytes[1]);
+    CHECK_EQUAL(3, num_packet_sent_events);
+}
+
+TEST(H2LibusbTransport, SingleAclOutTransferUsesHciBuffer){
+    hci_transport_usb_set_num_buffers(3, 10, 1);
+    open();
+    CHECK(transport->can_send_packet_now(HCI_ACL_DATA_PACKET));
+    CHECK_EQUAL(0, send_acl_packet(20, 0x10));
+    CHECK_EQUAL(1, num_submitted_transfers(ACL_OUT_ADDR));
+    struct libusb_transfer * transfer = submitted_transfer(ACL_OUT_ADDR, 0);
+    POINTERS_EQUAL(hci_packet_buffer, transfer->buffer);
+
+    // HCI packet buffer is in use until transfer completes
+    CHECK_EQUAL(0, num_packet_sent_events);
+    CHECK_FALSE(transport->can_send_packet_now(HCI_ACL_DATA_PACKET));
+    complete_transfer(transfer, 20);
+    process_events();
+    CHECK_EQUAL(1, num_packet_sent_events);
+    CHECK(transport->can_send_packet_now(HCI_ACL_DATA_PACKET));
+}
+
+TEST(H2LibusbTransport, CloseFreesAclOutTransfersInFlight){
+    open();
+    CHECK_EQUAL(0, send_acl_packet(20, 0x10));
+    CHECK_EQUAL(0, send_acl_packet(20, 0x20));
+    int allocated = num_allocated;
+    transport->close();
+    CHECK_EQUAL(0, num_submitted);
+    // 3 + 3 incoming and 3 outgoing ACL transfers freed
+    CHECK_EQUAL(allocated - 9, num_allocated);
+    CHECK_EQUAL(-1, send_acl_packet(20, 0x30));
+}
+
+// libusb pollfds are run loop data sources, e.g. Linux usbfs signals completed transfers with POLLOUT
+// and a timerfd handles libusb timeouts
+#define USBFS_FD   10
+#define EVENT_FD   11
+#define TIMER_FD   12
+
+TEST_GROUP(H2LibusbPollfds){
+    const hci_transport_t * transport;
+    uint8_t hci_packet_buffer[HCI_ACL_BUFFER_SIZE];
+
+    void setup(void){
+        reset_stubs();
+        add_pollfd(USBFS_FD, POLLOUT);
+        add_pollfd(EVENT_FD, POLLIN);
+        add_pollfd(TIMER_FD, POLLIN);
+        pollfds_handle_timeouts = 1;
+        // pending libusb timeout, e.g. for a control transfer
+        next_timeout_ms = 1000;
+        transport = hci_transport_usb_instance();
+        transport->register_packet_handler(&packet_handler);
+    }
+
+    void teardown(void){
+        transport->close();
+        check_closed();
+        POINTERS_EQUAL(NULL, (void *) pollfd_added_cb);
+        POINTERS_EQUAL(NULL, (void *) pollfd_removed_cb);
+    }
+
+    void add_pollfd(int fd, short events){
+        pollfds[num_pollfds].fd = fd;
+        pollfds[num_pollfds].events = events;
+        num_pollfds++;
+    }
+
+    void fd_ready(int fd, btstack_data_source_callback_type_t callback_type){
+        btstack_data_source_t * ds = data_source_for_fd(fd);
+        CHECK(ds != NULL);
+        CHECK(ds->flags & callback_type);
+        ds->process(ds, callback_type);
+    }
+};
+
+TEST(H2LibusbPollfds, PollfdsRegisteredAsDataSources){
+    CHECK_EQUAL(0, transport->open());
+    CHECK_EQUAL(3, num_data_sources);
+    CHECK_EQUAL(DATA_SOURCE_CALLBACK_WRITE, data_source_for_fd(USBFS_FD)->flags);
+    CHECK_EQUAL(DATA_SOURCE_CALLBACK_READ,  data_source_for_fd(EVENT_FD)->flags);
+    CHECK_EQUAL(DATA_SOURCE_CALLBACK_READ,  data_source_for_fd(TIMER_FD)->flags);
+    CHECK(pollfd_added_cb != NULL);
+    CHECK(pollfd_removed_cb != NULL);
+
+    // timeouts handled by libusb timerfd: no timer while idle
+    CHECK(usb_timer == NULL);
+    CHECK_EQUAL(0, num_handle_events_calls);
+}
+
+TEST(H2LibusbPollfds, ReadyPollfdHandlesEvents){
+    const uint8_t event[] = { 0x0e, 0x00 };
+    CHECK_EQUAL(0, transport->open());
+
+    receive(EVENT_IN_ADDR, event, sizeof(event));
+    fd_ready(EVENT_FD, DATA_SOURCE_CALLBACK_READ);
+    CHECK_EQUAL(1, num_handle_events_calls);
+    CHECK_EQUAL(1, num_received_packets);
+    CHECK_EQUAL(HCI_EVENT_PACKET, received_types[0]);
+    CHECK_EQUAL(3, num_submitted_transfers(EVENT_IN_ADDR));
+
+    // ACL out completion signalled by usbfs pollfd
+    fill_packet(hci_packet_buffer, 20, 0x10);
+    CHECK_EQUAL(0, transport->send_packet(HCI_ACL_DATA_PACKET, hci_packet_buffer, 20));
+    CHECK_EQUAL(0, transport->send_packet(HCI_ACL_DATA_PACKET, hci_packet_buffer, 20));
+    CHECK_EQUAL(0, transport->send_packet(HCI_ACL_DATA_PACKET, hci_packet_buffer, 20));
+    CHECK_FALSE(transport->can_send_packet_now(HCI_ACL_DATA_PACKET));
+    complete_transfer(submitted_transfer(ACL_OUT_ADDR, 0), 20);
+    fd_ready(USBFS_FD, DATA_SOURCE_CALLBACK_WRITE);
+    CHECK_EQUAL(2, num_handle_events_calls);
+    CHECK_EQUAL(3, num_packet_sent_events);
+    CHECK(transport->can_send_packet_now(HCI_ACL_DATA_PACKET));
+
+    // timerfd expiry only lets libusb handle its timeouts
+    fd_ready(TIMER_FD, DATA_SOURCE_CALLBACK_READ);
+    CHECK_EQUAL(3, num_handle_events_calls);
+    CHECK(usb_timer == NULL);
+}
+
+TEST(H2LibusbPollfds, PollfdNotifiersUpdateDataSources){
+    CHECK_EQUAL(0, transport->open());
+    CHECK(pollfd_added_cb != NULL);
+    pollfd_added_cb(13, POLLIN, NULL);
+    CHECK_EQUAL(4, num_data_sources);
+    CHECK_EQUAL(DATA_SOURCE_CALLBACK_READ, data_source_for_fd(13)->flags);
+
+    pollfd_removed_cb(TIMER_FD, NULL);
+    CHECK_EQUAL(3, num_data_sources);
+    CHECK(data_source_for_fd(TIMER_FD) == NULL);
+
+    // removed entry is re-used
+    pollfd_added_cb(14, POLLIN | POLLOUT, NULL);
+    CHECK_EQUAL(4, num_data_sources);
+    CHECK_EQUAL(DATA_SOURCE_CALLBACK_READ | DATA_SOURCE_CALLBACK_WRITE, data_source_for_fd(14)->flags);
+    fd_ready(14, DATA_SOURCE_CALLBACK_READ);
+    CHECK_EQUAL(1, num_handle_events_calls);
+}
+
+TEST(H2LibusbPollfds, TimerForLibusbTimeoutsWithoutTimerfd){
+    num_pollfds = 2;
+    pollfds_handle_timeouts = 0;
+    next_timeout_ms = 0;
+    CHECK_EQUAL(0, transport->open());
+    CHECK_EQUAL(2, num_data_sources);
+
+    // no pending libusb timeout
+    CHECK(usb_timer == NULL);
+
+    // timer started for next libusb timeout
+    next_timeout_ms = 250;
+    fd_ready(EVENT_FD, DATA_SOURCE_CALLBACK_READ);
+    CHECK(usb_timer != NULL);
+    CHECK_EQUAL(250, usb_timer->timeout);
+
+    next_timeout_ms = 0;
+    process_events();
+    CHECK_EQUAL(2, num_handle_events_calls);
+    CHECK(usb_timer == NULL);
+}
+
+int main (int argc, const char * argv[]){
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
@@ -0,0 +1,185 @@
+//
+// Minimal libusb-1.0 API subset used by hci_transport_h2_libusb.c
+// Functions are implemented by the test, transfers are completed by the test
+//
+#ifndef __LIBUSB_STUB_H
+#define __LIBUSB_STUB_H
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define LIBUSB_CALL
+
+#define LIBUSB_CONTROL_SETUP_SIZE 8
+
+enum libusb_error {
+    LIBUSB_SUCCESS      =   0,
+    LIBUSB_ERROR_IO     =  -1,
+    LIBUSB_ERROR_NOT_FOUND = -5,
+    LIBUSB_ERROR_BUSY   =  -6,
+    LIBUSB_ERROR_NO_MEM = -11,
+};
+
+enum libusb_transfer_status {
+    LIBUSB_TRANSFER_COMPLETED,
+    LIBUSB_TRANSFER_ERROR,
+    LIBUSB_TRANSFER_TIMED_OUT,
+    LIBUSB_TRANSFER_CANCELLED,
+    LIBUSB_TRANSFER_STALL,
+    LIBUSB_TRANSFER_NO_DEVICE,
+    LIBUSB_TRANSFER_OVERFLOW,
+};
+
+enum libusb_transfer_type {
+    LIBUSB_TRANSFER_TYPE_CONTROL     = 0,
+    LIBUSB_TRANSFER_TYPE_ISOCHRONOUS = 1,
+    LIBUSB_TRANSFER_TYPE_BULK        = 2,
+    LIBUSB_TRANSFER_TYPE_INTERRUPT   = 3,
+};
+
+enum libusb_transfer_flags {
+    LIBUSB_TRANSFER_SHORT_NOT_OK    = 1 << 0,
+    LIBUSB_TRANSFER_FREE_BUFFER     = 1 << 1,
+    LIBUSB_TRANSFER_FREE_TRANSFER   = 1 << 2,
+};
+
+enum libusb_request_type {
+    LIBUSB_REQUEST_TYPE_STANDARD = (0x00 << 5),
+    LIBUSB_REQUEST_TYPE_CLASS    = (0x01 << 5),
+    LIBUSB_REQUEST_TYPE_VENDOR   = (0x02 << 5),
+};
+
+enum libusb_request_recipient {
+    LIBUSB_RECIPIENT_DEVICE    = 0x00,
+    LIBUSB_RECIPIENT_INTERFACE = 0x01,
+    LIBUSB_RECIPIENT_ENDPOINT  = 0x02,
+};
+
+enum libusb_log_level {
+    LIBUSB_LOG_LEVEL_NONE = 0,
+    LIBUSB_LOG_LEVEL_ERROR,
+    LIBUSB_LOG_LEVEL_WARNING,
+    LIBUSB_LOG_LEVEL_INFO,
+    LIBUSB_LOG_LEVEL_DEBUG,
+};
+
+typedef struct libusb_context       libusb_context;
+typedef struct libusb_device        libusb_device;
+typedef struct libusb_device_handle libusb_device_handle;
+
+struct libusb_control_setup {
+    uint8_t  bmRequestType;
+    uint8_t  bRequest;
+    uint16_t wValue;
+    uint16_t wIndex;
+    uint16_t wLength;
+};
+
+struct libusb_iso_packet_descriptor {
+    unsigned int length;
+    unsigned int actual_length;
+    enum libusb_transfer_status status;
+};
+
+struct libusb_transfer;
+
+typedef void (LIBUSB_CALL *libusb_transfer_cb_fn)(struct libusb_transfer *transfer);
+
+struct libusb_transfer {
+    libusb_device_handle *dev_handle;
+    uint8_t flags;
+    unsigned char endpoint;
+    unsigned char type;
+    unsigned int timeout;
+    enum libusb_transfer_status status;
+    int length;
+    int actual_length;
+    libusb_transfer_cb_fn callback;
+    void *user_data;
+    unsigned char *buffer;
+    int num_iso_packets;
+    struct libusb_iso_packet_descriptor iso_packet_desc[0];
+};
+
+struct libusb_pollfd {
+    int fd;
+    short events;
+};
+
+typedef void (LIBUSB_CALL *libusb_pollfd_added_cb)(int fd, short events, void *user_data);
+typedef void (LIBUSB_CALL *libusb_pollfd_removed_cb)(int fd, void *user_data);
+
+int  libusb_init(libusb_context **ctx);
+void libusb_exit(libusb_context *ctx);
+void libusb_set_debug(libusb_context *ctx, int level);
+const char * libusb_error_name(int errcode);
+
+int  libusb_open(libusb_device *dev, libusb_device_handle **dev_handle);
+libusb_device_handle * libusb_open_device_with_vid_pid(libusb_context *ctx, uint16_t vendor_id, uint16_t product_id);
+void libusb_close(libusb_device_handle *dev_handle);
+libusb_device * libusb_get_device(libusb_device_handle *dev_handle);
+int  libusb_get_port_numbers(libusb_device *dev, uint8_t *port_numbers, int port_numbers_len);
+int  libusb_reset_device(libusb_device_handle *dev_handle);
+int  libusb_kernel_driver_active(libusb_device_handle *dev_handle, int interface_number);
+int  libusb_detach_kernel_driver(libusb_device_handle *dev_handle, int interface_number);
+int  libusb_attach_kernel_driver(libusb_device_handle *dev_handle, int interface_number);
+int  libusb_set_configuration(libusb_device_handle *dev_handle, int configuration);
+int  libusb_claim_interface(libusb_device_handle *dev_handle, int interface_number);
+int  libusb_release_interface(libusb_device_handle *dev_handle, int interface_number);
+int  libusb_clear_halt(libusb_device_handle *dev_handle, unsigned char endpoint);
+
+struct libusb_transfer * libusb_alloc_transfer(int iso_packets);
+int  libusb_submit_transfer(struct libusb_transfer *transfer);
+int  libusb_cancel_transfer(struct libusb_transfer *transfer);
+void libusb_free_transfer(struct libusb_transfer *transfer);
+
+int  libusb_handle_events_timeout(libusb_context *ctx, struct timeval *tv);
+int  libusb_get_next_timeout(libusb_context *ctx, struct timeval *tv);
+int  libusb_pollfds_handle_timeouts(libusb_context *ctx);
+const struct libusb_pollfd ** libusb_get_pollfds(libusb_context *ctx);
+void libusb_set_pollfd_notifiers(libusb_context *ctx, libusb_pollfd_added_cb added_cb, libusb_pollfd_removed_cb removed_cb, void *user_data);
+
+static inline void libusb_fill_control_setup(unsigned char *buffer, uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue, uint16_t wIndex, uint16_t wLength){
+    struct libusb_control_setup *setup = (struct libusb_control_setup *)(void *) buffer;
+    setup->bmRequestType = bmRequestType;
+    setup->bRequest      = bRequest;
+    setup->wValue        = wValue;
+    setup->wIndex        = wIndex;
+    setup->wLength       = wLength;
+}
+
+static inline void libusb_fill_control_transfer(struct libusb_transfer *transfer, libusb_device_handle *dev_handle, unsigned char *buffer,
+    libusb_transfer_cb_fn callback, void *user_data, unsigned int timeout){
+    struct libusb_control_setup *setup = (struct libusb_control_setup *)(void *) buffer;
+    transfer->dev_handle = dev_handle;
+    transfer->endpoint   = 0;
+    transfer->type       = LIBUSB_TRANSFER_TYPE_CONTROL;
+    transfer->timeout    = timeout;
+    transfer->buffer     = buffer;
+    if (setup){
+        transfer->length = LIBUSB_CONTROL_SETUP_SIZE + setup->wLength;
+    }
+    transfer->user_data  = user_data;
+    transfer->callback   = callback;
+}
+
+static inline void libusb_fill_bulk_transfer(struct libusb_transfer *transfer, libusb_device_handle *dev_handle, unsigned char endpoint,
+    unsigned char *buffer, int length, libusb_transfer_cb_fn callback, void *user_data, unsigned int timeout){
+    transfer->dev_handle = dev_handle;
+    transfer->endpoint   = endpoint;
+    transfer->type       = LIBUSB_TRANSFER_TYPE_BULK;
+    transfer->timeout    = timeout;
+    transfer->buffer     = buffer;
+    transfer->length     = length;
+    transfer->user_data  = user_data;
+    transfer->callback   = callback;
+}
+
+static inline void libusb_fill_interrupt_transfer(struct libusb_transfer *transfer, libusb_device_handle *dev_handle, unsigned char endpoint,
+    unsigned char *buffer, int length, libusb_transfer_cb_fn callback, void *user_data, unsigned int timeout){
+    libusb_fill_bulk_transfer(transfer, dev_handle, endpoint, buffer, length, callback, user_data, timeout);
+    transfer->type = LIBUSB_TRANSFER_TYPE_INTERRUPT;
+}
+
+#endif
@@ -0,0 +1,20 @@
+//
+// btstack_config.h for H5 transport test
+//
+#ifndef __BTSTACK_CONFIG
+#define __BTSTACK_CONFIG
+
+// Port related features
+#define HAVE_MALLOC
+
+// BTstack features that can be enabled
+#define ENABLE_CLASSIC
+#define ENABLE_LOG_ERROR
+#define ENABLE_H5_DATA_INTEGRITY_CHECK
+
+// BTstack configuration. buffers, sizes, ...
+#define HCI_ACL_PAYLOAD_SIZE 52
+#define HCI_INCOMING_PRE_BUFFER_SIZE 4
+#define HCI_TRANSPORT_H5_SLIDING_WINDOW_SIZE 4
+
+#endif
@@ -0,0 +1,539 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "CppUTest/TestHarness.h"
+#include "CppUTest/CommandLineTestRunner.h"
+
+#include "btstack_config.h"
+#include "btstack_defines.h"
+#include "btstack_run_loop.h"
+#include "btstack_uart_block.h"
+#include "hci.h"
+#include "hci_transport.h"
+
+#define MAX_FRAMES    16
+#define MAX_FRAME_LEN 300
+
+#define LINK_ACKNOWLEDGEMENT_TYPE 0x00
+#define LINK_CONTROL_PACKET_TYPE  0x0f
+
+// window size 4 and data integrity check as offered in Config message
+#define CONFIG_FIELD 0x14
+
+static const uint8_t sync_response[]   = { 0x02, 0x7d };
+static const uint8_t config_response[] = { 0x04, 0x7b, CONFIG_FIELD };
+
+// mock UART: records written data, write completion and reception are triggered by the test
+
+static void (*block_sent_handler)(void);
+static void (*data_received_handler)(uint16_t size);
+static uint8_t * receive_buffer;
+static uint16_t  receive_max_len;
+static int       write_pending;
+static uint8_t   uart_output[4096];
+static int       uart_output_len;
+
+static int mock_uart_init(const btstack_uart_config_t * uart_config){
+    (void) uart_config;
+    return 0;
+}
+
+static int mock_uart_open(void){
+    return 0;
+}
+
+static int mock_uart_close(void){
+    return 0;
+}
+
+static void mock_uart_set_block_received(void (*handler)(void)){
+    (void) handler;
+}
+
+static void mock_uart_set_block_sent(void (*handler)(void)){
+    block_sent_handler = handler;
+}
+
+static int mock_uart_set_baudrate(uint32_t baudrate){
+    (void) baudrate;
+    return 0;
+}
+
+static int mock_uart_set_parity(int parity){
+    (void) parity;
+    return 0;
+}
+
+static void mock_uart_receive_block(uint8_t * buffer, uint16_t len){
+    (void) buffer;
+    (void) len;
+}
+
+static void mock_uart_send_block(const uint8_t * buffer, uint16_t length){
+    CHECK_FALSE(write_pending);
+    CHECK(uart_output_len + length <= (int) sizeof(uart_output));
+    memcpy(&uart_output[uart_output_len], buffer, length);
+    uart_output_len += length;
+    write_pending = 1;
+}
+
+static void mock_uart_set_data_received(void (*handler)(uint16_t size)){
+    data_received_handler = handler;
+}
+
+static void mock_uart_receive_available(uint8_t * buffer, uint16_t max_len){
+    receive_buffer  = buffer;
+    receive_max_len = max_len;
+}
+
+static const btstack_uart_block_t mock_uart = {
+    &mock_uart_init,
+    &mock_uart_open,
+    &mock_uart_close,
+    &mock_uart_set_block_received,
+    &mock_uart_set_block_sent,
+    &mock_uart_set_baudrate,
+    &mock_uart_set_parity,
+    &mock_uart_receive_block,
+    &mock_uart_send_block,
+    NULL,
+    NULL,
+    &mock_uart_set_data_received,
+    &mock_uart_receive_available,
+};
+
+// mock run loop: active timers are only fired by the test
+
+#define MAX_TIMERS 4
+static btstack_timer_source_t * timers[MAX_TIMERS];
+
+void btstack_run_loop_set_timer(btstack_timer_source_t * timer, uint32_t timeout_in_ms){
+    timer->timeout = timeout_in_ms;
+}
+
+void btstack_run_loop_set_timer_handler(btstack_timer_source_t * timer, void (*process)(btstack_timer_source_t * _timer)){
+    timer->process = process;
+}
+
+int btstack_run_loop_remove_timer(btstack_timer_source_t * timer){
+    int i;
+    for (i = 0; i < MAX_TIMERS; i++){
+        if (timers[i] != timer) continue;
+        timers[i] = NULL;
+        return 1;
+    }
+    return 0;
+}
+
+void btstack_run_loop_add_timer(btstack_timer_source_t * timer){
+    int i;
+    btstack_run_loop_remove_timer(timer);
+    for (i = 0; i < MAX_TIMERS; i++){
+        if (timers[i]) continue;
+        timers[i] = timer;
+        return;
+    }
+    FAIL("too many timers");
+}
+
+static int num_active_timers(void){
+    int i;
+    int num = 0;
+    for (i = 0; i < MAX_TIMERS; i++){
+        if (timers[i]) num++;
+    }
+    return num;
+}
+
+static void fire_timer(void){
+    CHECK_EQUAL(1, num_active_timers());
+    int i;
+    for (i = 0; i < MAX_TIMERS; i++){
+        btstack_timer_source_t * timer = timers[i];
+        if (!timer) continue;
+        timers[i] = NULL;
+        timer->process(timer);
+        return;
+    }
+}
+
+// packet handler
+
+static int     num_packet_sent_events;
+static int     num_received_packets;
+static uint8_t received_packet[MAX_FRAME_LEN];
+static int     received_packet_len;
+
+static void packet_handler(uint8_t packet_type, uint8_t * packet, uint16_t size){
+    if (packet_type == HCI_EVENT_PACKET && packet[0] == HCI_EVENT_TRANSPORT_PACKET_SENT){
+        num_packet_sent_events++;
+        return;
+    }
+    num_received_packets++;
+    memcpy(received_packet, packet, size);
+    received_packet_len = size;
+}
+
+// CRC-CCITT, LSB first, bitwise reference implementation
+
+static uint16_t crc16_ccitt_reference(uint16_t crc, const uint8_t * data, int len){
+    int i;
+    while (len--){
+        crc ^= *data++;
+        for (i = 0; i < 8; i++){
+            crc = (crc & 1) ? ((crc >> 1) ^ 0x8408) : (crc >> 1);
+        }
+    }
+    return crc;
+}
+
+static uint16_t bit_reverse_16(uint16_t value){
+    uint16_t reversed = 0;
+    int i;
+    for (i = 0; i < 16; i++){
+        reversed = (reversed << 1) | (value & 1);
+        value >>= 1;
+    }
+    return reversed;
+}
+
+static uint16_t dic_reference(const uint8_t * frame, int len){
+    return bit_reverse_16(crc16_ccitt_reference(0xffff, frame, len));
+}
+
+// H5 frames
+
+typedef struct {
+    uint8_t data[MAX_FRAME_LEN];
+    int     len;
+} frame_t;
+
+static frame_t frames[MAX_FRAMES];
+static int     num_frames;
+
+static void complete_writes(void){
+    while (write_pending){
+        write_pending = 0;
+        block_sent_handler();
+    }
+}
+
+// SLIP decode all data written since last clear_output
+static void decode_output(void){
+    int pos;
+    int escape = 0;
+    num_frames = 0;
+    frames[0].len = 0;
+    for (pos = 0; pos < uart_output_len; pos++){
+        uint8_t byte = uart_output[pos];
+        if (byte == 0xc0){
+            if (frames[num_frames].len == 0) continue;
+            num_frames++;
+            CHECK(num_frames < MAX_FRAMES);
+            frames[num_frames].len = 0;
+            continue;
+        }
+        if (byte == 0xdb){
+            escape = 1;
+            continue;
+        }
+        if (escape){
+            escape = 0;
+            byte = (byte == 0xdc) ? 0xc0 : 0xdb;
+        }
+        frames[num_frames].data[frames[num_frames].len++] = byte;
+    }
+}
+
+static void clear_output(void){
+    complete_writes();
+    uart_output_len = 0;
+    num_frames = 0;
+}
+
+static uint8_t frame_seq_nr(const frame_t * frame){
+    return frame->data[0] & 0x07;
+}
+
+static uint8_t frame_ack_nr(const frame_t * frame){
+    return (frame->data[0] >> 3) & 0x07;
+}
+
+static int frame_reliable(const frame_t * frame){
+    return (frame->data[0] & 0x80) != 0;
+}
+
+static int frame_dic_present(const frame_t * frame){
+    return (frame->data[0] & 0x40) != 0;
+}
+
+static uint8_t frame_packet_type(const frame_t * frame){
+    return frame->data[1] & 0x0f;
+}
+
+static int frame_payload_len(const frame_t * frame){
+    return (frame->data[1] >> 4) | (frame->data[2] << 4);
+}
+
+static const uint8_t * frame_payload(const frame_t * frame){
+    return &frame->data[4];
+}
+
+static void receive_bytes(const uint8_t * data, int len){
+    while (len){
+        CHECK(receive_buffer != NULL);
+        int chunk = len < receive_max_len ? len : receive_max_len;
+        memcpy(receive_buffer, data, chunk);
+        data += chunk;
+        len  -= chunk;
+        data_received_handler(chunk);
+    }
+}
+
+static void receive_frame(uint8_t seq_nr, uint8_t ack_nr, int reliable, int dic_present, uint8_t packet_type, const uint8_t * payload, int payload_len){
+    uint8_t frame[4 + MAX_FRAME_LEN + 2];
+    frame[0] = seq_nr | (ack_nr << 3) | (dic_present << 6) | (reliable << 7);
+    frame[1] = packet_type | ((payload_len & 0x0f) << 4);
+    frame[2] = payload_len >> 4;
+    frame[3] = 0xff - (frame[0] + frame[1] + frame[2]);
+    memcpy(&frame[4], payload, payload_len);
+    int frame_len = 4 + payload_len;
+    if (dic_present){
+        uint16_t dic = dic_reference(frame, frame_len);
+        frame[frame_len++] = dic >> 8;
+        frame[frame_len++] = dic & 0xff;
+    }
+
+    uint8_t encoded[2 * sizeof(frame) + 2];
+    int pos = 0;
+    int i;
+    encoded[pos++] = 0xc0;
+    for (i = 0; i < frame_len; i++){
+        switch (frame[i]){
+            case 0xc0:
+                encoded[pos++] = 0xdb;
+                encoded[pos++] = 0xdc;
+                break;
+            case 0xdb:
+                encoded[pos++] = 0xdb;
+                encoded[pos++] = 0xdd;
+                break;
+            default:
+                encoded[pos++] = frame[i];
+                break;
+        }
+    }
+    encoded[pos++] = 0xc0;
+    receive_bytes(encoded, pos);
+    complete_writes();
+}
+
+static void receive_ack(uint8_t ack_nr){
+    receive_frame(0, ack_nr, 0, 0, LINK_ACKNOWLEDGEMENT_TYPE, NULL, 0);
+}
+
+static void fill_packet(uint8_t * packet, int len, uint8_t first){
+    int i;
+    for (i = 0; i < len; i++){
+        packet[i] = first + i;
+    }
+}
+
+TEST_GROUP(H5Transport){
+    const hci_transport_t * transport;
+    hci_transport_config_uart_t config;
+
+    void setup(void){
+        memset(timers, 0, sizeof(timers));
+        write_pending = 0;
+        uart_output_len = 0;
+        num_frames = 0;
+        num_packet_sent_events = 0;
+        num_received_packets = 0;
+
+        config.type          = HCI_TRANSPORT_CONFIG_UART;
+        config.baudrate_init = 115200;
+        config.baudrate_main = 0;
+        config.flowcontrol   = 1;
+        config.device_name   = NULL;
+
+        transport = hci_transport_h5_instance(&mock_uart);
+        transport->init(&config);
+        transport->register_packet_handler(&packet_handler);
+        transport->open();
+
+        // Sync
+        complete_writes();
+        decode_output();
+        CHECK(num_frames >= 1);
+        CHECK_EQUAL(LINK_CONTROL_PACKET_TYPE, frame_packet_type(&frames[0]));
+        clear_output();
+        receive_frame(0, 0, 0, 0, LINK_CONTROL_PACKET_TYPE, sync_response, sizeof(sync_response));
+
+        // Config offers window size 4 and data integrity check
+        decode_output();
+        CHECK(num_frames >= 1);
+        CHECK_EQUAL(3, frame_payload_len(&frames[0]));
+        CHECK_EQUAL(CONFIG_FIELD, frame_payload(&frames[0])[2]);
+        clear_output();
+        receive_frame(0, 0, 0, 0, LINK_CONTROL_PACKET_TYPE, config_response, sizeof(config_response));
+        CHECK_EQUAL(1, num_packet_sent_events);
+        CHECK_EQUAL(0, num_active_timers());
+        clear_output();
+        num_packet_sent_events = 0;
+    }
+
+    void send_packet(uint8_t first){
+        uint8_t packet[20];
+        fill_packet(packet, sizeof(packet), first);
+        CHECK(transport->can_send_packet_now(HCI_ACL_DATA_PACKET));
+        CHECK_EQUAL(0, transport->send_packet(HCI_ACL_DATA_PACKET, packet, sizeof(packet)));
+        complete_writes();
+    }
+
+    void check_data_frame(const frame_t * frame, uint8_t seq_nr, uint8_t first){
+        uint8_t packet[20];
+        fill_packet(packet, sizeof(packet), first);
+        CHECK(frame_reliable(frame));
+        CHECK_EQUAL(seq_nr, frame_seq_nr(frame));
+        CHECK_EQUAL(HCI_ACL_DATA_PACKET, frame_packet_type(frame));
+        CHECK_EQUAL((int) sizeof(packet), frame_payload_len(frame));
+        MEMCMP_EQUAL(packet, frame_payload(frame), sizeof(packet));
+    }
+};
+
+TEST(H5Transport, CrcReferenceCheckValue){
+    // CRC-CCITT with initial value 0xffff, LSB first, no final xor
+    const uint8_t check[] = { '1', '2', '3', '4', '5', '6', '7', '8', '9' };
+    CHECK_EQUAL(0x6f91, crc16_ccitt_reference(0xffff, check, sizeof(check)));
+    CHECK_EQUAL(0x89f6, dic_reference(check, sizeof(check)));
+}
+
+TEST(H5Transport, DataIntegrityCheckMatchesReference){
+    // four packets cover all byte values of the CRC table
+    uint8_t packets[4][64];
+    int i;
+    for (i = 0; i < 4; i++){
+        fill_packet(packets[i], sizeof(packets[i]), i * 64);
+        CHECK(transport->can_send_packet_now(HCI_ACL_DATA_PACKET));
+        transport->send_packet(HCI_ACL_DATA_PACKET, packets[i], sizeof(packets[i]));
+        complete_writes();
+    }
+    decode_output();
+    CHECK_EQUAL(4, num_frames);
+    for (i = 0; i < 4; i++){
+        const frame_t * frame = &frames[i];
+        CHECK(frame_dic_present(frame));
+        CHECK_EQUAL(4 + 64 + 2, frame->len);
+        MEMCMP_EQUAL(packets[i], frame_payload(frame), 64);
+        uint16_t dic = (frame->data[frame->len - 2] << 8) | frame->data[frame->len - 1];
+        CHECK_EQUAL(dic_reference(frame->data, frame->len - 2), dic);
+    }
+}
+
+TEST(H5Transport, ReceivedFrameWithInvalidDicDropped){
+    const uint8_t event[] = { 0x0e, 0x04, 0x01, 0x03, 0x0c, 0x00 };
+
+    // reliable frame, seq 0, with a payload bit flipped after the DIC was calculated
+    uint8_t frame[4 + sizeof(event) + 2];
+    frame[0] = (1 << 6) | (1 << 7);
+    frame[1] = HCI_EVENT_PACKET | ((sizeof(event) & 0x0f) << 4);
+    frame[2] = sizeof(event) >> 4;
+    frame[3] = 0xff - (frame[0] + frame[1] + frame[2]);
+    memcpy(&frame[4], event, sizeof(event));
+    uint16_t dic = dic_reference(frame, 4 + sizeof(event));
+    frame[4 + sizeof(event)]     = dic >> 8;
+    frame[4 + sizeof(event) + 1] = dic & 0xff;
+    frame[5] ^= 0x01;
+    uint8_t encoded[sizeof(frame) + 2];
+    encoded[0] = 0xc0;
+    memcpy(&encoded[1], frame, sizeof(frame));
+    encoded[sizeof(frame) + 1] = 0xc0;
+    receive_bytes(encoded, sizeof(encoded));
+    complete_writes();
+
+    // dropped without ack
+    CHECK_EQUAL(0, num_received_packets);
+    decode_output();
+    CHECK_EQUAL(0, num_frames);
+
+    // valid frame is delivered and acknowledged
+    receive_frame(0, 0, 1, 1, HCI_EVENT_PACKET, event, sizeof(event));
+    CHECK_EQUAL(1, num_received_packets);
+    CHECK_EQUAL((int) sizeof(event), received_packet_len);
+    MEMCMP_EQUAL(event, received_packet, sizeof(event));
+    decode_output();
+    CHECK_EQUAL(1, num_frames);
+    CHECK_EQUAL(LINK_ACKNOWLEDGEMENT_TYPE, frame_packet_type(&frames[0]));
+    CHECK_EQUAL(1, frame_ack_nr(&frames[0]));
+}
+
+TEST(H5Transport, MultipleOutstandingFramesAcked){
+    int i;
+    for (i = 0; i < 4; i++){
+        send_packet(i * 0x10);
+    }
+    CHECK_FALSE(transport->can_send_packet_now(HCI_ACL_DATA_PACKET));
+    CHECK_EQUAL(1, num_active_timers());
+
+    // all frames are sent without waiting for acks
+    decode_output();
+    CHECK_EQUAL(4, num_frames);
+    for (i = 0; i < 4; i++){
+        check_data_frame(&frames[i], i, i * 0x10);
+    }
+    clear_output();
+
+    // single ack releases the first three frames
+    int events_before_ack = num_packet_sent_events;
+    receive_ack(3);
+    CHECK(transport->can_send_packet_now(HCI_ACL_DATA_PACKET));
+    CHECK_EQUAL(events_before_ack + 1, num_packet_sent_events);
+    CHECK_EQUAL(1, num_active_timers());
+
+    // ack for unsent frame is ignored
+    receive_ack(5);
+    CHECK_EQUAL(1, num_active_timers());
+
+    // last frame acked, resend timer stopped
+    receive_ack(4);
+    CHECK_EQUAL(0, num_active_timers());
+
+    // sequence numbers continue after acked frames
+    send_packet(0x40);
+    decode_output();
+    CHECK_EQUAL(1, num_frames);
+    check_data_frame(&frames[0], 4, 0x40);
+}
+
+TEST(H5Transport, RetransmitAfterTimeout){
+    int i;
+    for (i = 0; i < 3; i++){
+        send_packet(i * 0x10);
+    }
+    clear_output();
+
+    receive_ack(1);
+    CHECK_EQUAL(1, num_active_timers());
+    clear_output();
+
+    // unacknowledged frames are sent again in order
+    fire_timer();
+    complete_writes();
+    decode_output();
+    CHECK_EQUAL(2, num_frames);
+    check_data_frame(&frames[0], 1, 0x10);
+    check_data_frame(&frames[1], 2, 0x20);
+    CHECK_EQUAL(1, num_active_timers());
+    clear_output();
+
+    // no more retransmits after ack
+    receive_ack(3);
+    CHECK_EQUAL(0, num_active_timers());
+    decode_output();
+    CHECK_EQUAL(0, num_frames);
+}
+
+int main (int argc, const char * argv[]){
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
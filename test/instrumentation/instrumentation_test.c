@@ -0,0 +1,226 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "CppUTest/TestHarness.h"
+#include "CppUTest/CommandLineTestRunner.h"
+
+#include "btstack_instrumentation.h"
+#include "btstack_run_loop.h"
+#include "hci.h"
+
+// run loop with manual time
+static uint64_t now_us;
+static btstack_timer_source_t * active_timer;
+static uint32_t active_timer_timeout_ms;
+
+static uint32_t mock_get_time_ms(void){
+    return (uint32_t) (now_us / 1000);
+}
+
+static uint64_t mock_get_time_us(void){
+    return now_us;
+}
+
+static void mock_set_timer(btstack_timer_source_t * timer, uint32_t timeout_in_ms){
+    UNUSED(timer);
+    active_timer_timeout_ms = timeout_in_ms;
+}
+
+static void mock_add_timer(btstack_timer_source_t * timer){
+    active_timer = timer;
+}
+
+static int mock_remove_timer(btstack_timer_source_t * timer){
+    if (active_timer != timer) return 0;
+    active_timer = NULL;
+    return 1;
+}
+
+static void mock_init(void){
+}
+
+static const btstack_run_loop_t mock_run_loop = {
+    &mock_init,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    &mock_set_timer,
+    &mock_add_timer,
+    &mock_remove_timer,
+    NULL,
+    NULL,
+    &mock_get_time_ms,
+    &mock_get_time_us,
+    NULL,
+};
+
+static btstack_instrumentation_entry_t entry;
+
+static int find_entry(btstack_instrumentation_layer_t layer, hci_con_handle_t con_handle, uint16_t channel){
+    int i;
+    for (i = 0; i < btstack_instrumentation_get_num_entries(); i++){
+        btstack_instrumentation_get_entry(i, &entry);
+        if (entry.layer != layer) continue;
+        if (entry.con_handle != con_handle) continue;
+        if (entry.channel != channel) continue;
+        return 1;
+    }
+    return 0;
+}
+
+// transport -> HCI -> L2CAP -> ATT, each layer adds 10 us before and after the next one
+static void receive_att_packet(hci_con_handle_t con_handle, uint16_t size){
+    BTSTACK_INSTRUMENTATION_ENTER(BTSTACK_INSTRUMENTATION_LAYER_TRANSPORT, BTSTACK_INSTRUMENTATION_NO_CON_HANDLE, HCI_ACL_DATA_PACKET, size + 8);
+    now_us += 10;
+    BTSTACK_INSTRUMENTATION_ENTER(BTSTACK_INSTRUMENTATION_LAYER_HCI, con_handle, HCI_ACL_DATA_PACKET, size + 8);
+    now_us += 10;
+    BTSTACK_INSTRUMENTATION_ENTER(BTSTACK_INSTRUMENTATION_LAYER_L2CAP, con_handle, 0x0004, size + 8);
+    now_us += 10;
+    BTSTACK_INSTRUMENTATION_ENTER(BTSTACK_INSTRUMENTATION_LAYER_ATT, con_handle, 0x0004, size);
+    now_us += 10;
+    BTSTACK_INSTRUMENTATION_EXIT();
+    now_us += 10;
+    BTSTACK_INSTRUMENTATION_EXIT();
+    now_us += 10;
+    BTSTACK_INSTRUMENTATION_EXIT();
+    now_us += 10;
+    BTSTACK_INSTRUMENTATION_EXIT();
+}
+
+TEST_GROUP(Instrumentation){
+    void setup(void){
+        now_us = 1000000;
+        active_timer = NULL;
+        btstack_instrumentation_init();
+    }
+};
+
+TEST(Instrumentation, NestedLayers){
+    receive_att_packet(0x0040, 20);
+
+    CHECK_EQUAL(4, btstack_instrumentation_get_num_entries());
+
+    CHECK(find_entry(BTSTACK_INSTRUMENTATION_LAYER_TRANSPORT, BTSTACK_INSTRUMENTATION_NO_CON_HANDLE, HCI_ACL_DATA_PACKET));
+    CHECK_EQUAL(1, entry.num_packets);
+    CHECK_EQUAL(28, entry.num_bytes);
+    CHECK_EQUAL(0, entry.queueing_delay.count);
+    CHECK_EQUAL(70, entry.handler_time.max_us);
+
+    CHECK(find_entry(BTSTACK_INSTRUMENTATION_LAYER_HCI, 0x0040, HCI_ACL_DATA_PACKET));
+    CHECK_EQUAL(10, entry.queueing_delay.max_us);
+    CHECK_EQUAL(50, entry.handler_time.max_us);
+
+    CHECK(find_entry(BTSTACK_INSTRUMENTATION_LAYER_L2CAP, 0x0040, 0x0004));
+    CHECK_EQUAL(20, entry.queueing_delay.max_us);
+    CHECK_EQUAL(30, entry.handler_time.max_us);
+
+    CHECK(find_entry(BTSTACK_INSTRUMENTATION_LAYER_ATT, 0x0040, 0x0004));
+    CHECK_EQUAL(20, entry.num_bytes);
+    CHECK_EQUAL(30, entry.queueing_delay.max_us);
+    CHECK_EQUAL(10, entry.handler_time.max_us);
+    CHECK_EQUAL(1, entry.handler_time.count);
+}
+
+TEST(Instrumentation, PerConnection){
+    receive_att_packet(0x0040, 20);
+    receive_att_packet(0x0041, 20);
+    receive_att_packet(0x0040, 20);
+    CHECK_EQUAL(7, btstack_instrumentation_get_num_entries());
+    CHECK(find_entry(BTSTACK_INSTRUMENTATION_LAYER_ATT, 0x0040, 0x0004));
+    CHECK_EQUAL(2, entry.num_packets);
+    CHECK(find_entry(BTSTACK_INSTRUMENTATION_LAYER_ATT, 0x0041, 0x0004));
+    CHECK_EQUAL(1, entry.num_packets);
+    CHECK(find_entry(BTSTACK_INSTRUMENTATION_LAYER_TRANSPORT, BTSTACK_INSTRUMENTATION_NO_CON_HANDLE, HCI_ACL_DATA_PACKET));
+    CHECK_EQUAL(3, entry.num_packets);
+}
+
+TEST(Instrumentation, Percentiles){
+    int i;
+    for (i = 1; i <= 100; i++){
+        BTSTACK_INSTRUMENTATION_ENTER(BTSTACK_INSTRUMENTATION_LAYER_HCI, BTSTACK_INSTRUMENTATION_NO_CON_HANDLE, HCI_EVENT_PACKET, 10);
+        now_us += i;
+        BTSTACK_INSTRUMENTATION_EXIT();
+    }
+    CHECK(find_entry(BTSTACK_INSTRUMENTATION_LAYER_HCI, BTSTACK_INSTRUMENTATION_NO_CON_HANDLE, HCI_EVENT_PACKET));
+    CHECK_EQUAL(100, entry.handler_time.count);
+    CHECK_EQUAL(5050, entry.handler_time.total_us);
+    CHECK_EQUAL(100, entry.handler_time.max_us);
+    CHECK_EQUAL(1, btstack_instrumentation_histogram_get_percentile(&entry.handler_time, 0));
+
+    // bucket resolution 25%
+    uint32_t p50 = btstack_instrumentation_histogram_get_percentile(&entry.handler_time, 50);
+    CHECK(p50 >= 50);
+    CHECK(p50 <= 62);
+    uint32_t p99 = btstack_instrumentation_histogram_get_percentile(&entry.handler_time, 99);
+    CHECK(p99 >= 99);
+    CHECK(p99 <= 100);
+    CHECK_EQUAL(100, btstack_instrumentation_histogram_get_percentile(&entry.handler_time, 100));
+}
+
+TEST(Instrumentation, LargeValues){
+    BTSTACK_INSTRUMENTATION_ENTER(BTSTACK_INSTRUMENTATION_LAYER_HCI, BTSTACK_INSTRUMENTATION_NO_CON_HANDLE, HCI_EVENT_PACKET, 10);
+    now_us += 10000000;
+    BTSTACK_INSTRUMENTATION_EXIT();
+    CHECK(find_entry(BTSTACK_INSTRUMENTATION_LAYER_HCI, BTSTACK_INSTRUMENTATION_NO_CON_HANDLE, HCI_EVENT_PACKET));
+    CHECK_EQUAL(1, entry.handler_time.buckets[BTSTACK_INSTRUMENTATION_HISTOGRAM_BUCKETS-1]);
+    CHECK_EQUAL(10000000, btstack_instrumentation_histogram_get_percentile(&entry.handler_time, 50));
+}
+
+TEST(Instrumentation, Throughput){
+    // 100 bytes every 10 ms
+    int i;
+    for (i = 0; i < 250; i++){
+        BTSTACK_INSTRUMENTATION_ENTER(BTSTACK_INSTRUMENTATION_LAYER_L2CAP, 0x0040, 0x0040, 100);
+        BTSTACK_INSTRUMENTATION_EXIT();
+        now_us += 10000;
+    }
+    CHECK(find_entry(BTSTACK_INSTRUMENTATION_LAYER_L2CAP, 0x0040, 0x0040));
+    CHECK_EQUAL(25000, entry.num_bytes);
+    CHECK_EQUAL(10000, entry.bytes_per_second);
+    CHECK_EQUAL(10000, entry.bytes_per_second_max);
+}
+
+TEST(Instrumentation, MaxEntries){
+    int i;
+    for (i = 0; i < BTSTACK_INSTRUMENTATION_MAX_ENTRIES + 2; i++){
+        BTSTACK_INSTRUMENTATION_ENTER(BTSTACK_INSTRUMENTATION_LAYER_L2CAP, 0x0040, 0x0040 + i, 10);
+        BTSTACK_INSTRUMENTATION_ENTER(BTSTACK_INSTRUMENTATION_LAYER_RFCOMM, 0x0040, 0x0001, 5);
+        now_us += 10;
+        BTSTACK_INSTRUMENTATION_EXIT();
+        BTSTACK_INSTRUMENTATION_EXIT();
+    }
+    CHECK_EQUAL(BTSTACK_INSTRUMENTATION_MAX_ENTRIES, btstack_instrumentation_get_num_entries());
+    CHECK(find_entry(BTSTACK_INSTRUMENTATION_LAYER_RFCOMM, 0x0040, 0x0001));
+    CHECK_EQUAL(BTSTACK_INSTRUMENTATION_MAX_ENTRIES + 2, entry.num_packets);
+    CHECK_EQUAL(BTSTACK_INSTRUMENTATION_MAX_ENTRIES + 2, entry.handler_time.count);
+    CHECK_EQUAL(0, btstack_instrumentation_get_entry(BTSTACK_INSTRUMENTATION_MAX_ENTRIES, &entry));
+}
+
+TEST(Instrumentation, Reset){
+    receive_att_packet(0x0040, 20);
+    btstack_instrumentation_reset();
+    CHECK_EQUAL(0, btstack_instrumentation_get_num_entries());
+}
+
+TEST(Instrumentation, PeriodicReport){
+    receive_att_packet(0x0040, 20);
+    btstack_instrumentation_set_report_interval(5000);
+    CHECK(active_timer != NULL);
+    CHECK_EQUAL(5000, active_timer_timeout_ms);
+
+    // timer fires and is re-armed
+    btstack_timer_source_t * timer = active_timer;
+    active_timer = NULL;
+    timer->process(timer);
+    CHECK(active_timer == timer);
+
+    btstack_instrumentation_set_report_interval(0);
+    CHECK(active_timer == NULL);
+}
+
+int main (int argc, const char * argv[]){
+    btstack_run_loop_init(&mock_run_loop);
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
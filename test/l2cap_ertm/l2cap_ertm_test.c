@@ -0,0 +1,547 @@
+// L2CAP Enhanced Retransmission and Streaming Mode over an ACL loopback:
+// outgoing ACL packets are queued and fed back as incoming packets on the same connection,
+// so the outgoing channel connects to a service registered on the same stack.
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include "CppUTest/TestHarness.h"
+#include "CppUTest/CommandLineTestRunner.h"
+
+#include "btstack_event.h"
+#include "btstack_memory.h"
+#include "btstack_run_loop.h"
+#include "btstack_run_loop_embedded.h"
+#include "btstack_util.h"
+#include "hal_cpu.h"
+#include "hal_time_ms.h"
+#include "hci.h"
+#include "hci_transport.h"
+#include "l2cap.h"
+
+#define TEST_PSM        0x1001
+#define TEST_HANDLE     0x0040
+#define TEST_MTU        512
+#define TEST_NUM_ACL_PACKETS 8
+
+// virtual time for run loop timers
+static uint32_t time_ms;
+
+uint32_t hal_time_ms(void){
+    return time_ms;
+}
+void hal_cpu_disable_irqs(void){}
+void hal_cpu_enable_irqs(void){}
+void hal_cpu_enable_irqs_and_sleep(void){}
+
+// loopback transport
+#define LOOPBACK_QUEUE_SIZE 64
+static uint8_t  loopback_queue[LOOPBACK_QUEUE_SIZE][HCI_ACL_HEADER_SIZE + HCI_ACL_PAYLOAD_SIZE];
+static uint16_t loopback_sizes[LOOPBACK_QUEUE_SIZE];
+static int loopback_head;
+static int loopback_count;
+
+// link statistics
+static uint32_t link_packets;
+static uint32_t link_bytes;
+
+// fault injection: drop or corrupt n-th L2CAP packet on the dynamic channels, counted from 1
+static int filter_packet_nr;
+static int filter_data_packets;
+static int drop_packet_nr;
+static int corrupt_packet_nr;
+
+// MPS written into the first config request with Retransmission and Flow Control option, 0xffff = unchanged
+static uint16_t config_request_mps;
+static int num_config_unacceptable;
+
+static void loopback_inspect_signaling(uint8_t * packet, uint16_t size){
+    uint16_t cid = little_endian_read_16(packet, 6);
+    if (cid != L2CAP_CID_SIGNALING) return;
+    uint8_t code = packet[8];
+    if (code == CONFIGURE_RESPONSE && little_endian_read_16(packet, 16) == L2CAP_CONF_RESULT_UNACCEPTABLE_PARAMETERS){
+        num_config_unacceptable++;
+        return;
+    }
+    if (code != CONFIGURE_REQUEST || config_request_mps == 0xffff) return;
+    uint16_t pos = 16;
+    while (pos + 2 <= size){
+        uint8_t option_type = packet[pos] & 0x7f;
+        uint8_t length      = packet[pos+1];
+        if (option_type == L2CAP_CONFIG_OPTION_TYPE_RETRANSMISSION_AND_FLOW_CONTROL && length == 9){
+            little_endian_store_16(packet, pos + 2 + 7, config_request_mps);
+            config_request_mps = 0xffff;
+            return;
+        }
+        pos += 2 + length;
+    }
+}
+
+static void (*transport_packet_handler)(uint8_t packet_type, uint8_t *packet, uint16_t size);
+
+static void transport_register_packet_handler(void (*handler)(uint8_t packet_type, uint8_t *packet, uint16_t size)){
+    transport_packet_handler = handler;
+}
+
+static int transport_send_packet(uint8_t packet_type, uint8_t * packet, int size){
+    if (packet_type != HCI_ACL_DATA_PACKET) return 0;
+    if (loopback_count >= LOOPBACK_QUEUE_SIZE) return -1;
+    int pos = (loopback_head + loopback_count) % LOOPBACK_QUEUE_SIZE;
+    memcpy(loopback_queue[pos], packet, size);
+    loopback_sizes[pos] = size;
+    loopback_count++;
+    link_packets++;
+    link_bytes += size;
+    return 0;
+}
+
+static hci_transport_t transport;
+
+static void number_of_completed_packets(hci_con_handle_t con_handle, uint16_t num_packets){
+    uint8_t event[] = { HCI_EVENT_NUMBER_OF_COMPLETED_PACKETS, 5, 1, 0, 0, 0, 0};
+    little_endian_store_16(event, 3, con_handle);
+    little_endian_store_16(event, 5, num_packets);
+    transport_packet_handler(HCI_EVENT_PACKET, event, sizeof(event));
+}
+
+// deliver oldest queued packet, returns 0 if queue is empty
+static int loopback_pump_one(void){
+    if (loopback_count == 0) return 0;
+    uint8_t packet[HCI_ACL_HEADER_SIZE + HCI_ACL_PAYLOAD_SIZE];
+    uint16_t size = loopback_sizes[loopback_head];
+    memcpy(packet, loopback_queue[loopback_head], size);
+    loopback_head = (loopback_head + 1) % LOOPBACK_QUEUE_SIZE;
+    loopback_count--;
+
+    hci_con_handle_t con_handle = READ_ACL_CONNECTION_HANDLE(packet);
+    number_of_completed_packets(con_handle, 1);
+    loopback_inspect_signaling(packet, size);
+
+    // count packets on dynamic channels, optionally only I-frames
+    uint16_t cid = little_endian_read_16(packet, 6);
+    if (cid >= 0x40 && (!filter_data_packets || (packet[8] & 1) == 0)){
+        filter_packet_nr++;
+        if (filter_packet_nr == drop_packet_nr) return 1;
+        if (filter_packet_nr == corrupt_packet_nr){
+            packet[size - 3] ^= 0x01;
+        }
+    }
+
+    // remote controller sends it as start of automatically flushable packet
+    little_endian_store_16(packet, 0, con_handle | (0x02 << 12));
+    transport_packet_handler(HCI_ACL_DATA_PACKET, packet, size);
+    return 1;
+}
+
+static void loopback_pump(void){
+    int i;
+    for (i = 0; i < 10000; i++){
+        if (!loopback_pump_one()) return;
+    }
+    FAIL("loopback did not settle");
+}
+
+// advance virtual time and process due timers
+static void advance_time(uint32_t delta_ms){
+    time_ms += delta_ms;
+    btstack_run_loop_embedded_execute_once();
+    loopback_pump();
+}
+
+static void read_buffer_size_complete(uint16_t acl_length, uint16_t num_packets){
+    uint8_t event[] = { HCI_EVENT_COMMAND_COMPLETE, 11, 1, 0x05, 0x10, 0, 0, 0, 0, 0, 0, 0, 0};
+    little_endian_store_16(event, 6, acl_length);
+    little_endian_store_16(event, 9, num_packets);
+    transport_packet_handler(HCI_EVENT_PACKET, event, sizeof(event));
+}
+
+static bd_addr_t remote_addr = { 0x11, 0x22, 0x33, 0x44, 0x55, 0x66 };
+
+static void classic_connection(hci_con_handle_t con_handle){
+    uint8_t request[] = { HCI_EVENT_CONNECTION_REQUEST, 10, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1};
+    reverse_bd_addr(remote_addr, &request[2]);
+    transport_packet_handler(HCI_EVENT_PACKET, request, sizeof(request));
+
+    uint8_t complete[] = { HCI_EVENT_CONNECTION_COMPLETE, 11, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0};
+    little_endian_store_16(complete, 3, con_handle);
+    reverse_bd_addr(remote_addr, &complete[5]);
+    transport_packet_handler(HCI_EVENT_PACKET, complete, sizeof(complete));
+
+    uint8_t features[] = { HCI_EVENT_READ_REMOTE_SUPPORTED_FEATURES_COMPLETE, 11, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    little_endian_store_16(features, 3, con_handle);
+    transport_packet_handler(HCI_EVENT_PACKET, features, sizeof(features));
+}
+
+// channel state as seen by the packet handlers
+typedef struct {
+    uint16_t cid;
+    int      opened;
+    uint8_t  status;
+    int      closed;
+    int      num_sdus;
+    uint32_t num_bytes;
+    int      sdu_errors;
+} test_channel_t;
+
+static test_channel_t client;
+static test_channel_t server;
+
+static l2cap_channel_mode_t server_mode;
+static l2cap_ertm_config_t  server_config;
+static uint8_t server_buffer[L2CAP_ERTM_BUFFER_SIZE(8, TEST_MTU)];
+static l2cap_ertm_config_t  client_config;
+static uint8_t client_buffer[L2CAP_ERTM_BUFFER_SIZE(8, TEST_MTU)];
+
+// SDUs carry their length in each byte
+static void fill_sdu(uint8_t * sdu, uint16_t len){
+    memset(sdu, len & 0xff, len);
+}
+
+static void test_channel_handle_packet(test_channel_t * test_channel, uint8_t packet_type, uint8_t * packet, uint16_t size){
+    if (packet_type == L2CAP_DATA_PACKET){
+        test_channel->num_sdus++;
+        test_channel->num_bytes += size;
+        uint16_t i;
+        for (i = 0; i < size; i++){
+            if (packet[i] != (size & 0xff)){
+                test_channel->sdu_errors++;
+                break;
+            }
+        }
+        return;
+    }
+    if (packet_type != HCI_EVENT_PACKET) return;
+    switch (hci_event_packet_get_type(packet)){
+        case L2CAP_EVENT_CHANNEL_OPENED:
+            test_channel->opened = 1;
+            test_channel->status = l2cap_event_channel_opened_get_status(packet);
+            test_channel->cid    = l2cap_event_channel_opened_get_local_cid(packet);
+            break;
+        case L2CAP_EVENT_CHANNEL_CLOSED:
+            test_channel->closed = 1;
+            break;
+        default:
+            break;
+    }
+}
+
+static void client_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *packet, uint16_t size){
+    UNUSED(channel);
+    test_channel_handle_packet(&client, packet_type, packet, size);
+}
+
+static void server_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *packet, uint16_t size){
+    UNUSED(channel);
+    if (packet_type == HCI_EVENT_PACKET && hci_event_packet_get_type(packet) == L2CAP_EVENT_INCOMING_CONNECTION){
+        uint16_t local_cid = l2cap_event_incoming_connection_get_local_cid(packet);
+        if (server_mode == L2CAP_CHANNEL_MODE_BASIC){
+            l2cap_accept_connection(local_cid);
+        } else {
+            uint8_t status = l2cap_accept_ertm_connection(local_cid, &server_config, server_buffer, sizeof(server_buffer));
+            CHECK_EQUAL(0, status);
+        }
+        return;
+    }
+    test_channel_handle_packet(&server, packet_type, packet, size);
+}
+
+static void init_config(l2cap_ertm_config_t * config, l2cap_channel_mode_t mode){
+    memset(config, 0, sizeof(l2cap_ertm_config_t));
+    config->mode = mode;
+    config->mode_mandatory = 1;
+    config->max_transmit = 4;
+    config->retransmission_timeout_ms = L2CAP_ERTM_DEFAULT_RETRANSMISSION_TIMEOUT_MS;
+    config->monitor_timeout_ms = L2CAP_ERTM_DEFAULT_MONITOR_TIMEOUT_MS;
+    config->local_mtu = TEST_MTU;
+    config->tx_window_size = 8;
+    config->num_tx_buffers = 8;
+    config->fcs_option = 1;
+}
+
+static void stack_setup(void){
+    memset(&transport, 0, sizeof(transport));
+    transport.name = "LOOPBACK";
+    transport.register_packet_handler = &transport_register_packet_handler;
+    transport.send_packet = &transport_send_packet;
+
+    loopback_head = 0;
+    loopback_count = 0;
+    link_packets = 0;
+    link_bytes = 0;
+    filter_packet_nr = 0;
+    filter_data_packets = 0;
+    drop_packet_nr = 0;
+    corrupt_packet_nr = 0;
+    config_request_mps = 0xffff;
+    num_config_unacceptable = 0;
+    memset(&client, 0, sizeof(client));
+    memset(&server, 0, sizeof(server));
+    init_config(&client_config, L2CAP_CHANNEL_MODE_ENHANCED_RETRANSMISSION);
+    init_config(&server_config, L2CAP_CHANNEL_MODE_ENHANCED_RETRANSMISSION);
+
+    hci_init(&transport, NULL);
+    l2cap_init();
+    read_buffer_size_complete(HCI_ACL_PAYLOAD_SIZE, TEST_NUM_ACL_PACKETS);
+    classic_connection(TEST_HANDLE);
+    l2cap_register_service(&server_packet_handler, TEST_PSM, TEST_MTU, LEVEL_0);
+}
+
+static uint8_t connect(l2cap_channel_mode_t client_mode, l2cap_channel_mode_t mode_of_server){
+    server_mode = mode_of_server;
+    server_config.mode = mode_of_server;
+    client_config.mode = client_mode;
+    uint16_t cid = 0;
+    uint8_t status;
+    if (client_mode == L2CAP_CHANNEL_MODE_BASIC){
+        status = l2cap_create_channel(&client_packet_handler, remote_addr, TEST_PSM, TEST_MTU, &cid);
+    } else {
+        status = l2cap_create_ertm_channel(&client_packet_handler, remote_addr, TEST_PSM, &client_config,
+            client_buffer, sizeof(client_buffer), &cid);
+    }
+    if (status) return status;
+    loopback_pump();
+    return client.status;
+}
+
+static void send_sdu(uint16_t len){
+    uint8_t sdu[TEST_MTU];
+    fill_sdu(sdu, len);
+    CHECK(l2cap_can_send_packet_now(client.cid));
+    CHECK_EQUAL(0, l2cap_send(client.cid, sdu, len));
+}
+
+TEST_GROUP(L2CAPERTM){
+    void setup(void){
+        stack_setup();
+    }
+    void teardown(void){
+        hci_close();
+    }
+};
+
+TEST(L2CAPERTM, OpenAndDeliverSegmentedSDU){
+    CHECK_EQUAL(0, connect(L2CAP_CHANNEL_MODE_ENHANCED_RETRANSMISSION, L2CAP_CHANNEL_MODE_ENHANCED_RETRANSMISSION));
+    CHECK(client.opened);
+    CHECK(server.opened);
+    CHECK_EQUAL(0, server.status);
+
+    // SDU larger than MPS is split into several I-frames
+    send_sdu(TEST_MTU);
+    loopback_pump();
+    CHECK_EQUAL(1, server.num_sdus);
+    CHECK_EQUAL(TEST_MTU, server.num_bytes);
+    CHECK_EQUAL(0, server.sdu_errors);
+
+    send_sdu(10);
+    loopback_pump();
+    CHECK_EQUAL(2, server.num_sdus);
+    CHECK_EQUAL(0, server.sdu_errors);
+}
+
+TEST(L2CAPERTM, TxWindowLimitsOutstandingFrames){
+    server_config.tx_window_size = 2;
+    CHECK_EQUAL(0, connect(L2CAP_CHANNEL_MODE_ENHANCED_RETRANSMISSION, L2CAP_CHANNEL_MODE_ENHANCED_RETRANSMISSION));
+
+    // stored frames are sent until window of remote is exhausted
+    send_sdu(10);
+    send_sdu(10);
+    send_sdu(10);
+    loopback_pump();
+    CHECK_EQUAL(3, server.num_sdus);
+    CHECK_EQUAL(0, server.sdu_errors);
+}
+
+TEST(L2CAPERTM, RejectRecoversLostFrame){
+    connect(L2CAP_CHANNEL_MODE_ENHANCED_RETRANSMISSION, L2CAP_CHANNEL_MODE_ENHANCED_RETRANSMISSION);
+    filter_data_packets = 1;
+    filter_packet_nr = 0;
+    drop_packet_nr = 1;
+    send_sdu(10);
+    send_sdu(11);
+    send_sdu(12);
+    loopback_pump();
+    // second frame arrives out of sequence, REJ triggers retransmission of all three
+    CHECK_EQUAL(3, server.num_sdus);
+    CHECK_EQUAL(10 + 11 + 12, server.num_bytes);
+    CHECK_EQUAL(0, server.sdu_errors);
+}
+
+TEST(L2CAPERTM, RetransmissionTimeoutRecoversLastFrame){
+    connect(L2CAP_CHANNEL_MODE_ENHANCED_RETRANSMISSION, L2CAP_CHANNEL_MODE_ENHANCED_RETRANSMISSION);
+    filter_data_packets = 1;
+    filter_packet_nr = 0;
+    drop_packet_nr = 1;
+    send_sdu(20);
+    loopback_pump();
+    CHECK_EQUAL(0, server.num_sdus);
+
+    // retransmission timer expires, poll is answered with final bit and frame is resent
+    advance_time(L2CAP_ERTM_DEFAULT_RETRANSMISSION_TIMEOUT_MS + 10);
+    CHECK_EQUAL(1, server.num_sdus);
+    CHECK_EQUAL(0, server.sdu_errors);
+    CHECK(!client.closed);
+}
+
+TEST(L2CAPERTM, CorruptedFrameIsDiscarded){
+    connect(L2CAP_CHANNEL_MODE_ENHANCED_RETRANSMISSION, L2CAP_CHANNEL_MODE_ENHANCED_RETRANSMISSION);
+    filter_data_packets = 1;
+    filter_packet_nr = 0;
+    corrupt_packet_nr = 1;
+    send_sdu(30);
+    send_sdu(31);
+    loopback_pump();
+    // FCS mismatch drops first frame, second one triggers REJ
+    CHECK_EQUAL(2, server.num_sdus);
+    CHECK_EQUAL(30 + 31, server.num_bytes);
+    CHECK_EQUAL(0, server.sdu_errors);
+}
+
+TEST(L2CAPERTM, MaxTransmitClosesChannel){
+    connect(L2CAP_CHANNEL_MODE_ENHANCED_RETRANSMISSION, L2CAP_CHANNEL_MODE_ENHANCED_RETRANSMISSION);
+    // drop everything from client to server
+    filter_data_packets = 0;
+    filter_packet_nr = 0;
+    send_sdu(20);
+    int i;
+    for (i = 0; i < 20 && !client.closed; i++){
+        drop_packet_nr = filter_packet_nr + 1;
+        loopback_pump();
+        time_ms += L2CAP_ERTM_DEFAULT_MONITOR_TIMEOUT_MS + 10;
+        btstack_run_loop_embedded_execute_once();
+    }
+    drop_packet_nr = 0;
+    loopback_pump();
+    CHECK(client.closed);
+    CHECK_EQUAL(0, server.num_sdus);
+}
+
+TEST(L2CAPERTM, StreamingDropsLostSDU){
+    CHECK_EQUAL(0, connect(L2CAP_CHANNEL_MODE_STREAMING, L2CAP_CHANNEL_MODE_STREAMING));
+    filter_data_packets = 1;
+    filter_packet_nr = 0;
+    drop_packet_nr = 2;
+    // segmented SDU loses its second segment, following SDU is delivered
+    send_sdu(TEST_MTU);
+    loopback_pump();
+    send_sdu(40);
+    loopback_pump();
+    CHECK_EQUAL(1, server.num_sdus);
+    CHECK_EQUAL(40, server.num_bytes);
+    CHECK_EQUAL(0, server.sdu_errors);
+
+    // no retransmission later
+    advance_time(L2CAP_ERTM_DEFAULT_MONITOR_TIMEOUT_MS);
+    CHECK_EQUAL(1, server.num_sdus);
+}
+
+TEST(L2CAPERTM, MandatoryModeNotSupported){
+    // server only offers Basic mode
+    CHECK_EQUAL(L2CAP_CHANNEL_MODE_NOT_SUPPORTED_BY_REMOTE,
+        connect(L2CAP_CHANNEL_MODE_ENHANCED_RETRANSMISSION, L2CAP_CHANNEL_MODE_BASIC));
+    CHECK(client.opened);
+    CHECK(client.closed);
+    CHECK(!server.opened || server.closed);
+}
+
+TEST(L2CAPERTM, FallbackToBasicModeIfNotMandatory){
+    client_config.mode_mandatory = 0;
+    CHECK_EQUAL(0, connect(L2CAP_CHANNEL_MODE_ENHANCED_RETRANSMISSION, L2CAP_CHANNEL_MODE_BASIC));
+    CHECK(client.opened);
+    CHECK(server.opened);
+
+    send_sdu(100);
+    loopback_pump();
+    CHECK_EQUAL(1, server.num_sdus);
+    CHECK_EQUAL(0, server.sdu_errors);
+}
+
+// MPS too small for segmentation is rejected, channel opens with the MPS of the next config request
+static void check_remote_mps_rejected(uint16_t mps){
+    config_request_mps = mps;
+    CHECK_EQUAL(0, connect(L2CAP_CHANNEL_MODE_ENHANCED_RETRANSMISSION, L2CAP_CHANNEL_MODE_ENHANCED_RETRANSMISSION));
+    CHECK_EQUAL(0xffff, config_request_mps);
+    CHECK_EQUAL(1, num_config_unacceptable);
+    CHECK(client.opened);
+    CHECK(server.opened);
+
+    // both directions segment with a valid MPS
+    send_sdu(TEST_MTU);
+    uint8_t sdu[TEST_MTU];
+    fill_sdu(sdu, TEST_MTU);
+    CHECK(l2cap_can_send_packet_now(server.cid));
+    CHECK_EQUAL(0, l2cap_send(server.cid, sdu, TEST_MTU));
+    loopback_pump();
+    CHECK_EQUAL(1, server.num_sdus);
+    CHECK_EQUAL(0, server.sdu_errors);
+    CHECK_EQUAL(1, client.num_sdus);
+    CHECK_EQUAL(0, client.sdu_errors);
+}
+
+TEST(L2CAPERTM, RemoteMpsZeroRejected){
+    check_remote_mps_rejected(0);
+}
+
+TEST(L2CAPERTM, RemoteMpsTwoRejected){
+    check_remote_mps_rejected(2);
+}
+
+// Throughput over loopback: controller buffers are the only limit for Basic mode,
+// ERTM additionally waits for acknowledgements and pays for control field and FCS
+static void measure_throughput(const char * name, l2cap_channel_mode_t mode){
+    const int num_sdus = 2000;
+    const uint16_t sdu_len = 240;
+    if (mode == L2CAP_CHANNEL_MODE_BASIC){
+        connect(mode, mode);
+    } else {
+        CHECK_EQUAL(0, connect(mode, mode));
+    }
+    CHECK(client.opened);
+    link_bytes = 0;
+    link_packets = 0;
+
+    uint8_t sdu[TEST_MTU];
+    fill_sdu(sdu, sdu_len);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int sent = 0;
+    int iterations = 0;
+    while (server.num_sdus < num_sdus && iterations++ < 1000000){
+        while (sent < num_sdus && l2cap_can_send_packet_now(client.cid)){
+            CHECK_EQUAL(0, l2cap_send(client.cid, sdu, sdu_len));
+            sent++;
+        }
+        if (!loopback_pump_one()){
+            // wait for acknowledgement timer
+            advance_time(50);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    CHECK_EQUAL(num_sdus, server.num_sdus);
+    CHECK_EQUAL(0, server.sdu_errors);
+
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    uint32_t payload = num_sdus * sdu_len;
+    printf("%-10s %6.1f MB/s, %5u link packets, link overhead %4.1f%%\n", name,
+        payload / seconds / 1e6, link_packets, 100.0 * (link_bytes - payload) / payload);
+}
+
+TEST(L2CAPERTM, ThroughputBasic){
+    measure_throughput("Basic", L2CAP_CHANNEL_MODE_BASIC);
+}
+
+TEST(L2CAPERTM, ThroughputEnhancedRetransmission){
+    measure_throughput("ERTM", L2CAP_CHANNEL_MODE_ENHANCED_RETRANSMISSION);
+}
+
+TEST(L2CAPERTM, ThroughputStreaming){
+    measure_throughput("Streaming", L2CAP_CHANNEL_MODE_STREAMING);
+}
+
+int main (int argc, const char * argv[]){
+    btstack_memory_init();
+    btstack_run_loop_init(btstack_run_loop_embedded_get_instance());
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
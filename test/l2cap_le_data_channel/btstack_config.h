@@ -0,0 +1,21 @@
+//
+// btstack_config.h for L2CAP LE Data Channel loopback test
+//
+#ifndef __BTSTACK_CONFIG
+#define __BTSTACK_CONFIG
+
+// Port related features
+#define HAVE_MALLOC
+#define HAVE_EMBEDDED_TIME_MS
+
+// BTstack features that can be enabled
+#define ENABLE_BLE
+#define ENABLE_CLASSIC
+#define ENABLE_LE_DATA_CHANNELS
+#define ENABLE_LOG_ERROR
+
+// BTstack configuration. buffers, sizes, ...
+#define HCI_ACL_PAYLOAD_SIZE 64
+#define HCI_INCOMING_PRE_BUFFER_SIZE 4
+
+#endif
@@ -0,0 +1,338 @@
+// L2CAP LE Data Channels over an ACL loopback: outgoing ACL packets are queued and fed back
+// as incoming packets on the same connection, so the outgoing channel connects to a service
+// registered on the same stack.
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "CppUTest/TestHarness.h"
+#include "CppUTest/CommandLineTestRunner.h"
+
+#include "ble/sm.h"
+#include "btstack_event.h"
+#include "btstack_memory.h"
+#include "btstack_run_loop.h"
+#include "btstack_run_loop_embedded.h"
+#include "btstack_util.h"
+#include "hal_cpu.h"
+#include "hal_time_ms.h"
+#include "hci.h"
+#include "hci_transport.h"
+#include "l2cap.h"
+
+#define TEST_PSM        0x0080
+#define TEST_HANDLE     0x0040
+#define TEST_MTU        100
+#define TEST_NUM_ACL_PACKETS 8
+
+// virtual time for run loop timers
+static uint32_t time_ms;
+
+uint32_t hal_time_ms(void){
+    return time_ms;
+}
+void hal_cpu_disable_irqs(void){}
+void hal_cpu_enable_irqs(void){}
+void hal_cpu_enable_irqs_and_sleep(void){}
+
+// services are registered with LEVEL_0
+int sm_encryption_key_size(hci_con_handle_t con_handle){
+    UNUSED(con_handle);
+    return 0;
+}
+int sm_authenticated(hci_con_handle_t con_handle){
+    UNUSED(con_handle);
+    return 0;
+}
+authorization_state_t sm_authorization_state(hci_con_handle_t con_handle){
+    UNUSED(con_handle);
+    return AUTHORIZATION_UNKNOWN;
+}
+
+// loopback transport
+#define LOOPBACK_QUEUE_SIZE 64
+static uint8_t  loopback_queue[LOOPBACK_QUEUE_SIZE][HCI_ACL_HEADER_SIZE + HCI_ACL_PAYLOAD_SIZE];
+static uint16_t loopback_sizes[LOOPBACK_QUEUE_SIZE];
+static int loopback_head;
+static int loopback_count;
+
+static void (*transport_packet_handler)(uint8_t packet_type, uint8_t *packet, uint16_t size);
+
+static void transport_register_packet_handler(void (*handler)(uint8_t packet_type, uint8_t *packet, uint16_t size)){
+    transport_packet_handler = handler;
+}
+
+static int transport_send_packet(uint8_t packet_type, uint8_t * packet, int size){
+    if (packet_type != HCI_ACL_DATA_PACKET) return 0;
+    if (loopback_count >= LOOPBACK_QUEUE_SIZE) return -1;
+    int pos = (loopback_head + loopback_count) % LOOPBACK_QUEUE_SIZE;
+    memcpy(loopback_queue[pos], packet, size);
+    loopback_sizes[pos] = size;
+    loopback_count++;
+    return 0;
+}
+
+static hci_transport_t transport;
+
+static void number_of_completed_packets(hci_con_handle_t con_handle, uint16_t num_packets){
+    uint8_t event[] = { HCI_EVENT_NUMBER_OF_COMPLETED_PACKETS, 5, 1, 0, 0, 0, 0};
+    little_endian_store_16(event, 3, con_handle);
+    little_endian_store_16(event, 5, num_packets);
+    transport_packet_handler(HCI_EVENT_PACKET, event, sizeof(event));
+}
+
+// deliver oldest queued packet, returns 0 if queue is empty
+static int loopback_pump_one(void){
+    if (loopback_count == 0) return 0;
+    uint8_t packet[HCI_ACL_HEADER_SIZE + HCI_ACL_PAYLOAD_SIZE];
+    uint16_t size = loopback_sizes[loopback_head];
+    memcpy(packet, loopback_queue[loopback_head], size);
+    loopback_head = (loopback_head + 1) % LOOPBACK_QUEUE_SIZE;
+    loopback_count--;
+
+    hci_con_handle_t con_handle = READ_ACL_CONNECTION_HANDLE(packet);
+    number_of_completed_packets(con_handle, 1);
+
+    // remote controller sends it as start of automatically flushable packet
+    little_endian_store_16(packet, 0, con_handle | (0x02 << 12));
+    transport_packet_handler(HCI_ACL_DATA_PACKET, packet, size);
+    return 1;
+}
+
+static void loopback_pump(void){
+    int i;
+    for (i = 0; i < 10000; i++){
+        if (!loopback_pump_one()) return;
+    }
+    FAIL("loopback did not settle");
+}
+
+static void le_read_buffer_size_complete(uint8_t num_packets){
+    uint8_t event[] = { HCI_EVENT_COMMAND_COMPLETE, 7, 1, 0x02, 0x20, 0, 27, 0, 0};
+    event[8] = num_packets;
+    transport_packet_handler(HCI_EVENT_PACKET, event, sizeof(event));
+}
+
+static void le_connection_complete(hci_con_handle_t con_handle){
+    uint8_t event[] = { HCI_EVENT_LE_META, 19, HCI_SUBEVENT_LE_CONNECTION_COMPLETE, 0, 0, 0, HCI_ROLE_MASTER, 0,
+        0, 0, 0, 0, 0, 0, 0x28, 0, 0, 0, 0x48, 0, 0};
+    little_endian_store_16(event, 4, con_handle);
+    little_endian_store_16(event, 8, con_handle);
+    transport_packet_handler(HCI_EVENT_PACKET, event, sizeof(event));
+}
+
+// channel state as seen by the packet handlers
+typedef struct {
+    uint16_t cid;
+    int      opened;
+    uint8_t  status;
+    int      num_sdus;
+    uint32_t num_bytes;
+    int      sdu_errors;
+    int      num_packets_sent;
+} test_channel_t;
+
+static test_channel_t client;
+static test_channel_t server;
+
+static uint16_t server_initial_credits;
+static uint8_t  server_buffer[TEST_MTU];
+static uint8_t  client_buffer[TEST_MTU];
+
+// SDUs carry their length in each byte
+static uint8_t sdus[L2CAP_LE_DATA_CHANNELS_SEND_QUEUE_SIZE + 1][TEST_MTU];
+
+static uint8_t * fill_sdu(int index, uint16_t len){
+    memset(sdus[index], len & 0xff, len);
+    return sdus[index];
+}
+
+static void test_channel_handle_packet(test_channel_t * test_channel, uint8_t packet_type, uint8_t * packet, uint16_t size){
+    if (packet_type == L2CAP_DATA_PACKET){
+        test_channel->num_sdus++;
+        test_channel->num_bytes += size;
+        uint16_t i;
+        for (i = 0; i < size; i++){
+            if (packet[i] != (size & 0xff)){
+                test_channel->sdu_errors++;
+                break;
+            }
+        }
+        return;
+    }
+    if (packet_type != HCI_EVENT_PACKET) return;
+    switch (hci_event_packet_get_type(packet)){
+        case L2CAP_EVENT_LE_CHANNEL_OPENED:
+            test_channel->opened = 1;
+            test_channel->status = l2cap_event_le_channel_opened_get_status(packet);
+            test_channel->cid    = l2cap_event_le_channel_opened_get_local_cid(packet);
+            break;
+        case L2CAP_EVENT_LE_PACKET_SENT:
+            test_channel->num_packets_sent++;
+            break;
+        default:
+            break;
+    }
+}
+
+static void client_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *packet, uint16_t size){
+    UNUSED(channel);
+    test_channel_handle_packet(&client, packet_type, packet, size);
+}
+
+static void server_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *packet, uint16_t size){
+    UNUSED(channel);
+    if (packet_type == HCI_EVENT_PACKET && hci_event_packet_get_type(packet) == L2CAP_EVENT_LE_INCOMING_CONNECTION){
+        uint16_t local_cid = l2cap_event_le_incoming_connection_get_local_cid(packet);
+        l2cap_le_accept_connection(local_cid, server_buffer, TEST_MTU, server_initial_credits);
+        return;
+    }
+    test_channel_handle_packet(&server, packet_type, packet, size);
+}
+
+static void connect(uint16_t initial_credits){
+    server_initial_credits = initial_credits;
+    uint16_t cid = 0;
+    uint8_t status = l2cap_le_create_channel(&client_packet_handler, TEST_HANDLE, TEST_PSM, client_buffer, TEST_MTU,
+        L2CAP_LE_AUTOMATIC_CREDITS, LEVEL_0, &cid);
+    CHECK_EQUAL(0, status);
+    loopback_pump();
+    CHECK(client.opened);
+    CHECK_EQUAL(0, client.status);
+    CHECK(server.opened);
+}
+
+static l2cap_le_channel_statistics_t get_statistics(uint16_t cid){
+    l2cap_le_channel_statistics_t statistics;
+    memset(&statistics, 0, sizeof(statistics));
+    l2cap_le_get_channel_statistics(cid, &statistics);
+    return statistics;
+}
+
+TEST_GROUP(L2CAPLEDataChannel){
+    void setup(void){
+        memset(&transport, 0, sizeof(transport));
+        transport.name = "LOOPBACK";
+        transport.register_packet_handler = &transport_register_packet_handler;
+        transport.send_packet = &transport_send_packet;
+        loopback_head = 0;
+        loopback_count = 0;
+        memset(&client, 0, sizeof(client));
+        memset(&server, 0, sizeof(server));
+
+        hci_init(&transport, NULL);
+        l2cap_init();
+        le_read_buffer_size_complete(TEST_NUM_ACL_PACKETS);
+        le_connection_complete(TEST_HANDLE);
+        l2cap_le_register_service(&server_packet_handler, TEST_PSM, LEVEL_0);
+    }
+    void teardown(void){
+        hci_close();
+    }
+};
+
+TEST(L2CAPLEDataChannel, QueueSeveralSDUs){
+    // remote only gets a single credit, so first SDU stays in progress
+    connect(1);
+    int i;
+    for (i = 0; i <= L2CAP_LE_DATA_CHANNELS_SEND_QUEUE_SIZE; i++){
+        CHECK(l2cap_le_can_send_now(client.cid));
+        CHECK_EQUAL(0, l2cap_le_send_data(client.cid, fill_sdu(i, 50 + i), 50 + i));
+    }
+    // current SDU plus full queue
+    CHECK(!l2cap_le_can_send_now(client.cid));
+    CHECK_EQUAL(BTSTACK_ACL_BUFFERS_FULL, l2cap_le_send_data(client.cid, sdus[0], 10));
+
+    l2cap_le_provide_credits(server.cid, 100);
+    loopback_pump();
+    CHECK_EQUAL(L2CAP_LE_DATA_CHANNELS_SEND_QUEUE_SIZE + 1, client.num_packets_sent);
+    CHECK_EQUAL(L2CAP_LE_DATA_CHANNELS_SEND_QUEUE_SIZE + 1, server.num_sdus);
+    CHECK_EQUAL(0, server.sdu_errors);
+    CHECK(l2cap_le_can_send_now(client.cid));
+
+    l2cap_le_channel_statistics_t statistics = get_statistics(client.cid);
+    CHECK_EQUAL(L2CAP_LE_DATA_CHANNELS_SEND_QUEUE_SIZE + 1, statistics.num_sdus_sent);
+}
+
+TEST(L2CAPLEDataChannel, AutomaticCreditsAreGrantedInBatches){
+    connect(L2CAP_LE_AUTOMATIC_CREDITS);
+    int num_sdus = 0;
+    int iterations;
+    for (iterations = 0; iterations < 10000 && num_sdus < 200; iterations++){
+        if (l2cap_le_can_send_now(client.cid)){
+            l2cap_le_send_data(client.cid, fill_sdu(0, TEST_MTU), TEST_MTU);
+            num_sdus++;
+        }
+        // link transfers one packet per ms
+        loopback_pump_one();
+        time_ms++;
+    }
+    loopback_pump();
+    CHECK_EQUAL(200, server.num_sdus);
+    CHECK_EQUAL(0, server.sdu_errors);
+
+    // 5 PDUs per SDU, each grant covers several of them
+    l2cap_le_channel_statistics_t statistics = get_statistics(server.cid);
+    CHECK(statistics.num_credit_grants > 0);
+    CHECK(statistics.num_credit_grants * 4 < 200 * 5);
+    // target has grown with consumption
+    CHECK(statistics.automatic_credits_target > 5);
+    CHECK(statistics.automatic_credits_target <= 32);
+}
+
+TEST(L2CAPLEDataChannel, AutomaticCreditsFollowConsumption){
+    connect(L2CAP_LE_AUTOMATIC_CREDITS);
+    // burst, link transfers one packet per ms
+    int i;
+    for (i = 0; i < 1000; i++){
+        if (l2cap_le_can_send_now(client.cid)){
+            l2cap_le_send_data(client.cid, fill_sdu(0, TEST_MTU), TEST_MTU);
+        }
+        loopback_pump_one();
+        time_ms++;
+    }
+    loopback_pump();
+    uint16_t burst_target = get_statistics(server.cid).automatic_credits_target;
+
+    // a single small SDU every 200 ms
+    for (i = 0; i < 20; i++){
+        time_ms += 200;
+        l2cap_le_send_data(client.cid, fill_sdu(0, 10), 10);
+        loopback_pump();
+    }
+    uint16_t idle_target = get_statistics(server.cid).automatic_credits_target;
+    CHECK(idle_target < burst_target);
+    // still enough credits for a complete SDU of MTU size
+    CHECK(idle_target >= (TEST_MTU + 2 + 22) / 23);
+}
+
+TEST(L2CAPLEDataChannel, CreditStarvationAndLatency){
+    // remote only gets a single credit
+    connect(1);
+    time_ms = 1000;
+    CHECK_EQUAL(0, l2cap_le_send_data(client.cid, fill_sdu(0, 60), 60));
+    loopback_pump();
+    CHECK_EQUAL(0, server.num_sdus);
+
+    time_ms += 150;
+    l2cap_le_channel_statistics_t statistics = get_statistics(client.cid);
+    CHECK_EQUAL(150, statistics.credit_starvation_ms);
+
+    l2cap_le_provide_credits(server.cid, 5);
+    loopback_pump();
+    CHECK_EQUAL(1, server.num_sdus);
+
+    statistics = get_statistics(client.cid);
+    CHECK_EQUAL(150, statistics.credit_starvation_ms);
+    CHECK_EQUAL(1, statistics.num_sdus_sent);
+    CHECK_EQUAL(150, statistics.sdu_latency_max_ms);
+    CHECK_EQUAL(150, statistics.sdu_latency_total_ms);
+    // credits are managed by application
+    CHECK_EQUAL(0, get_statistics(server.cid).automatic_credits_target);
+}
+
+int main (int argc, const char * argv[]){
+    btstack_memory_init();
+    btstack_run_loop_init(btstack_run_loop_embedded_get_instance());
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
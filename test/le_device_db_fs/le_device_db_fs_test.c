@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "CppUTest/TestHarness.h"
+#include "CppUTest/CommandLineTestRunner.h"
+
+#include "ble/le_device_db.h"
+#include "btstack_run_loop.h"
+#include "btstack_util.h"
+
+#include "btstack_config.h"
+
+// run loop mock: flush timer gets triggered by test
+static btstack_timer_source_t * pending_timer;
+
+extern "C" uint32_t btstack_run_loop_get_time_ms(void) { return 0; }
+extern "C" void btstack_run_loop_set_timer(btstack_timer_source_t * ts, uint32_t timeout_in_ms){
+    UNUSED(ts);
+    UNUSED(timeout_in_ms);
+}
+extern "C" void btstack_run_loop_set_timer_handler(btstack_timer_source_t * ts, void (*process)(btstack_timer_source_t *_ts)){
+    ts->process = process;
+}
+extern "C" void btstack_run_loop_add_timer(btstack_timer_source_t * ts){
+    pending_timer = ts;
+}
+extern "C" int btstack_run_loop_remove_timer(btstack_timer_source_t * ts){
+    if (pending_timer != ts) return 0;
+    pending_timer = NULL;
+    return 1;
+}
+
+static void fire_timer(void){
+    btstack_timer_source_t * ts = pending_timer;
+    pending_timer = NULL;
+    if (ts) ts->process(ts);
+}
+
+#define DB_PATH "/tmp/btstack_at_00-1B-DC-07-32-EF_le_device_db.bin"
+
+static bd_addr_t local_addr = { 0x00, 0x1b, 0xdc, 0x07, 0x32, 0xef };
+static bd_addr_t remote_addr = { 0x11, 0x22, 0x33, 0x44, 0x55, 0x66 };
+
+static void reload(void){
+    le_device_db_init();
+    le_device_db_set_local_bd_addr(local_addr);
+}
+
+TEST_GROUP(LEDeviceDBFS){
+    sm_key_t irk;
+    sm_key_t ltk;
+    sm_key_t csrk;
+
+    void setup(void){
+        unlink(DB_PATH);
+        pending_timer = NULL;
+        int i;
+        for (i=0;i<16;i++){
+            irk[i]  = i;
+            ltk[i]  = 0x10 + i;
+            csrk[i] = 0x20 + i;
+        }
+        reload();
+    }
+
+    void teardown(void){
+        le_device_db_init();
+        unlink(DB_PATH);
+    }
+};
+
+TEST(LEDeviceDBFS, AddPersists){
+    int index = le_device_db_add(BD_ADDR_TYPE_LE_PUBLIC, remote_addr, irk);
+    CHECK(index >= 0);
+    uint8_t rand[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+    le_device_db_encryption_set(index, 0x1234, rand, ltk, 16, 1, 0);
+    le_device_db_remote_csrk_set(index, csrk);
+    reload();
+
+    CHECK_EQUAL(1, le_device_db_count());
+    int addr_type;
+    bd_addr_t addr;
+    sm_key_t test_key;
+    le_device_db_info(index, &addr_type, addr, test_key);
+    CHECK_EQUAL(BD_ADDR_TYPE_LE_PUBLIC, addr_type);
+    MEMCMP_EQUAL(remote_addr, addr, 6);
+    MEMCMP_EQUAL(irk, test_key, 16);
+
+    uint16_t ediv;
+    uint8_t test_rand[8];
+    int key_size, authenticated, authorized;
+    le_device_db_encryption_get(index, &ediv, test_rand, test_key, &key_size, &authenticated, &authorized);
+    CHECK_EQUAL(0x1234, ediv);
+    MEMCMP_EQUAL(rand, test_rand, 8);
+    MEMCMP_EQUAL(ltk, test_key, 16);
+    CHECK_EQUAL(16, key_size);
+    CHECK_EQUAL(1, authenticated);
+    CHECK_EQUAL(0, authorized);
+
+    le_device_db_remote_csrk_get(index, test_key);
+    MEMCMP_EQUAL(csrk, test_key, 16);
+}
+
+TEST(LEDeviceDBFS, RemovePersists){
+    int index = le_device_db_add(BD_ADDR_TYPE_LE_PUBLIC, remote_addr, irk);
+    le_device_db_remove(index);
+    reload();
+    CHECK_EQUAL(0, le_device_db_count());
+}
+
+TEST(LEDeviceDBFS, CounterUpdatesDeferred){
+    int index = le_device_db_add(BD_ADDR_TYPE_LE_PUBLIC, remote_addr, irk);
+    int i;
+    for (i=1;i<=100;i++){
+        le_device_db_remote_counter_set(index, i);
+        le_device_db_local_counter_set(index, 2*i);
+    }
+    CHECK(pending_timer != NULL);
+    fire_timer();
+    reload();
+    CHECK_EQUAL(100, le_device_db_remote_counter_get(index));
+    CHECK_EQUAL(200, le_device_db_local_counter_get(index));
+}
+
+TEST(LEDeviceDBFS, CounterFlushedOnInit){
+    int index = le_device_db_add(BD_ADDR_TYPE_LE_PUBLIC, remote_addr, irk);
+    le_device_db_remote_counter_set(index, 5);
+    reload();
+    CHECK(pending_timer == NULL);
+    CHECK_EQUAL(5, le_device_db_remote_counter_get(index));
+}
+
+TEST(LEDeviceDBFS, CorruptRecordFallsBackToPrevious){
+    int index = le_device_db_add(BD_ADDR_TYPE_LE_PUBLIC, remote_addr, irk);
+    le_device_db_remote_counter_set(index, 1);
+    fire_timer();
+    le_device_db_remote_counter_set(index, 2);
+    fire_timer();
+    le_device_db_init();
+
+    // corrupt most recent record of device: sequence number 3 is stored in second slot
+    int fd = open(DB_PATH, O_RDWR);
+    CHECK(fd >= 0);
+    uint8_t garbage = 0x55;
+    CHECK_EQUAL(1, pwrite(fd, &garbage, 1, 8 + (index * 2 + 1) * 100 + 50));
+    close(fd);
+
+    le_device_db_set_local_bd_addr(local_addr);
+    CHECK_EQUAL(1, le_device_db_count());
+    CHECK_EQUAL(1, le_device_db_remote_counter_get(index));
+}
+
+TEST(LEDeviceDBFS, InvalidFileIgnored){
+    le_device_db_init();
+    FILE * file = fopen(DB_PATH, "w");
+    fputs("# addr_type, addr, irk, ltk\n", file);
+    fclose(file);
+    le_device_db_set_local_bd_addr(local_addr);
+    CHECK_EQUAL(0, le_device_db_count());
+    int index = le_device_db_add(BD_ADDR_TYPE_LE_PUBLIC, remote_addr, irk);
+    CHECK(index >= 0);
+    reload();
+    CHECK_EQUAL(1, le_device_db_count());
+}
+
+int main (int argc, const char * argv[]){
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2016 BlueKitchen GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 4. Any redistribution, use, or modification is done solely for
+ *    personal benefit and not for any commercial purpose or for
+ *    monetary gain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BLUEKITCHEN GMBH AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MATTHIAS
+ * RINGWALD OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Please inquire about commercial licensing options at 
+ * contact@bluekitchen-gmbh.com
+ *
+ */
+
+#include "CppUTest/TestHarness.h"
+#include "CppUTest/CommandLineTestRunner.h"
+
+#include "btstack_memory_pool.h"
+
+#define NUM_BLOCKS 4
+
+typedef struct {
+    void * item;
+    uint32_t data[4];
+} test_block_t;
+
+static test_block_t storage[NUM_BLOCKS];
+static uint8_t      small_storage[NUM_BLOCKS][sizeof(void *)];
+
+TEST_GROUP(MemoryPool){
+    btstack_memory_pool_t pool;
+    btstack_memory_pool_statistics_t statistics;
+
+    void setup(void){
+        btstack_memory_pool_create(&pool, storage, NUM_BLOCKS, sizeof(test_block_t));
+    }
+};
+
+TEST(MemoryPool, GetAll){
+    int i;
+    for (i = 0; i < NUM_BLOCKS; i++){
+        CHECK(btstack_memory_pool_get(&pool) != NULL);
+    }
+    POINTERS_EQUAL(NULL, btstack_memory_pool_get(&pool));
+}
+
+TEST(MemoryPool, DoubleFree){
+    void * block_a = btstack_memory_pool_get(&pool);
+    void * block_b = btstack_memory_pool_get(&pool);
+    btstack_memory_pool_free(&pool, block_a);
+    btstack_memory_pool_free(&pool, block_a);
+    btstack_memory_pool_free(&pool, block_b);
+    // only NUM_BLOCKS blocks available
+    int i;
+    for (i = 0; i < NUM_BLOCKS; i++){
+        CHECK(btstack_memory_pool_get(&pool) != NULL);
+    }
+    POINTERS_EQUAL(NULL, btstack_memory_pool_get(&pool));
+}
+
+TEST(MemoryPool, FreeOfAllocatedBlockWithTagContent){
+    // allocated block may contain the free tag by chance
+    test_block_t * block_a = (test_block_t *) btstack_memory_pool_get(&pool);
+    test_block_t * block_b = (test_block_t *) btstack_memory_pool_get(&pool);
+    memcpy(block_a, block_b, sizeof(test_block_t));
+    btstack_memory_pool_free(&pool, block_b);
+    memcpy(block_a, block_b, sizeof(test_block_t));
+    btstack_memory_pool_free(&pool, block_a);
+    btstack_memory_pool_get_statistics(&pool, &statistics);
+    CHECK_EQUAL(0, statistics.blocks_used);
+}
+
+TEST(MemoryPool, ForeignBlock){
+    test_block_t foreign;
+    btstack_memory_pool_free(&pool, &foreign);
+    btstack_memory_pool_free(&pool, ((uint8_t *) &storage[1]) + 1);
+    btstack_memory_pool_get_statistics(&pool, &statistics);
+    CHECK_EQUAL(0, statistics.blocks_used);
+    int i;
+    for (i = 0; i < NUM_BLOCKS; i++){
+        void * block = btstack_memory_pool_get(&pool);
+        CHECK(block >= (void *) &storage[0] && block < (void *) &storage[NUM_BLOCKS]);
+    }
+    POINTERS_EQUAL(NULL, btstack_memory_pool_get(&pool));
+}
+
+TEST(MemoryPool, Statistics){
+    void * block_a = btstack_memory_pool_get(&pool);
+    void * block_b = btstack_memory_pool_get(&pool);
+    void * block_c = btstack_memory_pool_get(&pool);
+    btstack_memory_pool_free(&pool, block_b);
+    btstack_memory_pool_get_statistics(&pool, &statistics);
+    CHECK_EQUAL(NUM_BLOCKS, statistics.blocks_total);
+    CHECK_EQUAL(2, statistics.blocks_used);
+    CHECK_EQUAL(3, statistics.blocks_used_max);
+    CHECK_EQUAL(0, statistics.failed_gets);
+    btstack_memory_pool_get(&pool);
+    btstack_memory_pool_get(&pool);
+    btstack_memory_pool_get(&pool);
+    btstack_memory_pool_get_statistics(&pool, &statistics);
+    CHECK_EQUAL(NUM_BLOCKS, statistics.blocks_used);
+    CHECK_EQUAL(NUM_BLOCKS, statistics.blocks_used_max);
+    CHECK_EQUAL(1, statistics.failed_gets);
+    btstack_memory_pool_free(&pool, block_a);
+    btstack_memory_pool_free(&pool, block_c);
+    btstack_memory_pool_get_statistics(&pool, &statistics);
+    CHECK_EQUAL(NUM_BLOCKS - 2, statistics.blocks_used);
+}
+
+TEST(MemoryPool, SmallBlocks){
+    // blocks without space for tag fall back to list walk
+    btstack_memory_pool_t small_pool;
+    btstack_memory_pool_create(&small_pool, small_storage, NUM_BLOCKS, sizeof(void *));
+    void * block = btstack_memory_pool_get(&small_pool);
+    btstack_memory_pool_free(&small_pool, block);
+    btstack_memory_pool_free(&small_pool, block);
+    btstack_memory_pool_get_statistics(&small_pool, &statistics);
+    CHECK_EQUAL(0, statistics.blocks_used);
+    CHECK_EQUAL(1, statistics.blocks_used_max);
+}
+
+int main (int argc, const char * argv[]){
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
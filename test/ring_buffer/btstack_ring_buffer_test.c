@@ -1,5 +1,7 @@
 #include "CppUTest/TestHarness.h"
 #include "CppUTest/CommandLineTestRunner.h"
+#include <stdlib.h>
+
 #include "btstack_ring_buffer.h"
 
 static  uint8_t storage[10];
@@ -88,6 +90,127 @@ TEST(RingBuffer, ReadWriteChunks){
     }
 }
 
+TEST(RingBuffer, WrapAround){
+    uint8_t test_write_data[] = {1,2,3,4,5,6,7};
+    uint8_t test_read_data[7];
+    uint32_t number_of_bytes_read = 0;
+    // move positions to the middle of the storage
+    btstack_ring_buffer_write(&ring_buffer, test_write_data, 6);
+    btstack_ring_buffer_read(&ring_buffer, test_read_data, 6, &number_of_bytes_read);
+    CHECK_TRUE(btstack_ring_buffer_empty(&ring_buffer));
+    CHECK_EQUAL(0, btstack_ring_buffer_write(&ring_buffer, test_write_data, 7));
+    CHECK_EQUAL(7, btstack_ring_buffer_bytes_available(&ring_buffer));
+    CHECK_EQUAL(3, btstack_ring_buffer_bytes_free(&ring_buffer));
+    btstack_ring_buffer_read(&ring_buffer, test_read_data, 10, &number_of_bytes_read);
+    CHECK_EQUAL(7, number_of_bytes_read);
+    CHECK_EQUAL(0, memcmp(test_write_data, test_read_data, 7));
+}
+
+TEST(RingBuffer, WriteTooMuch){
+    uint8_t test_write_data[11];
+    memset(test_write_data, 0, sizeof(test_write_data));
+    CHECK_EQUAL(0x07, btstack_ring_buffer_write(&ring_buffer, test_write_data, 11));
+    CHECK_EQUAL(0, btstack_ring_buffer_write(&ring_buffer, test_write_data, 10));
+    CHECK_EQUAL(0, btstack_ring_buffer_bytes_free(&ring_buffer));
+    CHECK_FALSE(btstack_ring_buffer_empty(&ring_buffer));
+    CHECK_EQUAL(0x07, btstack_ring_buffer_write(&ring_buffer, test_write_data, 1));
+}
+
+TEST(RingBuffer, Spans){
+    uint8_t * span;
+    uint32_t number_of_bytes_read = 0;
+    uint8_t test_read_data[10];
+    // empty
+    CHECK_EQUAL(0, btstack_ring_buffer_peek_read(&ring_buffer, &span));
+    CHECK_EQUAL(10, btstack_ring_buffer_peek_write(&ring_buffer, &span));
+    // write 8 in place
+    memset(span, 0x55, 8);
+    btstack_ring_buffer_commit_write(&ring_buffer, 8);
+    CHECK_EQUAL(8, btstack_ring_buffer_peek_read(&ring_buffer, &span));
+    POINTERS_EQUAL(storage, span);
+    btstack_ring_buffer_commit_read(&ring_buffer, 6);
+    // free space wraps: 2 at the end, 6 at the start
+    CHECK_EQUAL(8, btstack_ring_buffer_bytes_free(&ring_buffer));
+    CHECK_EQUAL(2, btstack_ring_buffer_peek_write(&ring_buffer, &span));
+    POINTERS_EQUAL(&storage[8], span);
+    memset(span, 0x66, 2);
+    btstack_ring_buffer_commit_write(&ring_buffer, 2);
+    CHECK_EQUAL(6, btstack_ring_buffer_peek_write(&ring_buffer, &span));
+    POINTERS_EQUAL(storage, span);
+    memset(span, 0x77, 6);
+    btstack_ring_buffer_commit_write(&ring_buffer, 6);
+    CHECK_EQUAL(0, btstack_ring_buffer_bytes_free(&ring_buffer));
+    CHECK_EQUAL(4, btstack_ring_buffer_peek_read(&ring_buffer, &span));
+    btstack_ring_buffer_read(&ring_buffer, test_read_data, 10, &number_of_bytes_read);
+    CHECK_EQUAL(10, number_of_bytes_read);
+    const uint8_t expected[] = {0x55, 0x55, 0x66, 0x66, 0x77, 0x77, 0x77, 0x77, 0x77, 0x77};
+    CHECK_EQUAL(0, memcmp(expected, test_read_data, 10));
+}
+
+static void check_random_read_write(btstack_ring_buffer_t * ring_buffer, int size){
+    uint8_t write_data[64];
+    uint8_t read_data[64];
+    uint8_t next_write = 0;
+    uint8_t next_read  = 0;
+    int available = 0;
+    int i, j;
+    srand(size);
+    for (i = 0; i < 10000; i++){
+        int len = rand() % (size + 1);
+        if (rand() & 1){
+            for (j = 0; j < len; j++){
+                write_data[j] = next_write + j;
+            }
+            int status = btstack_ring_buffer_write(ring_buffer, write_data, len);
+            if (available + len > size){
+                CHECK_EQUAL(0x07, status);
+            } else {
+                CHECK_EQUAL(0, status);
+                next_write += len;
+                available  += len;
+            }
+        } else {
+            uint32_t number_of_bytes_read;
+            btstack_ring_buffer_read(ring_buffer, read_data, len, &number_of_bytes_read);
+            CHECK_EQUAL(len < available ? len : available, (int) number_of_bytes_read);
+            for (j = 0; j < (int) number_of_bytes_read; j++){
+                CHECK_EQUAL((uint8_t)(next_read + j), read_data[j]);
+            }
+            next_read += number_of_bytes_read;
+            available -= number_of_bytes_read;
+        }
+        CHECK_EQUAL(available, btstack_ring_buffer_bytes_available(ring_buffer));
+        CHECK_EQUAL(size - available, btstack_ring_buffer_bytes_free(ring_buffer));
+    }
+}
+
+TEST(RingBuffer, RandomReadWrite){
+    check_random_read_write(&ring_buffer, storage_size);
+}
+
+static uint8_t storage_power_of_two[16];
+
+TEST_GROUP(RingBufferPowerOfTwo){
+    btstack_ring_buffer_t ring_buffer;
+
+    void setup(void){
+        btstack_ring_buffer_init(&ring_buffer, storage_power_of_two, sizeof(storage_power_of_two));
+    }
+};
+
+TEST(RingBufferPowerOfTwo, Full){
+    uint8_t test_write_data[16];
+    memset(test_write_data, 0x42, sizeof(test_write_data));
+    CHECK_EQUAL(0, btstack_ring_buffer_write(&ring_buffer, test_write_data, 16));
+    CHECK_EQUAL(16, btstack_ring_buffer_bytes_available(&ring_buffer));
+    CHECK_EQUAL(0, btstack_ring_buffer_bytes_free(&ring_buffer));
+    CHECK_FALSE(btstack_ring_buffer_empty(&ring_buffer));
+}
+
+TEST(RingBufferPowerOfTwo, RandomReadWrite){
+    check_random_read_write(&ring_buffer, sizeof(storage_power_of_two));
+}
+
 int main (int argc, const char * argv[]){
     return CommandLineTestRunner::RunAllTests(argc, argv);
 }
\ No newline at end of file
@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2016 BlueKitchen GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 4. Any redistribution, use, or modification is done solely for
+ *    personal benefit and not for any commercial purpose or for
+ *    monetary gain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BLUEKITCHEN GMBH AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MATTHIAS
+ * RINGWALD OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Please inquire about commercial licensing options at 
+ * contact@bluekitchen-gmbh.com
+ *
+ */
+
+#include "CppUTest/TestHarness.h"
+#include "CppUTest/CommandLineTestRunner.h"
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "btstack_callback_queue.h"
+#include "bluetooth.h"
+
+#define NUM_ENTRIES 16
+#define NUM_PRODUCERS 4
+#define NUM_ITEMS_PER_PRODUCER 100000
+
+static btstack_callback_queue_entry_t entries[NUM_ENTRIES];
+
+static void callback_a(void * context){ (void) context; }
+static void callback_b(void * context){ (void) context; }
+
+TEST_GROUP(CallbackQueue){
+    btstack_callback_queue_t callback_queue;
+
+    void setup(void){
+        btstack_callback_queue_init(&callback_queue, entries, NUM_ENTRIES);
+    }
+};
+
+TEST(CallbackQueue, Empty){
+    void (*callback)(void * context);
+    void * context;
+    CHECK_EQUAL(0, btstack_callback_queue_get(&callback_queue, &callback, &context));
+}
+
+TEST(CallbackQueue, FIFO){
+    void (*callback)(void * context);
+    void * context;
+    int values[2];
+    CHECK_EQUAL(0, btstack_callback_queue_add(&callback_queue, &callback_a, &values[0]));
+    CHECK_EQUAL(0, btstack_callback_queue_add(&callback_queue, &callback_b, &values[1]));
+    CHECK_EQUAL(1, btstack_callback_queue_get(&callback_queue, &callback, &context));
+    POINTERS_EQUAL((void *) &callback_a, (void *) callback);
+    POINTERS_EQUAL(&values[0], context);
+    CHECK_EQUAL(1, btstack_callback_queue_get(&callback_queue, &callback, &context));
+    POINTERS_EQUAL((void *) &callback_b, (void *) callback);
+    POINTERS_EQUAL(&values[1], context);
+    CHECK_EQUAL(0, btstack_callback_queue_get(&callback_queue, &callback, &context));
+}
+
+TEST(CallbackQueue, Full){
+    void (*callback)(void * context);
+    void * context;
+    int round, i;
+    for (round = 0; round < 3; round++){
+        for (i = 0; i < NUM_ENTRIES; i++){
+            CHECK_EQUAL(0, btstack_callback_queue_add(&callback_queue, &callback_a, (void *)(intptr_t) i));
+        }
+        CHECK_EQUAL(ERROR_CODE_MEMORY_CAPACITY_EXCEEDED, btstack_callback_queue_add(&callback_queue, &callback_a, NULL));
+        for (i = 0; i < NUM_ENTRIES; i++){
+            CHECK_EQUAL(1, btstack_callback_queue_get(&callback_queue, &callback, &context));
+            CHECK_EQUAL(i, (int)(intptr_t) context);
+        }
+        CHECK_EQUAL(0, btstack_callback_queue_get(&callback_queue, &callback, &context));
+    }
+}
+
+static btstack_callback_queue_t * shared_queue;
+
+static void * producer_thread(void * arg){
+    uintptr_t producer = (uintptr_t) arg;
+    uintptr_t i;
+    for (i = 0; i < NUM_ITEMS_PER_PRODUCER; i++){
+        uintptr_t value = (producer << 24) | i;
+        while (btstack_callback_queue_add(shared_queue, &callback_a, (void *) value)){
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+TEST(CallbackQueue, MultipleProducers){
+    pthread_t threads[NUM_PRODUCERS];
+    uintptr_t next_item[NUM_PRODUCERS];
+    uintptr_t i;
+    shared_queue = &callback_queue;
+    for (i = 0; i < NUM_PRODUCERS; i++){
+        next_item[i] = 0;
+        pthread_create(&threads[i], NULL, &producer_thread, (void *) i);
+    }
+    int received = 0;
+    while (received < NUM_PRODUCERS * NUM_ITEMS_PER_PRODUCER){
+        void (*callback)(void * context);
+        void * context;
+        if (!btstack_callback_queue_get(&callback_queue, &callback, &context)) continue;
+        uintptr_t value = (uintptr_t) context;
+        uintptr_t producer = value >> 24;
+        // items of each producer are received in order
+        CHECK_TRUE(producer < NUM_PRODUCERS);
+        CHECK_EQUAL(next_item[producer], value & 0xffffff);
+        next_item[producer]++;
+        received++;
+    }
+    for (i = 0; i < NUM_PRODUCERS; i++){
+        pthread_join(threads[i], NULL);
+    }
+}
+
+int main (int argc, const char * argv[]){
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
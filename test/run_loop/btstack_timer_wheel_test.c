@@ -0,0 +1,117 @@
+#include "CppUTest/TestHarness.h"
+#include "CppUTest/CommandLineTestRunner.h"
+
+#include <stdlib.h>
+
+#include "btstack_timer_wheel.h"
+
+#define NUM_TIMERS 1000
+
+static btstack_timer_source_t timers[NUM_TIMERS];
+
+TEST_GROUP(TimerWheel){
+    btstack_timer_wheel_t timer_wheel;
+
+    void setup(void){
+        memset(timers, 0, sizeof(timers));
+        btstack_timer_wheel_init(&timer_wheel, 1000);
+    }
+};
+
+TEST(TimerWheel, Empty){
+    CHECK_TRUE(btstack_timer_wheel_empty(&timer_wheel));
+    CHECK_EQUAL(-1, btstack_timer_wheel_get_time_until_next(&timer_wheel, 1000));
+    POINTERS_EQUAL(NULL, btstack_timer_wheel_get_expired(&timer_wheel, 5000));
+}
+
+TEST(TimerWheel, SingleTimer){
+    timers[0].timeout = 1100;
+    btstack_timer_wheel_add(&timer_wheel, &timers[0]);
+    CHECK_FALSE(btstack_timer_wheel_empty(&timer_wheel));
+    int32_t delta = btstack_timer_wheel_get_time_until_next(&timer_wheel, 1000);
+    CHECK_TRUE(delta >= 0 && delta <= 100);
+    POINTERS_EQUAL(NULL, btstack_timer_wheel_get_expired(&timer_wheel, 1099));
+    CHECK_EQUAL(1, btstack_timer_wheel_get_time_until_next(&timer_wheel, 1099));
+    POINTERS_EQUAL(&timers[0], btstack_timer_wheel_get_expired(&timer_wheel, 1100));
+    POINTERS_EQUAL(NULL, btstack_timer_wheel_get_expired(&timer_wheel, 1100));
+    CHECK_TRUE(btstack_timer_wheel_empty(&timer_wheel));
+}
+
+TEST(TimerWheel, Remove){
+    timers[0].timeout = 1100;
+    timers[1].timeout = 200000;
+    btstack_timer_wheel_add(&timer_wheel, &timers[0]);
+    btstack_timer_wheel_add(&timer_wheel, &timers[1]);
+    CHECK_EQUAL(0, btstack_timer_wheel_remove(&timer_wheel, &timers[0]));
+    CHECK_EQUAL(-1, btstack_timer_wheel_remove(&timer_wheel, &timers[0]));
+    CHECK_EQUAL(0, btstack_timer_wheel_remove(&timer_wheel, &timers[1]));
+    CHECK_TRUE(btstack_timer_wheel_empty(&timer_wheel));
+    POINTERS_EQUAL(NULL, btstack_timer_wheel_get_expired(&timer_wheel, 300000));
+}
+
+TEST(TimerWheel, Rearm){
+    timers[0].timeout = 1100;
+    btstack_timer_wheel_add(&timer_wheel, &timers[0]);
+    timers[0].timeout = 5000;
+    btstack_timer_wheel_add(&timer_wheel, &timers[0]);
+    POINTERS_EQUAL(NULL, btstack_timer_wheel_get_expired(&timer_wheel, 4999));
+    POINTERS_EQUAL(&timers[0], btstack_timer_wheel_get_expired(&timer_wheel, 5000));
+    CHECK_TRUE(btstack_timer_wheel_empty(&timer_wheel));
+}
+
+TEST(TimerWheel, AlreadyExpired){
+    POINTERS_EQUAL(NULL, btstack_timer_wheel_get_expired(&timer_wheel, 2000));
+    timers[0].timeout = 1500;
+    btstack_timer_wheel_add(&timer_wheel, &timers[0]);
+    CHECK_EQUAL(0, btstack_timer_wheel_get_time_until_next(&timer_wheel, 2000));
+    POINTERS_EQUAL(&timers[0], btstack_timer_wheel_get_expired(&timer_wheel, 2000));
+}
+
+static void check_random_timers(btstack_timer_wheel_t * timer_wheel, uint32_t start, uint32_t max_timeout, uint32_t max_step){
+    int i;
+    int num_expired = 0;
+    for (i = 0; i < NUM_TIMERS; i++){
+        timers[i].timeout = start + 1 + (rand() % max_timeout);
+        btstack_timer_wheel_add(timer_wheel, &timers[i]);
+    }
+    // remove every 10th timer
+    for (i = 0; i < NUM_TIMERS; i += 10){
+        CHECK_EQUAL(0, btstack_timer_wheel_remove(timer_wheel, &timers[i]));
+    }
+    uint32_t last = start;
+    uint32_t now  = start;
+    while (num_expired < NUM_TIMERS - NUM_TIMERS / 10){
+        int32_t delta = btstack_timer_wheel_get_time_until_next(timer_wheel, now);
+        CHECK_TRUE(delta >= 0);
+        uint32_t step = 1 + (rand() % max_step);
+        if (step > (uint32_t) delta) step = delta;
+        last = now;
+        now += step;
+        btstack_timer_source_t * ts;
+        while ((ts = btstack_timer_wheel_get_expired(timer_wheel, now)) != NULL){
+            // not early, not late
+            CHECK_TRUE((int32_t)(ts->timeout - now) <= 0);
+            CHECK_TRUE((int32_t)(ts->timeout - last) > 0);
+            CHECK_TRUE(((ts - timers) % 10) != 0);
+            num_expired++;
+        }
+    }
+    CHECK_TRUE(btstack_timer_wheel_empty(timer_wheel));
+}
+
+TEST(TimerWheel, RandomShort){
+    check_random_timers(&timer_wheel, 1000, 5000, 10);
+}
+
+TEST(TimerWheel, RandomLong){
+    check_random_timers(&timer_wheel, 1000, 100000000, 100000);
+}
+
+TEST(TimerWheel, WrapAround){
+    btstack_timer_wheel_init(&timer_wheel, 0xffff0000);
+    check_random_timers(&timer_wheel, 0xffff0000, 0x20000, 100);
+}
+
+int main (int argc, const char * argv[]){
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
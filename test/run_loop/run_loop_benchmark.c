@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2016 BlueKitchen GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 4. Any redistribution, use, or modification is done solely for
+ *    personal benefit and not for any commercial purpose or for
+ *    monetary gain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BLUEKITCHEN GMBH AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MATTHIAS
+ * RINGWALD OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Please inquire about commercial licensing options at 
+ * contact@bluekitchen-gmbh.com
+ *
+ */
+
+// *****************************************************************************
+//
+// Run loop benchmark: compare select() based POSIX run loop against epoll
+//
+// For each configuration, N data sources are registered for read. N-1 of them
+// are idle, one is a pipe that gets a single byte written in its own callback
+// (ping). The time per wakeup is measured over a fixed number of iterations.
+// Each configuration runs in a forked child as a run loop can only be initialized once.
+//
+// *****************************************************************************
+
+#include "btstack_config.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/select.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#include "btstack_run_loop.h"
+#include "btstack_run_loop_posix.h"
+#include "btstack_run_loop_epoll.h"
+
+#define NUM_ITERATIONS 100000
+
+static btstack_data_source_t * data_sources;
+static int ping_fds[2];
+static int num_iterations;
+static struct timeval start_tv;
+static const char * run_loop_name;
+static int num_sources;
+
+static void ping(void){
+    uint8_t byte = 0;
+    if (write(ping_fds[1], &byte, 1) != 1){
+        printf("write failed\n");
+        exit(1);
+    }
+}
+
+static void idle_handler(btstack_data_source_t * ds, btstack_data_source_callback_type_t callback_type){
+    printf("idle data source %d got callback\n", ds->fd);
+    exit(1);
+}
+
+static void ping_handler(btstack_data_source_t * ds, btstack_data_source_callback_type_t callback_type){
+    uint8_t byte;
+    if (read(ds->fd, &byte, 1) != 1){
+        printf("read failed\n");
+        exit(1);
+    }
+    num_iterations++;
+    if (num_iterations < NUM_ITERATIONS){
+        ping();
+        return;
+    }
+    struct timeval end_tv;
+    gettimeofday(&end_tv, NULL);
+    double duration_us = (end_tv.tv_sec - start_tv.tv_sec) * 1000000.0 + (end_tv.tv_usec - start_tv.tv_usec);
+    printf("%-6s %5u sources: %8.3f us per wakeup\n", run_loop_name, num_sources, duration_us / NUM_ITERATIONS);
+    exit(0);
+}
+
+static void run_benchmark(const btstack_run_loop_t * run_loop){
+    // idle sources are dups of a single pipe that never gets written
+    int idle_fds[2];
+    if (pipe(idle_fds) || pipe(ping_fds)){
+        printf("pipe failed\n");
+        exit(1);
+    }
+
+    btstack_run_loop_init(run_loop);
+
+    data_sources = calloc(num_sources, sizeof(btstack_data_source_t));
+    int i;
+    for (i = 0; i < num_sources; i++){
+        btstack_data_source_t * ds = &data_sources[i];
+        if (i == 0){
+            btstack_run_loop_set_data_source_fd(ds, ping_fds[0]);
+            btstack_run_loop_set_data_source_handler(ds, &ping_handler);
+        } else {
+            int fd = dup(idle_fds[0]);
+            if (fd < 0){
+                printf("dup failed\n");
+                exit(1);
+            }
+            btstack_run_loop_set_data_source_fd(ds, fd);
+            btstack_run_loop_set_data_source_handler(ds, &idle_handler);
+        }
+        btstack_run_loop_enable_data_source_callbacks(ds, DATA_SOURCE_CALLBACK_READ);
+        btstack_run_loop_add_data_source(ds);
+        if (run_loop == btstack_run_loop_posix_get_instance() && ds->fd >= FD_SETSIZE){
+            printf("%-6s %5u sources: n/a, exceeds FD_SETSIZE\n", run_loop_name, num_sources);
+            exit(0);
+        }
+    }
+
+    gettimeofday(&start_tv, NULL);
+    ping();
+    btstack_run_loop_execute();
+}
+
+int main(int argc, const char * argv[]){
+    // allow for more than 1000 file descriptors
+    struct rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+
+    const int sources[] = { 10, 100, 1000 };
+    unsigned int i;
+    for (i = 0; i < sizeof(sources) / sizeof(int); i++){
+        int loop;
+        for (loop = 0; loop < 2; loop++){
+            fflush(stdout);
+            pid_t pid = fork();
+            if (pid == 0){
+                num_sources = sources[i];
+                if (loop == 0){
+                    run_loop_name = "select";
+                    run_benchmark(btstack_run_loop_posix_get_instance());
+                } else {
+                    run_loop_name = "epoll";
+                    run_benchmark(btstack_run_loop_epoll_get_instance());
+                }
+            }
+            int status;
+            waitpid(pid, &status, 0);
+            if (!WIFEXITED(status) || WEXITSTATUS(status)) return 1;
+        }
+    }
+    return 0;
+}
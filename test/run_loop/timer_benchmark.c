@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2016 BlueKitchen GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 4. Any redistribution, use, or modification is done solely for
+ *    personal benefit and not for any commercial purpose or for
+ *    monetary gain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BLUEKITCHEN GMBH AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MATTHIAS
+ * RINGWALD OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Please inquire about commercial licensing options at 
+ * contact@bluekitchen-gmbh.com
+ *
+ */
+
+// *****************************************************************************
+//
+// Timer benchmark: churn 10k timers in a sorted linked list (as used by the
+// embedded run loop) and in the timer wheel used by the POSIX run loops
+//
+// Each operation re-arms a random timer with a random timeout of up to 30 s.
+// Every 100 operations, time advances by 1 ms and expired timers are processed.
+//
+// *****************************************************************************
+
+#include "btstack_config.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "btstack_linked_list.h"
+#include "btstack_timer_wheel.h"
+
+#define NUM_TIMERS      10000
+#define NUM_OPERATIONS  200000
+#define MAX_TIMEOUT_MS  30000
+
+static btstack_timer_source_t timers[NUM_TIMERS];
+static btstack_linked_list_t timer_list;
+static btstack_timer_wheel_t timer_wheel;
+static uint32_t now_ms;
+
+// sorted list
+static void list_add(btstack_timer_source_t * ts){
+    btstack_linked_item_t *it;
+    for (it = (btstack_linked_item_t *) &timer_list; it->next ; it = it->next){
+        if ((btstack_timer_source_t *) it->next == ts) return;
+        if (ts->timeout < ((btstack_timer_source_t *) it->next)->timeout) break;
+    }
+    ts->item.next = it->next;
+    it->next = (btstack_linked_item_t *) ts;
+}
+
+static void list_remove(btstack_timer_source_t * ts){
+    btstack_linked_list_remove(&timer_list, (btstack_linked_item_t *) ts);
+}
+
+static btstack_timer_source_t * list_get_expired(uint32_t now){
+    btstack_timer_source_t * ts = (btstack_timer_source_t *) timer_list;
+    if (!ts || ts->timeout > now) return NULL;
+    list_remove(ts);
+    return ts;
+}
+
+// timer wheel
+static void wheel_add(btstack_timer_source_t * ts){
+    btstack_timer_wheel_add(&timer_wheel, ts);
+}
+
+static void wheel_remove(btstack_timer_source_t * ts){
+    btstack_timer_wheel_remove(&timer_wheel, ts);
+}
+
+static btstack_timer_source_t * wheel_get_expired(uint32_t now){
+    return btstack_timer_wheel_get_expired(&timer_wheel, now);
+}
+
+static void run_benchmark(const char * name, void (*add)(btstack_timer_source_t * ts), void (*remove)(btstack_timer_source_t * ts),
+    btstack_timer_source_t * (*get_expired)(uint32_t now)){
+
+    int i;
+    srand(0);
+    now_ms = 1000;
+    timer_list = NULL;
+    btstack_timer_wheel_init(&timer_wheel, now_ms);
+    memset(timers, 0, sizeof(timers));
+    for (i = 0; i < NUM_TIMERS; i++){
+        timers[i].timeout = now_ms + 1 + (rand() % MAX_TIMEOUT_MS);
+        (*add)(&timers[i]);
+    }
+
+    int num_expired = 0;
+    struct timeval start_tv;
+    struct timeval end_tv;
+    gettimeofday(&start_tv, NULL);
+    for (i = 0; i < NUM_OPERATIONS; i++){
+        btstack_timer_source_t * ts = &timers[rand() % NUM_TIMERS];
+        (*remove)(ts);
+        ts->timeout = now_ms + 1 + (rand() % MAX_TIMEOUT_MS);
+        (*add)(ts);
+        if ((i % 100) == 0){
+            now_ms++;
+            while ((ts = (*get_expired)(now_ms)) != NULL){
+                // re-arm expired timer
+                ts->timeout = now_ms + 1 + (rand() % MAX_TIMEOUT_MS);
+                (*add)(ts);
+                num_expired++;
+            }
+        }
+    }
+    gettimeofday(&end_tv, NULL);
+    double duration_us = (end_tv.tv_sec - start_tv.tv_sec) * 1000000.0 + (end_tv.tv_usec - start_tv.tv_usec);
+    printf("%-12s %u timers: %8.3f us per re-arm, %u expired\n", name, NUM_TIMERS, duration_us / NUM_OPERATIONS, num_expired);
+}
+
+int main(int argc, const char * argv[]){
+    run_benchmark("sorted list", &list_add, &list_remove, &list_get_expired);
+    run_benchmark("timer wheel", &wheel_add, &wheel_remove, &wheel_get_expired);
+    return 0;
+}
@@ -0,0 +1,132 @@
+// Encodes N simultaneous mSBC streams, each with its own hfp_msbc_state_t on its own thread,
+// for N = 1, 2, 4, ... up to the number of online CPUs or the number given on the command line.
+// As the encoder keeps all state in its instance, aggregate throughput should scale linearly
+// with N as long as N does not exceed the number of cores. The output of each stream is compared
+// against a single-threaded reference encoding of the same input.
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "btstack_sbc.h"
+#include "hfp_msbc.h"
+
+#define MSBC_SAMPLES_PER_FRAME 120
+#define MSBC_STREAM_FRAME_SIZE 60
+#define NUM_INPUT_FRAMES       100
+#define NUM_FRAMES             20000
+#define MAX_STREAMS            256
+
+typedef struct {
+    int16_t pcm[NUM_INPUT_FRAMES * MSBC_SAMPLES_PER_FRAME];
+    hfp_msbc_state_t msbc_state;
+    uint32_t reference_hash;
+    uint32_t hash;
+} stream_t;
+
+static stream_t * streams[MAX_STREAMS];
+
+static uint64_t get_time_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// sawtooth with a different period per stream plus pseudo-random noise
+static void stream_init_pcm(stream_t * stream, int index){
+    uint32_t seed = 1 + index;
+    int period = 40 + 7 * index;
+    int i;
+    for (i = 0; i < NUM_INPUT_FRAMES * MSBC_SAMPLES_PER_FRAME; i++){
+        seed = seed * 1103515245 + 12345;
+        stream->pcm[i] = (int16_t) (((i % period) * 16000 / period) - 8000 + ((int16_t) (seed >> 16) >> 4));
+    }
+}
+
+// FNV-1a over the encoded stream
+static uint32_t encode_stream(stream_t * stream){
+    uint8_t frame[MSBC_STREAM_FRAME_SIZE];
+    uint32_t hash = 2166136261u;
+    hfp_msbc_init(&stream->msbc_state);
+    int i;
+    for (i = 0; i < NUM_FRAMES; i++){
+        int16_t * pcm = &stream->pcm[(i % NUM_INPUT_FRAMES) * MSBC_SAMPLES_PER_FRAME];
+        hfp_msbc_encode_audio_frame(&stream->msbc_state, pcm);
+        hfp_msbc_read_from_stream(&stream->msbc_state, frame, sizeof(frame));
+        int j;
+        for (j = 0; j < sizeof(frame); j++){
+            hash = (hash ^ frame[j]) * 16777619u;
+        }
+    }
+    return hash;
+}
+
+static void * encoder_thread(void * context){
+    stream_t * stream = (stream_t *) context;
+    stream->hash = encode_stream(stream);
+    return NULL;
+}
+
+static int run(int num_streams, double * single_stream_rate){
+    pthread_t threads[MAX_STREAMS];
+    uint64_t start = get_time_ns();
+    int i;
+    for (i = 0; i < num_streams; i++){
+        pthread_create(&threads[i], NULL, &encoder_thread, streams[i]);
+    }
+    for (i = 0; i < num_streams; i++){
+        pthread_join(threads[i], NULL);
+    }
+    uint64_t duration = get_time_ns() - start;
+
+    int errors = 0;
+    for (i = 0; i < num_streams; i++){
+        if (streams[i]->hash != streams[i]->reference_hash) errors++;
+    }
+
+    double frames_per_second = (double) num_streams * NUM_FRAMES * 1e9 / duration;
+    if (num_streams == 1){
+        *single_stream_rate = frames_per_second;
+    }
+    // mSBC frames cover 7.5 ms of audio
+    printf("%3u streams: %8.1f ms, %9.0f frames/s, %6.0fx realtime, speedup %5.2f%s\n",
+        num_streams, duration / 1e6, frames_per_second, frames_per_second * 0.0075,
+        frames_per_second / *single_stream_rate, errors ? ", OUTPUT MISMATCH" : "");
+    return errors;
+}
+
+int main(int argc, const char * argv[]){
+    int max_streams = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (argc > 1){
+        max_streams = atoi(argv[1]);
+    }
+    if (max_streams < 1) max_streams = 1;
+    if (max_streams > MAX_STREAMS) max_streams = MAX_STREAMS;
+
+    printf("mSBC encoder, %u frames per stream, %ld CPUs online\n", NUM_FRAMES, sysconf(_SC_NPROCESSORS_ONLN));
+
+    int i;
+    for (i = 0; i < max_streams; i++){
+        streams[i] = (stream_t *) malloc(sizeof(stream_t));
+        stream_init_pcm(streams[i], i);
+        streams[i]->reference_hash = encode_stream(streams[i]);
+    }
+
+    double single_stream_rate = 0;
+    int errors = 0;
+    int num_streams = 1;
+    while (1){
+        errors += run(num_streams, &single_stream_rate);
+        if (num_streams == max_streams) break;
+        num_streams *= 2;
+        if (num_streams > max_streams) num_streams = max_streams;
+    }
+
+    for (i = 0; i < max_streams; i++){
+        free(streams[i]);
+    }
+    return errors ? 1 : 0;
+}
@@ -58,6 +58,7 @@
 
 static int16_t read_buffer[8*16*2];
 static uint8_t output_buffer[24];
+static hfp_msbc_state_t msbc_state;
 
 int main (int argc, const char * argv[]){
     if (argc < 3){
@@ -79,18 +80,18 @@ int main (int argc, const char * argv[]){
         return -1;
     }
     
-    hfp_msbc_init();
-    int num_samples = hfp_msbc_num_audio_samples_per_frame() * 2;
+    hfp_msbc_init(&msbc_state);
+    int num_samples = hfp_msbc_num_audio_samples_per_frame(&msbc_state) * 2;
 
     while (1){
-        if (hfp_msbc_can_encode_audio_frame_now()){
+        if (hfp_msbc_can_encode_audio_frame_now(&msbc_state)){
             int bytes_read = wav_reader_read_int16(num_samples, read_buffer);
             if (bytes_read < num_samples) break;
 
-            hfp_msbc_encode_audio_frame(read_buffer);
+            hfp_msbc_encode_audio_frame(&msbc_state, read_buffer);
         }
-        if (hfp_msbc_num_bytes_in_stream() >= sizeof(output_buffer)){
-            hfp_msbc_read_from_stream(output_buffer, sizeof(output_buffer));
+        if (hfp_msbc_num_bytes_in_stream(&msbc_state) >= sizeof(output_buffer)){
+            hfp_msbc_read_from_stream(&msbc_state, output_buffer, sizeof(output_buffer));
             fwrite(output_buffer, 1, sizeof(output_buffer), sbc_fd);
         } 
     }
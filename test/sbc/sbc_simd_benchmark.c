@@ -0,0 +1,213 @@
+// Measures single-threaded SBC encoder and decoder throughput in frames per second per core
+// for mSBC, 8-subband and 4-subband SBC, once for each SIMD level supported by the CPU.
+// Each measurement is repeated NUM_RUNS times and the fastest run is reported.
+// The encoded and decoded streams of each level are compared against the C implementation.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sbc_encoder.h"
+#include "oi_codec_sbc.h"
+
+#define NUM_INPUT_FRAMES 100
+#define NUM_RUNS         5
+#define MAX_FRAME_SIZE   512
+#define MAX_SAMPLES      (SBC_MAX_NUM_OF_BLOCKS * SBC_MAX_NUM_OF_SUBBANDS * SBC_MAX_NUM_OF_CHANNELS)
+
+typedef struct {
+    const char * name;
+    int msbc;
+    int sampling_frequency;
+    int sample_rate;
+    int channel_mode;
+    int num_channels;
+    int num_subbands;
+    int num_blocks;
+    int bitpool;
+    int num_frames;
+} config_t;
+
+static const config_t configs[] = {
+    { "mSBC, 16 kHz mono",                1, SBC_sf16000, 16000, SBC_MONO,         1, 8, 15, 26, 50000 },
+    { "SBC 8 subbands, 44.1 kHz joint",   0, SBC_sf44100, 44100, SBC_JOINT_STEREO, 2, 8, 16, 53, 20000 },
+    { "SBC 4 subbands, 48 kHz mono",      0, SBC_sf48000, 48000, SBC_MONO,         1, 4, 16, 31, 50000 },
+};
+
+static const struct {
+    UINT8 level;
+    const char * name;
+} levels[] = {
+    { SBC_SIMD_NONE, "C"    },
+    { SBC_SIMD_SSE2, "SSE2" },
+    { SBC_SIMD_AVX2, "AVX2" },
+    { SBC_SIMD_NEON, "NEON" },
+};
+
+static int16_t pcm[NUM_INPUT_FRAMES * MAX_SAMPLES];
+static uint8_t stream[NUM_INPUT_FRAMES * MAX_FRAME_SIZE];
+static uint32_t stream_len;
+static OI_UINT32 decoder_data[CODEC_DATA_WORDS(2, SBC_CODEC_FAST_FILTER_BUFFERS)];
+
+static uint64_t get_time_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint32_t hash_update(uint32_t hash, const uint8_t * data, int len){
+    int i;
+    for (i = 0; i < len; i++){
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// sawtooth plus pseudo-random noise
+static void init_pcm(void){
+    uint32_t seed = 1;
+    int i;
+    for (i = 0; i < NUM_INPUT_FRAMES * MAX_SAMPLES; i++){
+        seed = seed * 1103515245 + 12345;
+        pcm[i] = (int16_t) (((i % 73) * 16000 / 73) - 8000 + ((int16_t) (seed >> 16) >> 4));
+    }
+}
+
+// encodes num_frames frames, keeps the first NUM_INPUT_FRAMES in stream for the decoder
+static uint32_t encode(const config_t * config, uint64_t * duration){
+    static SBC_ENC_PARAMS params;
+    static uint8_t packet[MAX_FRAME_SIZE];
+    int samples_per_frame = config->num_blocks * config->num_subbands * config->num_channels;
+    uint32_t hash = 2166136261u;
+    uint64_t start;
+    int i;
+
+    memset(&params, 0, sizeof(params));
+    params.s16SamplingFreq     = config->sampling_frequency;
+    params.s16ChannelMode      = config->channel_mode;
+    params.s16NumOfChannels    = config->num_channels;
+    params.s16NumOfSubBands    = config->num_subbands;
+    params.s16NumOfBlocks      = config->num_blocks;
+    params.s16AllocationMethod = SBC_LOUDNESS;
+    params.s16BitPool          = config->bitpool;
+    params.mSBCEnabled         = config->msbc;
+    params.pu8Packet           = packet;
+    SBC_Encoder_Init(&params);
+
+    stream_len = 0;
+    start = get_time_ns();
+    for (i = 0; i < config->num_frames; i++){
+        params.ps16PcmBuffer = &pcm[(i % NUM_INPUT_FRAMES) * samples_per_frame];
+        SBC_Encoder(&params);
+        hash = hash_update(hash, params.pu8Packet, params.u16PacketLength);
+        if (i < NUM_INPUT_FRAMES){
+            memcpy(&stream[stream_len], params.pu8Packet, params.u16PacketLength);
+            stream_len += params.u16PacketLength;
+        }
+    }
+    *duration = get_time_ns() - start;
+    return hash;
+}
+
+// decodes the encoded frames repeatedly until num_frames frames have been decoded
+static uint32_t decode(const config_t * config, uint64_t * duration){
+    static OI_CODEC_SBC_DECODER_CONTEXT context;
+    static int16_t decoded[MAX_SAMPLES];
+    uint32_t hash = 2166136261u;
+    uint64_t start;
+    int frames = 0;
+
+    // the decoder does not clear the synthesis filter history on reset
+    memset(decoder_data, 0, sizeof(decoder_data));
+    if (config->msbc){
+        OI_CODEC_mSBC_DecoderReset(&context, decoder_data, sizeof(decoder_data));
+    } else {
+        OI_CODEC_SBC_DecoderReset(&context, decoder_data, sizeof(decoder_data), config->num_channels, config->num_channels, FALSE);
+    }
+
+    start = get_time_ns();
+    while (frames < config->num_frames){
+        const OI_BYTE * data = stream;
+        OI_UINT32 bytes_left = stream_len;
+        while (bytes_left > 0 && frames < config->num_frames){
+            OI_UINT32 pcm_bytes = sizeof(decoded);
+            OI_STATUS status = OI_CODEC_SBC_DecodeFrame(&context, &data, &bytes_left, decoded, &pcm_bytes);
+            if (status != OI_OK){
+                printf("decoding failed with status %d\n", status);
+                *duration = get_time_ns() - start;
+                return 0;
+            }
+            hash = hash_update(hash, (const uint8_t *) decoded, pcm_bytes);
+            frames++;
+        }
+    }
+    *duration = get_time_ns() - start;
+    return hash;
+}
+
+int main(int argc, const char * argv[]){
+    int errors = 0;
+    unsigned int c, l;
+
+    (void) argc;
+    (void) argv;
+    init_pcm();
+
+    for (c = 0; c < sizeof(configs) / sizeof(configs[0]); c++){
+        const config_t * config = &configs[c];
+        double frame_duration = (double) (config->num_blocks * config->num_subbands) / config->sample_rate;
+        double encoder_reference_rate = 0;
+        double decoder_reference_rate = 0;
+        uint32_t encoder_reference_hash = 0;
+        uint32_t decoder_reference_hash = 0;
+
+        printf("%s, %u frames\n", config->name, config->num_frames);
+        for (l = 0; l < sizeof(levels) / sizeof(levels[0]); l++){
+            uint64_t encoder_duration = UINT64_MAX;
+            uint64_t decoder_duration = UINT64_MAX;
+            uint32_t encoder_hash = 0;
+            uint32_t decoder_hash = 0;
+            double encoder_rate;
+            double decoder_rate;
+            int mismatch = 0;
+            int run;
+
+            // unsupported levels fall back to the best one
+            if (SBC_Encoder_SetSimdLevel(levels[l].level) != levels[l].level) continue;
+            if (OI_CODEC_SBC_SetSimdLevel(levels[l].level) != levels[l].level) continue;
+
+            for (run = 0; run < NUM_RUNS; run++){
+                uint64_t duration;
+                uint32_t hash = encode(config, &duration);
+                if (run > 0 && hash != encoder_hash) mismatch = 1;
+                if (duration < encoder_duration) encoder_duration = duration;
+                encoder_hash = hash;
+                hash = decode(config, &duration);
+                if (run > 0 && hash != decoder_hash) mismatch = 1;
+                if (duration < decoder_duration) decoder_duration = duration;
+                decoder_hash = hash;
+            }
+            encoder_rate = (double) config->num_frames * 1e9 / encoder_duration;
+            decoder_rate = (double) config->num_frames * 1e9 / decoder_duration;
+            if (levels[l].level == SBC_SIMD_NONE){
+                encoder_reference_hash = encoder_hash;
+                decoder_reference_hash = decoder_hash;
+                encoder_reference_rate = encoder_rate;
+                decoder_reference_rate = decoder_rate;
+            }
+            if (encoder_hash != encoder_reference_hash || decoder_hash != decoder_reference_hash || decoder_hash == 0){
+                mismatch = 1;
+            }
+            errors += mismatch;
+
+            printf("  %-4s encoder %9.0f frames/s, %6.0fx realtime, speedup %5.2f - decoder %9.0f frames/s, %6.0fx realtime, speedup %5.2f%s\n",
+                levels[l].name,
+                encoder_rate, encoder_rate * frame_duration, encoder_rate / encoder_reference_rate,
+                decoder_rate, decoder_rate * frame_duration, decoder_rate / decoder_reference_rate,
+                mismatch ? ", OUTPUT MISMATCH" : "");
+        }
+    }
+    return errors ? 1 : 0;
+}
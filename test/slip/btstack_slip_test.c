@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2016 BlueKitchen GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 4. Any redistribution, use, or modification is done solely for
+ *    personal benefit and not for any commercial purpose or for
+ *    monetary gain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BLUEKITCHEN GMBH AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MATTHIAS
+ * RINGWALD OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Please inquire about commercial licensing options at 
+ * contact@bluekitchen-gmbh.com
+ *
+ */
+
+#include "CppUTest/TestHarness.h"
+#include "CppUTest/CommandLineTestRunner.h"
+
+#include <stdlib.h>
+
+#include "btstack_slip.h"
+
+#define MAX_FRAME_SIZE 300
+
+static uint8_t decoder_buffer[MAX_FRAME_SIZE];
+static uint8_t frames[3][MAX_FRAME_SIZE];
+static int     frame_lens[3];
+static uint8_t stream[4 * MAX_FRAME_SIZE];
+static int     stream_len;
+
+static void slip_encode_frame(const uint8_t * data, uint16_t len){
+    stream[stream_len++] = BTSTACK_SLIP_SOF;
+    btstack_slip_encoder_start(data, len);
+    while (btstack_slip_encoder_has_data()){
+        stream[stream_len++] = btstack_slip_encoder_get_byte();
+    }
+    stream[stream_len++] = BTSTACK_SLIP_SOF;
+}
+
+// decode stream in chunks, check all frames are received
+static void check_decode_in_chunks(int max_chunk_size){
+    int frame_nr = 0;
+    int pos = 0;
+    btstack_slip_decoder_init(decoder_buffer, sizeof(decoder_buffer));
+    while (pos < stream_len){
+        int chunk_size = 1 + rand() % max_chunk_size;
+        if (chunk_size > stream_len - pos){
+            chunk_size = stream_len - pos;
+        }
+        int chunk_pos = 0;
+        while (chunk_pos < chunk_size){
+            chunk_pos += btstack_slip_decoder_process_block(&stream[pos + chunk_pos], chunk_size - chunk_pos);
+            uint16_t frame_size = btstack_slip_decoder_frame_size();
+            if (frame_size){
+                CHECK(frame_nr < 3);
+                CHECK_EQUAL(frame_lens[frame_nr], frame_size);
+                CHECK_EQUAL(0, memcmp(frames[frame_nr], decoder_buffer, frame_size));
+                frame_nr++;
+                btstack_slip_decoder_init(decoder_buffer, sizeof(decoder_buffer));
+            }
+        }
+        pos += chunk_size;
+    }
+    CHECK_EQUAL(3, frame_nr);
+}
+
+TEST_GROUP(SLIP){
+    void setup(void){
+        int i, j;
+        stream_len = 0;
+        // garbage before first frame
+        stream[stream_len++] = 0x12;
+        stream[stream_len++] = 0xdb;
+        for (i = 0; i < 3; i++){
+            frame_lens[i] = 50 + i * 100;
+            for (j = 0; j < frame_lens[i]; j++){
+                // include SOF and escape bytes
+                frames[i][j] = (j % 17 == 0) ? BTSTACK_SLIP_SOF : (j % 13 == 0) ? 0xdb : (uint8_t) (i * 100 + j);
+            }
+            slip_encode_frame(frames[i], frame_lens[i]);
+        }
+    }
+};
+
+TEST(SLIP, DecodeByteByByte){
+    check_decode_in_chunks(1);
+}
+
+TEST(SLIP, DecodeSmallChunks){
+    srand(1);
+    check_decode_in_chunks(7);
+}
+
+TEST(SLIP, DecodeLargeChunks){
+    srand(2);
+    check_decode_in_chunks(200);
+}
+
+TEST(SLIP, DecodeSingleBlock){
+    check_decode_in_chunks(sizeof(stream));
+}
+
+TEST(SLIP, FrameTooLong){
+    uint8_t small_buffer[10];
+    uint8_t data[20];
+    memset(data, 0x33, sizeof(data));
+    stream_len = 0;
+    slip_encode_frame(data, sizeof(data));
+    slip_encode_frame(data, 5);
+    btstack_slip_decoder_init(small_buffer, sizeof(small_buffer));
+    uint16_t pos = btstack_slip_decoder_process_block(stream, stream_len);
+    CHECK_EQUAL(5, btstack_slip_decoder_frame_size());
+    CHECK_EQUAL(stream_len, pos);
+}
+
+int main (int argc, const char * argv[]){
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
@@ -81,6 +81,11 @@ extern "C" {
  */
 void btstack_memory_init(void);
 
+/**
+ * @brief Log usage statistics of all memory pools (current use, high-water mark, failed gets) to size MAX_NR_* values.
+ */
+void btstack_memory_log_statistics(void);
+
 /* API_END */
 """
 
@@ -104,6 +109,7 @@ cfile_header_begin = """
 
 #include "btstack_memory.h"
 #include "btstack_memory_pool.h"
+#include "btstack_debug.h"
 
 #include <stdlib.h>
 
@@ -116,7 +122,7 @@ code_template = """
 // MARK: STRUCT_TYPE
 #if !defined(HAVE_MALLOC) && !defined(POOL_COUNT)
     #if defined(POOL_COUNT_OLD_NO)
-        #error "Deprecated POOL_COUNT_OLD_NO defined instead of POOL_COUNT. Please update your btstack_config.h to use POOL_COUNT."
+        #error "Deprecated POOL_COUNT_OLD_NO defined instead of POOL_COUNT. Please update your btstack_config.h to use POOL_COUNT"
     #else
         #define POOL_COUNT 0
     #endif
@@ -155,6 +161,11 @@ init_template = """#if POOL_COUNT > 0
     btstack_memory_pool_create(&STRUCT_NAME_pool, STRUCT_NAME_storage, POOL_COUNT, sizeof(STRUCT_TYPE));
 #endif"""
 
+statistics_template = """#if POOL_COUNT > 0
+    btstack_memory_pool_get_statistics(&STRUCT_NAME_pool, &statistics);
+    log_info("STRUCT_NAME: used %u, max %u of %u, failed gets %u", statistics.blocks_used, statistics.blocks_used_max, statistics.blocks_total, statistics.failed_gets);
+#endif"""
+
 def writeln(f, data):
     f.write(data + "\n")
 
@@ -169,7 +180,7 @@ def replacePlaceholder(template, struct_name):
     return snippet
     
 list_of_structs = [
-    ["hci_connection"],
+    ["hci_connection", "hci_acl_buffer", "hci_acl_reassembly_buffer"],
     ["l2cap_service", "l2cap_channel"],
     ["rfcomm_multiplexer", "rfcomm_service", "rfcomm_channel"],
     ["btstack_link_key_db_memory_entry"],
@@ -177,7 +188,7 @@ list_of_structs = [
     ["hfp_connection"],
     ["service_record_item"]
 ]
-list_of_le_structs = [["gatt_client", "whitelist_entry", "sm_lookup_entry"]]
+list_of_le_structs = [["gatt_client", "gatt_client_cache", "whitelist_entry", "sm_lookup_entry"]]
 
 file_name = "../src/btstack_memory"
 
@@ -226,5 +237,21 @@ for struct_names in list_of_le_structs:
         writeln(f, replacePlaceholder(init_template, struct_name))
 writeln(f, "#endif")
 writeln(f, "}")
+
+writeln(f, "")
+writeln(f, "// statistics")
+writeln(f, "void btstack_memory_log_statistics(void){")
+writeln(f, "    btstack_memory_pool_statistics_t statistics;")
+writeln(f, "    // silence compiler warning if no pools are configured")
+writeln(f, "    (void) statistics;")
+for struct_names in list_of_structs:
+    for struct_name in struct_names:
+        writeln(f, replacePlaceholder(statistics_template, struct_name))
+writeln(f, "#ifdef ENABLE_BLE")
+for struct_names in list_of_le_structs:
+    for struct_name in struct_names:
+        writeln(f, replacePlaceholder(statistics_template, struct_name))
+writeln(f, "#endif")
+writeln(f, "}")
 f.close();
     
@@ -88,6 +88,7 @@ defines_for_services = []
 
 handle = 1
 total_size = 0
+profile_bytes = []
 
 def read_defines(infile):
     defines = dict()
@@ -145,15 +146,18 @@ def parseProperties(properties):
             print("WARNING: property %s undefined" % (property))
     return value
 
+# all bytes of profile_data are emitted here and collected in profile_bytes for the index
 def write_8(fout, value):
+    profile_bytes.append(value & 0xff)
     fout.write( "0x%02x, " % (value & 0xff))
 
 def write_16(fout, value):
-    fout.write('0x%02x, 0x%02x, ' % (value & 0xff, (value >> 8) & 0xff))
+    write_8(fout, value)
+    write_8(fout, value >> 8)
 
-def write_uuid(uuid):
+def write_uuid(fout, uuid):
     for byte in uuid:
-        fout.write( "0x%02x, " % byte)
+        write_8(fout, byte)
 
 def write_string(fout, text):
     for l in text.lstrip('"').rstrip('"'):
@@ -162,7 +166,7 @@ def write_string(fout, text):
 def write_sequence(fout, text):
     parts = text.split()
     for part in parts:
-        fout.write("0x%s, " % (part.strip()))
+        write_8(fout, int(part.strip(), 16))
 
 def write_indent(fout):
     fout.write("    ")
@@ -211,7 +215,7 @@ def parseService(fout, parts, service_type):
     write_16(fout, property)
     write_16(fout, handle)
     write_16(fout, service_type)
-    write_uuid(uuid)
+    write_uuid(fout, uuid)
     fout.write("\n")
 
     current_service_uuid_string = c_string_for_uuid(parts[1])
@@ -252,7 +256,7 @@ def parseIncludeService(fout, parts):
     write_16(fout, services[keyUUID][0])
     write_16(fout, services[keyUUID][1])
     if uuid_size > 0:
-        write_uuid(uuid)
+        write_uuid(fout, uuid)
     fout.write("\n")
 
     handle = handle + 1
@@ -298,7 +302,7 @@ def parseCharacteristic(fout, parts):
     write_16(fout, 0x2803)
     write_8(fout, properties)
     write_16(fout, handle+1)
-    write_uuid(uuid)
+    write_uuid(fout, uuid)
     fout.write("\n")
     handle = handle + 1
     total_size = total_size + size
@@ -318,7 +322,7 @@ def parseCharacteristic(fout, parts):
     write_16(fout, size)
     write_16(fout, properties)
     write_16(fout, handle)
-    write_uuid(uuid)
+    write_uuid(fout, uuid)
     if is_string(value):
         write_string(fout, value)
     else:
@@ -431,9 +435,9 @@ def parseCharacteristicFormat(fout, parts):
     write_16(fout, 0x2904)
     write_sequence(fout, format)
     write_sequence(fout, exponent)
-    write_uuid(unit)
+    write_uuid(fout, unit)
     write_sequence(fout, name_space)
-    write_uuid(description)
+    write_uuid(fout, description)
     fout.write("\n")
     handle = handle + 1
 
@@ -667,6 +671,60 @@ def parse(fname_in, fin, fname_out, fout):
     
     fout.write("}; // total size %u bytes \n" % total_size);
 
+def uuid16ForAttribute(flags, uuid):
+    if not flags & property_flags['LONG_UUID']:
+        return uuid[0] | (uuid[1] << 8)
+    # UUID128 based on Bluetooth Base UUID 00000000-0000-1000-8000-00805F9B34FB
+    base_uuid = parseUUID128('00000000-0000-1000-8000-00805F9B34FB')
+    if uuid[0:12] != base_uuid[0:12] or uuid[14:16] != base_uuid[14:16]:
+        return 0
+    return uuid[12] | (uuid[13] << 8)
+
+def write_index_table(fout, comment, table):
+    write_indent(fout)
+    fout.write('// %s\n' % comment)
+    for entry in table:
+        write_indent(fout)
+        for value in entry:
+            fout.write('0x%04x, ' % value)
+        fout.write('\n')
+
+def writeIndex(fout):
+    attributes = []
+    services = []
+    uuid16s = []
+    offset = 0
+    while True:
+        size = profile_bytes[offset] | (profile_bytes[offset+1] << 8)
+        if size == 0:
+            break
+        flags  = profile_bytes[offset+2] | (profile_bytes[offset+3] << 8)
+        handle = profile_bytes[offset+4] | (profile_bytes[offset+5] << 8)
+        uuid16 = uuid16ForAttribute(flags, profile_bytes[offset+6:offset+22])
+        attributes.append([handle, offset])
+        if uuid16 in [0x2800, 0x2801]:
+            if len(services):
+                services[-1][1] = attributes[-2][0]
+            services.append([handle, 0])
+        if uuid16:
+            uuid16s.append([uuid16, handle])
+        offset += size
+    if len(services):
+        services[-1][1] = attributes[-1][0]
+    uuid16s.sort()
+
+    fout.write('\n\n')
+    fout.write('//\n')
+    fout.write('// index for att_set_db_index, requires ENABLE_ATT_DB_INDEX\n')
+    fout.write('//\n')
+    fout.write('const uint16_t profile_data_index[] =\n')
+    fout.write('{\n')
+    write_index_table(fout, 'number of attributes, services, UUID16 entries', [[len(attributes), len(services), len(uuid16s)]])
+    write_index_table(fout, 'attribute handle, offset in profile_data', attributes)
+    write_index_table(fout, 'service start handle, end handle', services)
+    write_index_table(fout, 'UUID16, attribute handle, sorted by UUID16', uuid16s)
+    fout.write('};\n')
+
 def listHandles(fout):
     fout.write('\n\n')
     fout.write('//\n')
@@ -696,6 +754,7 @@ try:
     fin  = codecs.open (sys.argv[1], encoding='utf-8')
     fout = open (filename, 'w')
     parse(sys.argv[1], fin, filename, fout)
+    writeIndex(fout)
     listHandles(fout)    
     fout.close()
     print('Created %s' % filename)
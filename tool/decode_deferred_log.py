@@ -0,0 +1,136 @@
+#!/usr/bin/env python
+# BlueKitchen GmbH (c) 2016
+
+# convert deferred log records (ENABLE_HCI_DUMP_DEFERRED_LOG) in a PacketLogger file
+# into regular log messages, can be viewed with Wireshark
+
+# APPLE PacketLogger
+# typedef struct {
+# 	uint32_t	len;
+# 	uint32_t	ts_sec;
+# 	uint32_t	ts_usec;
+# 	uint8_t		type;   // 0xfc for note
+# }
+#
+# deferred log record, type 0xf0, little endian
+# - format:  0x00, format id (16), format string
+# - message: 0x01, format id (16), arguments
+#   - int: 32 bit
+#   - long, long long, size_t, intmax_t, ptrdiff_t, pointer, double: 64 bit
+#   - string: 8 bit length, characters
+
+import os
+import re
+import struct
+import sys
+
+PKTLOG_HDR_SIZE = 13
+DEFERRED_LOG_PACKET = 0xf0
+DEFERRED_LOG_FORMAT = 0
+DEFERRED_LOG_MESSAGE = 1
+LOG_MESSAGE_PACKET = 0xfc
+
+conversion_pattern = re.compile(r'%([-+ #0]*)([0-9]*|\*)(\.(?:[0-9]*|\*))?(hh|h|ll|l|z|j|t)?([diuxXoceEfFgGps%])')
+
+formats = {}
+
+class ArgumentReader:
+	def __init__(self, data):
+		self.data = data
+		self.pos  = 0
+
+	def read(self, fmt):
+		size = struct.calcsize(fmt)
+		(value,) = struct.unpack_from(fmt, self.data, self.pos)
+		self.pos += size
+		return value
+
+	def read_string(self):
+		length = self.data[self.pos]
+		value = self.data[self.pos+1:self.pos+1+length].decode('utf-8', 'replace')
+		self.pos += 1 + length
+		return value
+
+# h and hh arguments are promoted to int, vsnprintf converts them back to short or char
+def narrow(value, length, signed):
+	bits = {'h': 16, 'hh': 8}.get(length)
+	if bits is None:
+		return value
+	value &= (1 << bits) - 1
+	if signed and value >= (1 << (bits - 1)):
+		value -= 1 << bits
+	return value
+
+def format_message(format, arguments):
+	reader = ArgumentReader(arguments)
+	def convert(match):
+		(flags, width, precision, length, conversion) = match.groups()
+		if conversion == '%':
+			return '%'
+		if width == '*':
+			width = str(reader.read('<i'))
+		if precision == '.*':
+			precision = '.' + str(reader.read('<i'))
+		spec = '%' + flags + width + (precision or '')
+		wide = length in ('l', 'll', 'z', 'j', 't')
+		if conversion in 'di':
+			return (spec + 'd') % narrow(reader.read('<q' if wide else '<i'), length, True)
+		if conversion == 'u':
+			return (spec + 'd') % narrow(reader.read('<Q' if wide else '<I'), length, False)
+		if conversion in 'xXo':
+			return (spec + conversion) % narrow(reader.read('<Q' if wide else '<I'), length, False)
+		if conversion == 'c':
+			return (spec + 'c') % chr(reader.read('<I') & 0xff)
+		if conversion == 'p':
+			return (spec + 's') % ('0x%x' % reader.read('<Q'))
+		if conversion == 's':
+			return (spec + 's') % reader.read_string()
+		return (spec + conversion) % reader.read('<d')
+	try:
+		return conversion_pattern.sub(convert, format)
+	except (struct.error, IndexError):
+		return format + ' (cannot decode arguments)'
+
+def write_packet(fout, ts_sec, ts_usec, type, data):
+	fout.write(struct.pack('>III', 9 + len(data), ts_sec, ts_usec))
+	fout.write(bytearray([type]))
+	fout.write(data)
+
+def decode_deferred_log(data):
+	record_type = data[0]
+	(format_id,) = struct.unpack_from('<H', data, 1)
+	if record_type == DEFERRED_LOG_FORMAT:
+		formats[format_id] = bytes(data[3:]).decode('utf-8', 'replace')
+		return None
+	if format_id not in formats:
+		return 'unknown format %u' % format_id
+	return format_message(formats[format_id], data[3:])
+
+if len(sys.argv) == 1:
+	print('BTstack deferred log decoder')
+	print('Copyright 2016, BlueKitchen GmbH')
+	print('')
+	print('Usage: ', sys.argv[0], 'hci_dump.pklg [decoded.pklg]')
+	print('Decoded file can be viewed with Wireshark and OS X PacketLogger')
+	exit(0)
+
+infile = sys.argv[1]
+outfile = os.path.splitext(infile)[0] + "_decoded.pklg"
+if len(sys.argv) > 2:
+	outfile = sys.argv[2]
+
+with open (outfile, 'wb') as fout:
+	with open (infile, 'rb') as fin:
+		while True:
+			header = fin.read(PKTLOG_HDR_SIZE)
+			if len(header) < PKTLOG_HDR_SIZE:
+				break
+			(length, ts_sec, ts_usec, type) = struct.unpack('>IIIB', header)
+			data = bytearray(fin.read(length - 9))
+			if type != DEFERRED_LOG_PACKET:
+				write_packet(fout, ts_sec, ts_usec, type, data)
+				continue
+			message = decode_deferred_log(data)
+			if message is None:
+				continue
+			write_packet(fout, ts_sec, ts_usec, LOG_MESSAGE_PACKET, message.encode('utf-8'))